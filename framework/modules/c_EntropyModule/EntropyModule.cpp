@@ -52,6 +52,7 @@
 #include <sstream>
 #include <math.h>
 #include <assert.h>
+#include <memory>
 
 // More complex modules will likely put functions and variables other than 
 // the module API functions in separate source files and/or may define various
@@ -67,14 +68,59 @@
 // Placing these functions in an anonymous namespace to give them static-linkage is one way to 
 // accomplish this.
 //
-// CAVEAT: Static data can be incompatible with multithreading, since each
-// thread will get its own copy of the data.
+// CAVEAT: Static data is shared by all of the threads that run the module,
+// so it must not be changed by the module execution functions without a lock.
 namespace
 {
     const char *MODULE_NAME = "tskEntropyModule";
     const char *MODULE_DESCRIPTION = "Performs an entropy calculation for the contents of a given file";
     const char *MODULE_VERSION = "1.0.0";
 
+    /**
+    * The number of times that each byte value was seen in the content of
+    * a file.
+    */
+    struct ByteCounts
+    {
+        ByteCounts() : totalBytes(0) { memset(counts, 0, sizeof(counts)); }
+
+        long counts[256];
+        long totalBytes;
+    };
+
+    /**
+    * Adds a piece of file content to the byte counts.
+    */
+    void countBytes(ByteCounts &byteCounts, const char *buffer, size_t length)
+    {
+        for (size_t i = 0; i < length; ++i)
+        {
+            byteCounts.counts[static_cast<uint8_t>(buffer[i])]++;
+        }
+        byteCounts.totalBytes += static_cast<long>(length);
+    }
+
+    /**
+    * Calculates the entropy of the content that was counted.
+    *
+    * @param byteCounts Byte counts of the content of a file.
+    * @return The entropy of the file.
+    */
+    double calculateEntropy(const ByteCounts &byteCounts)
+    {
+        double entropy = 0.0;
+        for (int i = 0; i<256; ++i)
+        {
+            double p = static_cast<double>(byteCounts.counts[i]) / static_cast<double>(byteCounts.totalBytes);
+            if (p > 0.0)
+            {
+                entropy -= p * (log(p) / log(2.0));
+            }
+        }
+
+        return entropy;
+    }
+
     /**
     * Calculates the entropy of a file.
     *
@@ -85,40 +131,20 @@ namespace
     {
         const uint32_t FILE_BUFFER_SIZE = 8193;
 
-        uint8_t byte = 0;
-        long byteCounts[256];
-        memset(byteCounts, 0, sizeof(long) * 256);
-        long totalBytes = 0;
+        ByteCounts byteCounts;
         char buffer[FILE_BUFFER_SIZE];
         ssize_t bytesRead = 0;
         do
         {
-            memset(buffer, 0, FILE_BUFFER_SIZE);
             bytesRead = pFile->read(buffer, FILE_BUFFER_SIZE);
             if (bytesRead > 0)
             {
-                for (int i = 0; i < bytesRead; ++i)
-                {
-                    byte = static_cast<uint8_t>(buffer[i]);
-                    byteCounts[byte]++;
-                }
-
-                totalBytes += bytesRead;
+                countBytes(byteCounts, buffer, static_cast<size_t>(bytesRead));
             }
         } 
         while (bytesRead > 0);
 
-        double entropy = 0.0;
-        for (int i = 0; i<256; ++i)
-        {
-            double p = static_cast<double>(byteCounts[i]) / static_cast<double>(totalBytes);
-            if (p > 0.0)
-            {
-                entropy -= p * (log(p) / log(2.0));
-            }
-        }
-
-        return entropy;
+        return calculateEntropy(byteCounts);
     }
 }
 
@@ -316,6 +342,80 @@ extern "C"
         }
     }
 
+    /**
+    * Streaming interface for file analysis modules.  When a module exports
+    * beginStream(), streamChunk() and endStream(), the pipeline calls them
+    * instead of run(): it reads the content of each file once and passes
+    * each chunk to all of the streaming modules that are next to each other
+    * in the pipeline, so modules that read the whole file do not each read
+    * it again.
+    *
+    * CAVEAT: These functions are intended to be called by TSK Framework only.
+    *
+    * @param pFile A pointer to the file whose content is going to be streamed.
+    * @param context Set to the byte counts for the file.
+    * @returns TskModule::OK on success, TskModule::FAIL on error.
+    */
+    TskModule::Status TSK_MODULE_EXPORT beginStream(TskFile *pFile, void **context)
+    {
+        *context = NULL;
+        if (pFile == NULL) 
+        {
+            LOGERROR(std::string(MODULE_NAME) + "::beginStream : passed NULL TskFile pointer");
+            return TskModule::FAIL;
+        }
+
+        *context = new ByteCounts;
+        return TskModule::OK;
+    }
+
+    /**
+    * Adds a chunk of file content to the byte counts.
+    *
+    * @param context Byte counts set by beginStream().
+    * @param buffer File content.
+    * @param length Number of bytes in buffer.
+    * @returns TskModule::OK
+    */
+    TskModule::Status TSK_MODULE_EXPORT streamChunk(void *context, const char *buffer, size_t length)
+    {
+        countBytes(*static_cast<ByteCounts *>(context), buffer, length);
+        return TskModule::OK;
+    }
+
+    /**
+    * Posts the entropy of the streamed content if all of it was received
+    * and frees the byte counts.
+    *
+    * @param pFile A pointer to the file whose content was streamed.
+    * @param context Byte counts set by beginStream().
+    * @param complete True if the whole file was streamed.
+    * @returns TskModule::OK on success, TskModule::FAIL on error or if the
+    * content is incomplete.
+    */
+    TskModule::Status TSK_MODULE_EXPORT endStream(TskFile *pFile, void *context, bool complete)
+    {
+        std::auto_ptr<ByteCounts> byteCounts(static_cast<ByteCounts *>(context));
+
+        // The entropy of part of a file must not be posted.  The pipeline has
+        // logged why the content is incomplete.
+        if (!complete)
+            return TskModule::FAIL;
+
+        try
+        {
+            pFile->addGenInfoAttribute(TskBlackboardAttribute(TSK_ENTROPY, MODULE_NAME, "", calculateEntropy(*byteCounts)));
+        }
+        catch (std::exception &ex)
+        {
+            std::ostringstream msg;
+            msg << MODULE_NAME << "::endStream : std::exception: " << ex.what();
+            LOGERROR(msg.str());
+            return TskModule::FAIL;
+        }
+        return TskModule::OK;
+    }
+
     //  /**
     //   * Module execution function for post-processing modules. 
     //   *
@@ -19,6 +19,7 @@
 #include <sstream>
 #include <stdlib.h>
 #include <string.h>
+#include <memory>
 
 // Framework includes
 #include "tsk/framework/utilities/TskModuleDev.h"
@@ -27,6 +28,7 @@
 #include "Poco/UnicodeConverter.h"
 #include "Poco/File.h"
 #include "Poco/Path.h"
+#include "Poco/Mutex.h"
 
 // Magic includes
 #include "magic.h"
@@ -40,6 +42,51 @@ namespace
   static const uint32_t FILE_BUFFER_SIZE = 1024;
 
   static magic_t magicHandle = NULL;
+
+  // The module is shared by the threads of a worker pool and a magic
+  // handle can not be used by several threads at once.
+  static Poco::FastMutex magicLock;
+
+  // The beginning of a file that is being streamed.
+  struct SigContext
+  {
+      SigContext() : length(0) {}
+
+      char buffer[FILE_BUFFER_SIZE];
+      size_t length;
+  };
+
+  /**
+   * Determines the type of a file from the beginning of its content and
+   * posts it to the blackboard.
+   * @param pFile The file.
+   * @param buffer Up to FILE_BUFFER_SIZE bytes from the start of the file.
+   * @param length Number of bytes in buffer.
+   * @returns TskModule::OK on success and TskModule::FAIL on error.
+   */
+  TskModule::Status postFileType(TskFile * pFile, const char * buffer, size_t length)
+  {
+      // clean up type -- we've seen invalid UTF-8 data being returned
+      char cleanType[1024];
+      {
+          Poco::FastMutex::ScopedLock lock(magicLock);
+          const char *type = magic_buffer(magicHandle, buffer, length);
+          if (type == NULL) {
+              std::stringstream msg;
+              msg << "FileTypeSigModule: Error getting file type: " << magic_error(magicHandle);
+              LOGERROR(msg.str());
+              return TskModule::FAIL;
+          }
+          cleanType[1023] = '\0';
+          strncpy(cleanType, type, 1023);
+      }
+      TskUtilities::cleanUTF8(cleanType);
+
+      // Add to blackboard
+      TskBlackboardAttribute attr(TSK_FILE_TYPE_SIG, MODULE_NAME, "", cleanType);
+      pFile->addGenInfoAttribute(attr);
+      return TskModule::OK;
+  }
 }
 
 extern "C" 
@@ -157,23 +204,7 @@ extern "C"
                 return TskModule::FAIL;
             }
 
-            const char *type = magic_buffer(magicHandle, buffer, readLen);
-            if (type == NULL) {
-                std::stringstream msg;
-                msg << "FileTypeSigModule: Error getting file type: " << magic_error(magicHandle);
-                LOGERROR(msg.str());
-                return TskModule::FAIL;
-            }
-
-            // clean up type -- we've seen invalid UTF-8 data being returned
-            char cleanType[1024];
-            cleanType[1023] = '\0';
-            strncpy(cleanType, type, 1023);
-            TskUtilities::cleanUTF8(cleanType);
-
-            // Add to blackboard
-            TskBlackboardAttribute attr(TSK_FILE_TYPE_SIG, MODULE_NAME, "", cleanType);
-            pFile->addGenInfoAttribute(attr);
+            return postFileType(pFile, buffer, readLen);
         }
         catch (TskException& tskEx)
         {
@@ -193,10 +224,100 @@ extern "C"
         return TskModule::OK;
     }
 
+    /**
+     * Streaming version of run(). The pipeline reads the content of the
+     * file once for this module and the streaming modules next to it and
+     * passes it in chunks. Only the first FILE_BUFFER_SIZE bytes are kept.
+     * @param pFile A pointer to the file whose content is going to be streamed.
+     * @param context Set to the state of the stream, or NULL for an empty file.
+     * @returns TskModule::OK on success and TskModule::FAIL on error.
+     */
+    TskModule::Status TSK_MODULE_EXPORT beginStream(TskFile * pFile, void ** context)
+    {
+        *context = NULL;
+        if (pFile == NULL)
+        {
+            LOGERROR("FileTypeSigModule: Passed NULL file pointer.");
+            return TskModule::FAIL;
+        }
+
+        if (pFile->getSize() > 0)
+            *context = new SigContext;
+        return TskModule::OK;
+    }
+
+    /**
+     * Keeps the beginning of the content.
+     * @param context State set by beginStream().
+     * @param buffer File content.
+     * @param length Number of bytes in buffer.
+     * @returns TskModule::OK
+     */
+    TskModule::Status TSK_MODULE_EXPORT streamChunk(void * context, const char * buffer, size_t length)
+    {
+        SigContext *ctx = static_cast<SigContext *>(context);
+        if (ctx == NULL || ctx->length == FILE_BUFFER_SIZE)
+            return TskModule::OK;
+
+        size_t copyLen = FILE_BUFFER_SIZE - ctx->length;
+        if (copyLen > length)
+            copyLen = length;
+        memcpy(ctx->buffer + ctx->length, buffer, copyLen);
+        ctx->length += copyLen;
+        return TskModule::OK;
+    }
+
+    /**
+     * Determines the file type from the content that was kept and frees
+     * the state of the stream.
+     * @param pFile A pointer to the file whose content was streamed.
+     * @param context State set by beginStream().
+     * @param complete True if the whole file was streamed.
+     * @returns TskModule::OK on success and TskModule::FAIL on error.
+     */
+    TskModule::Status TSK_MODULE_EXPORT endStream(TskFile * pFile, void * context, bool complete)
+    {
+        std::auto_ptr<SigContext> ctx(static_cast<SigContext *>(context));
+        if (ctx.get() == NULL)
+            return TskModule::OK;
+
+        // The type only depends on the beginning of the file, so a stream
+        // that stopped after it is still good.
+        if (!complete && ctx->length < FILE_BUFFER_SIZE && (TSK_OFF_T) ctx->length < pFile->getSize())
+            return TskModule::FAIL;
+
+        if (ctx->length == 0) {
+            std::stringstream msg;
+            msg << "FileTypeSigModule: Error reading file contents for file " << pFile->getId();
+            LOGERROR(msg.str());
+            return TskModule::FAIL;
+        }
+
+        try
+        {
+            return postFileType(pFile, ctx->buffer, ctx->length);
+        }
+        catch (TskException& tskEx)
+        {
+            std::stringstream msg;
+            msg << "FileTypeModule: Caught framework exception: " << tskEx.message();
+            LOGERROR(msg.str());
+            return TskModule::FAIL;
+        }
+        catch (std::exception& ex)
+        {
+            std::stringstream msg;
+            msg << "FileTypeModule: Caught exception: " << ex.what();
+            LOGERROR(msg.str());
+            return TskModule::FAIL;
+        }
+    }
+
     TskModule::Status TSK_MODULE_EXPORT finalize()
     {
         if (magicHandle != NULL) {
             magic_close(magicHandle);
+            magicHandle = NULL;
         }
         return TskModule::OK;
     }
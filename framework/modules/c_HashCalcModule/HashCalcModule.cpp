@@ -16,6 +16,7 @@
 #include <string>
 #include <sstream>
 #include <string.h>
+#include <memory>
 
 // Framework includes
 #include "tsk/framework/utilities/TskModuleDev.h"
@@ -29,6 +30,60 @@ static bool calculateSHA1 = false;
 
 static const char hexMap[] = "0123456789abcdef";
 
+/// Hash state for one file.
+struct HashContext
+{
+    TSK_MD5_CTX md5Ctx;
+    TSK_SHA_CTX sha1Ctx;
+};
+
+static void initHashes(HashContext &ctx)
+{
+    if (calculateMD5)
+        TSK_MD5_Init(&ctx.md5Ctx);
+
+    if (calculateSHA1)
+        TSK_SHA_Init(&ctx.sha1Ctx);
+}
+
+static void updateHashes(HashContext &ctx, const char *buffer, size_t length)
+{
+    if (calculateMD5)
+        TSK_MD5_Update(&ctx.md5Ctx, (unsigned char *) buffer, (unsigned int) length);
+
+    if (calculateSHA1)
+        TSK_SHA_Update(&ctx.sha1Ctx, (unsigned char *) buffer, (unsigned int) length);
+}
+
+static void postHashes(HashContext &ctx, TskFile *pFile)
+{
+    if (calculateMD5) {
+        unsigned char md5Hash[16];
+        TSK_MD5_Final(md5Hash, &ctx.md5Ctx);
+
+        char md5TextBuff[33];            
+        for (int i = 0; i < 16; i++) {
+            md5TextBuff[2 * i] = hexMap[(md5Hash[i] >> 4) & 0xf];
+            md5TextBuff[2 * i + 1] = hexMap[md5Hash[i] & 0xf];
+        }
+        md5TextBuff[32] = '\0';
+        pFile->setHash(TskImgDB::MD5, md5TextBuff);
+    }
+
+    if (calculateSHA1) {
+        unsigned char sha1Hash[20];
+        TSK_SHA_Final(sha1Hash, &ctx.sha1Ctx);
+
+        char textBuff[41];            
+        for (int i = 0; i < 20; i++) {
+            textBuff[2 * i] = hexMap[(sha1Hash[i] >> 4) & 0xf];
+            textBuff[2 * i + 1] = hexMap[sha1Hash[i] & 0xf];
+        }
+        textBuff[40] = '\0';
+        pFile->setHash(TskImgDB::SHA1, textBuff);
+    }
+}
+
 extern "C" 
 {
     /**
@@ -137,14 +192,8 @@ extern "C"
 
         try 
         {
-            TSK_MD5_CTX md5Ctx;
-            TSK_SHA_CTX sha1Ctx;
-
-            if (calculateMD5)
-                TSK_MD5_Init(&md5Ctx);
-
-            if (calculateSHA1)
-                TSK_SHA_Init(&sha1Ctx);
+            HashContext ctx;
+            initHashes(ctx);
 
             // file buffer
             static const uint32_t FILE_BUFFER_SIZE = 32768;
@@ -152,45 +201,15 @@ extern "C"
 
             ssize_t bytesRead = 0;
 
-            // Read file content into buffer and write it to the DigestOutputStream.
+            // Read file content into buffer and add it to the hashes.
             do 
             {
                 bytesRead = pFile->read(buffer, FILE_BUFFER_SIZE);
-                if (bytesRead > 0) {
-                    if (calculateMD5)
-                        TSK_MD5_Update(&md5Ctx, (unsigned char *) buffer, (unsigned int) bytesRead);
-
-                    if (calculateSHA1)
-                        TSK_SHA_Update(&sha1Ctx, (unsigned char *) buffer, (unsigned int) bytesRead);                  
-                }
+                if (bytesRead > 0)
+                    updateHashes(ctx, buffer, (size_t)bytesRead);
             } while (bytesRead > 0);
 
-            if (calculateMD5) {
-                unsigned char md5Hash[16];
-                TSK_MD5_Final(md5Hash, &md5Ctx);
-
-                char md5TextBuff[33];            
-                for (int i = 0; i < 16; i++) {
-                    md5TextBuff[2 * i] = hexMap[(md5Hash[i] >> 4) & 0xf];
-                    md5TextBuff[2 * i + 1] = hexMap[md5Hash[i] & 0xf];
-                }
-                md5TextBuff[32] = '\0';
-                pFile->setHash(TskImgDB::MD5, md5TextBuff);
-            }
-
-            if (calculateSHA1) {
-                unsigned char sha1Hash[20];
-                TSK_SHA_Final(sha1Hash, &sha1Ctx);
-
-                char textBuff[41];            
-                for (int i = 0; i < 20; i++) {
-                    textBuff[2 * i] = hexMap[(sha1Hash[i] >> 4) & 0xf];
-                    textBuff[2 * i + 1] = hexMap[sha1Hash[i] & 0xf];
-                }
-                textBuff[40] = '\0';
-                pFile->setHash(TskImgDB::SHA1, textBuff);
-            }
-
+            postHashes(ctx, pFile);
         }
         catch (TskException& tskEx)
         {
@@ -210,6 +229,85 @@ extern "C"
         return TskModule::OK;
     }
 
+    /**
+     * Streaming interface. When present, the pipeline reads the file once and
+     * passes its content to this and any other streaming modules instead of
+     * calling run().
+     *
+     * @param pFile File whose content is going to be streamed.
+     * @param context Set to the hash state for the file.
+     * @returns TskModule::OK on success, TskModule::FAIL on error.
+     */
+    TskModule::Status TSK_MODULE_EXPORT beginStream(TskFile * pFile, void ** context)
+    {
+        *context = NULL;
+        if (pFile == NULL) 
+        {
+            LOGERROR("HashCalcModule: passed NULL file pointer.");
+            return TskModule::FAIL;
+        }
+
+        // We will not attempt to calculate hash values for "unused sector"
+        // files.
+        if (pFile->getTypeId() == TskImgDB::IMGDB_FILES_TYPE_UNUSED)
+            return TskModule::OK;
+
+        HashContext *ctx = new HashContext;
+        initHashes(*ctx);
+        *context = ctx;
+        return TskModule::OK;
+    }
+
+    /**
+     * Adds a chunk of file content to the hashes.
+     *
+     * @param context Hash state set by beginStream().
+     * @param buffer File content.
+     * @param length Number of bytes in buffer.
+     * @returns TskModule::OK
+     */
+    TskModule::Status TSK_MODULE_EXPORT streamChunk(void * context, const char * buffer, size_t length)
+    {
+        if (context != NULL)
+            updateHashes(*static_cast<HashContext *>(context), buffer, length);
+        return TskModule::OK;
+    }
+
+    /**
+     * Posts the hashes of the streamed content if all of it was received and
+     * frees the hash state.
+     *
+     * @param pFile File whose content was streamed.
+     * @param context Hash state set by beginStream().
+     * @param complete True if the whole file was streamed.
+     * @returns TskModule::OK on success, TskModule::FAIL on error or if the
+     * content is incomplete.
+     */
+    TskModule::Status TSK_MODULE_EXPORT endStream(TskFile * pFile, void * context, bool complete)
+    {
+        std::auto_ptr<HashContext> ctx(static_cast<HashContext *>(context));
+        if (ctx.get() == NULL)
+            return TskModule::OK;
+
+        // A partial hash must not be posted or reported as a success.  The
+        // pipeline has logged why the content is incomplete.
+        if (!complete)
+            return TskModule::FAIL;
+
+        try
+        {
+            postHashes(*ctx, pFile);
+        }
+        catch (std::exception& ex)
+        {
+            std::stringstream msg;
+            msg << "HashCalcModule - Error processing file id " << pFile->getId() << ": " << ex.what();
+            LOGERROR(msg.str());
+            return TskModule::FAIL;
+        }
+        return TskModule::OK;
+    }
+
     /**
      * Module cleanup function. This module does not need to free any 
      * resources allocated during initialization or execution.
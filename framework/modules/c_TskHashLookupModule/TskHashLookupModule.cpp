@@ -255,9 +255,11 @@ extern "C"
     {
         if (knownHashDBInfo != NULL)
             tsk_hdb_close(knownHashDBInfo); // Closes the index file and frees the memory for the TSK_HDB_INFO struct. 
+        knownHashDBInfo = NULL;
 
         for (std::vector<TSK_HDB_INFO*>::iterator it = knownBadHashDBInfos.begin(); it < knownBadHashDBInfos.end(); ++it)
             tsk_hdb_close(*it); // Closes the index file and frees the memory for the TSK_HDB_INFO struct.
+        knownBadHashDBInfos.clear();
 
         return TskModule::OK;
     }
@@ -0,0 +1,384 @@
+/*
+ * The Sleuth Kit
+ *
+ * Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+ * Copyright (c) 2016 Basis Technology Corporation. All Rights
+ * reserved.
+ *
+ * This software is distributed under the Common Public License 1.0
+ */
+
+/**
+ * \file executable_module_test.cpp
+ * Tests the worker protocol of persistent TskExecutableModule modules.
+ * The program is its own worker: when it is run with "worker <mode>" it
+ * answers the requests on its standard input.  In "normal" mode it
+ * replies with the number of bytes it received for each file, in "exit"
+ * mode it exits as soon as it gets a file and in "hang" mode it does not
+ * exit when its standard input is closed.
+ *
+ * The output files are written to the current directory and are removed
+ * when the test passes.
+ */
+
+// System includes
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef TSK_WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <signal.h>
+#include <errno.h>
+#endif
+
+// Framework includes
+#include "tsk/framework/pipeline/TskExecutableModule.h"
+#include "tsk/framework/file/TskFile.h"
+
+// Poco includes
+#include "Poco/Path.h"
+#include "Poco/File.h"
+#include "Poco/Process.h"
+#include "Poco/Thread.h"
+#include "Poco/Stopwatch.h"
+
+namespace
+{
+    const char *NORMAL_OUTPUT = "executable_module_test.out";
+    const char *HANG_OUTPUT = "executable_module_test.hang";
+
+    /**
+     * A file whose content is held in memory.  It is not in the image
+     * database.
+     */
+    class TestFile : public TskFile
+    {
+    public:
+        TestFile(uint64_t id, const std::string &path, const std::string &content) :
+            m_content(content)
+        {
+            m_id = id;
+            m_fileRecord.fileId = id;
+            m_fileRecord.fullPath = path;
+            m_fileRecord.size = (TSK_OFF_T)content.size();
+        }
+
+        virtual std::string getPath() const { return m_fileRecord.fullPath; }
+        virtual bool exists() const { return false; }
+        virtual bool isDirectory() const { return false; }
+        virtual bool isVirtual() const { return true; }
+        virtual void open() { m_isOpen = true; }
+        virtual void close() { m_isOpen = false; }
+        virtual TSK_OFF_T tell() const { return m_offset; }
+
+        virtual TSK_OFF_T seek(const TSK_OFF_T off, std::ios::seekdir origin = std::ios::beg)
+        {
+            m_offset = off;
+            return m_offset;
+        }
+
+        virtual ssize_t read(char *buf, const size_t count)
+        {
+            size_t len = 0;
+            if (m_offset < (TSK_OFF_T)m_content.size())
+                len = m_content.copy(buf, count, (size_t)m_offset);
+            m_offset += len;
+            m_bytesRead += len;
+            return (ssize_t)len;
+        }
+
+    private:
+        std::string m_content;
+    };
+
+    /**
+     * Answer the requests on standard input until it is closed.
+     * @param mode "normal", "exit" or "hang"
+     */
+    int runWorker(const std::string &mode)
+    {
+#ifdef TSK_WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+        std::string line;
+        uint64_t fileId = 0;
+        size_t received = 0;
+        std::vector<char> data;
+
+        while (std::getline(std::cin, line))
+        {
+            std::istringstream request(line);
+            std::string command;
+            request >> command;
+
+            if (command == "FILE")
+            {
+                if (mode == "exit")
+                    return 0;
+
+                TSK_OFF_T size;
+                size_t pathLength;
+                request >> fileId >> size >> pathLength;
+                data.resize(pathLength + 1);
+                std::cin.read(&data[0], pathLength);
+                received = 0;
+            }
+            else if (command == "DATA")
+            {
+                size_t length;
+                request >> length;
+                data.resize(length + 1);
+                std::cin.read(&data[0], length);
+                received += (size_t)std::cin.gcount();
+            }
+            else if (command == "EOF")
+            {
+                std::cout << "OUT " << Poco::Process::id() << " " << fileId << " " << received << "\n"
+                    << "LOG received file " << fileId << "\n"
+                    << "END OK" << std::endl;
+            }
+            else if (command == "ABORT")
+            {
+                std::cout << "END FAIL" << std::endl;
+            }
+            else if (command == "REPORT")
+            {
+                std::cout << "OUT report\nEND OK" << std::endl;
+            }
+            else
+            {
+                std::cout << "ERROR unknown request: " << line << "\nEND FAIL" << std::endl;
+            }
+        }
+
+        if (mode == "hang")
+        {
+            for (;;)
+                Poco::Thread::sleep(1000);
+        }
+        return 0;
+    }
+
+    std::string makeContent(size_t length)
+    {
+        std::string content;
+        for (size_t i = 0; i < length; i++)
+            content += (char)(i * 7 + i / 251);
+        return content;
+    }
+
+    /**
+     * Stream a file to a module in chunks of the given size, as the file
+     * analysis pipeline does.
+     * @param complete false to stop after the first chunk
+     */
+    TskModule::Status streamFile(TskModule &module, TskFile &file, size_t chunkSize, bool complete)
+    {
+        void *context = NULL;
+        TskModule::Status status = module.beginStream(&file, &context);
+        if (status != TskModule::OK)
+            return status;
+
+        std::vector<char> buffer(chunkSize);
+        ssize_t bytesRead;
+        bool sent = true;
+        while (sent && (bytesRead = file.read(&buffer[0], buffer.size())) > 0)
+        {
+            sent = (module.streamChunk(context, &buffer[0], (size_t)bytesRead) == TskModule::OK);
+            if (!complete)
+                break;
+        }
+        return module.endStream(&file, context, sent && complete);
+    }
+
+    bool checkStatus(TskModule::Status status, TskModule::Status expected, const char *desc)
+    {
+        if (status == expected)
+            return true;
+        std::cerr << desc << ": status is " << status << ", expected " << expected << std::endl;
+        return false;
+    }
+
+    void removeFile(const std::string &path)
+    {
+        Poco::File file(path);
+        if (file.exists())
+            file.remove();
+    }
+
+    std::vector<std::string> readLines(const std::string &path)
+    {
+        std::vector<std::string> lines;
+        std::ifstream in(path.c_str());
+        std::string line;
+        while (std::getline(in, line))
+            lines.push_back(line);
+        return lines;
+    }
+
+    /**
+     * A worker that answers each file and exits when its standard input is
+     * closed.  It is started once for all of the files.
+     */
+    bool testNormal(const std::string &program)
+    {
+        std::string output = Poco::Path::current() + NORMAL_OUTPUT;
+        removeFile(output);
+
+        Poco::Stopwatch stopWatch;
+        {
+            TskExecutableModule module;
+            module.setPath(program);
+            module.setArguments("worker normal");
+            module.setOutput(output);
+            module.setPersistent(true);
+
+            TestFile file1(1, "/dir/file one\nwith a newline", makeContent(100000));
+            TestFile file2(2, "/dir/file2", makeContent(10));
+            TestFile file3(3, "/dir/file3", makeContent(5000));
+            if (!checkStatus(streamFile(module, file1, 30000, true), TskModule::OK, "Normal, file 1")
+                || !checkStatus(streamFile(module, file2, 30000, true), TskModule::OK, "Normal, file 2")
+                || !checkStatus(streamFile(module, file3, 1000, false), TskModule::FAIL, "Normal, aborted file")
+                || !checkStatus(module.report(), TskModule::OK, "Normal, report"))
+                return false;
+
+            stopWatch.start();
+        }
+        stopWatch.stop();
+
+        // The worker exits by itself and must not be left to be killed.
+        if (stopWatch.elapsedSeconds() > 5)
+        {
+            std::cerr << "Normal: stopping the worker took " << stopWatch.elapsedSeconds()
+                << " seconds" << std::endl;
+            return false;
+        }
+
+        std::vector<std::string> lines = readLines(output);
+        if (lines.size() != 3)
+        {
+            std::cerr << "Normal: " << lines.size() << " output lines, expected 3" << std::endl;
+            return false;
+        }
+
+        // Each line has the worker's process id, the file id and the number
+        // of bytes that the worker received.
+        int pid1 = 0, pid2 = 0;
+        uint64_t id1 = 0, id2 = 0;
+        size_t size1 = 0, size2 = 0;
+        std::istringstream(lines[0]) >> pid1 >> id1 >> size1;
+        std::istringstream(lines[1]) >> pid2 >> id2 >> size2;
+        if (pid1 != pid2)
+        {
+            std::cerr << "Normal: the files went to different workers" << std::endl;
+            return false;
+        }
+        if (id1 != 1 || size1 != 100000 || id2 != 2 || size2 != 10 || lines[2] != "report")
+        {
+            std::cerr << "Normal: wrong output: " << lines[0] << " / " << lines[1]
+                << " / " << lines[2] << std::endl;
+            return false;
+        }
+
+        removeFile(output);
+        return true;
+    }
+
+    /**
+     * A worker that exits without replying.  Each file fails and a new
+     * worker is started for the next one.
+     */
+    bool testExit(const std::string &program)
+    {
+        TskExecutableModule module;
+        module.setPath(program);
+        module.setArguments("worker exit");
+        module.setPersistent(true);
+
+        TestFile file1(1, "/dir/file1", makeContent(200000));
+        TestFile file2(2, "/dir/file2", makeContent(10));
+        return checkStatus(streamFile(module, file1, 1000, true), TskModule::FAIL, "Exit, file 1")
+            && checkStatus(streamFile(module, file2, 1000, true), TskModule::FAIL, "Exit, file 2");
+    }
+
+    /**
+     * A worker that does not exit when its standard input is closed.  It
+     * is killed when the module is destroyed.
+     */
+    bool testHang(const std::string &program)
+    {
+        std::string output = Poco::Path::current() + HANG_OUTPUT;
+        removeFile(output);
+
+        Poco::Stopwatch stopWatch;
+        {
+            TskExecutableModule module;
+            module.setPath(program);
+            module.setArguments("worker hang");
+            module.setOutput(output);
+            module.setPersistent(true);
+
+            TestFile file(1, "/dir/file1", makeContent(1000));
+            if (!checkStatus(streamFile(module, file, 1000, true), TskModule::OK, "Hang, file 1"))
+                return false;
+
+            stopWatch.start();
+        }
+        stopWatch.stop();
+
+        // The worker is killed after TskExecutableModule has waited for
+        // it for ten seconds.
+        if (stopWatch.elapsedSeconds() > 60)
+        {
+            std::cerr << "Hang: stopping the worker took " << stopWatch.elapsedSeconds()
+                << " seconds" << std::endl;
+            return false;
+        }
+
+        std::vector<std::string> lines = readLines(output);
+        if (lines.size() != 1)
+        {
+            std::cerr << "Hang: " << lines.size() << " output lines, expected 1" << std::endl;
+            return false;
+        }
+
+#ifndef TSK_WIN32
+        int pid = atoi(lines[0].c_str());
+        if (pid <= 0 || kill(pid, 0) == 0 || errno != ESRCH)
+        {
+            std::cerr << "Hang: worker process " << pid << " is still running" << std::endl;
+            return false;
+        }
+#endif
+
+        removeFile(output);
+        return true;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc == 3 && strcmp(argv[1], "worker") == 0)
+        return runWorker(argv[2]);
+
+    try
+    {
+        std::string program = Poco::Path(argv[0]).absolute().toString();
+        if (!testNormal(program) || !testExit(program) || !testHang(program))
+            return EXIT_FAILURE;
+    }
+    catch (std::exception &ex)
+    {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
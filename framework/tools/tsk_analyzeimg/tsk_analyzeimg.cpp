@@ -15,16 +15,19 @@
 #include <sstream>
 #include <time.h>
 #include <memory>
+#include <fstream>
 
 #include "tsk/tsk_tools_i.h" // Needed for tsk_getopt
 #include "tsk/framework/framework.h"
-#include "tsk/framework/services/TskSchedulerQueue.h"
+#include "tsk/framework/services/TskPriorityScheduler.h"
 #include "tsk/framework/services/TskSystemPropertiesImpl.h"
 #include "tsk/framework/services/TskImgDBSqlite.h"
 #include "tsk/framework/file/TskFileManagerImpl.h"
 #include "tsk/framework/extraction/TskCarvePrepSectorConcat.h"
+#include "tsk/framework/extraction/TskCarvePrepSectorMap.h"
 #include "tsk/framework/extraction/TskCarveExtractScalpel.h"
 #include "tsk/framework/extraction/TskExtract.h"
+#include "tsk/framework/pipeline/TskWorkerPool.h"
 
 #include "Poco/Path.h"
 #include "Poco/File.h"
@@ -37,6 +40,9 @@
 
 #include "Poco/File.h"
 #include "Poco/UnicodeConverter.h"
+#include "Poco/NumberParser.h"
+#include "Poco/Environment.h"
+#include "Poco/String.h"
 
 static uint8_t 
 makeDir(const char *dir) 
@@ -79,6 +85,33 @@ class StderrLog : public Log
     }
 };
 
+/**
+ * Writes the module counters of the file analysis and post-processing
+ * pipelines to a JSON file.
+ */
+static void
+writeProfile(const std::string &path, const TskWorkerPool &workerPool, const TskPipeline *reportPipeline)
+{
+    std::ofstream out(path.c_str());
+    if (!out)
+    {
+        LOGERROR("Error creating pipeline profile: " + path);
+        return;
+    }
+
+    out << "{\n";
+    out << "  \"workers\": " << workerPool.getNumWorkers() << ",\n";
+    out << "  \"file_analysis\": ";
+    workerPool.getProfile().writeJson(out, 2);
+    out << ",\n";
+    out << "  \"post_processing\": ";
+    if (reportPipeline)
+        reportPipeline->getProfile().writeJson(out, 2);
+    else
+        out << "[]";
+    out << "\n}\n";
+}
+
 void 
 usage(const char *program) 
 {
@@ -301,8 +334,30 @@ int main(int argc, char **argv1)
     if (pipeline_config.size()) 
         SetSystemProperty(TskSystemProperties::PIPELINE_CONFIG_FILE, pipeline_config);
 
-    // Create a Scheduler and register it
-    TskSchedulerQueue scheduler;
+    // Figure out how many workers will run the file analysis pipelines
+    unsigned int numWorkers = 1;
+    try {
+        numWorkers = Poco::NumberParser::parseUnsigned(GetSystemProperty(TskSystemProperties::NUM_WORKER_THREADS));
+    }
+    catch (const Poco::SyntaxException &) {
+        std::stringstream msg;
+        msg << "Invalid NUM_WORKER_THREADS value: " << GetSystemProperty(TskSystemProperties::NUM_WORKER_THREADS);
+        LOGERROR(msg.str());
+        return 1;
+    }
+    if (numWorkers == 0)
+        numWorkers = Poco::Environment::processorCount();
+
+    // Create a Scheduler with a queue per worker and register it.  It
+    // orders the files by the priority rules and by size.
+    TskPriorityScheduler scheduler(numWorkers);
+    try {
+        scheduler.setPriorityRules(GetSystemProperty(TskSystemProperties::SCHEDULER_PRIORITY_RULES));
+    }
+    catch (const TskException &e) {
+        LOGERROR(e.message());
+        return 1;
+    }
     TskServices::Instance().setScheduler(scheduler);
 
     // Create a FileManager and register it with the framework.
@@ -326,17 +381,11 @@ int main(int argc, char **argv1)
     }
 
     // Let's get the pipelines setup to make sure there are no errors.
+    // Each worker gets its own file analysis pipeline.
+    TskWorkerPool workerPool(scheduler, numWorkers);
+    bool haveFilePipeline = workerPool.initialize(createUnusedSectorFiles);
+
     TskPipelineManager pipelineMgr;
-    TskPipeline *filePipeline;
-    try {
-        filePipeline = pipelineMgr.createPipeline(TskPipelineManager::FILE_ANALYSIS_PIPELINE);
-    }
-    catch (const TskException &e ) {
-        std::stringstream msg;
-        msg << "Error creating file analysis pipeline: " << e.message();
-        LOGERROR(msg.str());
-        filePipeline = NULL;
-    }
 
     TskPipeline *reportPipeline;
     try {
@@ -349,7 +398,7 @@ int main(int argc, char **argv1)
         reportPipeline = NULL;
     }
 
-    if ((filePipeline == NULL) && (reportPipeline == NULL)) {
+    if (!haveFilePipeline && (reportPipeline == NULL)) {
         std::stringstream msg;
         msg << "No pipelines configured.  Stopping";
         LOGERROR(msg.str());
@@ -358,8 +407,6 @@ int main(int argc, char **argv1)
 
     // Now we analyze the data.
 
-    std::auto_ptr<TskCarveExtractScalpel> carver(new TskCarveExtractScalpel(createUnusedSectorFiles));
-
     // Extract
     if (!containerExtractor.isNull())   // Input is an archive file
     {
@@ -381,45 +428,22 @@ int main(int argc, char **argv1)
             return 1;
         }
 
-        if (doCarving && !GetSystemProperty("SCALPEL_DIR").empty())
+        if (doCarving && (Poco::icompare(GetSystemProperty("CARVE_ENGINE"), "STREAM") == 0))
         {
-            TskCarvePrepSectorConcat carvePrep;
+            // The sectors are carved in place, so nothing is copied here.
+            TskCarvePrepSectorMap carvePrep;
             carvePrep.processSectors();
-            carver.reset(new TskCarveExtractScalpel());
         }
-    }
-
-    TskSchedulerQueue::task_struct *task;
-    while ((task = scheduler.nextTask()) != NULL) 
-    {
-        try
+        else if (doCarving && !GetSystemProperty("SCALPEL_DIR").empty())
         {
-            if (task->task == Scheduler::FileAnalysis && filePipeline && !filePipeline->isEmpty())
-            {
-                filePipeline->run(task->id);
-            }
-            else if (task->task == Scheduler::Carve && carver.get())
-            {
-                carver->processFile(static_cast<int>(task->id));
-            }
-            else
-            {
-                std::stringstream msg;
-                msg << "WARNING: Skipping task: " << task->task;
-                LOGWARN(msg.str());
-            }
-            delete task;
-        }
-        catch (...) 
-        {
-            // Error message has been logged already.
+            TskCarvePrepSectorConcat carvePrep;
+            carvePrep.processSectors();
         }
     }
 
-    if (filePipeline && !filePipeline->isEmpty())
-    {
-        filePipeline->logModuleExecutionTimes();
-    }
+    // Run the file analysis and carving tasks on the workers.
+    workerPool.run();
+    workerPool.logModuleExecutionTimes();
 
     // Do image analysis tasks.
     if (reportPipeline) 
@@ -442,6 +466,9 @@ int main(int argc, char **argv1)
         }
     }
 
+    writeProfile(GetSystemProperty(TskSystemProperties::SYSTEM_OUT_DIR) + Poco::Path::separator() + "pipeline_profile.json",
+        workerPool, reportPipeline);
+
     std::stringstream msg;
     msg << "image analysis complete";
     LOGINFO(msg.str());
@@ -0,0 +1,671 @@
+/*
+ * The Sleuth Kit
+ *
+ * Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+ * Copyright (c) 2012 Basis Technology Corporation. All Rights
+ * reserved.
+ *
+ * This software is distributed under the Common Public License 1.0
+ */
+
+/**
+ * \file TskCarveExtractStream.cpp
+ * Contains the implementation of the TskCarveExtractStream class.
+ */
+
+// Include the class definition first to ensure it does not depend on subsequent includes in this file.
+#include "TskCarveExtractStream.h"
+
+// TSK Framework includes
+#include "tsk/framework/services/TskServices.h"
+#include "tsk/framework/services/TskImgDB.h"
+#include "tsk/framework/utilities/TskException.h"
+
+// Poco includes
+#include "Poco/StringTokenizer.h"
+#include "Poco/String.h"
+
+// C/C++ library includes
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+#include <memory>
+
+namespace
+{
+    // Sector size to use if the image database does not have one.
+    const uint64_t DEFAULT_SECTOR_SIZE = 512;
+
+    // Number of bytes read from the image at a time.
+    const uint64_t READ_SIZE = 1024 * 1024;
+
+    // Maximum number of headers of one type that can wait for a footer at
+    // the same time.  Further headers are ignored until one of them ends.
+    const size_t MAX_OPEN_CANDIDATES = 16;
+
+    const char WILDCARD = '?';
+
+    uint64_t parseSize(const std::string &text)
+    {
+        uint64_t size = 0;
+        std::istringstream(text) >> size;
+        return size;
+    }
+}
+
+TskCarveExtractStream::TskCarveExtractStream(bool createUnusedSectorFiles)
+    : m_createUnusedSectorFiles(createUnusedSectorFiles), m_signaturesLoaded(false),
+    m_search(NULL), m_maxPatternLength(0), m_sectorSize(DEFAULT_SECTOR_SIZE), m_unallocImgId(0), m_volId(0),
+    m_runs(NULL), m_imgLength(0), m_numCarved(0)
+{
+}
+
+TskCarveExtractStream::~TskCarveExtractStream()
+{
+    if (m_search != NULL)
+    {
+        tsk_msearch_free(m_search);
+    }
+}
+
+int TskCarveExtractStream::processFile(int unallocImgId)
+{
+    TskImgDB *imgDB = NULL;
+    try
+    {
+        imgDB = &TskServices::Instance().getImgDB();
+
+        if (!m_signaturesLoaded)
+        {
+            loadSignatures();
+        }
+
+        // The sector runs in the image database are in image sectors.
+        int imgType, sectorSize;
+        m_sectorSize = DEFAULT_SECTOR_SIZE;
+        if ((imgDB->getImageInfo(imgType, sectorSize) == 0) && (sectorSize > 0))
+        {
+            m_sectorSize = static_cast<uint64_t>(sectorSize);
+        }
+
+        int volId = 0;
+        std::vector<ImgRun> runs;
+        getImgRuns(unallocImgId, volId, runs);
+
+        if (runs.empty() || m_signatures.empty())
+        {
+            imgDB->setUnallocImgStatus(unallocImgId, TskImgDB::IMGDB_UNALLOC_IMG_STATUS_CARVED_NOT_NEEDED);
+            return 0;
+        }
+
+        carve(unallocImgId, volId, runs);
+
+        // Update the unused sector info in the image database so it is known which of the unallocated sectors just carved did not go into a carved file.
+        if (m_createUnusedSectorFiles)
+        {
+            std::vector<TskUnusedSectorsRecord> unusedSectorsList;
+            imgDB->addUnusedSectors(unallocImgId, unusedSectorsList);
+        }
+
+        imgDB->setUnallocImgStatus(unallocImgId, TskImgDB::IMGDB_UNALLOC_IMG_STATUS_CARVED_OK);
+        return 0;
+    }
+    catch (TskException &ex)
+    {
+        LOGERROR(ex.message());
+
+        if (imgDB)
+        {
+            imgDB->setUnallocImgStatus(unallocImgId, TskImgDB::IMGDB_UNALLOC_IMG_STATUS_CARVED_ERR);
+        }
+
+        return 1;
+    }
+}
+
+/**
+ * Reads the signatures from the Scalpel configuration file and compiles
+ * the literal part of each header and footer (up to the first wildcard)
+ * into one search.
+ */
+void TskCarveExtractStream::loadSignatures()
+{
+    std::string configFilePath = GetSystemProperty("SCALPEL_CONFIG_FILE");
+    std::ifstream configStream(configFilePath.c_str());
+    if (!configStream)
+    {
+        std::stringstream msg;
+        msg << "TskCarveExtractStream::loadSignatures : unable to open carving configuration file '" << configFilePath << "'";
+        throw TskException(msg.str());
+    }
+
+    // Start over if an earlier attempt failed part way.
+    if (m_search != NULL)
+    {
+        tsk_msearch_free(m_search);
+        m_signatures.clear();
+        m_maxPatternLength = 0;
+    }
+
+    if ((m_search = tsk_msearch_alloc()) == NULL)
+    {
+        throw TskException("TskCarveExtractStream::loadSignatures : error allocating signature search");
+    }
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(configStream, line))
+    {
+        lineNumber++;
+
+        std::string::size_type comment = line.find('#');
+        if (comment != std::string::npos)
+        {
+            line.erase(comment);
+        }
+
+        Poco::StringTokenizer tokenizer(line, "\t ", Poco::StringTokenizer::TOK_IGNORE_EMPTY | Poco::StringTokenizer::TOK_TRIM);
+        if (tokenizer.count() == 0)
+        {
+            continue;
+        }
+
+        std::stringstream warning;
+        warning << "TskCarveExtractStream::loadSignatures : skipping line " << lineNumber << " of '" << configFilePath << "': ";
+
+        if (tokenizer.count() < 4)
+        {
+            warning << "expected extension, case, size and header";
+            LOGWARN(warning.str());
+            continue;
+        }
+
+        Signature sig;
+        sig.extension = tokenizer[0];
+        sig.caseSensitive = (Poco::icompare(tokenizer[1], "y") == 0);
+        sig.footerMode = Signature::FOOTER_FIRST;
+
+        std::string::size_type colon = tokenizer[2].find(':');
+        if (colon == std::string::npos)
+        {
+            sig.minSize = 0;
+            sig.maxSize = parseSize(tokenizer[2]);
+        }
+        else
+        {
+            sig.minSize = parseSize(tokenizer[2].substr(0, colon));
+            sig.maxSize = parseSize(tokenizer[2].substr(colon + 1));
+        }
+
+        if (!parsePattern(tokenizer[3], sig.header, sig.headerMask) || (sig.headerMask[0] == 0))
+        {
+            warning << "header must not be empty or start with a wildcard";
+            LOGWARN(warning.str());
+            continue;
+        }
+
+        for (size_t i = 4; i < tokenizer.count(); i++)
+        {
+            if (Poco::icompare(tokenizer[i], "REVERSE") == 0)
+            {
+                sig.footerMode = Signature::FOOTER_LAST;
+            }
+            else if (Poco::icompare(tokenizer[i], "NEXT") == 0)
+            {
+                sig.footerMode = Signature::FOOTER_NEXT;
+            }
+            else if (sig.footer.empty())
+            {
+                parsePattern(tokenizer[i], sig.footer, sig.footerMask);
+            }
+        }
+
+        if (!sig.footer.empty() && (sig.footerMask[0] == 0))
+        {
+            warning << "footer must not start with a wildcard";
+            LOGWARN(warning.str());
+            continue;
+        }
+
+        if (sig.maxSize == 0)
+        {
+            warning << "maximum size must be greater than zero";
+            LOGWARN(warning.str());
+            continue;
+        }
+
+        // Pattern IDs are twice the signature index, plus one for footers.
+        int sigId = static_cast<int>(m_signatures.size());
+        size_t literal = sig.headerMask.find('\0');
+        if (tsk_msearch_add(m_search, (const uint8_t *)sig.header.data(),
+                (literal == std::string::npos) ? sig.header.size() : literal,
+                sig.caseSensitive ? 0 : 1, sigId * 2))
+        {
+            throw TskException("TskCarveExtractStream::loadSignatures : error adding header signature");
+        }
+        m_maxPatternLength = std::max(m_maxPatternLength, sig.header.size());
+
+        if (!sig.footer.empty())
+        {
+            literal = sig.footerMask.find('\0');
+            if (tsk_msearch_add(m_search, (const uint8_t *)sig.footer.data(),
+                    (literal == std::string::npos) ? sig.footer.size() : literal,
+                    sig.caseSensitive ? 0 : 1, sigId * 2 + 1))
+            {
+                throw TskException("TskCarveExtractStream::loadSignatures : error adding footer signature");
+            }
+            m_maxPatternLength = std::max(m_maxPatternLength, sig.footer.size());
+        }
+
+        m_signatures.push_back(sig);
+    }
+
+    if (tsk_msearch_compile(m_search))
+    {
+        throw TskException("TskCarveExtractStream::loadSignatures : error compiling signatures");
+    }
+
+    std::stringstream msg;
+    msg << "TskCarveExtractStream::loadSignatures : loaded " << m_signatures.size() << " signature(s) from '" << configFilePath << "'";
+    LOGINFO(msg.str());
+
+    m_signaturesLoaded = true;
+}
+
+/**
+ * Converts a header or footer from the configuration file to bytes.
+ * Supports the \\xHH, \\n, \\r, \\t, \\s (space) and \\\\ escapes and
+ * the ? wildcard.
+ *
+ * @param text Pattern as written in the configuration file.
+ * @param pattern Bytes of the pattern (output).
+ * @param mask 0 for each wildcard byte in the pattern, 1 otherwise (output).
+ * @returns false if the pattern is empty.
+ */
+bool TskCarveExtractStream::parsePattern(const std::string &text, std::string &pattern, std::string &mask)
+{
+    pattern.clear();
+    mask.clear();
+
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        char c = text[i];
+        char m = 1;
+
+        if ((c == '\\') && (i + 1 < text.size()))
+        {
+            char e = text[++i];
+            if (((e == 'x') || (e == 'X')) && (i + 2 < text.size()) && isxdigit((unsigned char)text[i + 1]) && isxdigit((unsigned char)text[i + 2]))
+            {
+                c = static_cast<char>(strtoul(text.substr(i + 1, 2).c_str(), NULL, 16));
+                i += 2;
+            }
+            else if (e == 'n')
+                c = '\n';
+            else if (e == 'r')
+                c = '\r';
+            else if (e == 't')
+                c = '\t';
+            else if (e == 's')
+                c = ' ';
+            else
+                c = e;
+        }
+        else if (c == WILDCARD)
+        {
+            m = 0;
+        }
+
+        pattern.push_back(c);
+        mask.push_back(m);
+    }
+
+    return !pattern.empty();
+}
+
+/**
+ * Gets the runs of image sectors that make up an unallocated sectors image.
+ */
+void TskCarveExtractStream::getImgRuns(int unallocImgId, int &volId, std::vector<ImgRun> &runs) const
+{
+    std::vector<TskAllocUnallocMapRecord> records;
+    if (TskServices::Instance().getImgDB().getAllocUnallocMapInfo(unallocImgId, records) != 0)
+    {
+        std::stringstream msg;
+        msg << "TskCarveExtractStream::getImgRuns : unable to get sector runs of unallocated sectors image " << unallocImgId;
+        throw TskException(msg.str());
+    }
+
+    for (std::vector<TskAllocUnallocMapRecord>::const_iterator it = records.begin(); it != records.end(); ++it)
+    {
+        ImgRun imgRun;
+        imgRun.offset = it->unalloc_img_sect_start;
+        imgRun.imgStart = it->orig_img_sect_start;
+        imgRun.length = it->sect_len;
+        runs.push_back(imgRun);
+
+        volId = it->vol_id;
+    }
+}
+
+TSK_WALK_RET_ENUM TskCarveExtractStream::matchCallback(int patternId, TSK_OFF_T offset, void *ptr)
+{
+    TskCarveExtractStream *self = static_cast<TskCarveExtractStream *>(ptr);
+
+    Hit hit;
+    hit.offset = static_cast<uint64_t>(offset);
+    hit.signature = static_cast<size_t>(patternId / 2);
+    hit.isFooter = (patternId % 2) == 1;
+
+    // Headers only count at the start of a sector so that the carved file
+    // can be described by whole sectors.
+    if (hit.isFooter || (hit.offset % self->m_sectorSize == 0))
+    {
+        self->m_hits.push_back(hit);
+    }
+    return TSK_WALK_CONT;
+}
+
+/**
+ * Reads the unallocated sectors image from the disk image, one chunk at a
+ * time, and carves it.
+ */
+void TskCarveExtractStream::carve(int unallocImgId, int volId, const std::vector<ImgRun> &runs)
+{
+    TskImageFile &imageFile = TskServices::Instance().getImageFile();
+
+    m_unallocImgId = unallocImgId;
+    m_volId = volId;
+    m_runs = &runs;
+    m_imgLength = (runs.back().offset + runs.back().length) * m_sectorSize;
+    m_candidates.clear();
+    m_hits.clear();
+    m_numCarved = 0;
+
+    // The buffer holds the end of the previous chunk followed by the current
+    // chunk so that a match that starts near the end of one chunk can be
+    // checked against its full pattern once the next chunk has been read.
+    const size_t keep = m_maxPatternLength;
+    const uint64_t sectorsPerRead = std::max(READ_SIZE / m_sectorSize, (uint64_t)1);
+    std::vector<char> buffer(keep + sectorsPerRead * m_sectorSize);
+    uint64_t bufferOffset = 0;      // Offset of buffer[0] in the unallocated sectors image
+    size_t bufferLength = 0;
+    std::vector<Hit> deferred;
+
+    TSK_MSEARCH_STATE state;
+    tsk_msearch_state_init(&state);
+
+    for (std::vector<ImgRun>::const_iterator run = runs.begin(); run != runs.end(); ++run)
+    {
+        for (uint64_t sector = 0; sector < run->length; )
+        {
+            uint64_t sectorsToRead = std::min(sectorsPerRead, run->length - sector);
+
+            // Move the end of the previous chunk to the front of the buffer.
+            size_t carried = std::min(keep, bufferLength);
+            if (carried > 0)
+            {
+                memmove(&buffer[0], &buffer[bufferLength - carried], carried);
+            }
+            bufferOffset += bufferLength - carried;
+            bufferLength = carried;
+
+            int bytesRead = imageFile.getByteData((run->imgStart + sector) * m_sectorSize, sectorsToRead * m_sectorSize, &buffer[bufferLength]);
+            uint64_t sectorsRead = (bytesRead > 0) ? static_cast<uint64_t>(bytesRead) / m_sectorSize : 0;
+            if (sectorsRead == 0)
+            {
+                std::stringstream msg;
+                msg << "TskCarveExtractStream::carve : error reading sector " << run->imgStart + sector
+                    << " of unallocated sectors image " << unallocImgId;
+                throw TskException(msg.str());
+            }
+
+            const char *chunk = &buffer[bufferLength];
+            uint64_t chunkOffset = bufferOffset + bufferLength;
+            size_t chunkLength = static_cast<size_t>(sectorsRead * m_sectorSize);
+            bufferLength += chunkLength;
+            sector += sectorsRead;
+
+            // Matches near the end of the data are handled with the next
+            // chunk, after their full pattern has been read, so that all
+            // matches are handled in order.
+            uint64_t done = bufferOffset + bufferLength;
+            uint64_t threshold = (done == m_imgLength) ? done : ((done > keep) ? done - keep : 0);
+
+            m_hits.swap(deferred);
+            deferred.clear();
+            tsk_msearch_scan(m_search, &state, chunkOffset, (const uint8_t *)chunk, chunkLength, matchCallback, this);
+
+            std::vector<Hit> hits;
+            for (std::vector<Hit>::const_iterator hit = m_hits.begin(); hit != m_hits.end(); ++hit)
+            {
+                if (hit->offset >= threshold)
+                    deferred.push_back(*hit);
+                else if (verify(*hit, buffer, bufferOffset, bufferLength))
+                    hits.push_back(*hit);
+            }
+            m_hits.clear();
+
+            std::stable_sort(hits.begin(), hits.end());
+            for (std::vector<Hit>::const_iterator hit = hits.begin(); hit != hits.end(); ++hit)
+            {
+                closeCandidates(hit->offset, false);
+                processHit(*hit);
+            }
+
+            // No match that is still to come can start before the threshold.
+            closeCandidates(threshold, false);
+        }
+    }
+
+    closeCandidates(m_imgLength, true);
+    m_runs = NULL;
+
+    std::stringstream msg;
+    msg << "TskCarveExtractStream::carve : carved " << m_numCarved << " file(s) from unallocated sectors image " << unallocImgId;
+    LOGINFO(msg.str());
+}
+
+/**
+ * Checks all of the bytes of a header or footer that the search matched
+ * on its literal prefix.
+ *
+ * @param hit Match to check.
+ * @param buffer Data read so far.
+ * @param bufferOffset Offset of the start of the buffer in the unallocated
+ * sectors image.
+ * @param bufferLength Number of bytes of data in the buffer.
+ * @returns true if the pattern matches.
+ */
+bool TskCarveExtractStream::verify(const Hit &hit, const std::vector<char> &buffer, uint64_t bufferOffset, size_t bufferLength) const
+{
+    const Signature &sig = m_signatures[hit.signature];
+    const std::string &pattern = hit.isFooter ? sig.footer : sig.header;
+    const std::string &mask = hit.isFooter ? sig.footerMask : sig.headerMask;
+
+    if ((hit.offset < bufferOffset) || (hit.offset - bufferOffset + pattern.size() > bufferLength))
+    {
+        return false;
+    }
+
+    size_t start = static_cast<size_t>(hit.offset - bufferOffset);
+    for (size_t i = 0; i < pattern.size(); i++)
+    {
+        if (mask[i] == 0)
+        {
+            continue;
+        }
+
+        char c = buffer[start + i];
+        char p = pattern[i];
+        if (!sig.caseSensitive)
+        {
+            c = static_cast<char>(tolower((unsigned char)c));
+            p = static_cast<char>(tolower((unsigned char)p));
+        }
+        if (c != p)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Starts a candidate file for a header or ends one for a footer.  Footers
+ * end the most recent header of the same type, so nested files are carved
+ * as in Scalpel's -e mode.
+ */
+void TskCarveExtractStream::processHit(const Hit &hit)
+{
+    const Signature &sig = m_signatures[hit.signature];
+
+    if (!hit.isFooter)
+    {
+        size_t open = 0;
+        for (std::vector<Candidate>::const_iterator it = m_candidates.begin(); it != m_candidates.end(); ++it)
+        {
+            if (it->signature == hit.signature)
+                open++;
+        }
+
+        if (open < MAX_OPEN_CANDIDATES)
+        {
+            Candidate candidate;
+            candidate.signature = hit.signature;
+            candidate.start = hit.offset;
+            candidate.end = 0;
+            m_candidates.push_back(candidate);
+        }
+        return;
+    }
+
+    uint64_t footerEnd = hit.offset + sig.footer.size();
+
+    for (size_t i = m_candidates.size(); i > 0; i--)
+    {
+        Candidate &candidate = m_candidates[i - 1];
+        if ((candidate.signature != hit.signature)
+            || (hit.offset < candidate.start + sig.header.size())
+            || (footerEnd > candidate.start + sig.maxSize))
+        {
+            continue;
+        }
+
+        if (sig.footerMode == Signature::FOOTER_LAST)
+        {
+            // Keep looking for a later footer until the maximum size is reached.
+            candidate.end = footerEnd;
+            continue;
+        }
+
+        Candidate found = candidate;
+        m_candidates.erase(m_candidates.begin() + (i - 1));
+        addCarvedFile(found, (sig.footerMode == Signature::FOOTER_NEXT) ? hit.offset : footerEnd);
+        return;
+    }
+}
+
+/**
+ * Ends the candidates that cannot get a footer any more.
+ *
+ * @param offset Offset at or after which all of the matches that are still
+ * to come start.
+ * @param atEnd true if the whole unallocated sectors image has been read.
+ */
+void TskCarveExtractStream::closeCandidates(uint64_t offset, bool atEnd)
+{
+    for (size_t i = 0; i < m_candidates.size(); )
+    {
+        const Candidate candidate = m_candidates[i];
+        const Signature &sig = m_signatures[candidate.signature];
+        uint64_t limit = candidate.start + sig.maxSize;
+
+        if (!atEnd && (limit > offset))
+        {
+            i++;
+            continue;
+        }
+
+        m_candidates.erase(m_candidates.begin() + i);
+
+        if (sig.footer.empty())
+        {
+            // Without a footer the file is as large as it can be.
+            addCarvedFile(candidate, std::min(limit, m_imgLength));
+        }
+        else if (candidate.end != 0)
+        {
+            addCarvedFile(candidate, candidate.end);
+        }
+    }
+}
+
+/**
+ * Maps a carved file to sectors of the disk image and adds it to the image
+ * database.
+ *
+ * @param candidate Header of the file.
+ * @param end Offset after the last byte of the file.
+ */
+void TskCarveExtractStream::addCarvedFile(const Candidate &candidate, uint64_t end)
+{
+    const Signature &sig = m_signatures[candidate.signature];
+    uint64_t size = end - candidate.start;
+    if ((end <= candidate.start) || (size < sig.minSize))
+    {
+        return;
+    }
+
+    // Convert the range of the file in the unallocated sectors image into
+    // runs of image sectors, splitting it where the image is not contiguous.
+    uint64_t firstSector = candidate.start / m_sectorSize;
+    uint64_t endSector = (end + m_sectorSize - 1) / m_sectorSize;
+    std::vector<uint64_t> runStarts;
+    std::vector<uint64_t> runLengths;
+
+    for (std::vector<ImgRun>::const_iterator run = m_runs->begin(); run != m_runs->end(); ++run)
+    {
+        uint64_t from = std::max(firstSector, run->offset);
+        uint64_t to = std::min(endSector, run->offset + run->length);
+        if (from >= to)
+        {
+            continue;
+        }
+
+        uint64_t start = run->imgStart + (from - run->offset);
+        if (!runStarts.empty() && (runStarts.back() + runLengths.back() == start))
+        {
+            runLengths.back() += to - from;
+        }
+        else
+        {
+            runStarts.push_back(start);
+            runLengths.push_back(to - from);
+        }
+    }
+
+    m_numCarved++;
+    std::stringstream name;
+    name << m_unallocImgId << "_" << std::setw(8) << std::setfill('0') << m_numCarved << "." << sig.extension;
+
+    TskImgDB &imgDB = TskServices::Instance().getImgDB();
+    uint64_t fileId;
+    if (imgDB.addCarvedFileInfo(m_volId, name.str().c_str(), size, &runStarts[0], &runLengths[0], static_cast<int>(runStarts.size()), fileId) == -1)
+    {
+        std::stringstream msg;
+        msg << "TskCarveExtractStream::addCarvedFile : unable to save carved file info for '" << name.str() << "'";
+        throw TskException(msg.str());
+    }
+
+    if (imgDB.updateFileStatus(fileId, TskImgDB::IMGDB_FILES_STATUS_READY_FOR_ANALYSIS) == 1)
+    {
+        std::stringstream msg;
+        msg << "TskCarveExtractStream::addCarvedFile : unable to update file status for '" << name.str() << "'";
+        throw TskException(msg.str());
+    }
+}
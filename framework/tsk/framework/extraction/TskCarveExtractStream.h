@@ -0,0 +1,133 @@
+/*
+ * The Sleuth Kit
+ *
+ * Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+ * Copyright (c) 2012 Basis Technology Corporation. All Rights
+ * reserved.
+ *
+ * This software is distributed under the Common Public License 1.0
+ */
+
+/**
+ * \file TskCarveExtractStream.h
+ * Contains the interface of the TskCarveExtractStream class.
+ */
+
+#ifndef _TSK_CARVEEXTRACTSTREAM_H
+#define _TSK_CARVEEXTRACTSTREAM_H
+
+// TSK Framework includes
+#include "tsk/framework/extraction/CarveExtract.h"
+
+// C/C++ library includes
+#include <string>
+#include <vector>
+
+/**
+ * The TskCarveExtractStream class implements the CarveExtract interface
+ * with a built-in header/footer carver.  It reads the sectors of an
+ * unallocated sectors image straight from the disk image, using the
+ * mapping in the alloc_unalloc_map table, so it does not need the image
+ * to be written to disk (see TskCarvePrepSectorMap).  All of the header
+ * and footer signatures are matched in a single pass with a multi-pattern
+ * search (tsk_msearch).  Carved files are recorded as runs of image
+ * sectors only; their content is read from the image when they are
+ * analyzed.
+ *
+ * The signatures are read from the Scalpel configuration file named by the
+ * SCALPEL_CONFIG_FILE system property.  Each line has an extension, a case
+ * sensitivity flag (y/n), a maximum size (or min:max), a header and an
+ * optional footer followed by an optional REVERSE or NEXT keyword.  Headers
+ * are only matched at the start of a sector.
+ */
+class TSK_FRAMEWORK_API TskCarveExtractStream : public CarveExtract
+{
+public:
+    TskCarveExtractStream(bool createUnusedSectorFiles = false);
+    virtual ~TskCarveExtractStream();
+
+    virtual int processFile(int unallocImgId);
+
+private:
+    // Disallow copying
+    TskCarveExtractStream(const TskCarveExtractStream&);
+    TskCarveExtractStream& operator=(const TskCarveExtractStream&);
+
+    /// A header/footer signature from the configuration file.
+    struct Signature
+    {
+        enum FooterMode
+        {
+            FOOTER_FIRST,   ///< File ends with the first footer after the header
+            FOOTER_NEXT,    ///< File ends just before the first footer after the header
+            FOOTER_LAST     ///< File ends with the last footer within the maximum size
+        };
+
+        std::string extension;
+        bool caseSensitive;
+        uint64_t minSize;
+        uint64_t maxSize;
+        std::string header;
+        std::string headerMask;     ///< 0 where the header has a wildcard
+        std::string footer;
+        std::string footerMask;     ///< 0 where the footer has a wildcard
+        FooterMode footerMode;
+    };
+
+    /// A run of sectors in the unallocated sectors image.
+    struct ImgRun
+    {
+        uint64_t offset;        ///< Offset of the run in the unallocated sectors image (sectors)
+        uint64_t imgStart;      ///< Start of the run in the disk image (sectors)
+        uint64_t length;        ///< Length of the run (sectors)
+    };
+
+    /// A header that has been found and whose end has not been.
+    struct Candidate
+    {
+        size_t signature;
+        uint64_t start;         ///< Offset of the header (bytes)
+        uint64_t end;           ///< Offset after the last footer so far or 0 (bytes)
+    };
+
+    /// A header or footer match.
+    struct Hit
+    {
+        uint64_t offset;
+        size_t signature;
+        bool isFooter;
+        bool operator<(const Hit &other) const { return offset < other.offset; }
+    };
+
+    static TSK_WALK_RET_ENUM matchCallback(int patternId, TSK_OFF_T offset, void *ptr);
+
+    void loadSignatures();
+    static bool parsePattern(const std::string &text, std::string &pattern, std::string &mask);
+
+    void getImgRuns(int unallocImgId, int &volId, std::vector<ImgRun> &runs) const;
+    void carve(int unallocImgId, int volId, const std::vector<ImgRun> &runs);
+    bool verify(const Hit &hit, const std::vector<char> &buffer, uint64_t bufferOffset, size_t bufferLength) const;
+    void processHit(const Hit &hit);
+    void closeCandidates(uint64_t offset, bool atEnd);
+    void addCarvedFile(const Candidate &candidate, uint64_t end);
+
+    // Whether to generate unused sector files after carving.
+    bool m_createUnusedSectorFiles;
+
+    bool m_signaturesLoaded;
+    std::vector<Signature> m_signatures;
+    TSK_MSEARCH *m_search;
+    size_t m_maxPatternLength;
+    uint64_t m_sectorSize;              ///< Size of the image sectors (bytes)
+
+    // State of the image being carved.
+    int m_unallocImgId;
+    int m_volId;
+    const std::vector<ImgRun> *m_runs;
+    uint64_t m_imgLength;               ///< bytes
+    std::vector<Candidate> m_candidates;
+    std::vector<Hit> m_hits;
+    int m_numCarved;
+};
+
+#endif
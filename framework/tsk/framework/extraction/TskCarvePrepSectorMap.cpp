@@ -0,0 +1,143 @@
+/*
+ * The Sleuth Kit
+ *
+ * Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+ * Copyright (c) 2012 Basis Technology Corporation. All Rights
+ * reserved.
+ *
+ * This software is distributed under the Common Public License 1.0
+ */
+
+/**
+ * \file TskCarvePrepSectorMap.cpp
+ * Contains the implementation of the TskCarvePrepSectorMap class.
+ */
+
+// Include the class definition first to ensure it does not depend on subsequent includes in this file.
+#include "TskCarvePrepSectorMap.h"
+
+// TSK Framework includes
+#include "tsk/framework/services/TskImgDB.h"
+#include "tsk/framework/services/TskServices.h"
+#include "tsk/framework/services/Log.h"
+#include "tsk/framework/utilities/TskException.h"
+
+// C/C++ library includes
+#include <sstream>
+#include <cstdlib>
+#include <limits>
+#include <memory>
+
+namespace
+{
+    // Sector size to use if the image database does not have one.
+    const uint64_t DEFAULT_SECTOR_SIZE = 512;
+}
+
+int TskCarvePrepSectorMap::processSectors()
+{
+    try
+    {
+        // The free sector runs are in image sectors.
+        TskImgDB &imgDB = TskServices::Instance().getImgDB();
+        int imgType, sectorSize;
+        uint64_t imgSectorSize = DEFAULT_SECTOR_SIZE;
+        if ((imgDB.getImageInfo(imgType, sectorSize) == 0) && (sectorSize > 0))
+        {
+            imgSectorSize = static_cast<uint64_t>(sectorSize);
+        }
+
+        uint64_t maxImgSectors = strtoul(GetSystemProperty("MAX_UNALLOC_SECTORS_IMG_FILE_SIZE").c_str(), NULL, 10) / imgSectorSize;
+        if (maxImgSectors == 0)
+        {
+            maxImgSectors = std::numeric_limits<uint64_t>::max();
+        }
+
+        std::auto_ptr<SectorRuns> sectorRuns(imgDB.getFreeSectors());
+        if (sectorRuns.get())
+        {
+            mapSectorRuns(maxImgSectors, *sectorRuns);
+        }
+    }
+    catch (TskException &ex)
+    {
+        LOGERROR(ex.message());
+        return 1;
+    }
+
+    return 0;
+}
+
+void TskCarvePrepSectorMap::mapSectorRuns(uint64_t maxImgSectors, SectorRuns &sectorRuns) const
+{
+    TskImgDB &imgDB = TskServices::Instance().getImgDB();
+    int volumeID = -1;
+    int unallocSectorsImgId = 0;
+    uint64_t imgSectors = 0;
+
+    do
+    {
+        uint64_t runStart = sectorRuns.getDataStart();
+        uint64_t runLength = sectorRuns.getDataLen();
+
+        while (runLength > 0)
+        {
+            // Start a new unallocated sectors image on a volume boundary or
+            // when the current one is full.
+            if ((sectorRuns.getVolID() != volumeID) || (imgSectors == maxImgSectors))
+            {
+                if (unallocSectorsImgId != 0)
+                {
+                    schedule(unallocSectorsImgId);
+                }
+
+                if (imgDB.addUnallocImg(unallocSectorsImgId) == -1)
+                {
+                    throw TskException("TskCarvePrepSectorMap::mapSectorRuns : failed to get next unallocated sectors image number");
+                }
+                volumeID = sectorRuns.getVolID();
+                imgSectors = 0;
+            }
+
+            uint64_t length = runLength;
+            if (length > maxImgSectors - imgSectors)
+            {
+                length = maxImgSectors - imgSectors;
+            }
+
+            if (imgDB.addAllocUnallocMapInfo(volumeID, unallocSectorsImgId, imgSectors, length, runStart) != 0)
+            {
+                std::stringstream msg;
+                msg << "TskCarvePrepSectorMap::mapSectorRuns : failed to add mapping to image for unallocated sectors image " << unallocSectorsImgId;
+                throw TskException(msg.str());
+            }
+
+            imgSectors += length;
+            runStart += length;
+            runLength -= length;
+        }
+    }
+    while (sectorRuns.next() != -1);
+
+    if (unallocSectorsImgId != 0)
+    {
+        schedule(unallocSectorsImgId);
+    }
+}
+
+void TskCarvePrepSectorMap::schedule(int unallocSectorsImgId) const
+{
+    TskImgDB &imgDB = TskServices::Instance().getImgDB();
+
+    if (TskServices::Instance().getScheduler().schedule(Scheduler::Carve, unallocSectorsImgId, unallocSectorsImgId) == 0)
+    {
+        imgDB.setUnallocImgStatus(unallocSectorsImgId, TskImgDB::IMGDB_UNALLOC_IMG_STATUS_SCHEDULE_OK);
+    }
+    else
+    {
+        imgDB.setUnallocImgStatus(unallocSectorsImgId, TskImgDB::IMGDB_UNALLOC_IMG_STATUS_SCHEDULE_ERR);
+        std::stringstream msg;
+        msg << "TskCarvePrepSectorMap::schedule : failed to schedule carving of unallocated sectors image " << unallocSectorsImgId;
+        throw TskException(msg.str());
+    }
+}
@@ -0,0 +1,62 @@
+/*
+ * The Sleuth Kit
+ *
+ * Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+ * Copyright (c) 2012 Basis Technology Corporation. All Rights
+ * reserved.
+ *
+ * This software is distributed under the Common Public License 1.0
+ */
+
+/**
+ * \file TskCarvePrepSectorMap.h
+ * Contains the interface of the TskCarvePrepSectorMap class.
+ */
+
+#ifndef _TSK_CARVE_PREP_MAP_H
+#define _TSK_CARVE_PREP_MAP_H
+
+// TSK Framework includes
+#include "CarvePrep.h"
+
+/**
+ * The TskCarvePrepSectorMap class implements the CarvePrep abstract
+ * interface without copying any data.  It groups the unallocated sector
+ * runs of the image into unallocated sectors images in the same way as
+ * TskCarvePrepSectorConcat (breaking on volume boundaries and on
+ * MAX_UNALLOC_SECTORS_IMG_FILE_SIZE), but the images only exist as
+ * mappings in the alloc_unalloc_map table.  It is meant to be used with
+ * TskCarveExtractStream, which reads the mapped sectors straight from the
+ * disk image.
+ */
+class TSK_FRAMEWORK_API TskCarvePrepSectorMap : public CarvePrep
+{
+public:
+    TskCarvePrepSectorMap() {}
+    virtual ~TskCarvePrepSectorMap() {}
+
+    virtual int processSectors();
+
+private:
+    /**
+     * Adds the sector runs to one or more unallocated sectors images and
+     * schedules each one for carving.
+     *
+     * @param maxImgSectors Maximum number of sectors in an unallocated
+     * sectors image.
+     * @param sectorRuns Sector runs to be mapped.
+     * @return Throws TskException on error.
+     */
+    void mapSectorRuns(uint64_t maxImgSectors, SectorRuns &sectorRuns) const;
+
+    /**
+     * Schedules an unallocated sectors image for carving.
+     *
+     * @param unallocSectorsImgId ID assigned to the image by
+     * TskImgDB::addUnallocImg().
+     * @return Throws TskException on error.
+     */
+    void schedule(int unallocSectorsImgId) const;
+};
+
+#endif
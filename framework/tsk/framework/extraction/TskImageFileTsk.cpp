@@ -24,6 +24,13 @@
 #include "tsk/framework/services/TskServices.h"
 #include "tsk/base/tsk_base_i.h"
 
+namespace
+{
+    // Maximum number of files that are kept open after their last handle
+    // is closed, so that modules that open the same file again (or the
+    // next attribute of it) do not have to load its metadata again.
+    const size_t MAX_IDLE_FILES = 256;
+}
 
 /**
  * Utility function to close file system handles.
@@ -99,6 +106,9 @@ int TskImageFileTsk::openImages(const TSK_IMG_TYPE_ENUM imageType,
 
 void TskImageFileTsk::close()
 {
+    // Close the files and file systems before the image they are in.
+    closeAllFiles();
+
     if (m_img_info) {
         tsk_img_close(m_img_info);
         m_img_info = NULL;
@@ -110,12 +120,76 @@ void TskImageFileTsk::close()
     }
 
     m_images.clear();
+}
+
+/**
+ * Close all of the files, including those that still have handles, and
+ * all of the file systems.
+ */
+void TskImageFileTsk::closeAllFiles()
+{
+    Poco::FastMutex::ScopedLock lock(m_lock);
 
-    // Close the handles in m_openFiles and m_openFs
-    for (uint32_t i = 0; i < m_openFiles.size(); i++)
-        closeFile(i);
+    for (std::map<FILE_KEY, CACHED_FILE *>::iterator it = m_fileCache.begin(); it != m_fileCache.end(); it++) {
+        tsk_fs_file_close(it->second->fsFile);
+        delete it->second;
+    }
+    m_fileCache.clear();
+    m_idleFiles.clear();
+    m_openFiles.clear();
+    m_freeHandles.clear();
 
     std::for_each(m_openFs.begin(), m_openFs.end(), (&TskImageFileTsk::closeFs));
+    m_openFs.clear();
+}
+
+/**
+ * Get a file from the cache or open it and add it to the cache.  The
+ * caller must hold m_lock and call releaseFile() when done with it.
+ * @returns NULL on error
+ */
+TskImageFileTsk::CACHED_FILE * TskImageFileTsk::acquireFile(TSK_FS_INFO * fsInfo, const FILE_KEY &key)
+{
+    std::map<FILE_KEY, CACHED_FILE *>::iterator it = m_fileCache.find(key);
+    if (it != m_fileCache.end()) {
+        CACHED_FILE * file = it->second;
+        if (file->refCount++ == 0)
+            m_idleFiles.erase(file->lruPos);
+        return file;
+    }
+
+    TSK_FS_FILE * fsFile = tsk_fs_file_open_meta(fsInfo, NULL, key.fsFileId);
+    if (fsFile == NULL)
+        return NULL;
+
+    CACHED_FILE * file = new CACHED_FILE();
+    file->key = key;
+    file->fsFile = fsFile;
+    file->refCount = 1;
+    m_fileCache[key] = file;
+    return file;
+}
+
+/**
+ * Give up a reference to a cached file.  Files without references are
+ * kept open until they are among the least recently used of more than
+ * MAX_IDLE_FILES idle files.  The caller must hold m_lock.
+ */
+void TskImageFileTsk::releaseFile(CACHED_FILE * file)
+{
+    if (--file->refCount > 0)
+        return;
+
+    m_idleFiles.push_front(file);
+    file->lruPos = m_idleFiles.begin();
+
+    while (m_idleFiles.size() > MAX_IDLE_FILES) {
+        CACHED_FILE * oldest = m_idleFiles.back();
+        m_idleFiles.pop_back();
+        m_fileCache.erase(oldest->key);
+        tsk_fs_file_close(oldest->fsFile);
+        delete oldest;
+    }
 }
 
 /*
@@ -221,6 +295,8 @@ int TskImageFileTsk::openFile(const uint64_t fileId)
         return -1;
     }
 
+    Poco::FastMutex::ScopedLock lock(m_lock);
+
     // Check if the file system at the offset is already open (using m_openFs).  If not, open it (tsk_fs_open) and add it to the map.
     TSK_FS_INFO * fsInfo = m_openFs[fsByteOffset];
 
@@ -240,10 +316,13 @@ int TskImageFileTsk::openFile(const uint64_t fileId)
         m_openFs[fsByteOffset] = fsInfo;
     }
 
-    // Find a new entry in m_openFiles and use tsk_fs_file_open to open the file and save the handle in m_openFiles. 
-    TSK_FS_FILE * fsFile = tsk_fs_file_open_meta(fsInfo, NULL, fsFileId);
+    // Get the file from the cache or open it with tsk_fs_file_open_meta.
+    FILE_KEY key;
+    key.fsByteOffset = fsByteOffset;
+    key.fsFileId = fsFileId;
+    CACHED_FILE * file = acquireFile(fsInfo, key);
 
-    if (fsFile == NULL)
+    if (file == NULL)
     {
         std::wstringstream errorMsg;
         errorMsg << L"TskImageFileTsk::openFile - Error opening file : " << tsk_error_get();
@@ -251,7 +330,7 @@ int TskImageFileTsk::openFile(const uint64_t fileId)
         return -1;
     }
 
-    const TSK_FS_ATTR * fsAttr = tsk_fs_file_attr_get_id(fsFile, attrId);
+    const TSK_FS_ATTR * fsAttr = tsk_fs_file_attr_get_id(file->fsFile, attrId);
 
     // @@@ TSK_ATTR_TYPE_ENUM should have a value added to it to represent an
     // empty (or null) attribute type and we should then compare attrType against
@@ -264,17 +343,25 @@ int TskImageFileTsk::openFile(const uint64_t fileId)
         std::wstringstream msg;
         msg << L"TskImageFileTsk::openFile - Error getting attribute : " << tsk_error_get();
         LOGERROR(msg.str());
+        releaseFile(file);
         return -1;
     }
 
-    TskImageFileTsk::OPEN_FILE * openFile = new TskImageFileTsk::OPEN_FILE();
-    openFile->fsFile = fsFile;
-    openFile->fsAttr = fsAttr;
+    // Reuse the slot of a closed handle if there is one.
+    int handle;
+    if (!m_freeHandles.empty()) {
+        handle = m_freeHandles.back();
+        m_freeHandles.pop_back();
+    }
+    else {
+        handle = (int)m_openFiles.size();
+        m_openFiles.push_back(OPEN_FILE());
+    }
 
-    m_openFiles.push_back(openFile);
+    m_openFiles[handle].file = file;
+    m_openFiles[handle].fsAttr = fsAttr;
 
-    // Return the index into m_openFiles
-    return m_openFiles.size() - 1;
+    return handle;
 }
 
 int TskImageFileTsk::readFile(const int handle, 
@@ -282,9 +369,19 @@ int TskImageFileTsk::readFile(const int handle,
                               const size_t byte_len, 
                               char * buffer)
 {
-    TskImageFileTsk::OPEN_FILE * openFile = m_openFiles[handle];
+    TSK_FS_FILE * fsFile = NULL;
+    const TSK_FS_ATTR * fsAttr = NULL;
+    {
+        // The file stays open while the handle is, so the read itself
+        // does not need to hold the lock.
+        Poco::FastMutex::ScopedLock lock(m_lock);
+        if (handle >= 0 && (size_t)handle < m_openFiles.size() && m_openFiles[handle].file != NULL) {
+            fsFile = m_openFiles[handle].file->fsFile;
+            fsAttr = m_openFiles[handle].fsAttr;
+        }
+    }
 
-    if (openFile == NULL || openFile->fsFile == NULL)
+    if (fsFile == NULL)
     {
         std::wstringstream errorMsg;
         errorMsg << L"TskImageFileTsk::readFile - Either OPEN_FILE or TSK_FS_FILE is null." << std::endl;
@@ -293,21 +390,21 @@ int TskImageFileTsk::readFile(const int handle,
     }
 
     // fsAttr can be NULL if the file has no attributes.
-    if (openFile->fsAttr == NULL || (TSK_OFF_T)byte_offset >= openFile->fsAttr->size)
+    if (fsAttr == NULL || (TSK_OFF_T)byte_offset >= fsAttr->size)
     {
         // If the offset is larger than the attribute size then there is nothing left to read.
         return 0;
     }
 
-    int bytesRead = tsk_fs_attr_read(openFile->fsAttr, byte_offset, buffer, 
+    int bytesRead = tsk_fs_attr_read(fsAttr, byte_offset, buffer, 
                                           byte_len, TSK_FS_FILE_READ_FLAG_NONE);
     if (bytesRead == -1)
     {
         std::wstringstream errorMsg;
         errorMsg << L"TskImageFileTsk::readFile - Error reading file (FS_OFFSET: " 
-            << openFile->fsFile->fs_info->offset << " - ID: "
-            << openFile->fsFile->meta->addr << " - " 
-            << ((openFile->fsFile->meta->flags & TSK_FS_META_FLAG_ALLOC) ? "Allocated" : "Deleted")
+            << fsFile->fs_info->offset << " - ID: "
+            << fsFile->meta->addr << " - " 
+            << ((fsFile->meta->flags & TSK_FS_META_FLAG_ALLOC) ? "Allocated" : "Deleted")
             << ") (" 
             << tsk_error_get() << ")" << std::endl;
         LOGERROR(errorMsg.str());
@@ -318,10 +415,9 @@ int TskImageFileTsk::readFile(const int handle,
 
 int TskImageFileTsk::closeFile(const int handle)
 {
-    // get the handle from m_openFiles
-    TskImageFileTsk::OPEN_FILE * openFile = m_openFiles[handle];
+    Poco::FastMutex::ScopedLock lock(m_lock);
 
-    if (openFile == NULL || openFile->fsFile == NULL)
+    if (handle < 0 || (size_t)handle >= m_openFiles.size() || m_openFiles[handle].file == NULL)
     {
         std::wstringstream errorMsg;
         errorMsg << L"TskImageFileTsk::closeFile - Either OPEN_FILE ot TSK_FS_FILE is null." << std::endl;
@@ -329,14 +425,13 @@ int TskImageFileTsk::closeFile(const int handle)
         return -1;
     }
 
-    // close the file
-    tsk_fs_file_close(openFile->fsFile);
-
-    // remove the entry from m_openFiles
-    m_openFiles.erase(m_openFiles.begin() + handle);
+    // The file itself stays in the cache for a while in case it is
+    // opened again.
+    releaseFile(m_openFiles[handle].file);
 
-    // delete the struct
-    delete openFile;
+    m_openFiles[handle].file = NULL;
+    m_openFiles[handle].fsAttr = NULL;
+    m_freeHandles.push_back(handle);
 
     return 0;
 }
@@ -23,6 +23,9 @@
 
 #include <vector>
 #include <map>
+#include <list>
+
+#include "Poco/Mutex.h"
 
 /// A Sleuth Kit implementation of the TskImageFile interface. 
 /**
@@ -92,14 +95,45 @@ class TSK_FRAMEWORK_API TskImageFileTsk : public TskImageFile
     std::vector<std::string> m_images;
     const char **m_images_ptrs;
 
-    struct TSK_FRAMEWORK_API OPEN_FILE
+    /// Identifies a file in one of the file systems of the image.
+    struct FILE_KEY
+    {
+        uint64_t fsByteOffset;
+        uint64_t fsFileId;
+
+        bool operator<(const FILE_KEY &other) const
+        {
+            return fsByteOffset < other.fsByteOffset ||
+                (fsByteOffset == other.fsByteOffset && fsFileId < other.fsFileId);
+        }
+    };
+
+    /// An open TSK_FS_FILE that is shared by all handles to the file.
+    struct CACHED_FILE
     {
+        FILE_KEY key;
         TSK_FS_FILE * fsFile;
+        int refCount;                               // number of handles using the file
+        std::list<CACHED_FILE *>::iterator lruPos;  // position in m_idleFiles when refCount is 0
+    };
+
+    /// What a handle returned from openFile() refers to.
+    struct OPEN_FILE
+    {
+        CACHED_FILE * file;         // NULL if the handle is free
         const TSK_FS_ATTR * fsAttr;
     };
 
-    std::vector<OPEN_FILE *> m_openFiles; // maps handle returned from openFile() to the open TSK_FS_FILE object
+    std::vector<OPEN_FILE> m_openFiles; // maps handle returned from openFile() to the open file. Slots are reused.
+    std::vector<int> m_freeHandles;     // slots of m_openFiles that are not in use
+    std::map<FILE_KEY, CACHED_FILE *> m_fileCache; // all open TSK_FS_FILE objects
+    std::list<CACHED_FILE *> m_idleFiles;   // files without handles, most recently used first
     std::map<uint64_t, TSK_FS_INFO *> m_openFs; // maps the byte offset of a file system to its open object.
+    Poco::FastMutex m_lock; // protects the handle table, the file cache and m_openFs when files are opened from several threads
+
+    CACHED_FILE * acquireFile(TSK_FS_INFO * fsInfo, const FILE_KEY &key);
+    void releaseFile(CACHED_FILE * file);
+    void closeAllFiles();
 
     int openImages(const TSK_IMG_TYPE_ENUM imageType = TSK_IMG_TYPE_DETECT,
                    const unsigned int sectorSize = 0);
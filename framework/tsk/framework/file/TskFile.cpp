@@ -20,6 +20,13 @@
 #include "TskFile.h"
 #include "tsk/framework/services/TskServices.h"
 
+/**
+ * Initialize the members that are shared by all implementations.
+ */
+TskFile::TskFile() : m_id(0), m_offset(0), m_isOpen(false), m_bytesRead(0)
+{
+}
+
 /**
  * Delete the TskFile object.
  */
@@ -202,6 +209,16 @@ TskImgDB::FILE_STATUS TskFile::getStatus() const
     return m_fileRecord.status;
 }
 
+uint64_t TskFile::getBytesRead() const
+{
+    return m_bytesRead;
+}
+
+void TskFile::resetBytesRead()
+{
+    m_bytesRead = 0;
+}
+
 /*
  * What is this files full path
  */
@@ -221,6 +221,17 @@ class TSK_FRAMEWORK_API TskFile
      */
     virtual ssize_t read(char * buf, const size_t count) = 0;
 
+    /**
+     * Get the number of bytes of content that read() has returned since
+     * the file object was created or resetBytesRead() was last called.
+     */
+    uint64_t getBytesRead() const;
+
+    /**
+     * Set the count returned by getBytesRead() back to zero.
+     */
+    void resetBytesRead();
+
     /**
      * Set the file status (where it is in its analysis life cycle)
      */
@@ -243,6 +254,8 @@ class TSK_FRAMEWORK_API TskFile
 
 
 protected:
+    TskFile();
+
     // File id.
     uint64_t m_id;
 
@@ -252,6 +265,10 @@ class TSK_FRAMEWORK_API TskFile
     // Is the file open (used for both on disk and image files)
     bool m_isOpen;
 
+    // Number of bytes returned by read(). Implementations of read()
+    // must add to it.
+    uint64_t m_bytesRead;
+
     // The database file record.
     TskFileRecord m_fileRecord;
 
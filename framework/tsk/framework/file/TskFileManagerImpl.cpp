@@ -216,7 +216,14 @@ void TskFileManagerImpl::saveFile(TskFile* fileToSave)
     else
     {
         // Carved and derived files should already have been saved to storage by a call to addFile().
+        // Carved files that were only recorded as sector runs (see TskCarveExtractStream) are
+        // copied from the image instead.
         Poco::File file(Poco::Path(TskUtilities::toUTF8(getPath(fileToSave->getId()))));
+        if (!file.exists() && (fileType == TskImgDB::IMGDB_FILES_TYPE_CARVED))
+        {
+            copyFile(fileToSave, getPath(fileToSave->getId()));
+            return;
+        }
         assert(file.exists());
         if(!file.exists())
         {
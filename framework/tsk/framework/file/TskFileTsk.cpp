@@ -28,7 +28,7 @@
  */
 TskFileTsk::TskFileTsk(uint64_t id) 
     : m_file(TskUtilities::toUTF8(TskFileManagerImpl::instance().getPath(id))), 
-    m_fileInStream(NULL), m_handle(-1)
+    m_fileInStream(NULL), m_handle(-1), m_carvedSectorSize(512)
 {
     m_id = id;
     m_offset = 0;
@@ -110,6 +110,30 @@ void TskFileTsk::open()
                 m_fileInStream = new Poco::FileInputStream(m_file.path());
             }
         }
+        else if (getTypeId() == TskImgDB::IMGDB_FILES_TYPE_CARVED) {
+            // Carved files that were only recorded as sector runs are
+            // read from the image.
+            SectorRuns * runs = TskServices::Instance().getImgDB().getFileSectors(m_id);
+            if (runs == NULL) {
+                std::wstringstream msg;
+                msg << L"TskFileTsk::open - Open failed because carved file id (" << m_id
+                    << ") does not exist on disk and has no sectors.";
+                LOGERROR(msg.str());
+                throw TskFileException("Error opening file");
+            }
+
+            // The runs are in image sectors.
+            int imgType, sectorSize;
+            m_carvedSectorSize = 512;
+            if ((TskServices::Instance().getImgDB().getImageInfo(imgType, sectorSize) == 0) && (sectorSize > 0))
+                m_carvedSectorSize = (uint64_t)sectorSize;
+
+            m_carvedRuns.clear();
+            do {
+                m_carvedRuns.push_back(std::make_pair(runs->getDataStart(), runs->getDataLen()));
+            } while (runs->next() != -1);
+            delete runs;
+        }
         else {
             std::wstringstream msg;
             msg << L"TskFileTsk::open - Open failed because file id (" << m_id
@@ -152,12 +176,22 @@ void TskFileTsk::close()
         m_handle = -1;
     }
 
+    m_carvedRuns.clear();
+
     m_offset = 0;
     m_isOpen = false;
 }
 
 
 ssize_t TskFileTsk::read(char *buf, const size_t count)
+{
+    ssize_t bytesRead = readContent(buf, count);
+    if (bytesRead > 0)
+        m_bytesRead += bytesRead;
+    return bytesRead;
+}
+
+ssize_t TskFileTsk::readContent(char *buf, const size_t count)
 {
     // File must be opened before you can read.
     if (!m_isOpen)
@@ -217,6 +251,11 @@ ssize_t TskFileTsk::read(char *buf, const size_t count)
                 m_offset += bytesRead;
             return bytesRead;
         }
+        else if (getTypeId() == TskImgDB::IMGDB_FILES_TYPE_CARVED)
+        {
+            // readCarvedRuns will log any errors
+            return readCarvedRuns(buf, count);
+        }
         else {
             std::wstringstream errorMsg;
             errorMsg << "TskFileTsk::read ID: " << m_id << " -- unknown type" << std::endl;
@@ -306,3 +345,46 @@ TSK_OFF_T TskFileTsk::seek(const TSK_OFF_T off, std::ios::seekdir origin)
         return m_offset;
     }
 }
+
+/*
+ * Read the content of a carved file that is not on disk from its
+ * sector runs in the image.
+ */
+ssize_t TskFileTsk::readCarvedRuns(char *buf, const size_t count)
+{
+    TSK_OFF_T size = getSize();
+    if (m_offset >= size)
+        return 0;
+
+    uint64_t bytesToRead = count;
+    if ((uint64_t)(size - m_offset) < bytesToRead)
+        bytesToRead = size - m_offset;
+
+    uint64_t bytesRead = 0;
+    uint64_t runOffset = 0;     // offset in the file of the current run
+    for (std::vector<std::pair<uint64_t, uint64_t> >::const_iterator run = m_carvedRuns.begin();
+        (run != m_carvedRuns.end()) && (bytesRead < bytesToRead); ++run)
+    {
+        uint64_t runBytes = run->second * m_carvedSectorSize;
+        uint64_t pos = m_offset + bytesRead;
+        if (pos < runOffset + runBytes)
+        {
+            uint64_t len = runOffset + runBytes - pos;
+            if (len > bytesToRead - bytesRead)
+                len = bytesToRead - bytesRead;
+
+            // getByteData will log any errors
+            int retval = TskServices::Instance().getImageFile().getByteData(run->first * m_carvedSectorSize + (pos - runOffset), len, buf + bytesRead);
+            if (retval == -1)
+                return -1;
+
+            bytesRead += retval;
+            if ((uint64_t)retval < len)
+                break;
+        }
+        runOffset += runBytes;
+    }
+
+    m_offset += bytesRead;
+    return (ssize_t)bytesRead;
+}
@@ -18,6 +18,8 @@
 
 // System includes
 #include <string>
+#include <vector>
+#include <utility>
 
 // Framework includes
 #include "TskFile.h"
@@ -79,7 +81,7 @@ class TSK_FRAMEWORK_API TskFileTsk : public TskFile
     // Construct a file for the given id.
 	TskFileTsk(const uint64_t id);
 
-    TskFileTsk() {};
+    TskFileTsk() { m_bytesRead = 0; };
 
     // A handle to the file on disk
     Poco::File m_file;
@@ -92,5 +94,14 @@ class TSK_FRAMEWORK_API TskFileTsk : public TskFile
 
     // For IMGDB_FILES_TYPE_UNUSED unused_sectors only
     TskUnusedSectorsRecord m_unusedSectorsRecord;
+
+    // For IMGDB_FILES_TYPE_CARVED files that are not on disk only:
+    // start and length (in image sectors) of each run of the file.
+    std::vector<std::pair<uint64_t, uint64_t> > m_carvedRuns;
+    uint64_t m_carvedSectorSize;
+
+private:
+    ssize_t readContent(char * buf, const size_t count);
+    ssize_t readCarvedRuns(char * buf, const size_t count);
 };
 #endif
@@ -16,6 +16,17 @@
 
 // System includes
 #include <sstream>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <deque>
+
+#ifndef TSK_WIN32
+#include <signal.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include <errno.h>
+#endif
 
 // Framework includes
 #include "TskExecutableModule.h"
@@ -29,17 +40,23 @@
 #include "Poco/StringTokenizer.h"
 #include "Poco/FileStream.h"
 #include "Poco/Process.h"
+#include "Poco/Exception.h"
 #include "Poco/PipeStream.h"
 #include "Poco/StreamCopier.h"
 #include "Poco/Path.h"
 #include "Poco/DateTimeFormatter.h"
 #include "Poco/DateTimeFormat.h"
 #include "Poco/Environment.h"
+#include "Poco/Thread.h"
+#include "Poco/Mutex.h"
+#include "Poco/Condition.h"
 
 /**
  * Constructor
  */
-TskExecutableModule::TskExecutableModule() : m_output("")
+TskExecutableModule::TskExecutableModule() : m_output(""), m_persistent(false),
+    m_worker(NULL), m_toWorkerPipe(NULL), m_fromWorkerPipe(NULL), m_toWorker(NULL), m_fromWorker(NULL),
+    m_reader(NULL)
 {
 }
 
@@ -48,8 +65,182 @@ TskExecutableModule::TskExecutableModule() : m_output("")
  */
 TskExecutableModule::~TskExecutableModule()
 {
+    stopWorker();
 }
 
+namespace
+{
+    const size_t READ_CHUNK_SIZE = 64 * 1024;
+
+    // How long a worker has to exit once its standard input is closed
+    // before it is killed.
+    const long WORKER_EXIT_TIMEOUT_MS = 10000;
+    const long WORKER_EXIT_POLL_MS = 50;
+
+    TskModule::Status parseStatus(const std::string& status)
+    {
+        if (status == "OK")
+            return TskModule::OK;
+        else if (status == "STOP")
+            return TskModule::STOP;
+        return TskModule::FAIL;
+    }
+
+#ifndef TSK_WIN32
+    /**
+     * Blocks SIGPIPE on the calling thread while it writes to a worker, so
+     * that writing to a worker that has exited fails with EPIPE instead of
+     * killing the process.  A SIGPIPE raised by the write is consumed
+     * before the signal mask is restored.
+     */
+    class SigPipeBlocker
+    {
+    public:
+        SigPipeBlocker()
+        {
+            sigemptyset(&m_sigPipe);
+            sigaddset(&m_sigPipe, SIGPIPE);
+
+            // Leave a SIGPIPE that was already pending for the caller.
+            sigset_t pending;
+            sigemptyset(&pending);
+            sigpending(&pending);
+            m_wasPending = (sigismember(&pending, SIGPIPE) == 1);
+
+            pthread_sigmask(SIG_BLOCK, &m_sigPipe, &m_oldMask);
+        }
+
+        ~SigPipeBlocker()
+        {
+            if (!m_wasPending)
+            {
+                sigset_t pending;
+                sigemptyset(&pending);
+                sigpending(&pending);
+                if (sigismember(&pending, SIGPIPE) == 1)
+                {
+                    int sig;
+                    sigwait(&m_sigPipe, &sig);
+                }
+            }
+            pthread_sigmask(SIG_SETMASK, &m_oldMask, NULL);
+        }
+
+    private:
+        sigset_t m_sigPipe;
+        sigset_t m_oldMask;
+        bool m_wasPending;
+    };
+#endif
+
+    /**
+     * Wait for a process to exit.  Poco::Process::wait() can not be given
+     * a time limit.
+     * @param handle The process.
+     * @param timeoutMs How long to wait, in milliseconds.
+     * @param exitCode Set to the exit code of the process if it exited.
+     * @returns true if the process exited, false if it is still running.
+     * @throws Poco::SystemException on error
+     */
+    bool waitForExit(const Poco::ProcessHandle& handle, long timeoutMs, int& exitCode)
+    {
+#ifdef TSK_WIN32
+        HANDLE process = OpenProcess(SYNCHRONIZE, FALSE, handle.id());
+        if (process == NULL)
+            throw Poco::SystemException("Cannot open process");
+        DWORD rc = WaitForSingleObject(process, timeoutMs);
+        CloseHandle(process);
+        if (rc != WAIT_OBJECT_0)
+            return false;
+        exitCode = handle.wait();
+        return true;
+#else
+        // The process is reaped here, so Poco::Process::wait() must not be
+        // called for it afterwards.  The exit code is the one it returns.
+        for (long waited = 0; ; waited += WORKER_EXIT_POLL_MS)
+        {
+            int status;
+            pid_t pid = waitpid(handle.id(), &status, WNOHANG);
+            if (pid == handle.id())
+            {
+                exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : 256 + WTERMSIG(status);
+                return true;
+            }
+            if (pid < 0 && errno != EINTR)
+                throw Poco::SystemException("Cannot wait for process");
+            if (waited >= timeoutMs)
+                return false;
+            Poco::Thread::sleep(WORKER_EXIT_POLL_MS);
+        }
+#endif
+    }
+}
+
+/**
+ * Reads the lines written by a worker process to its standard output and
+ * queues them for readWorkerReply().  Reading on a separate thread keeps
+ * the worker from blocking on a full pipe while we are still writing a
+ * file's content to it.
+ */
+class TskExecutableModule::WorkerReader : public Poco::Runnable
+{
+public:
+    WorkerReader(std::istream& input) : m_input(input), m_eof(false)
+    {
+        m_thread.start(*this);
+    }
+
+    ~WorkerReader()
+    {
+        // The thread ends when the worker closes its standard output.
+        m_thread.join();
+    }
+
+    virtual void run()
+    {
+        std::string line;
+        while (std::getline(m_input, line))
+        {
+            if (!line.empty() && line[line.size() - 1] == '\r')
+                line.erase(line.size() - 1);
+
+            Poco::FastMutex::ScopedLock lock(m_lock);
+            m_lines.push_back(line);
+            m_available.signal();
+        }
+
+        Poco::FastMutex::ScopedLock lock(m_lock);
+        m_eof = true;
+        m_available.broadcast();
+    }
+
+    /**
+     * Wait for the next line from the worker.
+     * @returns false if the worker closed its standard output.
+     */
+    bool nextLine(std::string& line)
+    {
+        Poco::FastMutex::ScopedLock lock(m_lock);
+        while (m_lines.empty() && !m_eof)
+            m_available.wait(m_lock);
+
+        if (m_lines.empty())
+            return false;
+
+        line = m_lines.front();
+        m_lines.pop_front();
+        return true;
+    }
+
+private:
+    std::istream& m_input;
+    Poco::Thread m_thread;
+    Poco::FastMutex m_lock;
+    Poco::Condition m_available;
+    std::deque<std::string> m_lines;
+    bool m_eof;
+};
+
 /**
  * Run the module on the given file.
  */
@@ -62,6 +253,24 @@ TskModule::Status TskExecutableModule::run(TskFile* fileToAnalyze)
         throw TskException("Module execution failed.");
     }
 
+    if (m_persistent)
+    {
+        // Stream the content to the worker ourselves.
+        void* context = NULL;
+        Status status = beginStream(fileToAnalyze, &context);
+        if (status != TskModule::OK)
+            return status;
+
+        std::vector<char> buffer(READ_CHUNK_SIZE);
+        ssize_t bytesRead = 0;
+        bool sent = true;
+        while (sent && (bytesRead = fileToAnalyze->read(&buffer[0], buffer.size())) > 0)
+        {
+            sent = (streamChunk(context, &buffer[0], (size_t)bytesRead) == TskModule::OK);
+        }
+        return endStream(fileToAnalyze, context, sent && bytesRead == 0);
+    }
+
     return execute(fileToAnalyze);
 }
 
@@ -70,9 +279,90 @@ TskModule::Status TskExecutableModule::run(TskFile* fileToAnalyze)
  */
 TskModule::Status TskExecutableModule::report()
 {
+    if (m_persistent)
+    {
+        try
+        {
+            if (!m_worker)
+                startWorker();
+        }
+        catch (Poco::Exception& ex)
+        {
+            std::wstringstream errorMsg;
+            errorMsg << L"TskExecutableModule::report - Error starting worker: " << ex.displayText().c_str();
+            LOGERROR(errorMsg.str());
+            return TskModule::FAIL;
+        }
+
+        if (!sendToWorker("REPORT"))
+            return TskModule::FAIL;
+        return readWorkerReply(NULL, true);
+    }
+
     return execute(NULL);
 }
 
+/**
+ * Send the header of a file to the worker process, starting the worker if
+ * it is not running.
+ */
+TskModule::Status TskExecutableModule::beginStream(TskFile* fileToAnalyze, void** context)
+{
+    *context = NULL;
+    try
+    {
+        if (!m_worker)
+            startWorker();
+    }
+    catch (Poco::Exception& ex)
+    {
+        std::wstringstream errorMsg;
+        errorMsg << L"TskExecutableModule::beginStream - Error starting worker: " << ex.displayText().c_str();
+        LOGERROR(errorMsg.str());
+        return TskModule::FAIL;
+    }
+
+    // The path is sent as a data block so that any character in it,
+    // including a newline, is passed on as is.
+    std::string path = fileToAnalyze->getFullPath();
+    std::stringstream header;
+    header << "FILE " << fileToAnalyze->getId() << " " << fileToAnalyze->getSize()
+        << " " << path.size();
+    if (!sendToWorker(header.str(), path.data(), path.size()))
+        return TskModule::FAIL;
+
+    return TskModule::OK;
+}
+
+/**
+ * Send a block of file content to the worker process.
+ */
+TskModule::Status TskExecutableModule::streamChunk(void* context, const char* buffer, size_t length)
+{
+    std::stringstream header;
+    header << "DATA " << length;
+    if (!sendToWorker(header.str(), buffer, length))
+        return TskModule::FAIL;
+
+    return TskModule::OK;
+}
+
+/**
+ * Tell the worker process that the content has all been sent (or that it
+ * will not be) and wait for its reply.
+ */
+TskModule::Status TskExecutableModule::endStream(TskFile* fileToAnalyze, void* context, bool complete)
+{
+    // The worker is not running if sending the content failed.
+    if (!m_worker)
+        return TskModule::FAIL;
+
+    if (!sendToWorker(complete ? "EOF" : "ABORT"))
+        return TskModule::FAIL;
+
+    return readWorkerReply(fileToAnalyze, complete);
+}
+
 /**
  * Confirm that an executable file exists at location.
  */
@@ -142,6 +432,228 @@ std::string TskExecutableModule::getOutput() const
     return m_output;
 }
 
+/**
+ *
+ */
+void TskExecutableModule::setPersistent(bool persistent)
+{
+    m_persistent = persistent;
+}
+
+/**
+ * Launch the executable as a worker process with pipes to its standard
+ * input and output.
+ */
+void TskExecutableModule::startWorker()
+{
+    // The arguments are the same for every file, so only system property
+    // macros can be used.
+    std::string arguments = expandArgumentMacros(m_arguments, NULL);
+    Poco::StringTokenizer tokenizer(arguments, " ");
+    std::vector<std::string> vectorArgs(tokenizer.begin(), tokenizer.end());
+
+    std::auto_ptr<Poco::Pipe> toWorkerPipe(new Poco::Pipe());
+    std::auto_ptr<Poco::Pipe> fromWorkerPipe(new Poco::Pipe());
+    Poco::ProcessHandle handle = Poco::Process::launch(m_modulePath, vectorArgs, toWorkerPipe.get(), fromWorkerPipe.get(), NULL);
+
+    m_worker = new Poco::ProcessHandle(handle);
+    m_toWorkerPipe = toWorkerPipe.release();
+    m_fromWorkerPipe = fromWorkerPipe.release();
+    m_toWorker = new Poco::PipeOutputStream(*m_toWorkerPipe);
+    m_fromWorker = new Poco::PipeInputStream(*m_fromWorkerPipe);
+    m_reader = new WorkerReader(*m_fromWorker);
+
+    std::wstringstream msg;
+    msg << L"TskExecutableModule::startWorker - Started worker process " << m_worker->id()
+        << L" for " << m_modulePath.c_str();
+    LOGINFO(msg.str());
+}
+
+/**
+ * Close the worker's standard input and wait for it to exit.  A worker
+ * that does not exit within WORKER_EXIT_TIMEOUT_MS is killed.
+ */
+void TskExecutableModule::stopWorker()
+{
+    if (!m_worker)
+        return;
+
+    try
+    {
+        {
+#ifndef TSK_WIN32
+            // Closing the stream writes what is left in its buffer.
+            SigPipeBlocker sigPipeBlocker;
+#endif
+            m_toWorker->close();
+        }
+        int exitCode = 0;
+        if (!waitForExit(*m_worker, WORKER_EXIT_TIMEOUT_MS, exitCode))
+        {
+            std::wstringstream msg;
+            msg << L"TskExecutableModule::stopWorker - Module (" << m_modulePath.c_str()
+                << L") did not exit, killing process " << m_worker->id();
+            LOGWARN(msg.str());
+
+            Poco::Process::kill(m_worker->id());
+            waitForExit(*m_worker, WORKER_EXIT_TIMEOUT_MS, exitCode);
+        }
+        else if (exitCode != 0)
+        {
+            std::wstringstream msg;
+            msg << L"TskExecutableModule::stopWorker - Module (" << m_modulePath.c_str()
+                << L") exited with exit code: " << exitCode;
+            LOGWARN(msg.str());
+        }
+    }
+    catch (Poco::Exception& ex)
+    {
+        std::wstringstream errorMsg;
+        errorMsg << L"TskExecutableModule::stopWorker - Error: " << ex.displayText().c_str();
+        LOGERROR(errorMsg.str());
+    }
+
+    // The worker has exited, so its standard output is closed.
+    delete m_reader;
+    delete m_toWorker;
+    delete m_fromWorker;
+    delete m_toWorkerPipe;
+    delete m_fromWorkerPipe;
+    delete m_worker;
+    m_reader = NULL;
+    m_toWorker = NULL;
+    m_fromWorker = NULL;
+    m_toWorkerPipe = NULL;
+    m_fromWorkerPipe = NULL;
+    m_worker = NULL;
+}
+
+/**
+ * Write a request line and optional data to the worker.  The worker is
+ * stopped if it can not be written to.
+ * @returns true on success
+ */
+bool TskExecutableModule::sendToWorker(const std::string& line, const char* data, size_t length)
+{
+    if (!m_worker)
+        return false;
+
+#ifndef TSK_WIN32
+    SigPipeBlocker sigPipeBlocker;
+#endif
+
+    bool ok = true;
+    try
+    {
+        *m_toWorker << line << "\n";
+        if (data && length)
+            m_toWorker->write(data, length);
+        if (!data)
+            m_toWorker->flush();
+        ok = m_toWorker->good();
+    }
+    catch (std::exception&)
+    {
+        ok = false;
+    }
+
+    if (!ok)
+    {
+        std::wstringstream msg;
+        msg << L"TskExecutableModule::sendToWorker - Module (" << m_modulePath.c_str()
+            << L") is no longer accepting requests";
+        LOGERROR(msg.str());
+        stopWorker();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Read the worker's reply to a request up to the END line.
+ * @param fileToAnalyze File that the request was for or NULL.
+ * @param keepOutput false if OUT lines should be discarded.
+ * @returns Status given by the worker, or FAIL if it exited.
+ */
+TskModule::Status TskExecutableModule::readWorkerReply(TskFile* fileToAnalyze, bool keepOutput)
+{
+    std::vector<std::string> output;
+    std::string line;
+
+    while (m_reader->nextLine(line))
+    {
+        if (line.compare(0, 4, "END ") == 0 || line == "END")
+        {
+            if (keepOutput && !output.empty())
+                writeOutput(fileToAnalyze, output);
+            return parseStatus(line.size() > 4 ? line.substr(4) : "OK");
+        }
+        else if (line.compare(0, 4, "OUT ") == 0 || line == "OUT")
+        {
+            output.push_back(line.size() > 4 ? line.substr(4) : "");
+        }
+        else if (line.compare(0, 4, "LOG ") == 0)
+        {
+            std::wstringstream msg;
+            msg << m_name.c_str() << L": " << line.substr(4).c_str();
+            LOGINFO(msg.str());
+        }
+        else if (line.compare(0, 6, "ERROR ") == 0)
+        {
+            std::wstringstream msg;
+            msg << m_name.c_str() << L": " << line.substr(6).c_str();
+            LOGERROR(msg.str());
+        }
+        else
+        {
+            std::wstringstream msg;
+            msg << L"TskExecutableModule::readWorkerReply - Unexpected reply from module ("
+                << m_modulePath.c_str() << L"): " << line.c_str();
+            LOGWARN(msg.str());
+        }
+    }
+
+    std::wstringstream msg;
+    msg << L"TskExecutableModule::readWorkerReply - Module (" << m_modulePath.c_str()
+        << L") exited before replying";
+    LOGERROR(msg.str());
+    stopWorker();
+    return TskModule::FAIL;
+}
+
+/**
+ * Append the OUT lines of a reply to the output file, or to stdout if
+ * the module has none.
+ */
+void TskExecutableModule::writeOutput(TskFile* fileToAnalyze, const std::vector<std::string>& lines)
+{
+    std::string outFilePath = expandArgumentMacros(m_output, fileToAnalyze);
+
+    if (outFilePath.empty())
+    {
+        for (std::vector<std::string>::const_iterator it = lines.begin(); it != lines.end(); ++it)
+            std::cout << *it << std::endl;
+        return;
+    }
+
+    try
+    {
+        std::string outFilePathNoQuote(TskUtilities::stripQuotes(outFilePath));
+        Poco::File outDir(Poco::Path(outFilePathNoQuote).parent());
+        outDir.createDirectories();
+
+        Poco::FileOutputStream ostr(outFilePathNoQuote, std::ios::out|std::ios::app);
+        for (std::vector<std::string>::const_iterator it = lines.begin(); it != lines.end(); ++it)
+            ostr << *it << "\n";
+    }
+    catch (Poco::Exception& ex)
+    {
+        std::wstringstream errorMsg;
+        errorMsg << L"TskExecutableModule::writeOutput - Error: " << ex.displayText().c_str();
+        LOGERROR(errorMsg.str());
+    }
+}
+
 TskModule::Status TskExecutableModule::execute(TskFile * fileToAnalyze){
     try
     {
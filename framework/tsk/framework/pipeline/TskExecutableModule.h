@@ -13,9 +13,45 @@
 
 #include "TskModule.h"
 
+#include <vector>
+
+namespace Poco
+{
+    class ProcessHandle;
+    class Pipe;
+    class PipeInputStream;
+    class PipeOutputStream;
+}
+
 /**
  * Supports launching a process via an executable file to perform
  * some analysis on a TskFile object in a TskPipeline.
+ *
+ * By default the executable is launched once for every file, after the
+ * file has been saved to disk.  A persistent module instead launches the
+ * executable once (the first time it is needed) and keeps it running as a
+ * worker process.  The content of each file is streamed to the worker's
+ * standard input, so the file is never saved to disk, and the worker
+ * replies on its standard output.  Requests are made of lines and data
+ * blocks:
+ *
+ * - <tt>FILE <id> <size> <length></tt> starts a file.  It is followed by
+ *   length bytes holding the UTF-8 path of the file (which may contain
+ *   any character, including a newline), then by any number of
+ *   <tt>DATA <length></tt> lines, each followed by length bytes of content,
+ *   and then by <tt>EOF</tt> or, if the content could not all be sent, by
+ *   <tt>ABORT</tt>.
+ * - <tt>REPORT</tt> is sent when the module is run in a reporting pipeline.
+ *
+ * The worker answers each request with any number of <tt>OUT <text></tt>
+ * lines (written to the module's output file, or to stdout if it has none),
+ * <tt>LOG <text></tt> and <tt>ERROR <text></tt> lines (written to the log)
+ * and then a single <tt>END OK</tt>, <tt>END FAIL</tt> or <tt>END STOP</tt>
+ * line with the status of the module.  The worker should exit when its
+ * standard input is closed; it is killed if it is still running ten
+ * seconds later.  If it exits early it is launched again for the next
+ * file.  The worker's standard output is read on a separate thread, so a
+ * worker may reply before it has read all of a file's content.
  */
 class TSK_FRAMEWORK_API TskExecutableModule: public TskModule
 {
@@ -29,6 +65,11 @@ class TSK_FRAMEWORK_API TskExecutableModule: public TskModule
     virtual Status run(TskFile* fileToAnalyze);
     virtual Status report();
 
+    virtual bool supportsStreaming() const { return m_persistent; }
+    virtual Status beginStream(TskFile* fileToAnalyze, void** context);
+    virtual Status streamChunk(void* context, const char* buffer, size_t length);
+    virtual Status endStream(TskFile* fileToAnalyze, void* context, bool complete);
+
     /// Set the path of the executable to run.
     virtual void setPath(const std::string& location);
 
@@ -37,10 +78,35 @@ class TSK_FRAMEWORK_API TskExecutableModule: public TskModule
 
     std::string getOutput() const;
 
+    /// Set whether the executable is run once as a persistent worker process.
+    void setPersistent(bool persistent);
+
+    bool isPersistent() const { return m_persistent; }
+
 private:
+    // Disallow copying
+    TskExecutableModule(const TskExecutableModule&);
+    TskExecutableModule& operator=(const TskExecutableModule&);
+
     std::string m_output;
     Status execute(TskFile* fileToAnalyze);
 
+    // Reads the worker's standard output on its own thread.
+    class WorkerReader;
+
+    void startWorker();
+    void stopWorker();
+    bool sendToWorker(const std::string& line, const char* data = NULL, size_t length = 0);
+    Status readWorkerReply(TskFile* fileToAnalyze, bool keepOutput);
+    void writeOutput(TskFile* fileToAnalyze, const std::vector<std::string>& lines);
+
+    bool m_persistent;
+    Poco::ProcessHandle* m_worker;
+    Poco::Pipe* m_toWorkerPipe;
+    Poco::Pipe* m_fromWorkerPipe;
+    Poco::PipeOutputStream* m_toWorker;
+    Poco::PipeInputStream* m_fromWorker;
+    WorkerReader* m_reader;
 };
 
 #endif
@@ -28,6 +28,13 @@
 #include <sstream>
 #include <memory>
 
+namespace
+{
+    // Size of the chunks that are read once and given to all of the
+    // streaming modules.
+    const size_t STREAM_CHUNK_SIZE = 1024 * 1024;
+}
+
 void TskFileAnalysisPipeline::run(const uint64_t fileId)
 {
     // Get a file object for the given fileId
@@ -94,21 +101,42 @@ void TskFileAnalysisPipeline::run(TskFile* file)
         }
 
         bool bModuleFailed = false;
+        std::vector<TskModule::Status> streamStatus(m_modules.size(), TskModule::OK);
 
         Poco::Stopwatch stopWatch;
         for (size_t i = 0; i < m_modules.size(); i++)
         {
-            // we have no way of knowing if the file was closed by a module,
-            // so always make sure it is open
-            file->open();
+            TskModule::Status status;
+            if (m_modules[i]->supportsStreaming())
+            {
+                // Consecutive streaming modules get the content in a single
+                // pass when the first of them is reached. Their status is
+                // then handled in pipeline order.
+                if (i == 0 || !m_modules[i - 1]->supportsStreaming())
+                    streamContent(file, i, streamStatus);
+                status = streamStatus[i];
+            }
+            else
+            {
+                // we have no way of knowing if the file was closed by a module,
+                // so always make sure it is open
+                file->open();
 
-            // Reset the file offset to the beginning of the file.
-            file->seek(0);
+                // Reset the file offset to the beginning of the file.
+                file->seek(0);
 
-            stopWatch.restart();
-            TskModule::Status status = m_modules[i]->run(file);
-            stopWatch.stop();            
-            updateModuleExecutionTime(m_modules[i]->getModuleId(), stopWatch.elapsed());
+                // Only the content that the module reads through the file
+                // object is counted.  An executable module that reads the
+                // saved file itself is counted as reading nothing.
+                file->resetBytesRead();
+
+                Poco::Timespan::TimeDiff cpuStart = TskPipelineProfile::threadCpuTime();
+                stopWatch.restart();
+                status = m_modules[i]->run(file);
+                stopWatch.stop();            
+                recordModuleRun(m_modules[i]->getModuleId(), stopWatch.elapsed(),
+                    TskPipelineProfile::threadCpuTime() - cpuStart, file->getBytesRead(), status);
+            }
             
             imgDB.setModuleStatus(file->getId(), m_modules[i]->getModuleId(), (int)status);
 
@@ -159,3 +187,133 @@ void TskFileAnalysisPipeline::run(TskFile* file)
         throw;
     }
 }
+
+/**
+ * Reads the content of the file once and gives each chunk to the module at
+ * first and to the streaming modules that directly follow it in the
+ * pipeline.  If a module returns STOP, the streaming modules after it are
+ * told that the content is incomplete so that they do not post results for
+ * a file that the pipeline would not have given them.
+ * @param file File to stream.
+ * @param first Index of the first module to stream to.
+ * @param statuses Set to the status of each module that was streamed to.
+ */
+void TskFileAnalysisPipeline::streamContent(TskFile *file, size_t first, std::vector<TskModule::Status> &statuses)
+{
+    size_t last = first;
+    while (last < m_modules.size() && m_modules[last]->supportsStreaming())
+        last++;
+
+    std::vector<size_t> active;
+    for (size_t i = first; i < last; i++)
+        active.push_back(i);
+    if (active.empty())
+        return;
+
+    std::vector<void *> contexts(m_modules.size(), (void *)NULL);
+    std::vector<bool> ended(m_modules.size(), true);
+    std::vector<Poco::Timespan::TimeDiff> times(m_modules.size(), 0);
+    std::vector<Poco::Timespan::TimeDiff> cpuTimes(m_modules.size(), 0);
+    std::vector<uint64_t> bytesStreamed(m_modules.size(), 0);
+    Poco::Stopwatch stopWatch;
+    Poco::Timespan::TimeDiff cpuStart;
+
+    // Index of the first module that asked the pipeline to stop.
+    size_t stopIndex = m_modules.size();
+
+    for (std::vector<size_t>::iterator it = active.begin(); it != active.end(); )
+    {
+        cpuStart = TskPipelineProfile::threadCpuTime();
+        stopWatch.restart();
+        statuses[*it] = m_modules[*it]->beginStream(file, &contexts[*it]);
+        stopWatch.stop();
+        times[*it] += stopWatch.elapsed();
+        cpuTimes[*it] += TskPipelineProfile::threadCpuTime() - cpuStart;
+
+        if (statuses[*it] == TskModule::OK)
+        {
+            ended[*it] = false;
+            it++;
+        }
+        else
+        {
+            if (statuses[*it] == TskModule::STOP && *it < stopIndex)
+                stopIndex = *it;
+            it = active.erase(it);
+        }
+    }
+
+    bool complete = true;
+
+    if (m_streamBuffer.empty())
+        m_streamBuffer.resize(STREAM_CHUNK_SIZE);
+
+    file->open();
+    file->seek(0);
+    while (!active.empty())
+    {
+        ssize_t bytesRead = file->read(&m_streamBuffer[0], m_streamBuffer.size());
+        if (bytesRead == 0)
+            break;
+        if (bytesRead < 0)
+        {
+            std::stringstream msg;
+            msg << "TskFileAnalysisPipeline::streamContent : error reading file id (" << file->getId() << ")";
+            LOGERROR(msg.str());
+            complete = false;
+            break;
+        }
+
+        for (std::vector<size_t>::iterator it = active.begin(); it != active.end(); )
+        {
+            size_t i = *it;
+            if (i > stopIndex)
+            {
+                it = active.erase(it);
+                continue;
+            }
+
+            cpuStart = TskPipelineProfile::threadCpuTime();
+            stopWatch.restart();
+            TskModule::Status status = m_modules[i]->streamChunk(contexts[i], &m_streamBuffer[0], (size_t)bytesRead);
+            stopWatch.stop();
+            times[i] += stopWatch.elapsed();
+            cpuTimes[i] += TskPipelineProfile::threadCpuTime() - cpuStart;
+            bytesStreamed[i] += (uint64_t)bytesRead;
+
+            if (status == TskModule::OK)
+            {
+                it++;
+                continue;
+            }
+
+            // This module gets no more content.
+            statuses[i] = status;
+            cpuStart = TskPipelineProfile::threadCpuTime();
+            stopWatch.restart();
+            m_modules[i]->endStream(file, contexts[i], false);
+            stopWatch.stop();
+            times[i] += stopWatch.elapsed();
+            cpuTimes[i] += TskPipelineProfile::threadCpuTime() - cpuStart;
+            ended[i] = true;
+            it = active.erase(it);
+
+            if (status == TskModule::STOP && i < stopIndex)
+                stopIndex = i;
+        }
+    }
+
+    for (size_t i = first; i < last; i++)
+    {
+        if (!ended[i])
+        {
+            cpuStart = TskPipelineProfile::threadCpuTime();
+            stopWatch.restart();
+            statuses[i] = m_modules[i]->endStream(file, contexts[i], complete && i < stopIndex);
+            stopWatch.stop();
+            times[i] += stopWatch.elapsed();
+            cpuTimes[i] += TskPipelineProfile::threadCpuTime() - cpuStart;
+        }
+        recordModuleRun(m_modules[i]->getModuleId(), times[i], cpuTimes[i], bytesStreamed[i], statuses[i]);
+    }
+}
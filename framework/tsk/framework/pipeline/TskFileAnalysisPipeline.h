@@ -23,6 +23,7 @@
 
 // C/C++ library includes
 #include <string>
+#include <vector>
 
 /**
  * Controls the processing of a file analysis pipeline.  
@@ -47,6 +48,11 @@ class TSK_FRAMEWORK_API TskFileAnalysisPipeline : public TskPipeline
     { 
         return (new TskFileAnalysisPluginModule());
     }
+
+private:
+    void streamContent(TskFile *file, size_t first, std::vector<TskModule::Status> &statuses);
+
+    std::vector<char> m_streamBuffer;   ///< Chunk buffer for streaming modules
 };
 
 #endif
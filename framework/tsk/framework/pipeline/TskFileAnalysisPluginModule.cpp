@@ -23,6 +23,11 @@
 // C/C++ library includes
 #include <sstream>
 
+TskFileAnalysisPluginModule::TskFileAnalysisPluginModule()
+    : m_beginStream(NULL), m_streamChunk(NULL), m_endStream(NULL)
+{
+}
+
 TskModule::Status TskFileAnalysisPluginModule::run(TskFile *fileToAnalyze)
 {
     const std::string MSG_PREFIX = "TskFileAnalysisPluginModule::run : ";
@@ -79,6 +84,80 @@ TskModule::Status TskFileAnalysisPluginModule::run(TskFile *fileToAnalyze)
     return status;
 }
 
+bool TskFileAnalysisPluginModule::supportsStreaming() const
+{
+    return m_beginStream != NULL && m_streamChunk != NULL && m_endStream != NULL;
+}
+
+TskModule::Status TskFileAnalysisPluginModule::beginStream(TskFile *fileToAnalyze, void **context)
+{
+    try
+    {
+        return m_beginStream(fileToAnalyze, context);
+    }
+    catch (...)
+    {
+        return logException(TskPluginModule::BEGIN_STREAM_SYMBOL, "TskFileAnalysisPluginModule::beginStream : ");
+    }
+}
+
+TskModule::Status TskFileAnalysisPluginModule::streamChunk(void *context, const char *buffer, size_t length)
+{
+    try
+    {
+        return m_streamChunk(context, buffer, length);
+    }
+    catch (...)
+    {
+        return logException(TskPluginModule::STREAM_CHUNK_SYMBOL, "TskFileAnalysisPluginModule::streamChunk : ");
+    }
+}
+
+TskModule::Status TskFileAnalysisPluginModule::endStream(TskFile *fileToAnalyze, void *context, bool complete)
+{
+    try
+    {
+        return m_endStream(fileToAnalyze, context, complete);
+    }
+    catch (...)
+    {
+        return logException(TskPluginModule::END_STREAM_SYMBOL, "TskFileAnalysisPluginModule::endStream : ");
+    }
+}
+
+/**
+ * Logs the exception that is currently being handled.  Must be called from
+ * within a catch block.
+ * @returns TskModule::FAIL
+ */
+TskModule::Status TskFileAnalysisPluginModule::logException(const std::string &function, const std::string &msgPrefix)
+{
+    std::stringstream msg;
+    msg << msgPrefix;
+    try
+    {
+        throw;
+    }
+    catch (TskException &ex) 
+    {
+        msg << "TskException executing " << function << " function of " << getName() << ": " << ex.message();
+    }
+    catch (Poco::Exception &ex) 
+    {
+        msg << "Poco::Exception executing " << function << " function of " << getName() << ": " << ex.displayText();
+    }
+    catch (std::exception &ex) 
+    {
+        msg << "std::exception executing " << function << " function of " << getName() << ": " << ex.what();
+    }
+    catch (...)
+    {
+        msg << "unrecognized exception executing " << function << " function of " << getName();
+    }
+    LOGERROR(msg.str());
+    return TskModule::FAIL;
+}
+
 void TskFileAnalysisPluginModule::checkInterface()
 {
     const std::string MSG_PREFIX = "TskFileAnalysisPluginModule::checkInterface : ";
@@ -97,4 +176,14 @@ void TskFileAnalysisPluginModule::checkInterface()
         msg << MSG_PREFIX << getPath() << " does not define the required '" << TskPluginModule::RUN_SYMBOL << "' symbol";
         throw TskException(msg.str());
     }
+
+    // The streaming interface is optional, but it is all or nothing.
+    if (hasSymbol(TskPluginModule::BEGIN_STREAM_SYMBOL) &&
+        hasSymbol(TskPluginModule::STREAM_CHUNK_SYMBOL) &&
+        hasSymbol(TskPluginModule::END_STREAM_SYMBOL))
+    {
+        m_beginStream = (BeginStreamFunc)getSymbol(TskPluginModule::BEGIN_STREAM_SYMBOL);
+        m_streamChunk = (StreamChunkFunc)getSymbol(TskPluginModule::STREAM_CHUNK_SYMBOL);
+        m_endStream = (EndStreamFunc)getSymbol(TskPluginModule::END_STREAM_SYMBOL);
+    }
 }
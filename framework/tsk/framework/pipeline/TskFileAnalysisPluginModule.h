@@ -21,11 +21,40 @@
 class TSK_FRAMEWORK_API TskFileAnalysisPluginModule: public TskPluginModule
 {
 public:
+    TskFileAnalysisPluginModule();
+
     // Doxygen comment in base class.
     virtual Status run(TskFile *fileToAnalyze);
 
+    /**
+     * Returns true if the module library defines all of the optional
+     * 'beginStream', 'streamChunk' and 'endStream' symbols.
+     */
+    virtual bool supportsStreaming() const;
+
+    // Doxygen comment in base class.
+    virtual Status beginStream(TskFile *fileToAnalyze, void **context);
+
+    // Doxygen comment in base class.
+    virtual Status streamChunk(void *context, const char *buffer, size_t length);
+
+    // Doxygen comment in base class.
+    virtual Status endStream(TskFile *fileToAnalyze, void *context, bool complete);
+
     // Doxygen comment in base class.
     virtual void checkInterface();
+
+private:
+    typedef TskModule::Status (*BeginStreamFunc)(TskFile*, void**);
+    typedef TskModule::Status (*StreamChunkFunc)(void*, const char*, size_t);
+    typedef TskModule::Status (*EndStreamFunc)(TskFile*, void*, bool);
+
+    // Streaming functions of the module library, looked up by checkInterface().
+    BeginStreamFunc m_beginStream;
+    StreamChunkFunc m_streamChunk;
+    EndStreamFunc m_endStream;
+
+    Status logException(const std::string &function, const std::string &msgPrefix);
 };
 
 #endif
@@ -62,6 +62,50 @@ class TSK_FRAMEWORK_API TskModule
      */
     virtual Status report() { return TskModule::OK; };
 
+    /**
+     * Returns true if the module can analyze the content of a file that is
+     * pushed to it in sequential chunks through beginStream(), streamChunk()
+     * and endStream() instead of being run(). The file analysis pipeline
+     * reads the content of each file once and hands every chunk to all of
+     * the streaming modules that are next to each other in the pipeline.
+     * Modules that need random access to the content
+     * should return false (the default) and implement run() only.
+     */
+    virtual bool supportsStreaming() const { return false; }
+
+    /**
+     * Called before the first chunk of a file is streamed to the module.
+     * @param fileToAnalyze File whose content is going to be streamed.
+     * @param context Set by the module to whatever per-file state it needs.
+     * It is passed back to streamChunk() and endStream().
+     * @returns Status of module. No chunks are sent and endStream() is not
+     * called unless OK is returned.
+     */
+    virtual Status beginStream(TskFile* fileToAnalyze, void** context) { return TskModule::OK; }
+
+    /**
+     * Called for each chunk of the file content, in order.
+     * @param context Value set by beginStream().
+     * @param buffer Content of the chunk.
+     * @param length Number of bytes in buffer.
+     * @returns Status of module. The module gets no more chunks if anything
+     * other than OK is returned.
+     */
+    virtual Status streamChunk(void* context, const char* buffer, size_t length) { return TskModule::OK; }
+
+    /**
+     * Called once for every successful beginStream() after the last chunk.
+     * The module must release its context here.
+     * @param fileToAnalyze File whose content was streamed.
+     * @param context Value set by beginStream().
+     * @param complete false if the module did not get all of the content,
+     * because of a read error or because the module or an earlier one in the
+     * pipeline stopped. The module should not post results in that case
+     * and should return FAIL.
+     * @returns Status of module for the file.
+     */
+    virtual Status endStream(TskFile* fileToAnalyze, void* context, bool complete) { return TskModule::OK; }
+
     virtual void setPath(const std::string& location);
 
     /**
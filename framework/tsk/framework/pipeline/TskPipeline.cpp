@@ -27,6 +27,7 @@
 // Poco includes
 #include "Poco/AutoPtr.h"
 #include "Poco/NumberParser.h"
+#include "Poco/String.h"
 #include "Poco/DOM/DOMParser.h"
 #include "Poco/DOM/NodeList.h"
 #include "Poco/DOM/Document.h"
@@ -43,6 +44,7 @@ const std::string TskPipeline::MODULE_ORDER_ATTR = "order";
 const std::string TskPipeline::MODULE_LOCATION_ATTR = "location";
 const std::string TskPipeline::MODULE_ARGS_ATTR = "arguments";
 const std::string TskPipeline::MODULE_OUTPUT_ATTR = "output";
+const std::string TskPipeline::MODULE_PERSISTENT_ATTR = "persistent";
 const std::string TskPipeline::MODULE_EXECUTABLE_TYPE = "executable";
 const std::string TskPipeline::MODULE_PLUGIN_TYPE = "plugin";
 
@@ -152,8 +154,7 @@ void TskPipeline::initialize(const std::string & pipelineConfig)
                 else 
                 {
                     pModule->setModuleId(moduleId);
-                    m_moduleNames.insert(std::make_pair(moduleId, pModule->getName()));
-                    m_moduleExecTimes.insert(std::make_pair(moduleId, Poco::Timespan()));
+                    m_profile.addModule(moduleId, pModule->getName());
                 }
                 bool duplicate = false;
                 for (std::vector<TskModule*>::iterator it = m_modules.begin(); it != m_modules.end(); it++) {
@@ -202,8 +203,12 @@ TskModule * TskPipeline::createModule(Poco::XML::Element *pElem)
             //pModule->setPath(pElem->getAttribute(TskPipeline::MODULE_LOCATION_ATTR));
             pModule->setArguments(pElem->getAttribute(TskPipeline::MODULE_ARGS_ATTR));
             pModule->setOutput(pElem->getAttribute(TskPipeline::MODULE_OUTPUT_ATTR));
+            pModule->setPersistent(Poco::icompare(pElem->getAttribute(TskPipeline::MODULE_PERSISTENT_ATTR), "true") == 0);
 
-            m_hasExeModule = true;
+            // Persistent modules are sent the file content over a pipe, so
+            // the file only has to be saved for the other kind.
+            if (!pModule->isPersistent())
+                m_hasExeModule = true;
 
             // The module was successfully created so we no longer need the
             // auto_ptr to manage it.
@@ -265,13 +270,16 @@ TskModule * TskPipeline::createModule(Poco::XML::Element *pElem)
 
 void TskPipeline::logModuleExecutionTimes() const
 {
-    for (std::map<int, Poco::Timespan>::const_iterator it = m_moduleExecTimes.begin(); it != m_moduleExecTimes.end(); ++it)
+    const TskPipelineProfile::ModuleStatsMap &stats = m_profile.getModuleStats();
+    for (TskPipelineProfile::ModuleStatsMap::const_iterator it = stats.begin(); it != stats.end(); ++it)
     {
-        assert(m_moduleNames.find(it->first) != m_moduleNames.end());
+        Poco::Timespan total(it->second.wallTime);
         std::stringstream msg;
-        msg << "TskPipeline::logModuleExecutionTimes : "  << m_moduleNames.find(it->first)->second << " total execution time was "
-        << it->second.days() << ":" << it->second.hours() << ":" << it->second.minutes() << ":" << it->second.seconds() << ":" << it->second.milliseconds()
-        << " (days:hrs:mins:secs:ms)";
+        msg << "TskPipeline::logModuleExecutionTimes : "  << it->second.name << " total execution time was "
+        << total.days() << ":" << total.hours() << ":" << total.minutes() << ":" << total.seconds() << ":" << total.milliseconds()
+        << " (days:hrs:mins:secs:ms), CPU time " << it->second.cpuTime / 1000 << " ms, "
+        << it->second.invocations << " runs (" << it->second.failures << " failed, " << it->second.stops << " stopped), "
+        << it->second.bytes << " bytes";
         LOGINFO(msg.str());
     }
 }
@@ -293,15 +301,21 @@ bool TskPipeline::excludeFile(const TskFile* file)
 
 void TskPipeline::updateModuleExecutionTime(int moduleId, const Poco::Timespan::TimeDiff &executionTime)
 {
-    std::map<int, Poco::Timespan>::iterator it = m_moduleExecTimes.find(moduleId);
-    if (it != m_moduleExecTimes.end())
+    if (!m_profile.addTime(moduleId, executionTime))
     {
-        it->second += executionTime;
+        std::stringstream msg;
+        msg << "TskPipeline::updateModuleExecutionTime : unknown moduleId " << moduleId;
+        LOGERROR(msg.str());
     }
-    else
+}
+
+void TskPipeline::recordModuleRun(int moduleId, Poco::Timespan::TimeDiff wallTime, Poco::Timespan::TimeDiff cpuTime,
+    uint64_t bytes, TskModule::Status status)
+{
+    if (!m_profile.record(moduleId, wallTime, cpuTime, bytes, status))
     {
         std::stringstream msg;
-        msg << "TskPipeline::updateModuleExecutionTime : unknown moduleId " << moduleId;
+        msg << "TskPipeline::recordModuleRun : unknown moduleId " << moduleId;
         LOGERROR(msg.str());
     }
 }
@@ -23,6 +23,7 @@
 // TSK Framework includes
 #include "TskModule.h"
 #include "TskPluginModule.h"
+#include "TskPipelineProfile.h"
 
 // Poco includes
 #include "Poco/DOM/Element.h"
@@ -49,6 +50,7 @@ class TSK_FRAMEWORK_API TskPipeline
     static const std::string MODULE_LOCATION_ATTR; ///< attribute for module location in XML config file
     static const std::string MODULE_ARGS_ATTR; ///< attribute for module arguments in XML config file
     static const std::string MODULE_OUTPUT_ATTR; ///< attribute for module output in XML config file
+    static const std::string MODULE_PERSISTENT_ATTR; ///< attribute for running an executable module as a persistent worker in XML config file
     static const std::string MODULE_EXECUTABLE_TYPE; ///< value of MODULE_TYPE_ATTR for executable modules
     static const std::string MODULE_PLUGIN_TYPE; ///< value of MODULE_TYPE_ATTR for library modules
 
@@ -111,6 +113,12 @@ class TSK_FRAMEWORK_API TskPipeline
      */
     void logModuleExecutionTimes() const;
 
+    /**
+     * @returns The per-module timing and throughput counters recorded
+     * while the pipeline ran.
+     */
+    const TskPipelineProfile &getProfile() const { return m_profile; }
+
 protected:
     /**
      * Determine whether a particular file should be processed.
@@ -125,12 +133,23 @@ class TSK_FRAMEWORK_API TskPipeline
      */
     void updateModuleExecutionTime(int moduleId, const Poco::Timespan::TimeDiff &executionTime);
 
+    /**
+     * Records one invocation of a module in the pipeline profile.
+     * @param moduleId Module ID of the module.
+     * @param wallTime Wall clock time of the invocation (microseconds).
+     * @param cpuTime CPU time of the invocation (microseconds).
+     * @param bytes Number of content bytes given to the module.
+     * @param status Status returned by the module.
+     */
+    void recordModuleRun(int moduleId, Poco::Timespan::TimeDiff wallTime, Poco::Timespan::TimeDiff cpuTime,
+        uint64_t bytes, TskModule::Status status);
+
     /**
      * Collection of modules in the pipeline.
      */
     std::vector<TskModule*> m_modules;
 
-    bool m_hasExeModule;    ///< True if any module is an executable module
+    bool m_hasExeModule;    ///< True if any module is an executable module that needs files saved to disk
 
 private:
     // Disallow copying
@@ -147,14 +166,9 @@ class TSK_FRAMEWORK_API TskPipeline
     bool m_loadDll;     ///< True if dlls should be loaded during initialize
     
     /**
-     * A mapping of module IDs to module names.
-     */
-    std::map<int, std::string> m_moduleNames;
-
-    /**
-     * A mapping of module IDs to cumulative module execution times.
+     * Module names and execution counters, keyed by module ID.
      */
-    std::map<int, Poco::Timespan> m_moduleExecTimes;
+    TskPipelineProfile m_profile;
 };
 
 #endif
@@ -0,0 +1,211 @@
+/*
+ * The Sleuth Kit
+ *
+ * Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+ * Copyright (c) 2012 Basis Technology Corporation. All Rights
+ * reserved.
+ *
+ * This software is distributed under the Common Public License 1.0
+ */
+
+/**
+ * \file TskPipelineProfile.cpp
+ * Contains the implementation of the TskPipelineProfile class.
+ */
+
+// Include the class definition first to ensure it does not depend on subsequent includes in this file.
+#include "TskPipelineProfile.h"
+
+// C/C++ library includes
+#include <string.h>
+#include <time.h>
+
+#ifdef TSK_WIN32
+#include <windows.h>
+#endif
+
+namespace
+{
+    /// @returns The histogram bucket for a wall clock time.
+    int bucketOf(Poco::Timespan::TimeDiff wallTime)
+    {
+        int bucket = 0;
+        while (bucket < TskPipelineProfile::NUM_BUCKETS - 1 && wallTime >= ((Poco::Timespan::TimeDiff)1 << bucket))
+            bucket++;
+        return bucket;
+    }
+
+    /// Write a string as a JSON string literal.
+    void writeJsonString(std::ostream &out, const std::string &str)
+    {
+        out << '"';
+        for (std::string::const_iterator it = str.begin(); it != str.end(); ++it)
+        {
+            switch (*it)
+            {
+            case '"':
+                out << "\\\"";
+                break;
+            case '\\':
+                out << "\\\\";
+                break;
+            case '\n':
+                out << "\\n";
+                break;
+            case '\r':
+                out << "\\r";
+                break;
+            case '\t':
+                out << "\\t";
+                break;
+            default:
+                if ((unsigned char)*it < 0x20)
+                {
+                    const char hex[] = "0123456789abcdef";
+                    out << "\\u00" << hex[(*it >> 4) & 0xf] << hex[*it & 0xf];
+                }
+                else
+                {
+                    out << *it;
+                }
+            }
+        }
+        out << '"';
+    }
+}
+
+TskPipelineProfile::ModuleStats::ModuleStats()
+    : invocations(0), failures(0), stops(0), bytes(0), wallTime(0), cpuTime(0)
+{
+    memset(wallHistogram, 0, sizeof(wallHistogram));
+}
+
+void TskPipelineProfile::addModule(int moduleId, const std::string &name)
+{
+    m_modules[moduleId].name = name;
+}
+
+bool TskPipelineProfile::record(int moduleId, Poco::Timespan::TimeDiff wallTime, Poco::Timespan::TimeDiff cpuTime,
+    uint64_t bytes, TskModule::Status status)
+{
+    ModuleStatsMap::iterator it = m_modules.find(moduleId);
+    if (it == m_modules.end())
+        return false;
+
+    ModuleStats &stats = it->second;
+    stats.invocations++;
+    if (status == TskModule::FAIL)
+        stats.failures++;
+    else if (status == TskModule::STOP)
+        stats.stops++;
+    stats.bytes += bytes;
+    stats.wallTime += wallTime;
+    stats.cpuTime += cpuTime;
+    stats.wallHistogram[bucketOf(wallTime)]++;
+    return true;
+}
+
+bool TskPipelineProfile::addTime(int moduleId, Poco::Timespan::TimeDiff wallTime)
+{
+    ModuleStatsMap::iterator it = m_modules.find(moduleId);
+    if (it == m_modules.end())
+        return false;
+
+    it->second.wallTime += wallTime;
+    return true;
+}
+
+void TskPipelineProfile::merge(const TskPipelineProfile &other)
+{
+    for (ModuleStatsMap::const_iterator it = other.m_modules.begin(); it != other.m_modules.end(); ++it)
+    {
+        ModuleStats &stats = m_modules[it->first];
+        if (stats.name.empty())
+            stats.name = it->second.name;
+        stats.invocations += it->second.invocations;
+        stats.failures += it->second.failures;
+        stats.stops += it->second.stops;
+        stats.bytes += it->second.bytes;
+        stats.wallTime += it->second.wallTime;
+        stats.cpuTime += it->second.cpuTime;
+        for (int i = 0; i < NUM_BUCKETS; i++)
+            stats.wallHistogram[i] += it->second.wallHistogram[i];
+    }
+}
+
+void TskPipelineProfile::writeJson(std::ostream &out, int indent) const
+{
+    const std::string pad(indent, ' ');
+
+    out << "[";
+    for (ModuleStatsMap::const_iterator it = m_modules.begin(); it != m_modules.end(); ++it)
+    {
+        const ModuleStats &stats = it->second;
+        if (it != m_modules.begin())
+            out << ",";
+        out << "\n" << pad << "  {\n";
+        out << pad << "    \"id\": " << it->first << ",\n";
+        out << pad << "    \"name\": ";
+        writeJsonString(out, stats.name);
+        out << ",\n";
+        out << pad << "    \"invocations\": " << stats.invocations << ",\n";
+        out << pad << "    \"failures\": " << stats.failures << ",\n";
+        out << pad << "    \"stops\": " << stats.stops << ",\n";
+        out << pad << "    \"bytes\": " << stats.bytes << ",\n";
+        out << pad << "    \"wall_us\": " << stats.wallTime << ",\n";
+        out << pad << "    \"cpu_us\": " << stats.cpuTime << ",\n";
+
+        // Throughput is in bytes per second of wall clock time.
+        uint64_t throughput = 0;
+        if (stats.wallTime > 0)
+            throughput = (uint64_t)((double)stats.bytes * 1000000.0 / (double)stats.wallTime);
+        out << pad << "    \"bytes_per_sec\": " << throughput << ",\n";
+
+        // Only the buckets that were used are written.
+        out << pad << "    \"wall_histogram\": [";
+        bool first = true;
+        for (int i = 0; i < NUM_BUCKETS; i++)
+        {
+            if (stats.wallHistogram[i] == 0)
+                continue;
+            if (!first)
+                out << ", ";
+            first = false;
+            out << "{\"lt_us\": ";
+            if (i == NUM_BUCKETS - 1)
+                out << "null";
+            else
+                out << ((uint64_t)1 << i);
+            out << ", \"count\": " << stats.wallHistogram[i] << "}";
+        }
+        out << "]\n";
+        out << pad << "  }";
+    }
+    if (!m_modules.empty())
+        out << "\n" << pad;
+    out << "]";
+}
+
+Poco::Timespan::TimeDiff TskPipelineProfile::threadCpuTime()
+{
+#ifdef TSK_WIN32
+    FILETIME creationTime, exitTime, kernelTime, userTime;
+    if (!GetThreadTimes(GetCurrentThread(), &creationTime, &exitTime, &kernelTime, &userTime))
+        return 0;
+
+    // FILETIME counts 100 nanosecond intervals.
+    ULARGE_INTEGER kernel, user;
+    kernel.LowPart = kernelTime.dwLowDateTime;
+    kernel.HighPart = kernelTime.dwHighDateTime;
+    user.LowPart = userTime.dwLowDateTime;
+    user.HighPart = userTime.dwHighDateTime;
+    return (Poco::Timespan::TimeDiff)((kernel.QuadPart + user.QuadPart) / 10);
+#elif defined(CLOCK_THREAD_CPUTIME_ID)
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+        return 0;
+    return (Poco::Timespan::TimeDiff)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,126 @@
+/*
+ * The Sleuth Kit
+ *
+ * Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+ * Copyright (c) 2012 Basis Technology Corporation. All Rights
+ * reserved.
+ *
+ * This software is distributed under the Common Public License 1.0
+ */
+
+/**
+ * \file TskPipelineProfile.h
+ * Contains the interface of the TskPipelineProfile class.
+ */
+
+#ifndef _TSK_PIPELINEPROFILE_H
+#define _TSK_PIPELINEPROFILE_H
+
+// TSK includes
+#include "tsk/base/tsk_os.h" // for uint64_t
+
+// TSK Framework includes
+#include "TskModule.h"
+
+// Poco includes
+#include "Poco/Timespan.h"
+
+// C/C++ library includes
+#include <map>
+#include <ostream>
+#include <string>
+
+/**
+ * Per-module timing and throughput counters for a pipeline.  A pipeline
+ * records every module invocation (one per file for file analysis
+ * pipelines) with its wall clock time, the CPU time of the calling thread,
+ * the number of content bytes the module read or was streamed and its
+ * status.  The wall clock times are also counted in a histogram so that a
+ * module that is slow on a few files can be told apart from one that is
+ * slow on all of them.
+ *
+ * Recording is not synchronized; each pipeline owns its profile and is
+ * only run by one thread.  The profiles of several pipelines (such as the
+ * pipelines of a TskWorkerPool) are combined with merge().
+ */
+class TSK_FRAMEWORK_API TskPipelineProfile
+{
+public:
+    /// Number of buckets in the wall clock time histogram.
+    static const int NUM_BUCKETS = 32;
+
+    /// Counters for one module.
+    struct ModuleStats
+    {
+        ModuleStats();
+
+        std::string name;
+        uint64_t invocations;
+        uint64_t failures;                  ///< Invocations that returned FAIL
+        uint64_t stops;                     ///< Invocations that returned STOP
+        uint64_t bytes;                     ///< Content bytes read by or streamed to the module
+        Poco::Timespan::TimeDiff wallTime;  ///< microseconds
+        Poco::Timespan::TimeDiff cpuTime;   ///< microseconds
+        /// Bucket i counts the invocations that took less than 2^i
+        /// microseconds (and at least 2^(i-1)).  The last bucket also
+        /// counts everything longer.
+        uint64_t wallHistogram[NUM_BUCKETS];
+    };
+
+    typedef std::map<int, ModuleStats> ModuleStatsMap;
+
+    /**
+     * Add a module to the profile.  Modules are reported in the order of
+     * their IDs.
+     * @param moduleId Module ID of the module.
+     * @param name Name of the module.
+     */
+    void addModule(int moduleId, const std::string &name);
+
+    /**
+     * Record one invocation of a module.
+     * @param moduleId Module ID of the module.
+     * @param wallTime Wall clock time of the invocation (microseconds).
+     * @param cpuTime CPU time of the invocation (microseconds).
+     * @param bytes Number of content bytes read by or streamed to the module.
+     * @param status Status returned by the module.
+     * @returns false if the module is not in the profile.
+     */
+    bool record(int moduleId, Poco::Timespan::TimeDiff wallTime, Poco::Timespan::TimeDiff cpuTime,
+        uint64_t bytes, TskModule::Status status);
+
+    /**
+     * Add time to a module without counting an invocation.
+     * @param moduleId Module ID of the module.
+     * @param wallTime Wall clock time to add (microseconds).
+     * @returns false if the module is not in the profile.
+     */
+    bool addTime(int moduleId, Poco::Timespan::TimeDiff wallTime);
+
+    /**
+     * Add the counters of another profile to this one.  Modules are
+     * matched by module ID.
+     */
+    void merge(const TskPipelineProfile &other);
+
+    /// @returns The counters of each module, keyed by module ID.
+    const ModuleStatsMap &getModuleStats() const { return m_modules; }
+
+    /**
+     * Write the profile as a JSON array with one object per module.
+     * @param out Stream to write to.
+     * @param indent Number of spaces to put before each line after the first.
+     */
+    void writeJson(std::ostream &out, int indent = 0) const;
+
+    /**
+     * @returns The CPU time used so far by the calling thread in
+     * microseconds, or 0 if the platform can not report it.
+     */
+    static Poco::Timespan::TimeDiff threadCpuTime();
+
+private:
+    ModuleStatsMap m_modules;
+};
+
+#endif
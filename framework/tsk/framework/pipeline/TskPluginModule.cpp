@@ -26,10 +26,35 @@
 #include "Poco/String.h"
 #include "Poco/Path.h"
 #include "Poco/Environment.h"
+#include "Poco/Mutex.h"
 
 // C/C++ library includes
 #include <sstream>
 #include <string>
+#include <map>
+
+namespace
+{
+    /**
+     * A module library is loaded only once by the process no matter how
+     * many TskPluginModule objects load it (for example, one for each
+     * thread of a TskWorkerPool), so its static data is shared.  This
+     * keeps track of the objects that use each library so that the
+     * library is initialized by the first of them and finalized by the
+     * last.
+     */
+    struct LibraryState
+    {
+        LibraryState() : refs(0), initialized(false), initStatus(TskModule::FAIL) {}
+
+        int refs;
+        bool initialized;
+        TskModule::Status initStatus;
+    };
+
+    std::map<std::string, LibraryState> libraryStates;
+    Poco::FastMutex libraryStatesLock;
+}
 
 const std::string TskPluginModule::GET_COMPILER_SYMBOL = "getCompiler";
 const std::string TskPluginModule::GET_COMPILER_VERSION_SYMBOL = "getCompilerVersion";
@@ -42,17 +67,28 @@ const std::string TskPluginModule::RUN_SYMBOL = "run";
 const std::string TskPluginModule::REPORT_SYMBOL = "report";
 const std::string TskPluginModule::INITIALIZE_SYMBOL = "initialize";
 const std::string TskPluginModule::FINALIZE_SYMBOL = "finalize";
+const std::string TskPluginModule::BEGIN_STREAM_SYMBOL = "beginStream";
+const std::string TskPluginModule::STREAM_CHUNK_SYMBOL = "streamChunk";
+const std::string TskPluginModule::END_STREAM_SYMBOL = "endStream";
 
 TskPluginModule::~TskPluginModule()
 {
     if (m_sharedLibrary.isLoaded())
     {
-        // Call finalize function if defined.
-        if (m_sharedLibrary.hasSymbol(TskPluginModule::FINALIZE_SYMBOL))
+        Poco::FastMutex::ScopedLock lock(libraryStatesLock);
+
+        // Call finalize function if defined and this is the last object
+        // that uses the library.
+        std::map<std::string, LibraryState>::iterator state = libraryStates.find(m_modulePath);
+        if (state != libraryStates.end() && --state->second.refs == 0)
         {
-            typedef TskModule::Status (*FinalizeFunc)();
-            FinalizeFunc fin = (FinalizeFunc)m_sharedLibrary.getSymbol(TskPluginModule::FINALIZE_SYMBOL);
-            fin();
+            libraryStates.erase(state);
+            if (m_sharedLibrary.hasSymbol(TskPluginModule::FINALIZE_SYMBOL))
+            {
+                typedef TskModule::Status (*FinalizeFunc)();
+                FinalizeFunc fin = (FinalizeFunc)m_sharedLibrary.getSymbol(TskPluginModule::FINALIZE_SYMBOL);
+                fin();
+            }
         }
 
         m_sharedLibrary.unload();
@@ -140,6 +176,11 @@ void TskPluginModule::setPath(const std::string& location)
 
         if (m_sharedLibrary.isLoaded())
         {
+            {
+                Poco::FastMutex::ScopedLock lock(libraryStatesLock);
+                libraryStates[m_modulePath].refs++;
+            }
+
            validateLibraryVersionInfo();
 
            // TODO: Eliminate code duplication that follows.
@@ -205,6 +246,13 @@ TskModule::Status TskPluginModule::initialize()
     TskModule::Status status = TskModule::FAIL;
     if (m_sharedLibrary.hasSymbol(TskPluginModule::INITIALIZE_SYMBOL))
     {
+        // The library is initialized once for all of the objects that
+        // use it; the others get the status of the first initialization.
+        Poco::FastMutex::ScopedLock lock(libraryStatesLock);
+        LibraryState &state = libraryStates[m_modulePath];
+        if (state.initialized)
+            return state.initStatus;
+
         try
         {
             std::string arguments = expandArgumentMacros(m_arguments, 0);
@@ -240,6 +288,9 @@ TskModule::Status TskPluginModule::initialize()
             LOGERROR(msg.str());
             status = TskModule::FAIL;
         }
+
+        state.initialized = true;
+        state.initStatus = status;
     }
 
     return status;
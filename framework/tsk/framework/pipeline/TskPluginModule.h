@@ -25,8 +25,8 @@ class TSK_FRAMEWORK_API TskPluginModule: public TskModule
 {
 public:
     /** 
-     * Destructor that calls the finalize function of the module library and
-     * unloads the library.
+     * Destructor that unloads the module library.  The finalize function
+     * of the library is called if this is the last object that uses it.
      */
     virtual ~TskPluginModule();
 
@@ -40,6 +40,8 @@ class TSK_FRAMEWORK_API TskPluginModule: public TskModule
 
     /**
      * Calls the initialize function in the module library, if present.
+     * A library is initialized only once for all of the objects that
+     * load it, since they share its static data.
      */
     TskModule::Status initialize();
 
@@ -62,6 +64,9 @@ class TSK_FRAMEWORK_API TskPluginModule: public TskModule
     static const std::string REPORT_SYMBOL;
     static const std::string INITIALIZE_SYMBOL;
     static const std::string FINALIZE_SYMBOL;
+    static const std::string BEGIN_STREAM_SYMBOL;
+    static const std::string STREAM_CHUNK_SYMBOL;
+    static const std::string END_STREAM_SYMBOL;
 
     /** 
      * Checks whether or not the module library is loaded.
@@ -30,10 +30,12 @@ void TskReportPipeline::run()
     Poco::Stopwatch stopWatch;
     for (size_t i = 0; i < m_modules.size(); i++)
     {
+        Poco::Timespan::TimeDiff cpuStart = TskPipelineProfile::threadCpuTime();
         stopWatch.restart();
         TskModule::Status status = m_modules[i]->report();
         stopWatch.stop();
-        updateModuleExecutionTime(m_modules[i]->getModuleId(), stopWatch.elapsed());
+        recordModuleRun(m_modules[i]->getModuleId(), stopWatch.elapsed(),
+            TskPipelineProfile::threadCpuTime() - cpuStart, 0, status);
 
         TskServices::Instance().getImgDB().setModuleStatus(0, m_modules[i]->getModuleId(), (int)status);
 
@@ -0,0 +1,189 @@
+/*
+ * The Sleuth Kit
+ *
+ * Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+ * Copyright (c) 2012 Basis Technology Corporation. All Rights
+ * reserved.
+ *
+ * This software is distributed under the Common Public License 1.0
+ */
+
+/**
+ * \file TskWorkerPool.cpp
+ * Contains the implementation for the TskWorkerPool class.
+ */
+
+// Include the class definition first to ensure it does not depend on subsequent includes in this file.
+#include "TskWorkerPool.h"
+
+// TSK Framework includes
+#include "tsk/framework/services/TskServices.h"
+#include "tsk/framework/extraction/TskCarveExtractScalpel.h"
+#include "tsk/framework/extraction/TskCarveExtractStream.h"
+#include "tsk/framework/utilities/TskException.h"
+
+// Poco includes
+#include "Poco/String.h"
+
+// C/C++ library includes
+#include <sstream>
+
+namespace
+{
+    // How long (in milliseconds) an idle worker waits before checking
+    // again for tasks that other workers may still schedule.
+    const long IDLE_WAIT_MS = 10;
+}
+
+TskWorkerPool::TskWorkerPool(TskWorkStealingScheduler &scheduler, unsigned int numWorkers)
+    : m_scheduler(scheduler)
+{
+    if (numWorkers == 0)
+        numWorkers = 1;
+
+    for (unsigned int i = 0; i < numWorkers; i++)
+        m_workers.push_back(new Worker(scheduler, i));
+}
+
+TskWorkerPool::~TskWorkerPool()
+{
+    for (std::vector<Worker *>::iterator it = m_workers.begin(); it != m_workers.end(); it++)
+        delete *it;
+}
+
+bool TskWorkerPool::initialize(bool createUnusedSectorFiles)
+{
+    for (size_t i = 0; i < m_workers.size(); i++)
+    {
+        try
+        {
+            m_workers[i]->initialize(createUnusedSectorFiles);
+        }
+        catch (const TskException &e)
+        {
+            std::stringstream msg;
+            msg << "TskWorkerPool::initialize - Error creating file analysis pipeline for worker "
+                << i << ": " << e.message();
+            LOGERROR(msg.str());
+            return false;
+        }
+    }
+
+    std::stringstream msg;
+    msg << "TskWorkerPool::initialize - Created " << m_workers.size() << " worker(s)";
+    LOGINFO(msg.str());
+    return true;
+}
+
+void TskWorkerPool::run()
+{
+    for (size_t i = 1; i < m_workers.size(); i++)
+        m_workers[i]->getThread().start(*m_workers[i]);
+
+    // The calling thread is the first worker.
+    m_workers[0]->run();
+
+    for (size_t i = 1; i < m_workers.size(); i++)
+        m_workers[i]->getThread().join();
+
+    // Make everything that the modules posted visible to the report
+    // pipeline and to other processes reading the database.
+    TskServices::Instance().getImgDB().flush();
+}
+
+void TskWorkerPool::logModuleExecutionTimes() const
+{
+    for (size_t i = 0; i < m_workers.size(); i++)
+    {
+        TskPipeline *pipeline = m_workers[i]->getFilePipeline();
+        if (pipeline && !pipeline->isEmpty())
+        {
+            if (m_workers.size() > 1)
+            {
+                std::stringstream msg;
+                msg << "TskWorkerPool::logModuleExecutionTimes : worker " << i;
+                LOGINFO(msg.str());
+            }
+            pipeline->logModuleExecutionTimes();
+        }
+    }
+}
+
+TskPipelineProfile TskWorkerPool::getProfile() const
+{
+    TskPipelineProfile profile;
+    for (size_t i = 0; i < m_workers.size(); i++)
+    {
+        TskPipeline *pipeline = m_workers[i]->getFilePipeline();
+        if (pipeline)
+            profile.merge(pipeline->getProfile());
+    }
+    return profile;
+}
+
+TskWorkerPool::Worker::Worker(TskWorkStealingScheduler &scheduler, unsigned int index)
+    : m_scheduler(scheduler), m_index(index), m_filePipeline(NULL), m_carver(NULL)
+{
+}
+
+TskWorkerPool::Worker::~Worker()
+{
+    delete m_carver;
+}
+
+void TskWorkerPool::Worker::initialize(bool createUnusedSectorFiles)
+{
+    if (Poco::icompare(GetSystemProperty("CARVE_ENGINE"), "STREAM") == 0)
+        m_carver = new TskCarveExtractStream(createUnusedSectorFiles);
+    else
+        m_carver = new TskCarveExtractScalpel(createUnusedSectorFiles);
+    m_filePipeline = m_pipelineMgr.createPipeline(TskPipelineManager::FILE_ANALYSIS_PIPELINE);
+}
+
+void TskWorkerPool::Worker::run()
+{
+    while (true)
+    {
+        Scheduler::task_struct *task = m_scheduler.nextTask(m_index);
+        if (task == NULL)
+        {
+            // A running task on another worker may still schedule more
+            // (carved or extracted files), so we only stop once nothing
+            // is pending anywhere.
+            if (!m_scheduler.hasPendingTasks())
+                break;
+
+            Poco::Thread::sleep(IDLE_WAIT_MS);
+            continue;
+        }
+
+        try
+        {
+            processTask(*task);
+        }
+        catch (...)
+        {
+            // Error message has been logged already.
+        }
+        delete task;
+        m_scheduler.taskComplete();
+    }
+}
+
+void TskWorkerPool::Worker::processTask(const Scheduler::task_struct &task)
+{
+    if (task.task == Scheduler::FileAnalysis && m_filePipeline && !m_filePipeline->isEmpty())
+    {
+        m_filePipeline->run(task.id);
+    }
+    else if (task.task == Scheduler::Carve && m_carver)
+    {
+        m_carver->processFile(static_cast<int>(task.id));
+    }
+    else
+    {
+        std::stringstream msg;
+        msg << "WARNING: Skipping task: " << task.task;
+        LOGWARN(msg.str());
+    }
+}
@@ -0,0 +1,114 @@
+/*
+ * The Sleuth Kit
+ *
+ * Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+ * Copyright (c) 2012 Basis Technology Corporation. All Rights
+ * reserved.
+ *
+ * This software is distributed under the Common Public License 1.0
+ */
+
+/**
+ * \file TskWorkerPool.h
+ * Contains the interface for the TskWorkerPool class.
+ */
+
+#ifndef _TSK_WORKERPOOL_H
+#define _TSK_WORKERPOOL_H
+
+// TSK Framework includes
+#include "TskPipelineManager.h"
+#include "tsk/framework/services/TskWorkStealingScheduler.h"
+#include "tsk/framework/extraction/CarveExtract.h"
+
+// Poco includes
+#include "Poco/Runnable.h"
+#include "Poco/Thread.h"
+
+// C/C++ library includes
+#include <vector>
+
+/**
+ * Runs the FileAnalysis and Carve tasks of a TskWorkStealingScheduler on
+ * several threads.  Each worker owns its own file analysis pipeline and
+ * its own carver.  The module libraries are loaded once by the process, so
+ * each library is initialized once and its functions are called by all of
+ * the workers (see TskPluginModule::initialize()).  The services registered
+ * with TskServices are shared by all of the workers.
+ */
+class TSK_FRAMEWORK_API TskWorkerPool
+{
+public:
+    /**
+     * @param scheduler Scheduler to take tasks from.  It should have one
+     * queue per worker.
+     * @param numWorkers Number of workers (at least one is created).
+     */
+    TskWorkerPool(TskWorkStealingScheduler &scheduler, unsigned int numWorkers);
+    ~TskWorkerPool();
+
+    /**
+     * Create the pipeline and carver of each worker.  Pipelines are
+     * created here rather than in the worker threads so that modules are
+     * loaded and initialized one at a time.
+     * @param createUnusedSectorFiles Passed on to the carver selected by the
+     * CARVE_ENGINE system property.
+     * @returns true if the workers have a file analysis pipeline, false if
+     * one could not be created (the error is logged).
+     */
+    bool initialize(bool createUnusedSectorFiles = false);
+
+    /**
+     * Process tasks until the scheduler has none left.  The calling thread
+     * acts as the first worker.
+     */
+    void run();
+
+    /**
+     * Logs the module execution times recorded by each worker.
+     */
+    void logModuleExecutionTimes() const;
+
+    /**
+     * @returns The module counters of all of the workers' file analysis
+     * pipelines added together.
+     */
+    TskPipelineProfile getProfile() const;
+
+    /// @returns Number of workers in the pool.
+    unsigned int getNumWorkers() const { return (unsigned int)m_workers.size(); }
+
+private:
+    // Disallow copying
+    TskWorkerPool(const TskWorkerPool&);
+    TskWorkerPool& operator=(const TskWorkerPool&);
+
+    /// A worker thread with its own pipeline and carver.
+    class Worker : public Poco::Runnable
+    {
+    public:
+        Worker(TskWorkStealingScheduler &scheduler, unsigned int index);
+        ~Worker();
+
+        void initialize(bool createUnusedSectorFiles);
+        void run();
+
+        TskPipeline *getFilePipeline() const { return m_filePipeline; }
+        Poco::Thread &getThread() { return m_thread; }
+
+    private:
+        void processTask(const Scheduler::task_struct &task);
+
+        TskWorkStealingScheduler &m_scheduler;
+        unsigned int m_index;           ///< Index of the worker's queue in the scheduler
+        TskPipelineManager m_pipelineMgr;
+        TskPipeline *m_filePipeline;    ///< Owned by m_pipelineMgr
+        CarveExtract *m_carver;
+        Poco::Thread m_thread;
+    };
+
+    TskWorkStealingScheduler &m_scheduler;
+    std::vector<Worker *> m_workers;
+};
+
+#endif
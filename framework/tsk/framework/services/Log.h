@@ -17,6 +17,8 @@
 #include <iostream>
 #include <fstream>
 
+#include "Poco/Mutex.h"
+
 // @@@ TODO: Resolve circular references between TskServices.h and this header by replacing macros with inline functions in TskServices.h
 
 /**
@@ -134,6 +136,9 @@ class TSK_FRAMEWORK_API Log
     std::string m_previousMessage;
     unsigned int m_messageRepeatCount;
 
+    /// Serializes messages that are logged from several worker threads.
+    Poco::FastMutex m_lock;
+
     static const int REPEAT_THRESHOLD;
 };
 #endif
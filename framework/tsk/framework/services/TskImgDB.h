@@ -218,6 +218,14 @@ class TSK_FRAMEWORK_API TskImgDB
     virtual int begin() = 0;
     virtual int commit() = 0;
 
+    /**
+     * Write any blackboard data that the implementation has buffered to
+     * the database.  Implementations that buffer writes also flush before
+     * the data is read back.
+     * @returns 0 on success and 1 on failure.
+     */
+    virtual int flush() { return 0; }
+
     virtual int addToolInfo(const char* name, const char* version) = 0;
     virtual int addImageInfo(int type, int sectorSize) = 0;
 
@@ -323,6 +331,16 @@ class TSK_FRAMEWORK_API TskImgDB
      */
     virtual UnallocRun * getUnallocRun(int a_unalloc_img_id, int a_file_offset) const = 0; 
 
+    /**
+     * Returns all of the runs that make up an unallocated image.
+     *
+     * @param unallocImgId ID of the unallocated image
+     * @param allocUnallocMapList The runs, in order of their offset in the
+     * unallocated image (output)
+     * @returns 0 on success or -1 on error.
+     */
+    virtual int getAllocUnallocMapInfo(int unallocImgId, std::vector<TskAllocUnallocMapRecord> & allocUnallocMapList) const = 0;
+
     /**
      * Returns a list of the sectors that are not used by files and that
      * are in unpartitioned space.  Typically this is used by CarvePrep.
@@ -1355,6 +1355,42 @@ UnallocRun * TskImgDBPostgreSQL::getUnallocRun(int a_unalloc_img_id, int a_file_
     }
 }
 
+int TskImgDBPostgreSQL::getAllocUnallocMapInfo(int unallocImgId, std::vector<TskAllocUnallocMapRecord> & allocUnallocMapList) const
+{
+    if (!initialized())
+        return -1;
+
+    std::stringstream stmt;
+    stmt << "SELECT vol_id, unalloc_img_sect_start, sect_len, orig_img_sect_start FROM alloc_unalloc_map "
+        "WHERE unalloc_img_id = " << unallocImgId << " ORDER BY unalloc_img_sect_start ASC";
+
+    try
+    {
+        pqxx::read_transaction trans(*m_dbConnection);
+        pqxx::result R = trans.exec(stmt.str());
+
+        for (pqxx::result::const_iterator i = R.begin(); i != R.end(); ++i)
+        {
+            TskAllocUnallocMapRecord record;
+            i[0].to(record.vol_id);
+            record.unalloc_img_id = unallocImgId;
+            i[1].to(record.unalloc_img_sect_start);
+            i[2].to(record.sect_len);
+            i[3].to(record.orig_img_sect_start);
+            allocUnallocMapList.push_back(record);
+        }
+    }
+    catch (const exception &e)
+    {
+        std::wstringstream errorMsg;
+        errorMsg << L"TskImgDBPostgreSQL::getAllocUnallocMapInfo - Error fetching data from alloc_unalloc_map table: "
+            << e.what();
+        LOGERROR(errorMsg.str());
+        return -1;
+    }
+    return 0;
+}
+
 /**
  * Adds information about a carved file into the database.  This includes the sector layout
  * information. 
@@ -1729,6 +1765,43 @@ SectorRuns * TskImgDBPostgreSQL::getFileSectors(uint64_t a_fileId) const
         return NULL;
     }
 
+    // Carved files have no file system blocks; their sectors are kept in
+    // the carved_sectors table instead.
+    if (srCount < 1)
+    {
+        stmt.str("");
+        stmt << "SELECT carved_sectors.sect_start, carved_sectors.sect_len, carved_files.vol_id "
+            "FROM carved_sectors "
+            "JOIN carved_files ON carved_sectors.file_id = carved_files.file_id "
+            "WHERE carved_sectors.file_id = " << a_fileId << " ORDER BY carved_sectors.seq;";
+
+        try
+        {
+            pqxx::read_transaction trans(*m_dbConnection);
+            pqxx::result R = trans.exec(stmt);
+
+            for (pqxx::result::const_iterator i = R.begin(); i!= R.end(); ++i)
+            {
+                uint64_t sectStart; i[0].to(sectStart);
+                uint64_t sectLength; i[1].to(sectLength);
+                int volId; i[2].to(volId);
+
+                sr->addRun(sectStart, sectLength, volId);
+                srCount++;
+            }
+        }
+        catch (const exception &e)
+        {
+            std::wstringstream errorMsg;
+            errorMsg << L"TskImgDBPostgreSQL::getFileSectors - Error finding carved sectors for file_id= " << a_fileId
+                << e.what() << std::endl;
+            LOGERROR(errorMsg.str());
+
+            delete sr;
+            return NULL;
+        }
+    }
+
     return sr;
 }
 
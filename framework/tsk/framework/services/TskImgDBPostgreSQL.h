@@ -83,6 +83,7 @@ class TskImgDBPostgreSQL : public TskImgDB
     virtual TskImgDB::KNOWN_STATUS getKnownStatus(const uint64_t fileId) const;
 
     virtual UnallocRun * getUnallocRun(int file_id, int file_offset) const; 
+    virtual int getAllocUnallocMapInfo(int unallocImgId, std::vector<TskAllocUnallocMapRecord> & allocUnallocMapList) const;
     virtual SectorRuns * getFreeSectors() const;
 
     virtual int updateFileStatus(uint64_t a_file_id, TskImgDB::FILE_STATUS a_status);
@@ -39,6 +39,9 @@
 #define IMGDB_MAX_RETRY_COUNT 50    // how many times will we retry a SQL statement
 #define IMGDB_RETRY_WAIT 100   // how long (in milliseconds) are we willing to wait between retries
 
+// number of blackboard attributes that are buffered before they are written
+static const size_t ATTRIBUTE_BATCH_SIZE = 1000;
+
 /**
  * Set the database location.  Must call
  * initialize() before the object can be used.
@@ -57,6 +60,9 @@ TskImgDBSqlite::TskImgDBSqlite(const char * a_outpath)
     strncpy(m_dbFilePath, m_outPath, 256);
     strncat(m_dbFilePath, "image.db", 256);
     m_db = NULL;
+    m_inTransaction = false;
+    m_insertAttributeStmt = NULL;
+    m_insertArtifactStmt = NULL;
 }
 
 TskImgDBSqlite::~TskImgDBSqlite()
@@ -67,6 +73,13 @@ TskImgDBSqlite::~TskImgDBSqlite()
 int TskImgDBSqlite::close()
 {
     if (m_db) {
+        flush();
+
+        sqlite3_finalize(m_insertAttributeStmt);
+        m_insertAttributeStmt = NULL;
+        sqlite3_finalize(m_insertArtifactStmt);
+        m_insertArtifactStmt = NULL;
+
         if (sqlite3_close(m_db) == SQLITE_OK)
             m_db = NULL;
         else
@@ -470,6 +483,7 @@ int TskImgDBSqlite::open()
 
 int TskImgDBSqlite::addToolInfo(const char* name, const char* version)
 {
+    Poco::Mutex::ScopedLock lock(m_lock);
     char *errmsg;
     char stmt[1024];
 
@@ -494,6 +508,7 @@ int TskImgDBSqlite::addToolInfo(const char* name, const char* version)
 
 int TskImgDBSqlite::addImageInfo(int type, int size)
 {
+    Poco::Mutex::ScopedLock lock(m_lock);
     char *errmsg;
     std::stringstream stmt;
 
@@ -516,6 +531,7 @@ int TskImgDBSqlite::addImageInfo(int type, int size)
 
 int TskImgDBSqlite::addImageName(char const *imgPath)
 {
+    Poco::Mutex::ScopedLock lock(m_lock);
     char *errmsg;
     char stmt[1024];
 
@@ -542,6 +558,7 @@ int TskImgDBSqlite::addImageName(char const *imgPath)
  */
 int TskImgDBSqlite::addVolumeInfo(const TSK_VS_PART_INFO * vs_part)
 {
+    Poco::Mutex::ScopedLock lock(m_lock);
     char stmt[1024];
     char * errmsg;
 
@@ -567,6 +584,7 @@ int TskImgDBSqlite::addVolumeInfo(const TSK_VS_PART_INFO * vs_part)
 
 int TskImgDBSqlite::addFsInfo(int volId, int fsId, const TSK_FS_INFO * fs_info)
 {
+    Poco::Mutex::ScopedLock lock(m_lock);
     std::stringstream stmt;
     char * errmsg;
 
@@ -698,6 +716,7 @@ int TskImgDBSqlite::getFileRecord(const uint64_t fileId, TskFileRecord& fileReco
 
 int TskImgDBSqlite::addFsFileInfo(int fileSystemID, const TSK_FS_FILE *fileSystemFile, const char *fileName, int fileSystemAttrType, int fileSystemAttrID, uint64_t &fileID, const char *filePath)
 {
+    Poco::Mutex::ScopedLock lock(m_lock);
     const std::string msgPrefix = "TskImgDBSqlite::addFsFileInfo : ";
     fileID = 0;
 
@@ -836,6 +855,7 @@ int TskImgDBSqlite::addFsFileInfo(int fileSystemID, const TSK_FS_FILE *fileSyste
  */
 int TskImgDBSqlite::addFsBlockInfo(int a_fsId, uint64_t a_fileId, int a_sequence, uint64_t a_blk_addr, uint64_t a_len)
 {
+    Poco::Mutex::ScopedLock lock(m_lock);
     std::stringstream stmt;
     char * errmsg;
 
@@ -861,6 +881,7 @@ int TskImgDBSqlite::addFsBlockInfo(int a_fsId, uint64_t a_fileId, int a_sequence
 int TskImgDBSqlite::addAllocUnallocMapInfo(int a_volID, int unallocImgID, 
                                            uint64_t unallocImgStart, uint64_t length, uint64_t origImgStart)
 {
+    Poco::Mutex::ScopedLock lock(m_lock);
     std::stringstream stmt;
     char * errmsg;
 
@@ -1320,7 +1341,13 @@ int TskImgDBSqlite::begin()
     if (!m_db)
         return 1;
 
+    Poco::Mutex::ScopedLock lock(m_lock);
+    int &depth = m_transactionDepths[Poco::Thread::current()];
+    if (depth++ > 0 || m_inTransaction)
+        return 0;
+
     if (sqlite3_exec(m_db, "BEGIN", NULL, NULL, &errmsg) != SQLITE_OK) {
+        depth--;
         std::wstringstream infoMessage;
         infoMessage << L"TskImgDBSqlite::begin - BEGIN Error: " << errmsg;
         LOGERROR(infoMessage.str());
@@ -1328,6 +1355,7 @@ int TskImgDBSqlite::begin()
         sqlite3_free(errmsg);
         return 1;
     }
+    m_inTransaction = true;
     return 0;
 }
 
@@ -1337,6 +1365,17 @@ int TskImgDBSqlite::commit()
     if (!m_db)
         return 1;
 
+    Poco::Mutex::ScopedLock lock(m_lock);
+    std::map<Poco::Thread *, int>::iterator it = m_transactionDepths.find(Poco::Thread::current());
+    if (it == m_transactionDepths.end() || it->second == 0)
+        return 0;   // this thread has no transaction
+    if (--it->second > 0)
+        return 0;
+    m_transactionDepths.erase(it);
+
+    if (!m_inTransaction)
+        return 0;
+    m_inTransaction = false;
     if (sqlite3_exec(m_db, "COMMIT", NULL, NULL, &errmsg) != SQLITE_OK) {
         std::wstringstream infoMessage;
         infoMessage << L"TskImgDBSqlite::commit - COMMIT Error: " << errmsg;
@@ -1345,6 +1384,22 @@ int TskImgDBSqlite::commit()
         sqlite3_free(errmsg);
         return 1;
     }
+
+    // Other threads are still in the middle of their transactions.
+    for (it = m_transactionDepths.begin(); it != m_transactionDepths.end(); it++) {
+        if (it->second > 0) {
+            if (sqlite3_exec(m_db, "BEGIN", NULL, NULL, &errmsg) != SQLITE_OK) {
+                std::wstringstream infoMessage;
+                infoMessage << L"TskImgDBSqlite::commit - BEGIN Error: " << errmsg;
+                LOGERROR(infoMessage.str());
+
+                sqlite3_free(errmsg);
+                return 1;
+            }
+            m_inTransaction = true;
+            break;
+        }
+    }
     return 0;
 }
 
@@ -1388,6 +1443,36 @@ UnallocRun * TskImgDBSqlite::getUnallocRun(int a_unalloc_img_id, int a_file_offs
     }
 }
 
+int TskImgDBSqlite::getAllocUnallocMapInfo(int unallocImgId, std::vector<TskAllocUnallocMapRecord> & allocUnallocMapList) const
+{
+    if (!m_db)
+        return -1;
+
+    std::stringstream stmt;
+    stmt << "SELECT vol_id, unalloc_img_sect_start, sect_len, orig_img_sect_start FROM alloc_unalloc_map "
+        "WHERE unalloc_img_id = " << unallocImgId << " ORDER BY unalloc_img_sect_start ASC";
+
+    sqlite3_stmt * statement;
+    if (sqlite3_prepare_v2(m_db, stmt.str().c_str(), -1, &statement, 0) != SQLITE_OK) {
+        std::wstringstream infoMessage;
+        infoMessage << L"TskImgDBSqlite::getAllocUnallocMapInfo - Error querying alloc_unalloc_map table: " << sqlite3_errmsg(m_db);
+        LOGERROR(infoMessage.str());
+        return -1;
+    }
+
+    while (sqlite3_step(statement) == SQLITE_ROW) {
+        TskAllocUnallocMapRecord record;
+        record.vol_id = (int)sqlite3_column_int(statement, 0);
+        record.unalloc_img_id = unallocImgId;
+        record.unalloc_img_sect_start = (uint64_t)sqlite3_column_int64(statement, 1);
+        record.sect_len = (uint64_t)sqlite3_column_int64(statement, 2);
+        record.orig_img_sect_start = (uint64_t)sqlite3_column_int64(statement, 3);
+        allocUnallocMapList.push_back(record);
+    }
+    sqlite3_finalize(statement);
+    return 0;
+}
+
 /**
  * Adds information about a carved file into the database.  This includes the sector layout
  * information. 
@@ -1404,6 +1489,7 @@ UnallocRun * TskImgDBSqlite::getUnallocRun(int a_unalloc_img_id, int a_file_offs
 int TskImgDBSqlite::addCarvedFileInfo(int vol_id, const char *name, uint64_t size, 
                                       uint64_t *runStarts, uint64_t *runLengths, int numRuns, uint64_t & fileId)
 {
+    Poco::Mutex::ScopedLock lock(m_lock);
     char stmt[1024];
     char * errmsg;
     std::wstringstream infoMessage;
@@ -1489,6 +1575,7 @@ int TskImgDBSqlite::addDerivedFileInfo(const std::string& name, const uint64_t p
                                        const int ctime, const int crtime, const int atime, const int mtime,
                                        uint64_t &fileId, std::string path)
 {
+    Poco::Mutex::ScopedLock lock(m_lock);
     if (!m_db)
         return -1;
 
@@ -1672,9 +1759,40 @@ SectorRuns * TskImgDBSqlite::getFileSectors(uint64_t a_fileId) const
             L"TskImgDBSqlite::getFileSectors - "
             L"Error finding block data for file_id=" << a_fileId << ": " << sqlite3_errmsg(m_db);
         LOGERROR(infoMessage.str());
+        delete sr;
         return NULL;
     }
 
+    // Carved files have no file system blocks; their sectors are kept in
+    // the carved_sectors table instead.
+    if (srCount < 1) {
+        stmt.str("");
+        stmt <<
+            "SELECT carved_sectors.sect_start, carved_sectors.sect_len, carved_files.vol_id "
+            "FROM carved_sectors "
+            "JOIN carved_files ON carved_sectors.file_id = carved_files.file_id "
+            "WHERE carved_sectors.file_id = " << a_fileId << " "
+            "ORDER BY carved_sectors.seq;";
+        if (sqlite3_prepare_v2(m_db, stmt.str().c_str(), -1, &statement, 0) == SQLITE_OK) {
+            while(sqlite3_step(statement) == SQLITE_ROW) {
+                sr->addRun((uint64_t)sqlite3_column_int64(statement, 0),
+                    (uint64_t)sqlite3_column_int64(statement, 1),
+                    sqlite3_column_int(statement, 2));
+                srCount++;
+            }
+            sqlite3_finalize(statement);
+        }
+        else {
+            std::wstringstream infoMessage;
+            infoMessage <<
+                L"TskImgDBSqlite::getFileSectors - "
+                L"Error finding carved sectors for file_id=" << a_fileId << ": " << sqlite3_errmsg(m_db);
+            LOGERROR(infoMessage.str());
+            delete sr;
+            return NULL;
+        }
+    }
+
     if (srCount < 1) {
         delete sr;
         sr = NULL;
@@ -1713,6 +1831,26 @@ int TskImgDBSqlite::updateFileStatus(uint64_t a_file_id, FILE_STATUS a_status)
     if (!m_db)
         return 1;
 
+    Poco::Mutex::ScopedLock lock(m_lock);
+
+    // The analysis of a file is over.  The attributes that were posted on
+    // this thread are written in the same transaction as the status, so
+    // that a file is never recorded as analyzed without them.
+    if (a_status == IMGDB_FILES_STATUS_ANALYSIS_COMPLETE ||
+        a_status == IMGDB_FILES_STATUS_ANALYSIS_FAILED)
+    {
+        begin();
+        try {
+            flushAttributes(m_attributeBuffers[Poco::Thread::current()]);
+        }
+        catch (TskException &) {
+            // Error message has been logged already.
+            commit();
+            return 1;
+        }
+        commit();
+    }
+
     std::stringstream stmt;
     char * errmsg;
 
@@ -2280,6 +2418,7 @@ void TskImgDBSqlite::constructStmt(std::string& stmt, std::string condition) con
 // Return 1 on failure, 0 on success.
 int TskImgDBSqlite::setHash(const uint64_t a_file_id, const TskImgDB::HASH_TYPE hashType, const std::string& hash) const 
 {
+    Poco::Mutex::ScopedLock lock(m_lock);
     if (!m_db)
         throw TskException("No database.");
 
@@ -2637,6 +2776,7 @@ int TskImgDBSqlite::getFileTypeRecords(const std::string& stmt, std::list<TskFil
  */
 int TskImgDBSqlite::addModule(const std::string& name, const std::string& description, int & moduleId)
 {
+    Poco::Mutex::ScopedLock lock(m_lock);
     if (!m_db)
         return -1;
 
@@ -2705,6 +2845,7 @@ int TskImgDBSqlite::addModule(const std::string& name, const std::string& descri
  */
 int TskImgDBSqlite::setModuleStatus(uint64_t file_id, int module_id, int status)
 {
+    Poco::Mutex::ScopedLock lock(m_lock);
     int rc = -1;
 
     if (!m_db)
@@ -2871,6 +3012,7 @@ TskImgDB::KNOWN_STATUS TskImgDBSqlite::getKnownStatus(const uint64_t fileId) con
  */
 int TskImgDBSqlite::addUnallocImg(int & unallocImgId)
 {
+    Poco::Mutex::ScopedLock lock(m_lock);
     int rc = -1;
 
     if (!m_db)
@@ -3070,6 +3212,7 @@ int TskImgDBSqlite::addUnusedSectors(int unallocImgId, std::vector<TskUnusedSect
  */
 int TskImgDBSqlite::addUnusedSector(uint64_t sectStart, uint64_t sectEnd, int volId, std::vector<TskUnusedSectorsRecord> & unusedSectorsList)
 {
+    Poco::Mutex::ScopedLock lock(m_lock);
     assert(sectEnd > sectStart);
     int rc = -1;
     if (!m_db)
@@ -3188,7 +3331,8 @@ int TskImgDBSqlite::getUnusedSector(uint64_t fileId, TskUnusedSectorsRecord & un
 
 ///BLACKBOARD FUNCTIONS
 /**
- * Add the given blackboard attribute to the database
+ * Add the given blackboard attribute to the database.  The attribute is
+ * buffered and written together with others by flushAttributes().
  * @param attr input attribute. should be fully populated
  */
 void TskImgDBSqlite::addBlackboardAttribute(TskBlackboardAttribute attr)
@@ -3196,74 +3340,111 @@ void TskImgDBSqlite::addBlackboardAttribute(TskBlackboardAttribute attr)
     if (!m_db)
         throw TskException("No database.");
 
-    std::stringstream str;
-    char *item;
-    sqlite3_stmt * statement;
+    Poco::Mutex::ScopedLock lock(m_lock);
+    std::vector<TskBlackboardAttribute> &buffer = m_attributeBuffers[Poco::Thread::current()];
+    buffer.push_back(attr);
+    if (buffer.size() >= ATTRIBUTE_BATCH_SIZE)
+        flushAttributes(buffer);
+}
 
-    str << "INSERT INTO blackboard_attributes (artifact_id, source, context, attribute_type_id, value_type, "
-        "value_byte, value_text, value_int32, value_int64, value_double, obj_id) VALUES (";
-        str << attr.getArtifactID() << ", ";
-    item = sqlite3_mprintf("%Q", attr.getModuleName().c_str()); str << item << ", ";
-    sqlite3_free(item);
-    item = sqlite3_mprintf("%Q", attr.getContext().c_str()); str << item << ", ";
-    sqlite3_free(item);
-    str << attr.getAttributeTypeID() << ", ";
-    str << attr.getValueType() << ", ";
-    switch (attr.getValueType()) {
-        case TSK_BYTE:
-            str << " ?, '', 0, 0, 0.0";
-            break;
-        case TSK_STRING:
-            item = sqlite3_mprintf("%Q", attr.getValueString().c_str());
-            str << " '', " << item << ", 0, 0, 0.0";
-            sqlite3_free(item);
-            break;
-        case TSK_INTEGER:
-            str << " '', '', " << attr.getValueInt() << ",     0, 0.0";
-            break;
-        case TSK_LONG:
-            str << " '', '', 0, " << attr.getValueLong() << ",     0.0";
-            break;
-        case TSK_DOUBLE:
-            str << " '', '', 0, 0, " << setprecision(20) << attr.getValueDouble();
-            break;
-    };
-    str << ", " << attr.getObjectID();
-    str << ")";
+int TskImgDBSqlite::flush()
+{
+    if (!m_db)
+        return 1;
 
-    if (sqlite3_prepare_v2(m_db, str.str().c_str(), -1, &statement, 0) == SQLITE_OK) {
-        int result = SQLITE_OK;
-        unsigned char *pBuf = 0;
-        if (attr.getValueType() == TSK_BYTE) {
-            // Bind the byte vector
-            int a_size = attr.getValueBytes().size();
-            pBuf = new unsigned char[a_size];
-            for (int i = 0; i < a_size; i++) {
-                pBuf[i] = attr.getValueBytes()[i];
-            }
-            result = sqlite3_bind_blob(statement, 1, pBuf, a_size, SQLITE_STATIC);
+    Poco::Mutex::ScopedLock lock(m_lock);
+    int rc = 0;
+    for (std::map<Poco::Thread *, std::vector<TskBlackboardAttribute> >::iterator it = m_attributeBuffers.begin();
+        it != m_attributeBuffers.end(); it++) {
+        try {
+            flushAttributes(it->second);
         }
-        if (result == SQLITE_OK) {
-            result = sqlite3_step(statement);
-            if (!(result == SQLITE_ROW || result == SQLITE_DONE)) {
-                sqlite3_finalize(statement);
-                if (pBuf) delete [] pBuf;
-                throw TskException("TskImgDBSqlite::addBlackboardAttribute - Insert failed");
-            }
-        } else {
+        catch (TskException &) {
+            // Error message has been logged already.
+            rc = 1;
+        }
+    }
+    return rc;
+}
+
+/**
+ * Write a buffer of blackboard attributes in one transaction using a
+ * single prepared statement.  The caller must hold m_lock.  The buffer is
+ * emptied even if an insert fails.
+ * @param buffer Attributes buffered by one thread.
+ */
+void TskImgDBSqlite::flushAttributes(std::vector<TskBlackboardAttribute> &buffer)
+{
+    if (buffer.empty())
+        return;
+
+    std::vector<TskBlackboardAttribute> attributes;
+    attributes.swap(buffer);
+
+    if (m_insertAttributeStmt == NULL) {
+        const char *stmt = "INSERT INTO blackboard_attributes (artifact_id, source, context, attribute_type_id, value_type, "
+            "value_byte, value_text, value_int32, value_int64, value_double, obj_id) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)";
+        if (sqlite3_prepare_v2(m_db, stmt, -1, &m_insertAttributeStmt, 0) != SQLITE_OK) {
             std::wstringstream infoMessage;
-            infoMessage << L"TskImgDBSqlite::addBlackboardAttribute - Error in sqlite3_bind_blob: " << sqlite3_errmsg(m_db);
+            infoMessage << L"TskImgDBSqlite::flushAttributes - Error adding data to blackboard table: " << sqlite3_errmsg(m_db);
             LOGERROR(infoMessage.str());
-            throw TskException("TskImgDBSqlite::addBlackboardAttribute - Insert failed");
+            m_insertAttributeStmt = NULL;
+            throw TskException("TskImgDBSqlite::flushAttributes - Insert failed");
+        }
+    }
+
+    begin();
+    sqlite3_stmt *statement = m_insertAttributeStmt;
+    for (std::vector<TskBlackboardAttribute>::const_iterator it = attributes.begin(); it != attributes.end(); it++) {
+        const TskBlackboardAttribute &attr = *it;
+        const std::string source = attr.getModuleName();
+        const std::string context = attr.getContext();
+        const std::string valueString = attr.getValueString();
+        const std::vector<unsigned char> valueBytes = attr.getValueBytes();
+
+        sqlite3_bind_int64(statement, 1, attr.getArtifactID());
+        sqlite3_bind_text(statement, 2, source.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(statement, 3, context.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(statement, 4, attr.getAttributeTypeID());
+        sqlite3_bind_int(statement, 5, attr.getValueType());
+
+        // Columns that do not hold the value get the same defaults as before.
+        sqlite3_bind_text(statement, 6, "", -1, SQLITE_STATIC);
+        sqlite3_bind_text(statement, 7, "", -1, SQLITE_STATIC);
+        sqlite3_bind_int(statement, 8, 0);
+        sqlite3_bind_int64(statement, 9, 0);
+        sqlite3_bind_double(statement, 10, 0.0);
+        switch (attr.getValueType()) {
+            case TSK_BYTE:
+                sqlite3_bind_blob(statement, 6, valueBytes.empty() ? NULL : &valueBytes[0], (int)valueBytes.size(), SQLITE_TRANSIENT);
+                break;
+            case TSK_STRING:
+                sqlite3_bind_text(statement, 7, valueString.c_str(), -1, SQLITE_TRANSIENT);
+                break;
+            case TSK_INTEGER:
+                sqlite3_bind_int(statement, 8, attr.getValueInt());
+                break;
+            case TSK_LONG:
+                sqlite3_bind_int64(statement, 9, attr.getValueLong());
+                break;
+            case TSK_DOUBLE:
+                sqlite3_bind_double(statement, 10, attr.getValueDouble());
+                break;
+        };
+        sqlite3_bind_int64(statement, 11, attr.getObjectID());
+
+        int result = sqlite3_step(statement);
+        sqlite3_reset(statement);
+        if (!(result == SQLITE_ROW || result == SQLITE_DONE)) {
+            std::wstringstream infoMessage;
+            infoMessage << L"TskImgDBSqlite::flushAttributes - Error adding data to blackboard table: " << sqlite3_errmsg(m_db);
+            LOGERROR(infoMessage.str());
+            commit();
+            throw TskException("TskImgDBSqlite::flushAttributes - Insert failed");
         }
-        sqlite3_finalize(statement);
-        if (pBuf) delete [] pBuf;
-    } else {
-        std::wstringstream infoMessage;
-        infoMessage << L"TskImgDBSqlite::addBlackboardAttribute - Error adding data to blackboard table: " << sqlite3_errmsg(m_db);
-        LOGERROR(infoMessage.str());
-        throw TskException("TskImgDBSqlite::addBlackboardAttribute - Insert failed");
     }
+    sqlite3_clear_bindings(statement);
+    commit();
 }
 
 /**
@@ -3532,6 +3713,8 @@ vector<TskBlackboardAttribute> TskImgDBSqlite::getMatchingAttributes(string cond
 {
     if (!m_db)
         throw TskException("No database.");
+
+    flush();
     
     vector<TskBlackboardAttribute> attributes;
     std::string stmt("SELECT blackboard_attributes.artifact_id, blackboard_attributes.source, blackboard_attributes.context, blackboard_attributes.attribute_type_id, blackboard_attributes.value_type, blackboard_attributes.value_byte, blackboard_attributes.value_text, blackboard_attributes.value_int32, blackboard_attributes.value_int64, blackboard_attributes.value_double, blackboard_attributes.obj_id FROM blackboard_attributes ");
@@ -3576,39 +3759,30 @@ TskBlackboardArtifact TskImgDBSqlite::createBlackboardArtifact(uint64_t file_id,
     if (!m_db)
         throw TskException("No database.");
 
-    uint64_t artifactId = 0;
-    std::stringstream str;
-    sqlite3_stmt * statement;
+    Poco::Mutex::ScopedLock lock(m_lock);
 
-    str << "INSERT INTO blackboard_artifacts (artifact_id, obj_id, artifact_type_id) VALUES (NULL, " << file_id << ", " << artifactTypeID << ")";
-
-    if (sqlite3_prepare_v2(m_db, str.str().c_str(), -1, &statement, 0) == SQLITE_OK) {
-        if (!(sqlite3_step(statement) == SQLITE_DONE)) {
-            sqlite3_finalize(statement);
-            throw TskException("TskImgDBSqlite::addBlackboardInfo - Insert failed");
-        }
-        // select max(artifact_id) from blackboard
-        str.str("");
-        str << "SELECT artifact_id from blackboard_artifacts WHERE obj_id = " << file_id << " AND artifact_type_id = " << artifactTypeID;
-        sqlite3_finalize(statement);
-        if (sqlite3_prepare_v2(m_db, str.str().c_str(), -1, &statement, 0) == SQLITE_OK) {
-            while(sqlite3_step(statement) == SQLITE_ROW) {
-                uint64_t newID = sqlite3_column_int64(statement, 0);
-                if(newID > artifactId)
-                    artifactId = newID;
-            }
-        } else {
-            sqlite3_finalize(statement);
-            throw TskException("TskImgDBSqlite::newBlackboardArtifact - Select artifact_id failed");
+    if (m_insertArtifactStmt == NULL) {
+        const char *stmt = "INSERT INTO blackboard_artifacts (artifact_id, obj_id, artifact_type_id) VALUES (NULL, ?, ?)";
+        if (sqlite3_prepare_v2(m_db, stmt, -1, &m_insertArtifactStmt, 0) != SQLITE_OK) {
+            std::wstringstream infoMessage;
+            infoMessage << L"TskImgDBSqlite::newBlackboardArtifact - Error adding new artifact: " << sqlite3_errmsg(m_db);
+            LOGERROR(infoMessage.str());
+            m_insertArtifactStmt = NULL;
+            throw TskException("TskImgDBSqlite::newBlackboardArtifact - Insert failed");
         }
-        sqlite3_finalize(statement);
-    } else {
-        std::wstringstream infoMessage;
-        infoMessage << L"TskImgDBSqlite::newBlackboardArtifact - Error adding new artifact: " << sqlite3_errmsg(m_db);
-        LOGERROR(infoMessage.str());
-        throw TskException("TskImgDBSqlite::newBlackboardArtifact - Insert failed");
     }
 
+    sqlite3_bind_int64(m_insertArtifactStmt, 1, file_id);
+    sqlite3_bind_int(m_insertArtifactStmt, 2, artifactTypeID);
+    int result = sqlite3_step(m_insertArtifactStmt);
+    sqlite3_reset(m_insertArtifactStmt);
+    if (result != SQLITE_DONE) {
+        throw TskException("TskImgDBSqlite::addBlackboardInfo - Insert failed");
+    }
+
+    // The row id of the new row is its artifact_id.
+    uint64_t artifactId = sqlite3_last_insert_rowid(m_db);
+
     return TskImgDB::createArtifact(artifactId, file_id, artifactTypeID);
 }
 
@@ -3620,6 +3794,7 @@ TskBlackboardArtifact TskImgDBSqlite::createBlackboardArtifact(uint64_t file_id,
  */
 void TskImgDBSqlite::addArtifactType(int typeID, string artifactTypeName, string displayName)
 {
+    Poco::Mutex::ScopedLock lock(m_lock);
     if (!m_db)
         throw TskException("No database.");
 
@@ -3664,6 +3839,7 @@ void TskImgDBSqlite::addArtifactType(int typeID, string artifactTypeName, string
  */
 void TskImgDBSqlite::addAttributeType(int typeID, string attributeTypeName, string displayName)
 {
+    Poco::Mutex::ScopedLock lock(m_lock);
     if (!m_db)
         throw TskException("No database.");
 
@@ -3738,6 +3914,8 @@ vector<int> TskImgDBSqlite::findAttributeTypes(int artifactTypeId)
     if (!m_db) {
         throw TskException("No database.");
     }
+
+    flush();
     vector<int> attrTypes;
     std::stringstream stmt;
     stmt << "SELECT DISTINCT(attribute_type_id) FROM blackboard_attributes JOIN blackboard_artifacts ON blackboard_attributes.artifact_id = blackboard_artifacts.artifact_id WHERE artifact_type_id = " << artifactTypeId;
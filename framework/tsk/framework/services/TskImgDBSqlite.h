@@ -15,6 +15,7 @@
 // System includes
 #include <string> // to get std::wstring
 #include <list>
+#include <map>
 #include <vector>
 using namespace std;
 
@@ -28,6 +29,9 @@ using namespace std;
 
 #include "tsk/libtsk.h"
 
+#include "Poco/Mutex.h"
+#include "Poco/Thread.h"
+
 #ifdef HAVE_LIBSQLITE3
   #include <sqlite3.h>
 #else
@@ -52,6 +56,7 @@ class TSK_FRAMEWORK_API TskImgDBSqlite : public TskImgDB
 
     virtual int begin();
     virtual int commit();
+    virtual int flush();
 
     virtual int addToolInfo(const char* name, const char* version);
     virtual int addImageInfo(int type, int sectorSize);
@@ -87,6 +92,7 @@ class TSK_FRAMEWORK_API TskImgDBSqlite : public TskImgDB
     virtual TskImgDB::KNOWN_STATUS getKnownStatus(const uint64_t fileId) const;
 
     virtual UnallocRun * getUnallocRun(int file_id, int file_offset) const; 
+    virtual int getAllocUnallocMapInfo(int unallocImgId, std::vector<TskAllocUnallocMapRecord> & allocUnallocMapList) const;
     virtual SectorRuns * getFreeSectors() const;
 
     virtual int updateFileStatus(uint64_t a_file_id, FILE_STATUS a_status);
@@ -151,6 +157,41 @@ class TSK_FRAMEWORK_API TskImgDBSqlite : public TskImgDB
     char m_dbFilePath[256];
     sqlite3 * m_db;
 
+    /**
+     * Held by every method that runs an INSERT so that no other insert
+     * can run between an INSERT and the sqlite3_last_insert_rowid() call
+     * that reads back its row id.
+     */
+    mutable Poco::Mutex m_lock;
+
+    /**
+     * Number of begin() calls without a matching commit() on each thread
+     * (NULL for the main thread).  Only a thread's outermost pair counts,
+     * so that flushAttributes() can be called while TskAutoImpl or a file
+     * analysis pipeline has a transaction open, and a commit() without a
+     * begin() on the same thread is ignored.  A transaction belongs to the
+     * connection, which the threads share: when a thread's outermost
+     * commit() is reached, everything written so far is committed and a
+     * new transaction is started for the threads that are still in one.
+     * Protected by m_lock.
+     */
+    std::map<Poco::Thread *, int> m_transactionDepths;
+    bool m_inTransaction;       ///< Set if BEGIN has been issued without COMMIT
+
+    /**
+     * Blackboard attributes that have not been written yet, with one buffer
+     * for each thread that posts them (NULL for the main thread).  A
+     * thread's buffer is written in one transaction once there are enough
+     * attributes in it and when the thread sets the final status of a file.  All of
+     * them are written on flush() and before attributes are read back.
+     * Protected by m_lock.
+     */
+    std::map<Poco::Thread *, std::vector<TskBlackboardAttribute> > m_attributeBuffers;
+    sqlite3_stmt * m_insertAttributeStmt;   ///< Prepared on first use
+    sqlite3_stmt * m_insertArtifactStmt;    ///< Prepared on first use
+
+    void flushAttributes(std::vector<TskBlackboardAttribute> &buffer);
+
     int dropTables();
 
     static int busyHandler(void *, int);
@@ -0,0 +1,300 @@
+/*
+ * The Sleuth Kit
+ *
+ * Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+ * Copyright (c) 2012 Basis Technology Corporation. All Rights
+ * reserved.
+ *
+ * This software is distributed under the Common Public License 1.0
+ */
+
+/**
+ * \file TskPriorityScheduler.cpp
+ * Contains the implementation of the TskPriorityScheduler class.
+ */
+
+#include "TskPriorityScheduler.h"
+
+// TSK Framework includes
+#include "tsk/framework/services/TskServices.h"
+#include "tsk/framework/services/Log.h"
+#include "tsk/framework/utilities/TskException.h"
+
+// Poco includes
+#include "Poco/String.h"
+#include "Poco/StringTokenizer.h"
+#include "Poco/NumberParser.h"
+#include "Poco/Exception.h"
+
+// C/C++ library includes
+#include <algorithm>
+#include <map>
+#include <sstream>
+
+namespace
+{
+    // Maximum number of files that are looked up in the database at once.
+    const uint64_t MAX_LOOKUP_IDS = 10000;
+
+    /// A FileAnalysis task with what it is ordered by.
+    struct OrderedTask
+    {
+        uint64_t id;
+        int priority;
+        TSK_OFF_T size;
+
+        bool operator<(const OrderedTask &other) const
+        {
+            if (priority != other.priority)
+                return priority > other.priority;
+            if (size != other.size)
+                return size > other.size;
+            return id < other.id;
+        }
+    };
+}
+
+TskPriorityScheduler::TskPriorityScheduler(unsigned int numQueues)
+    : TskWorkStealingScheduler(numQueues), m_releasing(0)
+{
+}
+
+TskPriorityScheduler::~TskPriorityScheduler()
+{
+}
+
+void TskPriorityScheduler::setPriorityRules(const std::string &rules)
+{
+    std::vector<Rule> parsed;
+
+    Poco::StringTokenizer ruleTokens(rules, ";", Poco::StringTokenizer::TOK_TRIM | Poco::StringTokenizer::TOK_IGNORE_EMPTY);
+    for (Poco::StringTokenizer::Iterator it = ruleTokens.begin(); it != ruleTokens.end(); ++it)
+    {
+        std::string::size_type colon = it->find(':');
+        std::string::size_type equals = it->rfind('=');
+        if (colon == std::string::npos || equals == std::string::npos || equals < colon)
+        {
+            throw TskException("TskPriorityScheduler::setPriorityRules : invalid rule: " + *it);
+        }
+
+        Rule rule;
+        std::string kind = Poco::toLower(Poco::trim(it->substr(0, colon)));
+        if (kind == "ext")
+            rule.kind = Rule::EXTENSION;
+        else if (kind == "path")
+            rule.kind = Rule::PATH;
+        else if (kind == "type")
+            rule.kind = Rule::TYPE;
+        else
+            throw TskException("TskPriorityScheduler::setPriorityRules : unknown rule type: " + *it);
+
+        try
+        {
+            rule.priority = Poco::NumberParser::parse(Poco::trim(it->substr(equals + 1)));
+        }
+        catch (const Poco::SyntaxException &)
+        {
+            throw TskException("TskPriorityScheduler::setPriorityRules : invalid priority: " + *it);
+        }
+
+        Poco::StringTokenizer valueTokens(it->substr(colon + 1, equals - colon - 1), ",",
+            Poco::StringTokenizer::TOK_TRIM | Poco::StringTokenizer::TOK_IGNORE_EMPTY);
+        for (Poco::StringTokenizer::Iterator value = valueTokens.begin(); value != valueTokens.end(); ++value)
+        {
+            std::string lower = Poco::toLower(*value);
+            if (rule.kind == Rule::PATH)
+                std::replace(lower.begin(), lower.end(), '\\', '/');
+            else if (rule.kind == Rule::EXTENSION && !lower.empty() && lower[0] == '.')
+                lower.erase(0, 1);
+            rule.values.push_back(lower);
+        }
+        if (rule.values.empty())
+            throw TskException("TskPriorityScheduler::setPriorityRules : rule has no values: " + *it);
+
+        parsed.push_back(rule);
+    }
+
+    m_rules.swap(parsed);
+}
+
+int TskPriorityScheduler::getPriority(const TskFileRecord &record) const
+{
+    bool matched = false;
+    int priority = 0;
+
+    for (std::vector<Rule>::const_iterator rule = m_rules.begin(); rule != m_rules.end(); ++rule)
+    {
+        std::string key;
+        switch (rule->kind)
+        {
+        case Rule::EXTENSION:
+            {
+                std::string::size_type dot = record.name.rfind('.');
+                if (dot == std::string::npos)
+                    continue;
+                key = Poco::toLower(record.name.substr(dot + 1));
+                break;
+            }
+        case Rule::PATH:
+            key = Poco::toLower(record.fullPath);
+            break;
+        case Rule::TYPE:
+            switch (record.typeId)
+            {
+            case TskImgDB::IMGDB_FILES_TYPE_FS:
+                key = "fs";
+                break;
+            case TskImgDB::IMGDB_FILES_TYPE_CARVED:
+                key = "carved";
+                break;
+            case TskImgDB::IMGDB_FILES_TYPE_DERIVED:
+                key = "derived";
+                break;
+            case TskImgDB::IMGDB_FILES_TYPE_UNUSED:
+                key = "unused";
+                break;
+            }
+            break;
+        }
+
+        for (std::vector<std::string>::const_iterator value = rule->values.begin(); value != rule->values.end(); ++value)
+        {
+            bool match = (rule->kind == Rule::PATH) ? (key.find(*value) != std::string::npos) : (key == *value);
+            if (match)
+            {
+                if (!matched || rule->priority > priority)
+                    priority = rule->priority;
+                matched = true;
+                break;
+            }
+        }
+    }
+
+    return priority;
+}
+
+int TskPriorityScheduler::schedule(Scheduler::TaskType task, uint64_t startId, uint64_t endId)
+{
+    if (task != Scheduler::FileAnalysis)
+        return TskWorkStealingScheduler::schedule(task, startId, endId);
+
+    if (endId < startId) {
+        // @@@ Log a message
+        return -1;
+    }
+
+    Poco::FastMutex::ScopedLock lock(m_heldLock);
+    for (uint64_t id = startId; id <= endId; id++)
+        m_held.push_back(id);
+    return 0;
+}
+
+Scheduler::task_struct *TskPriorityScheduler::nextTask(unsigned int queueIndex)
+{
+    bool held;
+    {
+        Poco::FastMutex::ScopedLock lock(m_heldLock);
+        held = !m_held.empty();
+    }
+    if (held)
+        releaseHeldTasks();
+
+    return TskWorkStealingScheduler::nextTask(queueIndex);
+}
+
+bool TskPriorityScheduler::hasPendingTasks() const
+{
+    {
+        Poco::FastMutex::ScopedLock lock(m_heldLock);
+        if (!m_held.empty() || m_releasing > 0)
+            return true;
+    }
+    return TskWorkStealingScheduler::hasPendingTasks();
+}
+
+/**
+ * Order the held FileAnalysis tasks and add them to the worker queues.
+ * The files are looked up in the image database in runs of consecutive
+ * IDs.  If they can not be looked up, the tasks are queued in ID order.
+ */
+void TskPriorityScheduler::releaseHeldTasks()
+{
+    Poco::FastMutex::ScopedLock releaseLock(m_releaseLock);
+
+    std::vector<uint64_t> ids;
+    {
+        Poco::FastMutex::ScopedLock lock(m_heldLock);
+        ids.swap(m_held);
+        m_releasing = ids.size();
+    }
+    if (ids.empty())
+        return;
+
+    std::sort(ids.begin(), ids.end());
+
+    std::vector<OrderedTask> tasks;
+    tasks.reserve(ids.size());
+    try
+    {
+        TskImgDB &imgDB = TskServices::Instance().getImgDB();
+
+        size_t first = 0;
+        while (first < ids.size())
+        {
+            size_t last = first;
+            while (last + 1 < ids.size() && ids[last + 1] == ids[last] + 1 && last + 1 - first < MAX_LOOKUP_IDS)
+                last++;
+
+            std::stringstream condition;
+            condition << "WHERE f.file_id BETWEEN " << ids[first] << " AND " << ids[last];
+            std::vector<TskFileRecord> records = imgDB.getFileRecords(condition.str());
+
+            std::map<uint64_t, size_t> recordIndex;
+            for (size_t i = 0; i < records.size(); i++)
+                recordIndex[records[i].fileId] = i;
+
+            for (size_t i = first; i <= last; i++)
+            {
+                OrderedTask task;
+                task.id = ids[i];
+                task.priority = 0;
+                task.size = 0;
+
+                std::map<uint64_t, size_t>::const_iterator found = recordIndex.find(ids[i]);
+                if (found != recordIndex.end())
+                {
+                    task.priority = getPriority(records[found->second]);
+                    task.size = records[found->second].size;
+                }
+                tasks.push_back(task);
+            }
+
+            first = last + 1;
+        }
+
+        std::sort(tasks.begin(), tasks.end());
+    }
+    catch (TskException &ex)
+    {
+        std::stringstream msg;
+        msg << "TskPriorityScheduler::releaseHeldTasks : files are not ordered: " << ex.message();
+        LOGERROR(msg.str());
+
+        tasks.clear();
+        for (std::vector<uint64_t>::const_iterator it = ids.begin(); it != ids.end(); ++it)
+        {
+            OrderedTask task;
+            task.id = *it;
+            task.priority = 0;
+            task.size = 0;
+            tasks.push_back(task);
+        }
+    }
+
+    // Scheduling the tasks one at a time deals them out to the queues.
+    for (std::vector<OrderedTask>::const_iterator it = tasks.begin(); it != tasks.end(); ++it)
+        TskWorkStealingScheduler::schedule(Scheduler::FileAnalysis, it->id, it->id);
+
+    Poco::FastMutex::ScopedLock lock(m_heldLock);
+    m_releasing = 0;
+}
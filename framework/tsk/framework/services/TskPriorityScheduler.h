@@ -0,0 +1,110 @@
+/*
+ * The Sleuth Kit
+ *
+ * Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+ * Copyright (c) 2012 Basis Technology Corporation. All Rights
+ * reserved.
+ *
+ * This software is distributed under the Common Public License 1.0
+ */
+
+/**
+ * \file TskPriorityScheduler.h
+ * Contains the interface of the TskPriorityScheduler class.
+ */
+
+#ifndef TSK_PRIORITY_SCHEDULER
+#define TSK_PRIORITY_SCHEDULER
+
+#include "TskWorkStealingScheduler.h"
+#include "TskImgDB.h"
+
+// Poco includes
+#include "Poco/Mutex.h"
+
+// C/C++ library includes
+#include <string>
+#include <vector>
+
+/**
+ * TskWorkStealingScheduler that decides the order in which files are
+ * analyzed.  FileAnalysis tasks are held back when they are scheduled and
+ * are ordered the next time that a worker asks for a task: first by
+ * priority, which comes from rules on the extension, path and type of the
+ * file, and then by size, largest first.  Starting the large files early
+ * keeps one worker from being left with a multi-GB file after the others
+ * are done, and the rules let small files that matter most (registry
+ * hives, browser databases) go ahead of bulk data.  The ordered tasks are
+ * dealt out to the worker queues one at a time so that every worker works
+ * from the front of the order.  Other tasks are scheduled as they are by
+ * TskWorkStealingScheduler.
+ */
+class TSK_FRAMEWORK_API TskPriorityScheduler : public TskWorkStealingScheduler {
+public:
+    /**
+     * @param numQueues Number of per-worker queues (usually the number of
+     * worker threads).
+     */
+    TskPriorityScheduler(unsigned int numQueues = 1);
+    virtual ~TskPriorityScheduler();
+
+    /**
+     * Set the priority rules.  Rules are separated by ';' and have the form
+     * "ext:reg,dat=100" (file name extensions), "path:/Windows/System32/config/=200"
+     * (text in the path of the file) or "type:carved=-10" (fs, carved, derived
+     * or unused).  Matching ignores case.  A file gets the highest priority
+     * of the rules that match it, or 0 if none do.
+     * @param rules Rules as in TskSystemProperties::SCHEDULER_PRIORITY_RULES.
+     * @throws TskException if a rule can not be parsed.
+     */
+    void setPriorityRules(const std::string &rules);
+
+    /**
+     * Get the priority that the rules give a file.
+     * @param record File to get the priority of.
+     * @returns Priority of the file.
+     */
+    int getPriority(const TskFileRecord &record) const;
+
+    int schedule(Scheduler::TaskType task, uint64_t startId, uint64_t endId);
+
+    using TskWorkStealingScheduler::nextTask;
+
+    /**
+     * Order the FileAnalysis tasks that have been scheduled since the last
+     * call and get the next task for a given worker.
+     * @param queueIndex Index of the worker's own queue.
+     * @returns Next task or NULL if all queues are empty. Caller must
+     * free the object.
+     */
+    task_struct *nextTask(unsigned int queueIndex);
+
+    bool hasPendingTasks() const;
+
+private:
+    // Disallow copying
+    TskPriorityScheduler(const TskPriorityScheduler&);
+    TskPriorityScheduler& operator=(const TskPriorityScheduler&);
+
+    /// A priority rule from setPriorityRules().
+    struct Rule {
+        enum Kind {
+            EXTENSION,
+            PATH,
+            TYPE
+        };
+        Kind kind;
+        std::vector<std::string> values;    ///< Lower case
+        int priority;
+    };
+
+    void releaseHeldTasks();
+
+    std::vector<Rule> m_rules;
+    std::vector<uint64_t> m_held;       ///< FileAnalysis IDs that have not been ordered yet
+    uint64_t m_releasing;               ///< Held tasks that are being ordered
+    mutable Poco::FastMutex m_heldLock; ///< Protects m_held and m_releasing
+    Poco::FastMutex m_releaseLock;      ///< Held by the thread that orders the tasks
+};
+
+#endif
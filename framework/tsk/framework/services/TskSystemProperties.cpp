@@ -46,7 +46,10 @@ namespace
     const std::string DEFAULT_CARVE_EXTRACT_KEEP_INPUT_FILES = "false";
     const std::string DEFAULT_CARVE_EXTRACT_KEEP_OUTPUT_FILES = "false";
     const std::string DEFAULT_SCALPEL_CONFIG_FILE = std::string("#SCALPEL_DIR#") + Poco::Path::separator() + std::string("scalpel.conf");
+    const std::string DEFAULT_CARVE_ENGINE = "SCALPEL";
     const std::string DEFAULT_PIPELINE_CONFIG_FILE = std::string("#CONFIG_DIR#") + Poco::Path::separator() + std::string("pipeline_config.xml");
+    const std::string DEFAULT_NUM_WORKER_THREADS = "1";
+    const std::string DEFAULT_SCHEDULER_PRIORITY_RULES = "";
 
     struct PredefProp
     {
@@ -77,6 +80,7 @@ namespace
         PredefProp(TskSystemProperties::CARVE_EXTRACT_KEEP_OUTPUT_FILES, "CARVE_EXTRACT_KEEP_OUTPUT_FILES", false, DEFAULT_CARVE_EXTRACT_KEEP_OUTPUT_FILES),
         PredefProp(TskSystemProperties::SCALPEL_DIR, "SCALPEL_DIR", false, ""),
         PredefProp(TskSystemProperties::SCALPEL_CONFIG_FILE, "SCALPEL_CONFIG_FILE", false, DEFAULT_SCALPEL_CONFIG_FILE),
+        PredefProp(TskSystemProperties::CARVE_ENGINE, "CARVE_ENGINE", false, DEFAULT_CARVE_ENGINE),
         PredefProp(TskSystemProperties::PIPELINE_CONFIG_FILE, "PIPELINE_CONFIG_FILE", false, DEFAULT_PIPELINE_CONFIG_FILE),
         PredefProp(TskSystemProperties::SESSION_ID, "SESSION_ID", false, ""),
         PredefProp(TskSystemProperties::CURRENT_TASK, "CURRENT_TASK", false, ""),
@@ -86,7 +90,9 @@ namespace
         PredefProp(TskSystemProperties::START_TIME, "START_TIME", false, ""),
         PredefProp(TskSystemProperties::CURRENT_TIME, "CURRENT_TIME", false, ""),
         PredefProp(TskSystemProperties::UNIQUE_ID, "UNIQUE_ID", false, ""),
-        PredefProp(TskSystemProperties::IMAGE_FILE, "IMAGE_FILE", false, "")
+        PredefProp(TskSystemProperties::IMAGE_FILE, "IMAGE_FILE", false, ""),
+        PredefProp(TskSystemProperties::NUM_WORKER_THREADS, "NUM_WORKER_THREADS", false, DEFAULT_NUM_WORKER_THREADS),
+        PredefProp(TskSystemProperties::SCHEDULER_PRIORITY_RULES, "SCHEDULER_PRIORITY_RULES", false, DEFAULT_SCHEDULER_PRIORITY_RULES)
     };
 
     const std::size_t MAX_PATH_LENGTH = 1024;
@@ -158,6 +158,14 @@ class TSK_FRAMEWORK_API TskSystemProperties
          */
         SCALPEL_CONFIG_FILE,
 
+        /**
+         * Carving engine used by tsk_analyzeimg. SCALPEL (the default) writes
+         * unallocated sectors image files to CARVE_DIR and carves them with
+         * Scalpel. STREAM carves the unallocated sectors in place with
+         * TskCarveExtractStream, using the signatures in SCALPEL_CONFIG_FILE.
+         */
+        CARVE_ENGINE,
+
         /** 
          * Path to a pipeline configuration file. Defaults to 
          * \#CONFIG_DIR#/pipeline_config.xml. 
@@ -214,6 +222,22 @@ class TSK_FRAMEWORK_API TskSystemProperties
          */
         IMAGE_FILE,
 
+        /**
+         * Number of worker threads that run file analysis and carving tasks,
+         * each with its own pipeline. Zero means one per processor. Defaults
+         * to 1.
+         */
+        NUM_WORKER_THREADS,
+
+        /**
+         * Rules that raise or lower the priority of file analysis tasks
+         * (see TskPriorityScheduler). Rules are separated by ';' and have
+         * the form "ext:reg,dat=100", "path:/Windows/System32/config/=200"
+         * or "type:carved=-10". Empty by default, which means that files
+         * are only ordered by size.
+         */
+        SCHEDULER_PRIORITY_RULES,
+
 		END_PROPS
     };
 
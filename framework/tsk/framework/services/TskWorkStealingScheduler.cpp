@@ -0,0 +1,164 @@
+/*
+ * The Sleuth Kit
+ *
+ * Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+ * Copyright (c) 2012 Basis Technology Corporation. All Rights
+ * reserved.
+ *
+ * This software is distributed under the Common Public License 1.0
+ */
+
+/**
+ * \file TskWorkStealingScheduler.cpp
+ * Contains the implementation of the TskWorkStealingScheduler class.
+ */
+
+#include "TskWorkStealingScheduler.h"
+
+TskWorkStealingScheduler::TskWorkStealingScheduler(unsigned int numQueues, unsigned int chunkSize)
+    : m_chunkSize(chunkSize ? chunkSize : 1), m_nextQueue(0), m_pending(0)
+{
+    if (numQueues == 0)
+        numQueues = 1;
+
+    for (unsigned int i = 0; i < numQueues; i++)
+        m_queues.push_back(new TaskQueue());
+}
+
+TskWorkStealingScheduler::~TskWorkStealingScheduler()
+{
+    for (std::vector<TaskQueue *>::iterator it = m_queues.begin(); it != m_queues.end(); it++)
+        delete *it;
+}
+
+int TskWorkStealingScheduler::schedule(Scheduler::TaskType task, uint64_t startId, uint64_t endId)
+{
+    if (endId < startId) {
+        // @@@ Log a message
+        return -1;
+    }
+
+    uint64_t id = startId;
+    while (true) {
+        TaskRange range;
+        range.task = task;
+        range.startId = id;
+        range.endId = (endId - id < m_chunkSize) ? endId : id + m_chunkSize - 1;
+
+        // Count the tasks before they become visible to the workers so that
+        // hasPendingTasks() never reports false while they are queued.
+        unsigned int queueIndex;
+        {
+            Poco::FastMutex::ScopedLock lock(m_scheduleLock);
+            queueIndex = m_nextQueue;
+            m_nextQueue = (m_nextQueue + 1) % m_queues.size();
+            m_pending += range.endId - range.startId + 1;
+        }
+
+        TaskQueue *queue = m_queues[queueIndex];
+        {
+            Poco::FastMutex::ScopedLock lock(queue->lock);
+            queue->ranges.push_back(range);
+        }
+
+        if (range.endId == endId)
+            break;
+        id = range.endId + 1;
+    }
+    return 0;
+}
+
+Scheduler::task_struct *TskWorkStealingScheduler::nextTask()
+{
+    return nextTask(0);
+}
+
+Scheduler::task_struct *TskWorkStealingScheduler::nextTask(unsigned int queueIndex)
+{
+    queueIndex = queueIndex % m_queues.size();
+    TaskQueue *own = m_queues[queueIndex];
+
+    {
+        Poco::FastMutex::ScopedLock lock(own->lock);
+        task_struct *t = takeFront(*own);
+        if (t != NULL)
+            return t;
+    }
+
+    // Our queue is empty, so take work from one of the others.
+    TaskRange stolen;
+    if (!steal(queueIndex, stolen))
+        return NULL;
+
+    Poco::FastMutex::ScopedLock lock(own->lock);
+    own->ranges.push_back(stolen);
+    return takeFront(*own);
+}
+
+void TskWorkStealingScheduler::taskComplete()
+{
+    Poco::FastMutex::ScopedLock lock(m_scheduleLock);
+    if (m_pending > 0)
+        m_pending--;
+}
+
+bool TskWorkStealingScheduler::hasPendingTasks() const
+{
+    Poco::FastMutex::ScopedLock lock(m_scheduleLock);
+    return m_pending > 0;
+}
+
+/**
+ * Remove the first ID of the range at the front of the queue.
+ * Caller must hold the lock of the queue.
+ * @returns NULL if the queue is empty.
+ */
+Scheduler::task_struct *TskWorkStealingScheduler::takeFront(TaskQueue &queue)
+{
+    if (queue.ranges.empty())
+        return NULL;
+
+    TaskRange &range = queue.ranges.front();
+    task_struct *t = new(task_struct);
+    t->task = range.task;
+    t->id = range.startId;
+
+    if (range.startId == range.endId)
+        queue.ranges.pop_front();
+    else
+        range.startId++;
+
+    return t;
+}
+
+/**
+ * Take the upper half of the last range of another queue.  Queues are
+ * tried in order starting after the thief so that the victims are spread
+ * out across the workers.
+ * @param queueIndex Index of the queue that is stealing.
+ * @param range Range that was stolen (output).
+ * @returns false if all other queues are empty.
+ */
+bool TskWorkStealingScheduler::steal(unsigned int queueIndex, TaskRange &range)
+{
+    for (size_t i = 1; i < m_queues.size(); i++) {
+        TaskQueue *victim = m_queues[(queueIndex + i) % m_queues.size()];
+        Poco::FastMutex::ScopedLock lock(victim->lock);
+
+        if (victim->ranges.empty())
+            continue;
+
+        TaskRange &back = victim->ranges.back();
+        range = back;
+        if (back.endId > back.startId) {
+            uint64_t mid = back.startId + (back.endId - back.startId + 1) / 2;
+            range.startId = mid;
+            back.endId = mid - 1;
+        }
+        else {
+            victim->ranges.pop_back();
+        }
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,112 @@
+/*
+ * The Sleuth Kit
+ *
+ * Contact: Brian Carrier [carrier <at> sleuthkit [dot] org]
+ * Copyright (c) 2012 Basis Technology Corporation. All Rights
+ * reserved.
+ *
+ * This software is distributed under the Common Public License 1.0
+ */
+
+/**
+ * \file TskWorkStealingScheduler.h
+ * Contains the interface of the TskWorkStealingScheduler class.
+ */
+
+#ifndef TSK_WORK_STEALING_SCHEDULER
+#define TSK_WORK_STEALING_SCHEDULER
+
+#include "Scheduler.h"
+
+// Poco includes
+#include "Poco/Mutex.h"
+
+// C/C++ library includes
+#include <deque>
+#include <vector>
+
+/**
+ * Thread-safe implementation of the Scheduler interface for use with
+ * several worker threads in a single process (see TskWorkerPool).
+ *
+ * Each worker has its own queue of ID ranges. Scheduled ranges are cut
+ * into chunks and handed out to the queues round-robin.  A worker takes
+ * tasks from the front of its own queue and, once that is empty, steals
+ * half of the range at the back of another worker's queue.
+ *
+ * Workers must call taskComplete() for every task that they get from
+ * nextTask() so that hasPendingTasks() can tell an empty queue apart
+ * from one that is about to receive tasks from a running task.
+ */
+class TSK_FRAMEWORK_API TskWorkStealingScheduler : public Scheduler {
+public:
+    /**
+     * @param numQueues Number of per-worker queues (usually the number of
+     * worker threads).
+     * @param chunkSize Maximum number of IDs per range when a schedule()
+     * request is split across the queues.
+     */
+    TskWorkStealingScheduler(unsigned int numQueues = 1, unsigned int chunkSize = 64);
+    virtual ~TskWorkStealingScheduler();
+
+    int schedule(Scheduler::TaskType task, uint64_t startId, uint64_t endId);
+
+    /**
+     * Get the next task from the first queue, stealing from the other
+     * queues if it is empty.
+     * @returns Next task or NULL if all queues are empty. Caller must
+     * free the object.
+     */
+    task_struct *nextTask();
+
+    /**
+     * Get the next task for a given worker.
+     * @param queueIndex Index of the worker's own queue.
+     * @returns Next task or NULL if all queues are empty. Caller must
+     * free the object.
+     */
+    virtual task_struct *nextTask(unsigned int queueIndex);
+
+    /**
+     * Signal that a task returned by nextTask() has been processed.
+     */
+    void taskComplete();
+
+    /**
+     * @returns true if there are tasks that are queued or that have been
+     * handed out but not completed yet.
+     */
+    virtual bool hasPendingTasks() const;
+
+    /// @returns Number of per-worker queues.
+    unsigned int getNumQueues() const { return (unsigned int)m_queues.size(); }
+
+private:
+    // Disallow copying
+    TskWorkStealingScheduler(const TskWorkStealingScheduler&);
+    TskWorkStealingScheduler& operator=(const TskWorkStealingScheduler&);
+
+    /// A contiguous range of IDs that all get the same task.
+    struct TaskRange {
+        Scheduler::TaskType task;
+        uint64_t startId;
+        uint64_t endId;
+    };
+
+    /// A per-worker queue and the lock protecting it.
+    struct TaskQueue {
+        Poco::FastMutex lock;
+        std::deque<TaskRange> ranges;
+    };
+
+    task_struct *takeFront(TaskQueue &queue);
+    bool steal(unsigned int queueIndex, TaskRange &range);
+
+    std::vector<TaskQueue *> m_queues;
+    unsigned int m_chunkSize;
+    unsigned int m_nextQueue;           ///< Queue that gets the next scheduled range
+    uint64_t m_pending;                 ///< Tasks queued or in progress
+    mutable Poco::FastMutex m_scheduleLock; ///< Protects m_nextQueue and m_pending
+};
+
+#endif
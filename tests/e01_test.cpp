@@ -0,0 +1,380 @@
+/*
+* The Sleuth Kit
+*
+* Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2016 Brian Carrier.  All Rights reserved
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/*
+ * This is a test file for The Sleuth Kit.  It tests the built-in E01
+ * reader.  It writes a small E01 image that is split over three segment
+ * files and has both compressed and stored chunks, opens it and checks
+ * the MD5 of its content.  It then checks that a stored chunk with a bad
+ * checksum can not be read and that segment files with invalid table
+ * and section sizes are not opened.
+ *
+ * The files are written to the current directory and are removed when
+ * the test passes.
+ */
+#include "tsk/tsk_tools_i.h"
+
+#include <vector>
+#include <string>
+
+#define EXIT_IGNORE 77
+
+#if HAVE_LIBZ
+#include <zlib.h>
+
+static const uint32_t SECTORS_PER_CHUNK = 64;
+static const uint32_t BYTES_PER_SECTOR = 512;
+static const uint32_t CHUNK_SIZE = SECTORS_PER_CHUNK * BYTES_PER_SECTOR;
+static const uint32_t NUM_CHUNKS = 37;
+static const int NUM_SEGMENTS = 3;
+
+// the last chunk is 10 sectors short
+static const uint64_t NUM_SECTORS =
+    (uint64_t) NUM_CHUNKS * SECTORS_PER_CHUNK - 10;
+
+// MD5 of the content made by make_content()
+static const char *CONTENT_MD5 = "d7d31c69787040c1264e20a973dae489";
+
+static const char *BASE_NAME = "e01_test";
+
+static void
+put32(std::string & a_buf, uint32_t a_val)
+{
+    for (int i = 0; i < 4; i++)
+        a_buf += (char) ((a_val >> (8 * i)) & 0xff);
+}
+
+static void
+put64(std::string & a_buf, uint64_t a_val)
+{
+    for (int i = 0; i < 8; i++)
+        a_buf += (char) ((a_val >> (8 * i)) & 0xff);
+}
+
+/* Every third chunk compresses well and the rest do not. */
+static std::string
+make_content()
+{
+    std::string data;
+    uint32_t seed = 1;
+
+    for (uint32_t i = 0; i < NUM_CHUNKS; i++) {
+        if (i % 3 == 0) {
+            data.append(CHUNK_SIZE, (char) i);
+        }
+        else {
+            for (uint32_t j = 0; j < CHUNK_SIZE; j++) {
+                seed = seed * 1103515245 + 12345;
+                data += (char) (seed >> 16);
+            }
+        }
+    }
+    data.resize((size_t) (NUM_SECTORS * BYTES_PER_SECTOR));
+    return data;
+}
+
+/* Make a section descriptor. */
+static std::string
+section(const char *a_type, uint64_t a_next, uint64_t a_size)
+{
+    std::string desc(a_type);
+    desc.resize(16, '\0');
+    put64(desc, a_next);
+    put64(desc, a_size);
+    desc.append(40, '\0');
+    put32(desc, (uint32_t) adler32(1, (const Bytef *) desc.data(),
+            (uInt) desc.size()));
+    return desc;
+}
+
+static std::string
+segment_name(int a_num)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "%s.E%02d", BASE_NAME, a_num);
+    return name;
+}
+
+static bool
+write_file(const std::string & a_name, const std::string & a_data)
+{
+    FILE *hFile = fopen(a_name.c_str(), "wb");
+    if (hFile == NULL) {
+        fprintf(stderr, "Error creating %s\n", a_name.c_str());
+        return false;
+    }
+    bool ok = (fwrite(a_data.data(), 1, a_data.size(), hFile) ==
+        a_data.size());
+    if (fclose(hFile) != 0)
+        ok = false;
+    return ok;
+}
+
+/*
+ * Write the segment files of an image of a_data.
+ * @param a_stored_offset Set to the offset in its segment file of the
+ * first stored chunk
+ */
+static bool
+write_image(const std::string & a_data, std::string & a_first_seg,
+    size_t & a_stored_offset)
+{
+    uint32_t per_seg = (NUM_CHUNKS + NUM_SEGMENTS - 1) / NUM_SEGMENTS;
+    a_stored_offset = 0;
+
+    for (int seg = 0; seg < NUM_SEGMENTS; seg++) {
+        std::string file("EVF\x09\x0d\x0a\xff\x00\x01", 9);
+        file += (char) ((seg + 1) & 0xff);
+        file += (char) ((seg + 1) >> 8);
+        file.append(2, '\0');
+
+        if (seg == 0) {
+            std::string volume;
+            put32(volume, 1);
+            put32(volume, NUM_CHUNKS);
+            put32(volume, SECTORS_PER_CHUNK);
+            put32(volume, BYTES_PER_SECTOR);
+            put64(volume, NUM_SECTORS);
+            volume.resize(1052, '\0');
+            file += section("volume", file.size() + 76 + volume.size(),
+                76 + volume.size());
+            file += volume;
+        }
+
+        // the chunks
+        size_t sectors_off = file.size();
+        std::string body;
+        std::vector<uint32_t> entries;
+        for (uint32_t i = seg * per_seg;
+            (i < NUM_CHUNKS) && (i < (seg + 1) * per_seg); i++) {
+            std::string chunk = a_data.substr((size_t) i * CHUNK_SIZE,
+                CHUNK_SIZE);
+            uint32_t rel = (uint32_t) body.size();
+            if (i % 3 == 0) {
+                std::vector<Bytef> zbuf(compressBound(chunk.size()));
+                uLongf zlen = zbuf.size();
+                compress(&zbuf[0], &zlen, (const Bytef *) chunk.data(),
+                    chunk.size());
+                body.append((const char *) &zbuf[0], zlen);
+                entries.push_back(rel | 0x80000000);
+            }
+            else {
+                if (a_stored_offset == 0)
+                    a_stored_offset = sectors_off + 76 + rel;
+                body += chunk;
+                put32(body, (uint32_t) adler32(1,
+                        (const Bytef *) chunk.data(), chunk.size()));
+                entries.push_back(rel);
+            }
+        }
+        file += section("sectors", sectors_off + 76 + body.size(),
+            76 + body.size());
+        file += body;
+
+        std::string table;
+        put32(table, (uint32_t) entries.size());
+        put32(table, 0);
+        put64(table, sectors_off + 76);
+        put32(table, 0);
+        put32(table, 0);
+        for (size_t i = 0; i < entries.size(); i++)
+            put32(table, entries[i]);
+        put32(table, 0);
+        file += section("table", file.size() + 76 + table.size(),
+            76 + table.size());
+        file += table;
+
+        if (seg == NUM_SEGMENTS - 1)
+            file += section("done", file.size(), 76);
+        else
+            file += section("next", file.size(), 76);
+
+        if (write_file(segment_name(seg + 1), file) == false)
+            return false;
+    }
+    a_first_seg = segment_name(1);
+    return true;
+}
+
+static void
+remove_image()
+{
+    for (int seg = 1; seg <= NUM_SEGMENTS; seg++)
+        remove(segment_name(seg).c_str());
+}
+
+/* Read the whole image in pieces that do not line up with the chunks. */
+static bool
+check_content(TSK_IMG_INFO * a_img, const std::string & a_data)
+{
+    std::vector<char> buf(100000);
+    std::string read_data;
+    TSK_MD5_CTX md5;
+    unsigned char hash[16];
+    char hash_str[33];
+    TSK_OFF_T off = 0;
+
+    if (a_img->size != (TSK_OFF_T) a_data.size()) {
+        fprintf(stderr, "Image size is %" PRIuOFF ", expected %"
+            PRIuSIZE "\n", a_img->size, a_data.size());
+        return false;
+    }
+
+    TSK_MD5_Init(&md5);
+    while (off < a_img->size) {
+        size_t len = 1000 + (size_t) (off % 77777);
+        if ((TSK_OFF_T) len > a_img->size - off)
+            len = (size_t) (a_img->size - off);
+        ssize_t cnt = tsk_img_read(a_img, off, &buf[0], len);
+        if (cnt != (ssize_t) len) {
+            fprintf(stderr, "Error reading %" PRIuSIZE " bytes at %"
+                PRIuOFF "\n", len, off);
+            tsk_error_print(stderr);
+            return false;
+        }
+        TSK_MD5_Update(&md5, (unsigned char *) &buf[0], (unsigned int) len);
+        off += len;
+    }
+    TSK_MD5_Final(hash, &md5);
+    for (int i = 0; i < 16; i++)
+        snprintf(&hash_str[i * 2], 3, "%02x", hash[i]);
+
+    if (strcmp(hash_str, CONTENT_MD5) != 0) {
+        fprintf(stderr, "MD5 of image content is %s, expected %s\n",
+            hash_str, CONTENT_MD5);
+        return false;
+    }
+    return true;
+}
+
+/* Change the bytes at an offset in a segment file. */
+static bool
+patch_file(const std::string & a_name, size_t a_off, const std::string & a_bytes)
+{
+    FILE *hFile = fopen(a_name.c_str(), "r+b");
+    if (hFile == NULL)
+        return false;
+    bool ok = (fseek(hFile, (long) a_off, SEEK_SET) == 0)
+        && (fwrite(a_bytes.data(), 1, a_bytes.size(), hFile) ==
+        a_bytes.size());
+    if (fclose(hFile) != 0)
+        ok = false;
+    return ok;
+}
+
+int
+main(int argc, char **argv)
+{
+    std::string data = make_content();
+    std::string first;
+    size_t stored_offset;
+    TSK_IMG_INFO *img;
+
+    if (write_image(data, first, stored_offset) == false) {
+        remove_image();
+        return EXIT_FAILURE;
+    }
+
+    // the content of a good image
+    if ((img = tsk_img_open_utf8_sing(first.c_str(),
+                TSK_IMG_TYPE_EWF_NATIVE, 0)) == NULL) {
+        fprintf(stderr, "Error opening E01 image\n");
+        tsk_error_print(stderr);
+        return EXIT_FAILURE;
+    }
+    if (check_content(img, data) == false) {
+        tsk_img_close(img);
+        return EXIT_FAILURE;
+    }
+    tsk_img_close(img);
+
+    // a stored chunk with a bad checksum
+    if (patch_file(first, stored_offset + 100, "\xde\xad\xbe\xef") == false) {
+        fprintf(stderr, "Error changing %s\n", first.c_str());
+        return EXIT_FAILURE;
+    }
+    if ((img = tsk_img_open_utf8_sing(first.c_str(),
+                TSK_IMG_TYPE_EWF_NATIVE, 0)) == NULL) {
+        fprintf(stderr, "Error opening E01 image with a bad chunk\n");
+        tsk_error_print(stderr);
+        return EXIT_FAILURE;
+    }
+    {
+        std::vector<char> buf(CHUNK_SIZE);
+        if (tsk_img_read(img, CHUNK_SIZE, &buf[0], CHUNK_SIZE) != -1) {
+            fprintf(stderr, "Chunk with a bad checksum was read\n");
+            tsk_img_close(img);
+            return EXIT_FAILURE;
+        }
+        tsk_error_reset();
+        if (tsk_img_read(img, 0, &buf[0], CHUNK_SIZE) != CHUNK_SIZE) {
+            fprintf(stderr, "Error reading the chunk before a bad one\n");
+            tsk_error_print(stderr);
+            tsk_img_close(img);
+            return EXIT_FAILURE;
+        }
+    }
+    tsk_img_close(img);
+
+    // a table with more entries than fit in it (0x40000001 entries
+    // overflow a 32-bit byte count) and a section size past the end of
+    // the file
+    if (write_image(data, first, stored_offset) == false) {
+        remove_image();
+        return EXIT_FAILURE;
+    }
+    {
+        std::string seg2 = segment_name(2);
+        FILE *hFile = fopen(seg2.c_str(), "rb");
+        std::string file;
+        char buf[4096];
+        size_t cnt;
+        if (hFile == NULL)
+            return EXIT_FAILURE;
+        while ((cnt = fread(buf, 1, sizeof(buf), hFile)) > 0)
+            file.append(buf, cnt);
+        fclose(hFile);
+
+        size_t table_off = file.find(std::string("table\0", 6));
+        if (table_off == std::string::npos) {
+            fprintf(stderr, "Table section not found\n");
+            return EXIT_FAILURE;
+        }
+        std::string bytes;
+        put32(bytes, 0x40000001);
+        std::string size;
+        put64(size, 0x200000000ULL);
+        if ((patch_file(seg2, table_off + 76, bytes) == false)
+            || (patch_file(seg2, table_off + 24, size) == false)) {
+            fprintf(stderr, "Error changing %s\n", seg2.c_str());
+            return EXIT_FAILURE;
+        }
+    }
+    if ((img = tsk_img_open_utf8_sing(first.c_str(),
+                TSK_IMG_TYPE_EWF_NATIVE, 0)) != NULL) {
+        fprintf(stderr, "Opened E01 image with an invalid table\n");
+        tsk_img_close(img);
+        return EXIT_FAILURE;
+    }
+    tsk_error_reset();
+
+    remove_image();
+    return EXIT_SUCCESS;
+}
+
+#else
+
+int
+main(int argc, char **argv)
+{
+    // the built-in E01 reader needs zlib
+    return EXIT_IGNORE;
+}
+
+#endif
@@ -0,0 +1,240 @@
+/*
+* The Sleuth Kit
+*
+* Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2016 Brian Carrier.  All Rights reserved
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/*
+ * This is a test file for The Sleuth Kit.  It tests the multi-pattern
+ * search in tsk_msearch.c: overlapping patterns, case-insensitive
+ * patterns, matches that cross the boundaries of the buffers that are
+ * scanned and stopping the scan from the callback.
+ */
+#include "tsk/tsk_tools_i.h"
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+typedef std::vector < std::pair < TSK_OFF_T, int > > Matches;
+
+static TSK_WALK_RET_ENUM
+collect(int a_id, TSK_OFF_T a_off, void *a_ptr)
+{
+    ((Matches *) a_ptr)->push_back(std::make_pair(a_off, a_id));
+    return TSK_WALK_CONT;
+}
+
+static TSK_WALK_RET_ENUM
+stop_after_first(int a_id, TSK_OFF_T a_off, void *a_ptr)
+{
+    ((Matches *) a_ptr)->push_back(std::make_pair(a_off, a_id));
+    return TSK_WALK_STOP;
+}
+
+/*
+ * Allocate a search with the given patterns and compile it.
+ * @param a_pats Patterns, ending with NULL
+ * @param a_nocase Case-insensitive flag for each pattern
+ */
+static TSK_MSEARCH *
+make_search(const char *const a_pats[], const uint8_t a_nocase[])
+{
+    TSK_MSEARCH *ms;
+
+    if ((ms = tsk_msearch_alloc()) == NULL) {
+        tsk_error_print(stderr);
+        return NULL;
+    }
+    for (int i = 0; a_pats[i] != NULL; i++) {
+        if (tsk_msearch_add(ms, (const uint8_t *) a_pats[i],
+                strlen(a_pats[i]), a_nocase[i], i + 1)) {
+            fprintf(stderr, "Error adding pattern %d\n", i + 1);
+            tsk_error_print(stderr);
+            tsk_msearch_free(ms);
+            return NULL;
+        }
+    }
+    if (tsk_msearch_compile(ms)) {
+        fprintf(stderr, "Error compiling the search\n");
+        tsk_error_print(stderr);
+        tsk_msearch_free(ms);
+        return NULL;
+    }
+    return ms;
+}
+
+/*
+ * Scan a buffer in pieces of a_piece bytes, keeping the state between
+ * them.  The matches are sorted by offset and ID.
+ */
+static bool
+scan(const TSK_MSEARCH * a_ms, const std::string & a_buf, size_t a_piece,
+    Matches & a_matches)
+{
+    TSK_MSEARCH_STATE state;
+
+    a_matches.clear();
+    tsk_msearch_state_init(&state);
+    for (size_t off = 0; off < a_buf.size(); off += a_piece) {
+        size_t len = std::min(a_piece, a_buf.size() - off);
+        if (tsk_msearch_scan(a_ms, &state, (TSK_OFF_T) off,
+                (const uint8_t *) a_buf.data() + off, len, collect,
+                &a_matches) != TSK_WALK_CONT) {
+            fprintf(stderr, "Scan did not return TSK_WALK_CONT\n");
+            return false;
+        }
+    }
+    std::sort(a_matches.begin(), a_matches.end());
+    return true;
+}
+
+static bool
+check_matches(const Matches & a_matches, const Matches & a_expected,
+    const char *a_desc)
+{
+    if (a_matches == a_expected)
+        return true;
+
+    fprintf(stderr, "%s: wrong matches:", a_desc);
+    for (size_t i = 0; i < a_matches.size(); i++)
+        fprintf(stderr, " %" PRIdOFF ":%d", a_matches[i].first,
+            a_matches[i].second);
+    fprintf(stderr, "\n");
+    return false;
+}
+
+static bool
+test_overlapping()
+{
+    static const char *const pats[] = { "he", "she", "his", "hers", "aa",
+        NULL
+    };
+    static const uint8_t nocase[] = { 0, 0, 0, 0, 0 };
+    TSK_MSEARCH *ms;
+    Matches matches, expected;
+    bool ok;
+
+    if ((ms = make_search(pats, nocase)) == NULL)
+        return false;
+
+    if (tsk_msearch_max_len(ms) != 4) {
+        fprintf(stderr, "Overlapping: wrong maximum length: %" PRIuSIZE
+            "\n", tsk_msearch_max_len(ms));
+        tsk_msearch_free(ms);
+        return false;
+    }
+
+    expected.push_back(std::make_pair((TSK_OFF_T) 1, 2));       // she
+    expected.push_back(std::make_pair((TSK_OFF_T) 2, 1));       // he
+    expected.push_back(std::make_pair((TSK_OFF_T) 2, 4));       // hers
+    expected.push_back(std::make_pair((TSK_OFF_T) 7, 5));       // aa three times
+    expected.push_back(std::make_pair((TSK_OFF_T) 8, 5));
+    expected.push_back(std::make_pair((TSK_OFF_T) 9, 5));
+    ok = scan(ms, "ushers aaaa", 64, matches)
+        && check_matches(matches, expected, "Overlapping");
+
+    tsk_msearch_free(ms);
+    return ok;
+}
+
+static bool
+test_case()
+{
+    static const char *const pats[] = { "Abc", "XYZ", NULL };
+    static const uint8_t nocase[] = { 0, 1 };
+    TSK_MSEARCH *ms;
+    Matches matches, expected;
+    bool ok;
+
+    if ((ms = make_search(pats, nocase)) == NULL)
+        return false;
+
+    expected.push_back(std::make_pair((TSK_OFF_T) 4, 1));
+    expected.push_back(std::make_pair((TSK_OFF_T) 12, 2));
+    expected.push_back(std::make_pair((TSK_OFF_T) 16, 2));
+    ok = scan(ms, "abc Abc ABC xyz XyZ", 64, matches)
+        && check_matches(matches, expected, "Case");
+
+    tsk_msearch_free(ms);
+    return ok;
+}
+
+static bool
+test_buffer_boundaries()
+{
+    static const char *const pats[] = { "JFIF", "FIFO", "%pdf-",
+        "\xff\xd8\xff", NULL
+    };
+    static const uint8_t nocase[] = { 0, 0, 1, 0 };
+    TSK_MSEARCH *ms;
+    Matches whole, matches;
+    char desc[64];
+
+    if ((ms = make_search(pats, nocase)) == NULL)
+        return false;
+
+    std::string buf("xx\xff\xd8\xff" "JFIFO..%PDF-1.4 jfif JFIFIFO %pdf-%pDf-");
+    if ((scan(ms, buf, buf.size(), whole) == false) || (whole.size() != 8)) {
+        fprintf(stderr, "Buffer boundaries: %" PRIuSIZE
+            " matches, expected 8\n", whole.size());
+        tsk_msearch_free(ms);
+        return false;
+    }
+
+    // every way of splitting the buffer finds the same matches
+    for (size_t piece = 1; piece < buf.size(); piece++) {
+        snprintf(desc, sizeof(desc), "Buffer boundaries, %" PRIuSIZE
+            " byte pieces", piece);
+        if ((scan(ms, buf, piece, matches) == false)
+            || (check_matches(matches, whole, desc) == false)) {
+            tsk_msearch_free(ms);
+            return false;
+        }
+    }
+
+    tsk_msearch_free(ms);
+    return true;
+}
+
+static bool
+test_stop()
+{
+    static const char *const pats[] = { "ab", NULL };
+    static const uint8_t nocase[] = { 0 };
+    TSK_MSEARCH *ms;
+    TSK_MSEARCH_STATE state;
+    Matches matches;
+    bool ok = true;
+
+    if ((ms = make_search(pats, nocase)) == NULL)
+        return false;
+
+    tsk_msearch_state_init(&state);
+    if (tsk_msearch_scan(ms, &state, 0, (const uint8_t *) "abab", 4,
+            stop_after_first, &matches) != TSK_WALK_STOP) {
+        fprintf(stderr, "Stop: scan did not return TSK_WALK_STOP\n");
+        ok = false;
+    }
+    else if ((matches.size() != 1) || (matches[0].first != 0)) {
+        fprintf(stderr, "Stop: scan did not stop after the first match\n");
+        ok = false;
+    }
+
+    tsk_msearch_free(ms);
+    return ok;
+}
+
+int
+main(int argc, char **argv)
+{
+    if ((test_overlapping() == false) || (test_case() == false)
+        || (test_buffer_boundaries() == false) || (test_stop() == false))
+        return EXIT_FAILURE;
+
+    return EXIT_SUCCESS;
+}
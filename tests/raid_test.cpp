@@ -0,0 +1,322 @@
+/*
+* The Sleuth Kit
+*
+* Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2016 Brian Carrier.  All Rights reserved
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/*
+ * This is a test file for The Sleuth Kit.  It tests the RAID 0 and RAID 5
+ * code.  It writes the members of small sets (each member has a header
+ * before the striped data and some bytes after the last full row), opens
+ * them as a set and compares what is read with the original data.  RAID 5
+ * is tested with each of the four layouts, both with all members and
+ * with one of them missing.
+ *
+ * The member files are written to the current directory and are removed
+ * when the test passes.
+ */
+#include "tsk/tsk_tools_i.h"
+
+#include <vector>
+#include <string>
+
+static const unsigned int STRIPE_SIZE = 4096;
+static const TSK_OFF_T DATA_OFFSET = 1024;
+static const int NUM_ROWS = 9;
+static const int NUM_MEMBERS = 4;
+
+static const char *BASE_NAME = "raid_test";
+
+/*
+ * Where the stripes of a row are on the four members of a RAID 5 set, as
+ * drawn in the Linux md documentation.  The value is the stripe number in
+ * the row or -1 for the parity.  The pattern repeats every four rows.
+ * This is written out rather than computed so that the test does not
+ * share the mapping code that it tests.
+ */
+static const int RAID5_LAYOUTS[4][4][NUM_MEMBERS] = {
+    // TSK_IMG_RAID_LAYOUT_LEFT_ASYMMETRIC
+    {{0, 1, 2, -1}, {0, 1, -1, 2}, {0, -1, 1, 2}, {-1, 0, 1, 2}},
+    // TSK_IMG_RAID_LAYOUT_LEFT_SYMMETRIC
+    {{0, 1, 2, -1}, {1, 2, -1, 0}, {2, -1, 0, 1}, {-1, 0, 1, 2}},
+    // TSK_IMG_RAID_LAYOUT_RIGHT_ASYMMETRIC
+    {{-1, 0, 1, 2}, {0, -1, 1, 2}, {0, 1, -1, 2}, {0, 1, 2, -1}},
+    // TSK_IMG_RAID_LAYOUT_RIGHT_SYMMETRIC
+    {{-1, 0, 1, 2}, {2, -1, 0, 1}, {1, 2, -1, 0}, {0, 1, 2, -1}},
+};
+
+static std::string
+make_content(size_t a_len)
+{
+    std::string data;
+    uint32_t seed = 1;
+
+    for (size_t i = 0; i < a_len; i++) {
+        seed = seed * 1103515245 + 12345;
+        data += (char) (seed >> 16);
+    }
+    return data;
+}
+
+static std::string
+member_name(int a_num)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "%s.m%d", BASE_NAME, a_num);
+    return name;
+}
+
+static bool
+write_file(const std::string & a_name, const std::string & a_data)
+{
+    FILE *hFile = fopen(a_name.c_str(), "wb");
+    if (hFile == NULL) {
+        fprintf(stderr, "Error creating %s\n", a_name.c_str());
+        return false;
+    }
+    bool ok = (fwrite(a_data.data(), 1, a_data.size(), hFile) ==
+        a_data.size());
+    if (fclose(hFile) != 0)
+        ok = false;
+    return ok;
+}
+
+static void
+remove_members()
+{
+    for (int i = 0; i < NUM_MEMBERS; i++)
+        remove(member_name(i).c_str());
+}
+
+/*
+ * Write the members of a set of a_data.
+ * @param a_layout Index in RAID5_LAYOUTS or -1 for RAID 0
+ */
+static bool
+write_members(const std::string & a_data, int a_num_members, int a_layout)
+{
+    std::vector<std::string> members(a_num_members);
+    int per_row = (a_layout < 0) ? a_num_members : a_num_members - 1;
+
+    for (int i = 0; i < a_num_members; i++)
+        members[i].assign((size_t) DATA_OFFSET, (char) (0xa0 + i));
+
+    for (int row = 0; row < NUM_ROWS; row++) {
+        std::string parity(STRIPE_SIZE, '\0');
+
+        for (int i = 0; i < a_num_members; i++) {
+            int idx = (a_layout < 0) ? i : RAID5_LAYOUTS[a_layout][row % 4][i];
+            if (idx < 0)
+                continue;
+            size_t off = ((size_t) row * per_row + idx) * STRIPE_SIZE;
+            members[i].append(a_data, off, STRIPE_SIZE);
+            for (size_t j = 0; j < STRIPE_SIZE; j++)
+                parity[j] ^= a_data[off + j];
+        }
+        for (int i = 0; i < a_num_members; i++) {
+            if ((a_layout >= 0) && (RAID5_LAYOUTS[a_layout][row % 4][i] < 0))
+                members[i].append(parity);
+        }
+    }
+
+    // a partial row at the end that is not part of the set
+    for (int i = 0; i < a_num_members; i++) {
+        members[i].append(700, (char) 0xee);
+        if (write_file(member_name(i), members[i]) == false)
+            return false;
+    }
+    return true;
+}
+
+/*
+ * Read the whole set in pieces that do not line up with the stripes and
+ * then in one read, and compare with the original.
+ */
+static bool
+check_content(TSK_IMG_INFO * a_img, const std::string & a_data,
+    const char *a_desc)
+{
+    std::vector<char> buf(a_data.size());
+    TSK_OFF_T off = 0;
+
+    if (a_img->size != (TSK_OFF_T) a_data.size()) {
+        fprintf(stderr, "%s: size is %" PRIuOFF ", expected %" PRIuSIZE
+            "\n", a_desc, a_img->size, a_data.size());
+        return false;
+    }
+
+    while (off < a_img->size) {
+        size_t len = 100 + (size_t) (off % 7777);
+        if ((TSK_OFF_T) len > a_img->size - off)
+            len = (size_t) (a_img->size - off);
+        ssize_t cnt = tsk_img_read(a_img, off, &buf[0], len);
+        if (cnt != (ssize_t) len) {
+            fprintf(stderr, "%s: error reading %" PRIuSIZE " bytes at %"
+                PRIuOFF "\n", a_desc, len, off);
+            tsk_error_print(stderr);
+            return false;
+        }
+        if (memcmp(&buf[0], a_data.data() + off, len) != 0) {
+            fprintf(stderr, "%s: wrong data in %" PRIuSIZE " bytes at %"
+                PRIuOFF "\n", a_desc, len, off);
+            return false;
+        }
+        off += len;
+    }
+
+    // stripes on all of the members at once
+    memset(&buf[0], 0, buf.size());
+    if ((tsk_img_read(a_img, 0, &buf[0], buf.size()) != (ssize_t) buf.size())
+        || (memcmp(&buf[0], a_data.data(), buf.size()) != 0)) {
+        fprintf(stderr, "%s: wrong data in a read of the whole set\n",
+            a_desc);
+        tsk_error_print(stderr);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Open the members and then the set.
+ * @param a_missing Member to leave out or -1
+ */
+static TSK_IMG_INFO *
+open_set(int a_num_members, TSK_IMG_RAID_LEVEL_ENUM a_level,
+    TSK_IMG_RAID_LAYOUT_ENUM a_layout, int a_missing)
+{
+    TSK_IMG_INFO *members[NUM_MEMBERS];
+    TSK_IMG_INFO *img;
+
+    for (int i = 0; i < a_num_members; i++) {
+        members[i] = NULL;
+        if (i == a_missing)
+            continue;
+        if ((members[i] = tsk_img_open_utf8_sing(member_name(i).c_str(),
+                    TSK_IMG_TYPE_RAW, 0)) == NULL) {
+            fprintf(stderr, "Error opening %s\n", member_name(i).c_str());
+            tsk_error_print(stderr);
+            for (int j = 0; j < i; j++) {
+                if (members[j])
+                    tsk_img_close(members[j]);
+            }
+            return NULL;
+        }
+    }
+
+    if ((img = tsk_img_open_raid(a_num_members, members, a_level,
+                a_layout, STRIPE_SIZE, DATA_OFFSET)) == NULL) {
+        tsk_error_print(stderr);
+        for (int i = 0; i < a_num_members; i++) {
+            if (members[i])
+                tsk_img_close(members[i]);
+        }
+    }
+    return img;
+}
+
+static bool
+test_set(const std::string & a_data, int a_num_members,
+    TSK_IMG_RAID_LEVEL_ENUM a_level, TSK_IMG_RAID_LAYOUT_ENUM a_layout,
+    int a_missing, const char *a_desc)
+{
+    TSK_IMG_INFO *img;
+    bool ok;
+
+    if ((img = open_set(a_num_members, a_level, a_layout, a_missing)) ==
+        NULL) {
+        fprintf(stderr, "%s: error opening the set\n", a_desc);
+        return false;
+    }
+    ok = check_content(img, a_data, a_desc);
+    tsk_img_close(img);
+    return ok;
+}
+
+int
+main(int argc, char **argv)
+{
+    static const char *layout_names[4] = {
+        "left asymmetric", "left symmetric", "right asymmetric",
+        "right symmetric"
+    };
+    std::string data;
+    char desc[64];
+
+    // RAID 0 with three members
+    data = make_content((size_t) NUM_ROWS * 3 * STRIPE_SIZE);
+    if ((write_members(data, 3, -1) == false)
+        || (test_set(data, 3, TSK_IMG_RAID_LEVEL_0,
+                TSK_IMG_RAID_LAYOUT_LEFT_ASYMMETRIC, -1,
+                "RAID 0") == false)) {
+        remove_members();
+        return EXIT_FAILURE;
+    }
+
+    // RAID 5 with four members in each layout
+    data = make_content((size_t) NUM_ROWS * (NUM_MEMBERS - 1) * STRIPE_SIZE);
+    for (int layout = 0; layout < 4; layout++) {
+        if (write_members(data, NUM_MEMBERS, layout) == false) {
+            remove_members();
+            return EXIT_FAILURE;
+        }
+        for (int missing = -1; missing < NUM_MEMBERS; missing++) {
+            if (missing < 0)
+                snprintf(desc, sizeof(desc), "RAID 5 %s",
+                    layout_names[layout]);
+            else
+                snprintf(desc, sizeof(desc),
+                    "RAID 5 %s without member %d", layout_names[layout],
+                    missing);
+            if (test_set(data, NUM_MEMBERS, TSK_IMG_RAID_LEVEL_5,
+                    (TSK_IMG_RAID_LAYOUT_ENUM) layout, missing,
+                    desc) == false) {
+                remove_members();
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+#ifndef TSK_WIN32
+    // the description that the tools take (the members of the last set
+    // are right symmetric)
+    {
+        std::vector<std::string> names;
+        const char *images[NUM_MEMBERS];
+        TSK_IMG_INFO *img;
+
+        for (int i = 0; i < NUM_MEMBERS; i++)
+            names.push_back((i == 2) ? "missing" : member_name(i));
+        for (int i = 0; i < NUM_MEMBERS; i++)
+            images[i] = names[i].c_str();
+
+        if ((img = tsk_img_open_raid_spec("5,4k,rs,1024", NUM_MEMBERS,
+                    images, TSK_IMG_TYPE_RAW, 0)) == NULL) {
+            fprintf(stderr, "Error opening the set from its description\n");
+            tsk_error_print(stderr);
+            remove_members();
+            return EXIT_FAILURE;
+        }
+        if (check_content(img, data, "RAID 5 description") == false) {
+            tsk_img_close(img);
+            remove_members();
+            return EXIT_FAILURE;
+        }
+        tsk_img_close(img);
+
+        if ((img = tsk_img_open_raid_spec("5,4k,xs", NUM_MEMBERS,
+                    images, TSK_IMG_TYPE_RAW, 0)) != NULL) {
+            fprintf(stderr, "Opened a set with an unknown layout\n");
+            tsk_img_close(img);
+            remove_members();
+            return EXIT_FAILURE;
+        }
+        tsk_error_reset();
+    }
+#endif
+
+    remove_members();
+    return EXIT_SUCCESS;
+}
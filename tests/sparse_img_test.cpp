@@ -0,0 +1,520 @@
+/*
+* The Sleuth Kit
+*
+* Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2016 Brian Carrier.  All Rights reserved
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/*
+ * This is a test file for The Sleuth Kit.  It tests the maps of stored
+ * grains and blocks that the VMDK and VHD readers load when they open a
+ * monolithic sparse VMDK or a dynamic VHD.  It writes a small image of
+ * each kind where some of the grains or blocks (and a whole VMDK grain
+ * table) are not stored, opens it and checks the map, then compares what
+ * is read with the original data, both from one thread and from several
+ * threads at once.  The last grain and block are partial.
+ *
+ * The images are written to the current directory and are removed when
+ * the test passes.  The test is skipped if TSK was built without both
+ * libvmdk and libvhdi.
+ */
+#include "tsk/tsk_tools_i.h"
+#include "tsk_thread.h"
+
+#include <algorithm>
+#include <vector>
+#include <string>
+
+#define EXIT_IGNORE 77
+
+#if HAVE_LIBVMDK || HAVE_LIBVHDI
+
+#if HAVE_LIBVMDK
+#include "tsk/img/vmdk.h"
+#endif
+#if HAVE_LIBVHDI
+#include "tsk/img/vhd.h"
+#endif
+
+static const size_t SECTOR_SIZE = 512;
+static const int NUM_THREADS = 4;
+
+static std::string
+make_content(size_t a_len)
+{
+    std::string data;
+    uint32_t seed = 1;
+
+    data.reserve(a_len);
+    for (size_t i = 0; i < a_len; i++) {
+        seed = seed * 1103515245 + 12345;
+        data += (char) (seed >> 16);
+    }
+    return data;
+}
+
+static bool
+write_file(const char *a_name, const std::string & a_data)
+{
+    FILE *hFile = fopen(a_name, "wb");
+    if (hFile == NULL) {
+        fprintf(stderr, "Error creating %s\n", a_name);
+        return false;
+    }
+    bool ok = (fwrite(a_data.data(), 1, a_data.size(), hFile) ==
+        a_data.size());
+    if (fclose(hFile) != 0)
+        ok = false;
+    return ok;
+}
+
+static void
+put_le(std::string & a_buf, size_t a_off, int a_len, uint64_t a_val)
+{
+    for (int i = 0; i < a_len; i++)
+        a_buf[a_off + i] = (char) ((a_val >> (8 * i)) & 0xff);
+}
+
+static void
+put_be(std::string & a_buf, size_t a_off, int a_len, uint64_t a_val)
+{
+    for (int i = 0; i < a_len; i++)
+        a_buf[a_off + i] = (char) ((a_val >> (8 * (a_len - 1 - i))) & 0xff);
+}
+
+/*
+ * Read the whole image in pieces that do not line up with the grains or
+ * blocks, starting a_start bytes in, and then in one read, and compare
+ * with the original.
+ */
+static bool
+check_content(TSK_IMG_INFO * a_img, const std::string & a_data,
+    size_t a_start, const char *a_desc)
+{
+    std::vector < char >buf(a_data.size());
+    TSK_OFF_T off = (TSK_OFF_T) a_start;
+
+    if (a_img->size != (TSK_OFF_T) a_data.size()) {
+        fprintf(stderr, "%s: size is %" PRIuOFF ", expected %" PRIuSIZE
+            "\n", a_desc, a_img->size, a_data.size());
+        return false;
+    }
+
+    while (off < a_img->size) {
+        size_t len = 100 + (size_t) (off % 7777);
+        if ((TSK_OFF_T) len > a_img->size - off)
+            len = (size_t) (a_img->size - off);
+        ssize_t cnt = tsk_img_read(a_img, off, &buf[0], len);
+        if (cnt != (ssize_t) len) {
+            fprintf(stderr, "%s: error reading %" PRIuSIZE " bytes at %"
+                PRIuOFF "\n", a_desc, len, off);
+            tsk_error_print(stderr);
+            return false;
+        }
+        if (memcmp(&buf[0], a_data.data() + off, len) != 0) {
+            fprintf(stderr, "%s: wrong data in %" PRIuSIZE " bytes at %"
+                PRIuOFF "\n", a_desc, len, off);
+            return false;
+        }
+        off += len;
+    }
+
+    memset(&buf[0], 0, buf.size());
+    if ((tsk_img_read(a_img, 0, &buf[0], buf.size()) != (ssize_t) buf.size())
+        || (memcmp(&buf[0], a_data.data(), buf.size()) != 0)) {
+        fprintf(stderr, "%s: wrong data in a read of the whole image\n",
+            a_desc);
+        tsk_error_print(stderr);
+        return false;
+    }
+    return true;
+}
+
+/* Runs check_content() on an image that other threads read at the same
+ * time. */
+class ReadThread : public TskThread {
+public:
+    ReadThread(TSK_IMG_INFO * a_img, const std::string & a_data,
+        size_t a_start, const char *a_desc) :
+        m_img(a_img), m_data(a_data), m_start(a_start), m_desc(a_desc),
+        m_ok(false) {}
+
+    void operator()() {
+        m_ok = check_content(m_img, m_data, m_start, m_desc);
+    }
+
+    bool ok() const { return m_ok; }
+private:
+    TSK_IMG_INFO *m_img;
+    const std::string & m_data;
+    size_t m_start;
+    const char *m_desc;
+    bool m_ok;
+
+    // disable copy and assignment
+    ReadThread(const ReadThread &);
+    ReadThread & operator=(const ReadThread &);
+};
+
+/*
+ * Compare what is read from the image with the original, from one thread
+ * and then from NUM_THREADS threads at once.
+ */
+static bool
+check_reads(TSK_IMG_INFO * a_img, const std::string & a_data,
+    const char *a_desc)
+{
+    ReadThread *threads[NUM_THREADS];
+    bool ok = true;
+
+    if (check_content(a_img, a_data, 0, a_desc) == false)
+        return false;
+
+    for (int i = 0; i < NUM_THREADS; i++)
+        threads[i] = new ReadThread(a_img, a_data, 1000 * i, a_desc);
+    TskThread::run((TskThread **) threads, NUM_THREADS);
+    for (int i = 0; i < NUM_THREADS; i++) {
+        if (threads[i]->ok() == false)
+            ok = false;
+        delete threads[i];
+    }
+    return ok;
+}
+
+#if HAVE_LIBVMDK
+
+static const char *VMDK_NAME = "sparse_img_test.vmdk";
+
+static const size_t GRAIN_SECTORS = 8;
+static const size_t GRAIN_SIZE = GRAIN_SECTORS * SECTOR_SIZE;
+static const size_t GTES_PER_GT = 512;
+static const size_t NUM_GTS = 3;
+static const size_t NUM_GRAINS = GTES_PER_GT * NUM_GTS;
+
+// the last grain is 3 sectors short
+static const size_t VMDK_SECTORS = NUM_GRAINS * GRAIN_SECTORS - 3;
+
+/*
+ * Grain table 1 is not there at all.  In the others, some of the grains
+ * are not stored.
+ */
+static bool
+vmdk_grain_stored(size_t a_grain)
+{
+    size_t gt = a_grain / GTES_PER_GT;
+    return ((gt == 0) && (a_grain % 3 != 1))
+        || ((gt == 2) && (a_grain % 5 != 0));
+}
+
+/*
+ * Write a monolithic sparse VMDK of a_data: the header, the embedded
+ * descriptor, the grain directory, the grain tables and the grains.
+ */
+static bool
+write_vmdk(const std::string & a_data, size_t & a_num_stored)
+{
+    const size_t desc_off = 1;
+    const size_t desc_sectors = 20;
+    const size_t gd_off = desc_off + desc_sectors;
+    const size_t gt_sectors = GTES_PER_GT * 4 / SECTOR_SIZE;
+    const size_t gt_off[NUM_GTS] = { gd_off + 1, 0, gd_off + 1 + gt_sectors };
+    const size_t overhead = (gd_off + 1 + 2 * gt_sectors + GRAIN_SECTORS -
+        1) / GRAIN_SECTORS * GRAIN_SECTORS;
+    std::string vmdk(overhead * SECTOR_SIZE, '\0');
+    char desc[1024];
+
+    vmdk.replace(0, 4, "KDMV");
+    put_le(vmdk, 4, 4, 1);      // version
+    put_le(vmdk, 8, 4, 1);      // valid new line detection
+    put_le(vmdk, 12, 8, VMDK_SECTORS);
+    put_le(vmdk, 20, 8, GRAIN_SECTORS);
+    put_le(vmdk, 28, 8, desc_off);
+    put_le(vmdk, 36, 8, desc_sectors);
+    put_le(vmdk, 44, 4, GTES_PER_GT);
+    put_le(vmdk, 56, 8, gd_off);
+    put_le(vmdk, 64, 8, overhead);
+    vmdk.replace(73, 4, "\n \r\n");
+
+    snprintf(desc, sizeof(desc),
+        "# Disk DescriptorFile\n"
+        "version=1\n"
+        "CID=fffffffe\n"
+        "parentCID=ffffffff\n"
+        "createType=\"monolithicSparse\"\n"
+        "\n"
+        "# Extent description\n"
+        "RW %" PRIuSIZE " SPARSE \"%s\"\n"
+        "\n"
+        "# The Disk Data Base\n"
+        "#DDB\n"
+        "\n"
+        "ddb.virtualHWVersion = \"4\"\n"
+        "ddb.geometry.cylinders = \"6\"\n"
+        "ddb.geometry.heads = \"16\"\n"
+        "ddb.geometry.sectors = \"63\"\n"
+        "ddb.adapterType = \"ide\"\n", VMDK_SECTORS, VMDK_NAME);
+    vmdk.replace(desc_off * SECTOR_SIZE, strlen(desc), desc);
+
+    a_num_stored = 0;
+    for (size_t gt = 0; gt < NUM_GTS; gt++)
+        put_le(vmdk, gd_off * SECTOR_SIZE + gt * 4, 4, gt_off[gt]);
+    for (size_t grain = 0; grain < NUM_GRAINS; grain++) {
+        size_t off = grain * GRAIN_SIZE;
+        size_t len = std::min(GRAIN_SIZE, a_data.size() - off);
+
+        if (vmdk_grain_stored(grain) == false)
+            continue;
+        put_le(vmdk, gt_off[grain / GTES_PER_GT] * SECTOR_SIZE +
+            (grain % GTES_PER_GT) * 4, 4, vmdk.size() / SECTOR_SIZE);
+        vmdk.append(a_data, off, len);
+        vmdk.append(GRAIN_SIZE - len, '\0');
+        a_num_stored++;
+    }
+    return write_file(VMDK_NAME, vmdk);
+}
+
+static bool
+test_vmdk()
+{
+    std::string data = make_content(VMDK_SECTORS * SECTOR_SIZE);
+    TSK_IMG_INFO *img;
+    IMG_VMDK_INFO *vmdk_info;
+    size_t num_stored;
+    bool ok = true;
+
+    for (size_t grain = 0; grain < NUM_GRAINS; grain++) {
+        if (vmdk_grain_stored(grain) == false)
+            data.replace(grain * GRAIN_SIZE,
+                std::min(GRAIN_SIZE, data.size() - grain * GRAIN_SIZE),
+                std::min(GRAIN_SIZE, data.size() - grain * GRAIN_SIZE),
+                '\0');
+    }
+    if (write_vmdk(data, num_stored) == false)
+        return false;
+
+    if ((img = tsk_img_open_utf8_sing(VMDK_NAME, TSK_IMG_TYPE_DETECT,
+                0)) == NULL) {
+        fprintf(stderr, "Error opening the VMDK\n");
+        tsk_error_print(stderr);
+        return false;
+    }
+    vmdk_info = (IMG_VMDK_INFO *) img;
+
+    if (img->itype != TSK_IMG_TYPE_VMDK_VMDK) {
+        fprintf(stderr, "VMDK: opened as type %d\n", (int) img->itype);
+        tsk_img_close(img);
+        return false;
+    }
+
+    if ((vmdk_info->grain_map == NULL)
+        || (vmdk_info->grain_size != (TSK_OFF_T) GRAIN_SIZE)
+        || (vmdk_info->num_grains != NUM_GRAINS)
+        || (vmdk_info->num_alloc_grains != num_stored)) {
+        fprintf(stderr, "VMDK: grain map was not loaded or has %" PRIu64
+            " of %" PRIu64 " grains stored, expected %" PRIuSIZE " of %"
+            PRIuSIZE "\n", vmdk_info->num_alloc_grains,
+            vmdk_info->num_grains, num_stored, NUM_GRAINS);
+        ok = false;
+    }
+    if (ok)
+        ok = check_reads(img, data, "VMDK");
+
+    tsk_img_close(img);
+    return ok;
+}
+
+#endif
+
+#if HAVE_LIBVHDI
+
+static const char *VHD_NAME = "sparse_img_test.vhd";
+
+static const size_t BLOCK_SIZE = 0x200000;
+static const size_t NUM_BLOCKS = 6;
+static const size_t BLOCK_SECTORS = BLOCK_SIZE / SECTOR_SIZE;
+static const size_t BITMAP_SIZE = BLOCK_SECTORS / 8;
+
+// the last block is 300 sectors long
+static const size_t VHD_SIZE = (NUM_BLOCKS - 1) * BLOCK_SIZE +
+    300 * SECTOR_SIZE;
+
+static bool
+vhd_block_stored(size_t a_block)
+{
+    return (a_block != 1) && (a_block != 3);
+}
+
+/* Set the checksum of a footer or dynamic disk header. */
+static void
+vhd_checksum(std::string & a_buf, size_t a_off, size_t a_len,
+    size_t a_sum_off)
+{
+    uint32_t sum = 0;
+
+    put_be(a_buf, a_off + a_sum_off, 4, 0);
+    for (size_t i = 0; i < a_len; i++)
+        sum += (uint8_t) a_buf[a_off + i];
+    put_be(a_buf, a_off + a_sum_off, 4, ~sum);
+}
+
+/* The footer, with the disk geometry as the VHD specification computes
+ * it. */
+static std::string
+vhd_footer()
+{
+    std::string footer(SECTOR_SIZE, '\0');
+    uint64_t total = VHD_SIZE / SECTOR_SIZE;
+    uint64_t spt = 17, heads, cyl_heads;
+
+    cyl_heads = total / spt;
+    heads = (cyl_heads + 1023) / 1024;
+    if (heads < 4)
+        heads = 4;
+    if ((cyl_heads >= heads * 1024) || (heads > 16)) {
+        spt = 31;
+        heads = 16;
+        cyl_heads = total / spt;
+    }
+    if (cyl_heads >= heads * 1024) {
+        spt = 63;
+        heads = 16;
+        cyl_heads = total / spt;
+    }
+
+    footer.replace(0, 8, "conectix");
+    put_be(footer, 8, 4, 2);    // features
+    put_be(footer, 12, 4, 0x00010000);
+    put_be(footer, 16, 8, SECTOR_SIZE); // dynamic disk header
+    footer.replace(28, 4, "tsk ");
+    put_be(footer, 32, 4, 0x00010000);
+    footer.replace(36, 4, "Wi2k");
+    put_be(footer, 40, 8, VHD_SIZE);
+    put_be(footer, 48, 8, VHD_SIZE);
+    put_be(footer, 56, 2, cyl_heads / heads);
+    put_be(footer, 58, 1, heads);
+    put_be(footer, 59, 1, spt);
+    put_be(footer, 60, 4, 3);   // dynamic
+    for (int i = 0; i < 16; i++)
+        footer[68 + i] = (char) (0x11 * i);
+    vhd_checksum(footer, 0, SECTOR_SIZE, 64);
+    return footer;
+}
+
+/*
+ * Write a dynamic VHD of a_data: the copy of the footer, the dynamic disk
+ * header, the block allocation table, the blocks and the footer.
+ */
+static bool
+write_vhd(const std::string & a_data, size_t & a_num_stored)
+{
+    const size_t bat_off = 3 * SECTOR_SIZE;
+    std::string footer = vhd_footer();
+    std::string vhd(footer);
+
+    vhd.append(1024, '\0');
+    vhd.replace(SECTOR_SIZE, 8, "cxsparse");
+    put_be(vhd, SECTOR_SIZE + 8, 8, 0xffffffffffffffffULL);
+    put_be(vhd, SECTOR_SIZE + 16, 8, bat_off);
+    put_be(vhd, SECTOR_SIZE + 24, 4, 0x00010000);
+    put_be(vhd, SECTOR_SIZE + 28, 4, NUM_BLOCKS);
+    put_be(vhd, SECTOR_SIZE + 32, 4, BLOCK_SIZE);
+    vhd_checksum(vhd, SECTOR_SIZE, 1024, 36);
+
+    vhd.append(SECTOR_SIZE, '\xff');
+    a_num_stored = 0;
+    for (size_t block = 0; block < NUM_BLOCKS; block++) {
+        size_t off = block * BLOCK_SIZE;
+        size_t len = std::min(BLOCK_SIZE, a_data.size() - off);
+        std::string bitmap(BITMAP_SIZE, '\0');
+
+        if (vhd_block_stored(block) == false)
+            continue;
+        for (size_t s = 0; s < len / SECTOR_SIZE; s++)
+            bitmap[s / 8] |= (char) (0x80 >> (s % 8));
+        put_be(vhd, bat_off + block * 4, 4, vhd.size() / SECTOR_SIZE);
+        vhd.append(bitmap);
+        vhd.append(a_data, off, len);
+        vhd.append(BLOCK_SIZE - len, '\0');
+        a_num_stored++;
+    }
+    vhd.append(footer);
+    return write_file(VHD_NAME, vhd);
+}
+
+static bool
+test_vhd()
+{
+    std::string data = make_content(VHD_SIZE);
+    TSK_IMG_INFO *img;
+    IMG_VHDI_INFO *vhdi_info;
+    size_t num_stored;
+    bool ok = true;
+
+    for (size_t block = 0; block < NUM_BLOCKS; block++) {
+        if (vhd_block_stored(block) == false)
+            data.replace(block * BLOCK_SIZE, BLOCK_SIZE, BLOCK_SIZE, '\0');
+    }
+    if (write_vhd(data, num_stored) == false)
+        return false;
+
+    if ((img = tsk_img_open_utf8_sing(VHD_NAME, TSK_IMG_TYPE_DETECT,
+                0)) == NULL) {
+        fprintf(stderr, "Error opening the VHD\n");
+        tsk_error_print(stderr);
+        return false;
+    }
+    vhdi_info = (IMG_VHDI_INFO *) img;
+
+    if (img->itype != TSK_IMG_TYPE_VHD_VHD) {
+        fprintf(stderr, "VHD: opened as type %d\n", (int) img->itype);
+        tsk_img_close(img);
+        return false;
+    }
+
+    if ((vhdi_info->block_map == NULL)
+        || (vhdi_info->block_size != (TSK_OFF_T) BLOCK_SIZE)
+        || (vhdi_info->num_blocks != NUM_BLOCKS)
+        || (vhdi_info->num_alloc_blocks != num_stored)) {
+        fprintf(stderr, "VHD: block map was not loaded or has %" PRIu64
+            " of %" PRIu64 " blocks stored, expected %" PRIuSIZE " of %"
+            PRIuSIZE "\n", vhdi_info->num_alloc_blocks,
+            vhdi_info->num_blocks, num_stored, NUM_BLOCKS);
+        ok = false;
+    }
+    if (ok)
+        ok = check_reads(img, data, "VHD");
+
+    tsk_img_close(img);
+    return ok;
+}
+
+#endif
+
+int
+main(int argc, char **argv)
+{
+#if HAVE_LIBVMDK
+    if (test_vmdk() == false)
+        return EXIT_FAILURE;
+    remove(VMDK_NAME);
+#endif
+#if HAVE_LIBVHDI
+    if (test_vhd() == false)
+        return EXIT_FAILURE;
+    remove(VHD_NAME);
+#endif
+    return EXIT_SUCCESS;
+}
+
+#else
+
+int
+main(int argc, char **argv)
+{
+    // there is no VMDK or VHD reader to test
+    return EXIT_IGNORE;
+}
+
+#endif
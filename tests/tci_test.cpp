@@ -0,0 +1,436 @@
+/*
+* The Sleuth Kit
+*
+* Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2016 Brian Carrier.  All Rights reserved
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/*
+ * This is a test file for The Sleuth Kit.  It tests the TSK chunked image
+ * (TCI) writer and reader.  It writes a raw image that has zero chunks, a
+ * chunk that compresses well and a partial last chunk, opens it with a
+ * TCI image writer, reads pieces of it and finishes the image.  The TCI
+ * file is then opened and compared with the raw image, including the MD5
+ * and SHA-1 that the writer stored in it.  It then checks that a chunk
+ * with a bad CRC can not be read and that files with a truncated index or
+ * an index entry that points past the end of the file are not opened.
+ *
+ * The files are written to the current directory and are removed when
+ * the test passes.
+ */
+#include "tsk/tsk_tools_i.h"
+#include "tsk/img/raw.h"
+
+#include <vector>
+#include <string>
+
+#define EXIT_IGNORE 77
+
+#if HAVE_LIBZ
+#include <zlib.h>
+#include "tsk/img/tci.h"
+
+static const char *RAW_NAME = "tci_test.raw";
+static const char *TCI_NAME = "tci_test.tci";
+static const char *BAD_NAME = "tci_test.bad.tci";
+
+static const size_t CHUNK_SIZE = 65536;
+static const size_t NUM_CHUNKS = 12;
+static const size_t IMAGE_SIZE = (NUM_CHUNKS - 1) * CHUNK_SIZE + 5000;
+static const size_t ZERO_CHUNKS[2] = { 3, 7 };
+static const size_t FILL_CHUNK = 5;     // one byte value, so it is compressed
+static const size_t HEADER_SIZE = 512;
+static const size_t ENTRY_SIZE = 16;
+
+static std::string
+make_content(size_t a_len)
+{
+    std::string data;
+    uint32_t seed = 1;
+
+    data.reserve(a_len);
+    for (size_t i = 0; i < a_len; i++) {
+        seed = seed * 1103515245 + 12345;
+        data += (char) (seed >> 16);
+    }
+    for (int i = 0; i < 2; i++)
+        data.replace(ZERO_CHUNKS[i] * CHUNK_SIZE, CHUNK_SIZE, CHUNK_SIZE,
+            '\0');
+    data.replace(FILL_CHUNK * CHUNK_SIZE, CHUNK_SIZE, CHUNK_SIZE, 'x');
+    return data;
+}
+
+static bool
+write_file(const char *a_name, const std::string & a_data)
+{
+    FILE *hFile = fopen(a_name, "wb");
+    if (hFile == NULL) {
+        fprintf(stderr, "Error creating %s\n", a_name);
+        return false;
+    }
+    bool ok = (fwrite(a_data.data(), 1, a_data.size(), hFile) ==
+        a_data.size());
+    if (fclose(hFile) != 0)
+        ok = false;
+    return ok;
+}
+
+static bool
+read_file(const char *a_name, std::string & a_data)
+{
+    FILE *hFile = fopen(a_name, "rb");
+    char buf[65536];
+    size_t cnt;
+
+    if (hFile == NULL) {
+        fprintf(stderr, "Error opening %s\n", a_name);
+        return false;
+    }
+    a_data.clear();
+    while ((cnt = fread(buf, 1, sizeof(buf), hFile)) > 0)
+        a_data.append(buf, cnt);
+    fclose(hFile);
+    return true;
+}
+
+static uint64_t
+get_le(const std::string & a_buf, size_t a_off, int a_len)
+{
+    uint64_t val = 0;
+    for (int i = a_len - 1; i >= 0; i--)
+        val = (val << 8) | (uint8_t) a_buf[a_off + i];
+    return val;
+}
+
+static void
+put_le(std::string & a_buf, size_t a_off, int a_len, uint64_t a_val)
+{
+    for (int i = 0; i < a_len; i++)
+        a_buf[a_off + i] = (char) ((a_val >> (8 * i)) & 0xff);
+}
+
+/*
+ * Open the raw image with a TCI writer, read a piece of most chunks
+ * (including one that spans two chunks and the end of the image), then
+ * let the writer add the rest and close the image.
+ */
+static bool
+write_tci()
+{
+    TSK_IMG_INFO *img;
+    IMG_RAW_INFO *raw_info;
+    std::vector < char >buf(CHUNK_SIZE);
+    bool ok = true;
+
+    if ((img = tsk_img_open_utf8_sing(RAW_NAME, TSK_IMG_TYPE_RAW,
+                0)) == NULL) {
+        fprintf(stderr, "Error opening the raw image\n");
+        tsk_error_print(stderr);
+        return false;
+    }
+    if (tsk_img_writer_create(img, _TSK_T("tci_test.tci")) != TSK_OK) {
+        fprintf(stderr, "Error creating the image writer\n");
+        tsk_error_print(stderr);
+        tsk_img_close(img);
+        return false;
+    }
+    raw_info = (IMG_RAW_INFO *) img;
+
+    for (size_t chunk = 0; ok && (chunk < NUM_CHUNKS); chunk += 2) {
+        TSK_OFF_T off = (TSK_OFF_T) (chunk * CHUNK_SIZE + 1000 * chunk);
+        size_t len = 3000;
+
+        if (chunk == 8) {
+            off = (TSK_OFF_T) (9 * CHUNK_SIZE - 1000);
+            len = 2000;
+        }
+        else if (chunk == NUM_CHUNKS - 2) {
+            off = (TSK_OFF_T) (IMAGE_SIZE - 1500);
+            len = 1500;
+        }
+        if (tsk_img_read(img, off, &buf[0], len) != (ssize_t) len) {
+            fprintf(stderr, "Error reading %" PRIuSIZE " bytes at %"
+                PRIdOFF "\n", len, off);
+            tsk_error_print(stderr);
+            ok = false;
+        }
+    }
+
+    if (ok && (raw_info->img_writer->finish_image(raw_info->img_writer) !=
+            TSK_OK)) {
+        fprintf(stderr, "Error finishing the image\n");
+        tsk_error_print(stderr);
+        ok = false;
+    }
+
+    tsk_img_close(img);
+    return ok;
+}
+
+/*
+ * Open the TCI file and compare its content and hashes with the raw
+ * image.
+ */
+static bool
+check_tci(const std::string & a_data)
+{
+    TSK_IMG_INFO *img;
+    IMG_TCI_INFO *tci_info;
+    std::vector < char >buf(IMAGE_SIZE);
+    TSK_MD5_CTX md5;
+    TSK_SHA_CTX sha1;
+    unsigned char md5_sum[TSK_MD5_DIGEST_LENGTH];
+    BYTE sha1_sum[TSK_SHA_DIGEST_LENGTH];
+    TSK_OFF_T off = 0;
+    bool ok = true;
+
+    if ((img = tsk_img_open_utf8_sing(TCI_NAME, TSK_IMG_TYPE_DETECT,
+                0)) == NULL) {
+        fprintf(stderr, "Error opening the TCI file\n");
+        tsk_error_print(stderr);
+        return false;
+    }
+    tci_info = (IMG_TCI_INFO *) img;
+
+    if ((img->itype != TSK_IMG_TYPE_TCI)
+        || (img->size != (TSK_OFF_T) IMAGE_SIZE)) {
+        fprintf(stderr, "TCI file has type %d and size %" PRIdOFF "\n",
+            (int) img->itype, img->size);
+        tsk_img_close(img);
+        return false;
+    }
+
+    // pieces that do not line up with the chunks
+    while (ok && (off < img->size)) {
+        size_t len = 100 + (size_t) (off % 77777);
+        if ((TSK_OFF_T) len > img->size - off)
+            len = (size_t) (img->size - off);
+        if ((tsk_img_read(img, off, &buf[0], len) != (ssize_t) len)
+            || (memcmp(&buf[0], a_data.data() + off, len) != 0)) {
+            fprintf(stderr, "Wrong data in %" PRIuSIZE " bytes at %"
+                PRIdOFF "\n", len, off);
+            tsk_error_print(stderr);
+            ok = false;
+        }
+        off += len;
+    }
+
+    // the whole image at once
+    if (ok && ((tsk_img_read(img, 0, &buf[0], IMAGE_SIZE) !=
+                (ssize_t) IMAGE_SIZE)
+            || (memcmp(&buf[0], a_data.data(), IMAGE_SIZE) != 0))) {
+        fprintf(stderr, "Wrong data in a read of the whole image\n");
+        tsk_error_print(stderr);
+        ok = false;
+    }
+
+    TSK_MD5_Init(&md5);
+    TSK_MD5_Update(&md5, (unsigned char *) a_data.data(),
+        (unsigned int) a_data.size());
+    TSK_MD5_Final(md5_sum, &md5);
+    TSK_SHA_Init(&sha1);
+    TSK_SHA_Update(&sha1, (BYTE *) a_data.data(), (int) a_data.size());
+    TSK_SHA_Final(sha1_sum, &sha1);
+
+    if (ok && (tci_info->hash_flags != (TSK_BASE_HASH_MD5 |
+                TSK_BASE_HASH_SHA1))) {
+        fprintf(stderr, "TCI file does not have its hashes\n");
+        ok = false;
+    }
+    if (ok && (memcmp(tci_info->md5, md5_sum, TSK_MD5_DIGEST_LENGTH) != 0)) {
+        fprintf(stderr, "Wrong MD5 in the TCI file\n");
+        ok = false;
+    }
+    if (ok && (memcmp(tci_info->sha1, sha1_sum, 20) != 0)) {
+        fprintf(stderr, "Wrong SHA-1 in the TCI file\n");
+        ok = false;
+    }
+
+    tsk_img_close(img);
+    return ok;
+}
+
+/*
+ * Check the index in the file: the zero chunks are not stored, the
+ * filled chunk is compressed and the others are stored as they are.
+ * @param a_stored Set to the offset of the first chunk that is stored
+ * as it is
+ */
+static bool
+check_index(const std::string & a_tci, size_t & a_stored)
+{
+    size_t index_off = (size_t) get_le(a_tci, 40, 8);
+
+    a_stored = 0;
+    if ((get_le(a_tci, 32, 8) != NUM_CHUNKS)
+        || (index_off + NUM_CHUNKS * ENTRY_SIZE > a_tci.size())) {
+        fprintf(stderr, "Wrong number of chunks or index offset\n");
+        return false;
+    }
+
+    for (size_t chunk = 0; chunk < NUM_CHUNKS; chunk++) {
+        size_t entry = index_off + chunk * ENTRY_SIZE;
+        uint64_t offset = get_le(a_tci, entry, 8);
+        uint32_t size = (uint32_t) get_le(a_tci, entry + 8, 4);
+        size_t len = (chunk == NUM_CHUNKS - 1) ?
+            IMAGE_SIZE - chunk * CHUNK_SIZE : CHUNK_SIZE;
+        bool zero = (chunk == ZERO_CHUNKS[0]) || (chunk == ZERO_CHUNKS[1]);
+
+        if (zero != ((offset == 0) && (size == 0))) {
+            fprintf(stderr, "Chunk %" PRIuSIZE " has offset %" PRIu64
+                " and size %" PRIu32 "\n", chunk, offset, size);
+            return false;
+        }
+        if ((chunk == FILL_CHUNK) && (size >= len)) {
+            fprintf(stderr, "Chunk %" PRIuSIZE " is not compressed\n",
+                chunk);
+            return false;
+        }
+        if ((a_stored == 0) && (zero == false) && (size == len))
+            a_stored = (size_t) offset;
+    }
+    if (a_stored == 0) {
+        fprintf(stderr, "No chunk is stored uncompressed\n");
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Update the CRCs of the index and the header after the index was
+ * changed, so that only the change itself is found.
+ */
+static void
+update_crcs(std::string & a_tci)
+{
+    size_t index_off = (size_t) get_le(a_tci, 40, 8);
+
+    put_le(a_tci, 48, 4, crc32(0, (const Bytef *) a_tci.data() + index_off,
+            (uInt) (NUM_CHUNKS * ENTRY_SIZE)));
+    put_le(a_tci, HEADER_SIZE - 4, 4, crc32(0,
+            (const Bytef *) a_tci.data(), (uInt) (HEADER_SIZE - 4)));
+}
+
+/*
+ * Check that a_tci can not be opened.
+ */
+static bool
+check_not_opened(const std::string & a_tci, const char *a_desc)
+{
+    TSK_IMG_INFO *img;
+
+    if (write_file(BAD_NAME, a_tci) == false)
+        return false;
+    if ((img = tsk_img_open_utf8_sing(BAD_NAME, TSK_IMG_TYPE_TCI,
+                0)) != NULL) {
+        fprintf(stderr, "Opened a file with %s\n", a_desc);
+        tsk_img_close(img);
+        return false;
+    }
+    tsk_error_reset();
+    return true;
+}
+
+/*
+ * Check that a stored chunk with a changed byte can not be read while the
+ * chunks around it still can.
+ */
+static bool
+check_bad_crc(const std::string & a_tci, size_t a_stored)
+{
+    std::string bad(a_tci);
+    std::vector < char >buf(CHUNK_SIZE);
+    TSK_IMG_INFO *img;
+    size_t index_off = (size_t) get_le(a_tci, 40, 8);
+    size_t chunk;
+    bool ok = true;
+
+    for (chunk = 0; chunk < NUM_CHUNKS; chunk++) {
+        if (get_le(a_tci, index_off + chunk * ENTRY_SIZE, 8) == a_stored)
+            break;
+    }
+
+    bad[a_stored + 100] ^= 0x55;
+    if (write_file(BAD_NAME, bad) == false)
+        return false;
+    if ((img = tsk_img_open_utf8_sing(BAD_NAME, TSK_IMG_TYPE_TCI,
+                0)) == NULL) {
+        fprintf(stderr, "Error opening the file with a bad chunk\n");
+        tsk_error_print(stderr);
+        return false;
+    }
+
+    if (tsk_img_read(img, (TSK_OFF_T) (chunk * CHUNK_SIZE), &buf[0],
+            CHUNK_SIZE) >= 0) {
+        fprintf(stderr, "Read chunk %" PRIuSIZE " with a bad CRC\n", chunk);
+        ok = false;
+    }
+    tsk_error_reset();
+
+    chunk = (chunk == 0) ? 1 : chunk - 1;
+    if (ok && (tsk_img_read(img, (TSK_OFF_T) (chunk * CHUNK_SIZE), &buf[0],
+                CHUNK_SIZE) != (ssize_t) CHUNK_SIZE)) {
+        fprintf(stderr, "Error reading chunk %" PRIuSIZE
+            " next to the bad one\n", chunk);
+        tsk_error_print(stderr);
+        ok = false;
+    }
+
+    tsk_img_close(img);
+    return ok;
+}
+
+int
+main(int argc, char **argv)
+{
+    std::string data = make_content(IMAGE_SIZE);
+    std::string tci;
+    std::string bad;
+    size_t stored;
+    size_t index_off;
+
+    if ((write_file(RAW_NAME, data) == false) || (write_tci() == false)
+        || (check_tci(data) == false) || (read_file(TCI_NAME, tci) == false)
+        || (check_index(tci, stored) == false)
+        || (check_bad_crc(tci, stored) == false))
+        return EXIT_FAILURE;
+
+    index_off = (size_t) get_le(tci, 40, 8);
+
+    // the file ends in the middle of the index
+    bad.assign(tci, 0, index_off + ENTRY_SIZE * NUM_CHUNKS / 2);
+    if (check_not_opened(bad, "a truncated index") == false)
+        return EXIT_FAILURE;
+
+    // the index is past the end of the file
+    bad = tci;
+    put_le(bad, 40, 8, bad.size() + 512);
+    update_crcs(bad);
+    if (check_not_opened(bad, "an index past the end") == false)
+        return EXIT_FAILURE;
+
+    // a chunk is past the end of the file
+    bad = tci;
+    put_le(bad, index_off + ENTRY_SIZE, 8, bad.size() - 10);
+    update_crcs(bad);
+    if (check_not_opened(bad, "a chunk past the end") == false)
+        return EXIT_FAILURE;
+
+    remove(RAW_NAME);
+    remove(TCI_NAME);
+    remove(BAD_NAME);
+    return EXIT_SUCCESS;
+}
+
+#else
+
+int
+main(int argc, char **argv)
+{
+    // the TCI format needs zlib
+    return EXIT_IGNORE;
+}
+
+#endif
@@ -0,0 +1,317 @@
+/*
+* The Sleuth Kit
+*
+* Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2016 Brian Carrier.  All Rights reserved
+*
+* This software is distributed under the Common Public License 1.0
+*/
+
+/*
+ * This is a test file for The Sleuth Kit.  It tests the VHD image writer.
+ * It writes a raw image, opens it with an image writer and reads pieces
+ * of it so that the writer gets partial blocks, including more of them
+ * than it keeps in memory.  The VHD is then parsed here (footer, dynamic
+ * disk header, block allocation table and blocks) and compared with the
+ * raw image, first after the image is closed with only those pieces and
+ * then after the writer has filled in the rest with finish_image.  Two of
+ * the blocks are all zeros.  They must be left out of the VHD when the
+ * writer gets them whole.
+ *
+ * The files are written to the current directory and are removed when
+ * the test passes.
+ */
+#include "tsk/tsk_tools_i.h"
+#include "tsk/img/raw.h"
+
+#include <vector>
+#include <string>
+
+static const char *RAW_NAME = "vhd_writer_test.raw";
+static const char *VHD_NAME = "vhd_writer_test.vhd";
+
+static const size_t SECTOR_SIZE = 512;
+static const size_t BLOCK_SIZE = 0x200000;
+static const size_t NUM_BLOCKS = 20;    // more than the writer keeps in memory
+static const size_t IMAGE_SIZE = (NUM_BLOCKS - 1) * BLOCK_SIZE + 300 * SECTOR_SIZE;
+static const size_t ZERO_BLOCKS[2] = { 10, 15 };
+
+static std::string
+make_content(size_t a_len)
+{
+    std::string data;
+    uint32_t seed = 1;
+
+    data.reserve(a_len);
+    for (size_t i = 0; i < a_len; i++) {
+        seed = seed * 1103515245 + 12345;
+        data += (char) (seed >> 16);
+    }
+    for (int i = 0; i < 2; i++)
+        data.replace(ZERO_BLOCKS[i] * BLOCK_SIZE, BLOCK_SIZE, BLOCK_SIZE,
+            '\0');
+    return data;
+}
+
+static bool
+write_file(const char *a_name, const std::string & a_data)
+{
+    FILE *hFile = fopen(a_name, "wb");
+    if (hFile == NULL) {
+        fprintf(stderr, "Error creating %s\n", a_name);
+        return false;
+    }
+    bool ok = (fwrite(a_data.data(), 1, a_data.size(), hFile) ==
+        a_data.size());
+    if (fclose(hFile) != 0)
+        ok = false;
+    return ok;
+}
+
+static bool
+read_file(const char *a_name, std::string & a_data)
+{
+    FILE *hFile = fopen(a_name, "rb");
+    char buf[65536];
+    size_t cnt;
+
+    if (hFile == NULL) {
+        fprintf(stderr, "Error opening %s\n", a_name);
+        return false;
+    }
+    a_data.clear();
+    while ((cnt = fread(buf, 1, sizeof(buf), hFile)) > 0)
+        a_data.append(buf, cnt);
+    fclose(hFile);
+    return true;
+}
+
+static uint64_t
+get_be(const std::string & a_buf, size_t a_off, int a_len)
+{
+    uint64_t val = 0;
+    for (int i = 0; i < a_len; i++)
+        val = (val << 8) | (uint8_t) a_buf[a_off + i];
+    return val;
+}
+
+static bool
+is_zero(const std::string & a_buf, size_t a_off, size_t a_len)
+{
+    return a_buf.find_first_not_of('\0', a_off) >= a_off + a_len;
+}
+
+static bool
+get_bit(const std::string & a_buf, size_t a_off, size_t a_index)
+{
+    return (((uint8_t) a_buf[a_off + a_index / 8]) >> (7 - (a_index % 8)))
+        & 1;
+}
+
+/*
+ * Check a VHD footer (or its copy at the start of the file).
+ */
+static bool
+check_footer(const std::string & a_vhd, size_t a_off, const char *a_desc)
+{
+    uint32_t sum = 0;
+
+    if (a_vhd.compare(a_off, 8, "conectix") != 0) {
+        fprintf(stderr, "%s: no footer at %" PRIuSIZE "\n", a_desc, a_off);
+        return false;
+    }
+    for (size_t i = 0; i < 512; i++) {
+        if ((i < 0x40) || (i >= 0x44))
+            sum += (uint8_t) a_vhd[a_off + i];
+    }
+    if ((uint32_t) get_be(a_vhd, a_off + 0x40, 4) != (uint32_t) ~ sum) {
+        fprintf(stderr, "%s: wrong footer checksum\n", a_desc);
+        return false;
+    }
+    if (get_be(a_vhd, a_off + 0x30, 8) != IMAGE_SIZE) {
+        fprintf(stderr, "%s: wrong size in the footer\n", a_desc);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Parse the VHD and compare each sector that it has with the raw image.
+ * A sector that is not in the VHD reads as zeros.
+ * @param a_read Sectors that were read from the image and must be there
+ * @param a_complete true if every sector must be there
+ * @param a_no_zero true if the blocks that are all zeros must not be there
+ */
+static bool
+check_vhd(const std::string & a_data, const std::vector < bool > &a_read,
+    bool a_complete, bool a_no_zero, const char *a_desc)
+{
+    std::string vhd;
+    size_t sectors_per_block = BLOCK_SIZE / SECTOR_SIZE;
+
+    if (read_file(VHD_NAME, vhd) == false)
+        return false;
+    if ((vhd.size() < 0x600 + 512) || (vhd.size() % SECTOR_SIZE != 0)) {
+        fprintf(stderr, "%s: VHD size is %" PRIuSIZE "\n", a_desc,
+            vhd.size());
+        return false;
+    }
+    if ((check_footer(vhd, 0, a_desc) == false)
+        || (check_footer(vhd, vhd.size() - 512, a_desc) == false))
+        return false;
+
+    if ((vhd.compare(0x200, 8, "cxsparse") != 0)
+        || (get_be(vhd, 0x210, 8) != 0x600)
+        || (get_be(vhd, 0x21c, 4) != NUM_BLOCKS)
+        || (get_be(vhd, 0x220, 4) != BLOCK_SIZE)) {
+        fprintf(stderr, "%s: wrong dynamic disk header\n", a_desc);
+        return false;
+    }
+
+    for (size_t blk = 0; blk < NUM_BLOCKS; blk++) {
+        uint32_t entry = (uint32_t) get_be(vhd, 0x600 + 4 * blk, 4);
+        size_t nsect = sectors_per_block;
+        if ((blk + 1) * BLOCK_SIZE > IMAGE_SIZE)
+            nsect = (IMAGE_SIZE - blk * BLOCK_SIZE) / SECTOR_SIZE;
+
+        if ((entry != 0xffffffff) && a_no_zero
+            && is_zero(a_data, blk * BLOCK_SIZE, nsect * SECTOR_SIZE)) {
+            fprintf(stderr, "%s: zero block %" PRIuSIZE " is in the VHD\n",
+                a_desc, blk);
+            return false;
+        }
+
+        if (entry == 0xffffffff) {
+            for (size_t s = 0; s < nsect; s++) {
+                if (is_zero(a_data, blk * BLOCK_SIZE + s * SECTOR_SIZE,
+                        SECTOR_SIZE))
+                    continue;
+                if (a_complete || a_read[blk * sectors_per_block + s]) {
+                    fprintf(stderr, "%s: block %" PRIuSIZE
+                        " is missing\n", a_desc, blk);
+                    return false;
+                }
+            }
+            continue;
+        }
+
+        size_t bitmap_off = (size_t) entry * SECTOR_SIZE;
+        size_t data_off = bitmap_off + SECTOR_SIZE;
+        if (data_off + BLOCK_SIZE > vhd.size() - 512) {
+            fprintf(stderr, "%s: block %" PRIuSIZE
+                " is past the end of the file\n", a_desc, blk);
+            return false;
+        }
+        for (size_t s = 0; s < nsect; s++) {
+            size_t img_off = blk * BLOCK_SIZE + s * SECTOR_SIZE;
+            if (get_bit(vhd, bitmap_off, s) == false) {
+                if (a_complete || a_read[blk * sectors_per_block + s]) {
+                    fprintf(stderr, "%s: sector %" PRIuSIZE
+                        " of block %" PRIuSIZE " is missing\n", a_desc, s,
+                        blk);
+                    return false;
+                }
+                continue;
+            }
+            if (vhd.compare(data_off + s * SECTOR_SIZE, SECTOR_SIZE, a_data,
+                    img_off, SECTOR_SIZE) != 0) {
+                fprintf(stderr, "%s: wrong data in sector %" PRIuSIZE
+                    " of block %" PRIuSIZE "\n", a_desc, s, blk);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/*
+ * Open the raw image with a VHD writer, read a piece of each block (and
+ * a piece that spans two blocks) if a_pieces is set, then finish the
+ * image if a_finish is set and close it.
+ */
+static bool
+write_vhd(std::vector < bool > &a_read, bool a_pieces, bool a_finish,
+    const char *a_desc)
+{
+    TSK_IMG_INFO *img;
+    IMG_RAW_INFO *raw_info;
+    std::vector < char >buf(BLOCK_SIZE);
+    bool ok = true;
+
+    a_read.assign(NUM_BLOCKS * BLOCK_SIZE / SECTOR_SIZE, false);
+
+    if ((img = tsk_img_open_utf8_sing(RAW_NAME, TSK_IMG_TYPE_RAW,
+                0)) == NULL) {
+        fprintf(stderr, "%s: error opening the raw image\n", a_desc);
+        tsk_error_print(stderr);
+        return false;
+    }
+    if (tsk_img_writer_create(img, _TSK_T("vhd_writer_test.vhd")) !=
+        TSK_OK) {
+        fprintf(stderr, "%s: error creating the image writer\n", a_desc);
+        tsk_error_print(stderr);
+        tsk_img_close(img);
+        return false;
+    }
+    raw_info = (IMG_RAW_INFO *) img;
+
+    for (size_t blk = 0; a_pieces && ok && (blk < NUM_BLOCKS); blk++) {
+        TSK_OFF_T off = (TSK_OFF_T) (blk * BLOCK_SIZE + (blk % 5) * 8192);
+        size_t len = 3000 + blk * 100;
+
+        // the last one spans the end of a block
+        if (blk == NUM_BLOCKS - 2) {
+            off = (TSK_OFF_T) ((blk + 1) * BLOCK_SIZE - 4096);
+            len = 8192;
+        }
+        if (tsk_img_read(img, off, &buf[0], len) != (ssize_t) len) {
+            fprintf(stderr, "%s: error reading at %" PRIdOFF "\n", a_desc,
+                off);
+            tsk_error_print(stderr);
+            ok = false;
+        }
+        for (size_t i = 0; i < len; i += SECTOR_SIZE)
+            a_read[(size_t) (off + i) / SECTOR_SIZE] = true;
+        a_read[(size_t) (off + len - 1) / SECTOR_SIZE] = true;
+    }
+
+    if (ok && a_finish) {
+        if (raw_info->img_writer->finish_image(raw_info->img_writer) !=
+            TSK_OK) {
+            fprintf(stderr, "%s: error finishing the image\n", a_desc);
+            tsk_error_print(stderr);
+            ok = false;
+        }
+        else if (raw_info->img_writer->finishProgress != 100) {
+            fprintf(stderr, "%s: progress is %d after finishing\n",
+                a_desc, raw_info->img_writer->finishProgress);
+            ok = false;
+        }
+    }
+
+    tsk_img_close(img);
+    return ok;
+}
+
+int
+main(int argc, char **argv)
+{
+    std::string data = make_content(IMAGE_SIZE);
+    std::vector < bool > read;
+
+    if (write_file(RAW_NAME, data) == false)
+        return EXIT_FAILURE;
+
+    if ((write_vhd(read, true, false, "Partial") == false)
+        || (check_vhd(data, read, false, false, "Partial") == false)
+        || (write_vhd(read, true, true, "Finished") == false)
+        || (check_vhd(data, read, true, false, "Finished") == false)
+        || (write_vhd(read, false, true, "Whole blocks") == false)
+        || (check_vhd(data, read, true, true, "Whole blocks") == false)) {
+        return EXIT_FAILURE;
+    }
+
+    remove(RAW_NAME);
+    remove(VHD_NAME);
+    return EXIT_SUCCESS;
+}
@@ -23,10 +23,11 @@
 #include <dirent.h>
 #endif
 
-/* The general concept of this procedure is to walk the image and load the file and dir names
- * into a structure.  Then, analyze the directory to see if the name is in there or not. If it
- * was found, remove it.  At the end, we'll have a list of names that were in either the image
- * or dir, but not both. */
+/* The general concept of this procedure is to walk the directory and load the file names
+ * into a structure.  Then, walk the image and see if each name is in there or not. If it
+ * was found, mark it.  At the end, we'll have a list of names that were in either the image
+ * or dir, but not both.  With -m, the content of the files that are in both is hashed
+ * and compared too. */
 
 static TSK_TCHAR *progname;
 
@@ -37,7 +38,7 @@ usage()
 {
     TFPRINTF(stderr,
         _TSK_T
-        ("usage: %s [-f fstype] [-i imgtype] [-b dev_sector_size] [-o sector_offset] [-n start_inum] [-vV] image [image] comparison_directory\n"),
+        ("usage: %s [-f fstype] [-i imgtype] [-b dev_sector_size] [-o sector_offset] [-n start_inum] [-j threads] [-mvV] image [image] comparison_directory\n"),
         progname);
 
     tsk_fprintf(stderr,
@@ -50,6 +51,12 @@ usage()
         "\t-o sector_offset: sector offset for file system to compare\n");
     tsk_fprintf(stderr,
         "\t-n start_inum: inum for directory in image file to start compare at\n");
+    tsk_fprintf(stderr,
+        "\t-m: Compare the MD5 and SHA-1 of the files that are in both\n");
+#ifdef HAVE_PTHREAD
+    tsk_fprintf(stderr,
+        "\t-j threads: Number of threads that hash files (only useful with -m)\n");
+#endif
     tsk_fprintf(stderr, "\t-v: verbose output to stderr\n");
     tsk_fprintf(stderr, "\t-V: Print version\n");
 
@@ -57,6 +64,14 @@ usage()
 }
 
 
+TskCompareDir::TskCompareDir()
+{
+    m_lclDir = NULL;
+    m_hash = false;
+    m_threads = 0;
+    m_hashPool = NULL;
+}
+
 // Print errors as they are encountered
 uint8_t TskCompareDir::handleError() 
 {
@@ -65,7 +80,7 @@ uint8_t TskCompareDir::handleError()
 }
 
 /**
- * Process a local directory and compare its contents with the image.
+ * Load the names of the files in a local directory.
  * This will recursively call itself on subdirectories. 
  * @param a_dir Subdirectory of m_lclDir to process. 
  * @returns 1 on error
@@ -73,7 +88,10 @@ uint8_t TskCompareDir::handleError()
 uint8_t
     TskCompareDir::processLclDir(const TSK_TCHAR * a_dir)
 {
-    std::set < char *, ltstr >::iterator it;
+    LCL_FILE lclFile;
+    lclFile.inImg = false;
+    lclFile.imgErr = 0;
+    lclFile.lclErr = 0;
 
 #ifdef TSK_WIN32
     WIN32_FIND_DATA ffd;
@@ -113,7 +131,8 @@ uint8_t
         //if the file is a directory make recursive call
         if (ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
             // skip the '.' and '..' entries
-            if ((file[0] == L'.') && ((file[1] == '\0') || ((file[1] == L'.') && (file[2] == '\0')))) {
+            const wchar_t *name = ffd.cFileName;
+            if ((name[0] == L'.') && ((name[1] == '\0') || ((name[1] == L'.') && (name[2] == '\0')))) {
                 // do nothing
             }
             else if (processLclDir(file)) {
@@ -139,15 +158,11 @@ uint8_t
                 return 1;
             }
 
-            //if the file is in the set, remove it and continue, if not print
-            it = m_filesInImg.find(file8);
-            if (it != m_filesInImg.end()) {
-                m_filesInImg.erase(it);
-            }
-            else {
-                printf("file: %s not found in image file\n", file8);
-                m_missDirFile = true;
-            }
+            lclFile.name = file8;
+            lclFile.fullPath = (wchar_t *) m_lclDir;
+            lclFile.fullPath += file;
+            m_lclNames[lclFile.name] = m_lclFiles.size();
+            m_lclFiles.push_back(lclFile);
         }
     } while (FindNextFile(hFind, &ffd) != 0);
 
@@ -174,10 +189,22 @@ uint8_t
         strncpy(fullPath, m_lclDir, TSK_CD_BUFSIZE);
         strncat(fullPath, file, TSK_CD_BUFSIZE-strlen(fullPath));
 
-        stat(fullPath, &status);
-        if (S_ISDIR(status.st_mode)) {
+        bool isDir;
+#ifdef DT_DIR
+        if (dirp->d_type == DT_DIR)
+            isDir = true;
+        else if (dirp->d_type == DT_REG)
+            isDir = false;
+        else
+#endif
+        {
+            stat(fullPath, &status);
+            isDir = S_ISDIR(status.st_mode);
+        }
+        if (isDir) {
             // skip the '.' and '..' entries
-            if ((file[0] == '.') && ((file[1] == '\0') || ((file[1] == '.') && (file[2] == '\0')))) {
+            const char *name = dirp->d_name;
+            if ((name[0] == '.') && ((name[1] == '\0') || ((name[1] == '.') && (name[2] == '\0')))) {
                 // do nothing
             }
             else if (processLclDir(file)) {
@@ -185,24 +212,20 @@ uint8_t
             }
         }
         else {
-            // see if we already saw this file in the image
-            it = m_filesInImg.find(file);
-            if (it != m_filesInImg.end()) {
-                m_filesInImg.erase(it);
-            }
-            else {
-                printf("file: %s not found in image file\n", file);
-                m_missDirFile = true;
-            }
+            lclFile.name = file;
+            lclFile.fullPath = fullPath;
+            m_lclNames[lclFile.name] = m_lclFiles.size();
+            m_lclFiles.push_back(lclFile);
         }
     }
+    closedir(dp);
 #endif
 
     return 0;
 }
 
 
-/********** Methods that load the internal list / set with info from the image **********/
+/********** Methods that compare the files in the image with the internal list **********/
 
 TSK_RETVAL_ENUM
 TskCompareDir::processFile(TSK_FS_FILE * a_fs_file, const char *a_path)
@@ -221,30 +244,52 @@ TskCompareDir::processFile(TSK_FS_FILE * a_fs_file, const char *a_path)
         return TSK_OK;
     
     //create the full path
-    size_t len = strlen(a_fs_file->name->name) + strlen(a_path) + 1;
-    char *fullPath = (char *) tsk_malloc(len);
-    if (fullPath == NULL) {
-        registerError();
-        return TSK_STOP;
-    }
-    
-    snprintf(fullPath, len, "/");
-    strncat(fullPath, a_path, len-strlen(fullPath));
-    strncat(fullPath, a_fs_file->name->name, len-strlen(fullPath));
+    std::string fullPath = "/";
+    fullPath += a_path;
+    fullPath += a_fs_file->name->name;
     
     //convert path for win32
 #ifdef WIN32
-    for (size_t i = 0; i < strlen(fullPath); i++) {
+    for (size_t i = 0; i < fullPath.size(); i++) {
         if (fullPath[i] == '/')
             fullPath[i] = '\\';
     }
 #endif
     
-    //add the path to the internal list/set
-    m_filesInImg.insert(fullPath);
+    //if the file is in the directory, mark it, if not remember it
+    std::map < std::string, size_t >::iterator it = m_lclNames.find(fullPath);
+    if (it == m_lclNames.end()) {
+        m_filesInImg.insert(fullPath);
+        return TSK_OK;
+    }
+
+    LCL_FILE & lclFile = m_lclFiles[it->second];
+    if ((m_hash) && (lclFile.inImg == false)) {
+        if ((m_hashPool->addImgFile(a_fs_file, &lclFile))
+            || (m_hashPool->addLclFile(lclFile.fullPath.c_str(), &lclFile))) {
+            registerError();
+            return TSK_STOP;
+        }
+    }
+    lclFile.inImg = true;
     return TSK_OK;
 }
 
+/* Save the hashes of a file in the image or the directory */
+void
+TskCompareDir::hashDone(TSK_HASH_JOB * a_job, void * /*a_ptr*/)
+{
+    LCL_FILE *lclFile = (LCL_FILE *) a_job->ptr;
+    if (a_job->fs_file) {
+        lclFile->imgErr = a_job->err;
+        lclFile->imgHash = a_job->hash;
+    }
+    else {
+        lclFile->lclErr = a_job->err;
+        lclFile->lclHash = a_job->hash;
+    }
+}
+
 TSK_FILTER_ENUM
 TskCompareDir::filterVol(const TSK_VS_PART_INFO * /*a_vs_part*/)
 {
@@ -266,24 +311,47 @@ uint8_t
 {
     uint8_t retval;
 
-    // collect the file names that are in the disk image
+    // load the file names that are in the local directory
+    m_lclDir = a_lcl_dir;
+    if (processLclDir(_TSK_T("")))
+        return 1;
+
+    // compare the file names that are in the disk image with them
+    TSK_OFF_T start = a_soffset * m_img_info->sector_size;
+    TSK_FS_INFO *fs_info = tsk_fs_open_img(m_img_info, start, a_fstype);
+    if (fs_info == NULL) {
+        tsk_error_set_errstr2("Sector offset: %" PRIuOFF, start / 512);
+        registerError();
+        return 1;
+    }
+
+    TskHashPool hashPool((TSK_BASE_HASH_ENUM) (TSK_BASE_HASH_MD5 |
+            TSK_BASE_HASH_SHA1), m_hash ? m_threads : 0, hashDone, this);
+    m_hashPool = &hashPool;
     if (a_inum != 0)
-        retval =
-            findFilesInFs(a_soffset * m_img_info->sector_size, a_fstype, a_inum);
+        retval = findFilesInFs(fs_info, a_inum);
     else
-        retval = findFilesInFs(a_soffset * m_img_info->sector_size, a_fstype);
+        retval = findFilesInFs(fs_info);
+
+    // the hashes need the file system
+    hashPool.finish();
+    m_hashPool = NULL;
+    tsk_fs_close(fs_info);
 
     if (retval)
         return 1;
 
-    m_missDirFile = false;
-    m_lclDir = a_lcl_dir;
-
-    // process the local directory
-    if (processLclDir(_TSK_T("")))
-        return 1;
+    bool missDirFile = false;
+    bool diffContent = false;
+    for (size_t i = 0; i < m_lclFiles.size(); i++) {
+        const LCL_FILE & lclFile = m_lclFiles[i];
+        if (lclFile.inImg == false) {
+            printf("file: %s not found in image file\n", lclFile.name.c_str());
+            missDirFile = true;
+        }
+    }
 
-    if (m_missDirFile == false) {
+    if (missDirFile == false) {
         printf("All files in directory found in image\n");
     }
 
@@ -291,10 +359,33 @@ uint8_t
         printf("All files in image found in directory\n");
     }
     else {
-        std::set < char *, ltstr >::iterator it;
+        std::set < std::string, std::greater < std::string > >::iterator it;
         for (it = m_filesInImg.begin(); it != m_filesInImg.end(); ++it)
-            printf("file: %" PRIttocTSK " not found in directory\n",
-                (TSK_TCHAR *) * it);
+            printf("file: %s not found in directory\n", it->c_str());
+    }
+
+    if (m_hash) {
+        for (size_t i = 0; i < m_lclFiles.size(); i++) {
+            const LCL_FILE & lclFile = m_lclFiles[i];
+            if (lclFile.inImg == false)
+                continue;
+            if ((lclFile.imgErr) || (lclFile.lclErr)) {
+                printf("file: %s could not be hashed in the %s\n",
+                    lclFile.name.c_str(),
+                    lclFile.imgErr ? "image file" : "directory");
+                diffContent = true;
+            }
+            else if ((memcmp(lclFile.imgHash.md5_digest,
+                        lclFile.lclHash.md5_digest, 16))
+                || (memcmp(lclFile.imgHash.sha1_digest,
+                        lclFile.lclHash.sha1_digest, 20))) {
+                printf("file: %s content differs\n", lclFile.name.c_str());
+                diffContent = true;
+            }
+        }
+        if (diffContent == false) {
+            printf("All files in both have the same content\n");
+        }
     }
 
     return 0;
@@ -323,11 +414,13 @@ main(int argc, char **argv1)
     TSK_TCHAR *cp;
     int ch;
     TSK_INUM_T inum = 0;
+    bool hash = false;
+    int threads = 0;
 
     progname = argv[0];
     setlocale(LC_ALL, "");
 
-    while ((ch = GETOPT(argc, argv, _TSK_T("b:f:i:o:n:vV"))) > 0) {
+    while ((ch = GETOPT(argc, argv, _TSK_T("b:f:i:j:mo:n:vV"))) > 0) {
         switch (ch) {
         case _TSK_T('?'):
         default:
@@ -374,6 +467,21 @@ main(int argc, char **argv1)
             break;
             
 
+        case _TSK_T('j'):
+            threads = (int) TSTRTOUL(OPTARG, &cp, 0);
+            if (*cp || *cp == *OPTARG || threads < 1) {
+                TFPRINTF(stderr,
+                         _TSK_T
+                         ("invalid argument: threads must be positive: %s\n"),
+                         OPTARG);
+                usage();
+            }
+            break;
+
+        case _TSK_T('m'):
+            hash = true;
+            break;
+
         case _TSK_T('n'):
             if (tsk_fs_parse_inum(OPTARG, &inum, NULL, NULL, NULL, NULL)) {
                 tsk_error_print(stderr);
@@ -408,6 +516,7 @@ main(int argc, char **argv1)
     TskCompareDir tskCompareDir;
 
     tskCompareDir.setFileFilterFlags(TSK_FS_DIR_WALK_FLAG_ALLOC);
+    tskCompareDir.setHash(hash, threads);
 
     if (tskCompareDir.openImage(argc - OPTIND - 1, &argv[OPTIND], imgtype, ssize)) {
         tsk_error_print(stderr);
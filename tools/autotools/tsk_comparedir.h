@@ -1,30 +1,49 @@
 #ifndef _TSK_COMPAREDIR_H
 #define _TSK_COMPAREDIR_H
 
+#include <functional>
+#include <map>
 #include <set>
+#include <string>
+#include <vector>
 #include <stdlib.h>
 
-struct ltstr
-{
-  bool operator()(char* s1, char* s2) const
-  {
-    return strcmp(s1, s2) > 0;
-  }
-};
+#include "tsk_hashpool.h"
 
 class TskCompareDir : public TskAuto {
 public:
+    TskCompareDir();
     uint8_t compareDirs(TSK_OFF_T soffset, TSK_INUM_T inum, TSK_FS_TYPE_ENUM a_fstype, const TSK_TCHAR * lcl_dir);
     virtual uint8_t handleError();
+    void setHash(bool a_hash, int a_threads) {
+        m_hash = a_hash;
+        m_threads = a_threads;
+    };
 
 private:
-    std::set<char*, ltstr> m_filesInImg; 
-    bool m_missDirFile;
+    /* A file in the local directory, in the order that they were found */
+    typedef struct {
+        std::string name;       ///< Path from the directory, in UTF-8
+        std::basic_string<TSK_TCHAR> fullPath;
+        bool inImg;
+        uint8_t imgErr;
+        uint8_t lclErr;
+        TSK_FS_HASH_RESULTS imgHash;
+        TSK_FS_HASH_RESULTS lclHash;
+    } LCL_FILE;
+
+    std::vector<LCL_FILE> m_lclFiles;
+    std::map<std::string, size_t> m_lclNames;  ///< Index in m_lclFiles by name
+    std::set<std::string, std::greater<std::string> > m_filesInImg;   ///< Files that are not in the directory
     const TSK_TCHAR *m_lclDir;
+    bool m_hash;
+    int m_threads;
+    TskHashPool *m_hashPool;
     
     virtual TSK_RETVAL_ENUM processFile(TSK_FS_FILE * fs_file, const char *path); 
 	virtual TSK_FILTER_ENUM filterVol(const TSK_VS_PART_INFO * vs_part);
     uint8_t processLclDir(const TSK_TCHAR *dir);
+    static void hashDone(TSK_HASH_JOB * a_job, void *a_ptr);
 };
 
 #endif
@@ -10,6 +10,8 @@
  */
 
 #include "tsk/tsk_tools_i.h"
+#include "tsk/fs/tsk_fs_i.h"
+#include "tsk_hashpool.h"
 #include <locale.h>
 #include <time.h>
 
@@ -21,13 +23,17 @@ usage()
 {
     TFPRINTF(stderr,
         _TSK_T
-        ("usage: %s [-vVm] [-i imgtype] [-b dev_sector_size] [-z zone] [-s seconds] image [image]\n"),
+        ("usage: %s [-vVm] [-i imgtype] [-b dev_sector_size] [-j threads] [-z zone] [-s seconds] image [image]\n"),
         progname);
     tsk_fprintf(stderr,
         "\t-i imgtype: The format of the image file (use '-i list' for supported types)\n");
     tsk_fprintf(stderr,
         "\t-b dev_sector_size: The size (in bytes) of the device sectors\n");
 	tsk_fprintf(stderr, "\t-m: Calculate MD5 hash in output (slow)\n");
+#ifdef HAVE_PTHREAD
+    tsk_fprintf(stderr,
+        "\t-j threads: Number of threads that hash files (only useful with -m)\n");
+#endif
     tsk_fprintf(stderr, "\t-v: verbose output to stderr\n");
     tsk_fprintf(stderr, "\t-V: Print version\n");
     tsk_fprintf(stderr,
@@ -48,19 +54,38 @@ class TskGetTimes:public TskAuto {
     virtual TSK_FILTER_ENUM filterVol(const TSK_VS_PART_INFO * vs_part);
     virtual TSK_FILTER_ENUM filterFs(TSK_FS_INFO * fs_info);
     virtual uint8_t handleError();
+    void setThreads(int a_threads) {
+        m_threads = a_threads;
+    };
     
 private:
     int m_curVolAddr;
     int32_t m_secSkew;
 	bool m_compute_hash;
+    int m_threads;
+    TskHashPool *m_hashPool;
+    char m_macPre[32];
+
+    static TSK_WALK_RET_ENUM hashDentAct(TSK_FS_FILE * fs_file,
+        const char *path, void *ptr);
+    static void printHashedFile(TSK_HASH_JOB * a_job, void *a_ptr);
 };
 
+/* A file whose hash is being calculated and the attributes that it
+ * has a line for */
+typedef struct {
+    std::string path;
+    std::vector < int > attrIds;        ///< -1 for a line without an attribute
+} GETTIMES_FILE;
+
 
 TskGetTimes::TskGetTimes(int32_t a_secSkew)
 {
     m_curVolAddr = -1;
     m_secSkew = a_secSkew;
 	m_compute_hash = false;
+    m_threads = 0;
+    m_hashPool = NULL;
 }
 
 TskGetTimes::TskGetTimes(int32_t a_secSkew, bool a_compute_hash)
@@ -68,6 +93,8 @@ TskGetTimes::TskGetTimes(int32_t a_secSkew, bool a_compute_hash)
     m_curVolAddr = -1;
     m_secSkew = a_secSkew;
 	m_compute_hash = a_compute_hash;
+    m_threads = 0;
+    m_hashPool = NULL;
 }
 
 // Print errors as they are encountered
@@ -84,6 +111,92 @@ TSK_RETVAL_ENUM TskGetTimes::processFile(TSK_FS_FILE * /*fs_file*/, const char *
 }
 
 
+/* Queue a file to be hashed with the lines that tsk_fs_fls() would
+ * print for it with TSK_FS_FLS_MAC, TSK_FS_FLS_DIR and TSK_FS_FLS_FILE. */
+TSK_WALK_RET_ENUM
+TskGetTimes::hashDentAct(TSK_FS_FILE * fs_file, const char *a_path,
+    void *ptr)
+{
+    TskGetTimes *tsk = (TskGetTimes *) ptr;
+    GETTIMES_FILE *file = new GETTIMES_FILE;
+    file->path = a_path;
+
+    /* Make a special case for NTFS so we can identify all of the
+     * alternate data streams! */
+    if ((TSK_FS_TYPE_ISNTFS(fs_file->fs_info->ftype)) && (fs_file->meta)) {
+        uint8_t printed = 0;
+        int cnt = tsk_fs_file_attr_getsize(fs_file);
+        for (int i = 0; i < cnt; i++) {
+            const TSK_FS_ATTR *fs_attr = tsk_fs_file_attr_get_idx(fs_file, i);
+            if (!fs_attr)
+                continue;
+
+            if (fs_attr->type == TSK_FS_ATTR_TYPE_NTFS_DATA) {
+                printed = 1;
+                // skip the ..:blah stream
+                if ((fs_file->meta->type == TSK_FS_META_TYPE_DIR)
+                    && (fs_file->name->name[0] == '.')
+                    && (fs_file->name->name[1])
+                    && (fs_file->name->name[2] == '\0'))
+                    continue;
+                file->attrIds.push_back(fs_attr->id);
+            }
+            else if (fs_attr->type == TSK_FS_ATTR_TYPE_NTFS_IDXROOT) {
+                printed = 1;
+                if (!TSK_FS_ISDOT(fs_file->name->name))
+                    file->attrIds.push_back(fs_attr->id);
+            }
+            else if ((fs_attr->type == TSK_FS_ATTR_TYPE_NTFS_FNAME) &&
+                (fs_attr->id == fs_file->meta->time2.ntfs.fn_id)) {
+                if (!TSK_FS_ISDOT(fs_file->name->name))
+                    file->attrIds.push_back(fs_attr->id);
+            }
+        }
+        if (printed == 0)
+            file->attrIds.push_back(-1);
+    }
+    else if (!TSK_FS_ISDOT(fs_file->name->name)) {
+        file->attrIds.push_back(-1);
+    }
+
+    if (file->attrIds.empty()) {
+        delete file;
+        return TSK_WALK_CONT;
+    }
+    if (tsk->m_hashPool->addImgFile(fs_file, file)) {
+        delete file;
+        return TSK_WALK_ERROR;
+    }
+    return TSK_WALK_CONT;
+}
+
+/* Print the lines of a file once its hash is done */
+void
+TskGetTimes::printHashedFile(TSK_HASH_JOB * a_job, void *a_ptr)
+{
+    TskGetTimes *tsk = (TskGetTimes *) a_ptr;
+    GETTIMES_FILE *file = (GETTIMES_FILE *) a_job->ptr;
+    unsigned char null_buf[16];
+
+    // If the hash calculation had errors, pass in a buffer of nulls
+    memset(null_buf, 0, 16);
+    for (size_t i = 0; i < file->attrIds.size(); i++) {
+        const TSK_FS_ATTR *fs_attr = NULL;
+        if (file->attrIds[i] >= 0) {
+            fs_attr = tsk_fs_file_attr_get_id(a_job->fs_file,
+                (uint16_t) file->attrIds[i]);
+            if (fs_attr == NULL)
+                tsk_error_reset();
+        }
+        tsk_fs_name_print_mac_md5(stdout, a_job->fs_file,
+            file->path.c_str(), fs_attr, tsk->m_macPre, tsk->m_secSkew,
+            a_job->err ? null_buf : a_job->hash.md5_digest);
+        tsk_printf("\n");
+    }
+    delete file;
+}
+
+
 TSK_FILTER_ENUM
 TskGetTimes::filterFs(TSK_FS_INFO * fs_info)
 {
@@ -95,6 +208,28 @@ TskGetTimes::filterFs(TSK_FS_INFO * fs_info)
         volName[0] = '\0';
     }
 
+    /* With threads, the content is hashed by a TskHashPool and the lines
+     * are printed in the same order as tsk_fs_fls() prints them. */
+    if ((m_compute_hash) && (m_threads > 0)) {
+        if (m_curVolAddr > -1)
+            snprintf(m_macPre, sizeof(m_macPre), "vol%d/", m_curVolAddr);
+        else
+            m_macPre[0] = '\0';
+
+        m_hashPool = new TskHashPool(TSK_BASE_HASH_MD5, m_threads,
+            printHashedFile, this);
+        if (tsk_fs_dir_walk(fs_info, fs_info->root_inum,
+                (TSK_FS_DIR_WALK_FLAG_ENUM) (TSK_FS_DIR_WALK_FLAG_ALLOC |
+                    TSK_FS_DIR_WALK_FLAG_UNALLOC |
+                    TSK_FS_DIR_WALK_FLAG_RECURSE), hashDentAct, this)) {
+        }
+        // the file system is closed after this returns
+        m_hashPool->finish();
+        delete m_hashPool;
+        m_hashPool = NULL;
+        return TSK_FILTER_SKIP;
+    }
+
     TSK_FS_FLS_FLAG_ENUM fls_flags = (TSK_FS_FLS_FLAG_ENUM)(TSK_FS_FLS_MAC | TSK_FS_FLS_DIR | TSK_FS_FLS_FILE | TSK_FS_FLS_FULL);
     if(m_compute_hash){
         fls_flags = (TSK_FS_FLS_FLAG_ENUM)(fls_flags | TSK_FS_FLS_HASH);
@@ -125,6 +260,7 @@ main(int argc, char **argv1)
     TSK_TCHAR *cp;
     int32_t sec_skew = 0;
 	bool do_hash = false;
+    int threads = 0;
 
 #ifdef TSK_WIN32
     // On Windows, get the wide arguments (mingw doesn't support wmain)
@@ -140,7 +276,7 @@ main(int argc, char **argv1)
     progname = argv[0];
     setlocale(LC_ALL, "");
 
-    while ((ch = GETOPT(argc, argv, _TSK_T("b:i:s:mvVz:"))) > 0) {
+    while ((ch = GETOPT(argc, argv, _TSK_T("b:i:j:s:mvVz:"))) > 0) {
         switch (ch) {
         case _TSK_T('?'):
         default:
@@ -175,6 +311,17 @@ main(int argc, char **argv1)
             }
             break;
                 
+        case _TSK_T('j'):
+            threads = (int) TSTRTOUL(OPTARG, &cp, 0);
+            if (*cp || *cp == *OPTARG || threads < 1) {
+                TFPRINTF(stderr,
+                    _TSK_T
+                    ("invalid argument: threads must be positive: %s\n"),
+                    OPTARG);
+                usage();
+            }
+            break;
+
         case _TSK_T('s'):
             sec_skew = TATOI(OPTARG);
             break;
@@ -216,6 +363,7 @@ main(int argc, char **argv1)
     }
 
     TskGetTimes tskGetTimes(sec_skew, do_hash);
+    tskGetTimes.setThreads(threads);
     if (tskGetTimes.openImage(argc - OPTIND, &argv[OPTIND], imgtype,
             ssize)) {
         tsk_error_print(stderr);
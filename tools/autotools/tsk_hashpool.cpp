@@ -0,0 +1,382 @@
+/*
+ ** The Sleuth Kit
+ **
+ ** Brian Carrier [carrier <at> sleuthkit [dot] org]
+ ** Copyright (c) 2010-2016 Brian Carrier.  All Rights reserved
+ **
+ ** This software is distributed under the Common Public License 1.0
+ **
+ */
+
+/**
+ * \file tsk_hashpool.cpp
+ * Hashes file content with a pool of threads for tsk_gettimes and
+ * tsk_comparedir.  See tsk_hashpool.h.
+ */
+
+#include "tsk/tsk_tools_i.h"
+#include "tsk/fs/tsk_fs_i.h"
+#include "tsk_hashpool.h"
+
+#define TSK_HASH_POOL_BUFSIZE (1024 * 1024)     ///< Read size
+#define TSK_HASH_POOL_JOBS 64   ///< Files queued per thread before add() waits
+
+
+/**
+ * @param a_flags Digests to calculate
+ * @param a_threads Number of threads, or 0 to hash each file when it is added
+ * @param a_cb Called with each file once it is hashed
+ * @param a_ptr Passed to a_cb
+ */
+TskHashPool::TskHashPool(TSK_BASE_HASH_ENUM a_flags, int a_threads,
+    TSK_HASH_POOL_CB a_cb, void *a_ptr)
+{
+    m_flags = a_flags;
+    m_threads = a_threads;
+    m_cb = a_cb;
+    m_ptr = a_ptr;
+    m_buf = NULL;
+
+#ifdef HAVE_PTHREAD
+    pthread_mutex_init(&m_lock, NULL);
+    pthread_cond_init(&m_cond, NULL);
+    m_lastAddr = 0;
+    m_maxJobs = TSK_HASH_POOL_JOBS * (a_threads > 0 ? a_threads : 1);
+    m_stop = false;
+    for (int i = 0; i < a_threads; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, workerMain, this))
+            break;
+        m_workers.push_back(thread);
+    }
+#endif
+}
+
+TskHashPool::~TskHashPool()
+{
+    finish();
+#ifdef HAVE_PTHREAD
+    pthread_mutex_lock(&m_lock);
+    m_stop = true;
+    pthread_cond_broadcast(&m_cond);
+    pthread_mutex_unlock(&m_lock);
+    for (size_t i = 0; i < m_workers.size(); i++)
+        pthread_join(m_workers[i], NULL);
+    pthread_cond_destroy(&m_cond);
+    pthread_mutex_destroy(&m_lock);
+#endif
+    free(m_buf);
+}
+
+
+/** The digests of one file while it is read */
+typedef struct {
+    TSK_BASE_HASH_ENUM flags;
+    TSK_MD5_CTX md5;
+    TSK_SHA_CTX sha1;
+} HASH_POOL_CTX;
+
+static void
+hash_init(HASH_POOL_CTX * a_ctx, TSK_BASE_HASH_ENUM a_flags)
+{
+    a_ctx->flags = a_flags;
+    if (a_flags & TSK_BASE_HASH_MD5)
+        TSK_MD5_Init(&a_ctx->md5);
+    if (a_flags & TSK_BASE_HASH_SHA1)
+        TSK_SHA_Init(&a_ctx->sha1);
+}
+
+static void
+hash_update(HASH_POOL_CTX * a_ctx, char *a_buf, size_t a_len)
+{
+    if (a_ctx->flags & TSK_BASE_HASH_MD5)
+        TSK_MD5_Update(&a_ctx->md5, (unsigned char *) a_buf,
+            (unsigned int) a_len);
+    if (a_ctx->flags & TSK_BASE_HASH_SHA1)
+        TSK_SHA_Update(&a_ctx->sha1, (BYTE *) a_buf, (int) a_len);
+}
+
+static void
+hash_final(HASH_POOL_CTX * a_ctx, TSK_FS_HASH_RESULTS * a_hash)
+{
+    a_hash->flags = a_ctx->flags;
+    if (a_ctx->flags & TSK_BASE_HASH_MD5)
+        TSK_MD5_Final(a_hash->md5_digest, &a_ctx->md5);
+    if (a_ctx->flags & TSK_BASE_HASH_SHA1)
+        TSK_SHA_Final(a_hash->sha1_digest, &a_ctx->sha1);
+}
+
+/* Hash a local file */
+static uint8_t
+hash_lcl_file(const std::basic_string < TSK_TCHAR > &a_path,
+    TSK_BASE_HASH_ENUM a_flags, char *a_buf, TSK_FS_HASH_RESULTS * a_hash)
+{
+    HASH_POOL_CTX ctx;
+    FILE *hFile;
+
+#ifdef TSK_WIN32
+    hFile = _wfopen(a_path.c_str(), L"rb");
+#else
+    hFile = fopen(a_path.c_str(), "rb");
+#endif
+    if (hFile == NULL)
+        return 1;
+
+    hash_init(&ctx, a_flags);
+    size_t len;
+    while ((len = fread(a_buf, 1, TSK_HASH_POOL_BUFSIZE, hFile)) > 0)
+        hash_update(&ctx, a_buf, len);
+    if (ferror(hFile)) {
+        fclose(hFile);
+        return 1;
+    }
+    fclose(hFile);
+
+    hash_final(&ctx, a_hash);
+    return 0;
+}
+
+/* Hash the default attribute of a file in the image.  Unlike
+ * tsk_fs_file_hash_calc(), which walks the content one block at a time,
+ * this reads up to TSK_HASH_POOL_BUFSIZE bytes at a time, so each run of
+ * the file is read with few large reads. */
+static uint8_t
+hash_img_file(TSK_FS_FILE * a_fs_file, TSK_BASE_HASH_ENUM a_flags,
+    char *a_buf, TSK_FS_HASH_RESULTS * a_hash)
+{
+    HASH_POOL_CTX ctx;
+    const TSK_FS_ATTR *fs_attr;
+    TSK_OFF_T off;
+
+    if ((fs_attr = tsk_fs_file_attr_get(a_fs_file)) == NULL)
+        return 1;
+
+    hash_init(&ctx, a_flags);
+    for (off = 0; off < fs_attr->size;) {
+        size_t len = TSK_HASH_POOL_BUFSIZE;
+        if ((TSK_OFF_T) len > fs_attr->size - off)
+            len = (size_t) (fs_attr->size - off);
+        ssize_t cnt = tsk_fs_attr_read(fs_attr, off, a_buf, len,
+            TSK_FS_FILE_READ_FLAG_NONE);
+        if (cnt <= 0)
+            return 1;
+        hash_update(&ctx, a_buf, (size_t) cnt);
+        off += cnt;
+    }
+
+    hash_final(&ctx, a_hash);
+    return 0;
+}
+
+/**
+ * Hash one file.  For a file in the image, the meta is loaded first if
+ * the walk had it.
+ * @param a_buf Buffer of TSK_HASH_POOL_BUFSIZE bytes to read into
+ */
+void
+TskHashPool::hash(TSK_HASH_JOB * a_job, char *a_buf)
+{
+    a_job->err = 1;
+    if (a_job->fs_file == NULL) {
+        a_job->err =
+            hash_lcl_file(a_job->lclPath, m_flags, a_buf, &a_job->hash);
+        return;
+    }
+
+    TSK_FS_FILE *fs_file = a_job->fs_file;
+    if (a_job->hasMeta == false)
+        return;
+
+    /* Load the metadata the same way that tsk_fs_dir_walk() does.  The
+     * name has to be set first since NTFS uses its sequence number. */
+    if ((fs_file->meta == NULL)
+        && (fs_file->fs_info->file_add_meta(fs_file->fs_info, fs_file,
+                fs_file->name->meta_addr))) {
+        if (tsk_verbose)
+            tsk_error_print(stderr);
+        tsk_error_reset();
+        return;
+    }
+
+    if (hash_img_file(fs_file, m_flags, a_buf, &a_job->hash)) {
+        if (tsk_verbose)
+            tsk_error_print(stderr);
+        tsk_error_reset();
+        return;
+    }
+    a_job->err = 0;
+}
+
+
+/**
+ * Queue a file in the image to be hashed.  The caller can reuse its
+ * TSK_FS_FILE after this returns; the job gets its own with a copy of
+ * the name and the meta is loaded again when it is hashed.
+ * @param a_ptr Returned in the job
+ * @returns 1 on error
+ */
+uint8_t
+TskHashPool::addImgFile(TSK_FS_FILE * a_fs_file, void *a_ptr)
+{
+    TSK_FS_NAME *name = a_fs_file->name;
+    TSK_FS_FILE *fs_file = tsk_fs_file_alloc(a_fs_file->fs_info);
+    if (fs_file == NULL)
+        return 1;
+    fs_file->name = tsk_fs_name_alloc(name->name ? strlen(name->name) + 1 : 0,
+        name->shrt_name ? strlen(name->shrt_name) + 1 : 0);
+    if ((fs_file->name == NULL) || (tsk_fs_name_copy(fs_file->name, name))) {
+        tsk_fs_file_close(fs_file);
+        return 1;
+    }
+
+    TSK_HASH_JOB *job = new TSK_HASH_JOB;
+    job->fs_file = fs_file;
+    job->ptr = a_ptr;
+    job->hasMeta = (a_fs_file->meta != NULL);
+    job->addr = 0;
+    job->err = 0;
+    job->done = false;
+
+    // the first block of the content orders the reads
+    if (a_fs_file->meta) {
+        const TSK_FS_ATTR *fs_attr = tsk_fs_file_attr_get(a_fs_file);
+        if ((fs_attr) && (fs_attr->flags & TSK_FS_ATTR_NONRES)
+            && (fs_attr->nrd.run))
+            job->addr = fs_attr->nrd.run->addr;
+        else if (fs_attr == NULL)
+            tsk_error_reset();
+    }
+
+    return add(job);
+}
+
+/**
+ * Queue a local file to be hashed.
+ * @param a_ptr Returned in the job
+ * @returns 1 on error
+ */
+uint8_t
+TskHashPool::addLclFile(const TSK_TCHAR * a_path, void *a_ptr)
+{
+    TSK_HASH_JOB *job = new TSK_HASH_JOB;
+    job->fs_file = NULL;
+    job->lclPath = a_path;
+    job->ptr = a_ptr;
+    job->hasMeta = false;
+    job->addr = 0;
+    job->err = 0;
+    job->done = false;
+
+    return add(job);
+}
+
+uint8_t
+TskHashPool::add(TSK_HASH_JOB * a_job)
+{
+#ifdef HAVE_PTHREAD
+    if (m_workers.empty() == false) {
+        pthread_mutex_lock(&m_lock);
+        m_jobs.push_back(a_job);
+        m_pending.insert(std::make_pair(a_job->addr, a_job));
+        pthread_cond_broadcast(&m_cond);
+        pthread_mutex_unlock(&m_lock);
+
+        returnJobs(m_maxJobs - 1);
+        return 0;
+    }
+#endif
+
+    if ((m_buf == NULL)
+        && ((m_buf = (char *) tsk_malloc(TSK_HASH_POOL_BUFSIZE)) == NULL)) {
+        if (a_job->fs_file)
+            tsk_fs_file_close(a_job->fs_file);
+        delete a_job;
+        return 1;
+    }
+    hash(a_job, m_buf);
+    m_cb(a_job, m_ptr);
+    if (a_job->fs_file)
+        tsk_fs_file_close(a_job->fs_file);
+    delete a_job;
+    return 0;
+}
+
+/**
+ * Return the hashed files at the front of the queue.
+ * @param a_maxLeft Wait for unfinished files until at most this many are queued
+ */
+void
+TskHashPool::returnJobs(size_t a_maxLeft)
+{
+#ifdef HAVE_PTHREAD
+    pthread_mutex_lock(&m_lock);
+    while (m_jobs.empty() == false) {
+        TSK_HASH_JOB *job = m_jobs.front();
+        if (job->done == false) {
+            if (m_jobs.size() <= a_maxLeft)
+                break;
+            pthread_cond_wait(&m_cond, &m_lock);
+            continue;
+        }
+        m_jobs.pop_front();
+        pthread_mutex_unlock(&m_lock);
+
+        m_cb(job, m_ptr);
+        if (job->fs_file)
+            tsk_fs_file_close(job->fs_file);
+        delete job;
+
+        pthread_mutex_lock(&m_lock);
+    }
+    pthread_mutex_unlock(&m_lock);
+#endif
+}
+
+/**
+ * Wait for the queued files and return them.  This must be called
+ * before the file system of the queued files is closed.
+ */
+void
+TskHashPool::finish()
+{
+    returnJobs(0);
+}
+
+#ifdef HAVE_PTHREAD
+void *
+TskHashPool::workerMain(void *a_ptr)
+{
+    TskHashPool *pool = (TskHashPool *) a_ptr;
+    char *buf = (char *) tsk_malloc(TSK_HASH_POOL_BUFSIZE);
+
+    pthread_mutex_lock(&pool->m_lock);
+    while (1) {
+        while ((pool->m_stop == false) && (pool->m_pending.empty()))
+            pthread_cond_wait(&pool->m_cond, &pool->m_lock);
+        if (pool->m_pending.empty())
+            break;              // stopped with nothing left
+
+        // take the next file after the last one, going back to the start
+        std::multimap < TSK_DADDR_T, TSK_HASH_JOB * >::iterator it =
+            pool->m_pending.lower_bound(pool->m_lastAddr);
+        if (it == pool->m_pending.end())
+            it = pool->m_pending.begin();
+        TSK_HASH_JOB *job = it->second;
+        pool->m_lastAddr = it->first;
+        pool->m_pending.erase(it);
+        pthread_mutex_unlock(&pool->m_lock);
+
+        if (buf)
+            pool->hash(job, buf);
+        else
+            job->err = 1;
+
+        pthread_mutex_lock(&pool->m_lock);
+        job->done = true;
+        pthread_cond_broadcast(&pool->m_cond);
+    }
+    pthread_mutex_unlock(&pool->m_lock);
+    free(buf);
+    return NULL;
+}
+#endif
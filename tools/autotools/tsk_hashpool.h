@@ -0,0 +1,88 @@
+/*
+ ** The Sleuth Kit
+ **
+ ** Brian Carrier [carrier <at> sleuthkit [dot] org]
+ ** Copyright (c) 2010-2016 Brian Carrier.  All Rights reserved
+ **
+ ** This software is distributed under the Common Public License 1.0
+ **
+ */
+
+#ifndef _TSK_HASHPOOL_H
+#define _TSK_HASHPOOL_H
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+/** A file to hash, and its hashes once it is done */
+typedef struct {
+    TSK_FS_FILE *fs_file;       ///< File in the image (with its meta loaded), or NULL
+    std::basic_string < TSK_TCHAR > lclPath;    ///< Local file if fs_file is NULL
+    void *ptr;                  ///< Set by the caller
+    bool hasMeta;               ///< False if the walk had no meta for the file
+    TSK_DADDR_T addr;           ///< First block of the content
+    uint8_t err;                ///< 1 if the content could not be hashed
+    TSK_FS_HASH_RESULTS hash;
+    bool done;
+} TSK_HASH_JOB;
+
+/**
+ * Called with each file once it is hashed, in the order that the files
+ * were added, on the thread that added them.  The file is closed when
+ * this returns.
+ */
+typedef void (*TSK_HASH_POOL_CB) (TSK_HASH_JOB * a_job, void *a_ptr);
+
+/**
+ * Hashes the content of files in an image and of local files with a
+ * pool of threads.  Each file is hashed once for all of the requested
+ * digests, reading its content in pieces of up to 1 MB.  The threads
+ * take the queued file whose content starts at the lowest block address
+ * after the last one taken.  Only the files that are queued at the time
+ * (up to 64 per thread) are ordered, so the reads move forward through
+ * each window of files rather than through the whole image, and the
+ * threads read their files at the same time.
+ * Without threads, each file is hashed when it is added.
+ */
+class TskHashPool {
+  public:
+    TskHashPool(TSK_BASE_HASH_ENUM a_flags, int a_threads,
+        TSK_HASH_POOL_CB a_cb, void *a_ptr);
+    ~TskHashPool();
+
+    uint8_t addImgFile(TSK_FS_FILE * a_fs_file, void *a_ptr);
+    uint8_t addLclFile(const TSK_TCHAR * a_path, void *a_ptr);
+    void finish();
+
+  private:
+    void hash(TSK_HASH_JOB * a_job, char *a_buf);
+    uint8_t add(TSK_HASH_JOB * a_job);
+    void returnJobs(size_t a_maxLeft);
+
+    TSK_BASE_HASH_ENUM m_flags;
+    int m_threads;
+    TSK_HASH_POOL_CB m_cb;
+    void *m_ptr;
+    char *m_buf;                ///< Read buffer without threads
+
+#ifdef HAVE_PTHREAD
+    static void *workerMain(void *a_ptr);
+
+    pthread_mutex_t m_lock;     ///< Protects everything below
+    pthread_cond_t m_cond;
+    std::deque < TSK_HASH_JOB * >m_jobs;        ///< Not yet returned, in the order added
+    std::multimap < TSK_DADDR_T, TSK_HASH_JOB * >m_pending;      ///< Not yet taken by a worker
+    TSK_DADDR_T m_lastAddr;     ///< Address of the last job taken
+    size_t m_maxJobs;
+    bool m_stop;
+    std::vector < pthread_t > m_workers;
+#endif
+};
+
+#endif
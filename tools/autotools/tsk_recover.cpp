@@ -10,9 +10,23 @@
  */
 
 #include "tsk/tsk_tools_i.h"
+#include "tsk/fs/tsk_fs_i.h"
 #include <locale.h>
 #include <sys/stat.h>
 #include <errno.h>
+#include <time.h>
+#include <set>
+#include <string>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#include <deque>
+#endif
+
+#ifndef TSK_WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 static TSK_TCHAR *progname;
 
@@ -21,7 +35,7 @@ usage()
 {
     TFPRINTF(stderr,
         _TSK_T
-        ("usage: %s [-vVae] [-f fstype] [-i imgtype] [-b dev_sector_size] [-o sector_offset] [-d dir_inum] image [image] output_dir\n"),
+        ("usage: %s [-vVaep] [-f fstype] [-i imgtype] [-b dev_sector_size] [-o sector_offset] [-d dir_inum] [-j threads] image [image] output_dir\n"),
         progname);
     tsk_fprintf(stderr,
         "\t-i imgtype: The format of the image file (use '-i list' for supported types)\n");
@@ -38,6 +52,12 @@ usage()
         "\t-o sector_offset: sector offset for a volume to recover (recovers only that volume)\n");
     tsk_fprintf(stderr, 
         "\t-d dir_inum: Directory inum to recover from (must also specify a specific partition using -o or there must not be a volume system)\n");
+#ifdef HAVE_PTHREAD
+    tsk_fprintf(stderr,
+        "\t-j threads: Number of threads that read and write files\n");
+#endif
+    tsk_fprintf(stderr,
+        "\t-p: Print progress and throughput to stderr\n");
 
     exit(1);
 }
@@ -48,21 +68,69 @@ usage()
 #endif
 
 
+typedef std::basic_string < TSK_TCHAR > RECOVER_PATH;
+
+#define RECOVER_BUF_SIZE (1024 * 1024)  ///< Bytes collected before a write
+#define RECOVER_PROGRESS_SECS 5         ///< Seconds between progress lines
+
+
 class TskRecover:public TskAuto {
 public:
     explicit TskRecover(TSK_TCHAR * a_base_dir);
+    ~TskRecover();
     virtual TSK_RETVAL_ENUM processFile(TSK_FS_FILE * fs_file, const char *path);
     virtual TSK_FILTER_ENUM filterVol(const TSK_VS_PART_INFO * vs_part);
     virtual TSK_FILTER_ENUM filterFs(TSK_FS_INFO * fs_info);
     uint8_t findFiles(TSK_OFF_T soffset, TSK_FS_TYPE_ENUM a_ftype, TSK_INUM_T a_dirInum);
     uint8_t handleError();
+    void setThreads(int a_threads) {
+        m_threads = a_threads;
+    };
+    void setProgress(bool a_progress) {
+        m_progress = a_progress;
+    };
     
 private:
     TSK_TCHAR * m_base_dir;
+    uint8_t makeOutPath(TSK_FS_FILE * a_fs_file, const char *a_path,
+        RECOVER_PATH & a_outPath);
     uint8_t writeFile(TSK_FS_FILE * a_fs_file, const char *a_path);
+    void fileDone(uint64_t a_bytes);
+    void printProgress(bool a_final);
     char m_vsName[FILENAME_MAX];
     bool m_writeVolumeDir;
     int m_fileCount;
+    uint64_t m_byteCount;
+    std::set < RECOVER_PATH > m_dirs;   ///< Directories that have been made
+    char *m_buf;                ///< Write buffer used without threads
+    int m_threads;
+    bool m_progress;
+    time_t m_startTime;
+    time_t m_lastProgress;
+
+#ifdef HAVE_PTHREAD
+    /* With -j, the walk makes the directories and queues each file.  The
+     * workers load its metadata and read and write its content. */
+    typedef struct {
+        TSK_FS_FILE *fs_file;   ///< Own copy of the name; the worker loads the meta
+        std::string path;
+        RECOVER_PATH outPath;
+    } RECOVER_JOB;
+
+    uint8_t startWorkers();
+    uint8_t addJob(TSK_FS_FILE * a_fs_file, const char *a_path,
+        const RECOVER_PATH & a_outPath);
+    void stopWorkers();
+    static void *workerMain(void *a_ptr);
+
+    pthread_mutex_t m_lock;     ///< Protects the jobs and the counts
+    pthread_cond_t m_cond;
+    std::deque < RECOVER_JOB * >m_jobs;
+    std::set < RECOVER_PATH > m_busy;   ///< Output files queued or being written
+    size_t m_maxJobs;
+    bool m_stop;
+    std::vector < pthread_t > m_workers;
+#endif
 };
 
 
@@ -76,6 +144,27 @@ TskRecover::TskRecover(TSK_TCHAR * a_base_dir)
 #endif
     m_writeVolumeDir = false;
     m_fileCount = 0;
+    m_byteCount = 0;
+    m_buf = NULL;
+    m_threads = 0;
+    m_progress = false;
+    m_startTime = 0;
+    m_lastProgress = 0;
+#ifdef HAVE_PTHREAD
+    pthread_mutex_init(&m_lock, NULL);
+    pthread_cond_init(&m_cond, NULL);
+    m_maxJobs = 0;
+    m_stop = false;
+#endif
+}
+
+TskRecover::~TskRecover()
+{
+    free(m_buf);
+#ifdef HAVE_PTHREAD
+    pthread_cond_destroy(&m_cond);
+    pthread_mutex_destroy(&m_lock);
+#endif
 }
 
 // Print errors as they are encountered
@@ -85,6 +174,51 @@ uint8_t TskRecover::handleError()
     return 0;
 } 
 
+
+/* An output file and the buffer that its content is collected in, so
+ * that the block-sized pieces from tsk_fs_file_walk() are written with
+ * a few large writes. */
+typedef struct {
+#ifdef TSK_WIN32
+    HANDLE handle;
+#else
+    int fd;
+#endif
+    char *buf;
+    size_t len;
+    uint64_t written;
+} RECOVER_OUT;
+
+/**
+ * Write the collected content to the file.
+ * @returns 1 on error.
+ */
+static uint8_t
+recover_flush(RECOVER_OUT * a_out)
+{
+    size_t off = 0;
+    while (off < a_out->len) {
+#ifdef TSK_WIN32
+        DWORD written = 0;
+        if (!WriteFile(a_out->handle, &a_out->buf[off],
+                (DWORD) (a_out->len - off), &written, NULL))
+            return 1;
+#else
+        ssize_t written = write(a_out->fd, &a_out->buf[off],
+            a_out->len - off);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return 1;
+        }
+#endif
+        off += written;
+    }
+    a_out->written += a_out->len;
+    a_out->len = 0;
+    return 0;
+}
+
 /** \internal
  * Callback used to walk file content and write the results to the recovery file.
  */
@@ -93,29 +227,100 @@ file_walk_cb(TSK_FS_FILE * a_fs_file, TSK_OFF_T a_off,
     TSK_DADDR_T a_addr, char *a_buf, size_t a_len,
     TSK_FS_BLOCK_FLAG_ENUM a_flags, void *a_ptr)
 {
-    //write to the file
+    RECOVER_OUT *out = (RECOVER_OUT *) a_ptr;
+
+    while (a_len > 0) {
+        size_t len = RECOVER_BUF_SIZE - out->len;
+        if (len > a_len)
+            len = a_len;
+        memcpy(&out->buf[out->len], a_buf, len);
+        out->len += len;
+        a_buf += len;
+        a_len -= len;
+
+        //write to the file once the buffer is full
+        if ((out->len == RECOVER_BUF_SIZE) && (recover_flush(out))) {
+            fprintf(stderr, "Error writing file content\n");
+            return TSK_WALK_ERROR;
+        }
+    }
+    return TSK_WALK_CONT;
+}
+
+/**
+ * Write the content of a file to a recovery file.  This is called from
+ * the -j workers, so it only uses the file and the buffer it is given.
+ * @param a_buf Buffer of RECOVER_BUF_SIZE bytes
+ * @param a_written Set to the number of bytes written
+ * @returns 1 on error.
+ */
+static uint8_t
+recover_content(TSK_FS_FILE * a_fs_file, const RECOVER_PATH & a_outPath,
+    char *a_buf, uint64_t * a_written)
+{
+    RECOVER_OUT out;
+    out.buf = a_buf;
+    out.len = 0;
+    out.written = 0;
+    *a_written = 0;
+
 #ifdef TSK_WIN32
-    DWORD written = 0;
-    if (!WriteFile((HANDLE) a_ptr, a_buf, (DWORD)a_len, &written, NULL)) {
-        fprintf(stderr, "Error writing file content\n");
-        return TSK_WALK_ERROR;
+    //create the file
+    out.handle =
+        CreateFileW((LPCTSTR) a_outPath.c_str(), GENERIC_WRITE, 0, NULL,
+        OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (out.handle == INVALID_HANDLE_VALUE) {
+        fprintf(stderr, "Error Creating File (%S)", a_outPath.c_str());
+        return 1;
     }
 
+    //try to write to the file
+    if ((tsk_fs_file_walk(a_fs_file, (TSK_FS_FILE_WALK_FLAG_ENUM) 0,
+                file_walk_cb, &out)) || (recover_flush(&out))) {
+        fprintf(stderr, "Error writing file %S\n", a_outPath.c_str());
+        tsk_error_print(stderr);
+        CloseHandle(out.handle);
+        return 1;
+    }
+
+    CloseHandle(out.handle);
 #else
-    FILE *hFile = (FILE *) a_ptr;
-    if (fwrite(a_buf, a_len, 1, hFile) != 1) {
-        fprintf(stderr, "Error writing file content\n");
-        return TSK_WALK_ERROR;
+    // open the file
+    if ((out.fd = open(a_outPath.c_str(), O_RDWR | O_CREAT | O_TRUNC,
+                0666)) < 0) {
+        fprintf(stderr, "Error opening file for writing (%s)\n",
+            a_outPath.c_str());
+        return 1;
+    }
+
+    if ((tsk_fs_file_walk(a_fs_file, (TSK_FS_FILE_WALK_FLAG_ENUM) 0,
+                file_walk_cb, &out)) || (recover_flush(&out))) {
+        fprintf(stderr, "Error writing file: %s\n", a_outPath.c_str());
+        tsk_error_print(stderr);
+        close(out.fd);
+        return 1;
+    }
+
+    if (close(out.fd)) {
+        fprintf(stderr, "Error writing file: %s\n", a_outPath.c_str());
+        return 1;
     }
 #endif
-    return TSK_WALK_CONT;
+
+    *a_written = out.written;
+    return 0;
 }
 
 
 /**
+ * Make the name of the recovery file for a file and create the
+ * directories that it goes in.  Directories that were made before are
+ * remembered, so each is only checked once.
+ * @param a_outPath Set to the name of the recovery file
  * @returns 1 on error.
  */
-uint8_t TskRecover::writeFile(TSK_FS_FILE * a_fs_file, const char *a_path)
+uint8_t TskRecover::makeOutPath(TSK_FS_FILE * a_fs_file, const char *a_path,
+    RECOVER_PATH & a_outPath)
 {
     
 #ifdef TSK_WIN32
@@ -157,31 +362,37 @@ uint8_t TskRecover::writeFile(TSK_FS_FILE * a_fs_file, const char *a_path)
     wcsncat(path16full, L"\\", FILENAME_MAX-wcslen(path16full));
     wcsncat(path16full, path16, FILENAME_MAX-wcslen(path16full));
 
-    //build up directory structure
     size_t
         len = wcslen((const wchar_t *) path16full);
     for (size_t i = 0; i < len; i++) {
         if (path16full[i] == L'/')
             path16full[i] = L'\\';
-        if (((i > 0) && (path16full[i] == L'\\') && (path16full[i - 1] != L'\\'))
-            || ((path16full[i] != L'\\') && (i == len - 1))) {
-            uint8_t
-                replaced = 0;
-            if (path16full[i] == L'\\') {
-                path16full[i] = L'\0';
-                replaced = 1;
-            }
-            BOOL
-                result = CreateDirectoryW((LPCTSTR) path16full, NULL);
-            if (result == FALSE) {
-                if (GetLastError() == ERROR_PATH_NOT_FOUND) {
-                    fprintf(stderr, "Error Creating Directory (%S)", path16full);
-                    return 1;
+    }
+
+    //build up directory structure
+    if (m_dirs.find(path16full) == m_dirs.end()) {
+        for (size_t i = 0; i < len; i++) {
+            if (((i > 0) && (path16full[i] == L'\\') && (path16full[i - 1] != L'\\'))
+                || ((path16full[i] != L'\\') && (i == len - 1))) {
+                uint8_t
+                    replaced = 0;
+                if (path16full[i] == L'\\') {
+                    path16full[i] = L'\0';
+                    replaced = 1;
                 }
+                BOOL
+                    result = CreateDirectoryW((LPCTSTR) path16full, NULL);
+                if (result == FALSE) {
+                    if (GetLastError() == ERROR_PATH_NOT_FOUND) {
+                        fprintf(stderr, "Error Creating Directory (%S)", path16full);
+                        return 1;
+                    }
+                }
+                if (replaced)
+                    path16full[i] = L'\\';
             }
-            if (replaced)
-                path16full[i] = L'\\';
         }
+        m_dirs.insert(path16full);
     }
 
     //fix the end of the path so that the file name can be appended
@@ -214,35 +425,13 @@ uint8_t TskRecover::writeFile(TSK_FS_FILE * a_fs_file, const char *a_path)
 
     //append the file name onto the path
     wcsncat(path16full, name16, FILENAME_MAX-wcslen(path16full));
-
-    //create the file
-    HANDLE
-        handle =
-        CreateFileW((LPCTSTR) path16full, GENERIC_WRITE, 0, NULL, OPEN_ALWAYS,
-        FILE_ATTRIBUTE_NORMAL, NULL);
-    if (handle == INVALID_HANDLE_VALUE) {
-        fprintf(stderr, "Error Creating File (%S)", path16full);
-        return 1;
-    }
-
-    //try to write to the file
-    if (tsk_fs_file_walk(a_fs_file, (TSK_FS_FILE_WALK_FLAG_ENUM) 0,
-            file_walk_cb, handle)) {
-        fprintf(stderr, "Error writing file %S\n", path16full);
-        tsk_error_print(stderr);
-        CloseHandle(handle);
-        return 1;
-    }
-
-    CloseHandle(handle);
+    a_outPath = path16full;
 
 #else
     struct stat
      statds;
     char
      fbuf[PATH_MAX];
-    FILE *
-        hFile;
 
     snprintf(fbuf, PATH_MAX, "%s/%s/%s", (char *) m_base_dir, m_vsName,
         a_path);
@@ -254,7 +443,7 @@ uint8_t TskRecover::writeFile(TSK_FS_FILE * a_fs_file, const char *a_path)
     }
     
     // see if the directory already exists. Create, if not.
-    if (0 != lstat(fbuf, &statds)) {
+    if ((m_dirs.find(fbuf) == m_dirs.end()) && (0 != lstat(fbuf, &statds))) {
         size_t
             len = strlen(fbuf);
         for (size_t i = 0; i < len; i++) {
@@ -280,6 +469,7 @@ uint8_t TskRecover::writeFile(TSK_FS_FILE * a_fs_file, const char *a_path)
             }
         }
     }
+    m_dirs.insert(fbuf);
 
     if (fbuf[strlen(fbuf) - 1] != '/')
         strncat(fbuf, "/", PATH_MAX - strlen(fbuf));
@@ -291,27 +481,90 @@ uint8_t TskRecover::writeFile(TSK_FS_FILE * a_fs_file, const char *a_path)
         if (TSK_IS_CNTRL(fbuf[i]))
             fbuf[i] = '^';
     }
+    a_outPath = fbuf;
 
+#endif
 
-    // open the file
-    if ((hFile = fopen(fbuf, "w+")) == NULL) {
-        fprintf(stderr, "Error opening file for writing (%s)\n", fbuf);
+    return 0;
+}
+
+
+/**
+ * Count a recovered file and print the progress if it is time to.
+ */
+void TskRecover::fileDone(uint64_t a_bytes)
+{
+#ifdef HAVE_PTHREAD
+    pthread_mutex_lock(&m_lock);
+#endif
+    m_fileCount++;
+    m_byteCount += a_bytes;
+#ifdef HAVE_PTHREAD
+    pthread_mutex_unlock(&m_lock);
+#endif
+}
+
+/**
+ * Print the number of files and bytes recovered and the rate to stderr.
+ * @param a_final True for the summary at the end, which is always printed
+ */
+void TskRecover::printProgress(bool a_final)
+{
+    if (m_progress == false)
+        return;
+
+    time_t now = time(NULL);
+    if ((a_final == false) && (now - m_lastProgress < RECOVER_PROGRESS_SECS))
+        return;
+    m_lastProgress = now;
+
+#ifdef HAVE_PTHREAD
+    pthread_mutex_lock(&m_lock);
+#endif
+    int files = m_fileCount;
+    uint64_t bytes = m_byteCount;
+#ifdef HAVE_PTHREAD
+    pthread_mutex_unlock(&m_lock);
+#endif
+
+    double secs = (double) (now - m_startTime);
+    double mb = (double) bytes / (1024 * 1024);
+    if (secs > 0)
+        tsk_fprintf(stderr,
+            "%s: %d files, %.1f MB in %.0f seconds (%.1f MB/s)\n",
+            a_final ? "Recovered" : "Progress", files, mb, secs,
+            mb / secs);
+    else
+        tsk_fprintf(stderr, "%s: %d files, %.1f MB\n",
+            a_final ? "Recovered" : "Progress", files, mb);
+}
+
+
+/**
+ * @returns 1 on error.
+ */
+uint8_t TskRecover::writeFile(TSK_FS_FILE * a_fs_file, const char *a_path)
+{
+    RECOVER_PATH outPath;
+    if (makeOutPath(a_fs_file, a_path, outPath))
         return 1;
-    }
 
-    if (tsk_fs_file_walk(a_fs_file, (TSK_FS_FILE_WALK_FLAG_ENUM) 0,
-            file_walk_cb, hFile)) {
-        fprintf(stderr, "Error writing file: %s\n", fbuf);
+#ifdef HAVE_PTHREAD
+    if (m_workers.empty() == false)
+        return addJob(a_fs_file, a_path, outPath);
+#endif
+
+    if ((m_buf == NULL)
+        && ((m_buf = (char *) tsk_malloc(RECOVER_BUF_SIZE)) == NULL)) {
         tsk_error_print(stderr);
-        fclose(hFile);
         return 1;
     }
 
-    fclose(hFile);
-
-#endif
+    uint64_t written;
+    if (recover_content(a_fs_file, outPath, m_buf, &written))
+        return 1;
 
-    m_fileCount++;
+    fileDone(written);
     if (tsk_verbose)
         tsk_fprintf(stderr, "Recovered file %s%s (%" PRIuINUM ")\n",
             a_path, a_fs_file->name->name, a_fs_file->name->meta_addr);
@@ -320,6 +573,138 @@ uint8_t TskRecover::writeFile(TSK_FS_FILE * a_fs_file, const char *a_path)
 }
 
 
+#ifdef HAVE_PTHREAD
+/**
+ * Start the -j workers.  If none can be started then the files are
+ * written by the walk.
+ * @returns 1 on error.
+ */
+uint8_t TskRecover::startWorkers()
+{
+    m_stop = false;
+    m_maxJobs = 16 * m_threads;
+    for (int i = 0; i < m_threads; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, workerMain, this))
+            break;
+        m_workers.push_back(thread);
+    }
+    return m_workers.empty() ? 1 : 0;
+}
+
+/**
+ * Queue a file for the workers.  The walk reuses its TSK_FS_FILE, so the
+ * job gets its own with a copy of the name.  A file with the same
+ * recovery file as a queued one waits for it, so that the last one wins
+ * as it does without -j.
+ * @returns 1 on error.
+ */
+uint8_t TskRecover::addJob(TSK_FS_FILE * a_fs_file, const char *a_path,
+    const RECOVER_PATH & a_outPath)
+{
+    TSK_FS_NAME *name = a_fs_file->name;
+    TSK_FS_FILE *fs_file = tsk_fs_file_alloc(a_fs_file->fs_info);
+    if (fs_file == NULL) {
+        tsk_error_print(stderr);
+        return 1;
+    }
+    fs_file->name = tsk_fs_name_alloc(name->name ? strlen(name->name) + 1 : 0,
+        name->shrt_name ? strlen(name->shrt_name) + 1 : 0);
+    if ((fs_file->name == NULL) || (tsk_fs_name_copy(fs_file->name, name))) {
+        tsk_error_print(stderr);
+        tsk_fs_file_close(fs_file);
+        return 1;
+    }
+
+    RECOVER_JOB *job = new RECOVER_JOB;
+    job->fs_file = fs_file;
+    job->path = a_path;
+    job->outPath = a_outPath;
+
+    pthread_mutex_lock(&m_lock);
+    while ((m_jobs.size() >= m_maxJobs)
+        || (m_busy.find(a_outPath) != m_busy.end()))
+        pthread_cond_wait(&m_cond, &m_lock);
+    m_jobs.push_back(job);
+    m_busy.insert(a_outPath);
+    pthread_cond_broadcast(&m_cond);
+    pthread_mutex_unlock(&m_lock);
+    return 0;
+}
+
+/**
+ * Wait for the queued files to be written and stop the workers.  This
+ * must be done before the file system is closed.
+ */
+void TskRecover::stopWorkers()
+{
+    pthread_mutex_lock(&m_lock);
+    m_stop = true;
+    pthread_cond_broadcast(&m_cond);
+    pthread_mutex_unlock(&m_lock);
+    for (size_t i = 0; i < m_workers.size(); i++)
+        pthread_join(m_workers[i], NULL);
+    m_workers.clear();
+}
+
+void *TskRecover::workerMain(void *a_ptr)
+{
+    TskRecover *recover = (TskRecover *) a_ptr;
+    char *buf = (char *) tsk_malloc(RECOVER_BUF_SIZE);
+    if (buf == NULL) {
+        tsk_error_print(stderr);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&recover->m_lock);
+    while (1) {
+        while ((recover->m_stop == false) && (recover->m_jobs.empty()))
+            pthread_cond_wait(&recover->m_cond, &recover->m_lock);
+        if (recover->m_jobs.empty())
+            break;              // stopped with nothing left
+        RECOVER_JOB *job = recover->m_jobs.front();
+        recover->m_jobs.pop_front();
+        pthread_cond_broadcast(&recover->m_cond);
+        pthread_mutex_unlock(&recover->m_lock);
+
+        /* Load the metadata the same way that tsk_fs_dir_walk() does.
+         * The name has to be set first since NTFS uses its sequence number. */
+        TSK_FS_FILE *fs_file = job->fs_file;
+        TSK_FS_INFO *fs_info = fs_file->fs_info;
+        uint64_t written = 0;
+        uint8_t ret = 1;
+        if (fs_info->file_add_meta(fs_info, fs_file,
+                fs_file->name->meta_addr)) {
+            tsk_error_print(stderr);
+            tsk_error_reset();
+        }
+        else {
+            ret = recover_content(fs_file, job->outPath, buf, &written);
+        }
+
+        if ((ret == 0) && (tsk_verbose))
+            tsk_fprintf(stderr, "Recovered file %s%s (%" PRIuINUM ")\n",
+                job->path.c_str(), fs_file->name->name,
+                fs_file->name->meta_addr);
+
+        tsk_fs_file_close(fs_file);
+
+        pthread_mutex_lock(&recover->m_lock);
+        if (ret == 0) {
+            recover->m_fileCount++;
+            recover->m_byteCount += written;
+        }
+        recover->m_busy.erase(job->outPath);
+        pthread_cond_broadcast(&recover->m_cond);
+        delete job;
+    }
+    pthread_mutex_unlock(&recover->m_lock);
+    free(buf);
+    return NULL;
+}
+#endif
+
+
 TSK_RETVAL_ENUM TskRecover::processFile(TSK_FS_FILE * fs_file, const char *path)
 {
     // skip a bunch of the files that we don't want to write
@@ -333,6 +718,7 @@ TSK_RETVAL_ENUM TskRecover::processFile(TSK_FS_FILE * fs_file, const char *path)
         return TSK_OK;
 
     writeFile(fs_file, path);
+    printProgress(false);
     return TSK_OK;
 }
 
@@ -362,12 +748,37 @@ uint8_t
 TskRecover::findFiles(TSK_OFF_T a_soffset, TSK_FS_TYPE_ENUM a_ftype, TSK_INUM_T a_dirInum)
 {
     uint8_t retval;
+    m_startTime = m_lastProgress = time(NULL);
+
+#ifdef HAVE_PTHREAD
+    if ((m_threads > 0) && (startWorkers() == 0)) {
+        /* Open the file system here so that it stays open until the
+         * workers are done with its files. */
+        TSK_OFF_T start = a_soffset * m_img_info->sector_size;
+        TSK_FS_INFO *fs_info = tsk_fs_open_img(m_img_info, start, a_ftype);
+        if (fs_info == NULL) {
+            tsk_error_set_errstr2("Sector offset: %" PRIuOFF, start / 512);
+            registerError();
+            retval = 1;
+        }
+        else if (a_dirInum)
+            retval = findFilesInFs(fs_info, a_dirInum);
+        else
+            retval = findFilesInFs(fs_info);
+
+        stopWorkers();
+        if (fs_info)
+            tsk_fs_close(fs_info);
+    }
+    else
+#endif
     if (a_dirInum)
         retval = findFilesInFs(a_soffset * m_img_info->sector_size, a_ftype, a_dirInum);
     else
         retval = findFilesInFs(a_soffset * m_img_info->sector_size, a_ftype);
 
     printf("Files Recovered: %d\n", m_fileCount);
+    printProgress(true);
     return retval;
 }
 
@@ -383,6 +794,8 @@ main(int argc, char **argv1)
     TSK_TCHAR *cp;
     TSK_FS_DIR_WALK_FLAG_ENUM walkflag = TSK_FS_DIR_WALK_FLAG_UNALLOC;
     TSK_INUM_T dirInum = 0;
+    int threads = 0;
+    bool progress = false;
 
 #ifdef TSK_WIN32
     // On Windows, get the wide arguments (mingw doesn't support wmain)
@@ -398,7 +811,7 @@ main(int argc, char **argv1)
     progname = argv[0];
     setlocale(LC_ALL, "");
 
-    while ((ch = GETOPT(argc, argv, _TSK_T("ab:d:ef:i:o:vV"))) > 0) {
+    while ((ch = GETOPT(argc, argv, _TSK_T("ab:d:ef:i:j:o:pvV"))) > 0) {
         switch (ch) {
         case _TSK_T('?'):
         default:
@@ -463,6 +876,17 @@ main(int argc, char **argv1)
             }
             break;
                 
+        case _TSK_T('j'):
+            threads = (int) TSTRTOUL(OPTARG, &cp, 0);
+            if (*cp || *cp == *OPTARG || threads < 1) {
+                TFPRINTF(stderr,
+                    _TSK_T
+                    ("invalid argument: threads must be positive: %s\n"),
+                    OPTARG);
+                usage();
+            }
+            break;
+
         case _TSK_T('o'):
             if ((soffset = tsk_parse_offset(OPTARG)) == -1) {
                 tsk_error_print(stderr);
@@ -470,6 +894,10 @@ main(int argc, char **argv1)
             }
             break;
 
+        case _TSK_T('p'):
+            progress = true;
+            break;
+
         case _TSK_T('v'):
             tsk_verbose++;
             break;
@@ -490,6 +918,8 @@ main(int argc, char **argv1)
     TskRecover tskRecover(argv[argc-1]);
 
     tskRecover.setFileFilterFlags(walkflag);    
+    tskRecover.setThreads(threads);
+    tskRecover.setProgress(progress);
     if (tskRecover.openImage(argc - OPTIND - 1, &argv[OPTIND], imgtype,
             ssize)) {
         tsk_error_print(stderr);
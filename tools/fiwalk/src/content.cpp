@@ -34,6 +34,7 @@
 #define O_BINARY 0
 #endif
 
+#include <algorithm>
 #include <iostream>
 
 #include "fiwalk.h"
@@ -89,7 +90,11 @@ void content::set_filename(const string &filename)
 {
     this->evidence_filename = filename;
     this->do_plugin = plugin_match(this->evidence_filename);
+#ifdef HAVE_LIBMAGIC
+    if(do_plugin) open_tempfile();	// libmagic reads magic_buf instead
+#else
     if(do_plugin || opt_magic) open_tempfile();
+#endif
     if(opt_save)               open_savefile();
 }
 
@@ -185,7 +190,8 @@ void content::open_savefile()
 
 
 /**
- * run the file command.
+ * With libmagic, identify the start of the file that was kept in magic_buf.
+ * Otherwise run the file command on the temp file:
  * -b = do not put the filename in the output.
  * -z = attempt to decompress compressed files.
  */
@@ -202,12 +208,12 @@ string content::filemagic()
     if(magic_init==false){
 	magic_init=true;
 	mt = magic_open(MAGIC_NONE);
-	if(magic_load(mt,NULL)==-1){
+	if(mt==0 || magic_load(mt,NULL)==-1){
 	    magic_bad = true;
 	    return string("");
 	}
     }
-    const char *ret_ = magic_file(mt,tempfile_path.c_str());
+    const char *ret_ = magic_buffer(mt,magic_buf.data(),magic_buf.size());
     string ret(ret_ ? ret_ : "");
 #elif _MSC_VER
 	char cmd[1024];
@@ -359,6 +365,16 @@ void content::add_bytes(const u_char *buf,uint64_t file_offset,ssize_t size)
 	    }
 	}
     }
+#ifdef HAVE_LIBMAGIC
+    if(opt_magic && file_offset<MAGIC_BUF_SIZE){
+	/* Keep the start of the file for filemagic(); a gap is read as zeros
+	 * just as it would be from the temp file. */
+	if(file_offset>magic_buf.size()) magic_buf.resize(file_offset,'\0');
+	size_t len = (size_t)std::min((uint64_t)size,(uint64_t)(MAGIC_BUF_SIZE-file_offset));
+	magic_buf.replace(file_offset,std::min((size_t)(magic_buf.size()-file_offset),len),
+			  (const char *)buf,len);
+    }
+#endif
     if(fd_temp){
 	if(lseek(fd_temp,file_offset,SEEK_SET)<0){
 	    warn("lseek(fd_temp) failed:");
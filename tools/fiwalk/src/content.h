@@ -22,6 +22,11 @@ class seg {
 };
 
 typedef std::vector<class seg> seglist;	// vector of blocks
+
+/* With libmagic the file type comes from this many bytes at the start of
+ * the file, which is as much as magic_file() reads by default. */
+#define MAGIC_BUF_SIZE (256*1024)
+
 class content {
 private:
     std::string   evidence_filename;         // filename of what's currently being saved (from evidence file system)
@@ -45,6 +50,7 @@ class content {
     int      fd_temp;			// temp copy for plugin and "file" command
     std::string   tempdir;			// directory where temporary files are put
     std::string   tempfile_path;		// where the tempfile was put
+    std::string   magic_buf;		// first MAGIC_BUF_SIZE bytes, for libmagic
 
     md5_generator	h_md5;
     sha1_generator	h_sha1;
@@ -62,6 +68,7 @@ class content {
 	fd_temp(0),
 	tempdir("/tmp"),
         tempfile_path(""),
+        magic_buf(),
         h_md5(),
         h_sha1(),
         h_sectorhash(0),
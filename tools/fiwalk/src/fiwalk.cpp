@@ -79,6 +79,7 @@ bool opt_body_file = false;
 bool opt_ignore_ntfs_system_files = false;
 bool opt_parent_tracking = false;
 bool opt_sector_hash = false;
+int  opt_jobs = 1;			// threads that read file content
 
 const char *config_file = 0;
 int  file_count_max = 0;
@@ -147,6 +148,9 @@ void usage()
     printf("    -Gnn - Only process the contents of files smaller than nn gigabytes (default %d)\n",
 	   opt_maxgig);
     printf("           (Specify -G0 to remove space restrictions)\n");
+#ifdef HAVE_PTHREAD
+    printf("    -j nn = read the content of files with nn threads (output is unchanged)\n");
+#endif
 
     printf("\n");
     printf("Ways to make this program run slower:\n");
@@ -497,7 +501,7 @@ int main(int argc, char * const *argv1)
 	argv = (TSK_TCHAR * const*) argv1;
 #endif
 	
-    while ((ch = GETOPT(argc, argv, _TSK_T("A:a:C:dfG:gmv1IMX:S:T:VZn:c:b:xOzh?"))) > 0 ) { // s: removed
+    while ((ch = GETOPT(argc, argv, _TSK_T("A:a:C:dfG:gj:mv1IMX:S:T:VZn:c:b:xOzh?"))) > 0 ) { // s: removed
 	switch (ch) {
 	case _TSK_T('1'): opt_sha1 = true;break;
 	case _TSK_T('m'):
@@ -521,6 +525,10 @@ int main(int argc, char * const *argv1)
   case _TSK_T('b'): opt_get_fragments = false; break;
 	case _TSK_T('G'): opt_maxgig = TATOI(OPTARG);break;
 	case _TSK_T('h'): usage(); break;
+	case _TSK_T('j'):
+	    opt_jobs = TATOI(OPTARG);
+	    if(opt_jobs < 1) usage();
+	    break;
 	case _TSK_T('I'): opt_ignore_ntfs_system_files=true;break;
 	case _TSK_T('M'): opt_md5 = true;
 	case _TSK_T('O'): opt_allocated_only=true; break;
@@ -733,6 +741,7 @@ int main(int argc, char * const *argv1)
 	count = process_image_file(argc,argv,audit_file,512);
     }
 #endif
+    plugin_close();			// stop any worker plugins
 
     /* Calculate time elapsed (reported as a comment and with rusage) */
     struct timeval tv;
@@ -118,6 +118,7 @@ extern bool	opt_allocated_only;
 extern bool	opt_body_file;
 extern bool	opt_ignore_ntfs_system_files;
 extern bool     opt_sector_hash;
+extern int	opt_jobs;
 extern int	current_partition_num;
 extern int64_t	current_partition_start;
 extern const char *config_file;
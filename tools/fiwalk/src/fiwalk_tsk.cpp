@@ -25,6 +25,11 @@
 #include "unicode_escape.h"
 #include "tsk/fs/tsk_fatfs.h"
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#include <deque>
+#endif
+
 #define MAX_SPARSE_SIZE 1024*1024*64
 
 #ifdef _MSC_VER
@@ -70,19 +75,17 @@ file_act(TSK_FS_FILE * fs_file, TSK_OFF_T a_off, TSK_DADDR_T addr, char *buf,
     return ci->file_act(fs_file,a_off,addr,buf,size,flags);
 }
 
-/* This is modeled on print_dent_act printit in ./tsk/fs/fls_lib.c
- * See also tsk_fs_name_print() in ./tsk/fs/fs_name.c
+/* Read the content of a file: the hashes, the byte runs and the copies
+ * for plugins and libmagic.  Nothing is written to the output here, so
+ * this can run on a -j worker while earlier files are still being written.
+ * @return the content, or 0 if the file is not to be processed
  */
-
-static uint8_t
-process_tsk_file(TSK_FS_FILE * fs_file, const char *path)
+static content *
+read_tsk_file(TSK_FS_FILE * fs_file, const char *path)
 {
-    /* Use a flag to determine if a file is generically fit for plugins. */
-    bool can_run_plugin;
-
     /* Make sure that the SleuthKit structures are properly set */
     if (fs_file->name == NULL) 
-        return 1;
+        return 0;
     if (fs_file->meta == NULL && opt_debug)
         printf("File: %s %s  has no meta\n", path, fs_file->name->name);
 
@@ -93,39 +96,23 @@ process_tsk_file(TSK_FS_FILE * fs_file, const char *path)
 			  tsk_fs_name_type_str[fs_file->name->type],fs_file->name->type);
 
     /* Recover the filename from the fs_dent, if it is provided */
-    content ci(fs_file->fs_info->img_info);	// where the content will go
-    ci.evidence_dirname = path;
-    ci.set_filename(fs_file->name->name);
+    content *ci = new content(fs_file->fs_info->img_info);	// where the content will go
+    ci->evidence_dirname = path;
+    ci->set_filename(fs_file->name->name);
 
     /* If we are filtering and we have a filename, see if we want this file. */
-    if (ci.name_filtered()) return 0;
-
-    /* Looks like we are processing */
-    if(a) a->new_row();			// tell ARFF we are starting a new row
-    if(x) x->push("fileobject"); 	// tell XML we are starting a new XML object
-    if(opt_parent_tracking)
-    {
-        if(fs_file->name->par_addr){
-            if(x)
-            {
-                x->push("parent_object");
-                file_info("inode", fs_file->name->par_addr);
-                if(x) x->pop();
-            }
-            if((t||a) && !opt_body_file)
-            {
-                file_info("parent_inode", fs_file->name->par_addr);
-            }
-        }
+    if (ci->name_filtered()){
+	delete ci;
+	return 0;
     }
 
     if(fs_file->meta != NULL)
     {
         /* Get the content if needed */
-        if(ci.need_file_walk() && (opt_maxgig==0 || fs_file->meta->size/1000000000 < opt_maxgig)){
+        if(ci->need_file_walk() && (opt_maxgig==0 || fs_file->meta->size/1000000000 < opt_maxgig)){
     	int myflags = TSK_FS_FILE_WALK_FLAG_NOID;
     	if (opt_no_data) myflags |= TSK_FS_FILE_WALK_FLAG_AONLY;
-    	if (tsk_fs_file_walk (fs_file, (TSK_FS_FILE_WALK_FLAG_ENUM) myflags, file_act, (void *) &ci)) {
+    	if (tsk_fs_file_walk (fs_file, (TSK_FS_FILE_WALK_FLAG_ENUM) myflags, file_act, (void *) ci)) {
     
     	    // ignore errors from deleted files that were being recovered
     	    //if (tsk_errno != TSK_ERR_FS_RECOVER) {
@@ -140,6 +127,39 @@ process_tsk_file(TSK_FS_FILE * fs_file, const char *path)
     	}
         }
     }
+    return ci;
+}
+
+/* This is modeled on print_dent_act printit in ./tsk/fs/fls_lib.c
+ * See also tsk_fs_name_print() in ./tsk/fs/fs_name.c
+ *
+ * Writes the record of a file whose content was read by read_tsk_file().
+ */
+
+static uint8_t
+write_tsk_file(TSK_FS_FILE * fs_file, content &ci)
+{
+    /* Use a flag to determine if a file is generically fit for plugins. */
+    bool can_run_plugin;
+
+    /* Looks like we are processing */
+    if(a) a->new_row();			// tell ARFF we are starting a new row
+    if(x) x->push("fileobject"); 	// tell XML we are starting a new XML object
+    if(opt_parent_tracking)
+    {
+        if(fs_file->name->par_addr){
+            if(x)
+            {
+                x->push("parent_object");
+                file_info("inode", fs_file->name->par_addr);
+                if(x) x->pop();
+            }
+            if((t||a) && !opt_body_file)
+            {
+                file_info("parent_inode", fs_file->name->par_addr);
+            }
+        }
+    }
 
     if(file_count_max && file_count>file_count_max) return TSK_WALK_STOP;
     file_count++;
@@ -276,7 +296,7 @@ process_tsk_file(TSK_FS_FILE * fs_file, const char *path)
         }
     }
 
-    if(can_run_plugin && ci.do_plugin && ci.total_bytes>0) plugin_process(ci.tempfile_path);
+    if(can_run_plugin && ci.do_plugin && ci.total_bytes>0) plugin_process(fs_file->name->name,ci.tempfile_path);
 
     /* END of file processing */
     if(x) x->pop();
@@ -284,6 +304,186 @@ process_tsk_file(TSK_FS_FILE * fs_file, const char *path)
     return TSK_WALK_CONT;
 }
 
+static uint8_t
+process_tsk_file(TSK_FS_FILE * fs_file, const char *path)
+{
+    content *ci = read_tsk_file(fs_file, path);
+    if (ci == 0)
+        return 0;
+    uint8_t ret = write_tsk_file(fs_file, *ci);
+    delete ci;
+    return ret;
+}
+
+#ifdef HAVE_PTHREAD
+/****************************************************************
+ ** -j: reading file content with a pool of threads.
+ ****************************************************************/
+
+/* With -j, the directory walk hands each file to a pool of worker
+ * threads, which load its metadata and read its content.  The walk
+ * thread writes the records of the finished files in the order that the
+ * walk found them, so the output is the same as without -j.
+ */
+class file_job {
+public:
+    std::string path;
+    TSK_FS_FILE *fs_file;	// has a copy of the name; the worker loads the meta
+    content *ci;		// set by the worker (0 if not processed)
+    bool done;
+    file_job(const char *path_,TSK_FS_FILE *fs_file_):
+	path(path_),fs_file(fs_file_),ci(0),done(false){}
+};
+
+class file_pool {
+public:
+    pthread_mutex_t M;		// protects everything below
+    pthread_cond_t cond;	// signaled when there is a new job, a job is done or stop is set
+    std::deque<file_job *> jobs;	// jobs not yet written, in walk order
+    size_t next_job;		// index in jobs of the next one for a worker
+    size_t max_jobs;		// most jobs to have queued before the walk waits
+    bool stop;
+    std::vector<pthread_t> threads;
+    file_pool():M(),cond(),jobs(),next_job(0),max_jobs(0),stop(false),threads(){}
+};
+
+static file_pool *pool = 0;
+
+/* Load the metadata of a file the same way that tsk_fs_dir_walk() does.
+ * The name has to be set first since NTFS uses its sequence number.
+ */
+static void
+load_file_meta(TSK_FS_FILE *fs_file)
+{
+    TSK_FS_INFO *fs_info = fs_file->fs_info;
+    if ((fs_file->name->meta_addr)
+	|| (fs_file->name->flags & TSK_FS_NAME_FLAG_ALLOC)) {
+	if (fs_info->file_add_meta(fs_info, fs_file, fs_file->name->meta_addr)) {
+	    if (tsk_verbose)
+		tsk_error_print(stderr);
+	    tsk_error_reset();
+	}
+    }
+}
+
+static void *
+pool_worker(void *arg)
+{
+    file_pool *p = (file_pool *)arg;
+
+    pthread_mutex_lock(&p->M);
+    while(1){
+	while(!p->stop && p->next_job >= p->jobs.size())
+	    pthread_cond_wait(&p->cond,&p->M);
+	if(p->next_job >= p->jobs.size()) break;	// stopped with nothing left
+	file_job *job = p->jobs[p->next_job++];
+	pthread_mutex_unlock(&p->M);
+
+	load_file_meta(job->fs_file);
+	job->ci = read_tsk_file(job->fs_file,job->path.c_str());
+
+	pthread_mutex_lock(&p->M);
+	job->done = true;
+	pthread_cond_broadcast(&p->cond);
+    }
+    pthread_mutex_unlock(&p->M);
+    return 0;
+}
+
+/* Write the records of the finished jobs at the front of the queue.
+ * @param max_left - wait for unfinished jobs until at most this many are queued
+ */
+static void
+pool_write(file_pool *p,size_t max_left)
+{
+    pthread_mutex_lock(&p->M);
+    while(!p->jobs.empty()){
+	file_job *job = p->jobs.front();
+	if(!job->done){
+	    if(p->jobs.size() <= max_left) break;
+	    pthread_cond_wait(&p->cond,&p->M);
+	    continue;
+	}
+	p->jobs.pop_front();
+	p->next_job--;
+	pthread_mutex_unlock(&p->M);
+
+	if(job->ci){
+	    write_tsk_file(job->fs_file,*job->ci);
+	    delete job->ci;
+	}
+	tsk_fs_file_close(job->fs_file);
+	delete job;
+
+	pthread_mutex_lock(&p->M);
+    }
+    pthread_mutex_unlock(&p->M);
+}
+
+/* Queue a file for the workers.  The walk reuses its TSK_FS_FILE, so the
+ * job gets its own with a copy of the name.
+ * @return 1 if the file could not be queued
+ */
+static uint8_t
+pool_add(file_pool *p,TSK_FS_FILE *a_fs_file,const char *path)
+{
+    TSK_FS_NAME *name = a_fs_file->name;
+    TSK_FS_FILE *fs_file = tsk_fs_file_alloc(a_fs_file->fs_info);
+    if (fs_file == NULL) return 1;
+    fs_file->name = tsk_fs_name_alloc(name->name ? strlen(name->name) + 1 : 0,
+				      name->shrt_name ? strlen(name->shrt_name) + 1 : 0);
+    if (fs_file->name == NULL || tsk_fs_name_copy(fs_file->name, name)) {
+	tsk_fs_file_close(fs_file);
+	return 1;
+    }
+
+    pthread_mutex_lock(&p->M);
+    p->jobs.push_back(new file_job(path,fs_file));
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->M);
+
+    pool_write(p,p->max_jobs-1);
+    return 0;
+}
+
+static file_pool *
+pool_start(int num_threads)
+{
+    file_pool *p = new file_pool();
+    pthread_mutex_init(&p->M,NULL);
+    pthread_cond_init(&p->cond,NULL);
+    p->max_jobs = 16 * num_threads;
+    for(int i=0;i<num_threads;i++){
+	pthread_t th;
+	if(pthread_create(&th,NULL,pool_worker,p)==0) p->threads.push_back(th);
+    }
+    if(p->threads.empty()){
+	pthread_cond_destroy(&p->cond);
+	pthread_mutex_destroy(&p->M);
+	delete p;
+	return 0;
+    }
+    return p;
+}
+
+/* Write all of the queued files and stop the workers. */
+static void
+pool_finish(file_pool *p)
+{
+    pool_write(p,0);
+    pthread_mutex_lock(&p->M);
+    p->stop = true;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->M);
+    for(size_t i=0;i<p->threads.size();i++){
+	pthread_join(p->threads[i],NULL);
+    }
+    pthread_cond_destroy(&p->cond);
+    pthread_mutex_destroy(&p->M);
+    delete p;
+}
+#endif
+
 
 /**
  * The callback for each file in the file system.
@@ -299,6 +499,16 @@ dir_act(TSK_FS_FILE * fs_file, const char *path, void * /*ptr*/)
         && (fs_file->name->name[0] == '$'))
         return TSK_WALK_CONT;
 
+#ifdef HAVE_PTHREAD
+    if (pool) {
+	if (pool_add(pool, fs_file, path) == 0)
+	    return TSK_WALK_CONT;
+	/* could not copy it, so write the earlier files and do this one here */
+	tsk_error_reset();
+	pool_write(pool, 0);
+    }
+#endif
+
     /* If the name has corresponding metadata, then walk it */
    	process_tsk_file(fs_file, path);
 
@@ -369,8 +579,18 @@ int proc_fs(TSK_IMG_INFO * img_info, TSK_OFF_T start)
     }
 
     int ret = 0;
-    if (tsk_fs_dir_walk(fs_info, fs_info->root_inum,
-			(TSK_FS_DIR_WALK_FLAG_ENUM) dir_walk_flags, dir_act, NULL)) {
+#ifdef HAVE_PTHREAD
+    if (opt_jobs > 1) pool = pool_start(opt_jobs);
+#endif
+    int walk_ret = tsk_fs_dir_walk(fs_info, fs_info->root_inum,
+			(TSK_FS_DIR_WALK_FLAG_ENUM) dir_walk_flags, dir_act, NULL);
+#ifdef HAVE_PTHREAD
+    if (pool) {
+	pool_finish(pool);
+	pool = 0;
+    }
+#endif
+    if (walk_ret) {
 	comment("TSK Error: tsk_fs_dir_walk: ",tsk_error_get());
 	ret = -1;
     }
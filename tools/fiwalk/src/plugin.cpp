@@ -1,7 +1,7 @@
 /**
  * Implements the fiwalk plugin API
  * the fiwalk plugin configuration file is a text file that contains multiple lines of:
- * <glob> (dgi|jvm) command
+ * <glob> (dgi|worker|jvm) command
  *
  * <glob>   specifies which matching files should be called for the plugin; use * to call for
  *          for all files.
@@ -10,6 +10,10 @@
  *          with the filename on the command line to analyze, and the found terms are sent
  *	    to stdout as a series of name: value pairs.
  *
+ * worker   means the plug-in is started once and left running; fiwalk writes the
+ *          name of each file to analyze to its stdin as a line, and the plug-in
+ *          answers with name: value lines on stdout followed by an empty line.
+ *
  * command  the command to run.
  *
  * Future additions:
@@ -36,6 +40,9 @@
 #define pclose	_pclose
 #else
 #include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
 #endif
 
 #include <algorithm>
@@ -137,14 +144,26 @@ class plugins {
     string pattern;		// what we want
     string method;
     string path;
+#ifndef TSK_WIN32
+    pid_t worker_pid;		// the running "worker" plugin, or 0
+    FILE *worker_in;		// its stdin
+    FILE *worker_out;		// its stdout
+#endif
     plugins():glob(0){
+#ifndef TSK_WIN32
+	worker_pid = 0;
+	worker_in = worker_out = 0;
+#endif
     }
     plugins(string pattern,string method,string path){
 	this->pattern = pattern;
 	this->glob = new myglob(pattern.c_str());
 	this->method = method;
 	this->path = path;
-	
+#ifndef TSK_WIN32
+	worker_pid = 0;
+	worker_in = worker_out = 0;
+#endif
     }
     ~plugins() {
 	if(glob){
@@ -165,36 +184,146 @@ static bool all_whitespace(const char *buf)
     return true;
 }
 
-/** Return TRUE if the FNAME requires plugin processing */
-const plugins *current_plugin = 0;
-bool plugin_match(const std::string &fname)
+/* Return the first plugin whose pattern matches FNAME, or 0 if none do.
+ * This does not change any state, so it can be called by the -j workers.
+ */
+static plugins *plugin_find(const std::string &fname)
 {
     for(vector<class plugins *>::const_iterator i = plugin_list.begin();
 	i != plugin_list.end();
 	i++){
 	if( (*i)->glob->match(fname)){
-	    current_plugin = (*i);
-	    return true;
+	    return (*i);
 	}
     }
-    return false;
+    return 0;
+}
+
+/** Return TRUE if the FNAME requires plugin processing */
+bool plugin_match(const std::string &fname)
+{
+    return plugin_find(fname)!=0;
+}
+
+/* Report a name: value line from a plugin with file_info().
+ * Returns false if the line is not in that form. */
+static bool plugin_line(char *linebuf)
+{
+    static bool first = true;
+    static regex_t ncv;
+    if(first){
+	if(regcomp(&ncv,"([-a-zA-Z0-9_]+): +(.*)",REG_EXTENDED)) err(1,"regcomp");
+	first = 0;
+    }
+
+    char *cc = strchr(linebuf,'\n');
+    if(cc){		// we found an end-of-line
+	*cc = '\000';
+    }
+
+    /* process name: value pairs */
+    regmatch_t pmatch[4];
+    memset(pmatch,0,sizeof(pmatch));
+    if(regexec(&ncv,linebuf,4,pmatch,0)){
+	return false;
+    }
+    linebuf[pmatch[1].rm_eo] = 0;
+    linebuf[pmatch[2].rm_eo] = 0;
+    char *name = linebuf+pmatch[1].rm_so;
+    char *value = linebuf+pmatch[2].rm_so;
+
+    /* clean any characters in the name */
+    for(char *cc=name;*cc;cc++){
+	if (!isalpha(*cc)) *cc='_';
+    }
+    file_info(name,value);	// report each identified name & value
+    return true;
+}
+
+#ifndef TSK_WIN32
+/* Start a "worker" plugin with pipes to its stdin and stdout. */
+static void worker_start(plugins *p)
+{
+    int to_child[2];
+    int from_child[2];
+    if(pipe(to_child) || pipe(from_child)) err(1,"pipe");
+
+    /* Keep our ends out of later workers, so each sees end of file at close */
+    fcntl(to_child[1],F_SETFD,FD_CLOEXEC);
+    fcntl(from_child[0],F_SETFD,FD_CLOEXEC);
+
+    /* A worker that exits should be reported, not kill fiwalk */
+    signal(SIGPIPE,SIG_IGN);
+
+    pid_t pid = fork();
+    if(pid<0) err(1,"fork");
+    if(pid==0){
+	dup2(to_child[0],0);
+	dup2(from_child[1],1);
+	close(to_child[0]); close(to_child[1]);
+	close(from_child[0]); close(from_child[1]);
+	execl("/bin/sh","sh","-c",p->path.c_str(),(char *)0);
+	_exit(127);
+    }
+    close(to_child[0]);
+    close(from_child[1]);
+    p->worker_pid = pid;
+    p->worker_in  = fdopen(to_child[1],"w");
+    p->worker_out = fdopen(from_child[0],"r");
+    if(p->worker_in==0 || p->worker_out==0) err(1,"fdopen");
+    comment("started worker plugin %s (pid %d)",p->path.c_str(),(int)pid);
 }
 
+/* Send FNAME to a worker plugin and report what it returns. */
+static void worker_process(plugins *p,const std::string &fname)
+{
+    if(p->worker_pid==0) worker_start(p);
+
+    if(fprintf(p->worker_in,"%s\n",fname.c_str())<0 || fflush(p->worker_in)){
+	err(1,"worker plugin %s: write",p->path.c_str());
+    }
+
+    char *linebuf=0;
+    size_t linecapp=0;
+    while(true){
+	if(getline(&linebuf,&linecapp,p->worker_out)<=0){
+	    errx(1,"worker plugin %s exited while processing %s",
+		 p->path.c_str(),fname.c_str());
+	}
+	if(linebuf[0]=='\n' || linebuf[0]=='\000') break; // end of this file
+	if(!plugin_line(linebuf)){
+	    fprintf(stderr,"*** FILE: %s   line: %u\n",__FILE__,__LINE__);
+	    fprintf(stderr,"*** worker plugin %s returned: '%s'\n", p->path.c_str(),linebuf);
+	    fprintf(stderr,"*** %s will not be deleted.\n",fname.c_str());
+	    exit(1);
+	}
+    }
+    free(linebuf);
+}
+#endif
+
 /** Called by fiwalk main for each extracted file.
  * the file is created in the /tmp directory.
  * The plugin outputs a set of name: value pairs on standard output.
  * This code finds each of those name: value pairs and calls file_info(name,value)
  * for each. Names and values are passed to file_info as strings.
+ *
+ * @param name - the name of the file in the evidence, which picks the plugin
+ * @param fname - the temporary copy of the file
  */
-void plugin_process(const std::string &fname)
+void plugin_process(const std::string &name,const std::string &fname)
 {
     comment("plugin_process",fname.c_str());
-    static bool first = true;
-    static regex_t ncv;
-    if(first){
-	if(regcomp(&ncv,"([-a-zA-Z0-9_]+): +(.*)",REG_EXTENDED)) err(1,"regcomp");
-	first = 0;
+
+    plugins *current_plugin = plugin_find(name);
+    if(current_plugin==0) return;
+
+#ifndef TSK_WIN32
+    if(current_plugin->method=="worker"){
+	worker_process(current_plugin,fname);
+	return;
     }
+#endif
 
     if(current_plugin->method=="dgi"){
 	string cmd = current_plugin->path + " " + fname;
@@ -203,31 +332,13 @@ void plugin_process(const std::string &fname)
         char *linebuf=0;
         size_t linecapp=0;
         if(getline(&linebuf,&linecapp,f)>0){
-	    char *cc = strchr(linebuf,'\n');
-	    if(cc){		// we found an end-of-line
-		*cc = '\000';
-	    }
-	    
-	    /* process name: value pairs */
-	    regmatch_t pmatch[4];
-	    memset(pmatch,0,sizeof(pmatch));
-	    if(regexec(&ncv,linebuf,4,pmatch,0)){
+	    if(!plugin_line(linebuf)){
 		fprintf(stderr,"*** FILE: %s   line: %u\n",__FILE__,__LINE__);
 		fprintf(stderr,"*** plugin %s returned: '%s'\n", current_plugin->path.c_str(),linebuf);
 		fprintf(stderr,"*** original command line: %s\n",cmd.c_str());
 		fprintf(stderr,"*** %s will not be deleted.\n",fname.c_str());
 		exit(1);
 	    }
-	    linebuf[pmatch[1].rm_eo] = 0;
-	    linebuf[pmatch[2].rm_eo] = 0;
-	    char *name = linebuf+pmatch[1].rm_so;
-	    char *value = linebuf+pmatch[2].rm_so;
-
-	    /* clean any characters in the name */
-	    for(char *cc=name;*cc;cc++){
-                if (!isalpha(*cc)) *cc='_';
-	    }
-	    file_info(name,value);	// report each identified name & value
             free(linebuf);
 	}
 	pclose(f);
@@ -236,6 +347,25 @@ void plugin_process(const std::string &fname)
 }
 
 
+/** Stop the worker plugins; they see end of file on stdin. */
+void plugin_close()
+{
+#ifndef TSK_WIN32
+    for(vector<class plugins *>::const_iterator i = plugin_list.begin();
+	i != plugin_list.end();
+	i++){
+	plugins *p = *i;
+	if(p->worker_pid==0) continue;
+	fclose(p->worker_in);
+	fclose(p->worker_out);
+	int status = 0;
+	waitpid(p->worker_pid,&status,0);
+	p->worker_pid = 0;
+	p->worker_in = p->worker_out = 0;
+    }
+#endif
+}
+
 void config_read(const char *fname)
 {
     /* make sure the glob function works */
@@ -280,6 +410,12 @@ void config_read(const char *fname)
 
 	class plugins *plug = new plugins(linebuf+pmatch[1].rm_so, linebuf+pmatch[2].rm_so, linebuf+pmatch[3].rm_so);
 	plug->glob = new myglob(plug->pattern.c_str());
+#ifdef TSK_WIN32
+	if(plug->method=="worker"){
+	    fprintf(stderr,"Error in configuration file line %d: worker plugins are not supported on Windows\n",linenumber);
+	    exit(1);
+	}
+#endif
 	comment("pattern: %s  method: %s  path: %s",plug->pattern.c_str(),plug->method.c_str(),plug->path.c_str());
 	plugin_list.push_back(plug);
     }
@@ -3,7 +3,8 @@
 
 void config_read(const char *fname);
 bool plugin_match(const std::string &fname);
-void plugin_process(const std::string &fname);
+void plugin_process(const std::string &name,const std::string &fname);
+void plugin_close();
 
 
 #endif
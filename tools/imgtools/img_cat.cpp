@@ -21,12 +21,14 @@ usage()
 {
     TFPRINTF(stderr,
         _TSK_T
-        ("usage: %s [-vV] [-i imgtype] [-b dev_sector_size] [-s start_sector] [-e stop_sector] image\n"),
+        ("usage: %s [-vV] [-i imgtype] [-b dev_sector_size] [-R raid] [-s start_sector] [-e stop_sector] image [images]\n"),
         progname);
     tsk_fprintf(stderr,
         "\t-i imgtype: The format of the image file (use 'i list' for supported types)\n");
     tsk_fprintf(stderr,
         "\t-b dev_sector_size: The size (in bytes) of the device sectors\n");
+    tsk_fprintf(stderr,
+        "\t-R raid: The images are the members of a RAID set (level,stripe_size[,la|ls|ra|rs][,data_offset])\n");
     tsk_fprintf(stderr,
         "\t-s start_sector: The sector number to start at\n");
     tsk_fprintf(stderr,
@@ -50,6 +52,7 @@ main(int argc, char **argv1)
     TSK_TCHAR **argv;
     unsigned int ssize = 0;
     TSK_TCHAR *cp;
+    TSK_TCHAR *raid_spec = NULL;
 
 #ifdef TSK_WIN32
     // On Windows, get the wide arguments (mingw doesn't support wmain)
@@ -64,7 +67,7 @@ main(int argc, char **argv1)
 
     progname = argv[0];
 
-    while ((ch = GETOPT(argc, argv, _TSK_T("b:i:vVs:e:"))) > 0) {
+    while ((ch = GETOPT(argc, argv, _TSK_T("b:i:R:vVs:e:"))) > 0) {
         switch (ch) {
         case _TSK_T('?'):
         default:
@@ -94,6 +97,10 @@ main(int argc, char **argv1)
             }
             break;
 
+        case _TSK_T('R'):
+            raid_spec = OPTARG;
+            break;
+
         case _TSK_T('s'):
             start_sector = TSTRTOUL(OPTARG, &cp, 0);
             if (*cp || *cp == *OPTARG || start_sector < 1) {
@@ -133,9 +140,13 @@ main(int argc, char **argv1)
         usage();
     }
 
-    if ((img =
-            tsk_img_open(argc - OPTIND, &argv[OPTIND], imgtype,
-                ssize)) == NULL) {
+    if (raid_spec)
+        img =
+            tsk_img_open_raid_spec(raid_spec, argc - OPTIND,
+            &argv[OPTIND], imgtype, ssize);
+    else
+        img = tsk_img_open(argc - OPTIND, &argv[OPTIND], imgtype, ssize);
+    if (img == NULL) {
         tsk_error_print(stderr);
         exit(1);
     }
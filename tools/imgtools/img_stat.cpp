@@ -17,13 +17,17 @@ usage()
 {
     TFPRINTF(stderr,
         _TSK_T
-        ("usage: %s [-tvV] [-i imgtype] [-b dev_sector_size] image\n"),
+        ("usage: %s [-stvV] [-i imgtype] [-b dev_sector_size] [-R raid] image [images]\n"),
         progname);
     tsk_fprintf(stderr, "\t-t: display type only\n");
+    tsk_fprintf(stderr,
+        "\t-s: read the whole image and display read statistics\n");
     tsk_fprintf(stderr,
         "\t-i imgtype: The format of the image file (use '-i list' for list of supported types)\n");
     tsk_fprintf(stderr,
         "\t-b dev_sector_size: The size (in bytes) of the device sectors\n");
+    tsk_fprintf(stderr,
+        "\t-R raid: The images are the members of a RAID set (level,stripe_size[,la|ls|ra|rs][,data_offset])\n");
     tsk_fprintf(stderr, "\t-v: verbose output to stderr\n");
     tsk_fprintf(stderr, "\t-V: Print version\n");
 
@@ -38,9 +42,11 @@ main(int argc, char **argv1)
     TSK_IMG_TYPE_ENUM imgtype = TSK_IMG_TYPE_DETECT;
     int ch;
     uint8_t type = 0;
+    uint8_t read_stats = 0;
     TSK_TCHAR **argv;
     unsigned int ssize = 0;
     TSK_TCHAR *cp;
+    TSK_TCHAR *raid_spec = NULL;
 
 #ifdef TSK_WIN32
     // On Windows, get the wide arguments (mingw doesn't support wmain)
@@ -55,7 +61,7 @@ main(int argc, char **argv1)
 
     progname = argv[0];
 
-    while ((ch = GETOPT(argc, argv, _TSK_T("b:i:tvV"))) > 0) {
+    while ((ch = GETOPT(argc, argv, _TSK_T("b:i:R:stvV"))) > 0) {
         switch (ch) {
         case _TSK_T('?'):
         default:
@@ -85,6 +91,14 @@ main(int argc, char **argv1)
             }
             break;
 
+        case _TSK_T('R'):
+            raid_spec = OPTARG;
+            break;
+
+        case _TSK_T('s'):
+            read_stats = 1;
+            break;
+
         case _TSK_T('t'):
             type = 1;
             break;
@@ -105,9 +119,13 @@ main(int argc, char **argv1)
         usage();
     }
 
-    if ((img =
-            tsk_img_open(argc - OPTIND, &argv[OPTIND], imgtype,
-                ssize)) == NULL) {
+    if (raid_spec)
+        img =
+            tsk_img_open_raid_spec(raid_spec, argc - OPTIND,
+            &argv[OPTIND], imgtype, ssize);
+    else
+        img = tsk_img_open(argc - OPTIND, &argv[OPTIND], imgtype, ssize);
+    if (img == NULL) {
         tsk_error_print(stderr);
         exit(1);
     }
@@ -120,6 +138,23 @@ main(int argc, char **argv1)
         img->imgstat(img, stdout);
     }
 
+    if (read_stats) {
+        char buf[4096];
+        TSK_OFF_T off;
+
+        // read in blocks the size that file systems usually use so
+        // that the cache is used like it would be
+        tsk_img_reset_stats(img);
+        for (off = 0; off < img->size; off += sizeof(buf)) {
+            if (tsk_img_read(img, off, buf, sizeof(buf)) < 0) {
+                tsk_error_print(stderr);
+                tsk_error_reset();
+            }
+        }
+        tsk_printf("\n");
+        tsk_img_stats_print(img, stdout);
+    }
+
     tsk_img_close(img);
     exit(0);
 }
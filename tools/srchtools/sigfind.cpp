@@ -25,18 +25,300 @@ usage()
     fprintf(stderr,
             "%s [-b bsize] [-o offset] [-t template] [-lV] [hex_signature] file\n",
             progname);
+    fprintf(stderr,
+            "%s [-b bsize] [-f sigfile] [-t template]... [-lV] file\n",
+            progname);
     fprintf(stderr, "\t-b bsize: Give block size (default 512)\n");
     fprintf(stderr,
             "\t-o offset: Give offset into block where signature should exist (default 0)\n");
     fprintf(stderr, "\t-l: Signature will be little endian in image\n");
     fprintf(stderr, "\t-V: Version\n");
     fprintf(stderr,
-            "\t-t template: The name of a data structure template:\n");
+            "\t-t template: The name of a data structure template (can be given more than once):\n");
     fprintf(stderr,
             "\t\tdospart, ext2, ext3, ext4, fat, hfs, hfs+, ntfs, ufs1, ufs2\n");
+    fprintf(stderr,
+            "\t-f sigfile: File with one \"hex_signature offset [name]\" per line\n");
     exit(1);
 }
 
+/* Data structure templates.  The signatures are in the order that they
+ * are stored in the image. */
+typedef struct {
+    const char *name;
+    uint8_t sig[4];
+    int sig_size;
+    int sig_offset;
+} SIGFIND_TEMPLATE;
+
+static const SIGFIND_TEMPLATE templates[] = {
+    {"ext2", {0x53, 0xef, 0x00, 0x00}, 2, 56},
+    {"ext3", {0x53, 0xef, 0x00, 0x00}, 2, 56},
+    {"ext4", {0x53, 0xef, 0x00, 0x00}, 2, 56},
+    {"dospart", {0x55, 0xaa, 0x00, 0x00}, 2, 510},
+    {"fat", {0x55, 0xaa, 0x00, 0x00}, 2, 510},
+    {"ntfs", {0x55, 0xaa, 0x00, 0x00}, 2, 510},
+    /* Located 1372 into SB */
+    {"ufs1", {0x54, 0x19, 0x01, 0x00}, 4, 348},
+    {"ufs2", {0x19, 0x01, 0x54, 0x19}, 4, 348},
+    /* Located 1024 into image */
+    {"hfs+", {0x48, 0x2b, 0x00, 0x04}, 4, 0},
+    {"hfs", {0x42, 0x44, 0x00, 0x00}, 2, 0},
+    {NULL, {0, 0, 0, 0}, 0, 0}
+};
+
+/* Largest signature that can be given in a signature file */
+#define SIGFIND_MAX_SIG 64
+
+/* Number of bytes read at a time when searching for several signatures */
+#define SIGFIND_READ_SIZE (1024 * 1024)
+
+/* A signature that is searched for when more than one is given */
+typedef struct {
+    char name[32];
+    uint8_t sig[SIGFIND_MAX_SIG];
+    int sig_size;
+    int sig_offset;
+    TSK_OFF_T prev_hit;
+} SIGFIND_SIG;
+
+typedef struct {
+    SIGFIND_SIG *sigs;
+    int bs;
+} SIGFIND_DATA;
+
+/*
+ * Convert a hex string to bytes.  Prints an error and returns -1 if the
+ * string is not valid or has more than a_max bytes.
+ */
+static int
+parse_hex_sig(const char *a_str, uint8_t * a_sig, int a_max)
+{
+    int i, sig_size = 0;
+
+    for (i = 0; a_str[i] != '\0'; i++) {
+        uint8_t tmp = a_str[i];
+
+        if (i == 2 * a_max) {
+            fprintf(stderr,
+                    "Error: Maximum supported signature size is %d bytes\n",
+                    a_max);
+            return -1;
+        }
+
+        /* Digit */
+        if ((tmp >= 0x30) && (tmp <= 0x39)) {
+            tmp -= 0x30;
+        }
+        /* lowercase a-f */
+        else if ((tmp >= 0x61) && (tmp <= 0x66)) {
+            tmp -= 0x57;
+        }
+        else if ((tmp >= 0x41) && (tmp <= 0x46)) {
+            tmp -= 0x37;
+        }
+        else {
+            fprintf(stderr, "Invalid signature value: %c\n", tmp);
+            return -1;
+        }
+
+        /* big nibble */
+        if (0 == (i % 2)) {
+            a_sig[sig_size] = 16 * tmp;
+        }
+        else {
+            a_sig[sig_size] += tmp;
+            sig_size++;
+        }
+    }
+
+    if (i % 2) {
+        fprintf(stderr, "Invaild signature - full bytes only\n");
+        return -1;
+    }
+    return sig_size;
+}
+
+/* Switch the byte order of a signature */
+static void
+reverse_sig(uint8_t * a_sig, int a_size)
+{
+    int i;
+    for (i = 0; i < a_size / 2; i++) {
+        uint8_t tmp = a_sig[i];
+        a_sig[i] = a_sig[a_size - 1 - i];
+        a_sig[a_size - 1 - i] = tmp;
+    }
+}
+
+static SIGFIND_SIG *
+add_sig(SIGFIND_SIG ** a_sigs, int *a_num)
+{
+    SIGFIND_SIG *sigs;
+
+    if ((sigs =
+         (SIGFIND_SIG *) tsk_realloc(*a_sigs,
+                                     (*a_num + 1) * sizeof(SIGFIND_SIG))) ==
+        NULL) {
+        tsk_error_print(stderr);
+        exit(1);
+    }
+    *a_sigs = sigs;
+    memset(&sigs[*a_num], 0, sizeof(SIGFIND_SIG));
+    sigs[*a_num].prev_hit = -1;
+    return &sigs[(*a_num)++];
+}
+
+/*
+ * Load the signatures in a file.  Each line has a hex signature, the
+ * offset of the signature in the block and an optional name.  Blank
+ * lines and lines that start with '#' are ignored.
+ */
+static void
+load_sig_file(const char *a_path, uint8_t a_lit_end, SIGFIND_SIG ** a_sigs,
+              int *a_num)
+{
+    FILE *fd;
+    char line[512];
+    int line_num = 0;
+
+    if ((fd = fopen(a_path, "r")) == NULL) {
+        fprintf(stderr, "Error opening signature file: %s\n", a_path);
+        exit(1);
+    }
+
+    while (fgets(line, sizeof(line), fd) != NULL) {
+        char hex[256], off[256], name[256];
+        char *end;
+        int cnt;
+        SIGFIND_SIG *sig;
+
+        line_num++;
+        if ((cnt = sscanf(line, "%255s %255s %255s", hex, off, name)) < 1)
+            continue;
+        if (hex[0] == '#')
+            continue;
+        if (cnt < 2) {
+            fprintf(stderr,
+                    "Error: Missing offset on line %d of signature file\n",
+                    line_num);
+            exit(1);
+        }
+
+        sig = add_sig(a_sigs, a_num);
+        if ((sig->sig_size =
+             parse_hex_sig(hex, sig->sig, SIGFIND_MAX_SIG)) <= 0) {
+            fprintf(stderr, "Error on line %d of signature file\n",
+                    line_num);
+            exit(1);
+        }
+        if (a_lit_end)
+            reverse_sig(sig->sig, sig->sig_size);
+
+        sig->sig_offset = strtol(off, &end, 10);
+        if ((*end != '\0') || (sig->sig_offset < 0)) {
+            fprintf(stderr,
+                    "Error converting offset value on line %d of signature file: %s\n",
+                    line_num, off);
+            exit(1);
+        }
+
+        /* Use the signature as the name if there is none */
+        if (cnt < 3)
+            strcpy(name, hex);
+        name[sizeof(sig->name) - 1] = '\0';
+        strcpy(sig->name, name);
+    }
+    fclose(fd);
+}
+
+static TSK_WALK_RET_ENUM
+sig_hit(int a_id, TSK_OFF_T a_off, void *a_ptr)
+{
+    SIGFIND_DATA *data = (SIGFIND_DATA *) a_ptr;
+    SIGFIND_SIG *sig = &data->sigs[a_id];
+    TSK_OFF_T blk;
+
+    /* Only matches at the signature's offset in a block count */
+    if (a_off % data->bs != sig->sig_offset)
+        return TSK_WALK_CONT;
+
+    blk = a_off / data->bs;
+    if (sig->prev_hit == -1)
+        printf("Block: %" PRIuOFF " (-) %s\n", blk, sig->name);
+    else
+        printf("Block: %" PRIuOFF " (+%" PRIuOFF ") %s\n", blk,
+               (blk - sig->prev_hit), sig->name);
+    sig->prev_hit = blk;
+    return TSK_WALK_CONT;
+}
+
+/*
+ * Search the image for several signatures at once.  The image is read in
+ * large chunks and all of the signatures are matched in a single pass with
+ * tsk_msearch, which is much faster than reading it once per signature.
+ */
+static void
+find_sigs(TSK_IMG_INFO * img_info, SIGFIND_SIG * sigs, int num_sigs, int bs)
+{
+    TSK_MSEARCH *ms;
+    TSK_MSEARCH_STATE state;
+    SIGFIND_DATA data;
+    TSK_OFF_T cur_offset;
+    size_t read_size;
+    uint8_t *buf;
+    int i;
+
+    if ((ms = tsk_msearch_alloc()) == NULL) {
+        tsk_error_print(stderr);
+        exit(1);
+    }
+    for (i = 0; i < num_sigs; i++) {
+        if (tsk_msearch_add(ms, sigs[i].sig, sigs[i].sig_size, 0, i)) {
+            tsk_error_print(stderr);
+            exit(1);
+        }
+    }
+    if (tsk_msearch_compile(ms)) {
+        tsk_error_print(stderr);
+        exit(1);
+    }
+
+    /* Read a whole number of blocks at a time */
+    read_size = (SIGFIND_READ_SIZE / bs) * bs;
+    if (read_size == 0)
+        read_size = bs;
+    if ((buf = (uint8_t *) tsk_malloc(read_size)) == NULL) {
+        tsk_error_print(stderr);
+        exit(1);
+    }
+
+    data.sigs = sigs;
+    data.bs = bs;
+    tsk_msearch_state_init(&state);
+    for (cur_offset = 0; cur_offset < img_info->size;) {
+        ssize_t retval;
+
+        retval = tsk_img_read(img_info, cur_offset, (char *) buf,
+                              read_size);
+        if (retval == 0) {
+            break;
+        }
+        else if (retval == -1) {
+            fprintf(stderr, "error reading bytes %" PRIuOFF "\n",
+                    cur_offset / bs);
+            exit(1);
+        }
+
+        tsk_msearch_scan(ms, &state, cur_offset, buf, retval, sig_hit,
+                         &data);
+        cur_offset += retval;
+    }
+
+    free(buf);
+    tsk_msearch_free(ms);
+}
+
 // @@@ Should have a big endian flag as well
 int
 main(int argc, char **argv)
@@ -54,11 +336,14 @@ main(int argc, char **argv)
     int sig_size = 0;
     uint8_t lit_end = 0;
     int sig_print = 0;
+    SIGFIND_SIG *sigs = NULL;
+    int num_sigs = 0;
+    const char *sig_file = NULL;
 
 
     progname = argv[0];
 
-    while ((ch = getopt(argc, argv, "b:lo:t:V")) > 0) {
+    while ((ch = getopt(argc, argv, "b:f:lo:t:V")) > 0) {
         switch (ch) {
         case 'b':
             bs = strtol(optarg, err, 10);
@@ -73,6 +358,9 @@ main(int argc, char **argv)
                 exit(1);
             }
             break;
+        case 'f':
+            sig_file = optarg;
+            break;
         case 'l':
             lit_end = 1;
             break;
@@ -88,74 +376,27 @@ main(int argc, char **argv)
             }
             break;
 
-        case 't':
-            if ((strcmp(optarg, "ext2") == 0) ||
-                (strcmp(optarg, "ext3") == 0) ||
-                (strcmp(optarg, "ext4") == 0)) {
-                lit_end = 1;
-                sig[0] = 0x53;
-                sig[1] = 0xef;
-                sig_size = 2;
-                sig_offset = 56;
-                bs = 512;
-            }
-            else if ((strcmp(optarg, "dospart") == 0) ||
-                     (strcmp(optarg, "fat") == 0) ||
-                     (strcmp(optarg, "ntfs") == 0)) {
-                lit_end = 1;
-                sig[0] = 0x55;
-                sig[1] = 0xaa;
-                sig_size = 2;
-                sig_offset = 510;
-                bs = 512;
-            }
-            else if (strcmp(optarg, "ufs1") == 0) {
-                lit_end = 1;
-                sig[0] = 0x54;
-                sig[1] = 0x19;
-                sig[2] = 0x01;
-                sig[3] = 0x00;
-                sig_size = 4;
-                /* Located 1372 into SB */
-                sig_offset = 348;
-                bs = 512;
-            }
-            else if (strcmp(optarg, "ufs2") == 0) {
-                lit_end = 1;
-                sig[0] = 0x19;
-                sig[1] = 0x01;
-                sig[2] = 0x54;
-                sig[3] = 0x19;
-                sig_size = 4;
-                /* Located 1372 into SB */
-                sig_offset = 348;
-                bs = 512;
-            }
-            else if (strcmp(optarg, "hfs+") == 0) {
-                lit_end = 1;
-                sig[0] = 0x48;
-                sig[1] = 0x2b;
-                sig[2] = 0x00;
-                sig[3] = 0x04;
-                sig_size = 4;
-                /* Located 1024 into image */
-                sig_offset = 0;
-                bs = 512;
-            }
-            else if (strcmp(optarg, "hfs") == 0) {
-                lit_end = 1;
-                sig[0] = 0x42;
-                sig[1] = 0x44;
-                sig_size = 2;
-                /* Located 1024 into image */
-                sig_offset = 0;
+        case 't':{
+                const SIGFIND_TEMPLATE *tmpl;
+                SIGFIND_SIG *tsig;
+
+                for (tmpl = templates; tmpl->name != NULL; tmpl++) {
+                    if (strcmp(optarg, tmpl->name) == 0)
+                        break;
+                }
+                if (tmpl->name == NULL) {
+                    fprintf(stderr, "Invalid template\n");
+                    exit(1);
+                }
+
+                tsig = add_sig(&sigs, &num_sigs);
+                strncpy(tsig->name, tmpl->name, sizeof(tsig->name) - 1);
+                memcpy(tsig->sig, tmpl->sig, tmpl->sig_size);
+                tsig->sig_size = tmpl->sig_size;
+                tsig->sig_offset = tmpl->sig_offset;
                 bs = 512;
+                break;
             }
-            else {
-                fprintf(stderr, "Invalid template\n");
-                exit(1);
-            }
-            break;
 
         case 'V':
             tsk_version_print(stdout);
@@ -166,84 +407,75 @@ main(int argc, char **argv)
     }
 
 
-    /* If we didn't get a template then check the cmd line */
-    if (sig_size == 0) {
-        if (optind + 1 > argc) {
-            usage();
+    /* Search for several signatures at once */
+    if ((sig_file != NULL) || (num_sigs > 1)) {
+        if (sig_file != NULL)
+            load_sig_file(sig_file, lit_end, &sigs, &num_sigs);
+        if (num_sigs == 0) {
+            fprintf(stderr, "Error: No signatures in signature file\n");
+            exit(1);
         }
-        /* Get the hex value */
-        sig_size = 0;
-        for (i = 0; i < 9; i++) {
-            uint8_t tmp;
-            tmp = argv[optind][i];
-
-            if (tmp == 0) {
-                if (i % 2) {
-                    fprintf(stderr,
-                            "Invaild signature - full bytes only\n");
-                    exit(1);
-                }
-                break;
-            }
 
-            /* Digit */
-            if ((tmp >= 0x30) && (tmp <= 0x39)) {
-                tmp -= 0x30;
-            }
-            /* lowercase a-f */
-            else if ((tmp >= 0x61) && (tmp <= 0x66)) {
-                tmp -= 0x57;
-            }
-            else if ((tmp >= 0x41) && (tmp <= 0x46)) {
-                tmp -= 0x37;
-            }
-            else {
-                fprintf(stderr, "Invalid signature value: %c\n", tmp);
+        for (i = 0; i < num_sigs; i++) {
+            if ((sigs[i].sig_offset + sigs[i].sig_size) > bs) {
+                fprintf(stderr,
+                        "Error: The offset and signature sizes are greater than the block size (%s)\n",
+                        sigs[i].name);
                 exit(1);
             }
+        }
 
-            /* big nibble */
-            if (0 == (i % 2)) {
-                sig[sig_size] = 16 * tmp;
-            }
-            else {
-                sig[sig_size] += tmp;
-                sig_size++;
-            }
+        if (optind + 1 != argc) {
+            usage();
         }
-        optind++;
 
-        /* Check the signature length */
-        if (i == 9) {
-            fprintf(stderr,
-                    "Error: Maximum supported signature size is 4 bytes\n");
+        if ((img_info =
+             tsk_img_open_utf8_sing(argv[optind],
+                          TSK_IMG_TYPE_DETECT, 0)) == NULL) {
+            tsk_error_print(stderr);
             exit(1);
         }
 
+        printf("Block size: %d  Signatures: %d\n", bs, num_sigs);
+        for (i = 0; i < num_sigs; i++) {
+            int j;
+            printf("  %s  Offset: %d  Signature: ", sigs[i].name,
+                   sigs[i].sig_offset);
+            for (j = 0; j < sigs[i].sig_size; j++)
+                printf("%02X", sigs[i].sig[j]);
+            printf("\n");
+        }
+
+        find_sigs(img_info, sigs, num_sigs, bs);
+
+        free(sigs);
+        tsk_img_close(img_info);
+        exit(0);
+    }
+
+    /* A single template */
+    if (num_sigs == 1) {
+        memcpy(sig, sigs[0].sig, sigs[0].sig_size);
+        sig_size = sigs[0].sig_size;
+        sig_offset = sigs[0].sig_offset;
+        free(sigs);
+    }
+
+    /* If we didn't get a template then check the cmd line */
+    if (sig_size == 0) {
+        if (optind + 1 > argc) {
+            usage();
+        }
+        /* Get the hex value */
+        if ((sig_size = parse_hex_sig(argv[optind], sig, 4)) == -1) {
+            exit(1);
+        }
+        optind++;
+
 
         /* Need to switch order */
         if (lit_end) {
-            uint8_t tmp;
-
-            if (sig_size == 2) {
-                tmp = sig[1];
-                sig[1] = sig[0];
-                sig[0] = tmp;
-            }
-            else if (sig_size == 3) {
-                tmp = sig[2];
-                sig[2] = sig[0];
-                sig[0] = tmp;
-            }
-            else if (sig_size == 4) {
-                tmp = sig[3];
-                sig[3] = sig[0];
-                sig[0] = tmp;
-
-                tmp = sig[2];
-                sig[2] = sig[1];
-                sig[1] = tmp;
-            }
+            reverse_sig(sig, sig_size);
         }
     }
 
@@ -45,6 +45,9 @@
  * bigendian 16-bit, littleendian 16-bit, bigendian 32-bit, littleendian
  * 32-bit.
  * 
+ * -p threads	Read the file in large pieces and search them with THREADS
+ * threads.  The strings are still printed in file order.
+ * 
  * -h		Print the usage message on the standard output.
  * 
  * -v		Print the program version number.
@@ -66,6 +69,15 @@
 #include <string.h>
 
 #include <inttypes.h>
+#include <fcntl.h>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 /*
  * Some platforms need to put stdin into binary mode, to read binary files.
@@ -248,7 +260,20 @@ static bfd_boolean print_filenames;
 static char     encoding;
 static int      encoding_bytes;
 
+/* Number of threads to search a file with, or 0 to read it as a stream.  */
+static int      num_threads;
+
+/*
+ * Size of the pieces that a file is split into when it is searched with
+ * threads.  It must be a multiple of all of the character sizes.
+ */
+#define CHUNK_SIZE (4 * 1024 * 1024)
+
+/* Size of the reads past the end of a piece to finish a string.  */
+#define TAIL_SIZE (64 * 1024)
+
 static bfd_boolean strings_file(char *file);
+static bfd_boolean strings_file_chunked(char *file, uint64_t file_size);
 static int      integer_arg(char *s);
 static void     print_strings(const char *, FILE *, uint64_t, uint64_t, int, char *);
 static void     usage(FILE *, int);
@@ -270,7 +295,7 @@ main(int argc, char **argv)
         print_filenames = FALSE;
         encoding = 's';
 
-        while ((optc = getopt(argc, argv, "afhHn:ot:e:Vv0123456789")) != EOF) {
+        while ((optc = getopt(argc, argv, "afhHn:op:t:e:Vv0123456789")) != EOF) {
                 switch (optc) {
                 case 'a':
                         break;
@@ -295,6 +320,14 @@ main(int argc, char **argv)
                         address_radix = 8;
                         break;
 
+                case 'p':
+                        num_threads = integer_arg(optarg);
+                        if (num_threads < 1) {
+                                fprintf(stderr, "invalid number %s\n", optarg);
+                                usage(stderr, 1);
+                        }
+                        break;
+
                 case 't':
                         print_addresses = TRUE;
                         if (optarg[1] != '\0')
@@ -423,9 +456,13 @@ static          bfd_boolean
 strings_file(char *file)
 {
         FILE           *stream;
-        if (get_file_size(file) < 1)
+        off_t           file_size;
+
+        if ((file_size = get_file_size(file)) < 1)
                 return FALSE;
 
+        if (num_threads > 0)
+                return strings_file_chunked(file, (uint64_t) file_size);
 
         stream = file_open(file, "r");
         if (stream == NULL) {
@@ -598,6 +635,523 @@ print_strings(const char *filename, FILE * stream, uint64_t address,
 }
 
 
+/*
+ * Searching a file in pieces.
+ *
+ * The file is split into CHUNK_SIZE pieces that are searched by a pool of
+ * threads.  A string belongs to the piece that it starts in: each piece is
+ * read with the character before it so that a string that started in an
+ * earlier piece can be skipped, and a string that reaches the end of a
+ * piece is finished by reading past it.  The output of each piece is kept
+ * in memory and printed in file order, with at most 2 pieces per thread
+ * waiting to be printed.
+ */
+
+typedef struct {
+        char           *data;
+        size_t          len;
+        size_t          size;
+} out_buf;
+
+typedef struct {
+        const char     *filename;
+        int             fd;
+        uint64_t        file_size;
+        uint64_t        num_chunks;
+        uint64_t        next_chunk;     /* next piece to search */
+        uint64_t        next_print;     /* next piece to print */
+        uint64_t        window;         /* pieces that can be ahead of next_print */
+        out_buf        *results;        /* indexed by piece % window */
+        char           *done;
+        int             error;
+#ifdef HAVE_PTHREAD
+        pthread_mutex_t lock;
+        pthread_cond_t  cond;
+#endif
+} chunk_job;
+
+
+/* Return the character at P in the current encoding (see get_char).  */
+
+static long
+char_value(const unsigned char *p)
+{
+        switch (encoding) {
+        case 'b':
+                return (p[0] << 8) | p[1];
+        case 'l':
+                return p[0] | (p[1] << 8);
+        case 'B':
+                return ((long)p[0] << 24) | ((long)p[1] << 16) |
+                        ((long)p[2] << 8) | p[3];
+        case 'L':
+                return p[0] | ((long)p[1] << 8) | ((long)p[2] << 16) |
+                        ((long)p[3] << 24);
+        default:
+                return p[0];
+        }
+}
+
+
+/*
+ * Set FLAGS[i] to 1 if character i of BUF is graphic and 0 if not.  The
+ * 8-bit and little-endian 16-bit encodings are done 16 bytes at a time
+ * with SSE2 when it is available.
+ */
+
+static void
+classify_chars(const unsigned char *buf, size_t nchars, unsigned char *flags)
+{
+        size_t          i = 0;
+
+#ifdef __SSE2__
+        if (encoding == 's' || encoding == 'S') {
+                const __m128i   low = _mm_set1_epi8(0x1f);
+                const __m128i   high = _mm_set1_epi8(0x7f);
+                const __m128i   tab = _mm_set1_epi8('\t');
+                const __m128i   one = _mm_set1_epi8(1);
+                const __m128i   zero = _mm_setzero_si128();
+
+                for (; i + 16 <= nchars; i += 16) {
+                        __m128i         v = _mm_loadu_si128((const __m128i *)(buf + i));
+                        /* Signed compares, so 0x80 - 0xff are below low */
+                        __m128i         g = _mm_and_si128(_mm_cmpgt_epi8(v, low),
+                                _mm_cmplt_epi8(v, high));
+
+                        g = _mm_or_si128(g, _mm_cmpeq_epi8(v, tab));
+                        if (encoding == 'S')
+                                g = _mm_or_si128(g, _mm_cmplt_epi8(v, zero));
+                        _mm_storeu_si128((__m128i *)(flags + i),
+                                _mm_and_si128(g, one));
+                }
+        }
+        else if (encoding == 'l') {
+                const __m128i   low = _mm_set1_epi16(0x1f);
+                const __m128i   high = _mm_set1_epi16(0x7f);
+                const __m128i   tab = _mm_set1_epi16('\t');
+                const __m128i   one = _mm_set1_epi8(1);
+
+                for (; i + 8 <= nchars; i += 8) {
+                        __m128i         v = _mm_loadu_si128((const __m128i *)(buf + 2 * i));
+                        __m128i         g = _mm_and_si128(_mm_cmpgt_epi16(v, low),
+                                _mm_cmplt_epi16(v, high));
+
+                        g = _mm_or_si128(g, _mm_cmpeq_epi16(v, tab));
+                        /* Narrow the 8 16-bit results to bytes */
+                        g = _mm_packs_epi16(g, g);
+                        _mm_storel_epi64((__m128i *)(flags + i),
+                                _mm_and_si128(g, one));
+                }
+        }
+#endif
+
+        for (; i < nchars; i++) {
+                long            c = char_value(buf + i * encoding_bytes);
+                flags[i] = STRING_ISGRAPHIC(c) ? 1 : 0;
+        }
+}
+
+
+/* Add LEN bytes to OUT.  Return 1 on error.  */
+
+static int
+out_append(out_buf * out, const char *data, size_t len)
+{
+        if (out->len + len > out->size) {
+                size_t          size = out->size ? out->size : 4096;
+                char           *tmp;
+
+                while (size < out->len + len)
+                        size *= 2;
+                if ((tmp = (char *)realloc(out->data, size)) == NULL) {
+                        fprintf(stderr, "Error allocating memory\n");
+                        return 1;
+                }
+                out->data = tmp;
+                out->size = size;
+        }
+        memcpy(out->data + out->len, data, len);
+        out->len += len;
+        return 0;
+}
+
+
+/* Add NCHARS characters from BUF to OUT as print_strings would print them.  */
+
+static int
+out_chars(out_buf * out, const unsigned char *buf, size_t nchars)
+{
+        char            tmp[256];
+        size_t          i, n = 0;
+
+        if (encoding_bytes == 1)
+                return out_append(out, (const char *)buf, nchars);
+
+        for (i = 0; i < nchars; i++) {
+                tmp[n++] = (char)char_value(buf + i * encoding_bytes);
+                if (n == sizeof(tmp)) {
+                        if (out_append(out, tmp, n))
+                                return 1;
+                        n = 0;
+                }
+        }
+        return out_append(out, tmp, n);
+}
+
+
+/* Add the file name and address that go before a string to OUT.  */
+
+static int
+out_prefix(chunk_job * job, out_buf * out, uint64_t start)
+{
+        char            tmp[64];
+        int             n = 0;
+
+        if (print_filenames) {
+                if (out_append(out, job->filename, strlen(job->filename)) ||
+                        out_append(out, ": ", 2))
+                        return 1;
+        }
+        if (print_addresses) {
+                switch (address_radix) {
+                case 8:
+                        n = snprintf(tmp, sizeof(tmp), "%10" PRIo64 " ", start);
+                        break;
+
+                case 10:
+                        n = snprintf(tmp, sizeof(tmp), "%10" PRId64 " ", start);
+                        break;
+
+                case 16:
+                        n = snprintf(tmp, sizeof(tmp), "%10" PRIx64 " ", start);
+                        break;
+                }
+                if (out_append(out, tmp, n))
+                        return 1;
+        }
+        return 0;
+}
+
+
+/* Read LEN bytes at OFF.  Return the number of bytes read or -1 on error.  */
+
+static ssize_t
+read_at(int fd, unsigned char *buf, size_t len, uint64_t off)
+{
+        size_t          total = 0;
+
+        while (total < len) {
+                ssize_t         cnt = pread(fd, buf + total, len - total,
+                        (off_t) (off + total));
+                if (cnt == -1) {
+                        if (errno == EINTR)
+                                continue;
+                        return -1;
+                }
+                if (cnt == 0)
+                        break;
+                total += cnt;
+        }
+        return total;
+}
+
+
+/*
+ * Read past the end of a piece to find the rest of a string that reaches
+ * it.  TAIL gets the bytes of the rest of the string.  Return the number
+ * of characters in TAIL or -1 on error.
+ */
+
+static int64_t
+read_tail(chunk_job * job, uint64_t off, out_buf * tail)
+{
+        unsigned char  *buf, *flags;
+        int64_t         nchars = 0;
+
+        if ((buf = (unsigned char *)malloc(2 * TAIL_SIZE)) == NULL) {
+                fprintf(stderr, "Error allocating memory\n");
+                return -1;
+        }
+        flags = buf + TAIL_SIZE;
+
+        while (off < job->file_size) {
+                ssize_t         cnt;
+                size_t          n, i;
+
+                if ((cnt = read_at(job->fd, buf, TAIL_SIZE, off)) == -1) {
+                        fprintf(stderr, "%s: error reading offset %" PRIu64 ": %s\n",
+                                job->filename, off, strerror(errno));
+                        free(buf);
+                        return -1;
+                }
+                n = cnt / encoding_bytes;
+                if (n == 0)
+                        break;
+
+                classify_chars(buf, n, flags);
+                for (i = 0; i < n && flags[i]; i++);
+
+                if (out_append(tail, (const char *)buf, i * encoding_bytes)) {
+                        free(buf);
+                        return -1;
+                }
+                nchars += i;
+                if (i < n)
+                        break;
+                off += n * encoding_bytes;
+        }
+
+        free(buf);
+        return nchars;
+}
+
+
+/*
+ * Find the strings that start in piece K of the file and add them to OUT.
+ * BUF must hold CHUNK_SIZE + 4 bytes and FLAGS CHUNK_SIZE + 4 characters.
+ * Return 1 on error.
+ */
+
+static int
+search_chunk(chunk_job * job, uint64_t k, out_buf * out,
+        unsigned char *buf, unsigned char *flags)
+{
+        uint64_t        start = k * CHUNK_SIZE;
+        uint64_t        end = start + CHUNK_SIZE;
+        size_t          pre = (k > 0) ? encoding_bytes : 0;
+        size_t          len, nchars, i;
+        unsigned char  *p;
+
+        if (end > job->file_size)
+                end = job->file_size;
+
+        /* Read the piece with the character before it */
+        len = (size_t) (end - start) + pre;
+        if (read_at(job->fd, buf, len, start - pre) != (ssize_t) len) {
+                fprintf(stderr, "%s: error reading offset %" PRIu64 "\n",
+                        job->filename, start);
+                return 1;
+        }
+        nchars = len / encoding_bytes;
+        classify_chars(buf, nchars, flags);
+
+        i = 0;
+        if (pre) {
+                /* Skip a string that started in an earlier piece */
+                p = (unsigned char *)memchr(flags, 0, nchars);
+                i = p ? (size_t) (p - flags) : nchars;
+        }
+
+        while (i < nchars) {
+                size_t          s, e;
+
+                if ((p = (unsigned char *)memchr(flags + i, 1, nchars - i)) == NULL)
+                        break;
+                s = p - flags;
+                p = (unsigned char *)memchr(flags + s, 0, nchars - s);
+                e = p ? (size_t) (p - flags) : nchars;
+
+                if (e == nchars && end < job->file_size) {
+                        /* The string goes into the next piece */
+                        out_buf         tail = {NULL, 0, 0};
+                        int64_t         tail_chars;
+
+                        if ((tail_chars = read_tail(job, end, &tail)) == -1) {
+                                free(tail.data);
+                                return 1;
+                        }
+                        if ((int64_t) (e - s) + tail_chars >= string_min) {
+                                if (out_prefix(job, out, start - pre + s * encoding_bytes) ||
+                                        out_chars(out, buf + s * encoding_bytes, e - s) ||
+                                        out_chars(out, (unsigned char *)tail.data, (size_t) tail_chars) ||
+                                        out_append(out, "\n", 1)) {
+                                        free(tail.data);
+                                        return 1;
+                                }
+                        }
+                        free(tail.data);
+                }
+                else if (e - s >= (size_t) string_min) {
+                        if (out_prefix(job, out, start - pre + s * encoding_bytes) ||
+                                out_chars(out, buf + s * encoding_bytes, e - s) ||
+                                out_append(out, "\n", 1))
+                                return 1;
+                }
+                i = e;
+        }
+        return 0;
+}
+
+
+#ifdef HAVE_PTHREAD
+/* Thread that searches the next piece of the file until there are none.  */
+
+static void    *
+chunk_worker(void *arg)
+{
+        chunk_job      *job = (chunk_job *) arg;
+        unsigned char  *buf = (unsigned char *)malloc(CHUNK_SIZE + 4);
+        unsigned char  *flags = (unsigned char *)malloc(CHUNK_SIZE + 4);
+
+        if (buf == NULL || flags == NULL) {
+                fprintf(stderr, "Error allocating memory\n");
+                pthread_mutex_lock(&job->lock);
+                job->error = 1;
+                pthread_cond_broadcast(&job->cond);
+                pthread_mutex_unlock(&job->lock);
+                free(buf);
+                free(flags);
+                return NULL;
+        }
+
+        while (1) {
+                out_buf         out = {NULL, 0, 0};
+                uint64_t        k;
+                int             err;
+
+                pthread_mutex_lock(&job->lock);
+                while (!job->error && job->next_chunk < job->num_chunks &&
+                        job->next_chunk >= job->next_print + job->window)
+                        pthread_cond_wait(&job->cond, &job->lock);
+                if (job->error || job->next_chunk >= job->num_chunks) {
+                        pthread_mutex_unlock(&job->lock);
+                        break;
+                }
+                k = job->next_chunk++;
+                pthread_mutex_unlock(&job->lock);
+
+                err = search_chunk(job, k, &out, buf, flags);
+
+                pthread_mutex_lock(&job->lock);
+                if (err)
+                        job->error = 1;
+                job->results[k % job->window] = out;
+                job->done[k % job->window] = 1;
+                pthread_cond_broadcast(&job->cond);
+                pthread_mutex_unlock(&job->lock);
+        }
+
+        free(buf);
+        free(flags);
+        return NULL;
+}
+#endif
+
+
+/*
+ * Print the strings in FILE by searching it in pieces with num_threads
+ * threads.  The output is the same as print_strings.  Return TRUE if ok,
+ * FALSE if an error occurs.
+ */
+
+static          bfd_boolean
+strings_file_chunked(char *file, uint64_t file_size)
+{
+        chunk_job       job;
+        uint64_t        k;
+
+        memset(&job, 0, sizeof(job));
+        job.filename = file;
+        job.file_size = file_size;
+        job.num_chunks = (file_size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
+        if ((job.fd = open(file, O_RDONLY)) == -1) {
+                fprintf(stderr, "%s: ", program_name);
+                perror(file);
+                return FALSE;
+        }
+
+#ifdef HAVE_PTHREAD
+        {
+                pthread_t      *threads;
+                int             i, started = 0;
+
+                job.window = 2 * (uint64_t) num_threads;
+                job.results = (out_buf *) calloc(job.window, sizeof(out_buf));
+                job.done = (char *)calloc(job.window, 1);
+                threads = (pthread_t *) calloc(num_threads, sizeof(pthread_t));
+                if (job.results == NULL || job.done == NULL || threads == NULL) {
+                        fprintf(stderr, "Error allocating memory\n");
+                        free(job.results);
+                        free(job.done);
+                        free(threads);
+                        close(job.fd);
+                        return FALSE;
+                }
+                pthread_mutex_init(&job.lock, NULL);
+                pthread_cond_init(&job.cond, NULL);
+
+                for (i = 0; i < num_threads; i++) {
+                        if (pthread_create(&threads[started], NULL, chunk_worker, &job) == 0)
+                                started++;
+                }
+                if (started == 0) {
+                        fprintf(stderr, "Error starting threads\n");
+                        job.error = 1;
+                }
+
+                /* Print the pieces in order as they are done */
+                for (k = 0; k < job.num_chunks; k++) {
+                        out_buf         out;
+
+                        pthread_mutex_lock(&job.lock);
+                        while (!job.error && !job.done[k % job.window])
+                                pthread_cond_wait(&job.cond, &job.lock);
+                        if (job.error) {
+                                pthread_mutex_unlock(&job.lock);
+                                break;
+                        }
+                        out = job.results[k % job.window];
+                        job.done[k % job.window] = 0;
+                        job.next_print++;
+                        pthread_cond_broadcast(&job.cond);
+                        pthread_mutex_unlock(&job.lock);
+
+                        if (out.len)
+                                fwrite(out.data, 1, out.len, stdout);
+                        free(out.data);
+                }
+
+                for (i = 0; i < started; i++)
+                        pthread_join(threads[i], NULL);
+
+                for (k = 0; k < job.window; k++) {
+                        if (job.done[k])
+                                free(job.results[k].data);
+                }
+                pthread_cond_destroy(&job.cond);
+                pthread_mutex_destroy(&job.lock);
+                free(threads);
+                free(job.results);
+                free(job.done);
+        }
+#else
+        {
+                unsigned char  *buf = (unsigned char *)malloc(CHUNK_SIZE + 4);
+                unsigned char  *flags = (unsigned char *)malloc(CHUNK_SIZE + 4);
+
+                if (buf == NULL || flags == NULL) {
+                        fprintf(stderr, "Error allocating memory\n");
+                        job.error = 1;
+                }
+                for (k = 0; !job.error && k < job.num_chunks; k++) {
+                        out_buf         out = {NULL, 0, 0};
+
+                        job.error = search_chunk(&job, k, &out, buf, flags);
+                        if (out.len)
+                                fwrite(out.data, 1, out.len, stdout);
+                        free(out.data);
+                }
+                free(buf);
+                free(flags);
+        }
+#endif
+
+        close(job.fd);
+        return job.error ? FALSE : TRUE;
+}
+
+
 /*
  * Parse string S as an integer, using decimal radix by default, but allowing
  * octal and hex numbers as in C.
@@ -659,6 +1213,7 @@ usage(FILE * stream, int status)
   -<number>                 least [number] characters (default 4).\n\
   -t {o,x,d}        Print the location of the string in base 8, 10 or 16\n\
   -o                        An alias for --radix=o\n\
+  -p number          Search each file in pieces with [number] threads\n\
   -e {s,S,b,l,B,L} Select character size and endianness:\n\
                             s = 7-bit, S = 8-bit, {b,l} = 16-bit, {B,L} = 32-bit\n\
   -h                  Display this information\n\
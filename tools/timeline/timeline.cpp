@@ -0,0 +1,1234 @@
+/*
+ ** The Sleuth Kit
+ **
+ ** Brian Carrier [carrier <at> sleuthkit [dot] org]
+ ** Copyright (c) 2010-2016 Brian Carrier.  All Rights reserved
+ **
+ ** This software is distributed under the Common Public License 1.0
+ **
+ */
+
+/**
+ * \file timeline.cpp
+ * Bounded-memory timeline engine.  See timeline.h.
+ */
+
+#include "timeline.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef TSK_WIN32
+#define TL_FSEEK _fseeki64
+#else
+#define TL_FSEEK fseeko
+#endif
+
+static const char *tl_days[] =
+    { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+static const char *tl_months[] =
+    { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep",
+    "Oct", "Nov", "Dec"
+};
+
+
+/* Events are ordered by time, then by "inode,name" and then by the order
+ * that their files were added, which keeps the sort stable. */
+static bool
+tl_event_less(const TL_EVENT & a, const TL_EVENT & b)
+{
+    if (a.time != b.time)
+        return a.time < b.time;
+    int ret = memcmp(a.key, b.key, TL_KEY_LEN);
+    if (ret)
+        return ret < 0;
+    return a.file < b.file;
+}
+
+
+/* Make a temporary file that is removed when it is closed.
+ * @returns NULL on error */
+static FILE *
+tl_tmpfile(const std::basic_string < TSK_TCHAR > &a_dir)
+{
+    FILE *hFile;
+#ifdef TSK_WIN32
+    wchar_t *path =
+        _wtempnam(a_dir.empty()? NULL : a_dir.c_str(), L"tsk_tl");
+    if (path == NULL) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_AUX_GENERIC);
+        tsk_error_set_errstr("tl_tmpfile: error making a temporary name");
+        return NULL;
+    }
+    // 'D' removes the file when it is closed
+    hFile = _wfopen(path, L"w+bD");
+    free(path);
+#else
+    std::string path = (a_dir.empty()? "/tmp" : a_dir) + "/tsk_timeline.XXXXXX";
+    std::vector < char >buf(path.begin(), path.end());
+    buf.push_back('\0');
+    int fd = mkstemp(&buf[0]);
+    if (fd < 0) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_AUX_GENERIC);
+        tsk_error_set_errstr("tl_tmpfile: %s: %s", &buf[0],
+            strerror(errno));
+        return NULL;
+    }
+    unlink(&buf[0]);
+    hFile = fdopen(fd, "w+b");
+    if (hFile == NULL)
+        close(fd);
+#endif
+    if (hFile == NULL) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_AUX_GENERIC);
+        tsk_error_set_errstr("tl_tmpfile: error opening temporary file: %s",
+            strerror(errno));
+    }
+    return hFile;
+}
+
+
+/**
+ * Merges sorted runs.  Each run is read through its own buffer and a
+ * heap picks the smallest event at the front of the runs.
+ */
+class TlMerger {
+  public:
+    TlMerger(const std::vector < FILE * >&a_runs, size_t a_bufEvents);
+    ~TlMerger();
+    int next(TL_EVENT & a_ev);
+
+  private:
+    typedef struct {
+        FILE *hFile;
+        std::vector < TL_EVENT > buf;
+        size_t pos;
+    } RUN;
+
+    /* std::make_heap() makes a max heap, so this is reversed */
+    class HeapCmp {
+      public:
+        const std::vector < RUN > *runs;
+        bool operator() (size_t a, size_t b) const {
+            const RUN & ra = (*runs)[a];
+            const RUN & rb = (*runs)[b];
+            return tl_event_less(rb.buf[rb.pos], ra.buf[ra.pos]);
+        }
+    };
+
+    int fill(RUN & a_run);
+
+    size_t m_bufEvents;
+    std::vector < RUN > m_runs;
+    std::vector < size_t > m_heap;
+    HeapCmp m_cmp;
+    bool m_started;
+};
+
+TlMerger::TlMerger(const std::vector < FILE * >&a_runs, size_t a_bufEvents)
+{
+    m_bufEvents = a_bufEvents;
+    m_runs.resize(a_runs.size());
+    for (size_t i = 0; i < a_runs.size(); i++) {
+        m_runs[i].hFile = a_runs[i];
+        m_runs[i].pos = 0;
+    }
+    m_cmp.runs = &m_runs;
+    m_started = false;
+}
+
+TlMerger::~TlMerger()
+{
+    for (size_t i = 0; i < m_runs.size(); i++)
+        fclose(m_runs[i].hFile);
+}
+
+/* Read the next part of a run.
+ * @returns 1 if events were read, 0 at the end of the run and -1 on error */
+int
+TlMerger::fill(RUN & a_run)
+{
+    a_run.buf.resize(m_bufEvents);
+    size_t cnt =
+        fread(&a_run.buf[0], sizeof(TL_EVENT), m_bufEvents, a_run.hFile);
+    a_run.buf.resize(cnt);
+    a_run.pos = 0;
+    if (cnt == 0) {
+        if (ferror(a_run.hFile)) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_AUX_GENERIC);
+            tsk_error_set_errstr("TlMerger: error reading run: %s",
+                strerror(errno));
+            return -1;
+        }
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Get the next event in order.
+ * @returns 1 if an event was returned, 0 at the end and -1 on error
+ */
+int
+TlMerger::next(TL_EVENT & a_ev)
+{
+    if (m_started == false) {
+        m_started = true;
+        for (size_t i = 0; i < m_runs.size(); i++) {
+            int ret = fill(m_runs[i]);
+            if (ret < 0)
+                return -1;
+            else if (ret > 0)
+                m_heap.push_back(i);
+        }
+        std::make_heap(m_heap.begin(), m_heap.end(), m_cmp);
+    }
+
+    if (m_heap.empty())
+        return 0;
+
+    std::pop_heap(m_heap.begin(), m_heap.end(), m_cmp);
+    RUN & run = m_runs[m_heap.back()];
+    a_ev = run.buf[run.pos++];
+    if (run.pos == run.buf.size()) {
+        int ret = fill(run);
+        if (ret < 0)
+            return -1;
+        else if (ret == 0) {
+            m_heap.pop_back();
+            return 1;
+        }
+    }
+    std::push_heap(m_heap.begin(), m_heap.end(), m_cmp);
+    return 1;
+}
+
+
+/* Merge a group of runs into one run.  Used by the merge passes. */
+typedef struct {
+    std::vector < FILE * >in;
+    FILE *out;
+    size_t bufEvents;
+    const std::basic_string < TSK_TCHAR > *tmpDir;
+    std::string errStr;         ///< Set on error
+} TL_MERGE_JOB;
+
+static void
+tl_merge_job(TL_MERGE_JOB * a_job)
+{
+    a_job->out = tl_tmpfile(*a_job->tmpDir);
+    if (a_job->out == NULL) {
+        a_job->errStr = tsk_error_get();
+        return;
+    }
+
+    TlMerger merger(a_job->in, a_job->bufEvents);
+    a_job->in.clear();          // the merger closes them
+
+    std::vector < TL_EVENT > buf;
+    buf.reserve(a_job->bufEvents);
+    TL_EVENT ev;
+    int ret;
+    while ((ret = merger.next(ev)) > 0) {
+        buf.push_back(ev);
+        if (buf.size() == a_job->bufEvents) {
+            if (fwrite(&buf[0], sizeof(TL_EVENT), buf.size(),
+                    a_job->out) != buf.size())
+                break;
+            buf.clear();
+        }
+    }
+    if (ret < 0) {
+        a_job->errStr = tsk_error_get();
+        return;
+    }
+    if ((ret > 0) || ((buf.size())
+            && (fwrite(&buf[0], sizeof(TL_EVENT), buf.size(),
+                    a_job->out) != buf.size()))
+        || (fflush(a_job->out))) {
+        a_job->errStr = std::string("tl_merge_job: error writing run: ")
+            + strerror(errno);
+        return;
+    }
+    rewind(a_job->out);
+}
+
+#ifdef HAVE_PTHREAD
+typedef struct {
+    std::vector < TL_MERGE_JOB > *jobs;
+    size_t first;
+    size_t step;
+} TL_MERGE_THREAD;
+
+static void *
+tl_merge_thread(void *a_ptr)
+{
+    TL_MERGE_THREAD *thr = (TL_MERGE_THREAD *) a_ptr;
+    for (size_t i = thr->first; i < thr->jobs->size(); i += thr->step)
+        tl_merge_job(&(*thr->jobs)[i]);
+    return NULL;
+}
+#endif
+
+
+/**
+ * @param a_memBytes Memory to use for the events
+ * @param a_threads Number of threads that sort and merge runs while
+ * events are added.  With 0 the runs are sorted by the caller.
+ * @param a_tmpDir Directory for the runs
+ */
+TlSorter::TlSorter(size_t a_memBytes, int a_threads,
+    const TSK_TCHAR * a_tmpDir)
+{
+#ifdef HAVE_PTHREAD
+    m_threads = (a_threads > 0) ? a_threads : 0;
+    pthread_mutex_init(&m_lock, NULL);
+    pthread_cond_init(&m_cond, NULL);
+    m_stop = false;
+#else
+    m_threads = 0;
+#endif
+    m_memBytes = a_memBytes;
+    // one buffer is filled while the others are sorted
+    m_numBufs = m_threads + 1;
+    m_bufEvents = a_memBytes / (m_numBufs * sizeof(TL_EVENT));
+    if (m_bufEvents < 1024)
+        m_bufEvents = 1024;
+    if (a_tmpDir)
+        m_tmpDir = a_tmpDir;
+    m_count = 0;
+    m_cur = new EVENT_BUF;
+    m_allocBufs = 1;
+    m_submitted = 0;
+    m_numRuns = 0;
+    m_failed = false;
+    m_merger = NULL;
+    m_memPos = 0;
+}
+
+TlSorter::~TlSorter()
+{
+    stopWorkers();
+    if (m_cur)
+        delete m_cur;
+    for (size_t i = 0; i < m_free.size(); i++)
+        delete m_free[i];
+    for (size_t i = 0; i < m_full.size(); i++)
+        delete m_full[i];
+    if (m_merger)
+        delete m_merger;
+    for (size_t i = 0; i < m_runs.size(); i++)
+        fclose(m_runs[i]);
+#ifdef HAVE_PTHREAD
+    pthread_mutex_destroy(&m_lock);
+    pthread_cond_destroy(&m_cond);
+#endif
+}
+
+/* Sort a buffer and write it to a new run.
+ * @returns the run, rewound, or NULL on error */
+FILE *
+TlSorter::writeRun(EVENT_BUF * a_buf)
+{
+    std::sort(a_buf->begin(), a_buf->end(), tl_event_less);
+
+    FILE *hFile = tl_tmpfile(m_tmpDir);
+    if (hFile == NULL)
+        return NULL;
+    if ((fwrite(&(*a_buf)[0], sizeof(TL_EVENT), a_buf->size(),
+                hFile) != a_buf->size()) || (fflush(hFile))) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_AUX_GENERIC);
+        tsk_error_set_errstr("TlSorter::writeRun: error writing run: %s",
+            strerror(errno));
+        fclose(hFile);
+        return NULL;
+    }
+    rewind(hFile);
+    return hFile;
+}
+
+#ifdef HAVE_PTHREAD
+/* Worker thread that sorts and writes the full buffers */
+void *
+TlSorter::workerMain(void *a_ptr)
+{
+    TlSorter *sorter = (TlSorter *) a_ptr;
+
+    pthread_mutex_lock(&sorter->m_lock);
+    while (true) {
+        while ((sorter->m_full.empty()) && (sorter->m_stop == false))
+            pthread_cond_wait(&sorter->m_cond, &sorter->m_lock);
+        if (sorter->m_full.empty())
+            break;
+
+        EVENT_BUF *buf = sorter->m_full.front();
+        sorter->m_full.erase(sorter->m_full.begin());
+        pthread_mutex_unlock(&sorter->m_lock);
+
+        FILE *hFile = sorter->writeRun(buf);
+
+        pthread_mutex_lock(&sorter->m_lock);
+        if (hFile) {
+            sorter->m_runs.push_back(hFile);
+        }
+        else if (sorter->m_failed == false) {
+            sorter->m_failed = true;
+            sorter->m_errStr = tsk_error_get();
+        }
+        buf->clear();
+        sorter->m_free.push_back(buf);
+        pthread_cond_broadcast(&sorter->m_cond);
+    }
+    pthread_mutex_unlock(&sorter->m_lock);
+    return NULL;
+}
+#endif
+
+void
+TlSorter::stopWorkers()
+{
+#ifdef HAVE_PTHREAD
+    if (m_workers.empty())
+        return;
+    pthread_mutex_lock(&m_lock);
+    m_stop = true;
+    pthread_cond_broadcast(&m_cond);
+    pthread_mutex_unlock(&m_lock);
+    for (size_t i = 0; i < m_workers.size(); i++)
+        pthread_join(m_workers[i], NULL);
+    m_workers.clear();
+#endif
+}
+
+/* Hand a full buffer to the workers, or sort and write it here if
+ * there are none.  @returns 1 on error */
+uint8_t
+TlSorter::submit(EVENT_BUF * a_buf)
+{
+    m_submitted++;
+#ifdef HAVE_PTHREAD
+    if (m_threads > 0) {
+        if (m_workers.empty()) {
+            for (int i = 0; i < m_threads; i++) {
+                pthread_t thread;
+                if (pthread_create(&thread, NULL, workerMain, this)) {
+                    tsk_error_reset();
+                    tsk_error_set_errno(TSK_ERR_AUX_GENERIC);
+                    tsk_error_set_errstr
+                        ("TlSorter::submit: error starting thread");
+                    return 1;
+                }
+                m_workers.push_back(thread);
+            }
+        }
+        pthread_mutex_lock(&m_lock);
+        m_full.push_back(a_buf);
+        pthread_cond_broadcast(&m_cond);
+        pthread_mutex_unlock(&m_lock);
+        return 0;
+    }
+#endif
+    FILE *hFile = writeRun(a_buf);
+    if (hFile == NULL)
+        return 1;
+    m_runs.push_back(hFile);
+    a_buf->clear();
+    m_free.push_back(a_buf);
+    return 0;
+}
+
+/* Get an empty buffer to fill after the current one was submitted.
+ * Waits for a worker if all of the buffers are in use.
+ * @returns NULL on error */
+TlSorter::EVENT_BUF * TlSorter::getBuffer()
+{
+#ifdef HAVE_PTHREAD
+    if (m_threads > 0) {
+        EVENT_BUF *buf = NULL;
+        pthread_mutex_lock(&m_lock);
+        while ((m_free.empty()) && (m_allocBufs >= m_numBufs)
+            && (m_failed == false))
+            pthread_cond_wait(&m_cond, &m_lock);
+        if (m_failed) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_AUX_GENERIC);
+            tsk_error_set_errstr("%s", m_errStr.c_str());
+        }
+        else if (m_free.empty() == false) {
+            buf = m_free.back();
+            m_free.pop_back();
+        }
+        else {
+            buf = new EVENT_BUF;
+            m_allocBufs++;
+        }
+        pthread_mutex_unlock(&m_lock);
+        return buf;
+    }
+#endif
+    // submit() wrote the buffer and put it back on the free list
+    EVENT_BUF *buf = m_free.back();
+    m_free.pop_back();
+    return buf;
+}
+
+/**
+ * Add an event to be sorted.
+ * @returns 1 on error
+ */
+uint8_t
+TlSorter::add(const TL_EVENT & a_ev)
+{
+    if (m_cur->size() == m_cur->capacity()) {
+        if (m_cur->size() >= m_bufEvents) {
+            EVENT_BUF *full = m_cur;
+            m_cur = NULL;
+            if (submit(full)) {
+                m_cur = full;
+                return 1;
+            }
+            if ((m_cur = getBuffer()) == NULL)
+                return 1;
+        }
+        else {
+            // grow towards the limit without going past it
+            size_t size = m_cur->size() * 2;
+            if (size < 4096)
+                size = 4096;
+            if (size > m_bufEvents)
+                size = m_bufEvents;
+            m_cur->reserve(size);
+        }
+    }
+    m_cur->push_back(a_ev);
+    m_count++;
+    return 0;
+}
+
+/* Merge the runs in groups of TL_MAX_FANIN, in parallel if there are
+ * threads.  @returns 1 on error */
+uint8_t
+TlSorter::mergePass()
+{
+    size_t numJobs = (m_runs.size() + TL_MAX_FANIN - 1) / TL_MAX_FANIN;
+    size_t numThreads = (m_threads > 1) ? m_threads : 1;
+    if (numThreads > numJobs)
+        numThreads = numJobs;
+
+    size_t bufEvents =
+        m_memBytes / (sizeof(TL_EVENT) * numThreads * (TL_MAX_FANIN + 1));
+    if (bufEvents < 256)
+        bufEvents = 256;
+
+    std::vector < TL_MERGE_JOB > jobs(numJobs);
+    for (size_t i = 0; i < numJobs; i++) {
+        size_t first = i * TL_MAX_FANIN;
+        size_t last = std::min(first + TL_MAX_FANIN, m_runs.size());
+        jobs[i].in.assign(m_runs.begin() + first, m_runs.begin() + last);
+        jobs[i].out = NULL;
+        jobs[i].bufEvents = bufEvents;
+        jobs[i].tmpDir = &m_tmpDir;
+    }
+    m_runs.clear();
+
+#ifdef HAVE_PTHREAD
+    if (numThreads > 1) {
+        std::vector < TL_MERGE_THREAD > thr(numThreads);
+        std::vector < pthread_t > threads;
+        for (size_t i = 0; i < numThreads; i++) {
+            thr[i].jobs = &jobs;
+            thr[i].first = i;
+            thr[i].step = numThreads;
+            pthread_t thread;
+            if (pthread_create(&thread, NULL, tl_merge_thread, &thr[i])) {
+                // let the threads that did start do the rest
+                thr[i].first = numJobs;
+                for (size_t j = i; j < numJobs; j += numThreads)
+                    tl_merge_job(&jobs[j]);
+                continue;
+            }
+            threads.push_back(thread);
+        }
+        for (size_t i = 0; i < threads.size(); i++)
+            pthread_join(threads[i], NULL);
+    }
+    else
+#endif
+    {
+        for (size_t i = 0; i < numJobs; i++)
+            tl_merge_job(&jobs[i]);
+    }
+
+    std::string errStr;
+    for (size_t i = 0; i < numJobs; i++) {
+        for (size_t j = 0; j < jobs[i].in.size(); j++)
+            fclose(jobs[i].in[j]);
+        if (jobs[i].errStr.empty() == false) {
+            if (errStr.empty())
+                errStr = jobs[i].errStr;
+            if (jobs[i].out)
+                fclose(jobs[i].out);
+        }
+        else {
+            m_runs.push_back(jobs[i].out);
+        }
+    }
+    if (errStr.empty() == false) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_AUX_GENERIC);
+        tsk_error_set_errstr("%s", errStr.c_str());
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Call after the last event has been added to finish sorting.
+ * @returns 1 on error
+ */
+uint8_t
+TlSorter::finish()
+{
+    // everything fit in the first buffer, so sort it where it is
+    if (m_submitted == 0) {
+        std::sort(m_cur->begin(), m_cur->end(), tl_event_less);
+        m_memPos = 0;
+        return 0;
+    }
+
+    if ((m_cur) && (m_cur->empty() == false)) {
+        EVENT_BUF *last = m_cur;
+        m_cur = NULL;
+        if (submit(last)) {
+            m_cur = last;
+            return 1;
+        }
+    }
+    stopWorkers();
+
+    if (m_failed) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_AUX_GENERIC);
+        tsk_error_set_errstr("%s", m_errStr.c_str());
+        return 1;
+    }
+
+    // the buffers are not needed for merging
+    if (m_cur) {
+        delete m_cur;
+        m_cur = NULL;
+    }
+    for (size_t i = 0; i < m_free.size(); i++)
+        delete m_free[i];
+    m_free.clear();
+
+    m_numRuns = m_runs.size();
+    while (m_runs.size() > TL_MAX_FANIN) {
+        if (mergePass())
+            return 1;
+    }
+
+    size_t bufEvents = m_memBytes / (sizeof(TL_EVENT) * m_runs.size());
+    if (bufEvents < 256)
+        bufEvents = 256;
+    m_merger = new TlMerger(m_runs, bufEvents);
+    m_runs.clear();             // the merger closes them
+    return 0;
+}
+
+/**
+ * Get the next event in order after finish() has been called.
+ * @returns 1 if an event was returned, 0 at the end and -1 on error
+ */
+int
+TlSorter::next(TL_EVENT & a_ev)
+{
+    if (m_merger)
+        return m_merger->next(a_ev);
+    if ((m_cur == NULL) || (m_memPos >= m_cur->size()))
+        return 0;
+    a_ev = (*m_cur)[m_memPos++];
+    return 1;
+}
+
+
+TskTimeline::TskTimeline()
+{
+    m_start = 0;
+    m_end = 0;
+    m_mem = 256 * 1024 * 1024;
+    m_threads = 1;
+    m_comma = false;
+    m_iso = false;
+    m_monthNum = false;
+    m_index = NULL;
+    m_hourly = false;
+    m_spool = NULL;
+    m_spoolSize = 0;
+    m_spoolRead = (uint64_t) - 1;
+    m_sorter = NULL;
+    memset(&m_prevTm, 0, sizeof(m_prevTm));
+    m_prevTime = 0;
+    m_prevCnt = 0;
+    m_prevSet = false;
+}
+
+TskTimeline::~TskTimeline()
+{
+    if (m_sorter)
+        delete m_sorter;
+    if (m_spool)
+        fclose(m_spool);
+}
+
+/**
+ * Only keep times in a range.  The times are filtered as the files are
+ * added, so times outside of the range are never sorted.
+ * @param a_start First time to keep
+ * @param a_end Time after the last one to keep, or 0 for no end
+ */
+void
+TskTimeline::setRange(int64_t a_start, int64_t a_end)
+{
+    m_start = a_start;
+    m_end = a_end;
+}
+
+/** Set about how much memory is used to sort the events */
+void
+TskTimeline::setMemory(size_t a_memBytes)
+{
+    m_mem = a_memBytes;
+}
+
+/** Set the number of threads that sort the events, 0 for none */
+void
+TskTimeline::setThreads(int a_threads)
+{
+    m_threads = a_threads;
+}
+
+/** Set the directory for temporary files */
+void
+TskTimeline::setTempDir(const TSK_TCHAR * a_tmpDir)
+{
+    m_tmpDir = a_tmpDir;
+}
+
+/* Load names from a passwd or group file, where field 0 is the name
+ * and field 2 is the ID.  IDs with several names get them all. */
+static void
+tl_load_names(FILE * a_file, std::map < std::string, std::string > &a_map)
+{
+    char buf[1024];
+    while (fgets(buf, sizeof(buf), a_file)) {
+        if (buf[0] == '+')
+            continue;
+        buf[strcspn(buf, "\r\n")] = '\0';
+
+        std::vector < std::string > fields;
+        char *cur = buf;
+        while (true) {
+            char *sep = strchr(cur, ':');
+            if (sep)
+                *sep = '\0';
+            fields.push_back(cur);
+            if (sep == NULL)
+                break;
+            cur = sep + 1;
+        }
+        if ((fields.size() < 3) || (fields[0].empty())
+            || (fields[2].empty()))
+            continue;
+
+        std::string & names = a_map[fields[2]];
+        if (names.empty() == false)
+            names += "/";
+        names += fields[0];
+    }
+    // whitespace in the names is printed as '/' too
+    for (std::map < std::string, std::string >::iterator it =
+        a_map.begin(); it != a_map.end(); it++) {
+        for (size_t i = 0; i < it->second.size(); i++) {
+            if (isspace((unsigned char) it->second[i]))
+                it->second[i] = '/';
+        }
+    }
+}
+
+/** Print the names from a passwd file instead of the UIDs */
+uint8_t
+TskTimeline::loadUsers(FILE * a_passwd)
+{
+    tl_load_names(a_passwd, m_users);
+    return 0;
+}
+
+/** Print the names from a group file instead of the GIDs */
+uint8_t
+TskTimeline::loadGroups(FILE * a_group)
+{
+    tl_load_names(a_group, m_groups);
+    return 0;
+}
+
+/**
+ * Make the temporary files.  Call after the settings and before
+ * adding files.
+ * @returns 1 on error
+ */
+uint8_t
+TskTimeline::open()
+{
+    if ((m_spool = tl_tmpfile(m_tmpDir)) == NULL)
+        return 1;
+    m_sorter = new TlSorter(m_mem, m_threads, m_tmpDir.c_str());
+    return 0;
+}
+
+/**
+ * Add the events of a file.  Times outside of the range are dropped
+ * here and a file with no times in the range is not kept at all.
+ * Times that are the same become one event, as in mactime.
+ * @returns 1 on error
+ */
+uint8_t
+TskTimeline::addFile(const TlFile & a_file)
+{
+    int64_t times[4] =
+        { a_file.mtime, a_file.atime, a_file.ctime, a_file.crtime };
+    uint8_t flags[4] = { TL_M, TL_A, TL_C, TL_B };
+    TL_EVENT evs[4];
+    int cnt = 0;
+
+    // we need *some* value in the times
+    if ((times[0] == 0) && (times[1] == 0) && (times[2] == 0)
+        && (times[3] == 0))
+        return 0;
+
+    for (int i = 0; i < 4; i++) {
+        if ((times[i] < m_start) || ((m_end) && (times[i] >= m_end)))
+            continue;
+        int j;
+        for (j = 0; j < cnt; j++) {
+            if (evs[j].time == times[i])
+                break;
+        }
+        if (j == cnt) {
+            evs[cnt].time = times[i];
+            evs[cnt].macb = 0;
+            cnt++;
+        }
+        evs[j].macb |= flags[i];
+    }
+    if (cnt == 0)
+        return 0;
+
+    /* Save the details as a 4-byte length and then the strings
+     * with a NUL after each. */
+    std::string rec;
+    rec.append(a_file.name).push_back('\0');
+    rec.append(a_file.inode).push_back('\0');
+    rec.append(a_file.mode).push_back('\0');
+    rec.append(a_file.uid).push_back('\0');
+    rec.append(a_file.gid).push_back('\0');
+    rec.append(a_file.size).push_back('\0');
+    uint32_t len = (uint32_t) rec.size();
+    if ((fwrite(&len, sizeof(len), 1, m_spool) != 1)
+        || (fwrite(rec.data(), 1, len, m_spool) != len)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_AUX_GENERIC);
+        tsk_error_set_errstr("TskTimeline::addFile: error writing spool: %s",
+            strerror(errno));
+        return 1;
+    }
+    uint64_t off = m_spoolSize;
+    m_spoolSize += sizeof(len) + len;
+
+    char key[TL_KEY_LEN];
+    std::string keyStr = a_file.inode + "," + a_file.name;
+    memset(key, 0, TL_KEY_LEN);
+    memcpy(key, keyStr.data(), std::min(keyStr.size(),
+            (size_t) TL_KEY_LEN));
+
+    for (int i = 0; i < cnt; i++) {
+        evs[i].file = off;
+        memcpy(evs[i].key, key, TL_KEY_LEN);
+        if (m_sorter->add(evs[i]))
+            return 1;
+    }
+    return 0;
+}
+
+/* Read the details of a file back from the spool */
+uint8_t
+TskTimeline::readFile(uint64_t a_off, TlFile & a_file)
+{
+    if (a_off == m_spoolRead)
+        return 0;
+
+    uint32_t len;
+    std::vector < char >rec;
+    if ((TL_FSEEK(m_spool, a_off, SEEK_SET))
+        || (fread(&len, sizeof(len), 1, m_spool) != 1)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_AUX_GENERIC);
+        tsk_error_set_errstr("TskTimeline::readFile: error reading spool");
+        return 1;
+    }
+    rec.resize(len + 1);
+    if (fread(&rec[0], 1, len, m_spool) != len) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_AUX_GENERIC);
+        tsk_error_set_errstr("TskTimeline::readFile: error reading spool");
+        return 1;
+    }
+    rec[len] = '\0';
+
+    const char *cur = &rec[0];
+    std::string *fields[6] = { &a_file.name, &a_file.inode, &a_file.mode,
+        &a_file.uid, &a_file.gid, &a_file.size
+    };
+    for (int i = 0; i < 6; i++) {
+        fields[i]->assign(cur);
+        cur += fields[i]->size() + 1;
+        if (cur > &rec[len])
+            cur = &rec[len];
+    }
+    m_spoolRead = a_off;
+    return 0;
+}
+
+/* Decode the %XX escapes that mac-robber puts in body file fields */
+static void
+tl_unescape(std::string & a_str)
+{
+    size_t out = 0;
+    for (size_t i = 0; i < a_str.size(); i++) {
+        if ((a_str[i] == '%') && (i + 2 < a_str.size())
+            && (isxdigit((unsigned char) a_str[i + 1]))
+            && (isxdigit((unsigned char) a_str[i + 2]))) {
+            a_str[out++] =
+                (char) strtol(a_str.substr(i + 1, 2).c_str(), NULL, 16);
+            i += 2;
+        }
+        else {
+            a_str[out++] = a_str[i];
+        }
+    }
+    a_str.resize(out);
+}
+
+static bool
+tl_has_digit(const std::string & a_str)
+{
+    for (size_t i = 0; i < a_str.size(); i++) {
+        if (isdigit((unsigned char) a_str[i]))
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Add a line of a body file (from fls -m, ils -m, tsk_gettimes or
+ * mac-robber).  Comments and lines that are not in the format are
+ * skipped, as mactime skips them.
+ * @returns 1 on error
+ */
+uint8_t
+TskTimeline::addBodyLine(char *a_line)
+{
+    if (a_line[0] == '#')
+        return 0;
+
+    // md5|name|inode|mode|uid|gid|size|atime|mtime|ctime|crtime
+    std::vector < std::string > fields;
+    char *cur = a_line;
+    while (true) {
+        char *sep = strchr(cur, '|');
+        if (sep)
+            *sep = '\0';
+        fields.push_back(cur);
+        tl_unescape(fields.back());
+        if (sep == NULL)
+            break;
+        cur = sep + 1;
+    }
+    if (fields.size() < 11)
+        return 0;
+
+    // the inode is used in the sort key, which mactime expects to be
+    // digits and dashes
+    if ((fields[2].empty())
+        || (fields[2].find_first_not_of("0123456789-") !=
+            std::string::npos))
+        return 0;
+    for (int i = 4; i <= 10; i++) {
+        if (tl_has_digit(fields[i]) == false)
+            return 0;
+    }
+
+    TlFile file;
+    file.name = fields[1];
+    file.inode = fields[2];
+    file.mode = fields[3];
+    file.uid = fields[4];
+    file.gid = fields[5];
+    file.size = fields[6];
+    file.atime = strtoll(fields[7].c_str(), NULL, 10);
+    file.mtime = strtoll(fields[8].c_str(), NULL, 10);
+    file.ctime = strtoll(fields[9].c_str(), NULL, 10);
+    file.crtime = strtoll(fields[10].c_str(), NULL, 10);
+    return addFile(file);
+}
+
+/**
+ * Add every line of a body file.
+ * @returns 1 on error
+ */
+uint8_t
+TskTimeline::addBodyFile(FILE * a_body)
+{
+    char buf[4096];
+    std::string line;
+    while (fgets(buf, sizeof(buf), a_body)) {
+        line += buf;
+        if (line[line.size() - 1] != '\n')
+            continue;
+        line.erase(line.size() - 1);
+        if (addBodyLine(&line[0]))
+            return 1;
+        line.clear();
+    }
+    if (line.empty() == false) {
+        if (addBodyLine(&line[0]))
+            return 1;
+    }
+    if (ferror(a_body)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_AUX_GENERIC);
+        tsk_error_set_errstr("TskTimeline::addBodyFile: read error: %s",
+            strerror(errno));
+        return 1;
+    }
+    return 0;
+}
+
+/* Break a time into its parts, in UTC for ISO 8601 */
+static void
+tl_break_time(int64_t a_time, bool a_utc, struct tm *a_tm)
+{
+    time_t t = (time_t) a_time;
+    struct tm *tmp;
+    memset(a_tm, 0, sizeof(*a_tm));
+#ifdef TSK_WIN32
+    if (a_utc)
+        gmtime_s(a_tm, &t);
+    else
+        localtime_s(a_tm, &t);
+    (void) tmp;
+#else
+    if (a_utc)
+        tmp = gmtime_r(&t, a_tm);
+    else
+        tmp = localtime_r(&t, a_tm);
+    if (tmp == NULL)
+        memset(a_tm, 0, sizeof(*a_tm));
+#endif
+}
+
+/* Print the count of the day or hour that just ended to the index */
+void
+TskTimeline::printIndex()
+{
+    if ((m_index == NULL) || (m_prevTime <= 0))
+        return;
+
+    if (m_monthNum)
+        fprintf(m_index, "%s %02d %02d %d", tl_days[m_prevTm.tm_wday],
+            m_prevTm.tm_mon + 1, m_prevTm.tm_mday,
+            m_prevTm.tm_year + 1900);
+    else
+        fprintf(m_index, "%s %s %02d %d", tl_days[m_prevTm.tm_wday],
+            tl_months[m_prevTm.tm_mon], m_prevTm.tm_mday,
+            m_prevTm.tm_year + 1900);
+    if (m_hourly)
+        fprintf(m_index, " %02d:00:00", m_prevTm.tm_hour);
+    fprintf(m_index, "%s %" PRIu64 "\n", m_comma ? "," : ":", m_prevCnt);
+}
+
+/* Print one line of the timeline, in the same format as mactime */
+void
+TskTimeline::printEvent(FILE * a_out, const TL_EVENT & a_ev,
+    const TlFile & a_file, std::string & a_oldDate)
+{
+    struct tm tmv;
+    char date[64];
+
+    tl_break_time(a_ev.time, m_iso, &tmv);
+    if (m_iso) {
+        if (a_ev.time == 0)
+            strcpy(date, "0000-00-00T00:00:00Z");
+        else
+            snprintf(date, sizeof(date),
+                "%d-%02d-%02dT%02d:%02d:%02dZ", tmv.tm_year + 1900,
+                tmv.tm_mon + 1, tmv.tm_mday, tmv.tm_hour, tmv.tm_min,
+                tmv.tm_sec);
+    }
+    else if (a_ev.time == 0) {
+        strcpy(date, "Xxx Xxx 00 0000 00:00:00");
+    }
+    else if (m_monthNum) {
+        snprintf(date, sizeof(date), "%s %02d %02d %d %02d:%02d:%02d",
+            tl_days[tmv.tm_wday], tmv.tm_mon + 1, tmv.tm_mday,
+            tmv.tm_year + 1900, tmv.tm_hour, tmv.tm_min, tmv.tm_sec);
+    }
+    else {
+        snprintf(date, sizeof(date), "%s %s %02d %d %02d:%02d:%02d",
+            tl_days[tmv.tm_wday], tl_months[tmv.tm_mon], tmv.tm_mday,
+            tmv.tm_year + 1900, tmv.tm_hour, tmv.tm_min, tmv.tm_sec);
+    }
+
+    // only print the date when it changes
+    const char *dateStr = date;
+    if (a_oldDate == date) {
+        dateStr = m_iso ? "                    " :
+            "                        ";
+        if (m_index)
+            m_prevCnt++;
+    }
+    else {
+        a_oldDate = date;
+        if (m_index) {
+            if (m_prevSet == false) {
+                m_prevSet = true;
+                m_prevCnt = 0;
+            }
+            else if ((tmv.tm_mday != m_prevTm.tm_mday)
+                || (tmv.tm_mon != m_prevTm.tm_mon)
+                || (tmv.tm_year != m_prevTm.tm_year)
+                || ((m_hourly) && (tmv.tm_hour != m_prevTm.tm_hour))) {
+                printIndex();
+                m_prevCnt = 0;
+            }
+            m_prevTm = tmv;
+            m_prevTime = a_ev.time;
+            m_prevCnt++;
+        }
+    }
+
+    char macb[5];
+    macb[0] = (a_ev.macb & TL_M) ? 'm' : '.';
+    macb[1] = (a_ev.macb & TL_A) ? 'a' : '.';
+    macb[2] = (a_ev.macb & TL_C) ? 'c' : '.';
+    macb[3] = (a_ev.macb & TL_B) ? 'b' : '.';
+    macb[4] = '\0';
+
+    std::map < std::string, std::string >::const_iterator it;
+    const char *uid = a_file.uid.c_str();
+    if ((it = m_users.find(a_file.uid)) != m_users.end())
+        uid = it->second.c_str();
+    const char *gid = a_file.gid.c_str();
+    if ((it = m_groups.find(a_file.gid)) != m_groups.end())
+        gid = it->second.c_str();
+
+    if (m_comma == false) {
+        fprintf(a_out, "%s %8s %3s %s %-8s %-8s %-8s %s\n", dateStr,
+            a_file.size.c_str(), macb, a_file.mode.c_str(), uid, gid,
+            a_file.inode.c_str(), a_file.name.c_str());
+    }
+    else {
+        // escape any quotes in the name
+        std::string name;
+        for (size_t i = 0; i < a_file.name.size(); i++) {
+            if (a_file.name[i] == '"')
+                name += '"';
+            name += a_file.name[i];
+        }
+        fprintf(a_out, "%s,%s,%s,%s,%s,%s,%s,\"%s\"\n",
+            a_oldDate.c_str(), a_file.size.c_str(), macb,
+            a_file.mode.c_str(), uid, gid, a_file.inode.c_str(),
+            name.c_str());
+    }
+}
+
+/* Full "inode,name" order for events whose keys were cut off */
+class TlFullKeyLess {
+  public:
+    bool operator() (const std::pair < TL_EVENT, TlFile > &a,
+        const std::pair < TL_EVENT, TlFile > &b) const {
+        return (a.second.inode + "," + a.second.name) <
+            (b.second.inode + "," + b.second.name);
+    }
+};
+
+/* Print a group of events with the same time and key.  If the key was
+ * cut off then the group is put in full "inode,name" order.  Events for
+ * the same file are printed once. */
+void
+TskTimeline::printGroup(FILE * a_out,
+    std::vector < std::pair < TL_EVENT, TlFile > >&a_group,
+    std::string & a_oldDate)
+{
+    if ((a_group.size() > 1) && (a_group[0].first.key[TL_KEY_LEN - 1]))
+        std::stable_sort(a_group.begin(), a_group.end(), TlFullKeyLess());
+
+    for (size_t i = 0; i < a_group.size(); i++) {
+        TL_EVENT & ev = a_group[i].first;
+        const TlFile & file = a_group[i].second;
+        while ((i + 1 < a_group.size())
+            && (a_group[i + 1].second.inode == file.inode)
+            && (a_group[i + 1].second.name == file.name)) {
+            ev.macb |= a_group[i + 1].first.macb;
+            i++;
+        }
+        printEvent(a_out, ev, file, a_oldDate);
+    }
+    a_group.clear();
+}
+
+/**
+ * Sort the events and print the timeline.  Events for the same file
+ * and second that were added more than once are printed once.
+ * @returns 1 on error
+ */
+uint8_t
+TskTimeline::print(FILE * a_out)
+{
+    if (m_sorter->finish())
+        return 1;
+
+    if (m_comma)
+        fprintf(a_out, "Date,Size,Type,Mode,UID,GID,Meta,File Name\n");
+
+    std::string oldDate;
+    std::vector < std::pair < TL_EVENT, TlFile > >group;
+    TL_EVENT ev;
+    TlFile file;
+    int ret;
+
+    while ((ret = m_sorter->next(ev)) > 0) {
+        if (readFile(ev.file, file))
+            return 1;
+        if ((group.empty() == false)
+            && ((ev.time != group[0].first.time)
+                || (memcmp(ev.key, group[0].first.key, TL_KEY_LEN))))
+            printGroup(a_out, group, oldDate);
+        group.push_back(std::make_pair(ev, file));
+    }
+    if (ret < 0)
+        return 1;
+    printGroup(a_out, group, oldDate);
+
+    // finish the index for the last entry
+    if ((m_index) && (m_prevCnt > 0))
+        printIndex();
+    return 0;
+}
@@ -0,0 +1,207 @@
+/*
+ ** The Sleuth Kit
+ **
+ ** Brian Carrier [carrier <at> sleuthkit [dot] org]
+ ** Copyright (c) 2010-2016 Brian Carrier.  All Rights reserved
+ **
+ ** This software is distributed under the Common Public License 1.0
+ **
+ */
+
+/**
+ * \file timeline.h
+ * Timeline engine used by tsk_timeline.  Files are added from a directory
+ * walk or from body file lines and each becomes up to four fixed-width
+ * event records.  The events are sorted in bounded memory by sorting
+ * runs in worker threads, spilling them to temporary files and merging
+ * them.  The details of each file are kept in a temporary spool file
+ * and read back as the sorted events are printed.
+ */
+
+#ifndef _TSK_TIMELINE_H
+#define _TSK_TIMELINE_H
+
+#include "tsk/tsk_tools_i.h"
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#define TL_KEY_LEN 47           ///< Bytes of "inode,name" kept in each event
+#define TL_MAX_FANIN 64         ///< Most runs that are merged at once
+
+/* Flags for the times in an event */
+#define TL_M 0x01
+#define TL_A 0x02
+#define TL_C 0x04
+#define TL_B 0x08
+
+/**
+ * One timeline event: the times of one file that fall on one second.
+ * Events are ordered by time and then by "inode,name", as mactime
+ * orders them.  Only the start of that string is kept; events whose
+ * strings share the first TL_KEY_LEN bytes come out of the sort next
+ * to each other and are put in order when they are printed.
+ */
+typedef struct {
+    int64_t time;
+    uint64_t file;              ///< Offset of the file details in the spool
+    char key[TL_KEY_LEN];       ///< Start of "inode,name", padded with 0s
+    uint8_t macb;               ///< TL_M, TL_A, TL_C and TL_B
+} TL_EVENT;
+
+/** Details of a file in the body file format */
+class TlFile {
+  public:
+    std::string name;
+    std::string inode;
+    std::string mode;
+    std::string uid;
+    std::string gid;
+    std::string size;
+    int64_t atime;
+    int64_t mtime;
+    int64_t ctime;
+    int64_t crtime;
+};
+
+class TlMerger;
+
+/**
+ * Sorts TL_EVENT records using about a fixed amount of memory.  Events
+ * are added to a buffer; full buffers are sorted by the worker threads
+ * and written to temporary files as runs, which are merged at the end.
+ * If everything fits in one buffer then nothing is written.
+ */
+class TlSorter {
+  public:
+    TlSorter(size_t a_memBytes, int a_threads, const TSK_TCHAR * a_tmpDir);
+    ~TlSorter();
+
+    uint8_t add(const TL_EVENT & a_ev);
+    uint8_t finish();
+    int next(TL_EVENT & a_ev);
+    uint64_t count() const {
+        return m_count;
+    };
+    size_t runCount() const {
+        return m_numRuns;
+    };
+
+  private:
+    typedef std::vector < TL_EVENT > EVENT_BUF;
+
+    EVENT_BUF *getBuffer();
+    uint8_t submit(EVENT_BUF * a_buf);
+    FILE *writeRun(EVENT_BUF * a_buf);
+    uint8_t mergePass();
+    void stopWorkers();
+
+    size_t m_memBytes;
+    size_t m_bufEvents;         ///< Events per buffer
+    int m_threads;
+    std::basic_string < TSK_TCHAR > m_tmpDir;
+    uint64_t m_count;
+
+    EVENT_BUF *m_cur;           ///< Buffer being filled
+    std::vector < EVENT_BUF * >m_free;
+    std::vector < EVENT_BUF * >m_full;
+    size_t m_numBufs;           ///< Most buffers in use at once
+    size_t m_allocBufs;         ///< Buffers that have been allocated
+    uint64_t m_submitted;       ///< Buffers handed to submit()
+    std::vector < FILE * >m_runs;
+    size_t m_numRuns;           ///< Runs written before the merge passes
+    bool m_failed;              ///< Set by a worker that had an error
+    std::string m_errStr;       ///< The worker's error message
+
+    TlMerger *m_merger;         ///< Final merge, or 0
+    size_t m_memPos;            ///< Next event if everything is in m_cur
+
+#ifdef HAVE_PTHREAD
+    pthread_mutex_t m_lock;
+    pthread_cond_t m_cond;
+    std::vector < pthread_t > m_workers;
+    bool m_stop;
+    static void *workerMain(void *a_ptr);
+#endif
+};
+
+/**
+ * Builds a timeline from files and prints it in the mactime format.
+ */
+class TskTimeline {
+  public:
+    TskTimeline();
+    ~TskTimeline();
+
+    void setRange(int64_t a_start, int64_t a_end);
+    void setMemory(size_t a_memBytes);
+    void setThreads(int a_threads);
+    void setTempDir(const TSK_TCHAR * a_tmpDir);
+    void setComma(bool a_comma) {
+        m_comma = a_comma;
+    };
+    void setIso8601(bool a_iso) {
+        m_iso = a_iso;
+    };
+    void setMonthNum(bool a_monthNum) {
+        m_monthNum = a_monthNum;
+    };
+    void setIndex(FILE * a_index, bool a_hourly) {
+        m_index = a_index;
+        m_hourly = a_hourly;
+    };
+    uint8_t loadUsers(FILE * a_passwd);
+    uint8_t loadGroups(FILE * a_group);
+
+    uint8_t open();
+    uint8_t addFile(const TlFile & a_file);
+    uint8_t addBodyLine(char *a_line);
+    uint8_t addBodyFile(FILE * a_body);
+    uint8_t print(FILE * a_out);
+
+    uint64_t eventCount() const {
+        return m_sorter ? m_sorter->count() : 0;
+    };
+
+  private:
+    uint8_t readFile(uint64_t a_off, TlFile & a_file);
+    void printEvent(FILE * a_out, const TL_EVENT & a_ev,
+        const TlFile & a_file, std::string & a_oldDate);
+    void printGroup(FILE * a_out,
+        std::vector < std::pair < TL_EVENT, TlFile > >&a_group,
+        std::string & a_oldDate);
+    void printIndex();
+
+    int64_t m_start;
+    int64_t m_end;              ///< 0 for no end
+    size_t m_mem;
+    int m_threads;
+    std::basic_string < TSK_TCHAR > m_tmpDir;
+
+    bool m_comma;
+    bool m_iso;
+    bool m_monthNum;
+    FILE *m_index;
+    bool m_hourly;
+    std::map < std::string, std::string > m_users;
+    std::map < std::string, std::string > m_groups;
+
+    FILE *m_spool;              ///< File details, see addFile()
+    uint64_t m_spoolSize;
+    uint64_t m_spoolRead;       ///< Offset of the last record read
+    TlSorter *m_sorter;
+
+    /* Index state carried between events, as in mactime */
+    struct tm m_prevTm;
+    int64_t m_prevTime;
+    uint64_t m_prevCnt;
+    bool m_prevSet;
+};
+
+#endif
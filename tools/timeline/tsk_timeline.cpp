@@ -0,0 +1,589 @@
+/*
+ ** tsk_timeline
+ ** The Sleuth Kit
+ **
+ ** Make a timeline from disk images and body files in bounded memory.
+ **
+ ** Brian Carrier [carrier <at> sleuthkit [dot] org]
+ ** Copyright (c) 2010-2016 Brian Carrier.  All Rights reserved
+ **
+ ** This software is distributed under the Common Public License 1.0
+ **
+ */
+
+#include "timeline.h"
+#include <locale.h>
+#include <time.h>
+
+#ifdef TSK_WIN32
+#define TL_FOPEN(a_path, a_mode) _wfopen(a_path, _TSK_T(a_mode))
+#else
+#define TL_FOPEN(a_path, a_mode) fopen(a_path, a_mode)
+#endif
+
+static TSK_TCHAR *progname;
+
+static void
+usage()
+{
+    TFPRINTF(stderr,
+        _TSK_T
+        ("usage: %s [-dhmvVy] [-f body_file]... [-i imgtype] [-b dev_sector_size] [-s seconds] [-z zone] [-r date_range] [-g group_file] [-p passwd_file] [-D|-H index_file] [-M megabytes] [-j threads] [-T tmp_dir] [image [image]]\n"),
+        progname);
+    tsk_fprintf(stderr,
+        "\t-f body_file: Add the times from a body file ('-' for STDIN), may be repeated\n");
+    tsk_fprintf(stderr,
+        "\t-i imgtype: The format of the image file (use '-i list' for supported types)\n");
+    tsk_fprintf(stderr,
+        "\t-b dev_sector_size: The size (in bytes) of the device sectors\n");
+    tsk_fprintf(stderr,
+        "\t-s seconds: Time skew of original machine (in seconds)\n");
+    tsk_fprintf(stderr,
+        "\t-z: Time zone of original machine (i.e. EST5EDT or GMT)\n");
+    tsk_fprintf(stderr,
+        "\t-r date_range: Only times from yyyy-mm-dd[Thh:mm:ss] or in yyyy-mm-dd[Thh:mm:ss]..yyyy-mm-dd[Thh:mm:ss]\n");
+    tsk_fprintf(stderr, "\t-d: Output in comma delimited format\n");
+    tsk_fprintf(stderr,
+        "\t-h: Display a header with session information\n");
+    tsk_fprintf(stderr,
+        "\t-m: Dates have month as number instead of word (does not work with -y)\n");
+    tsk_fprintf(stderr,
+        "\t-y: Dates are displayed in ISO 8601 format\n");
+    tsk_fprintf(stderr,
+        "\t-g group_file: Print group names instead of GIDs\n");
+    tsk_fprintf(stderr,
+        "\t-p passwd_file: Print user names instead of UIDs\n");
+    tsk_fprintf(stderr,
+        "\t-D index_file: Write a daily summary to index_file\n");
+    tsk_fprintf(stderr,
+        "\t-H index_file: Write an hourly summary to index_file\n");
+    tsk_fprintf(stderr,
+        "\t-M megabytes: Memory to use for sorting (default 256)\n");
+    tsk_fprintf(stderr,
+        "\t-j threads: Number of threads that sort (default 1, 0 for none)\n");
+    tsk_fprintf(stderr,
+        "\t-T tmp_dir: Directory for temporary files (default TMPDIR)\n");
+    tsk_fprintf(stderr, "\t-v: verbose output to stderr\n");
+    tsk_fprintf(stderr, "\t-V: Print version\n");
+
+    exit(1);
+}
+
+
+/* Parse yyyy-mm-dd or yyyy-mm-ddThh:mm:ss in local time.
+ * @returns -1 if it is not in either format */
+static int64_t
+parse_isodate(const TSK_TCHAR * a_str)
+{
+    char buf[32];
+    size_t i;
+    for (i = 0; a_str[i] && i < sizeof(buf) - 1; i++)
+        buf[i] = (char) a_str[i];
+    buf[i] = '\0';
+
+    struct tm tmv;
+    char extra;
+    memset(&tmv, 0, sizeof(tmv));
+    if ((strlen(buf) == 10)
+        && (sscanf(buf, "%4d-%2d-%2d%c", &tmv.tm_year, &tmv.tm_mon,
+                &tmv.tm_mday, &extra) == 3)) {
+    }
+    else if ((strlen(buf) == 19)
+        && (sscanf(buf, "%4d-%2d-%2dT%2d:%2d:%2d%c", &tmv.tm_year,
+                &tmv.tm_mon, &tmv.tm_mday, &tmv.tm_hour, &tmv.tm_min,
+                &tmv.tm_sec, &extra) == 6)) {
+    }
+    else {
+        return -1;
+    }
+    tmv.tm_year -= 1900;
+    tmv.tm_mon -= 1;
+    tmv.tm_isdst = -1;
+    return (int64_t) mktime(&tmv);
+}
+
+
+class TskTimelineAuto:public TskAuto {
+public:
+    TskTimelineAuto(TskTimeline * a_tl, int32_t a_secSkew);
+    virtual TSK_RETVAL_ENUM processFile(TSK_FS_FILE * fs_file, const char *path);
+    virtual TSK_FILTER_ENUM filterVol(const TSK_VS_PART_INFO * vs_part);
+    virtual uint8_t handleError();
+
+private:
+    TSK_RETVAL_ENUM addFile(TSK_FS_FILE * fs_file, const char *path,
+        const TSK_FS_ATTR * fs_attr);
+
+    TskTimeline *m_tl;
+    int32_t m_secSkew;
+    char m_volName[32];
+};
+
+
+TskTimelineAuto::TskTimelineAuto(TskTimeline * a_tl, int32_t a_secSkew)
+{
+    m_tl = a_tl;
+    m_secSkew = a_secSkew;
+    m_volName[0] = '\0';
+    setFileFilterFlags((TSK_FS_DIR_WALK_FLAG_ENUM)
+        (TSK_FS_DIR_WALK_FLAG_ALLOC | TSK_FS_DIR_WALK_FLAG_UNALLOC));
+}
+
+// Print errors as they are encountered
+uint8_t TskTimelineAuto::handleError()
+{
+    fprintf(stderr, "%s", tsk_error_get());
+    return 0;
+}
+
+TSK_FILTER_ENUM
+TskTimelineAuto::filterVol(const TSK_VS_PART_INFO * vs_part)
+{
+    snprintf(m_volName, sizeof(m_volName), "vol%" PRIuPNUM "/",
+        vs_part->addr);
+    return TSK_FILTER_CONT;
+}
+
+/* Copy a string with control characters replaced, as fls -m prints them */
+static void
+append_sanitized(std::string & a_str, const char *a_src)
+{
+    for (; *a_src; a_src++)
+        a_str += TSK_IS_CNTRL(*a_src) ? '^' : *a_src;
+}
+
+static int64_t
+skew_time(int64_t a_time, int32_t a_skew)
+{
+    return a_time ? a_time - a_skew : 0;
+}
+
+/* Add a file (or one of its NTFS attributes) with the same details that
+ * fls -m would print for it. */
+TSK_RETVAL_ENUM
+TskTimelineAuto::addFile(TSK_FS_FILE * fs_file, const char *path,
+    const TSK_FS_ATTR * fs_attr)
+{
+    TlFile file;
+    char buf[64];
+
+    file.name = m_volName;
+    if (path)
+        append_sanitized(file.name, path);
+    append_sanitized(file.name, fs_file->name->name);
+
+    /* print the data stream name if it exists and is not the default NTFS */
+    if ((fs_attr) && (fs_attr->name)
+        && (fs_attr->type != TSK_FS_ATTR_TYPE_NTFS_FNAME)
+        && ((fs_attr->type != TSK_FS_ATTR_TYPE_NTFS_IDXROOT)
+            || (strcmp(fs_attr->name, "$I30") != 0))) {
+        file.name += ":";
+        append_sanitized(file.name, fs_attr->name);
+    }
+    if ((fs_attr) && (fs_attr->type == TSK_FS_ATTR_TYPE_NTFS_FNAME))
+        file.name += " ($FILE_NAME)";
+    if ((fs_file->meta) && (fs_file->meta->type == TSK_FS_META_TYPE_LNK)
+        && (fs_file->meta->link)) {
+        file.name += " -> ";
+        file.name += fs_file->meta->link;
+    }
+    if (fs_file->name->flags & TSK_FS_NAME_FLAG_UNALLOC) {
+        file.name += ((fs_file->meta)
+            && (fs_file->meta->flags & TSK_FS_META_FLAG_ALLOC)) ?
+            " (deleted-realloc)" : " (deleted)";
+    }
+
+    snprintf(buf, sizeof(buf), "%" PRIuINUM, fs_file->name->meta_addr);
+    file.inode = buf;
+    if (fs_attr) {
+        snprintf(buf, sizeof(buf), "-%" PRIu32 "-%" PRIu16,
+            fs_attr->type, fs_attr->id);
+        file.inode += buf;
+    }
+
+    if (fs_file->name->type < TSK_FS_NAME_TYPE_STR_MAX)
+        file.mode = tsk_fs_name_type_str[fs_file->name->type];
+    else
+        file.mode = "-";
+    file.mode += "/";
+
+    if (fs_file->meta == NULL) {
+        // files without metadata have no times, so they are not added
+        return TSK_OK;
+    }
+
+    char ls[12];
+    tsk_fs_meta_make_ls(fs_file->meta, ls, sizeof(ls));
+    file.mode += ls;
+    snprintf(buf, sizeof(buf), "%" PRIuUID, fs_file->meta->uid);
+    file.uid = buf;
+    snprintf(buf, sizeof(buf), "%" PRIuGID, fs_file->meta->gid);
+    file.gid = buf;
+    snprintf(buf, sizeof(buf), "%" PRIuOFF,
+        fs_attr ? fs_attr->size : fs_file->meta->size);
+    file.size = buf;
+
+    if ((fs_attr) && (fs_attr->type == TSK_FS_ATTR_TYPE_NTFS_FNAME)) {
+        file.atime = skew_time(fs_file->meta->time2.ntfs.fn_atime, m_secSkew);
+        file.mtime = skew_time(fs_file->meta->time2.ntfs.fn_mtime, m_secSkew);
+        file.ctime = skew_time(fs_file->meta->time2.ntfs.fn_ctime, m_secSkew);
+        file.crtime =
+            skew_time(fs_file->meta->time2.ntfs.fn_crtime, m_secSkew);
+    }
+    else {
+        file.atime = skew_time(fs_file->meta->atime, m_secSkew);
+        file.mtime = skew_time(fs_file->meta->mtime, m_secSkew);
+        file.ctime = skew_time(fs_file->meta->ctime, m_secSkew);
+        file.crtime = skew_time(fs_file->meta->crtime, m_secSkew);
+    }
+
+    if (m_tl->addFile(file)) {
+        tsk_error_print(stderr);
+        return TSK_STOP;
+    }
+    return TSK_OK;
+}
+
+/* Pick the same files and NTFS attributes that fls -m does */
+TSK_RETVAL_ENUM
+TskTimelineAuto::processFile(TSK_FS_FILE * fs_file, const char *path)
+{
+    if (TSK_FS_ISDOT(fs_file->name->name))
+        return TSK_OK;
+
+    if ((TSK_FS_TYPE_ISNTFS(fs_file->fs_info->ftype)) && (fs_file->meta)) {
+        bool added = false;
+        int cnt = tsk_fs_file_attr_getsize(fs_file);
+        for (int i = 0; i < cnt; i++) {
+            const TSK_FS_ATTR *fs_attr =
+                tsk_fs_file_attr_get_idx(fs_file, i);
+            if (!fs_attr)
+                continue;
+
+            if ((fs_attr->type == TSK_FS_ATTR_TYPE_NTFS_DATA)
+                || (fs_attr->type == TSK_FS_ATTR_TYPE_NTFS_IDXROOT)
+                || ((fs_attr->type == TSK_FS_ATTR_TYPE_NTFS_FNAME)
+                    && (fs_attr->id == fs_file->meta->time2.ntfs.fn_id))) {
+                if (fs_attr->type != TSK_FS_ATTR_TYPE_NTFS_FNAME)
+                    added = true;
+                if (addFile(fs_file, path, fs_attr) == TSK_STOP)
+                    return TSK_STOP;
+            }
+        }
+        if (added)
+            return TSK_OK;
+    }
+    return addFile(fs_file, path, NULL);
+}
+
+
+int
+main(int argc, char **argv1)
+{
+    TSK_IMG_TYPE_ENUM imgtype = TSK_IMG_TYPE_DETECT;
+    int ch;
+    TSK_TCHAR **argv;
+    unsigned int ssize = 0;
+    TSK_TCHAR *cp;
+    int32_t sec_skew = 0;
+    std::vector < TSK_TCHAR * >bodies;
+    TSK_TCHAR *range = NULL;
+    TSK_TCHAR *passwd = NULL;
+    TSK_TCHAR *group = NULL;
+    TSK_TCHAR *idx_file = NULL;
+    bool hourly = false;
+    bool header = false;
+    TskTimeline tl;
+
+#ifdef TSK_WIN32
+    // On Windows, get the wide arguments (mingw doesn't support wmain)
+    argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+    if (argv == NULL) {
+        fprintf(stderr, "Error getting wide arguments\n");
+        exit(1);
+    }
+#else
+    argv = (TSK_TCHAR **) argv1;
+    const char *tmpdir = getenv("TMPDIR");
+    if (tmpdir)
+        tl.setTempDir(tmpdir);
+#endif
+
+    progname = argv[0];
+    setlocale(LC_ALL, "");
+
+    while ((ch =
+            GETOPT(argc, argv,
+                _TSK_T("b:dD:f:g:hH:i:j:mM:p:r:s:T:vVyz:"))) > 0) {
+        switch (ch) {
+        case _TSK_T('?'):
+        default:
+            TFPRINTF(stderr, _TSK_T("Invalid argument: %s\n"),
+                argv[OPTIND]);
+            usage();
+            break;
+
+        case _TSK_T('b'):
+            ssize = (unsigned int) TSTRTOUL(OPTARG, &cp, 0);
+            if (*cp || *cp == *OPTARG || ssize < 1) {
+                TFPRINTF(stderr,
+                    _TSK_T
+                    ("invalid argument: sector size must be positive: %s\n"),
+                    OPTARG);
+                usage();
+            }
+            break;
+
+        case _TSK_T('d'):
+            tl.setComma(true);
+            break;
+
+        case _TSK_T('D'):
+        case _TSK_T('H'):
+            if (idx_file) {
+                tsk_fprintf(stderr,
+                    "Only one -D or -H argument can be supplied\n");
+                usage();
+            }
+            idx_file = OPTARG;
+            hourly = (ch == _TSK_T('H'));
+            break;
+
+        case _TSK_T('f'):
+            bodies.push_back(OPTARG);
+            break;
+
+        case _TSK_T('g'):
+            group = OPTARG;
+            break;
+
+        case _TSK_T('h'):
+            header = true;
+            break;
+
+        case _TSK_T('i'):
+            if (TSTRCMP(OPTARG, _TSK_T("list")) == 0) {
+                tsk_img_type_print(stderr);
+                exit(1);
+            }
+            imgtype = tsk_img_type_toid(OPTARG);
+            if (imgtype == TSK_IMG_TYPE_UNSUPP) {
+                TFPRINTF(stderr, _TSK_T("Unsupported image type: %s\n"),
+                    OPTARG);
+                usage();
+            }
+            break;
+
+        case _TSK_T('j'):
+            tl.setThreads(TATOI(OPTARG));
+            break;
+
+        case _TSK_T('m'):
+            tl.setMonthNum(true);
+            break;
+
+        case _TSK_T('M'):
+            {
+                unsigned long mb = TSTRTOUL(OPTARG, &cp, 0);
+                if (*cp || *cp == *OPTARG || mb < 1) {
+                    TFPRINTF(stderr,
+                        _TSK_T
+                        ("invalid argument: memory must be positive: %s\n"),
+                        OPTARG);
+                    usage();
+                }
+                tl.setMemory((size_t) mb * 1024 * 1024);
+            }
+            break;
+
+        case _TSK_T('p'):
+            passwd = OPTARG;
+            break;
+
+        case _TSK_T('r'):
+            range = OPTARG;
+            break;
+
+        case _TSK_T('s'):
+            sec_skew = TATOI(OPTARG);
+            break;
+
+        case _TSK_T('T'):
+            tl.setTempDir(OPTARG);
+            break;
+
+        case _TSK_T('v'):
+            tsk_verbose++;
+            break;
+
+        case _TSK_T('V'):
+            tsk_version_print(stdout);
+            exit(0);
+
+        case _TSK_T('y'):
+            tl.setIso8601(true);
+            break;
+
+        case _TSK_T('z'):
+            {
+                TSK_TCHAR envstr[32];
+                TSNPRINTF(envstr, 32, _TSK_T("TZ=%s"), OPTARG);
+                if (0 != TPUTENV(envstr)) {
+                    tsk_fprintf(stderr, "error setting environment");
+                    exit(1);
+                }
+
+                /* we should be checking this somehow */
+                TZSET();
+            }
+            break;
+        }
+    }
+
+    /* We need a body file or an image */
+    if ((OPTIND >= argc) && (bodies.empty())) {
+        tsk_fprintf(stderr, "Missing image name or body file\n");
+        usage();
+    }
+
+    if (range) {
+        TSK_TCHAR *start = range;
+        TSK_TCHAR *end = NULL;
+        for (TSK_TCHAR * c = range; *c; c++) {
+            if ((c[0] == '.') && (c[1] == '.')) {
+                *c = '\0';
+                end = c + 2;
+                break;
+            }
+        }
+        int64_t in_seconds = parse_isodate(start);
+        int64_t out_seconds = 0;
+        if (in_seconds < 0) {
+            TFPRINTF(stderr, _TSK_T("Invalid Date: %s\n"), start);
+            exit(1);
+        }
+        if ((end) && (*end)) {
+            out_seconds = parse_isodate(end);
+            if (out_seconds < 0) {
+                TFPRINTF(stderr, _TSK_T("Invalid Date: %s\n"), end);
+                exit(1);
+            }
+        }
+        tl.setRange(in_seconds, out_seconds);
+        if (end)
+            end[-2] = '.';      // put it back for the header
+    }
+
+    if (passwd) {
+        FILE *hFile = TL_FOPEN(passwd, "r");
+        if (hFile == NULL) {
+            TFPRINTF(stderr, _TSK_T("can't open %s\n"), passwd);
+            exit(1);
+        }
+        tl.loadUsers(hFile);
+        fclose(hFile);
+    }
+    if (group) {
+        FILE *hFile = TL_FOPEN(group, "r");
+        if (hFile == NULL) {
+            TFPRINTF(stderr, _TSK_T("can't open %s\n"), group);
+            exit(1);
+        }
+        tl.loadGroups(hFile);
+        fclose(hFile);
+    }
+
+    FILE *hIndex = NULL;
+    if (idx_file) {
+        if ((hIndex = TL_FOPEN(idx_file, "w")) == NULL) {
+            TFPRINTF(stderr, _TSK_T("Can not open %s\n"), idx_file);
+            exit(1);
+        }
+        tl.setIndex(hIndex, hourly);
+        fprintf(hIndex, "%s Summary for Timeline of ",
+            hourly ? "Hourly" : "Daily");
+        if (OPTIND < argc)
+            TFPRINTF(hIndex, _TSK_T("%s\n\n"), argv[OPTIND]);
+        else if (TSTRCMP(bodies[0], _TSK_T("-")) == 0)
+            fprintf(hIndex, "STDIN\n\n");
+        else
+            TFPRINTF(hIndex, _TSK_T("%s\n\n"), bodies[0]);
+    }
+
+    if (header) {
+        tsk_printf("The Sleuth Kit tsk_timeline Timeline\n");
+        tsk_printf("Input Source: ");
+        for (size_t i = 0; i < bodies.size(); i++) {
+            if (TSTRCMP(bodies[i], _TSK_T("-")) == 0)
+                tsk_printf("%sSTDIN", i ? ", " : "");
+            else
+                TFPRINTF(stdout, _TSK_T("%s%s"), i ? _TSK_T(", ") : _TSK_T(""),
+                    bodies[i]);
+        }
+        if (OPTIND < argc)
+            TFPRINTF(stdout, _TSK_T("%s%s"),
+                bodies.size() ? _TSK_T(", ") : _TSK_T(""), argv[OPTIND]);
+        tsk_printf("\n");
+        if (range)
+            TFPRINTF(stdout, _TSK_T("Time: %s\t\t"), range);
+        const char *tz = getenv("TZ");
+        if ((tz) && (*tz))
+            tsk_printf("Timezone: %s\n", tz);
+        else
+            tsk_printf("\n");
+        if (passwd)
+            TFPRINTF(stdout, _TSK_T("passwd File: %s"), passwd);
+        if (group)
+            TFPRINTF(stdout, _TSK_T("%sgroup File: %s"),
+                passwd ? _TSK_T("\t") : _TSK_T(""), group);
+        if ((passwd) || (group))
+            tsk_printf("\n");
+        tsk_printf("\n");
+    }
+
+    if (tl.open()) {
+        tsk_error_print(stderr);
+        exit(1);
+    }
+
+    for (size_t i = 0; i < bodies.size(); i++) {
+        FILE *hFile;
+        if (TSTRCMP(bodies[i], _TSK_T("-")) == 0)
+            hFile = stdin;
+        else if ((hFile = TL_FOPEN(bodies[i], "r")) == NULL) {
+            TFPRINTF(stderr, _TSK_T("Can't open %s\n"), bodies[i]);
+            exit(1);
+        }
+        if (tl.addBodyFile(hFile)) {
+            tsk_error_print(stderr);
+            exit(1);
+        }
+        if (hFile != stdin)
+            fclose(hFile);
+    }
+
+    if (OPTIND < argc) {
+        TskTimelineAuto tlAuto(&tl, sec_skew);
+        if (tlAuto.openImage(argc - OPTIND, &argv[OPTIND], imgtype, ssize)) {
+            tsk_error_print(stderr);
+            exit(1);
+        }
+        if (tlAuto.findFilesInImg()) {
+            // we already logged the errors
+            exit(1);
+        }
+    }
+
+    if (tsk_verbose)
+        tsk_fprintf(stderr, "tsk_timeline: sorting %" PRIu64 " events\n",
+            tl.eventCount());
+
+    if (tl.print(stdout)) {
+        tsk_error_print(stderr);
+        exit(1);
+    }
+    if (hIndex)
+        fclose(hIndex);
+
+    exit(0);
+}
@@ -24,7 +24,7 @@ usage()
 {
     TFPRINTF(stderr,
         _TSK_T
-        ("%s [-i imgtype] [-b dev_sector_size] [-o imgoffset] [-BrvV] [-aAmM] [-t vstype] image [images]\n"),
+        ("%s [-i imgtype] [-b dev_sector_size] [-R raid] [-o imgoffset] [-BrvV] [-aAmM] [-t vstype] image [images]\n"),
         progname);
     tsk_fprintf(stderr,
         "\t-t vstype: The type of volume system (use '-t list' for list of supported types)\n");
@@ -32,6 +32,8 @@ usage()
         "\t-i imgtype: The format of the image file (use '-i list' for list supported types)\n");
     tsk_fprintf(stderr,
         "\t-b dev_sector_size: The size (in bytes) of the device sectors\n");
+    tsk_fprintf(stderr,
+        "\t-R raid: The images are the members of a RAID set (level,stripe_size[,la|ls|ra|rs][,data_offset])\n");
     tsk_fprintf(stderr,
         "\t-o imgoffset: Offset to the start of the volume that contains the partition system (in sectors)\n");
     tsk_fprintf(stderr, "\t-B: print the rounded length in bytes\n");
@@ -156,6 +158,7 @@ main(int argc, char **argv1)
     TSK_TCHAR **argv;
     unsigned int ssize = 0;
     TSK_TCHAR *cp;
+    TSK_TCHAR *raid_spec = NULL;
 
 #ifdef TSK_WIN32
     // On Windows, get the wide arguments (mingw doesn't support wmain)
@@ -171,7 +174,7 @@ main(int argc, char **argv1)
 
     progname = argv[0];
 
-    while ((ch = GETOPT(argc, argv, _TSK_T("aAb:Bi:mMo:rt:vV"))) > 0) {
+    while ((ch = GETOPT(argc, argv, _TSK_T("aAb:Bi:mMo:rR:t:vV"))) > 0) {
         switch (ch) {
         case _TSK_T('a'):
             flags |= TSK_VS_PART_FLAG_ALLOC;
@@ -220,6 +223,9 @@ main(int argc, char **argv1)
         case _TSK_T('r'):
             recurse = 1;
             break;
+        case _TSK_T('R'):
+            raid_spec = OPTARG;
+            break;
         case _TSK_T('t'):
             if (TSTRCMP(OPTARG, _TSK_T("list")) == 0) {
                 tsk_vs_type_print(stderr);
@@ -264,7 +270,12 @@ main(int argc, char **argv1)
     }
 
     /* open the image */
-    img = tsk_img_open(argc - OPTIND, &argv[OPTIND], imgtype, ssize);
+    if (raid_spec)
+        img =
+            tsk_img_open_raid_spec(raid_spec, argc - OPTIND,
+            &argv[OPTIND], imgtype, ssize);
+    else
+        img = tsk_img_open(argc - OPTIND, &argv[OPTIND], imgtype, ssize);
 
     if (img == NULL) {
         tsk_error_print(stderr);
@@ -32,6 +32,7 @@ TskAuto::TskAuto()
     m_curVsPartDescr = "";
     m_imageWriterEnabled = false;
     m_imageWriterPath = NULL;
+    m_fsScanEnabled = false;
 }
 
 
@@ -299,12 +300,22 @@ TskAuto::findFilesInVs(TSK_OFF_T a_start, TSK_VS_TYPE_ENUM a_vtype)
         if(tsk_verbose)
             fprintf(stderr, "findFilesInVs: Error opening volume system, trying as a file system\n");
 
+        /* Look for file systems anywhere in the image instead of only at the start */
+        if (m_fsScanEnabled) {
+            if ((vs_info = tsk_vs_open(m_img_info, a_start, TSK_VS_TYPE_FSSCAN)) == NULL) {
+                tsk_error_reset();
+            }
+        }
+
         /* There was no volume system, but there could be a file system 
          * Errors will have been registered */
-        findFilesInFs(a_start);
+        if (vs_info == NULL) {
+            findFilesInFs(a_start);
+        }
     }
+
     // process the volume system
-    else {
+    if (vs_info != NULL) {
         TSK_FILTER_ENUM retval = filterVs(vs_info);
         if ((retval == TSK_FILTER_STOP) || (retval == TSK_FILTER_SKIP)|| (m_stopAllProcessing))
             return m_errors.empty() ? 0 : 1;
@@ -507,6 +518,31 @@ TskAuto::findFilesInFs(TSK_FS_INFO * a_fs_info)
     return m_errors.empty() ? 0 : 1;
 }
 
+/** 
+ * Processes the file system represented by the given TSK_FS_INFO
+ * pointer, starting at a specified directory. Will Call processFile()
+ * on each file that is found in that directory.
+ *
+ * @param a_fs_info Pointer to a previously opened file system.
+ * @param a_inum inum to start walking files system at.
+ *
+ * @returns 1 if an error occurred (messages will have been registered) and 0 on success
+ */
+uint8_t
+TskAuto::findFilesInFs(TSK_FS_INFO * a_fs_info, TSK_INUM_T a_inum)
+{
+    if (a_fs_info == NULL) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_AUTO_NOTOPEN);
+        tsk_error_set_errstr("findFilesInFs - fs_info");
+        registerError();
+        return 1;
+    }
+    
+    findFilesInFsInt(a_fs_info, a_inum);
+    return m_errors.empty() ? 0 : 1;
+}
+
 /** \internal
  * file name walk callback.  Walk the contents of each file
  * that is found.
@@ -648,6 +684,13 @@ TskAuto::enableImageWriter(const char * imagePath) {
 
 #else
 	m_imageWriterEnabled = false;
+
+	if ((m_imageWriterPath =
+		(char *)tsk_malloc(strlen(imagePath) + 1)) == NULL) {
+		return TSK_ERR;
+	}
+	strcpy(m_imageWriterPath, imagePath);
+	m_imageWriterEnabled = true;
 #endif
 	return TSK_OK;
 }
@@ -657,6 +700,11 @@ TskAuto::disableImageWriter() {
 	m_imageWriterEnabled = false;
 }
 
+void
+TskAuto::setFileSystemScan(bool a_enable) {
+    m_fsScanEnabled = a_enable;
+}
+
 uint8_t TskAuto::registerError() {
     // add to our list of errors
     error_record er;
@@ -19,6 +19,7 @@
 #include "tsk/img/ewf.h"
 #include "tsk/img/tsk_img_i.h"
 #endif
+#include "tsk/img/e01.h"
 #include <string.h>
 
 #include <algorithm>
@@ -225,6 +226,17 @@ TskAutoDb::addImageDetails(const char* deviceId)
        collectionDetails = ewf_get_details(ewf_info);   
    }
 #endif
+#if HAVE_LIBZ
+   if (m_img_info->itype == TSK_IMG_TYPE_EWF_NATIVE) {
+       IMG_E01_INFO *e01_info = (IMG_E01_INFO *)m_img_info;
+       if (e01_info->md5hash_isset) {
+           md5 = e01_info->md5hash;
+       }
+       if (e01_info->sha1hash_isset) {
+           sha1 = e01_info->sha1hash;
+       }
+   }
+#endif
 
     string devId;
     if (NULL != deviceId) {
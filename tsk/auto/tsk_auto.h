@@ -90,6 +90,7 @@ class TskAuto {
     uint8_t findFilesInFs(TSK_OFF_T start, TSK_FS_TYPE_ENUM ftype,
         TSK_INUM_T inum);
     uint8_t findFilesInFs(TSK_FS_INFO * a_fs_info);
+    uint8_t findFilesInFs(TSK_FS_INFO * a_fs_info, TSK_INUM_T inum);
     TSK_RETVAL_ENUM findFilesInFsRet(TSK_OFF_T start,
         TSK_FS_TYPE_ENUM a_ftype);
 
@@ -141,6 +142,8 @@ class TskAuto {
 
 	/**
 	 * Enables image writer, which creates a copy of the image as it is being processed.
+	 * The copy is a VHD unless the path ends in ".tci", in which case it is a
+	 * TSK chunked image.
 	 * @param imagePath UTF8 version of path to write the image to
 	 */
 	virtual TSK_RETVAL_ENUM enableImageWriter(const char * imagePath);
@@ -149,6 +152,16 @@ class TskAuto {
 	* Disables image writer
 	*/
 	virtual void disableImageWriter();
+
+    /**
+     * Sets whether the image is scanned for file systems when it has no
+     * volume system (for example, a wiped partition table).  The file
+     * systems that are found are processed as the volumes of a
+     * TSK_VS_TYPE_FSSCAN volume system.  Without this, a file system is only
+     * looked for at the start of the image.
+     * @param a_enable true to scan the image
+     */
+    void setFileSystemScan(bool a_enable);
     
     /**
      * Internal method that TskAuto calls when it encounters issues while processing an image.
@@ -252,6 +265,7 @@ class TskAuto {
     uint8_t isNonResident(const TSK_FS_ATTR * fs_attr);
 	bool m_imageWriterEnabled;
     TSK_TCHAR * m_imageWriterPath;
+    bool m_fsScanEnabled;
 
     
     TSK_RETVAL_ENUM processAttributes(TSK_FS_FILE * fs_file,
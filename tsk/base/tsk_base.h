@@ -399,6 +399,50 @@ extern "C" {
         TSK_PNUM_T * a_pnum);
 
 
+/** \name Multi-pattern search */
+//@{
+    /**
+     * A set of byte patterns that are compiled into an Aho-Corasick
+     * automaton so that a buffer can be searched for all of them in one
+     * pass.  See tsk_msearch_alloc() for details.
+     */
+    typedef struct TSK_MSEARCH TSK_MSEARCH;
+
+    /**
+     * Search position in a stream of buffers.  Keeping it between calls to
+     * tsk_msearch_scan() finds patterns that cross buffer boundaries.  A
+     * compiled TSK_MSEARCH can be shared by several threads as long as
+     * each uses its own state.
+     */
+    typedef struct {
+        uint32_t cs_node;       ///< Node in the case-sensitive automaton
+        uint32_t ci_node;       ///< Node in the case-insensitive automaton
+    } TSK_MSEARCH_STATE;
+
+    /**
+     * Callback for tsk_msearch_scan(), called for each match in order of
+     * the end of the match.
+     * @param a_id ID that the pattern was added with
+     * @param a_off Offset of the first byte of the match
+     * @param a_ptr Pointer that was passed to tsk_msearch_scan()
+     */
+    typedef TSK_WALK_RET_ENUM(*TSK_MSEARCH_CB) (int a_id, TSK_OFF_T a_off,
+        void *a_ptr);
+
+    extern TSK_MSEARCH *tsk_msearch_alloc();
+    extern uint8_t tsk_msearch_add(TSK_MSEARCH * a_ms,
+        const uint8_t * a_pat, size_t a_len, uint8_t a_nocase, int a_id);
+    extern uint8_t tsk_msearch_compile(TSK_MSEARCH * a_ms);
+    extern size_t tsk_msearch_max_len(const TSK_MSEARCH * a_ms);
+    extern void tsk_msearch_state_init(TSK_MSEARCH_STATE * a_state);
+    extern TSK_WALK_RET_ENUM tsk_msearch_scan(const TSK_MSEARCH * a_ms,
+        TSK_MSEARCH_STATE * a_state, TSK_OFF_T a_off,
+        const uint8_t * a_buf, size_t a_len, TSK_MSEARCH_CB a_action,
+        void *a_ptr);
+    extern void tsk_msearch_free(TSK_MSEARCH * a_ms);
+//@}
+
+
 
 /** \name MD5 and SHA-1 hashing */
 //@{
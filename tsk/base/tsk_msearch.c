@@ -0,0 +1,446 @@
+/*
+ * The Sleuth Kit
+ *
+ * Brian Carrier [carrier <at> sleuthkit [dot] org]
+ * Copyright (c) 2012 Brian Carrier.  All Rights reserved
+ *
+ * This software is distributed under the Common Public License 1.0
+ */
+#include "tsk_base_i.h"
+
+/** \file tsk_msearch.c
+ * Contains the functions to search a buffer (or a stream of buffers) for
+ * many byte patterns at once.  The patterns are compiled into Aho-Corasick
+ * automatons with a full transition table, so each byte of input costs one
+ * table lookup no matter how many patterns there are.  Case-sensitive and
+ * case-insensitive patterns are kept in separate automatons. */
+
+/* One pattern in the set */
+typedef struct {
+    uint8_t *bytes;
+    size_t len;
+    uint8_t nocase;
+    int id;
+    int next;                   // next pattern that ends at the same node or -1
+} TSK_MSEARCH_PAT;
+
+/* Aho-Corasick automaton.  Node 0 is the root. */
+typedef struct {
+    uint32_t *delta;            // num_nodes * 256 transitions
+    int *out;                   // first pattern ending at the node or -1
+    uint32_t *out_link;         // nearest proper suffix node with output or 0
+    uint8_t *has_out;           // 1 if out or out_link is set
+    uint8_t start[256];         // 1 if a pattern starts with the byte
+    uint32_t num_nodes;
+    uint32_t alloc_nodes;
+} TSK_MSEARCH_AC;
+
+struct TSK_MSEARCH {
+    TSK_MSEARCH_PAT *pats;
+    int num_pats;
+    int alloc_pats;
+    size_t max_len;
+    uint8_t compiled;
+    TSK_MSEARCH_AC cs;          // case-sensitive patterns
+    TSK_MSEARCH_AC ci;          // case-insensitive patterns (lower case)
+};
+
+static uint8_t
+ms_fold(uint8_t c)
+{
+    if ((c >= 'A') && (c <= 'Z'))
+        return c + ('a' - 'A');
+    return c;
+}
+
+/*
+ * Add a node to the trie of an automaton.
+ * @returns node index or 0 on error
+ */
+static uint32_t
+ms_new_node(TSK_MSEARCH_AC * a_ac)
+{
+    uint32_t n;
+
+    if (a_ac->num_nodes == a_ac->alloc_nodes) {
+        uint32_t alloc = a_ac->alloc_nodes ? a_ac->alloc_nodes * 2 : 64;
+        if ((a_ac->delta =
+                (uint32_t *) tsk_realloc(a_ac->delta,
+                    (size_t) alloc * 256 * sizeof(uint32_t))) == NULL)
+            return 0;
+        if ((a_ac->out =
+                (int *) tsk_realloc(a_ac->out, alloc * sizeof(int))) == NULL)
+            return 0;
+        if ((a_ac->out_link =
+                (uint32_t *) tsk_realloc(a_ac->out_link,
+                    alloc * sizeof(uint32_t))) == NULL)
+            return 0;
+        if ((a_ac->has_out =
+                (uint8_t *) tsk_realloc(a_ac->has_out, alloc)) == NULL)
+            return 0;
+        a_ac->alloc_nodes = alloc;
+    }
+
+    n = a_ac->num_nodes++;
+    memset(&a_ac->delta[(size_t) n * 256], 0, 256 * sizeof(uint32_t));
+    a_ac->out[n] = -1;
+    a_ac->out_link[n] = 0;
+    a_ac->has_out[n] = 0;
+    return n;
+}
+
+/*
+ * Build the trie, failure transitions and output links of an automaton
+ * from the patterns with the given case setting.
+ * @returns 1 on error
+ */
+static uint8_t
+ms_build(TSK_MSEARCH * a_ms, TSK_MSEARCH_AC * a_ac, uint8_t a_nocase)
+{
+    uint32_t *fail = NULL;
+    uint32_t *queue = NULL;
+    uint32_t head = 0, tail = 0;
+    int i;
+    size_t j;
+    int c;
+
+    /* The root */
+    if ((ms_new_node(a_ac) != 0) || (a_ac->num_nodes != 1))
+        return 1;
+
+    /* Build the trie.  A transition of 0 means "none" while building
+     * because no edge leads back to the root. */
+    for (i = 0; i < a_ms->num_pats; i++) {
+        TSK_MSEARCH_PAT *pat = &a_ms->pats[i];
+        uint32_t n = 0;
+
+        if (pat->nocase != a_nocase)
+            continue;
+
+        for (j = 0; j < pat->len; j++) {
+            uint8_t b = a_nocase ? ms_fold(pat->bytes[j]) : pat->bytes[j];
+            uint32_t next = a_ac->delta[(size_t) n * 256 + b];
+            if (next == 0) {
+                if ((next = ms_new_node(a_ac)) == 0)
+                    return 1;
+                a_ac->delta[(size_t) n * 256 + b] = next;
+            }
+            n = next;
+        }
+        pat->next = a_ac->out[n];
+        a_ac->out[n] = i;
+        a_ac->has_out[n] = 1;
+    }
+
+    /* Remember which bytes leave the root before it gets its failure
+     * transitions (which all lead back to itself). */
+    for (c = 0; c < 256; c++)
+        a_ac->start[c] = a_ac->delta[c] ? 1 : 0;
+
+    /* Breadth-first pass to fill in the failure transitions so that the
+     * table becomes a complete DFA. */
+    if (((fail =
+                (uint32_t *) tsk_malloc(a_ac->num_nodes *
+                    sizeof(uint32_t))) == NULL)
+        || ((queue =
+                (uint32_t *) tsk_malloc(a_ac->num_nodes *
+                    sizeof(uint32_t))) == NULL)) {
+        free(fail);
+        return 1;
+    }
+
+    for (c = 0; c < 256; c++) {
+        uint32_t v = a_ac->delta[c];
+        if (v) {
+            fail[v] = 0;
+            queue[tail++] = v;
+        }
+    }
+
+    while (head < tail) {
+        uint32_t u = queue[head++];
+        for (c = 0; c < 256; c++) {
+            uint32_t v = a_ac->delta[(size_t) u * 256 + c];
+            if (v) {
+                uint32_t f = a_ac->delta[(size_t) fail[u] * 256 + c];
+                fail[v] = f;
+                a_ac->out_link[v] = (a_ac->out[f] >= 0) ? f : a_ac->out_link[f];
+                if (a_ac->out_link[v])
+                    a_ac->has_out[v] = 1;
+                queue[tail++] = v;
+            }
+            else {
+                a_ac->delta[(size_t) u * 256 + c] =
+                    a_ac->delta[(size_t) fail[u] * 256 + c];
+            }
+        }
+    }
+
+    free(fail);
+    free(queue);
+    return 0;
+}
+
+static void
+ms_free_ac(TSK_MSEARCH_AC * a_ac)
+{
+    free(a_ac->delta);
+    free(a_ac->out);
+    free(a_ac->out_link);
+    free(a_ac->has_out);
+    memset(a_ac, 0, sizeof(TSK_MSEARCH_AC));
+}
+
+/*
+ * Report the patterns that end at a node.
+ * @param a_end Offset of the byte after the match
+ */
+static TSK_WALK_RET_ENUM
+ms_report(const TSK_MSEARCH * a_ms, const TSK_MSEARCH_AC * a_ac,
+    uint32_t a_node, TSK_OFF_T a_end, TSK_MSEARCH_CB a_action, void *a_ptr)
+{
+    uint32_t m = (a_ac->out[a_node] >= 0) ? a_node : a_ac->out_link[a_node];
+
+    while (m) {
+        int p;
+        for (p = a_ac->out[m]; p >= 0; p = a_ms->pats[p].next) {
+            TSK_WALK_RET_ENUM retval =
+                a_action(a_ms->pats[p].id,
+                a_end - (TSK_OFF_T) a_ms->pats[p].len, a_ptr);
+            if (retval != TSK_WALK_CONT)
+                return retval;
+        }
+        m = a_ac->out_link[m];
+    }
+    return TSK_WALK_CONT;
+}
+
+/**
+ * \ingroup baselib
+ * Create an empty pattern set.  Add patterns with tsk_msearch_add(),
+ * compile the set with tsk_msearch_compile() and then search buffers
+ * with tsk_msearch_scan().
+ * @returns Pointer to structure or NULL on error
+ */
+TSK_MSEARCH *
+tsk_msearch_alloc()
+{
+    return (TSK_MSEARCH *) tsk_malloc(sizeof(TSK_MSEARCH));
+}
+
+/**
+ * \ingroup baselib
+ * Add a pattern to a set that has not been compiled yet.  The same bytes
+ * can be added more than once with different IDs.
+ * @param a_ms Pattern set
+ * @param a_pat Bytes of the pattern (copied)
+ * @param a_len Number of bytes in the pattern (must be > 0)
+ * @param a_nocase 1 to ignore the case of ASCII letters
+ * @param a_id Value passed to the callback when the pattern is found
+ * @returns 1 on error
+ */
+uint8_t
+tsk_msearch_add(TSK_MSEARCH * a_ms, const uint8_t * a_pat, size_t a_len,
+    uint8_t a_nocase, int a_id)
+{
+    TSK_MSEARCH_PAT *pat;
+
+    if ((a_ms == NULL) || (a_pat == NULL) || (a_len == 0)
+        || (a_ms->compiled)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_AUX_GENERIC);
+        tsk_error_set_errstr("tsk_msearch_add: invalid arguments");
+        return 1;
+    }
+
+    if (a_ms->num_pats == a_ms->alloc_pats) {
+        int alloc = a_ms->alloc_pats ? a_ms->alloc_pats * 2 : 16;
+        if ((a_ms->pats =
+                (TSK_MSEARCH_PAT *) tsk_realloc(a_ms->pats,
+                    alloc * sizeof(TSK_MSEARCH_PAT))) == NULL)
+            return 1;
+        a_ms->alloc_pats = alloc;
+    }
+
+    pat = &a_ms->pats[a_ms->num_pats];
+    if ((pat->bytes = (uint8_t *) tsk_malloc(a_len)) == NULL)
+        return 1;
+    memcpy(pat->bytes, a_pat, a_len);
+    pat->len = a_len;
+    pat->nocase = a_nocase ? 1 : 0;
+    pat->id = a_id;
+    pat->next = -1;
+    a_ms->num_pats++;
+
+    if (a_len > a_ms->max_len)
+        a_ms->max_len = a_len;
+    return 0;
+}
+
+/**
+ * \ingroup baselib
+ * Compile the patterns of a set.  No patterns can be added afterwards.
+ * @param a_ms Pattern set
+ * @returns 1 on error
+ */
+uint8_t
+tsk_msearch_compile(TSK_MSEARCH * a_ms)
+{
+    if (a_ms->compiled)
+        return 0;
+
+    if (ms_build(a_ms, &a_ms->cs, 0) || ms_build(a_ms, &a_ms->ci, 1)) {
+        ms_free_ac(&a_ms->cs);
+        ms_free_ac(&a_ms->ci);
+        return 1;
+    }
+    a_ms->compiled = 1;
+    return 0;
+}
+
+/**
+ * \ingroup baselib
+ * Get the length of the longest pattern in a set.  Callers that need to
+ * look at the bytes of a match should keep at least this many bytes of
+ * the previous buffer when scanning a stream.
+ * @param a_ms Pattern set
+ * @returns Length in bytes
+ */
+size_t
+tsk_msearch_max_len(const TSK_MSEARCH * a_ms)
+{
+    return a_ms->max_len;
+}
+
+/**
+ * \ingroup baselib
+ * Set a search state to the start of a stream.
+ * @param a_state State to initialize
+ */
+void
+tsk_msearch_state_init(TSK_MSEARCH_STATE * a_state)
+{
+    a_state->cs_node = 0;
+    a_state->ci_node = 0;
+}
+
+/**
+ * \ingroup baselib
+ * Search a buffer for all of the patterns in a compiled set.  The buffer
+ * is treated as the continuation of the buffers that were previously
+ * scanned with the same state.
+ * @param a_ms Compiled pattern set
+ * @param a_state Search state, updated on return
+ * @param a_off Offset of the buffer in the stream (used to compute the
+ * offsets passed to the callback)
+ * @param a_buf Buffer to search
+ * @param a_len Number of bytes in the buffer
+ * @param a_action Callback called for each match
+ * @param a_ptr Pointer passed to the callback
+ * @returns TSK_WALK_CONT if the whole buffer was searched, otherwise the
+ * value returned by the callback that stopped the search
+ */
+TSK_WALK_RET_ENUM
+tsk_msearch_scan(const TSK_MSEARCH * a_ms, TSK_MSEARCH_STATE * a_state,
+    TSK_OFF_T a_off, const uint8_t * a_buf, size_t a_len,
+    TSK_MSEARCH_CB a_action, void *a_ptr)
+{
+    const TSK_MSEARCH_AC *cs = &a_ms->cs;
+    const TSK_MSEARCH_AC *ci = &a_ms->ci;
+    uint32_t cs_node = a_state->cs_node;
+    uint32_t ci_node = a_state->ci_node;
+    TSK_WALK_RET_ENUM retval = TSK_WALK_CONT;
+    size_t i;
+
+    if (!a_ms->compiled)
+        return TSK_WALK_ERROR;
+
+    /* The common cases of only one kind of pattern get their own loop so
+     * that the inner loop is a single table lookup. */
+    if (ci->num_nodes <= 1) {
+        for (i = 0; i < a_len; i++) {
+            /* From the root, skip the bytes that cannot start a pattern
+             * without walking the table. */
+            if (cs_node == 0) {
+                while ((i < a_len) && (cs->start[a_buf[i]] == 0))
+                    i++;
+                if (i == a_len)
+                    break;
+            }
+            cs_node = cs->delta[(size_t) cs_node * 256 + a_buf[i]];
+            if (cs->has_out[cs_node]) {
+                retval = ms_report(a_ms, cs, cs_node,
+                    a_off + (TSK_OFF_T) i + 1, a_action, a_ptr);
+                if (retval != TSK_WALK_CONT)
+                    break;
+            }
+        }
+    }
+    else if (cs->num_nodes <= 1) {
+        for (i = 0; i < a_len; i++) {
+            if (ci_node == 0) {
+                while ((i < a_len) && (ci->start[ms_fold(a_buf[i])] == 0))
+                    i++;
+                if (i == a_len)
+                    break;
+            }
+            ci_node = ci->delta[(size_t) ci_node * 256 + ms_fold(a_buf[i])];
+            if (ci->has_out[ci_node]) {
+                retval = ms_report(a_ms, ci, ci_node,
+                    a_off + (TSK_OFF_T) i + 1, a_action, a_ptr);
+                if (retval != TSK_WALK_CONT)
+                    break;
+            }
+        }
+    }
+    else {
+        for (i = 0; i < a_len; i++) {
+            if ((cs_node == 0) && (ci_node == 0)) {
+                while ((i < a_len) && (cs->start[a_buf[i]] == 0)
+                    && (ci->start[ms_fold(a_buf[i])] == 0))
+                    i++;
+                if (i == a_len)
+                    break;
+            }
+            cs_node = cs->delta[(size_t) cs_node * 256 + a_buf[i]];
+            ci_node = ci->delta[(size_t) ci_node * 256 + ms_fold(a_buf[i])];
+            if (cs->has_out[cs_node]) {
+                retval = ms_report(a_ms, cs, cs_node,
+                    a_off + (TSK_OFF_T) i + 1, a_action, a_ptr);
+                if (retval != TSK_WALK_CONT)
+                    break;
+            }
+            if (ci->has_out[ci_node]) {
+                retval = ms_report(a_ms, ci, ci_node,
+                    a_off + (TSK_OFF_T) i + 1, a_action, a_ptr);
+                if (retval != TSK_WALK_CONT)
+                    break;
+            }
+        }
+    }
+
+    a_state->cs_node = cs_node;
+    a_state->ci_node = ci_node;
+    return retval;
+}
+
+/**
+ * \ingroup baselib
+ * Free a pattern set.
+ * @param a_ms Pattern set to free
+ */
+void
+tsk_msearch_free(TSK_MSEARCH * a_ms)
+{
+    int i;
+
+    if (a_ms == NULL)
+        return;
+
+    for (i = 0; i < a_ms->num_pats; i++)
+        free(a_ms->pats[i].bytes);
+    free(a_ms->pats);
+    ms_free_ac(&a_ms->cs);
+    ms_free_ac(&a_ms->ci);
+    free(a_ms);
+}
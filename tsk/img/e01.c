@@ -0,0 +1,1142 @@
+/*
+ * Brian Carrier [carrier <at> sleuthkit [dot] org]
+ * Copyright (c) 2006-2016 Brian Carrier, Basis Technology.  All rights reserved
+ *
+ * This software is distributed under the Common Public License 1.0
+ *
+ */
+
+
+/** \file e01.c
+ * Internal code for TSK's own reader of Expert Witness (EnCase E01 and
+ * SMART S01) images.  The section tables of all of the segment files are
+ * read when the image is opened and turned into one index of where each
+ * chunk is stored.  A read then only has to read the chunk from its
+ * segment file and inflate it, so reads from several threads do not
+ * need a lock.  The index can be saved next to the image so that later
+ * opens do not have to read the section tables again.
+ */
+
+#include "tsk_img_i.h"
+
+#if HAVE_LIBZ
+#include "e01.h"
+#include <zlib.h>
+
+#ifndef TSK_WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+#define E01_FILE_HEADER_SIZE 13
+#define E01_SECTION_SIZE 76
+#define E01_TABLE_HEADER_SIZE 24
+#define E01_CHECKSUM_SIZE 4
+
+// Largest number of segment files (E01 to ZZZ)
+#define E01_MAX_SEGMENTS 14971
+
+static const uint8_t e01_signature[8] =
+    { 'E', 'V', 'F', 0x09, 0x0d, 0x0a, 0xff, 0x00 };
+
+// Whether index files are written (they are always read if they exist)
+static uint8_t e01_write_index = 0;
+
+#define E01_INDEX_MAGIC "TSKE01I1"
+#define E01_INDEX_HEADER_SIZE 112
+#define E01_INDEX_SEGMENT_SIZE 16
+#define E01_INDEX_CHUNK_SIZE 14
+#define E01_INDEX_EXT _TSK_T(".tskidx")
+
+#ifdef TSK_WIN32
+#define E01_FOPEN(a_path, a_mode) _wfopen(a_path, _TSK_T(a_mode))
+#else
+#define E01_FOPEN(a_path, a_mode) fopen(a_path, a_mode)
+#endif
+
+
+/**
+ * \ingroup imglib
+ * Set whether the built-in E01 reader saves the index of where each
+ * chunk is stored.  The index is written next to the first segment file
+ * (with .tskidx added to its name) and is used by later opens of the same
+ * segment files instead of reading their section tables.  Existing index
+ * files are always used if the segment files have not changed.
+ *
+ * @param a_write 1 to write index files, 0 to not (the default)
+ */
+void
+tsk_img_set_e01_index(uint8_t a_write)
+{
+    e01_write_index = a_write;
+}
+
+/**
+ * Read from a segment file at an offset without moving a shared file
+ * pointer, so several threads can read from the same file at once.
+ * @returns -1 on error or the number of bytes read
+ */
+static ssize_t
+e01_pread(E01_SEGMENT * a_seg, char *a_buf, size_t a_len, TSK_OFF_T a_off)
+{
+#ifdef TSK_WIN32
+    OVERLAPPED ov;
+    DWORD nread;
+
+    memset(&ov, 0, sizeof(ov));
+    ov.Offset = (DWORD) (a_off & 0xffffffff);
+    ov.OffsetHigh = (DWORD) (a_off >> 32);
+    if (FALSE == ReadFile(a_seg->fd, a_buf, (DWORD) a_len, &nread, &ov)) {
+        if (GetLastError() == ERROR_HANDLE_EOF)
+            return 0;
+        return -1;
+    }
+    return (ssize_t) nread;
+#else
+    size_t done = 0;
+
+    while (done < a_len) {
+        ssize_t cnt = pread(a_seg->fd, &a_buf[done], a_len - done,
+            (off_t) (a_off + done));
+        if (cnt < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (cnt == 0)
+            break;
+        done += cnt;
+    }
+    return (ssize_t) done;
+#endif
+}
+
+/**
+ * Read exactly a_len bytes from a segment file.
+ * @returns 1 on error (and sets tsk_error)
+ */
+static uint8_t
+e01_read_exact(IMG_E01_INFO * e01_info, int a_seg, char *a_buf,
+    size_t a_len, TSK_OFF_T a_off)
+{
+    ssize_t cnt =
+        e01_pread(&e01_info->segments[a_seg], a_buf, a_len, a_off);
+    if (cnt != (ssize_t) a_len) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_READ);
+        tsk_error_set_errstr("e01: segment %" PRIttocTSK " offset %"
+            PRIuOFF " length %" PRIuSIZE ": %s",
+            e01_info->img_info.images[a_seg], a_off, a_len,
+            (cnt < 0) ? strerror(errno) : "short read");
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Read a chunk and inflate it if it is compressed.
+ * @param a_out Buffer of at least chunk_size bytes for the media data
+ * @param a_tmp Buffer of at least max_stored bytes for compressed data
+ * @returns -1 on error or the number of bytes of media data
+ */
+static ssize_t
+e01_read_chunk(IMG_E01_INFO * e01_info, uint64_t a_chunk, char *a_out,
+    char *a_tmp)
+{
+    E01_CHUNK *chunk = &e01_info->chunks[a_chunk];
+    TSK_OFF_T chunk_off = (TSK_OFF_T) a_chunk * e01_info->chunk_size;
+    size_t want = e01_info->chunk_size;
+    uLongf out_len;
+    int zret;
+
+    if ((TSK_OFF_T) want > e01_info->img_info.size - chunk_off)
+        want = (size_t) (e01_info->img_info.size - chunk_off);
+
+    if (chunk->compressed == 0) {
+        // the media data is followed by its Adler-32 checksum
+        uint32_t stored;
+
+        if (chunk->size < want + E01_CHECKSUM_SIZE) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_IMG_READ);
+            tsk_error_set_errstr("e01: chunk %" PRIu64
+                " is too small (%" PRIu32 " bytes)", a_chunk, chunk->size);
+            return -1;
+        }
+        if (e01_read_exact(e01_info, chunk->segment, a_tmp,
+                want + E01_CHECKSUM_SIZE, chunk->offset))
+            return -1;
+        stored = tsk_getu32(TSK_LIT_ENDIAN, (uint8_t *) & a_tmp[want]);
+        if ((uint32_t) adler32(1, (Bytef *) a_tmp, (uInt) want) != stored) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_IMG_READ);
+            tsk_error_set_errstr("e01: checksum error in chunk %" PRIu64,
+                a_chunk);
+            return -1;
+        }
+        memcpy(a_out, a_tmp, want);
+        return (ssize_t) want;
+    }
+
+    if (e01_read_exact(e01_info, chunk->segment, a_tmp, chunk->size,
+            chunk->offset))
+        return -1;
+
+    // uncompress() checks the Adler-32 checksum at the end of the stream
+    out_len = e01_info->chunk_size;
+    zret = uncompress((Bytef *) a_out, &out_len, (Bytef *) a_tmp,
+        chunk->size);
+    if (zret != Z_OK) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_READ);
+        tsk_error_set_errstr("e01: error inflating chunk %" PRIu64
+            " (zlib error %d)", a_chunk, zret);
+        return -1;
+    }
+    if (out_len > want)
+        out_len = (uLongf) want;
+    return (ssize_t) out_len;
+}
+
+static ssize_t
+e01_image_read(TSK_IMG_INFO * img_info, TSK_OFF_T offset, char *buf,
+    size_t len)
+{
+    IMG_E01_INFO *e01_info = (IMG_E01_INFO *) img_info;
+    size_t chunk_size = e01_info->chunk_size;
+    char *chunk_buf = NULL;
+    char *tmp_buf = NULL;
+    size_t done = 0;
+
+    if (tsk_verbose)
+        tsk_fprintf(stderr,
+            "e01_image_read: byte offset: %" PRIuOFF " len: %" PRIuSIZE
+            "\n", offset, len);
+
+    if (offset > img_info->size) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_READ_OFF);
+        tsk_error_set_errstr("e01_image_read - %" PRIuOFF, offset);
+        return -1;
+    }
+    if ((TSK_OFF_T) len > img_info->size - offset)
+        len = (size_t) (img_info->size - offset);
+
+    if ((tmp_buf = (char *) tsk_malloc(e01_info->max_stored)) == NULL)
+        return -1;
+
+    while (done < len) {
+        TSK_OFF_T cur_off = offset + (TSK_OFF_T) done;
+        uint64_t chunk = (uint64_t) (cur_off / chunk_size);
+        size_t rel_off = (size_t) (cur_off % chunk_size);
+        size_t cnt = chunk_size - rel_off;
+        ssize_t retval;
+
+        if (cnt > len - done)
+            cnt = len - done;
+
+        if (chunk >= e01_info->num_chunks) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_IMG_READ);
+            tsk_error_set_errstr("e01_image_read - chunk %" PRIu64
+                " is not in the image", chunk);
+            free(chunk_buf);
+            free(tmp_buf);
+            return -1;
+        }
+
+        // whole chunks go straight to the caller's buffer
+        if ((rel_off == 0) && (cnt == chunk_size)) {
+            retval = e01_read_chunk(e01_info, chunk, &buf[done], tmp_buf);
+            if (retval < 0) {
+                free(chunk_buf);
+                free(tmp_buf);
+                return -1;
+            }
+            done += retval;
+            if ((size_t) retval < cnt)
+                break;
+            continue;
+        }
+
+        if ((chunk_buf == NULL)
+            && ((chunk_buf = (char *) tsk_malloc(chunk_size)) == NULL)) {
+            free(tmp_buf);
+            return -1;
+        }
+        retval = e01_read_chunk(e01_info, chunk, chunk_buf, tmp_buf);
+        if (retval < 0) {
+            free(chunk_buf);
+            free(tmp_buf);
+            return -1;
+        }
+        if ((size_t) retval < rel_off + cnt) {
+            if ((size_t) retval > rel_off) {
+                memcpy(&buf[done], &chunk_buf[rel_off], retval - rel_off);
+                done += retval - rel_off;
+            }
+            break;
+        }
+        memcpy(&buf[done], &chunk_buf[rel_off], cnt);
+        done += cnt;
+    }
+
+    free(chunk_buf);
+    free(tmp_buf);
+    return (ssize_t) done;
+}
+
+static void
+e01_image_imgstat(TSK_IMG_INFO * img_info, FILE * hFile)
+{
+    IMG_E01_INFO *e01_info = (IMG_E01_INFO *) img_info;
+
+    tsk_fprintf(hFile, "IMAGE FILE INFORMATION\n");
+    tsk_fprintf(hFile, "--------------------------------------------\n");
+    tsk_fprintf(hFile, "Image Type:\t\te01\n");
+    tsk_fprintf(hFile, "\nSize of data in bytes:\t%" PRIuOFF "\n",
+        img_info->size);
+    tsk_fprintf(hFile, "Sector size:\t%d\n", img_info->sector_size);
+    tsk_fprintf(hFile, "Segment files:\t%d\n", img_info->num_img);
+    tsk_fprintf(hFile, "Chunk size:\t%" PRIu32 "\n", e01_info->chunk_size);
+    tsk_fprintf(hFile, "Chunks:\t\t%" PRIu64 "\n", e01_info->num_chunks);
+
+    if (e01_info->md5hash_isset == 1) {
+        tsk_fprintf(hFile, "MD5 hash of data:\t%s\n", e01_info->md5hash);
+    }
+    if (e01_info->sha1hash_isset == 1) {
+        tsk_fprintf(hFile, "SHA1 hash of data:\t%s\n", e01_info->sha1hash);
+    }
+    return;
+}
+
+static void
+e01_image_close(TSK_IMG_INFO * img_info)
+{
+    IMG_E01_INFO *e01_info = (IMG_E01_INFO *) img_info;
+    int i;
+
+    if (e01_info->segments) {
+        for (i = 0; i < img_info->num_img; i++) {
+#ifdef TSK_WIN32
+            if (e01_info->segments[i].fd != INVALID_HANDLE_VALUE)
+                CloseHandle(e01_info->segments[i].fd);
+#else
+            if (e01_info->segments[i].fd >= 0)
+                close(e01_info->segments[i].fd);
+#endif
+        }
+        free(e01_info->segments);
+    }
+    free(e01_info->chunks);
+
+    if (img_info->images) {
+        for (i = 0; i < img_info->num_img; i++) {
+            free(img_info->images[i]);
+        }
+        free(img_info->images);
+    }
+
+    tsk_img_free(e01_info);
+}
+
+/**
+ * Make the name of a segment file from the name of the first one.  The
+ * extensions go from E01 to E99 and then from EAA to ZZZ (or from s01
+ * for SMART images).
+ * @param a_name Name of the first segment file; the last three
+ * characters are replaced
+ * @param a_num Segment number (1 for the first)
+ * @returns 1 if there can not be a segment with that number
+ */
+static uint8_t
+e01_segment_name(TSK_TCHAR * a_name, int a_num)
+{
+    size_t len = TSTRLEN(a_name);
+    TSK_TCHAR first = a_name[len - 3];
+    TSK_TCHAR letter_a = ((first >= 'a') && (first <= 'z')) ? 'a' : 'A';
+
+    if (a_num <= 99) {
+        a_name[len - 2] = (TSK_TCHAR) ('0' + a_num / 10);
+        a_name[len - 1] = (TSK_TCHAR) ('0' + a_num % 10);
+        return 0;
+    }
+
+    a_num -= 100;
+    first = (TSK_TCHAR) (first + a_num / (26 * 26));
+    if (first > letter_a + 25)
+        return 1;
+    a_name[len - 3] = first;
+    a_name[len - 2] = (TSK_TCHAR) (letter_a + (a_num / 26) % 26);
+    a_name[len - 1] = (TSK_TCHAR) (letter_a + a_num % 26);
+    return 0;
+}
+
+/**
+ * Find the segment files of an image from the name of the first one.
+ * @returns 1 on error
+ */
+static uint8_t
+e01_find_segments(IMG_E01_INFO * e01_info, const TSK_TCHAR * a_first)
+{
+    TSK_IMG_INFO *img_info = (TSK_IMG_INFO *) e01_info;
+    size_t len = TSTRLEN(a_first);
+    int num_alloc = 16;
+    int i;
+
+    if ((img_info->images =
+            (TSK_TCHAR **) tsk_malloc(num_alloc *
+                sizeof(TSK_TCHAR *))) == NULL)
+        return 1;
+    if ((img_info->images[0] =
+            (TSK_TCHAR *) tsk_malloc((len + 1) * sizeof(TSK_TCHAR))) ==
+        NULL)
+        return 1;
+    TSTRNCPY(img_info->images[0], a_first, len + 1);
+    img_info->num_img = 1;
+
+    // only names that end in .E01 or .s01 have more segments
+    if ((len < 4) || (a_first[len - 4] != '.')
+        || ((a_first[len - 3] != 'E') && (a_first[len - 3] != 'e')
+            && (a_first[len - 3] != 'S') && (a_first[len - 3] != 's'))
+        || (a_first[len - 2] != '0') || (a_first[len - 1] != '1'))
+        return 0;
+
+    for (i = 2; i <= E01_MAX_SEGMENTS; i++) {
+        struct STAT_STR stat_buf;
+        TSK_TCHAR *name;
+
+        if ((name =
+                (TSK_TCHAR *) tsk_malloc((len + 1) * sizeof(TSK_TCHAR))) ==
+            NULL)
+            return 1;
+        TSTRNCPY(name, a_first, len + 1);
+        if (e01_segment_name(name, i) || (TSTAT(name, &stat_buf) < 0)) {
+            free(name);
+            break;
+        }
+
+        if (img_info->num_img == num_alloc) {
+            TSK_TCHAR **tmp;
+            num_alloc *= 2;
+            if ((tmp = (TSK_TCHAR **) tsk_realloc(img_info->images,
+                        num_alloc * sizeof(TSK_TCHAR *))) == NULL) {
+                free(name);
+                return 1;
+            }
+            img_info->images = tmp;
+        }
+        img_info->images[img_info->num_img++] = name;
+    }
+
+    if (tsk_verbose)
+        tsk_fprintf(stderr, "e01_find_segments: found %d segment files\n",
+            img_info->num_img);
+    return 0;
+}
+
+/**
+ * Open the segment files and check their signatures and numbers.
+ * @returns 1 on error
+ */
+static uint8_t
+e01_open_segments(IMG_E01_INFO * e01_info)
+{
+    TSK_IMG_INFO *img_info = (TSK_IMG_INFO *) e01_info;
+    int i;
+
+    if ((e01_info->segments =
+            (E01_SEGMENT *) tsk_malloc(img_info->num_img *
+                sizeof(E01_SEGMENT))) == NULL)
+        return 1;
+    for (i = 0; i < img_info->num_img; i++) {
+#ifdef TSK_WIN32
+        e01_info->segments[i].fd = INVALID_HANDLE_VALUE;
+#else
+        e01_info->segments[i].fd = -1;
+#endif
+    }
+
+    for (i = 0; i < img_info->num_img; i++) {
+        E01_SEGMENT *seg = &e01_info->segments[i];
+        struct STAT_STR stat_buf;
+        uint8_t header[E01_FILE_HEADER_SIZE];
+
+        if (TSTAT(img_info->images[i], &stat_buf) < 0) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_IMG_STAT);
+            tsk_error_set_errstr("e01_open: %" PRIttocTSK " - %s",
+                img_info->images[i], strerror(errno));
+            return 1;
+        }
+        seg->size = stat_buf.st_size;
+        seg->mtime = stat_buf.st_mtime;
+
+#ifdef TSK_WIN32
+        seg->fd = CreateFile(img_info->images[i], FILE_READ_DATA,
+            FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0,
+            NULL);
+        if (seg->fd == INVALID_HANDLE_VALUE) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_IMG_OPEN);
+            tsk_error_set_errstr("e01_open: file: %" PRIttocTSK
+                ": (error %d)", img_info->images[i], (int) GetLastError());
+            return 1;
+        }
+#else
+        if ((seg->fd = open(img_info->images[i], O_RDONLY | O_BINARY)) < 0) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_IMG_OPEN);
+            tsk_error_set_errstr("e01_open: file: %" PRIttocTSK ": %s",
+                img_info->images[i], strerror(errno));
+            return 1;
+        }
+#endif
+
+        if (e01_pread(seg, (char *) header, sizeof(header),
+                0) != sizeof(header)
+            || memcmp(header, e01_signature, sizeof(e01_signature))) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_IMG_MAGIC);
+            tsk_error_set_errstr("e01_open: Not an E01 segment file: %"
+                PRIttocTSK, img_info->images[i]);
+            return 1;
+        }
+        if (tsk_getu16(TSK_LIT_ENDIAN, &header[9]) != i + 1) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_IMG_OPEN);
+            tsk_error_set_errstr("e01_open: %" PRIttocTSK
+                " is segment %d, expected %d", img_info->images[i],
+                tsk_getu16(TSK_LIT_ENDIAN, &header[9]), i + 1);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Add room for more chunks to the index.
+ * @returns 1 on error
+ */
+static uint8_t
+e01_grow_chunks(IMG_E01_INFO * e01_info, uint64_t * a_alloc,
+    uint64_t a_needed)
+{
+    E01_CHUNK *tmp;
+
+    if (a_needed <= *a_alloc)
+        return 0;
+    while (*a_alloc < a_needed)
+        *a_alloc = (*a_alloc == 0) ? 16384 : *a_alloc * 2;
+    if (*a_alloc > SIZE_MAX / sizeof(E01_CHUNK)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_OPEN);
+        tsk_error_set_errstr("e01_open: too many chunks (%" PRIu64 ")",
+            a_needed);
+        return 1;
+    }
+    if ((tmp = (E01_CHUNK *) tsk_realloc(e01_info->chunks,
+                (size_t) (*a_alloc * sizeof(E01_CHUNK)))) == NULL)
+        return 1;
+    e01_info->chunks = tmp;
+    return 0;
+}
+
+/**
+ * Add the chunks in a table section to the index.
+ * @param a_sect_off Offset of the table section descriptor
+ * @param a_sect_end Offset of the end of the table section (no more than
+ * the size of the segment file)
+ * @param a_data_end Offset of the end of the chunk data (the end of the
+ * sectors section), or 0 if there was no sectors section
+ * @returns 1 on error
+ */
+static uint8_t
+e01_load_table(IMG_E01_INFO * e01_info, int a_seg, TSK_OFF_T a_sect_off,
+    TSK_OFF_T a_sect_end, TSK_OFF_T a_data_start, TSK_OFF_T a_data_end,
+    uint64_t * a_alloc)
+{
+    uint8_t header[E01_TABLE_HEADER_SIZE];
+    uint8_t *entries;
+    uint32_t num_entries;
+    uint64_t table_len;
+    uint64_t base;
+    uint64_t first = e01_info->num_chunks;
+    uint8_t overflow = 0;
+    uint32_t i;
+
+    if (a_sect_end < a_sect_off + E01_SECTION_SIZE + E01_TABLE_HEADER_SIZE) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_OPEN);
+        tsk_error_set_errstr("e01_open: %" PRIttocTSK
+            ": table at %" PRIuOFF " is too small",
+            e01_info->img_info.images[a_seg], a_sect_off);
+        return 1;
+    }
+    if (e01_read_exact(e01_info, a_seg, (char *) header, sizeof(header),
+            a_sect_off + E01_SECTION_SIZE))
+        return 1;
+    num_entries = tsk_getu32(TSK_LIT_ENDIAN, &header[0]);
+    base = tsk_getu64(TSK_LIT_ENDIAN, &header[8]);
+
+    // the entries must fit in the section (and in a size_t)
+    table_len = (uint64_t) num_entries * 4;
+    if ((table_len > (uint64_t) (a_sect_end - a_sect_off -
+                E01_SECTION_SIZE - E01_TABLE_HEADER_SIZE))
+        || (table_len > SIZE_MAX)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_OPEN);
+        tsk_error_set_errstr("e01_open: %" PRIttocTSK
+            ": table at %" PRIuOFF " has too many entries (%" PRIu32 ")",
+            e01_info->img_info.images[a_seg], a_sect_off, num_entries);
+        return 1;
+    }
+    if (num_entries == 0)
+        return 0;
+
+    if ((entries = (uint8_t *) tsk_malloc((size_t) table_len)) == NULL)
+        return 1;
+    if (e01_read_exact(e01_info, a_seg, (char *) entries,
+            (size_t) table_len,
+            a_sect_off + E01_SECTION_SIZE + E01_TABLE_HEADER_SIZE)
+        || e01_grow_chunks(e01_info, a_alloc, first + num_entries)) {
+        free(entries);
+        return 1;
+    }
+
+    for (i = 0; i < num_entries; i++) {
+        E01_CHUNK *chunk = &e01_info->chunks[first + i];
+        uint32_t value =
+            tsk_getu32(TSK_LIT_ENDIAN, &entries[(size_t) i * 4]);
+
+        chunk->segment = (uint16_t) a_seg;
+        // Segment files larger than 2GB can have offsets that use the
+        // compressed flag bit.  Once an offset gets that large, the rest
+        // of the table is read as plain offsets (as libewf does) and
+        // whether they are compressed is worked out from their size.
+        if (overflow == 0) {
+            chunk->compressed = (uint8_t) (value >> 31);
+            value &= 0x7fffffff;
+            if ((uint64_t) value + e01_info->chunk_size > 0x7fffffff)
+                overflow = 1;
+        }
+        else {
+            chunk->compressed = 2;
+        }
+        chunk->offset = base + value;
+    }
+    free(entries);
+
+    // the size of a chunk is the distance to the next one; the last one
+    // ends at the end of the chunk data
+    for (i = 0; i < num_entries; i++) {
+        E01_CHUNK *chunk = &e01_info->chunks[first + i];
+        uint64_t end;
+
+        if (i + 1 < num_entries)
+            end = e01_info->chunks[first + i + 1].offset;
+        else if ((a_data_end > 0) && ((TSK_OFF_T) chunk->offset >= a_data_start)
+            && ((TSK_OFF_T) chunk->offset < a_data_end))
+            end = a_data_end;
+        else
+            end = a_sect_end;
+
+        if ((end <= chunk->offset)
+            || (end - chunk->offset > e01_info->chunk_size * 2 + 1024)) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_IMG_OPEN);
+            tsk_error_set_errstr("e01_open: %" PRIttocTSK
+                ": invalid offset for chunk %" PRIu64,
+                e01_info->img_info.images[a_seg], first + i);
+            return 1;
+        }
+        chunk->size = (uint32_t) (end - chunk->offset);
+
+        if (chunk->compressed == 2)
+            chunk->compressed =
+                (chunk->size != e01_info->chunk_size + E01_CHECKSUM_SIZE);
+    }
+
+    e01_info->num_chunks += num_entries;
+    return 0;
+}
+
+/** Make a hex string from a hash. */
+static void
+e01_hash_to_string(const uint8_t * a_hash, size_t a_len, char *a_str)
+{
+    static const char hex[] = "0123456789abcdef";
+    size_t i;
+
+    for (i = 0; i < a_len; i++) {
+        a_str[i * 2] = hex[a_hash[i] >> 4];
+        a_str[i * 2 + 1] = hex[a_hash[i] & 0xf];
+    }
+    a_str[a_len * 2] = '\0';
+}
+
+/**
+ * Read the media information and the chunk tables from the section
+ * lists of the segment files.
+ * @returns 1 on error
+ */
+static uint8_t
+e01_load_sections(IMG_E01_INFO * e01_info)
+{
+    TSK_IMG_INFO *img_info = (TSK_IMG_INFO *) e01_info;
+    uint64_t num_alloc = 0;
+    uint64_t sector_count = 0;
+    uint8_t have_volume = 0;
+    int seg;
+
+    for (seg = 0; seg < img_info->num_img; seg++) {
+        TSK_OFF_T sect_off = E01_FILE_HEADER_SIZE;
+        TSK_OFF_T data_start = 0;
+        TSK_OFF_T data_end = 0;
+
+        while (1) {
+            uint8_t desc[E01_SECTION_SIZE];
+            char type[17];
+            uint64_t next;
+            uint64_t size;
+
+            if (e01_read_exact(e01_info, seg, (char *) desc, sizeof(desc),
+                    sect_off))
+                return 1;
+            memcpy(type, desc, 16);
+            type[16] = '\0';
+            next = tsk_getu64(TSK_LIT_ENDIAN, &desc[16]);
+            size = tsk_getu64(TSK_LIT_ENDIAN, &desc[24]);
+
+            // the size is not trusted past the end of the segment file
+            if (size > (uint64_t) (e01_info->segments[seg].size - sect_off))
+                size = (uint64_t) (e01_info->segments[seg].size - sect_off);
+
+            if (tsk_verbose)
+                tsk_fprintf(stderr,
+                    "e01_load_sections: segment %d section %s at %"
+                    PRIuOFF " size %" PRIu64 "\n", seg + 1, type,
+                    sect_off, size);
+
+            if ((strcmp(type, "volume") == 0) || (strcmp(type, "disk") == 0)
+                || ((strcmp(type, "data") == 0) && (have_volume == 0))) {
+                uint8_t volume[24];
+                if (e01_read_exact(e01_info, seg, (char *) volume,
+                        sizeof(volume), sect_off + E01_SECTION_SIZE))
+                    return 1;
+                e01_info->bytes_per_sector =
+                    tsk_getu32(TSK_LIT_ENDIAN, &volume[12]);
+                e01_info->chunk_size =
+                    tsk_getu32(TSK_LIT_ENDIAN,
+                    &volume[8]) * e01_info->bytes_per_sector;
+                // SMART volume sections only have 32 bits for the count
+                if (size < 1000)
+                    sector_count = tsk_getu32(TSK_LIT_ENDIAN, &volume[16]);
+                else
+                    sector_count = tsk_getu64(TSK_LIT_ENDIAN, &volume[16]);
+                if ((e01_info->chunk_size == 0)
+                    || (e01_info->chunk_size > 64 * 1024 * 1024)) {
+                    tsk_error_reset();
+                    tsk_error_set_errno(TSK_ERR_IMG_OPEN);
+                    tsk_error_set_errstr
+                        ("e01_open: invalid chunk size (%" PRIu32 ")",
+                        e01_info->chunk_size);
+                    return 1;
+                }
+                have_volume = 1;
+            }
+            else if (strcmp(type, "sectors") == 0) {
+                data_start = sect_off + E01_SECTION_SIZE;
+                data_end = sect_off + size;
+            }
+            else if (strcmp(type, "table") == 0) {
+                if (have_volume == 0) {
+                    tsk_error_reset();
+                    tsk_error_set_errno(TSK_ERR_IMG_OPEN);
+                    tsk_error_set_errstr
+                        ("e01_open: chunk table before volume section");
+                    return 1;
+                }
+                if (e01_load_table(e01_info, seg, sect_off,
+                        sect_off + size, data_start, data_end, &num_alloc))
+                    return 1;
+            }
+            else if ((strcmp(type, "hash") == 0)
+                || (strcmp(type, "digest") == 0)) {
+                uint8_t hashes[36];
+                size_t hash_len = (strcmp(type, "hash") == 0) ? 16 : 36;
+                if (e01_read_exact(e01_info, seg, (char *) hashes,
+                        hash_len, sect_off + E01_SECTION_SIZE))
+                    return 1;
+                e01_hash_to_string(hashes, 16, e01_info->md5hash);
+                e01_info->md5hash_isset = 1;
+                if (hash_len == 36) {
+                    e01_hash_to_string(&hashes[16], 20, e01_info->sha1hash);
+                    e01_info->sha1hash_isset = 1;
+                }
+            }
+
+            if ((strcmp(type, "done") == 0) || (strcmp(type, "next") == 0)
+                || (next <= (uint64_t) sect_off)
+                || (next >= (uint64_t) e01_info->segments[seg].size))
+                break;
+            sect_off = (TSK_OFF_T) next;
+        }
+    }
+
+    if (have_volume == 0) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_OPEN);
+        tsk_error_set_errstr("e01_open: no volume section");
+        return 1;
+    }
+
+    img_info->size = (TSK_OFF_T) (sector_count * e01_info->bytes_per_sector);
+    return 0;
+}
+
+/** Build the name of the index file of an image. */
+static TSK_TCHAR *
+e01_index_name(IMG_E01_INFO * e01_info)
+{
+    const TSK_TCHAR *first = e01_info->img_info.images[0];
+    size_t len = TSTRLEN(first) + TSTRLEN(E01_INDEX_EXT) + 1;
+    TSK_TCHAR *name;
+
+    if ((name = (TSK_TCHAR *) tsk_malloc(len * sizeof(TSK_TCHAR))) == NULL)
+        return NULL;
+    TSTRNCPY(name, first, len);
+    TSTRNCAT(name, E01_INDEX_EXT, len - TSTRLEN(name));
+    return name;
+}
+
+static void
+e01_put32(uint8_t * a_buf, uint32_t a_val)
+{
+    int i;
+    for (i = 0; i < 4; i++)
+        a_buf[i] = (uint8_t) (a_val >> (8 * i));
+}
+
+static void
+e01_put64(uint8_t * a_buf, uint64_t a_val)
+{
+    int i;
+    for (i = 0; i < 8; i++)
+        a_buf[i] = (uint8_t) (a_val >> (8 * i));
+}
+
+/**
+ * Load the chunk index from the index file if there is one and it was
+ * made from segment files of the same sizes and times.
+ * @returns 1 if the index was not loaded
+ */
+static uint8_t
+e01_load_index(IMG_E01_INFO * e01_info)
+{
+    TSK_IMG_INFO *img_info = (TSK_IMG_INFO *) e01_info;
+    uint8_t header[E01_INDEX_HEADER_SIZE];
+    uint8_t *buf = NULL;
+    TSK_TCHAR *name;
+    FILE *hFile;
+    uint64_t num_chunks;
+    uint64_t i;
+    int seg;
+
+    if ((name = e01_index_name(e01_info)) == NULL) {
+        tsk_error_reset();
+        return 1;
+    }
+    hFile = E01_FOPEN(name, "rb");
+    free(name);
+    if (hFile == NULL)
+        return 1;
+
+    if ((fread(header, sizeof(header), 1, hFile) != 1)
+        || (memcmp(header, E01_INDEX_MAGIC, 8) != 0)
+        || (tsk_getu32(TSK_LIT_ENDIAN, &header[8]) != (uint32_t) img_info->num_img))
+        goto fail;
+
+    e01_info->chunk_size = tsk_getu32(TSK_LIT_ENDIAN, &header[12]);
+    e01_info->bytes_per_sector = tsk_getu32(TSK_LIT_ENDIAN, &header[16]);
+    img_info->size = (TSK_OFF_T) tsk_getu64(TSK_LIT_ENDIAN, &header[20]);
+    num_chunks = tsk_getu64(TSK_LIT_ENDIAN, &header[28]);
+    if ((e01_info->chunk_size == 0)
+        || (e01_info->chunk_size > 64 * 1024 * 1024)
+        || (num_chunks > ((uint64_t) img_info->size / e01_info->chunk_size) + 1))
+        goto fail;
+
+    for (seg = 0; seg < img_info->num_img; seg++) {
+        uint8_t seg_buf[E01_INDEX_SEGMENT_SIZE];
+        if ((fread(seg_buf, sizeof(seg_buf), 1, hFile) != 1)
+            || ((TSK_OFF_T) tsk_getu64(TSK_LIT_ENDIAN, &seg_buf[0]) !=
+                e01_info->segments[seg].size)
+            || ((int64_t) tsk_getu64(TSK_LIT_ENDIAN, &seg_buf[8]) !=
+                e01_info->segments[seg].mtime))
+            goto fail;
+    }
+
+    if (((e01_info->chunks =
+                (E01_CHUNK *) tsk_malloc((size_t) (num_chunks + 1) *
+                    sizeof(E01_CHUNK))) == NULL)
+        || ((buf =
+                (uint8_t *) tsk_malloc((size_t) (num_chunks + 1) *
+                    E01_INDEX_CHUNK_SIZE)) == NULL)) {
+        tsk_error_reset();
+        goto fail;
+    }
+    if ((num_chunks > 0)
+        && (fread(buf, E01_INDEX_CHUNK_SIZE, (size_t) num_chunks,
+                hFile) != (size_t) num_chunks))
+        goto fail;
+
+    for (i = 0; i < num_chunks; i++) {
+        E01_CHUNK *chunk = &e01_info->chunks[i];
+        uint8_t *entry = &buf[i * E01_INDEX_CHUNK_SIZE];
+        uint64_t value = tsk_getu64(TSK_LIT_ENDIAN, &entry[0]);
+
+        chunk->offset = value & 0x7fffffffffffffffULL;
+        chunk->compressed = (uint8_t) (value >> 63);
+        chunk->size = tsk_getu32(TSK_LIT_ENDIAN, &entry[8]);
+        chunk->segment = tsk_getu16(TSK_LIT_ENDIAN, &entry[12]);
+        if ((chunk->segment >= img_info->num_img)
+            || (chunk->size > e01_info->chunk_size * 2 + 1024))
+            goto fail;
+    }
+    e01_info->num_chunks = num_chunks;
+
+    // the hashes are stored as the strings that are reported
+    if (header[36] & 1) {
+        memcpy(e01_info->md5hash, &header[37], 32);
+        e01_info->md5hash[32] = '\0';
+        e01_info->md5hash_isset = 1;
+    }
+    if (header[36] & 2) {
+        memcpy(e01_info->sha1hash, &header[69], 40);
+        e01_info->sha1hash[40] = '\0';
+        e01_info->sha1hash_isset = 1;
+    }
+
+    free(buf);
+    fclose(hFile);
+    return 0;
+
+  fail:
+    if (tsk_verbose)
+        tsk_fprintf(stderr, "e01_load_index: index file not used\n");
+    free(buf);
+    free(e01_info->chunks);
+    e01_info->chunks = NULL;
+    e01_info->num_chunks = 0;
+    fclose(hFile);
+    return 1;
+}
+
+/**
+ * Save the chunk index to the index file.  Errors are only reported in
+ * verbose mode since the image can be used without it.
+ */
+static void
+e01_save_index(IMG_E01_INFO * e01_info)
+{
+    TSK_IMG_INFO *img_info = (TSK_IMG_INFO *) e01_info;
+    uint8_t header[E01_INDEX_HEADER_SIZE];
+    uint8_t *buf;
+    TSK_TCHAR *name;
+    FILE *hFile;
+    uint64_t i;
+    int seg;
+    uint8_t failed = 0;
+
+    if ((name = e01_index_name(e01_info)) == NULL) {
+        tsk_error_reset();
+        return;
+    }
+    if ((hFile = E01_FOPEN(name, "wb")) == NULL) {
+        if (tsk_verbose)
+            tsk_fprintf(stderr,
+                "e01_save_index: error creating index file: %s\n",
+                strerror(errno));
+        free(name);
+        return;
+    }
+
+    memset(header, 0, sizeof(header));
+    memcpy(header, E01_INDEX_MAGIC, 8);
+    e01_put32(&header[8], (uint32_t) img_info->num_img);
+    e01_put32(&header[12], e01_info->chunk_size);
+    e01_put32(&header[16], e01_info->bytes_per_sector);
+    e01_put64(&header[20], (uint64_t) img_info->size);
+    e01_put64(&header[28], e01_info->num_chunks);
+    if (e01_info->md5hash_isset) {
+        header[36] |= 1;
+        memcpy(&header[37], e01_info->md5hash, 32);
+    }
+    if (e01_info->sha1hash_isset) {
+        header[36] |= 2;
+        memcpy(&header[69], e01_info->sha1hash, 40);
+    }
+    if (fwrite(header, sizeof(header), 1, hFile) != 1)
+        failed = 1;
+
+    for (seg = 0; (seg < img_info->num_img) && (failed == 0); seg++) {
+        uint8_t seg_buf[E01_INDEX_SEGMENT_SIZE];
+        e01_put64(&seg_buf[0], (uint64_t) e01_info->segments[seg].size);
+        e01_put64(&seg_buf[8], (uint64_t) e01_info->segments[seg].mtime);
+        if (fwrite(seg_buf, sizeof(seg_buf), 1, hFile) != 1)
+            failed = 1;
+    }
+
+    // write the chunks a block at a time
+    if ((buf = (uint8_t *) tsk_malloc(4096 * E01_INDEX_CHUNK_SIZE)) == NULL) {
+        tsk_error_reset();
+        failed = 1;
+    }
+    for (i = 0; (i < e01_info->num_chunks) && (failed == 0);) {
+        size_t cnt = 0;
+        for (; (i < e01_info->num_chunks) && (cnt < 4096); i++, cnt++) {
+            E01_CHUNK *chunk = &e01_info->chunks[i];
+            uint8_t *entry = &buf[cnt * E01_INDEX_CHUNK_SIZE];
+            e01_put64(&entry[0],
+                chunk->offset | ((uint64_t) chunk->compressed << 63));
+            e01_put32(&entry[8], chunk->size);
+            entry[12] = (uint8_t) (chunk->segment & 0xff);
+            entry[13] = (uint8_t) (chunk->segment >> 8);
+        }
+        if (fwrite(buf, E01_INDEX_CHUNK_SIZE, cnt, hFile) != cnt)
+            failed = 1;
+    }
+    free(buf);
+
+    if (fclose(hFile) != 0)
+        failed = 1;
+    if (failed) {
+        if (tsk_verbose)
+            tsk_fprintf(stderr,
+                "e01_save_index: error writing index file\n");
+#ifdef TSK_WIN32
+        _wunlink(name);
+#else
+        unlink(name);
+#endif
+    }
+    free(name);
+}
+
+TSK_IMG_INFO *
+e01_open(int a_num_img, const TSK_TCHAR * const a_images[],
+    unsigned int a_ssize)
+{
+    IMG_E01_INFO *e01_info;
+    TSK_IMG_INFO *img_info;
+    uint8_t from_index = 0;
+    uint64_t needed;
+    uint64_t i;
+
+    if ((e01_info =
+            (IMG_E01_INFO *) tsk_img_malloc(sizeof(IMG_E01_INFO))) ==
+        NULL) {
+        return NULL;
+    }
+    img_info = (TSK_IMG_INFO *) e01_info;
+
+    if (a_num_img == 1) {
+        if (e01_find_segments(e01_info, a_images[0])) {
+            e01_image_close(img_info);
+            return NULL;
+        }
+    }
+    else {
+        int j;
+        if ((img_info->images =
+                (TSK_TCHAR **) tsk_malloc(a_num_img *
+                    sizeof(TSK_TCHAR *))) == NULL) {
+            tsk_img_free(e01_info);
+            return NULL;
+        }
+        for (j = 0; j < a_num_img; j++) {
+            size_t len = TSTRLEN(a_images[j]);
+            if ((img_info->images[j] =
+                    (TSK_TCHAR *) tsk_malloc((len +
+                            1) * sizeof(TSK_TCHAR))) == NULL) {
+                e01_image_close(img_info);
+                return NULL;
+            }
+            img_info->num_img = j + 1;
+            TSTRNCPY(img_info->images[j], a_images[j], len + 1);
+        }
+    }
+
+    if (img_info->num_img > E01_MAX_SEGMENTS) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_ARG);
+        tsk_error_set_errstr("e01_open: too many segment files (%d)",
+            img_info->num_img);
+        e01_image_close(img_info);
+        return NULL;
+    }
+
+    if (e01_open_segments(e01_info)) {
+        e01_image_close(img_info);
+        return NULL;
+    }
+
+    if (e01_load_index(e01_info) == 0) {
+        from_index = 1;
+        if (tsk_verbose)
+            tsk_fprintf(stderr, "e01_open: using index file\n");
+    }
+    else if (e01_load_sections(e01_info)) {
+        e01_image_close(img_info);
+        return NULL;
+    }
+
+    needed = ((uint64_t) img_info->size + e01_info->chunk_size - 1) /
+        e01_info->chunk_size;
+    if ((e01_info->num_chunks < needed) && (tsk_verbose))
+        tsk_fprintf(stderr,
+            "e01_open: image has %" PRIu64 " of %" PRIu64 " chunks\n",
+            e01_info->num_chunks, needed);
+
+    // compressed chunks are read into a buffer of this size
+    e01_info->max_stored = e01_info->chunk_size + E01_CHECKSUM_SIZE;
+    for (i = 0; i < e01_info->num_chunks; i++) {
+        if (e01_info->chunks[i].size > e01_info->max_stored)
+            e01_info->max_stored = e01_info->chunks[i].size;
+    }
+
+    if ((from_index == 0) && (e01_write_index))
+        e01_save_index(e01_info);
+
+    // use what they gave us
+    if (a_ssize != 0) {
+        img_info->sector_size = a_ssize;
+    }
+    else if ((e01_info->bytes_per_sector == 0)
+        || (e01_info->bytes_per_sector % 512)) {
+        img_info->sector_size = 512;
+    }
+    else {
+        img_info->sector_size = e01_info->bytes_per_sector;
+    }
+
+    img_info->itype = TSK_IMG_TYPE_EWF_NATIVE;
+    img_info->read = &e01_image_read;
+    img_info->close = &e01_image_close;
+    img_info->imgstat = &e01_image_imgstat;
+    // reads only use data that does not change
+    img_info->parallel_read = 1;
+
+    return img_info;
+}
+
+#else
+
+void
+tsk_img_set_e01_index(uint8_t a_write)
+{
+}
+
+#endif                          /* HAVE_LIBZ */
@@ -0,0 +1,65 @@
+/*
+ * Brian Carrier [carrier <at> sleuthkit [dot] org]
+ * Copyright (c) 2006-2016 Brian Carrier, Basis Technology.  All rights reserved
+ *
+ * This software is distributed under the Common Public License 1.0
+ *
+ */
+
+/*
+ * Header files for the built-in Expert Witness (E01) reader.
+ */
+
+#ifndef _TSK_IMG_E01_H
+#define _TSK_IMG_E01_H
+
+#if HAVE_LIBZ
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    extern TSK_IMG_INFO *e01_open(int, const TSK_TCHAR * const images[],
+        unsigned int a_ssize);
+
+    /* A segment file (.E01, .E02, ...) */
+    typedef struct {
+#ifdef TSK_WIN32
+        HANDLE fd;
+#else
+        int fd;
+#endif
+        TSK_OFF_T size;         ///< Size of the file in bytes
+        int64_t mtime;          ///< Modification time of the file (to check the index file)
+    } E01_SEGMENT;
+
+    /* Where a chunk of media data is stored */
+    typedef struct {
+        uint64_t offset;        ///< Offset of the chunk in its segment file
+        uint32_t size;          ///< Stored size (including the checksum of uncompressed chunks)
+        uint16_t segment;       ///< Index of the segment file
+        uint8_t compressed;     ///< 1 if the chunk is zlib compressed
+    } E01_CHUNK;
+
+    typedef struct {
+        TSK_IMG_INFO img_info;
+
+        // nothing below changes after e01_open, so reads do not lock
+        E01_SEGMENT *segments;
+        E01_CHUNK *chunks;      ///< Index of every chunk in the image
+        uint64_t num_chunks;
+        uint32_t chunk_size;    ///< Bytes of media data in a chunk
+        uint32_t max_stored;    ///< Largest stored size of a compressed chunk
+        uint32_t bytes_per_sector;      ///< Sector size stored in the image
+
+        char md5hash[33];
+        int md5hash_isset;
+        char sha1hash[41];
+        int sha1hash_isset;
+    } IMG_E01_INFO;
+
+#ifdef __cplusplus
+}
+#endif
+#endif
+#endif // _TSK_IMG_E01_H
@@ -18,6 +18,8 @@
 #if HAVE_LIBEWF
 #include "ewf.h"
 #include <cctype>
+#include <list>
+#include <map>
 
 using std::string;
 
@@ -41,34 +43,222 @@ getError(libewf_error_t * ewf_error,
 }
 #endif
 
-static ssize_t
-ewf_image_read(TSK_IMG_INFO * img_info, TSK_OFF_T offset, char *buf,
-    size_t len)
-{
 #if defined( HAVE_LIBEWF_V2_API )
+
+/**
+ * Decompressed EWF chunks that have been read, shared by all of the
+ * handles of an image.  The least recently used chunk is dropped when
+ * the cache is full.
+ */
+struct EWF_CHUNK_CACHE {
+    struct Entry {
+        char *data;
+        size_t len;
+        std::list < uint64_t >::iterator lru_pos;
+    };
+
+    tsk_lock_t lock;
+    size_t max_chunks;
+    std::map < uint64_t, Entry > entries;
+    std::list < uint64_t > lru;        // chunk numbers, most recently used first
+};
+
+static EWF_CHUNK_CACHE *
+ewf_cache_alloc(size_t a_max_chunks)
+{
+    EWF_CHUNK_CACHE *cache = new EWF_CHUNK_CACHE;
+    tsk_init_lock(&(cache->lock));
+    cache->max_chunks = a_max_chunks;
+    return cache;
+}
+
+static void
+ewf_cache_free(EWF_CHUNK_CACHE * a_cache)
+{
+    if (a_cache == NULL)
+        return;
+
+    for (std::map < uint64_t, EWF_CHUNK_CACHE::Entry >::iterator it =
+        a_cache->entries.begin(); it != a_cache->entries.end(); ++it) {
+        free(it->second.data);
+    }
+    tsk_deinit_lock(&(a_cache->lock));
+    delete a_cache;
+}
+
+/**
+ * Copy data from a chunk in the cache.
+ * @returns 1 if the chunk is in the cache and has all of the data, 0 if not
+ */
+static int
+ewf_cache_get(EWF_CHUNK_CACHE * a_cache, uint64_t a_chunk,
+    size_t a_rel_off, char *a_buf, size_t a_len)
+{
+    int found = 0;
+
+    tsk_take_lock(&(a_cache->lock));
+    std::map < uint64_t, EWF_CHUNK_CACHE::Entry >::iterator it =
+        a_cache->entries.find(a_chunk);
+    if ((it != a_cache->entries.end())
+        && (it->second.len >= a_rel_off + a_len)) {
+        memcpy(a_buf, &it->second.data[a_rel_off], a_len);
+        a_cache->lru.splice(a_cache->lru.begin(), a_cache->lru,
+            it->second.lru_pos);
+        found = 1;
+    }
+    tsk_release_lock(&(a_cache->lock));
+    return found;
+}
+
+/**
+ * Add a copy of a chunk to the cache.  Nothing is done if another
+ * thread has already added it.
+ */
+static void
+ewf_cache_put(EWF_CHUNK_CACHE * a_cache, uint64_t a_chunk,
+    const char *a_data, size_t a_len)
+{
+    char *data;
+
+    if (a_cache->max_chunks == 0)
+        return;
+
+    // copy it before taking the lock
+    if ((data = (char *) tsk_malloc(a_len)) == NULL) {
+        tsk_error_reset();
+        return;
+    }
+    memcpy(data, a_data, a_len);
+
+    tsk_take_lock(&(a_cache->lock));
+    if (a_cache->entries.find(a_chunk) != a_cache->entries.end()) {
+        tsk_release_lock(&(a_cache->lock));
+        free(data);
+        return;
+    }
+
+    while (a_cache->entries.size() >= a_cache->max_chunks) {
+        std::map < uint64_t, EWF_CHUNK_CACHE::Entry >::iterator old =
+            a_cache->entries.find(a_cache->lru.back());
+        free(old->second.data);
+        a_cache->entries.erase(old);
+        a_cache->lru.pop_back();
+    }
+
+    a_cache->lru.push_front(a_chunk);
+    EWF_CHUNK_CACHE::Entry & entry = a_cache->entries[a_chunk];
+    entry.data = data;
+    entry.len = a_len;
+    entry.lru_pos = a_cache->lru.begin();
+    tsk_release_lock(&(a_cache->lock));
+}
+
+/**
+ * Open another libewf handle on the segment files of an image.
+ * @returns 1 on error (and sets tsk_error)
+ */
+static uint8_t
+ewf_open_handle(IMG_EWF_INFO * ewf_info, libewf_handle_t ** a_handle)
+{
     char error_string[TSK_EWF_ERROR_STRING_SIZE];
     libewf_error_t *ewf_error = NULL;
+    libewf_handle_t *handle = NULL;
+    int is_error;
+
+    if (libewf_handle_initialize(&handle, &ewf_error) != 1) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_OPEN);
+        getError(ewf_error, error_string);
+        tsk_error_set_errstr("ewf_open_handle: Error initializing handle (%s)",
+            error_string);
+        libewf_error_free(&ewf_error);
+        return 1;
+    }
+#if defined( TSK_WIN32 )
+    is_error = (libewf_handle_open_wide(handle,
+            (wchar_t * const *) ewf_info->img_info.images,
+            ewf_info->img_info.num_img, LIBEWF_OPEN_READ, &ewf_error) != 1);
+#else
+    is_error = (libewf_handle_open(handle,
+            (char *const *) ewf_info->img_info.images,
+            ewf_info->img_info.num_img, LIBEWF_OPEN_READ, &ewf_error) != 1);
 #endif
+    if (is_error) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_OPEN);
+        getError(ewf_error, error_string);
+        tsk_error_set_errstr("ewf_open_handle: Error opening (%s)",
+            error_string);
+        libewf_error_free(&ewf_error);
+        libewf_handle_free(&handle, NULL);
+        return 1;
+    }
 
-    ssize_t cnt;
-    IMG_EWF_INFO *ewf_info = (IMG_EWF_INFO *) img_info;
+    *a_handle = handle;
+    return 0;
+}
 
-    if (tsk_verbose)
-        tsk_fprintf(stderr,
-            "ewf_image_read: byte offset: %" PRIuOFF " len: %" PRIuSIZE
-            "\n", offset, len);
+/**
+ * Read from the image with one of the handles in its pool.  An idle
+ * handle is used if there is one.  Otherwise, another handle is opened
+ * (up to max_handles) or the read waits for the handle with the fewest
+ * reads using it.  Since the decompression happens in libewf, reads with
+ * different handles are decompressed in parallel.
+ */
+static ssize_t
+ewf_read_handle(IMG_EWF_INFO * ewf_info, TSK_OFF_T offset, char *buf,
+    size_t len)
+{
+    char error_string[TSK_EWF_ERROR_STRING_SIZE];
+    libewf_error_t *ewf_error = NULL;
+    EWF_HANDLE_SLOT *slot = NULL;
+    ssize_t cnt;
+    int i;
 
-    if (offset > img_info->size) {
-        tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_IMG_READ_OFF);
-        tsk_error_set_errstr("ewf_image_read - %" PRIuOFF, offset);
-        return -1;
+    tsk_take_lock(&(ewf_info->pool_lock));
+    for (i = 0; i < ewf_info->num_handles; i++) {
+        if (ewf_info->slots[i].users == 0) {
+            slot = &(ewf_info->slots[i]);
+            break;
+        }
     }
+    // Opening is rare (at most max_handles times), so it is done while
+    // holding the pool lock to keep the bookkeeping simple.
+    if ((slot == NULL) && (ewf_info->num_handles < ewf_info->max_handles)) {
+        libewf_handle_t *handle = NULL;
+        if (ewf_open_handle(ewf_info, &handle)) {
+            if (tsk_verbose)
+                tsk_fprintf(stderr,
+                    "ewf_read_handle: Error opening handle %d, using %d handles: %s\n",
+                    ewf_info->num_handles + 1, ewf_info->num_handles,
+                    tsk_error_get());
+            tsk_error_reset();
+            ewf_info->max_handles = ewf_info->num_handles;
+        }
+        else {
+            slot = &(ewf_info->slots[ewf_info->num_handles++]);
+            slot->handle = handle;
+        }
+    }
+    if (slot == NULL) {
+        slot = &(ewf_info->slots[0]);
+        for (i = 1; i < ewf_info->num_handles; i++) {
+            if (ewf_info->slots[i].users < slot->users)
+                slot = &(ewf_info->slots[i]);
+        }
+    }
+    slot->users++;
+    tsk_release_lock(&(ewf_info->pool_lock));
 
-    tsk_take_lock(&(ewf_info->read_lock));
-#if defined( HAVE_LIBEWF_V2_API )
-    cnt = libewf_handle_read_random(ewf_info->handle,
+    tsk_take_lock(&(slot->lock));
+    cnt = libewf_handle_read_random(slot->handle,
         buf, len, offset, &ewf_error);
+    tsk_release_lock(&(slot->lock));
+
+    tsk_take_lock(&(ewf_info->pool_lock));
+    slot->users--;
+    tsk_release_lock(&(ewf_info->pool_lock));
+
     if (cnt < 0) {
         char *errmsg = NULL;
         tsk_error_reset();
@@ -80,10 +270,114 @@ ewf_image_read(TSK_IMG_INFO * img_info, TSK_OFF_T offset, char *buf,
 
         tsk_error_set_errstr("ewf_image_read - offset: %" PRIuOFF
             " - len: %" PRIuSIZE " - %s", offset, len, errmsg);
-        tsk_release_lock(&(ewf_info->read_lock));
+        libewf_error_free(&ewf_error);
+        return -1;
+    }
+    return cnt;
+}
+
+/**
+ * Read from the image a chunk at a time through the chunk cache.
+ * Chunks that are not in the cache are read whole so that later reads
+ * of the rest of the chunk do not decompress it again.
+ */
+static ssize_t
+ewf_read_chunks(IMG_EWF_INFO * ewf_info, TSK_OFF_T offset, char *buf,
+    size_t len)
+{
+    TSK_IMG_INFO *img_info = (TSK_IMG_INFO *) ewf_info;
+    size_t chunk_size = ewf_info->chunk_size;
+    char *chunk_buf = NULL;
+    size_t done = 0;
+
+    if ((TSK_OFF_T) len > img_info->size - offset)
+        len = (size_t) (img_info->size - offset);
+
+    while (done < len) {
+        TSK_OFF_T cur_off = offset + (TSK_OFF_T) done;
+        uint64_t chunk = (uint64_t) (cur_off / chunk_size);
+        size_t rel_off = (size_t) (cur_off % chunk_size);
+        size_t cnt = chunk_size - rel_off;
+        TSK_OFF_T chunk_off;
+        size_t chunk_len;
+        ssize_t retval;
+
+        if (cnt > len - done)
+            cnt = len - done;
+
+        if (ewf_cache_get(ewf_info->chunk_cache, chunk, rel_off,
+                &buf[done], cnt)) {
+            done += cnt;
+            continue;
+        }
+
+        if ((chunk_buf == NULL)
+            && ((chunk_buf = (char *) tsk_malloc(chunk_size)) == NULL)) {
+            return -1;
+        }
+
+        chunk_off = (TSK_OFF_T) chunk * chunk_size;
+        chunk_len = chunk_size;
+        if ((TSK_OFF_T) chunk_len > img_info->size - chunk_off)
+            chunk_len = (size_t) (img_info->size - chunk_off);
+
+        retval = ewf_read_handle(ewf_info, chunk_off, chunk_buf, chunk_len);
+        if (retval < 0) {
+            free(chunk_buf);
+            return -1;
+        }
+
+        // short read: return what we have
+        if ((size_t) retval < rel_off + cnt) {
+            if ((size_t) retval > rel_off) {
+                memcpy(&buf[done], &chunk_buf[rel_off], retval - rel_off);
+                done += retval - rel_off;
+            }
+            break;
+        }
+
+        memcpy(&buf[done], &chunk_buf[rel_off], cnt);
+        ewf_cache_put(ewf_info->chunk_cache, chunk, chunk_buf, retval);
+        done += cnt;
+    }
+
+    free(chunk_buf);
+    return (ssize_t) done;
+}
+
+#endif                          /* defined( HAVE_LIBEWF_V2_API ) */
+
+static ssize_t
+ewf_image_read(TSK_IMG_INFO * img_info, TSK_OFF_T offset, char *buf,
+    size_t len)
+{
+    IMG_EWF_INFO *ewf_info = (IMG_EWF_INFO *) img_info;
+
+    if (tsk_verbose)
+        tsk_fprintf(stderr,
+            "ewf_image_read: byte offset: %" PRIuOFF " len: %" PRIuSIZE
+            "\n", offset, len);
+
+    if (offset > img_info->size) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_READ_OFF);
+        tsk_error_set_errstr("ewf_image_read - %" PRIuOFF, offset);
         return -1;
     }
+
+#if defined( HAVE_LIBEWF_V2_API )
+    // tsk_img_set_ewf_cache() can not replace the cache once this is set
+    tsk_take_lock(&(ewf_info->pool_lock));
+    ewf_info->read_started = 1;
+    tsk_release_lock(&(ewf_info->pool_lock));
+
+    if (ewf_info->chunk_cache != NULL)
+        return ewf_read_chunks(ewf_info, offset, buf, len);
+    return ewf_read_handle(ewf_info, offset, buf, len);
 #else
+    ssize_t cnt;
+
+    tsk_take_lock(&(ewf_info->read_lock));
     cnt = libewf_read_random(ewf_info->handle, buf, len, offset);
     if (cnt < 0) {
         tsk_error_reset();
@@ -93,10 +387,10 @@ ewf_image_read(TSK_IMG_INFO * img_info, TSK_OFF_T offset, char *buf,
         tsk_release_lock(&(ewf_info->read_lock));
         return -1;
     }
-#endif
     tsk_release_lock(&(ewf_info->read_lock));
 
     return cnt;
+#endif
 }
 
 static void
@@ -123,8 +417,18 @@ ewf_image_close(TSK_IMG_INFO * img_info)
     IMG_EWF_INFO *ewf_info = (IMG_EWF_INFO *) img_info;
 
 #if defined ( HAVE_LIBEWF_V2_API)
-    libewf_handle_close(ewf_info->handle, NULL);
-    libewf_handle_free(&(ewf_info->handle), NULL);
+    int i;
+    // slots[0] holds ewf_info->handle
+    for (i = 0; i < ewf_info->num_handles; i++) {
+        libewf_handle_close(ewf_info->slots[i].handle, NULL);
+        libewf_handle_free(&(ewf_info->slots[i].handle), NULL);
+    }
+    for (i = 0; i < EWF_MAX_HANDLES; i++) {
+        tsk_deinit_lock(&(ewf_info->slots[i].lock));
+    }
+    tsk_deinit_lock(&(ewf_info->pool_lock));
+    ewf_cache_free(ewf_info->chunk_cache);
+    ewf_info->handle = NULL;
 
 #else
     libewf_close(ewf_info->handle);
@@ -565,6 +869,42 @@ ewf_open(int a_num_img,
     // initialize the read lock
     tsk_init_lock(&(ewf_info->read_lock));
 
+#if defined( HAVE_LIBEWF_V2_API )
+    // set up the handle pool with the handle that we have
+    tsk_init_lock(&(ewf_info->pool_lock));
+    for (int i = 0; i < EWF_MAX_HANDLES; i++) {
+        tsk_init_lock(&(ewf_info->slots[i].lock));
+    }
+    ewf_info->slots[0].handle = ewf_info->handle;
+    ewf_info->num_handles = 1;
+    ewf_info->max_handles = EWF_DEFAULT_MAX_HANDLES;
+
+    // the chunk cache is only used if we know the chunk size
+    uint32_t sectors_per_chunk = 0;
+    uint32_t chunk_bytes_per_sector = 0;
+    if ((libewf_handle_get_sectors_per_chunk(ewf_info->handle,
+                &sectors_per_chunk, &ewf_error) == 1)
+        && (libewf_handle_get_bytes_per_sector(ewf_info->handle,
+                &chunk_bytes_per_sector, &ewf_error) == 1)
+        && (sectors_per_chunk > 0) && (chunk_bytes_per_sector > 0)) {
+        ewf_info->chunk_size = sectors_per_chunk * chunk_bytes_per_sector;
+        ewf_info->chunk_cache =
+            ewf_cache_alloc(((size_t) EWF_DEFAULT_CACHE_MB << 20) /
+            ewf_info->chunk_size);
+    }
+    else {
+        if (tsk_verbose)
+            tsk_fprintf(stderr,
+                "ewf_open: error getting chunk size, not caching chunks\n");
+        libewf_error_free(&ewf_error);
+        ewf_info->chunk_size = 0;
+        ewf_info->chunk_cache = NULL;
+    }
+
+    // reads lock the pool and the handles themselves
+    img_info->parallel_read = 1;
+#endif
+
     return (img_info);
 }
 
@@ -699,3 +1039,77 @@ std::string ewf_get_details(IMG_EWF_INFO *ewf_info) {
     return collectionDetails;
 }
 #endif                          /* HAVE_LIBEWF */
+
+
+/**
+ * \ingroup imglib
+ * Set how many libewf handles an EWF image can be read with at once and
+ * the size of its cache of decompressed chunks.  Each handle decompresses
+ * the chunks that are read with it, so reads from several threads are
+ * decompressed in parallel.  Handles are only opened when reads overlap.
+ * The number of handles can be changed at any time, but the cache can
+ * only be changed before the image is first read.
+ *
+ * @param a_img_info EWF image
+ * @param a_max_handles Maximum number of handles (0 for the default)
+ * @param a_cache_mb Size of the chunk cache in MB (0 to disable it)
+ * @returns 1 on error (including if the image is not EWF or the cache
+ * size is changed after the image was read) and 0 on success
+ */
+uint8_t
+tsk_img_set_ewf_cache(TSK_IMG_INFO * a_img_info,
+    unsigned int a_max_handles, unsigned int a_cache_mb)
+{
+    if ((a_img_info == NULL) || (a_img_info->tag != TSK_IMG_INFO_TAG)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_ARG);
+        tsk_error_set_errstr("tsk_img_set_ewf_cache: invalid image");
+        return 1;
+    }
+    if (a_img_info->itype != TSK_IMG_TYPE_EWF_EWF) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_ARG);
+        tsk_error_set_errstr("tsk_img_set_ewf_cache: not an EWF image");
+        return 1;
+    }
+
+#if HAVE_LIBEWF && defined( HAVE_LIBEWF_V2_API )
+    IMG_EWF_INFO *ewf_info = (IMG_EWF_INFO *) a_img_info;
+
+    if (a_max_handles == 0)
+        a_max_handles = EWF_DEFAULT_MAX_HANDLES;
+    else if (a_max_handles > EWF_MAX_HANDLES)
+        a_max_handles = EWF_MAX_HANDLES;
+
+    tsk_take_lock(&(ewf_info->pool_lock));
+    // handles that are already open stay open
+    ewf_info->max_handles = a_max_handles;
+
+    if (ewf_info->chunk_size > 0) {
+        // reads use the cache without holding the lock
+        if (ewf_info->read_started) {
+            tsk_release_lock(&(ewf_info->pool_lock));
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_IMG_ARG);
+            tsk_error_set_errstr
+                ("tsk_img_set_ewf_cache: cache can not be changed after the image was read");
+            return 1;
+        }
+        ewf_cache_free(ewf_info->chunk_cache);
+        ewf_info->chunk_cache = NULL;
+        if (a_cache_mb > 0) {
+            ewf_info->chunk_cache =
+                ewf_cache_alloc(((size_t) a_cache_mb << 20) /
+                ewf_info->chunk_size);
+        }
+    }
+    tsk_release_lock(&(ewf_info->pool_lock));
+    return 0;
+#else
+    tsk_error_reset();
+    tsk_error_set_errno(TSK_ERR_IMG_UNSUPTYPE);
+    tsk_error_set_errstr
+        ("tsk_img_set_ewf_cache: not supported with this version of libewf");
+    return 1;
+#endif
+}
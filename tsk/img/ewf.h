@@ -27,6 +27,15 @@
 #define HAVE_LIBEWF_V2_API
 #endif
 
+// Most libewf handles that an image can be read with at once
+#define EWF_MAX_HANDLES 64
+
+// Defaults for the handle pool and the decompressed chunk cache
+#define EWF_DEFAULT_MAX_HANDLES 4
+#define EWF_DEFAULT_CACHE_MB 32
+
+struct EWF_CHUNK_CACHE;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -34,6 +43,14 @@ extern "C" {
     extern TSK_IMG_INFO *ewf_open(int, const TSK_TCHAR * const images[],
         unsigned int a_ssize);
 
+    /* A libewf handle in the pool of an image.  libewf handles are not
+     * thread safe, so each one is only used by one read at a time. */
+    typedef struct {
+        libewf_handle_t *handle;        ///< NULL until first needed
+        tsk_lock_t lock;        ///< Held while the handle is being used
+        int users;              ///< Reads using or waiting for the handle (protected by pool_lock)
+    } EWF_HANDLE_SLOT;
+
     typedef struct {
         TSK_IMG_INFO img_info;
         libewf_handle_t *handle;
@@ -42,7 +59,17 @@ extern "C" {
         char sha1hash[41];
         int sha1hash_isset;
         uint8_t used_ewf_glob;  // 1 if libewf_glob was used during open
-        tsk_lock_t read_lock;   ///< Lock for reads since libewf is not thread safe -- only works if you have a single instance of EWF_INFO for all threads.
+        tsk_lock_t read_lock;   ///< Lock for reads with the v1 API since libewf is not thread safe
+
+        // Reads with the v2 API are spread over a pool of handles that
+        // are opened as they are needed.  slots[0] holds handle.
+        tsk_lock_t pool_lock;   ///< Lock for the slot users counts and num_handles
+        EWF_HANDLE_SLOT slots[EWF_MAX_HANDLES];
+        int max_handles;        ///< Number of slots that can be used
+        int num_handles;        ///< Number of slots that have been used
+        uint32_t chunk_size;    ///< Bytes of media data in an EWF chunk
+        struct EWF_CHUNK_CACHE *chunk_cache;    ///< Decompressed chunks or NULL if disabled
+        uint8_t read_started;   ///< 1 once the image has been read, after which chunk_cache does not change (protected by pool_lock)
     } IMG_EWF_INFO;
 
     
@@ -0,0 +1,849 @@
+/*
+ * The Sleuth Kit
+ *
+ * Brian Carrier [carrier <at> sleuthkit [dot] org]
+ * Copyright (c) 2006-2016 Brian Carrier, Basis Technology.  All rights reserved
+ *
+ * This software is distributed under the Common Public License 1.0
+ */
+
+/**
+ * \file img_disk_cache.cpp
+ * Internal code for the persistent disk cache.  The cache keeps blocks of
+ * data that were read from an image (after they were decompressed) in a
+ * file in a local directory so that the next process that opens the same
+ * image does not have to read and decompress them again.  It sits below
+ * the in-memory cache of tsk_img_read() and above the format specific read
+ * functions.
+ *
+ * Two files are kept for each image, named after a fingerprint of the
+ * image: an MD5 of its size, its first and last 64KB and, for each file
+ * that it was opened from, the size, modification time and first and last
+ * 64KB of the file.  The data file holds a fixed number of block sized
+ * slots and grows as slots are used.  The index file holds the names of
+ * the image files and which block is in each slot, most recently used
+ * first.  The index is loaded when the cache is opened and written when
+ * the image is closed.  It is marked as in use while the cache is open so
+ * that a process that did not close the image does not leave an index
+ * that refers to overwritten slots.
+ */
+
+#include "tsk_img_i.h"
+#include "img_disk_cache.h"
+
+#include <list>
+#include <map>
+#include <vector>
+
+#ifdef TSK_WIN32
+#include <winioctl.h>
+#else
+#include <unistd.h>
+#endif
+
+#define DC_MAGIC "TSKDCIX2"
+#define DC_HEADER_SIZE 64
+#define DC_ENTRY_SIZE 16
+#define DC_FINGERPRINT_LEN 65536
+#define DC_DEFAULT_BLOCK_KB 256
+#define DC_DEFAULT_MB 1024
+
+#ifdef TSK_WIN32
+typedef HANDLE DC_FD;
+#define DC_FD_INVALID INVALID_HANDLE_VALUE
+#else
+typedef int DC_FD;
+#define DC_FD_INVALID -1
+#endif
+
+struct TSK_IMG_DISK_CACHE {
+    struct Entry {
+        uint32_t slot;
+        size_t len;
+        std::list < uint64_t >::iterator lru_pos;
+    };
+
+    tsk_lock_t lock;            // protects everything below and the slot data
+    DC_FD idx_fd;
+    DC_FD data_fd;
+    size_t block_size;
+    uint32_t num_slots;
+    std::vector < uint32_t > free_slots;
+    std::map < uint64_t, Entry > blocks;
+    std::list < uint64_t > lru;        // block numbers, most recently used first
+    uint8_t fingerprint[16];
+    std::vector < uint8_t > names;      // image file names, each ending with a NUL
+    uint64_t hits;
+    uint64_t misses;
+};
+
+static void
+dc_put32(uint8_t * a_buf, uint32_t a_val)
+{
+    for (int i = 0; i < 4; i++)
+        a_buf[i] = (uint8_t) (a_val >> (8 * i));
+}
+
+static void
+dc_put64(uint8_t * a_buf, uint64_t a_val)
+{
+    for (int i = 0; i < 8; i++)
+        a_buf[i] = (uint8_t) (a_val >> (8 * i));
+}
+
+static ssize_t
+dc_pread(DC_FD a_fd, char *a_buf, size_t a_len, TSK_OFF_T a_off)
+{
+#ifdef TSK_WIN32
+    OVERLAPPED ov;
+    DWORD nread;
+
+    memset(&ov, 0, sizeof(ov));
+    ov.Offset = (DWORD) (a_off & 0xffffffff);
+    ov.OffsetHigh = (DWORD) (a_off >> 32);
+    if (FALSE == ReadFile(a_fd, a_buf, (DWORD) a_len, &nread, &ov)) {
+        if (GetLastError() == ERROR_HANDLE_EOF)
+            return 0;
+        return -1;
+    }
+    return (ssize_t) nread;
+#else
+    size_t done = 0;
+
+    while (done < a_len) {
+        ssize_t cnt =
+            pread(a_fd, &a_buf[done], a_len - done, (off_t) (a_off + done));
+        if (cnt < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (cnt == 0)
+            break;
+        done += cnt;
+    }
+    return (ssize_t) done;
+#endif
+}
+
+/** @returns 1 on error */
+static uint8_t
+dc_pwrite(DC_FD a_fd, const char *a_buf, size_t a_len, TSK_OFF_T a_off)
+{
+#ifdef TSK_WIN32
+    OVERLAPPED ov;
+    DWORD nwritten;
+
+    memset(&ov, 0, sizeof(ov));
+    ov.Offset = (DWORD) (a_off & 0xffffffff);
+    ov.OffsetHigh = (DWORD) (a_off >> 32);
+    if ((FALSE == WriteFile(a_fd, a_buf, (DWORD) a_len, &nwritten, &ov))
+        || (nwritten != a_len))
+        return 1;
+    return 0;
+#else
+    size_t done = 0;
+
+    while (done < a_len) {
+        ssize_t cnt =
+            pwrite(a_fd, &a_buf[done], a_len - done, (off_t) (a_off + done));
+        if (cnt < 0) {
+            if (errno == EINTR)
+                continue;
+            return 1;
+        }
+        done += cnt;
+    }
+    return 0;
+#endif
+}
+
+static void
+dc_truncate(DC_FD a_fd, TSK_OFF_T a_size)
+{
+#ifdef TSK_WIN32
+    LARGE_INTEGER pos;
+    pos.QuadPart = a_size;
+    if (SetFilePointerEx(a_fd, pos, NULL, FILE_BEGIN))
+        SetEndOfFile(a_fd);
+#else
+    if (ftruncate(a_fd, (off_t) a_size) != 0 && tsk_verbose)
+        tsk_fprintf(stderr, "dc_truncate: %s\n", strerror(errno));
+#endif
+}
+
+static void
+dc_close_fd(DC_FD a_fd)
+{
+    if (a_fd == DC_FD_INVALID)
+        return;
+#ifdef TSK_WIN32
+    CloseHandle(a_fd);
+#else
+    close(a_fd);
+#endif
+}
+
+/**
+ * Open (and create) a cache file.  The index file is opened so that no
+ * other process can use it at the same time (an exclusive share mode on
+ * Windows and a lock on other systems, both of which go away if the
+ * process ends).
+ * @returns DC_FD_INVALID on error (and sets tsk_error)
+ */
+static DC_FD
+dc_open_file(const TSK_TCHAR * a_path, uint8_t a_exclusive)
+{
+    DC_FD fd;
+
+#ifdef TSK_WIN32
+    fd = CreateFile(a_path, GENERIC_READ | GENERIC_WRITE,
+        a_exclusive ? 0 : FILE_SHARE_READ, NULL, OPEN_ALWAYS, 0, NULL);
+    if (fd == INVALID_HANDLE_VALUE) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_OPEN);
+        tsk_error_set_errstr("tsk_img_set_disk_cache: %" PRIttocTSK
+            " (error %d)", a_path, (int) GetLastError());
+        return DC_FD_INVALID;
+    }
+    if (a_exclusive == 0) {
+        DWORD ret;
+        DeviceIoControl(fd, FSCTL_SET_SPARSE, NULL, 0, NULL, 0, &ret,
+            NULL);
+    }
+#else
+    if ((fd = open(a_path, O_RDWR | O_CREAT | O_BINARY, 0600)) < 0) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_OPEN);
+        tsk_error_set_errstr("tsk_img_set_disk_cache: %" PRIttocTSK ": %s",
+            a_path, strerror(errno));
+        return DC_FD_INVALID;
+    }
+    if (a_exclusive) {
+        struct flock lock;
+        memset(&lock, 0, sizeof(lock));
+        lock.l_type = F_WRLCK;
+        lock.l_whence = SEEK_SET;
+        if (fcntl(fd, F_SETLK, &lock) != 0) {
+            close(fd);
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_IMG_OPEN);
+            tsk_error_set_errstr("tsk_img_set_disk_cache: %" PRIttocTSK
+                " is in use by another process", a_path);
+            return DC_FD_INVALID;
+        }
+    }
+#endif
+    return fd;
+}
+
+/**
+ * Open an image file to read it.
+ * @returns DC_FD_INVALID on error
+ */
+static DC_FD
+dc_open_image_file(const TSK_TCHAR * a_path)
+{
+#ifdef TSK_WIN32
+    return CreateFile(a_path, FILE_READ_DATA,
+        FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
+#else
+    return open(a_path, O_RDONLY | O_BINARY);
+#endif
+}
+
+/**
+ * Add the files that an image was opened from to its fingerprint: the
+ * size and modification time of each file and its first and last bytes,
+ * which hold the headers of the container (and for some formats, such as
+ * E01, its identifier and stored hashes).  The data that the fingerprint
+ * samples through the image can stay the same when a container is
+ * replaced or changed, but the container files do not.
+ */
+static void
+dc_fingerprint_files(TSK_IMG_INFO * a_img_info, TSK_MD5_CTX * a_md5,
+    char *a_buf)
+{
+    for (int i = 0; i < a_img_info->num_img; i++) {
+        struct STAT_STR stat_buf;
+        uint8_t val_buf[8];
+        DC_FD fd;
+        ssize_t cnt;
+
+        if ((a_img_info->images[i] == NULL)
+            || (TSTAT(a_img_info->images[i], &stat_buf) < 0))
+            continue;
+
+        dc_put64(val_buf, (uint64_t) stat_buf.st_size);
+        TSK_MD5_Update(a_md5, val_buf, sizeof(val_buf));
+        dc_put64(val_buf, (uint64_t) stat_buf.st_mtime);
+        TSK_MD5_Update(a_md5, val_buf, sizeof(val_buf));
+
+        // devices have no size, so only their start is read
+        if ((fd = dc_open_image_file(a_img_info->images[i])) == DC_FD_INVALID)
+            continue;
+        if ((cnt = dc_pread(fd, a_buf, DC_FINGERPRINT_LEN, 0)) > 0)
+            TSK_MD5_Update(a_md5, (unsigned char *) a_buf,
+                (unsigned int) cnt);
+        if ((stat_buf.st_size > DC_FINGERPRINT_LEN)
+            && ((cnt = dc_pread(fd, a_buf, DC_FINGERPRINT_LEN,
+                        (TSK_OFF_T) stat_buf.st_size -
+                        DC_FINGERPRINT_LEN)) > 0))
+            TSK_MD5_Update(a_md5, (unsigned char *) a_buf,
+                (unsigned int) cnt);
+        dc_close_fd(fd);
+    }
+}
+
+/**
+ * Compute the fingerprint of an image from its size, the MD5 of its
+ * first and last blocks and the files that it was opened from.
+ * @returns 1 on error
+ */
+static uint8_t
+dc_fingerprint(TSK_IMG_INFO * a_img_info, uint8_t a_hash[16])
+{
+    TSK_MD5_CTX md5;
+    uint8_t size_buf[8];
+    char *buf;
+    size_t len = DC_FINGERPRINT_LEN;
+    ssize_t cnt;
+
+    if ((TSK_OFF_T) len > a_img_info->size)
+        len = (size_t) a_img_info->size;
+    if ((buf = (char *) tsk_malloc(DC_FINGERPRINT_LEN)) == NULL)
+        return 1;
+
+    TSK_MD5_Init(&md5);
+    dc_put64(size_buf, (uint64_t) a_img_info->size);
+    TSK_MD5_Update(&md5, size_buf, sizeof(size_buf));
+
+    if (len > 0) {
+        if ((cnt = tsk_img_read(a_img_info, 0, buf, len)) < 0) {
+            free(buf);
+            return 1;
+        }
+        TSK_MD5_Update(&md5, (unsigned char *) buf, (unsigned int) cnt);
+        if ((cnt = tsk_img_read(a_img_info, a_img_info->size - len, buf,
+                    len)) < 0) {
+            free(buf);
+            return 1;
+        }
+        TSK_MD5_Update(&md5, (unsigned char *) buf, (unsigned int) cnt);
+    }
+    dc_fingerprint_files(a_img_info, &md5, buf);
+    TSK_MD5_Final(a_hash, &md5);
+    free(buf);
+    return 0;
+}
+
+/**
+ * Keep the names of the image files, which are stored in the index so
+ * that a cache is only used for the files that it was made from.
+ */
+static void
+dc_set_names(TSK_IMG_DISK_CACHE * a_cache, TSK_IMG_INFO * a_img_info)
+{
+    a_cache->names.clear();
+    for (int i = 0; i < a_img_info->num_img; i++) {
+        const TSK_TCHAR *name = a_img_info->images[i];
+        if (name == NULL)
+            continue;
+        const uint8_t *bytes = (const uint8_t *) name;
+        a_cache->names.insert(a_cache->names.end(), bytes,
+            bytes + (TSTRLEN(name) + 1) * sizeof(TSK_TCHAR));
+    }
+}
+
+/**
+ * Make the name of a cache file.
+ * @returns NULL on error
+ */
+static TSK_TCHAR *
+dc_file_name(const TSK_TCHAR * a_dir, const uint8_t a_hash[16],
+    const char *a_ext)
+{
+    static const char hex[] = "0123456789abcdef";
+    size_t dir_len = TSTRLEN(a_dir);
+    size_t len = dir_len + 1 + 32 + strlen(a_ext) + 1;
+    TSK_TCHAR *name;
+    size_t pos;
+
+    if ((name = (TSK_TCHAR *) tsk_malloc(len * sizeof(TSK_TCHAR))) == NULL)
+        return NULL;
+    TSTRNCPY(name, a_dir, len);
+    pos = dir_len;
+    name[pos++] = '/';
+    for (int i = 0; i < 16; i++) {
+        name[pos++] = hex[a_hash[i] >> 4];
+        name[pos++] = hex[a_hash[i] & 0xf];
+    }
+    for (const char *c = a_ext; *c != '\0'; c++)
+        name[pos++] = *c;
+    name[pos] = '\0';
+    return name;
+}
+
+/**
+ * Load the index of a cache that was closed cleanly with the same block
+ * size, image and image file names.  Blocks in slots past the new number
+ * of slots are dropped.
+ * @returns 1 if the index could not be used (the cache is then empty)
+ */
+static uint8_t
+dc_load_index(TSK_IMG_DISK_CACHE * a_cache, TSK_IMG_INFO * a_img_info)
+{
+    uint8_t header[DC_HEADER_SIZE];
+    uint8_t *entries;
+    uint32_t count;
+    size_t names_len = a_cache->names.size();
+    std::vector < uint8_t > used(a_cache->num_slots, 0);
+    std::vector < uint8_t > names(names_len + 1);
+
+    if ((dc_pread(a_cache->idx_fd, (char *) header, sizeof(header),
+                0) != sizeof(header))
+        || (memcmp(header, DC_MAGIC, 8) != 0)
+        || (tsk_getu32(TSK_LIT_ENDIAN, &header[8]) != a_cache->block_size)
+        || (tsk_getu32(TSK_LIT_ENDIAN, &header[20]) != 1)
+        || ((TSK_OFF_T) tsk_getu64(TSK_LIT_ENDIAN, &header[24]) !=
+            a_img_info->size)
+        || (memcmp(&header[32], a_cache->fingerprint, 16) != 0)
+        || (tsk_getu32(TSK_LIT_ENDIAN, &header[48]) != names_len))
+        return 1;
+
+    if ((names_len > 0)
+        && ((dc_pread(a_cache->idx_fd, (char *) &names[0], names_len,
+                    DC_HEADER_SIZE) != (ssize_t) names_len)
+            || (memcmp(&names[0], &a_cache->names[0], names_len) != 0)))
+        return 1;
+
+    count = tsk_getu32(TSK_LIT_ENDIAN, &header[16]);
+    if (count == 0)
+        return 0;
+    if ((entries =
+            (uint8_t *) tsk_malloc((size_t) count * DC_ENTRY_SIZE)) == NULL) {
+        tsk_error_reset();
+        return 1;
+    }
+    if (dc_pread(a_cache->idx_fd, (char *) entries,
+            (size_t) count * DC_ENTRY_SIZE,
+            DC_HEADER_SIZE + names_len) !=
+        (ssize_t) count * DC_ENTRY_SIZE) {
+        free(entries);
+        return 1;
+    }
+
+    // the entries are most recently used first
+    for (uint32_t i = 0; i < count; i++) {
+        uint8_t *entry = &entries[i * DC_ENTRY_SIZE];
+        uint64_t block = tsk_getu64(TSK_LIT_ENDIAN, &entry[0]);
+        uint32_t slot = tsk_getu32(TSK_LIT_ENDIAN, &entry[8]);
+        uint32_t len = tsk_getu32(TSK_LIT_ENDIAN, &entry[12]);
+
+        if ((slot >= a_cache->num_slots) || (used[slot])
+            || (len == 0) || (len > a_cache->block_size)
+            || (a_cache->blocks.find(block) != a_cache->blocks.end()))
+            continue;
+        used[slot] = 1;
+        a_cache->lru.push_back(block);
+        TSK_IMG_DISK_CACHE::Entry & e = a_cache->blocks[block];
+        e.slot = slot;
+        e.len = len;
+        e.lru_pos = --a_cache->lru.end();
+    }
+    free(entries);
+
+    for (uint32_t slot = a_cache->num_slots; slot > 0; slot--) {
+        if (used[slot - 1] == 0)
+            a_cache->free_slots.push_back(slot - 1);
+    }
+    return 0;
+}
+
+/**
+ * Write the header of the index file.
+ * @returns 1 on error
+ */
+static uint8_t
+dc_write_header(TSK_IMG_DISK_CACHE * a_cache, TSK_IMG_INFO * a_img_info,
+    uint32_t a_count, uint8_t a_clean)
+{
+    uint8_t header[DC_HEADER_SIZE];
+
+    memset(header, 0, sizeof(header));
+    memcpy(header, DC_MAGIC, 8);
+    dc_put32(&header[8], (uint32_t) a_cache->block_size);
+    dc_put32(&header[12], a_cache->num_slots);
+    dc_put32(&header[16], a_count);
+    dc_put32(&header[20], a_clean);
+    dc_put64(&header[24], (uint64_t) a_img_info->size);
+    memcpy(&header[32], a_cache->fingerprint, 16);
+    dc_put32(&header[48], (uint32_t) a_cache->names.size());
+    return dc_pwrite(a_cache->idx_fd, (const char *) header,
+        sizeof(header), 0);
+}
+
+/**
+ * Write the image file names and the index and mark it as closed cleanly.
+ */
+static void
+dc_save_index(TSK_IMG_DISK_CACHE * a_cache, TSK_IMG_INFO * a_img_info)
+{
+    uint8_t *entries;
+    uint32_t count = 0;
+    size_t names_len = a_cache->names.size();
+
+    if ((entries =
+            (uint8_t *) tsk_malloc((a_cache->blocks.size() +
+                    1) * DC_ENTRY_SIZE)) == NULL) {
+        tsk_error_reset();
+        return;
+    }
+    for (std::list < uint64_t >::iterator it = a_cache->lru.begin();
+        it != a_cache->lru.end(); ++it, count++) {
+        TSK_IMG_DISK_CACHE::Entry & e = a_cache->blocks[*it];
+        uint8_t *entry = &entries[count * DC_ENTRY_SIZE];
+        dc_put64(&entry[0], *it);
+        dc_put32(&entry[8], e.slot);
+        dc_put32(&entry[12], (uint32_t) e.len);
+    }
+
+    if (((names_len > 0)
+            && dc_pwrite(a_cache->idx_fd, (const char *) &a_cache->names[0],
+                names_len, DC_HEADER_SIZE))
+        || dc_pwrite(a_cache->idx_fd, (const char *) entries,
+            (size_t) count * DC_ENTRY_SIZE, DC_HEADER_SIZE + names_len)
+        || dc_write_header(a_cache, a_img_info, count, 1)) {
+        if (tsk_verbose)
+            tsk_fprintf(stderr,
+                "dc_save_index: error writing cache index\n");
+    }
+    else {
+        dc_truncate(a_cache->idx_fd, DC_HEADER_SIZE + names_len +
+            (TSK_OFF_T) count * DC_ENTRY_SIZE);
+    }
+    free(entries);
+}
+
+static void
+dc_free(TSK_IMG_DISK_CACHE * a_cache)
+{
+    dc_close_fd(a_cache->data_fd);
+    dc_close_fd(a_cache->idx_fd);
+    tsk_deinit_lock(&(a_cache->lock));
+    delete a_cache;
+}
+
+/**
+ * \ingroup imglib
+ * Keep the data that is read from an image in a persistent cache in a
+ * local directory.  Blocks are stored after they have been decompressed,
+ * so later processes that open the same image (such as repeated runs of
+ * the command line tools) read them from the cache instead of the image.
+ * The least recently used blocks are replaced once the cache reaches its
+ * size limit.  This is mostly useful for compressed and remote images.
+ *
+ * The cache of an image can only be used by one process at a time.  A
+ * process that finds it in use reads the image without it.
+ *
+ * @param a_img_info Image to cache
+ * @param a_dir Existing directory to store the cache files in (or NULL to
+ * stop using a cache)
+ * @param a_max_mb Largest size of the cache file in MB (0 for the default
+ * of 1024)
+ * @param a_block_kb Size of the cached blocks in KB (0 for the default of
+ * 256).  Must be a power of two from 64 to 1024.
+ * @returns 1 on error
+ */
+uint8_t
+tsk_img_set_disk_cache(TSK_IMG_INFO * a_img_info, const TSK_TCHAR * a_dir,
+    unsigned int a_max_mb, unsigned int a_block_kb)
+{
+    TSK_IMG_DISK_CACHE *cache;
+    struct STAT_STR stat_buf;
+    TSK_TCHAR *name;
+    uint64_t num_slots;
+
+    if ((a_img_info == NULL) || (a_img_info->tag != TSK_IMG_INFO_TAG)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_ARG);
+        tsk_error_set_errstr("tsk_img_set_disk_cache: invalid image");
+        return 1;
+    }
+
+    tsk_img_disk_cache_close(a_img_info);
+    if (a_dir == NULL)
+        return 0;
+
+    if (a_max_mb == 0)
+        a_max_mb = DC_DEFAULT_MB;
+    if (a_block_kb == 0)
+        a_block_kb = DC_DEFAULT_BLOCK_KB;
+    if ((a_block_kb < 64) || (a_block_kb > 1024)
+        || (a_block_kb & (a_block_kb - 1))) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_ARG);
+        tsk_error_set_errstr
+            ("tsk_img_set_disk_cache: invalid block size (%u KB)",
+            a_block_kb);
+        return 1;
+    }
+    if ((TSTAT(a_dir, &stat_buf) < 0)
+        || ((stat_buf.st_mode & S_IFMT) != S_IFDIR)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_OPEN);
+        tsk_error_set_errstr("tsk_img_set_disk_cache: %" PRIttocTSK
+            " is not a directory", a_dir);
+        return 1;
+    }
+
+    cache = new TSK_IMG_DISK_CACHE;
+    tsk_init_lock(&(cache->lock));
+    cache->idx_fd = DC_FD_INVALID;
+    cache->data_fd = DC_FD_INVALID;
+    cache->block_size = (size_t) a_block_kb * 1024;
+    num_slots = (uint64_t) a_max_mb * 1024 / a_block_kb;
+    cache->num_slots = (num_slots > 0xffffffffULL) ? 0xffffffff :
+        ((num_slots == 0) ? 1 : (uint32_t) num_slots);
+    cache->hits = 0;
+    cache->misses = 0;
+
+    if (dc_fingerprint(a_img_info, cache->fingerprint)) {
+        dc_free(cache);
+        return 1;
+    }
+    dc_set_names(cache, a_img_info);
+
+    if ((name = dc_file_name(a_dir, cache->fingerprint, ".idx")) == NULL) {
+        dc_free(cache);
+        return 1;
+    }
+    cache->idx_fd = dc_open_file(name, 1);
+    free(name);
+    if (cache->idx_fd == DC_FD_INVALID) {
+        dc_free(cache);
+        return 1;
+    }
+
+    if ((name = dc_file_name(a_dir, cache->fingerprint, ".dat")) == NULL) {
+        dc_free(cache);
+        return 1;
+    }
+    cache->data_fd = dc_open_file(name, 0);
+    free(name);
+    if (cache->data_fd == DC_FD_INVALID) {
+        dc_free(cache);
+        return 1;
+    }
+
+    if (dc_load_index(cache, a_img_info)) {
+        if (tsk_verbose)
+            tsk_fprintf(stderr,
+                "tsk_img_set_disk_cache: starting a new cache\n");
+        cache->blocks.clear();
+        cache->lru.clear();
+        cache->free_slots.clear();
+        for (uint32_t slot = cache->num_slots; slot > 0; slot--)
+            cache->free_slots.push_back(slot - 1);
+        dc_truncate(cache->data_fd, 0);
+    }
+    else if (tsk_verbose) {
+        tsk_fprintf(stderr,
+            "tsk_img_set_disk_cache: loaded %" PRIuSIZE " cached blocks\n",
+            cache->blocks.size());
+    }
+
+    // the index is not valid until it is saved at close
+    if (dc_write_header(cache, a_img_info, 0, 0)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_WRITE);
+        tsk_error_set_errstr
+            ("tsk_img_set_disk_cache: error writing cache index");
+        dc_free(cache);
+        return 1;
+    }
+
+    tsk_take_lock(&(a_img_info->cache_lock));
+    a_img_info->disk_cache = cache;
+    tsk_release_lock(&(a_img_info->cache_lock));
+    return 0;
+}
+
+/**
+ * Read data through the disk cache.  This is called in place of the read
+ * function of the image format (with the same locking).
+ * @returns -1 on error or the number of bytes read
+ */
+ssize_t
+tsk_img_disk_cache_read(TSK_IMG_INFO * a_img_info, TSK_OFF_T a_off,
+    char *a_buf, size_t a_len)
+{
+    TSK_IMG_DISK_CACHE *cache = a_img_info->disk_cache;
+    size_t block_size = cache->block_size;
+    char *block_buf = NULL;
+    size_t done = 0;
+
+    if (a_off >= a_img_info->size) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_READ_OFF);
+        tsk_error_set_errstr("tsk_img_disk_cache_read - %" PRIuOFF,
+            a_off);
+        return -1;
+    }
+    if ((TSK_OFF_T) a_len > a_img_info->size - a_off)
+        a_len = (size_t) (a_img_info->size - a_off);
+
+    while (done < a_len) {
+        TSK_OFF_T cur_off = a_off + (TSK_OFF_T) done;
+        uint64_t block = (uint64_t) (cur_off / block_size);
+        size_t rel_off = (size_t) (cur_off % block_size);
+        size_t cnt = block_size - rel_off;
+        TSK_OFF_T block_off = (TSK_OFF_T) block * block_size;
+        size_t block_len = block_size;
+        ssize_t read_count;
+
+        if (cnt > a_len - done)
+            cnt = a_len - done;
+        if ((TSK_OFF_T) block_len > a_img_info->size - block_off)
+            block_len = (size_t) (a_img_info->size - block_off);
+
+        // slot data is read with the lock held so that the slot is not
+        // given to another block in the meantime
+        tsk_take_lock(&(cache->lock));
+        std::map < uint64_t, TSK_IMG_DISK_CACHE::Entry >::iterator it =
+            cache->blocks.find(block);
+        if ((it != cache->blocks.end())
+            && (it->second.len >= rel_off + cnt)
+            && (dc_pread(cache->data_fd, &a_buf[done], cnt,
+                    (TSK_OFF_T) it->second.slot * block_size + rel_off) ==
+                (ssize_t) cnt)) {
+            cache->lru.splice(cache->lru.begin(), cache->lru,
+                it->second.lru_pos);
+            cache->hits++;
+            tsk_release_lock(&(cache->lock));
+            done += cnt;
+            continue;
+        }
+        cache->misses++;
+        tsk_release_lock(&(cache->lock));
+
+        if ((block_buf == NULL)
+            && ((block_buf = (char *) tsk_malloc(block_size)) == NULL))
+            return -1;
+
+        read_count =
+            a_img_info->read(a_img_info, block_off, block_buf, block_len);
+        if (read_count < 0) {
+            free(block_buf);
+            return (done > 0) ? (ssize_t) done : -1;
+        }
+
+        if ((size_t) read_count == block_len) {
+            tsk_take_lock(&(cache->lock));
+            if (cache->blocks.find(block) == cache->blocks.end()) {
+                uint32_t slot;
+                if (cache->free_slots.empty() == false) {
+                    slot = cache->free_slots.back();
+                    cache->free_slots.pop_back();
+                }
+                else {
+                    std::map < uint64_t,
+                        TSK_IMG_DISK_CACHE::Entry >::iterator old =
+                        cache->blocks.find(cache->lru.back());
+                    slot = old->second.slot;
+                    cache->blocks.erase(old);
+                    cache->lru.pop_back();
+                }
+
+                if (dc_pwrite(cache->data_fd, block_buf, block_len,
+                        (TSK_OFF_T) slot * block_size)) {
+                    if (tsk_verbose)
+                        tsk_fprintf(stderr,
+                            "tsk_img_disk_cache_read: error writing block %"
+                            PRIu64 " to the cache\n", block);
+                    cache->free_slots.push_back(slot);
+                }
+                else {
+                    cache->lru.push_front(block);
+                    TSK_IMG_DISK_CACHE::Entry & e = cache->blocks[block];
+                    e.slot = slot;
+                    e.len = block_len;
+                    e.lru_pos = cache->lru.begin();
+                }
+            }
+            tsk_release_lock(&(cache->lock));
+        }
+
+        if ((size_t) read_count <= rel_off)
+            break;
+        if ((size_t) read_count < rel_off + cnt) {
+            memcpy(&a_buf[done], &block_buf[rel_off], read_count - rel_off);
+            done += read_count - rel_off;
+            break;
+        }
+        memcpy(&a_buf[done], &block_buf[rel_off], cnt);
+        done += cnt;
+    }
+
+    free(block_buf);
+    return (ssize_t) done;
+}
+
+/**
+ * Save the index of the disk cache of an image and close it.
+ */
+void
+tsk_img_disk_cache_close(TSK_IMG_INFO * a_img_info)
+{
+    TSK_IMG_DISK_CACHE *cache = a_img_info->disk_cache;
+
+    if (cache == NULL)
+        return;
+
+    tsk_take_lock(&(a_img_info->cache_lock));
+    a_img_info->disk_cache = NULL;
+    tsk_release_lock(&(a_img_info->cache_lock));
+
+    if (tsk_verbose)
+        tsk_fprintf(stderr,
+            "tsk_img_disk_cache_close: %" PRIu64 " hits, %" PRIu64
+            " misses, %" PRIuSIZE " blocks cached\n", cache->hits,
+            cache->misses, cache->blocks.size());
+
+    dc_save_index(cache, a_img_info);
+    dc_free(cache);
+}
+
+/**
+ * Use a disk cache if the TSK_IMG_DISK_CACHE environment variable names a
+ * directory.  TSK_IMG_DISK_CACHE_MB can give its size.  Raw images are
+ * not cached since reading them is no slower than reading the cache.
+ * Errors are only reported in verbose mode since the image can be read
+ * without the cache.
+ */
+void
+tsk_img_disk_cache_from_env(TSK_IMG_INFO * a_img_info)
+{
+    const char *mb_str;
+    unsigned int max_mb = 0;
+#ifdef TSK_WIN32
+    const TSK_TCHAR *dir = _wgetenv(L"TSK_IMG_DISK_CACHE");
+#else
+    const TSK_TCHAR *dir = getenv("TSK_IMG_DISK_CACHE");
+#endif
+
+    if ((dir == NULL) || (dir[0] == '\0')
+        || (a_img_info->itype == TSK_IMG_TYPE_RAW))
+        return;
+
+    if ((mb_str = getenv("TSK_IMG_DISK_CACHE_MB")) != NULL)
+        max_mb = (unsigned int) strtoul(mb_str, NULL, 10);
+
+    if (tsk_img_set_disk_cache(a_img_info, dir, max_mb, 0)) {
+        if (tsk_verbose) {
+            tsk_fprintf(stderr, "tsk_img_disk_cache_from_env: ");
+            tsk_error_print(stderr);
+        }
+        tsk_error_reset();
+    }
+}
@@ -0,0 +1,30 @@
+/*
+ * The Sleuth Kit
+ *
+ * Brian Carrier [carrier <at> sleuthkit [dot] org]
+ * Copyright (c) 2006-2016 Brian Carrier, Basis Technology.  All rights reserved
+ *
+ * This software is distributed under the Common Public License 1.0
+ */
+
+/*
+ * Contains the internal functions of the persistent disk cache that sits
+ * between tsk_img_read() and the format specific read functions.
+ */
+
+#ifndef _IMG_DISK_CACHE_H
+#define _IMG_DISK_CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    extern ssize_t tsk_img_disk_cache_read(TSK_IMG_INFO * a_img_info,
+        TSK_OFF_T a_off, char *a_buf, size_t a_len);
+    extern void tsk_img_disk_cache_close(TSK_IMG_INFO * a_img_info);
+    extern void tsk_img_disk_cache_from_env(TSK_IMG_INFO * a_img_info);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -11,9 +11,39 @@
  */
 
 #include "tsk_img_i.h"
+#include "img_disk_cache.h"
+#include "img_stats.h"
+
+#define CACHE_AGE   1000
+
+// Reads from the image format, through the disk cache if there is one.
+static ssize_t tsk_img_read_source(TSK_IMG_INFO * a_img_info, TSK_OFF_T a_off,
+    char *a_buf, size_t a_len)
+{
+    uint64_t start = tsk_img_stats_now();
+    ssize_t cnt;
+
+    if (a_img_info->disk_cache != NULL)
+        cnt = tsk_img_disk_cache_read(a_img_info, a_off, a_buf, a_len);
+    else
+        cnt = a_img_info->read(a_img_info, a_off, a_buf, a_len);
+    tsk_img_stats_backend(a_img_info, cnt, tsk_img_stats_now() - start);
+    return cnt;
+}
+
+// Takes cache_lock and counts how long it took to get it.
+static void tsk_img_take_cache_lock(TSK_IMG_INFO * a_img_info)
+{
+    uint64_t start = tsk_img_stats_now();
+
+    tsk_take_lock(&(a_img_info->cache_lock));
+    tsk_img_stats_add(&(a_img_info->stats.lock_wait_usec),
+        tsk_img_stats_now() - start);
+}
 
 // This function assumes that we hold the cache_lock even though we're not modyfying
-// the cache.  This is because the lower-level read callbacks make the same assumption.
+// the cache.  This is because the lower-level read callbacks make the same assumption
+// (unless parallel_read is set).
 static ssize_t tsk_img_read_no_cache(TSK_IMG_INFO * a_img_info, TSK_OFF_T a_off,
     char *a_buf, size_t a_len)
 {
@@ -29,7 +59,7 @@ static ssize_t tsk_img_read_no_cache(TSK_IMG_INFO * a_img_info, TSK_OFF_T a_off,
         if ((buf2 = (char *) tsk_malloc(len_tmp)) == NULL) {
             return -1;
         }
-        nbytes = a_img_info->read(a_img_info, a_off, buf2, len_tmp);
+        nbytes = tsk_img_read_source(a_img_info, a_off, buf2, len_tmp);
         if ((nbytes > 0) && (nbytes < (ssize_t) a_len)) {
             memcpy(a_buf, buf2, nbytes);
         }
@@ -40,11 +70,78 @@ static ssize_t tsk_img_read_no_cache(TSK_IMG_INFO * a_img_info, TSK_OFF_T a_off,
         free(buf2);
     }
     else {
-        nbytes = a_img_info->read(a_img_info, a_off, a_buf, a_len);
+        nbytes = tsk_img_read_source(a_img_info, a_off, a_buf, a_len);
     }
     return nbytes;
 }
 
+/* Reads the cache block that holds a_off for an image whose read callback
+ * does its own locking (parallel_read is set) and adds it to the cache.
+ * This is called without cache_lock so that several threads can have
+ * reads in progress at once.  The entry to replace is chosen once the
+ * data has been read since other threads may have used the cache in the
+ * meantime.
+ * @param a_len2 Number of bytes to copy to a_buf (a_len limited to the image size)
+ */
+static ssize_t tsk_img_read_fill(TSK_IMG_INFO * a_img_info, TSK_OFF_T a_off,
+    char *a_buf, size_t a_len, size_t a_len2)
+{
+    TSK_OFF_T fill_off = (a_off / 512) * 512;
+    size_t read_size = TSK_IMG_INFO_CACHE_LEN;
+    TSK_OFF_T rel_off;
+    ssize_t read_count;
+    char *fill_buf;
+    int cache_index;
+    int cache_next = 0;
+
+    if ((fill_off + (TSK_OFF_T)read_size) > a_img_info->size) {
+        read_size = (size_t) (a_img_info->size - fill_off);
+    }
+
+    if ((fill_buf = (char *) tsk_malloc(read_size)) == NULL) {
+        return -1;
+    }
+
+    read_count = tsk_img_read_source(a_img_info, fill_off, fill_buf, read_size);
+    if (read_count <= 0) {
+        free(fill_buf);
+        // Something went wrong so let's try skipping the cache
+        return tsk_img_read_no_cache(a_img_info, a_off, a_buf, a_len);
+    }
+
+    rel_off = a_off - fill_off;
+    if (rel_off > (TSK_OFF_T) read_count) {
+        a_len2 = 0;
+    }
+    else if ((rel_off + (TSK_OFF_T) a_len2) > (TSK_OFF_T) read_count) {
+        a_len2 = (size_t) (read_count - rel_off);
+    }
+    if (a_len2 > 0) {
+        memcpy(a_buf, &fill_buf[rel_off], a_len2);
+    }
+
+    // replace an unused entry or else the lowest age one
+    tsk_img_take_cache_lock(a_img_info);
+    for (cache_index = 0;
+        cache_index < TSK_IMG_INFO_CACHE_NUM; cache_index++) {
+        if (a_img_info->cache_len[cache_index] == 0) {
+            cache_next = cache_index;
+            break;
+        }
+        if (a_img_info->cache_age[cache_index] <
+            a_img_info->cache_age[cache_next])
+            cache_next = cache_index;
+    }
+    memcpy(a_img_info->cache[cache_next], fill_buf, read_count);
+    a_img_info->cache_off[cache_next] = fill_off;
+    a_img_info->cache_len[cache_next] = read_count;
+    a_img_info->cache_age[cache_next] = CACHE_AGE;
+    tsk_release_lock(&(a_img_info->cache_lock));
+
+    free(fill_buf);
+    return (ssize_t) a_len2;
+}
+
 /**
  * \ingroup imglib
  * Reads data from an open disk image
@@ -58,7 +155,6 @@ ssize_t
 tsk_img_read(TSK_IMG_INFO * a_img_info, TSK_OFF_T a_off,
     char *a_buf, size_t a_len)
 {
-#define CACHE_AGE   1000
     ssize_t read_count = 0;
     int cache_index = 0;
     int cache_next = 0;         // index to lowest age cache (to use next)
@@ -98,14 +194,22 @@ tsk_img_read(TSK_IMG_INFO * a_img_info, TSK_OFF_T a_off,
         return -1;
     }
 
+    tsk_img_stats_add(&(a_img_info->stats.reads), 1);
+    tsk_img_stats_add(&(a_img_info->stats.read_bytes), a_len);
+
     /* cache_lock is used for both the cache in IMG_INFO and 
      * the shared variables in the img type specific INFO structs.
      * grab it now so that it is held before any reads.
      */
-    tsk_take_lock(&(a_img_info->cache_lock));
+    tsk_img_take_cache_lock(a_img_info);
 
     // if they ask for more than the cache length, skip the cache
     if ((a_len + (a_off % 512)) > TSK_IMG_INFO_CACHE_LEN) {
+        tsk_img_stats_add(&(a_img_info->stats.cache_skips), 1);
+        if (a_img_info->parallel_read) {
+            tsk_release_lock(&(a_img_info->cache_lock));
+            return tsk_img_read_no_cache(a_img_info, a_off, a_buf, a_len);
+        }
         read_count = tsk_img_read_no_cache(a_img_info, a_off, a_buf, a_len);
         tsk_release_lock(&(a_img_info->cache_lock));
         return read_count;
@@ -179,6 +283,18 @@ tsk_img_read(TSK_IMG_INFO * a_img_info, TSK_OFF_T a_off,
         }
     }
 
+    if (read_count > 0)
+        tsk_img_stats_add(&(a_img_info->stats.cache_hits), 1);
+    else
+        tsk_img_stats_add(&(a_img_info->stats.cache_misses), 1);
+
+    // if we didn't find it and the format can be read by several threads
+    // at once, then read it without holding the lock
+    if ((read_count == 0) && (a_img_info->parallel_read)) {
+        tsk_release_lock(&(a_img_info->cache_lock));
+        return tsk_img_read_fill(a_img_info, a_off, a_buf, a_len, len2);
+    }
+
     // if we didn't find it, then load it into the cache_next entry
     if (read_count == 0) {
         size_t read_size = 0;
@@ -203,7 +319,7 @@ tsk_img_read(TSK_IMG_INFO * a_img_info, TSK_OFF_T a_off,
                 a_img_info->cache_off[cache_next]);
         }
 
-        read_count = a_img_info->read(a_img_info,
+        read_count = tsk_img_read_source(a_img_info,
             a_img_info->cache_off[cache_next],
             a_img_info->cache[cache_next], read_size);
 
@@ -17,11 +17,18 @@
 #include "tsk_img_i.h"
 
 #include "raw.h"
+#include "img_disk_cache.h"
+#include "img_stats.h"
 
 #if HAVE_LIBAFFLIB
 #include "aff.h"
 #endif
 
+#if HAVE_LIBZ
+#include "e01.h"
+#include "tci.h"
+#endif
+
 #if HAVE_LIBEWF
 #include "ewf.h"
 #endif
@@ -121,7 +128,7 @@ tsk_img_open(int num_img,
          * we try all of the embedded formats
          */
         TSK_IMG_INFO *img_set = NULL;
-#if HAVE_LIBAFFLIB || HAVE_LIBEWF || HAVE_LIBVMDK || HAVE_LIBVHDI
+#if HAVE_LIBAFFLIB || HAVE_LIBZ || HAVE_LIBEWF || HAVE_LIBVMDK || HAVE_LIBVHDI
         const char *set = NULL;
 #endif
 
@@ -151,6 +158,49 @@ tsk_img_open(int num_img,
         }
 #endif
 
+#if HAVE_LIBZ && !HAVE_LIBEWF
+        /* Without libewf, E01 images are opened with the built-in
+         * reader.  With libewf, the built-in reader is only used when
+         * its type is given. */
+        if ((img_info = e01_open(num_img, images, a_ssize)) != NULL) {
+            if (set == NULL) {
+                set = "EWF";
+                img_set = img_info;
+            }
+            else {
+                img_set->close(img_set);
+                img_info->close(img_info);
+                tsk_error_reset();
+                tsk_error_set_errno(TSK_ERR_IMG_UNKTYPE);
+                tsk_error_set_errstr("EWF or %s", set);
+                return NULL;
+            }
+        }
+        else {
+            tsk_error_reset();
+        }
+#endif
+
+#if HAVE_LIBZ
+        if ((img_info = tci_open(num_img, images, a_ssize)) != NULL) {
+            if (set == NULL) {
+                set = "TCI";
+                img_set = img_info;
+            }
+            else {
+                img_set->close(img_set);
+                img_info->close(img_info);
+                tsk_error_reset();
+                tsk_error_set_errno(TSK_ERR_IMG_UNKTYPE);
+                tsk_error_set_errstr("TCI or %s", set);
+                return NULL;
+            }
+        }
+        else {
+            tsk_error_reset();
+        }
+#endif
+
 #if HAVE_LIBEWF
         if ((img_info = ewf_open(num_img, images, a_ssize)) != NULL) {
             if (set == NULL) {
@@ -243,6 +293,16 @@ tsk_img_open(int num_img,
         break;
 #endif
 
+#if HAVE_LIBZ
+    case TSK_IMG_TYPE_EWF_NATIVE:
+        img_info = e01_open(num_img, images, a_ssize);
+        break;
+
+    case TSK_IMG_TYPE_TCI:
+        img_info = tci_open(num_img, images, a_ssize);
+        break;
+#endif
+
 #if HAVE_LIBEWF
     case TSK_IMG_TYPE_EWF_EWF:
         img_info = ewf_open(num_img, images, a_ssize);
@@ -256,8 +316,14 @@ tsk_img_open(int num_img,
         return NULL;
     }
 
+    if (img_info == NULL) {
+        return NULL;
+    }
+
     /* we have a good img_info, set up the cache lock */
     tsk_init_lock(&(img_info->cache_lock));
+
+    tsk_img_disk_cache_from_env(img_info);
     return img_info;
 }
 
@@ -451,6 +517,8 @@ tsk_img_open_external(
     img_info->read = read;
     img_info->close = close;
     img_info->imgstat = imgstat;
+    img_info->parallel_read = 0;
+    img_info->disk_cache = NULL;
 
     tsk_init_lock(&(img_info->cache_lock));
     return img_info;
@@ -552,6 +620,8 @@ tsk_img_close(TSK_IMG_INFO * a_img_info)
     if (a_img_info == NULL) {
         return;
     }
+    tsk_img_stats_close(a_img_info);
+    tsk_img_disk_cache_close(a_img_info);
     tsk_deinit_lock(&(a_img_info->cache_lock));
     a_img_info->close(a_img_info);
 }
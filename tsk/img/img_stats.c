@@ -0,0 +1,235 @@
+/*
+ * The Sleuth Kit
+ *
+ * Brian Carrier [carrier <at> sleuthkit [dot] org]
+ * Copyright (c) 2006-2016 Brian Carrier, Basis Technology.  All rights reserved
+ *
+ * This software is distributed under the Common Public License 1.0
+ */
+
+/**
+ * \file img_stats.c
+ * Contains the functions that count how the reads of an image are done:
+ * cache hits, bytes read from the image format, time waiting for the
+ * cache lock and a histogram of how long the image format takes.
+ */
+
+#include "tsk_img_i.h"
+#include "img_stats.h"
+
+#ifndef TSK_WIN32
+#include <time.h>
+#include <sys/time.h>
+#endif
+
+/**
+ * Get a time in microseconds that only goes forward.  It is only
+ * useful for finding how long something took.
+ */
+uint64_t
+tsk_img_stats_now(void)
+{
+#ifdef TSK_WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+
+    if (freq.QuadPart == 0)
+        QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (uint64_t) (now.QuadPart / (freq.QuadPart / 1000000.0));
+#elif defined(CLOCK_MONOTONIC)
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+#else
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return (uint64_t) now.tv_sec * 1000000 + now.tv_usec;
+#endif
+}
+
+/**
+ * Add to a counter that other threads may be adding to at the same time.
+ */
+void
+tsk_img_stats_add(uint64_t * a_counter, uint64_t a_val)
+{
+#ifdef TSK_WIN32
+    InterlockedExchangeAdd64((volatile LONGLONG *) a_counter,
+        (LONGLONG) a_val);
+#elif defined(__GNUC__)
+    __sync_fetch_and_add(a_counter, a_val);
+#else
+    // no atomic add, so the counts may be a little off with threads
+    *a_counter += a_val;
+#endif
+}
+
+// Get a counter that other threads may be adding to
+static uint64_t
+stats_get(uint64_t * a_counter)
+{
+#ifdef TSK_WIN32
+    return (uint64_t) InterlockedCompareExchange64((volatile LONGLONG *)
+        a_counter, 0, 0);
+#elif defined(__GNUC__)
+    return __sync_fetch_and_add(a_counter, 0);
+#else
+    return *a_counter;
+#endif
+}
+
+// Set a counter that other threads may be adding to back to 0
+static void
+stats_clear(uint64_t * a_counter)
+{
+#ifdef TSK_WIN32
+    InterlockedExchange64((volatile LONGLONG *) a_counter, 0);
+#elif defined(__GNUC__)
+    __sync_lock_test_and_set(a_counter, 0);
+#else
+    *a_counter = 0;
+#endif
+}
+
+/**
+ * Count a read of the image format.
+ * @param a_img_info Image that was read
+ * @param a_cnt Value returned by the read
+ * @param a_usec How long the read took
+ */
+void
+tsk_img_stats_backend(TSK_IMG_INFO * a_img_info, ssize_t a_cnt,
+    uint64_t a_usec)
+{
+    TSK_IMG_STATS *stats = &(a_img_info->stats);
+    int bucket = 0;
+
+    // the bucket is the number of bits needed for the time
+    while ((bucket < TSK_IMG_STATS_LAT_NUM - 1)
+        && ((a_usec >> bucket) != 0))
+        bucket++;
+
+    tsk_img_stats_add(&(stats->backend_reads), 1);
+    if (a_cnt < 0)
+        tsk_img_stats_add(&(stats->backend_errors), 1);
+    else
+        tsk_img_stats_add(&(stats->backend_bytes), (uint64_t) a_cnt);
+    tsk_img_stats_add(&(stats->backend_usec), a_usec);
+    tsk_img_stats_add(&(stats->backend_lat[bucket]), 1);
+}
+
+/**
+ * \ingroup imglib
+ * Get a copy of the read statistics of an image.  Each counter is read
+ * atomically, but reads by other threads while the copy is made may be
+ * in some of the counters and not others.
+ * @param a_img_info Image to get the statistics of
+ * @param a_stats Set to the statistics
+ */
+void
+tsk_img_get_stats(TSK_IMG_INFO * a_img_info, TSK_IMG_STATS * a_stats)
+{
+    uint64_t *src = (uint64_t *) & (a_img_info->stats);
+    uint64_t *dst = (uint64_t *) a_stats;
+    size_t i;
+
+    for (i = 0; i < sizeof(TSK_IMG_STATS) / sizeof(uint64_t); i++)
+        dst[i] = stats_get(&src[i]);
+}
+
+/**
+ * \ingroup imglib
+ * Set the read statistics of an image back to 0.
+ * @param a_img_info Image to reset the statistics of
+ */
+void
+tsk_img_reset_stats(TSK_IMG_INFO * a_img_info)
+{
+    uint64_t *counters = (uint64_t *) & (a_img_info->stats);
+    size_t i;
+
+    for (i = 0; i < sizeof(TSK_IMG_STATS) / sizeof(uint64_t); i++)
+        stats_clear(&counters[i]);
+}
+
+/**
+ * \ingroup imglib
+ * Print the read statistics of an image.
+ * @param a_img_info Image to print the statistics of
+ * @param hFile Handle to print to
+ */
+void
+tsk_img_stats_print(TSK_IMG_INFO * a_img_info, FILE * hFile)
+{
+    TSK_IMG_STATS stats;
+    uint64_t lookups;
+    int i;
+
+    tsk_img_get_stats(a_img_info, &stats);
+    lookups = stats.cache_hits + stats.cache_misses;
+
+    tsk_fprintf(hFile, "IMAGE READ STATISTICS\n");
+    tsk_fprintf(hFile, "--------------------------------------------\n");
+    tsk_fprintf(hFile, "Reads:\t\t\t%" PRIu64 "\n", stats.reads);
+    tsk_fprintf(hFile, "Bytes read:\t\t%" PRIu64 "\n", stats.read_bytes);
+    if (stats.reads)
+        tsk_fprintf(hFile, "Average read size:\t%" PRIu64 "\n",
+            stats.read_bytes / stats.reads);
+    tsk_fprintf(hFile, "Cache hits:\t\t%" PRIu64, stats.cache_hits);
+    if (lookups)
+        tsk_fprintf(hFile, " (%.1f%%)",
+            100.0 * stats.cache_hits / lookups);
+    tsk_fprintf(hFile, "\n");
+    tsk_fprintf(hFile, "Cache misses:\t\t%" PRIu64 "\n",
+        stats.cache_misses);
+    tsk_fprintf(hFile, "Too large for cache:\t%" PRIu64 "\n",
+        stats.cache_skips);
+    tsk_fprintf(hFile, "Cache lock wait:\t%" PRIu64 " us\n",
+        stats.lock_wait_usec);
+
+    tsk_fprintf(hFile, "\nImage format reads:\t%" PRIu64 "\n",
+        stats.backend_reads);
+    tsk_fprintf(hFile, "Image format bytes:\t%" PRIu64 "\n",
+        stats.backend_bytes);
+    tsk_fprintf(hFile, "Image format errors:\t%" PRIu64 "\n",
+        stats.backend_errors);
+    tsk_fprintf(hFile, "Image format time:\t%" PRIu64 " us\n",
+        stats.backend_usec);
+    if (stats.backend_reads) {
+        tsk_fprintf(hFile, "Average read time:\t%" PRIu64 " us\n",
+            stats.backend_usec / stats.backend_reads);
+        tsk_fprintf(hFile, "Read time histogram:\n");
+        for (i = 0; i < TSK_IMG_STATS_LAT_NUM; i++) {
+            if (stats.backend_lat[i] == 0)
+                continue;
+            if (i == 0)
+                tsk_fprintf(hFile, "  < 1 us: ");
+            else if (i == TSK_IMG_STATS_LAT_NUM - 1)
+                tsk_fprintf(hFile, "  >= %" PRIu64 " us: ",
+                    (uint64_t) 1 << (i - 1));
+            else
+                tsk_fprintf(hFile, "  %" PRIu64 "-%" PRIu64 " us: ",
+                    (uint64_t) 1 << (i - 1), ((uint64_t) 1 << i) - 1);
+            tsk_fprintf(hFile, "%" PRIu64 "\n", stats.backend_lat[i]);
+        }
+    }
+}
+
+/**
+ * Print the read statistics of an image to stderr as it is closed if
+ * the TSK_IMG_STATS environment variable is set.
+ */
+void
+tsk_img_stats_close(TSK_IMG_INFO * a_img_info)
+{
+    const char *env = getenv("TSK_IMG_STATS");
+
+    if ((env == NULL) || (env[0] == '\0') || (strcmp(env, "0") == 0))
+        return;
+
+    tsk_fprintf(stderr, "\n");
+    tsk_img_stats_print(a_img_info, stderr);
+}
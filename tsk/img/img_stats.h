@@ -0,0 +1,31 @@
+/*
+ * The Sleuth Kit
+ *
+ * Brian Carrier [carrier <at> sleuthkit [dot] org]
+ * Copyright (c) 2006-2016 Brian Carrier, Basis Technology.  All rights reserved
+ *
+ * This software is distributed under the Common Public License 1.0
+ */
+
+/*
+ * Contains the internal functions that keep the read statistics of an
+ * image up to date.
+ */
+
+#ifndef _IMG_STATS_H
+#define _IMG_STATS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    extern uint64_t tsk_img_stats_now(void);
+    extern void tsk_img_stats_add(uint64_t * a_counter, uint64_t a_val);
+    extern void tsk_img_stats_backend(TSK_IMG_INFO * a_img_info,
+        ssize_t a_cnt, uint64_t a_usec);
+    extern void tsk_img_stats_close(TSK_IMG_INFO * a_img_info);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -37,6 +37,11 @@ static IMG_TYPES img_open_table[] = {
     {"afflib", TSK_IMG_TYPE_AFF_ANY,
         "All AFFLIB image formats (including beta ones)"},
 #endif
+#if HAVE_LIBZ
+    {"e01", TSK_IMG_TYPE_EWF_NATIVE,
+        "Expert Witness Format (EnCase), built-in reader"},
+    {"tci", TSK_IMG_TYPE_TCI, "TSK chunked image (zlib)"},
+#endif
 #if HAVE_LIBEWF
     {"ewf", TSK_IMG_TYPE_EWF_EWF, "Expert Witness Format (EnCase)"},
 #endif
@@ -12,28 +12,114 @@
 
 /**
  * \file img_writer.c
- * Internal code to create an image on disk from a raw data source
+ * Internal code to create an image on disk from a raw data source.
+ * The data that is read from the image is copied into a queue and a
+ * writer thread writes it to the VHD.  The writer thread keeps each 2MB
+ * block in memory until all of its sectors have been added, so most
+ * blocks are written once.  Complete blocks that are all zeros are left
+ * out of the VHD.
  */
 
 #include "tsk_img_i.h"
 #include "img_writer.h"
 #include "raw.h"
+#include "tci.h"
 #include <time.h>
 
+#include <deque>
+#include <list>
+#include <map>
+
 #ifdef TSK_WIN32
 #include <winioctl.h>
+#include <process.h>
+#else
+#include <unistd.h>
 #endif
 
-/* Keep all non-public methods and variables inside this block */
-#ifdef TSK_WIN32
-
 #define VHD_MAX_IMAGE_SIZE 2000000000000 /* VHD_MAX_IMAGE_SIZE is a little lower than the actual maximum size for the VHD */
 #define VHD_DEFAULT_BLOCK_SIZE 0x200000  /* This needs to be 0x200000 to load the VHD in Windows */
 #define VHD_SECTOR_SIZE 0x200
 #define VHD_FOOTER_LENGTH 0x200
 #define VHD_DISK_HEADER_LENGTH 0x400
 
-static TSK_RETVAL_ENUM writeFooter(TSK_IMG_WRITER* writer);
+#define IMG_WRITER_MAX_QUEUED (64 * 1024 * 1024) /* Bytes of queued data before tsk_img_writer_add waits */
+#define IMG_WRITER_MAX_STAGED 16      /* Incomplete blocks that are kept in memory before being written */
+#define IMG_WRITER_FINISH_THREADS 4   /* Threads reading the image in tsk_img_writer_finish_image */
+
+static TSK_RETVAL_ENUM writeFooter(TSK_IMG_WRITER* writer, TSK_OFF_T offset);
+
+/* Data waiting for the writer thread */
+struct WRITER_REQUEST {
+    TSK_OFF_T addr;
+    char *data;
+    size_t len;
+};
+
+/* Data for a block that has not been written yet */
+struct STAGED_BLOCK {
+    char *data;                 /* blockSize bytes */
+    unsigned char *bitmap;      /* Sectors that are in data */
+    std::list<uint32_t>::iterator lruPos;
+};
+
+/*
+ * Queue between the threads that read the image and the thread that writes
+ * the VHD. Only the thread that applies the requests uses the file handle and
+ * the block bookkeeping in TSK_IMG_WRITER. That is the writer thread, or the
+ * caller while it holds lock if the writer thread could not be started.
+ */
+struct TSK_IMG_WRITER_QUEUE {
+    tsk_lock_t lock;            /* Protects the fields up to flushDone */
+#ifdef TSK_MULTITHREAD_LIB
+#ifdef TSK_WIN32
+    HANDLE thread;
+    CONDITION_VARIABLE changed; /* Signaled when any of the fields below change */
+#else
+    pthread_t thread;
+    pthread_cond_t changed;
+#endif
+#endif
+    bool started;               /* The writer thread is running */
+    std::deque<WRITER_REQUEST> requests;
+    size_t queuedBytes;
+    uint64_t flushRequested;    /* Number of flushes asked for */
+    uint64_t flushDone;         /* Number of flushes done */
+    bool stop;
+
+    tsk_lock_t statusLock;      /* Protects blockStatus, which the finish threads read */
+
+    /* Only used by the thread that applies the requests */
+    std::map<uint32_t, STAGED_BLOCK> staged;
+    std::list<uint32_t> lru;    /* Staged block numbers, most recently used first */
+    bool failed;
+};
+
+/*
+ * Wait for another thread to change the queue. The queue lock must be held.
+ */
+static void waitForQueue(TSK_IMG_WRITER_QUEUE * queue) {
+#ifdef TSK_MULTITHREAD_LIB
+#ifdef TSK_WIN32
+    SleepConditionVariableCS(&(queue->changed), &(queue->lock.critical_section), INFINITE);
+#else
+    pthread_cond_wait(&(queue->changed), &(queue->lock.mutex));
+#endif
+#endif
+}
+
+/*
+ * Wake the threads that are waiting for the queue to change.
+ */
+static void signalQueue(TSK_IMG_WRITER_QUEUE * queue) {
+#ifdef TSK_MULTITHREAD_LIB
+#ifdef TSK_WIN32
+    WakeAllConditionVariable(&(queue->changed));
+#else
+    pthread_cond_broadcast(&(queue->changed));
+#endif
+#endif
+}
 
 /*
  * Considering the buffer to be an array of bits, get the entry at
@@ -56,65 +142,80 @@ static void setBit(unsigned char * buffer, TSK_OFF_T index, bool val) {
 }
 
 /*
- * Move the file pointer to the given offset (relative the beginning of the file)
+ * Write a buffer to the VHD at the given offset (relative to the beginning of the file)
+ * @param what Description of the data for the error message
  */
-static TSK_RETVAL_ENUM seekToOffset(TSK_IMG_WRITER * writer, TSK_OFF_T offset) {
-    LARGE_INTEGER li;
-    li.QuadPart = offset;
-
-    li.LowPart = SetFilePointer(writer->outputFileHandle, li.LowPart,
-        &li.HighPart, FILE_BEGIN);
+static TSK_RETVAL_ENUM writeAt(TSK_IMG_WRITER * writer, TSK_OFF_T offset, const void *buffer,
+    size_t len, const char *what) {
+#ifdef TSK_WIN32
+    OVERLAPPED ov;
+    DWORD bytesWritten;
 
-    if ((li.LowPart == INVALID_SET_FILE_POINTER) &&
-        (GetLastError() != NO_ERROR)) {
+    memset(&ov, 0, sizeof(ov));
+    ov.Offset = (DWORD)(offset & 0xffffffff);
+    ov.OffsetHigh = (DWORD)(offset >> 32);
+    if ((FALSE == WriteFile(writer->outputFileHandle, buffer, (DWORD)len, &bytesWritten, &ov))
+        || (bytesWritten != len)) {
         int lastError = (int)GetLastError();
         tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_IMG_SEEK);
-        tsk_error_set_errstr("img_writer::seekToOffset: offset %" PRIuOFF " seek - %d",
-            offset,
-            lastError);
+        tsk_error_set_errno(TSK_ERR_IMG_WRITE);
+        tsk_error_set_errstr("img_writer: error writing %s at offset %" PRIuOFF " - %d",
+            what, offset, lastError);
         return TSK_ERR;
     }
+#else
+    size_t done = 0;
+    while (done < len) {
+        ssize_t cnt = pwrite(writer->outputFileHandle, (const char *)buffer + done, len - done,
+            (off_t)(offset + done));
+        if (cnt < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_IMG_WRITE);
+            tsk_error_set_errstr("img_writer: error writing %s at offset %" PRIuOFF " - %s",
+                what, offset, strerror(errno));
+            return TSK_ERR;
+        }
+        done += cnt;
+    }
+#endif
     return TSK_OK;
 }
 
 /*
- * Move the file pointer from the current location
+ * Get the status of a block. This can be called from any thread.
  */
-static TSK_RETVAL_ENUM seekAhead(TSK_IMG_WRITER * writer, TSK_OFF_T dist) {
-    LARGE_INTEGER li;
-    li.QuadPart = dist;
-
-    li.LowPart = SetFilePointer(writer->outputFileHandle, li.LowPart,
-        &li.HighPart, FILE_CURRENT);
+static IMG_WRITER_BLOCK_STATUS_ENUM getBlockStatus(TSK_IMG_WRITER* writer, uint32_t blockNum) {
+    tsk_take_lock(&(writer->queue->statusLock));
+    IMG_WRITER_BLOCK_STATUS_ENUM status = writer->blockStatus[blockNum];
+    tsk_release_lock(&(writer->queue->statusLock));
+    return status;
+}
 
-    if ((li.LowPart == INVALID_SET_FILE_POINTER) &&
-        (GetLastError() != NO_ERROR)) {
-        int lastError = (int)GetLastError();
-        tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_IMG_SEEK);
-        tsk_error_set_errstr("img_writer::seekAhead: offset %" PRIuOFF " seek - %d",
-            dist,
-            lastError);
-        return TSK_ERR;
-    }
-    return TSK_OK;
+static void setBlockStatus(TSK_IMG_WRITER* writer, uint32_t blockNum, IMG_WRITER_BLOCK_STATUS_ENUM status) {
+    tsk_take_lock(&(writer->queue->statusLock));
+    writer->blockStatus[blockNum] = status;
+    tsk_release_lock(&(writer->queue->statusLock));
 }
 
 /*
- * Use the sector bitmap to determine whether we're done writing data to a given block 
+ * Number of sectors in a block. The final block may not contain the full number of sectors.
  */
-static void checkIfBlockIsFinished(TSK_IMG_WRITER* writer, TSK_OFF_T blockNum) {
-
-    /* The final block may not contain the full number of sectors */
-    unsigned int nSectors;
+static unsigned int sectorsInBlock(TSK_IMG_WRITER* writer, uint32_t blockNum) {
     if ((blockNum == writer->totalBlocks - 1) && (writer->imageSize % writer->blockSize != 0)) {
-        nSectors = (writer->imageSize % writer->blockSize) / VHD_SECTOR_SIZE;
-    }
-    else {
-        nSectors = writer->sectorsPerBlock;
+        return (unsigned int)((writer->imageSize % writer->blockSize) / VHD_SECTOR_SIZE);
     }
+    return writer->sectorsPerBlock;
+}
+
+/*
+ * Use the sector bitmap to determine whether we're done writing data to a given block
+ */
+static void checkIfBlockIsFinished(TSK_IMG_WRITER* writer, uint32_t blockNum) {
 
+    unsigned int nSectors = sectorsInBlock(writer, blockNum);
     unsigned char * sectBitmap = writer->blockToSectorBitmap[blockNum];
     for (unsigned int i = 0; i < nSectors; i++) {
         if (false == getBit(sectBitmap, i)) {
@@ -124,184 +225,449 @@ static void checkIfBlockIsFinished(TSK_IMG_WRITER* writer, TSK_OFF_T blockNum) {
     }
 
     /* Mark the block as finished and free the memory for its sector bitmap */
-    writer->blockStatus[blockNum] = IMG_WRITER_BLOCK_STATUS_FINISHED;
+    setBlockStatus(writer, blockNum, IMG_WRITER_BLOCK_STATUS_FINISHED);
     free(writer->blockToSectorBitmap[blockNum]);
     writer->blockToSectorBitmap[blockNum] = NULL;
 }
 
 /*
- * Add a buffer of data to a previously started block in the VHD 
+ * Write a block that is not in the VHD yet: its BAT entry, its sector bitmap and
+ * all of its data (sectors that were not staged are zero).
  */
-static TSK_RETVAL_ENUM addToExistingBlock(TSK_IMG_WRITER* writer, TSK_OFF_T addr, char *buffer,
-    size_t len, TSK_OFF_T blockNum) {
+static TSK_RETVAL_ENUM writeNewBlock(TSK_IMG_WRITER* writer, uint32_t blockNum, STAGED_BLOCK * staged) {
 
     if (tsk_verbose) {
-        tsk_fprintf(stderr, "addToExistingBlock: Adding data to existing block 0x%x\n", blockNum);
+        tsk_fprintf(stderr, "writeNewBlock: Adding new block 0x%x\n", blockNum);
         fflush(stderr);
     }
 
-    /* Seek to where this buffer should start in the image */
-    if (TSK_OK != seekToOffset(writer, VHD_SECTOR_SIZE * TSK_OFF_T(writer->blockToSectorNumber[blockNum]) + writer->sectorBitmapLength +
-            (addr % writer->blockSize))) {
-        return TSK_ERR;
-    }
+    /* Given the max size of the VHD, the sector number will always fit in four bytes */
+    TSK_OFF_T dataOffset = writer->nextDataOffset;
+    uint32_t nextDataOffsetSector = uint32_t(dataOffset / VHD_SECTOR_SIZE);
 
-    /* Copy each sector that isn't already there */
-    for (size_t inputOffset = 0; inputOffset < len; inputOffset += VHD_SECTOR_SIZE) {
-        uint32_t currentSector = uint32_t((addr % writer->blockSize + inputOffset) / VHD_SECTOR_SIZE);
+    /* Prepare the new block offset - this is stored in big-endian order */
+    unsigned char newBlockOffset[4];
+    newBlockOffset[0] = (nextDataOffsetSector >> 24) & 0xff;
+    newBlockOffset[1] = (nextDataOffsetSector >> 16) & 0xff;
+    newBlockOffset[2] = (nextDataOffsetSector >> 8) & 0xff;
+    newBlockOffset[3] = nextDataOffsetSector & 0xff;
 
-        if (getBit(writer->blockToSectorBitmap[blockNum], currentSector)) {
-            if (TSK_OK != seekAhead(writer, VHD_SECTOR_SIZE)) {
-                return TSK_ERR;
-            }
-        }
-        else {
-            
-            DWORD bytesWritten;
-            if (FALSE == WriteFile(writer->outputFileHandle, &(buffer[inputOffset]), VHD_SECTOR_SIZE, 
-                    &bytesWritten, NULL)) {
-                int lastError = GetLastError();
-                tsk_error_reset();
-                tsk_error_set_errno(TSK_ERR_IMG_WRITE);
-                tsk_error_set_errstr("addToExistingBlock: error writing sector",
-                    lastError);
-                return TSK_ERR;
-            }
-            setBit(writer->blockToSectorBitmap[blockNum], currentSector, true);
-        }
+    /* Write the sector bitmap (padded out to a whole sector) and the data */
+    unsigned char * sectorBitmap = (unsigned char *)tsk_malloc(writer->sectorBitmapLength);
+    if (sectorBitmap == NULL) {
+        return TSK_ERR;
+    }
+    memcpy(sectorBitmap, staged->bitmap, writer->sectorBitmapArrayLength);
+    TSK_RETVAL_ENUM retval = writeAt(writer, dataOffset, sectorBitmap, writer->sectorBitmapLength,
+        "sector bitmap");
+    free(sectorBitmap);
+    if ((retval != TSK_OK)
+        || (writeAt(writer, dataOffset + writer->sectorBitmapLength, staged->data, writer->blockSize,
+            "block data") != TSK_OK)) {
+        return TSK_ERR;
     }
 
-    /* Update the sector bitmap */
-    if (TSK_OK != seekToOffset(writer, VHD_SECTOR_SIZE * TSK_OFF_T(writer->blockToSectorNumber[blockNum]))) {
+    /* Update the offset where the next block will start */
+    writer->nextDataOffset += writer->sectorBitmapLength + writer->blockSize;
+
+    /* Always add the footer on to make it a valid VHD */
+    if (writeFooter(writer, writer->nextDataOffset) != TSK_OK) {
         return TSK_ERR;
     }
-    
-    DWORD bytesWritten;
-    if (FALSE == WriteFile(writer->outputFileHandle, writer->blockToSectorBitmap[blockNum], 
-            writer->sectorBitmapArrayLength, &bytesWritten, NULL)) {
-        int lastError = GetLastError();
-        tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_IMG_WRITE);
-        tsk_error_set_errstr("addToExistingBlock: error writing sector",
-            lastError);
+
+    /* Write the new offset to the BAT once the block is there */
+    if (writeAt(writer, writer->batOffset + 4 * TSK_OFF_T(blockNum), newBlockOffset, 4,
+            "BAT entry") != TSK_OK) {
         return TSK_ERR;
     }
 
+    /* The staged bitmap becomes the bitmap of the block */
+    writer->blockToSectorNumber[blockNum] = nextDataOffsetSector;
+    setBlockStatus(writer, blockNum, IMG_WRITER_BLOCK_STATUS_ALLOC);
+    writer->blockToSectorBitmap[blockNum] = staged->bitmap;
+    staged->bitmap = NULL;
+
     return TSK_OK;
 }
 
-/* 
- * Add a new block to the VHD and copy in the buffer
+/*
+ * Write the staged sectors of a block that is already in the VHD. Each run of
+ * consecutive sectors that are not in the VHD yet is written at once, then
+ * the sector bitmap is updated.
  */
-static TSK_RETVAL_ENUM addNewBlock(TSK_IMG_WRITER* writer, TSK_OFF_T addr, char *buffer, size_t len, TSK_OFF_T blockNum) {
+static TSK_RETVAL_ENUM writeToExistingBlock(TSK_IMG_WRITER* writer, uint32_t blockNum, STAGED_BLOCK * staged) {
 
     if (tsk_verbose) {
-        tsk_fprintf(stderr, "addNewBlock: Adding new block 0x%x\n", blockNum);
+        tsk_fprintf(stderr, "writeToExistingBlock: Adding data to existing block 0x%x\n", blockNum);
         fflush(stderr);
     }
 
-    writer->blockStatus[blockNum] = IMG_WRITER_BLOCK_STATUS_ALLOC;
+    unsigned char * diskBitmap = writer->blockToSectorBitmap[blockNum];
+    TSK_OFF_T blockOffset = VHD_SECTOR_SIZE * TSK_OFF_T(writer->blockToSectorNumber[blockNum]);
+    TSK_OFF_T blockDataOffset = blockOffset + writer->sectorBitmapLength;
 
-    /* Given the max size of the VHD, the sector number will always fit in four bytes */
-    writer->blockToSectorNumber[blockNum] = uint32_t(writer->nextDataOffset / VHD_SECTOR_SIZE);
+    uint32_t sector = 0;
+    while (sector < writer->sectorsPerBlock) {
+        if ((false == getBit(staged->bitmap, sector)) || getBit(diskBitmap, sector)) {
+            sector++;
+            continue;
+        }
 
-    char * fullBuffer = (char *)tsk_malloc(writer->blockSize * sizeof(char));
-    char * sectorBitmap = (char *)tsk_malloc(writer->sectorBitmapLength * sizeof(char));
-    unsigned char * completedSectors = (unsigned char *)tsk_malloc(((writer->sectorBitmapArrayLength) * sizeof(char)));
+        uint32_t runEnd = sector + 1;
+        while ((runEnd < writer->sectorsPerBlock) && getBit(staged->bitmap, runEnd)
+            && (false == getBit(diskBitmap, runEnd))) {
+            runEnd++;
+        }
 
-    /* Create the full new block and record the sectors written */
-    TSK_OFF_T startingOffset = addr % writer->blockSize;
-    for (size_t i = 0; i < len; i++) {
+        if (writeAt(writer, blockDataOffset + TSK_OFF_T(sector) * VHD_SECTOR_SIZE,
+                &(staged->data[sector * VHD_SECTOR_SIZE]), (runEnd - sector) * VHD_SECTOR_SIZE,
+                "sectors") != TSK_OK) {
+            return TSK_ERR;
+        }
+        for (; sector < runEnd; sector++) {
+            setBit(diskBitmap, sector, true);
+        }
+    }
 
-        /* Update the sector bitmap */
-        if (((startingOffset + i) % VHD_SECTOR_SIZE) == 0) {
-            TSK_OFF_T currentSector = (startingOffset + i) / VHD_SECTOR_SIZE;
-            setBit(completedSectors, currentSector, true);
-            sectorBitmap[currentSector / 8] = completedSectors[currentSector / 8];
+    /* Update the sector bitmap */
+    return writeAt(writer, blockOffset, diskBitmap, writer->sectorBitmapArrayLength, "sector bitmap");
+}
+
+/*
+ * Check whether a buffer is all zeros. It is read a word at a time.
+ */
+static bool isZero(const char *buffer, size_t len) {
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        uint64_t val;
+        memcpy(&val, &buffer[i], sizeof(val));
+        if (val != 0) {
+            return false;
         }
+    }
+    for (; i < len; i++) {
+        if (buffer[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
 
-        fullBuffer[startingOffset + i] = buffer[i];
+/*
+ * Check whether a staged block that is not in the VHD yet has all of its
+ * sectors and they are all zeros. Such a block is left out of the VHD: its
+ * BAT entry stays unused and readers treat it as zeros.
+ */
+static bool isCompleteZeroBlock(TSK_IMG_WRITER* writer, uint32_t blockNum, STAGED_BLOCK * staged) {
+    if (writer->blockStatus[blockNum] != IMG_WRITER_BLOCK_STATUS_UNALLOC) {
+        return false;
+    }
+    unsigned int nSectors = sectorsInBlock(writer, blockNum);
+    for (unsigned int i = 0; i < nSectors; i++) {
+        if (false == getBit(staged->bitmap, i)) {
+            return false;
+        }
     }
-    writer->blockToSectorBitmap[blockNum] = completedSectors;
+    return isZero(staged->data, writer->blockSize);
+}
 
-    /* Prepare the new block offset - this is stored in big-endian order */
-    TSK_OFF_T nextDataOffsetSector = writer->nextDataOffset / VHD_SECTOR_SIZE;
-    unsigned char newBlockOffset[4];
-    newBlockOffset[0] = (nextDataOffsetSector >> 24) & 0xff;
-    newBlockOffset[1] = (nextDataOffsetSector >> 16) & 0xff;
-    newBlockOffset[2] = (nextDataOffsetSector >> 8) & 0xff;
-    newBlockOffset[3] = nextDataOffsetSector & 0xff;
+/*
+ * Write a staged block to the VHD and remove it from the staged blocks.
+ */
+static void flushStagedBlock(TSK_IMG_WRITER* writer, uint32_t blockNum) {
+    TSK_IMG_WRITER_QUEUE * queue = writer->queue;
+    std::map<uint32_t, STAGED_BLOCK>::iterator it = queue->staged.find(blockNum);
+    if (it == queue->staged.end()) {
+        return;
+    }
 
-    /* Write the new offset to the BAT */
-    if (TSK_OK != seekToOffset(writer, writer->batOffset + 4 * blockNum)) {
-        return TSK_ERR;
+    if (isCompleteZeroBlock(writer, blockNum, &(it->second))) {
+        if (tsk_verbose) {
+            tsk_fprintf(stderr, "flushStagedBlock: Leaving out zero block 0x%x\n", blockNum);
+        }
+        setBlockStatus(writer, blockNum, IMG_WRITER_BLOCK_STATUS_FINISHED);
     }
-    DWORD bytesWritten;
-    if (FALSE == WriteFile(writer->outputFileHandle, newBlockOffset, 4, &bytesWritten, NULL)) {
-        int lastError = GetLastError();
-        tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_IMG_WRITE);
-        tsk_error_set_errstr("addNewBlock: error writing BAT entry",
-            lastError);
-        return TSK_ERR;
+    else {
+        TSK_RETVAL_ENUM retval;
+        if (writer->blockStatus[blockNum] == IMG_WRITER_BLOCK_STATUS_ALLOC) {
+            retval = writeToExistingBlock(writer, blockNum, &(it->second));
+        }
+        else {
+            retval = writeNewBlock(writer, blockNum, &(it->second));
+        }
+
+        if (retval != TSK_OK) {
+            if (tsk_verbose) {
+                tsk_fprintf(stderr, "flushStagedBlock: ");
+                tsk_error_print(stderr);
+            }
+            queue->failed = true;
+        }
+        else {
+            /* Check whether the block is now done */
+            checkIfBlockIsFinished(writer, blockNum);
+        }
     }
 
-    /* Write the sector bitmap and the data */
-    if (TSK_OK != seekToOffset(writer, writer->nextDataOffset)) {
-        return TSK_ERR;
+    free(it->second.data);
+    free(it->second.bitmap);
+    queue->lru.erase(it->second.lruPos);
+    queue->staged.erase(it);
+}
+
+/*
+ * Copy data that is inside of one block into the staged copy of the block.
+ * The block is written once all of its sectors are either staged or already
+ * in the VHD, or when it is the least recently used block and room is needed
+ * for another.
+ */
+static void stageData(TSK_IMG_WRITER* writer, TSK_OFF_T addr, const char *buffer, size_t len) {
+    TSK_IMG_WRITER_QUEUE * queue = writer->queue;
+    uint32_t blockNum = uint32_t(addr / writer->blockSize);
+    size_t startingOffset = size_t(addr % writer->blockSize);
+
+    if (writer->blockStatus[blockNum] == IMG_WRITER_BLOCK_STATUS_FINISHED) {
+        return;
     }
-    if (FALSE == WriteFile(writer->outputFileHandle, sectorBitmap, writer->sectorBitmapLength, &bytesWritten, NULL)) {
-        int lastError = GetLastError();
-        tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_IMG_WRITE);
-        tsk_error_set_errstr("addNewBlock: error writing sector bitmap",
-            lastError);
-        return TSK_ERR;
+
+    std::map<uint32_t, STAGED_BLOCK>::iterator it = queue->staged.find(blockNum);
+    if (it == queue->staged.end()) {
+        if (queue->staged.size() >= IMG_WRITER_MAX_STAGED) {
+            flushStagedBlock(writer, queue->lru.back());
+        }
+
+        STAGED_BLOCK staged;
+        staged.data = (char *)tsk_malloc(writer->blockSize);
+        staged.bitmap = (unsigned char *)tsk_malloc(writer->sectorBitmapArrayLength);
+        if ((staged.data == NULL) || (staged.bitmap == NULL)) {
+            free(staged.data);
+            free(staged.bitmap);
+            queue->failed = true;
+            return;
+        }
+        queue->lru.push_front(blockNum);
+        staged.lruPos = queue->lru.begin();
+        it = queue->staged.insert(std::make_pair(blockNum, staged)).first;
     }
-    if (FALSE == WriteFile(writer->outputFileHandle, fullBuffer, writer->blockSize, &bytesWritten, NULL)) {
-        int lastError = GetLastError();
-        tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_IMG_WRITE);
-        tsk_error_set_errstr("addNewBlock: error writing block data",
-            lastError);
-        return TSK_ERR;
+    else {
+        queue->lru.splice(queue->lru.begin(), queue->lru, it->second.lruPos);
     }
 
-    /* Update the offset where the next block will start */
-    writer->nextDataOffset += writer->sectorBitmapLength + writer->blockSize;
+    /* Record the sectors that start in this buffer */
+    STAGED_BLOCK & staged = it->second;
+    memcpy(&(staged.data[startingOffset]), buffer, len);
+    for (size_t i = 0; i < len; i += VHD_SECTOR_SIZE) {
+        setBit(staged.bitmap, (startingOffset + i) / VHD_SECTOR_SIZE, true);
+    }
 
-    /* Always add the footer on to make it a valid VHD */
-    writeFooter(writer);
+    unsigned int nSectors = sectorsInBlock(writer, blockNum);
+    unsigned char * diskBitmap = writer->blockToSectorBitmap[blockNum];
+    for (unsigned int i = 0; i < nSectors; i++) {
+        if ((false == getBit(staged.bitmap, i)) &&
+            ((diskBitmap == NULL) || (false == getBit(diskBitmap, i)))) {
+            return;
+        }
+    }
+    flushStagedBlock(writer, blockNum);
+}
 
-    free(fullBuffer);
-    free(sectorBitmap);
+/*
+ * Stage a request, which can span several blocks.
+ */
+static void applyRequest(TSK_IMG_WRITER* writer, TSK_OFF_T addr, const char *buffer, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        TSK_OFF_T cur = addr + done;
+        if (cur >= writer->imageSize) {
+            break;
+        }
+        size_t cnt = writer->blockSize - size_t(cur % writer->blockSize);
+        if (cnt > len - done) {
+            cnt = len - done;
+        }
+        stageData(writer, cur, &buffer[done], cnt);
+        done += cnt;
+    }
+}
 
-    return TSK_OK;
+/*
+ * Write all of the staged blocks.
+ */
+static void flushAllStaged(TSK_IMG_WRITER* writer) {
+    TSK_IMG_WRITER_QUEUE * queue = writer->queue;
+    while (false == queue->lru.empty()) {
+        flushStagedBlock(writer, queue->lru.back());
+    }
 }
 
 /*
- * Add a buffer that fits in a single block of the VHD 
+ * Main loop of the writer thread. It stages the queued requests in order and
+ * writes all of the staged blocks when asked to flush or stop.
  */
-static TSK_RETVAL_ENUM addBlock(TSK_IMG_WRITER* writer, TSK_OFF_T addr, char *buffer, size_t len) {
-    TSK_OFF_T blockNum = addr / writer->blockSize;
+static void writerLoop(TSK_IMG_WRITER* writer) {
+    TSK_IMG_WRITER_QUEUE * queue = writer->queue;
+
+    tsk_take_lock(&(queue->lock));
+    while (true) {
+        if (false == queue->requests.empty()) {
+            WRITER_REQUEST request = queue->requests.front();
+            queue->requests.pop_front();
+            queue->queuedBytes -= request.len;
+            signalQueue(queue);
+            tsk_release_lock(&(queue->lock));
+
+            applyRequest(writer, request.addr, request.data, request.len);
+            free(request.data);
+
+            tsk_take_lock(&(queue->lock));
+        }
+        else if ((queue->flushDone < queue->flushRequested) || queue->stop) {
+            uint64_t flushing = queue->flushRequested;
+            bool stop = queue->stop;
+            tsk_release_lock(&(queue->lock));
+
+            flushAllStaged(writer);
+
+            tsk_take_lock(&(queue->lock));
+            queue->flushDone = flushing;
+            signalQueue(queue);
+            if (stop) {
+                break;
+            }
+        }
+        else {
+            waitForQueue(queue);
+        }
+    }
+    tsk_release_lock(&(queue->lock));
+}
 
-    if (writer->blockStatus[blockNum] == IMG_WRITER_BLOCK_STATUS_FINISHED){
-        return TSK_OK;
+#ifdef TSK_MULTITHREAD_LIB
+#ifdef TSK_WIN32
+static unsigned __stdcall writerThread(void *arg) {
+    writerLoop((TSK_IMG_WRITER*)arg);
+    return 0;
+}
+#else
+static void * writerThread(void *arg) {
+    writerLoop((TSK_IMG_WRITER*)arg);
+    return NULL;
+}
+#endif
+#endif
+
+/*
+ * Queue data for the writer thread, which frees it. Waits while the queue is full.
+ * If there is no writer thread, the data is written before this returns.
+ */
+static void queueRequest(TSK_IMG_WRITER* writer, TSK_OFF_T addr, char *data, size_t len) {
+    TSK_IMG_WRITER_QUEUE * queue = writer->queue;
+
+    tsk_take_lock(&(queue->lock));
+    if (false == queue->started) {
+        applyRequest(writer, addr, data, len);
+        tsk_release_lock(&(queue->lock));
+        free(data);
+        return;
     }
 
-    if (writer->blockStatus[blockNum] == IMG_WRITER_BLOCK_STATUS_ALLOC) {
-        addToExistingBlock(writer, addr, buffer, len, blockNum);
+    while (queue->queuedBytes >= IMG_WRITER_MAX_QUEUED) {
+        waitForQueue(queue);
+    }
+    WRITER_REQUEST request;
+    request.addr = addr;
+    request.data = data;
+    request.len = len;
+    queue->requests.push_back(request);
+    queue->queuedBytes += len;
+    signalQueue(queue);
+    tsk_release_lock(&(queue->lock));
+}
+
+/*
+ * Wait until everything that was queued before this call has been written,
+ * including the blocks that are only partly staged.
+ * @returns TSK_ERR if anything could not be written
+ */
+static TSK_RETVAL_ENUM flushQueue(TSK_IMG_WRITER* writer) {
+    TSK_IMG_WRITER_QUEUE * queue = writer->queue;
+
+    tsk_take_lock(&(queue->lock));
+    if (queue->started) {
+        uint64_t flush = ++queue->flushRequested;
+        signalQueue(queue);
+        while (queue->flushDone < flush) {
+            waitForQueue(queue);
+        }
     }
     else {
-        addNewBlock(writer, addr, buffer, len, blockNum);
+        flushAllStaged(writer);
     }
+    bool failed = queue->failed;
+    tsk_release_lock(&(queue->lock));
 
-    /* Check whether the block is now done */
-    checkIfBlockIsFinished(writer, blockNum);
-
+    if (failed) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_WRITE);
+        tsk_error_set_errstr("img_writer: error writing to \"%" PRIttocTSK "\"", writer->fileName);
+        return TSK_ERR;
+    }
     return TSK_OK;
 }
 
+/*
+ * Start the writer thread. If it can not be started, the data is written
+ * by the threads that add it.
+ */
+static void startWriterThread(TSK_IMG_WRITER* writer) {
+    TSK_IMG_WRITER_QUEUE * queue = writer->queue;
+    queue->started = false;
+#ifdef TSK_MULTITHREAD_LIB
+#ifdef TSK_WIN32
+    InitializeConditionVariable(&(queue->changed));
+    queue->thread = (HANDLE)_beginthreadex(NULL, 0, writerThread, writer, 0, NULL);
+    queue->started = (queue->thread != 0);
+#else
+    pthread_cond_init(&(queue->changed), NULL);
+    queue->started = (pthread_create(&(queue->thread), NULL, writerThread, writer) == 0);
+#endif
+#endif
+    if ((false == queue->started) && tsk_verbose) {
+        tsk_fprintf(stderr, "startWriterThread: writing without a writer thread\n");
+    }
+}
+
+/*
+ * Stop the writer thread once it has written everything that is queued and staged.
+ */
+static void stopWriterThread(TSK_IMG_WRITER* writer) {
+    TSK_IMG_WRITER_QUEUE * queue = writer->queue;
+
+    if (false == queue->started) {
+        tsk_take_lock(&(queue->lock));
+        flushAllStaged(writer);
+        tsk_release_lock(&(queue->lock));
+    }
+#ifdef TSK_MULTITHREAD_LIB
+    else {
+        tsk_take_lock(&(queue->lock));
+        queue->stop = true;
+        signalQueue(queue);
+        tsk_release_lock(&(queue->lock));
+#ifdef TSK_WIN32
+        WaitForSingleObject(queue->thread, INFINITE);
+        CloseHandle(queue->thread);
+#else
+        pthread_join(queue->thread, NULL);
+#endif
+        queue->started = false;
+    }
+#ifndef TSK_WIN32
+    pthread_cond_destroy(&(queue->changed));
+#endif
+#endif
+}
+
 
 /*
 * Utility function to write integer values to the VHD headers.
@@ -338,13 +704,15 @@ static uint32_t generateChecksum(unsigned char * buffer, int len) {
 }
 
 /*
-* Write the footer (which is also the first sector) to the file.
-* Will write to the current file position.
+* Write the footer (which is also the first sector) to the file at the given offset.
 * Save it so we only have to generate it once.
 */
-static TSK_RETVAL_ENUM writeFooter(TSK_IMG_WRITER* writer) {
+static TSK_RETVAL_ENUM writeFooter(TSK_IMG_WRITER* writer, TSK_OFF_T offset) {
     if (writer->footer == NULL) {
         writer->footer = (unsigned char *)tsk_malloc(VHD_FOOTER_LENGTH * sizeof(unsigned char));
+        if (writer->footer == NULL) {
+            return TSK_ERR;
+        }
 
         /* First calculate geometry values */
         uint32_t cylinders;
@@ -405,26 +773,15 @@ static TSK_RETVAL_ENUM writeFooter(TSK_IMG_WRITER* writer) {
         addIntToBuffer(writer->footer, 0x40, generateChecksum(writer->footer, VHD_FOOTER_LENGTH), 4); // Checksum
     }
 
-    DWORD bytesWritten;
-    if (FALSE == WriteFile(writer->outputFileHandle, writer->footer, VHD_FOOTER_LENGTH, &bytesWritten, NULL)) {
-        int lastError = GetLastError();
-        tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_IMG_WRITE);
-        tsk_error_set_errstr("writeFooter: error writing VHD footer",
-            lastError);
-        return TSK_ERR;
-    }
-    return TSK_OK;
+    return writeAt(writer, offset, writer->footer, VHD_FOOTER_LENGTH, "VHD footer");
 }
 
 /*
 * Write the dynamic disk header to the file
 */
 static TSK_RETVAL_ENUM writeDynamicDiskHeader(TSK_IMG_WRITER * writer) {
-    unsigned char * diskHeader = (unsigned char *)malloc(VHD_DISK_HEADER_LENGTH * sizeof(unsigned char));
-    for (int i = 0; i < VHD_DISK_HEADER_LENGTH; i++) {
-        diskHeader[i] = 0;
-    }
+    unsigned char diskHeader[VHD_DISK_HEADER_LENGTH];
+    memset(diskHeader, 0, VHD_DISK_HEADER_LENGTH);
 
     addStringToBuffer(diskHeader, 0, "cxsparse", 8); // Cookie
     addIntToBuffer(diskHeader, 8, 0xffffffff, 4);    // Data offset (1)
@@ -435,21 +792,14 @@ static TSK_RETVAL_ENUM writeDynamicDiskHeader(TSK_IMG_WRITER * writer) {
     addIntToBuffer(diskHeader, 0x20, writer->blockSize, 4);   // Block size
     addIntToBuffer(diskHeader, 0x24, generateChecksum(diskHeader, 0x400), 4); // Checksum
 
-    DWORD bytesWritten;
-    if (FALSE == WriteFile(writer->outputFileHandle, diskHeader, VHD_DISK_HEADER_LENGTH, &bytesWritten, NULL)) {
-        int lastError = GetLastError();
-        tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_IMG_WRITE);
-        tsk_error_set_errstr("writeFooter: error writing VHD header",
-            lastError);
-        return TSK_ERR;
-    }
-    return TSK_OK;
+    return writeAt(writer, VHD_FOOTER_LENGTH, diskHeader, VHD_DISK_HEADER_LENGTH, "VHD header");
 }
 
 
 /*
  * Add a buffer to the VHD. The buffer can span multiple blocks.
+ * The data is copied and written by the writer thread, so this does not wait
+ * for the disk unless the queue is full.
  * @param writer Image writer object
  * @param addr   Offset in the original image where the data starts
  * @param buffer The data to copy
@@ -473,37 +823,68 @@ static TSK_RETVAL_ENUM tsk_img_writer_add(TSK_IMG_WRITER* writer, TSK_OFF_T addr
         return TSK_ERR;
     }
 
-    if ((addr / writer->blockSize) == ((addr + len) / writer->blockSize)) {
-        /* The buffer is contained in a single block */
-        return addBlock(writer, addr, buffer, len);
+    if (len == 0) {
+        return TSK_OK;
     }
-    else {
-        /* The buffer spans two blocks */
-        TSK_OFF_T firstPartLength = writer->blockSize - (addr % writer->blockSize);
-        addBlock(writer, addr, buffer, firstPartLength);
-        if (addr + firstPartLength < writer->imageSize) {
-            addBlock(writer, addr + firstPartLength, buffer + firstPartLength, (addr + len) % writer->blockSize);
-        }
+
+    char * data = (char *)tsk_malloc(len);
+    if (data == NULL) {
+        return TSK_ERR;
     }
+    memcpy(data, buffer, len);
+    queueRequest(writer, addr, data, len);
 
     return TSK_OK;
 }
 
 /*
- * Close the image writer and free its memory
+ * Close the image writer and free its memory. Everything that was added
+ * is written first.
  * @param writer Image writer object
  */
 static TSK_RETVAL_ENUM tsk_img_writer_close(TSK_IMG_WRITER* img_writer) {
+    TSK_RETVAL_ENUM retval = TSK_OK;
 
     if (tsk_verbose) {
         tsk_fprintf(stderr,
-            "tsk_img_writer_close: Closing image writer");
+            "tsk_img_writer_close: Closing image writer\n");
+    }
+
+    if (img_writer->queue != NULL) {
+        TSK_IMG_WRITER_QUEUE * queue = img_writer->queue;
+        stopWriterThread(img_writer);
+        if (queue->failed) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_IMG_WRITE);
+            tsk_error_set_errstr("tsk_img_writer_close: error writing to \"%" PRIttocTSK "\"",
+                img_writer->fileName);
+            retval = TSK_ERR;
+        }
+
+        for (std::deque<WRITER_REQUEST>::iterator it = queue->requests.begin(); it != queue->requests.end(); ++it) {
+            free(it->data);
+        }
+        for (std::map<uint32_t, STAGED_BLOCK>::iterator it = queue->staged.begin(); it != queue->staged.end(); ++it) {
+            free(it->second.data);
+            free(it->second.bitmap);
+        }
+        tsk_deinit_lock(&(queue->lock));
+        tsk_deinit_lock(&(queue->statusLock));
+        delete queue;
+        img_writer->queue = NULL;
     }
-    
-    if (img_writer->outputFileHandle != 0) {
+
+#ifdef TSK_WIN32
+    if (img_writer->outputFileHandle != INVALID_HANDLE_VALUE) {
         CloseHandle(img_writer->outputFileHandle);
-        img_writer->outputFileHandle = 0;
-    }	
+        img_writer->outputFileHandle = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (img_writer->outputFileHandle >= 0) {
+        close(img_writer->outputFileHandle);
+        img_writer->outputFileHandle = -1;
+    }
+#endif
 
     /* Free the memory */
     free(img_writer->blockToSectorNumber);
@@ -526,18 +907,163 @@ static TSK_RETVAL_ENUM tsk_img_writer_close(TSK_IMG_WRITER* img_writer) {
     free(img_writer->fileName);
     img_writer->fileName = NULL;
 
-    return TSK_OK;
+    return retval;
+}
+
+/* Shared by the threads of tsk_img_writer_finish_image */
+struct FINISH_CONTEXT {
+    TSK_IMG_WRITER* writer;
+    tsk_lock_t lock;            /* Protects the fields below */
+    uint32_t nextBlock;
+    uint32_t blocksDone;
+    bool failed;
+};
+
+/* One of the threads of tsk_img_writer_finish_image */
+struct FINISH_THREAD {
+    FINISH_CONTEXT * ctx;
+#ifdef TSK_MULTITHREAD_LIB
+#ifdef TSK_WIN32
+    HANDLE thread;
+#else
+    pthread_t thread;
+#endif
+#endif
+    bool started;
+};
+
+/*
+ * Read a block of the image with a handle of this thread's own.
+ * @returns false on error
+ */
+#ifdef TSK_WIN32
+static bool readSource(TSK_IMG_WRITER* writer, HANDLE fd, TSK_OFF_T offset, char *buffer, size_t len) {
+    IMG_RAW_INFO * raw_info = (IMG_RAW_INFO *)(writer->img_info);
+    OVERLAPPED ov;
+    DWORD nread = 0;
+
+    memset(&ov, 0, sizeof(ov));
+    ov.Offset = (DWORD)(offset & 0xffffffff);
+    ov.OffsetHigh = (DWORD)(offset >> 32);
+    BOOL ok = ReadFile(fd, buffer, (DWORD)len, &nread, &ov);
+
+    // Physical drives can return no data for a read that ends at the end of the device
+    if (ok && raw_info->is_winobj && (nread == 0) && (offset + (TSK_OFF_T)len == writer->imageSize)) {
+        nread = (DWORD)len;
+    }
+    return (ok != FALSE) && (nread == len);
+}
+#else
+static bool readSource(TSK_IMG_WRITER* writer, int fd, TSK_OFF_T offset, char *buffer, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t cnt = pread(fd, &buffer[done], len - done, (off_t)(offset + done));
+        if (cnt < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (cnt == 0) {
+            return false;
+        }
+        done += cnt;
+    }
+    return true;
+}
+#endif
+
+/*
+ * Read whole blocks that are not finished yet and queue them for the writer
+ * thread. Each thread has its own handle to the image so that the reads do
+ * not wait on each other or on the image's read lock.
+ */
+static void finishLoop(FINISH_CONTEXT * ctx) {
+    TSK_IMG_WRITER* writer = ctx->writer;
+
+#ifdef TSK_WIN32
+    HANDLE fd = CreateFile(writer->img_info->images[0], FILE_READ_DATA,
+        FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
+    if (fd == INVALID_HANDLE_VALUE) {
+#else
+    int fd = open(writer->img_info->images[0], O_RDONLY | O_BINARY);
+    if (fd < 0) {
+#endif
+        tsk_take_lock(&(ctx->lock));
+        ctx->failed = true;
+        tsk_release_lock(&(ctx->lock));
+        return;
+    }
+
+    while (true) {
+        tsk_take_lock(&(ctx->lock));
+        bool stop = ctx->failed || (ctx->nextBlock >= writer->totalBlocks);
+        uint32_t blockNum = ctx->nextBlock++;
+        tsk_release_lock(&(ctx->lock));
+        if (stop || writer->cancelFinish) {
+            break;
+        }
+
+        /* The writer thread may be finishing this block from other reads at the same time,
+         * in which case it ignores the data */
+        if (getBlockStatus(writer, blockNum) != IMG_WRITER_BLOCK_STATUS_FINISHED) {
+            TSK_OFF_T startOfBlock = TSK_OFF_T(blockNum) * writer->blockSize;
+            size_t len = writer->blockSize;
+            if (startOfBlock + (TSK_OFF_T)len > writer->imageSize) {
+                len = size_t(writer->imageSize - startOfBlock);
+            }
+
+            char * buffer = (char *)tsk_malloc(len);
+            if ((buffer == NULL) || (false == readSource(writer, fd, startOfBlock, buffer, len))) {
+                // this usually happens when the device has been unplugged
+                free(buffer);
+                tsk_take_lock(&(ctx->lock));
+                ctx->failed = true;
+                tsk_release_lock(&(ctx->lock));
+                break;
+            }
+            queueRequest(writer, startOfBlock, buffer, len);
+        }
+
+        /* Simple progress indicator - blocks done / totalBlocks (as an integer) */
+        tsk_take_lock(&(ctx->lock));
+        ctx->blocksDone++;
+        writer->finishProgress = (int)((TSK_OFF_T(ctx->blocksDone) * 100) / writer->totalBlocks);
+        tsk_release_lock(&(ctx->lock));
+    }
+
+#ifdef TSK_WIN32
+    CloseHandle(fd);
+#else
+    close(fd);
+#endif
+}
+
+#ifdef TSK_MULTITHREAD_LIB
+#ifdef TSK_WIN32
+static unsigned __stdcall finishThread(void *arg) {
+    finishLoop(((FINISH_THREAD *)arg)->ctx);
+    return 0;
+}
+#else
+static void * finishThread(void *arg) {
+    finishLoop(((FINISH_THREAD *)arg)->ctx);
+    return NULL;
 }
+#endif
+#endif
 
 /*
- * Will go through the image and manually read any incomplete blocks to
- * complete the image.
+ * Will go through the image and read any incomplete blocks to
+ * complete the image. Whole blocks are read by several threads at once
+ * and the calling thread is one of them. If a thread can not be started,
+ * the others do its share.
  * @param img_writer Image writer object
  */
 static TSK_RETVAL_ENUM tsk_img_writer_finish_image(TSK_IMG_WRITER* img_writer) {
     if (tsk_verbose) {
         tsk_fprintf(stderr,
-            "tsk_img_writer_finish_image: Finishing image");
+            "tsk_img_writer_finish_image: Finishing image\n");
     }
 
     if (img_writer->is_finished == 1) {
@@ -548,88 +1074,112 @@ static TSK_RETVAL_ENUM tsk_img_writer_finish_image(TSK_IMG_WRITER* img_writer) {
         return TSK_ERR;
     }
 
-    IMG_RAW_INFO * raw_info = (IMG_RAW_INFO *)(img_writer->img_info);
-    TSK_OFF_T offset;
-    TSK_OFF_T startOfBlock;
-
-    char * buffer = (char*)tsk_malloc(TSK_IMG_INFO_CACHE_LEN * sizeof(char));
-    for (TSK_OFF_T i = 0; i < img_writer->totalBlocks; i++) {
-        if (img_writer->cancelFinish) {
-            return TSK_ERR;
+    FINISH_CONTEXT ctx;
+    ctx.writer = img_writer;
+    tsk_init_lock(&(ctx.lock));
+    ctx.nextBlock = 0;
+    ctx.blocksDone = 0;
+    ctx.failed = false;
+
+    FINISH_THREAD threads[IMG_WRITER_FINISH_THREADS];
+    for (int i = 0; i < IMG_WRITER_FINISH_THREADS; i++) {
+        threads[i].ctx = &ctx;
+        threads[i].started = false;
+    }
+#ifdef TSK_MULTITHREAD_LIB
+    for (int i = 1; i < IMG_WRITER_FINISH_THREADS; i++) {
+#ifdef TSK_WIN32
+        threads[i].thread = (HANDLE)_beginthreadex(NULL, 0, finishThread, &threads[i], 0, NULL);
+        threads[i].started = (threads[i].thread != 0);
+#else
+        threads[i].started = (pthread_create(&(threads[i].thread), NULL, finishThread, &threads[i]) == 0);
+#endif
+    }
+#endif
+    finishLoop(&ctx);
+#ifdef TSK_MULTITHREAD_LIB
+    for (int i = 1; i < IMG_WRITER_FINISH_THREADS; i++) {
+        if (threads[i].started) {
+#ifdef TSK_WIN32
+            WaitForSingleObject(threads[i].thread, INFINITE);
+            CloseHandle(threads[i].thread);
+#else
+            pthread_join(threads[i].thread, NULL);
+#endif
         }
+    }
+#endif
+    tsk_deinit_lock(&(ctx.lock));
 
-        /* Simple progress indicator - current block / totalBlocks (as an integer)
-         */
-        img_writer->finishProgress = (int)((i * 100) / img_writer->totalBlocks);
-
-        if (img_writer->blockStatus[i] != IMG_WRITER_BLOCK_STATUS_FINISHED) {
-
-            /* Read in the entire block in cache-length chunks. Each read will lead to a call to
-             * tsk_img_writer_add with the new data.
-             * We don't use the sector bitmap here because there is a chance the memory will get freed by
-             * another thread running tsk_img_writer_add.
-            */
-            startOfBlock = i * img_writer->blockSize;
-            for(offset = startOfBlock; offset < startOfBlock + img_writer->blockSize;offset += TSK_IMG_INFO_CACHE_LEN){
-                if (img_writer->cancelFinish) {
-                    return TSK_ERR;
-                }
-                /* Using tsk_img_read here to make sure we get the lock */
-                if (tsk_img_read(img_writer->img_info, offset, buffer, TSK_IMG_INFO_CACHE_LEN) < 0) {
-                    // this usually happens when the device has been unplugged
-                    return TSK_ERR;
-                }
-            }
-            /* In Autopsy, tsk_img_writer_finish_image() was starving other threads that were trying to do
-             * basic reads and made the app impossible to use. Add the short sleep to give
-             * other threads a chance to get the underlying locks. */
-            Sleep(1);
-        }
+    /* Wait for the queued blocks to be written */
+    TSK_RETVAL_ENUM retval = flushQueue(img_writer);
+
+    if (img_writer->cancelFinish) {
+        return TSK_ERR;
+    }
+    if (ctx.failed) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_READ);
+        tsk_error_set_errstr("tsk_img_writer_finish_image: error reading \"%" PRIttocTSK "\"",
+            img_writer->img_info->images[0]);
+        return TSK_ERR;
+    }
+    if (retval != TSK_OK) {
+        return retval;
     }
 
     img_writer->is_finished = 1;
     return TSK_OK;
 }
 
-#endif
-
-/* Any method that can be accessed from WIN32 or non-WIN32 goes after this point */
+/*
+ * Free a writer whose creation failed and remove it from the image.
+ */
+static TSK_RETVAL_ENUM createFailed(IMG_RAW_INFO * raw_info) {
+    tsk_img_writer_close(raw_info->img_writer);
+    free(raw_info->img_writer);
+    raw_info->img_writer = NULL;
+    return TSK_ERR;
+}
 
 /*
  * Create and initialize the TSK_IMG_WRITER struct and save reference in img_info,
- * then write the headers to the output file
+ * then write the headers to the output file. If the output file name ends in
+ * ".tci", a TSK chunked image is written instead of a VHD.
  * @param img_info        the TSK_IMG_INFO object
- * @param outputFileName  path to the VHD
+ * @param outputFileName  path to the VHD or TCI file
  */
 TSK_RETVAL_ENUM tsk_img_writer_create(TSK_IMG_INFO * img_info, const TSK_TCHAR * outputFileName) {
-#ifndef TSK_WIN32
-    return TSK_ERR;
-#else
+#if HAVE_LIBZ
+    size_t nameLen = TSTRLEN(outputFileName);
+    if ((nameLen > 4) && (TSTRICMP(&outputFileName[nameLen - 4], _TSK_T(".tci")) == 0)) {
+        return tci_writer_create(img_info, outputFileName);
+    }
+#endif
+
     if (tsk_verbose) {
         tsk_fprintf(stderr,
             "tsk_img_writer_create: Creating image writer in %" PRIttocTSK"\n",
             outputFileName);
     }
 
-    /* Everything will break if the buffers coming in are larger than the block 
-       size (i.e., they could span three blocks instead of just two)*/
-    if (TSK_IMG_INFO_CACHE_LEN > VHD_DEFAULT_BLOCK_SIZE) {
+    /* This should not be run on split images*/
+    if ((img_info->itype != TSK_IMG_TYPE_RAW) || (img_info->num_img != 1)) {
         tsk_error_reset();
         tsk_error_set_errno(TSK_ERR_IMG_OPEN);
-        tsk_error_set_errstr("tsk_img_writer_create: tsk cache length is larger than the block size");
+        tsk_error_set_errstr("tsk_img_writer_create: image writer can only be used on single raw images");
         return TSK_ERR;
     }
 
-    IMG_RAW_INFO* raw_info = (IMG_RAW_INFO *)img_info;
-
-    /* This should not be run on split images*/
-    if (img_info->num_img != 1) {
+    if (img_info->size > VHD_MAX_IMAGE_SIZE) {
         tsk_error_reset();
         tsk_error_set_errno(TSK_ERR_IMG_OPEN);
-        tsk_error_set_errstr("tsk_img_writer_create: image writer can not be used on split images");
+        tsk_error_set_errstr("tsk_img_writer_create: image file is too large to copy");
         return TSK_ERR;
     }
 
+    IMG_RAW_INFO* raw_info = (IMG_RAW_INFO *)img_info;
+
     /* Initialize the img_writer object */
     if ((raw_info->img_writer = (TSK_IMG_WRITER *)tsk_malloc(sizeof(TSK_IMG_WRITER))) == NULL)
         return TSK_ERR;
@@ -642,18 +1192,20 @@ TSK_RETVAL_ENUM tsk_img_writer_create(TSK_IMG_INFO * img_info, const TSK_TCHAR *
     writer->add = tsk_img_writer_add;
     writer->close = tsk_img_writer_close;
     writer->finish_image = tsk_img_writer_finish_image;
+#ifdef TSK_WIN32
+    writer->outputFileHandle = INVALID_HANDLE_VALUE;
+#else
+    writer->outputFileHandle = -1;
+#endif
 
-    writer->fileName = (TSK_TCHAR*)tsk_malloc((TSTRLEN(outputFileName) + 1) * sizeof(TCHAR));
-    TSTRNCPY(writer->fileName, outputFileName, TSTRLEN(outputFileName) + 1);
+    size_t fileNameLen = TSTRLEN(outputFileName);
+    if ((writer->fileName = (TSK_TCHAR*)tsk_malloc((fileNameLen + 1) * sizeof(TSK_TCHAR))) == NULL) {
+        return createFailed(raw_info);
+    }
+    TSTRNCPY(writer->fileName, outputFileName, fileNameLen + 1);
 
     /* Calculation time */
     writer->imageSize = raw_info->img_info.size;
-    if (writer->imageSize > VHD_MAX_IMAGE_SIZE) {
-        tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_IMG_OPEN);
-        tsk_error_set_errstr("tsk_img_writer_create: image file is too large to copy");
-        return TSK_ERR;
-    }
     writer->blockSize = VHD_DEFAULT_BLOCK_SIZE;
     writer->totalBlocks = uint32_t(writer->imageSize / writer->blockSize);
     if (writer->imageSize % writer->blockSize != 0) {
@@ -670,34 +1222,35 @@ TSK_RETVAL_ENUM tsk_img_writer_create(TSK_IMG_INFO * img_info, const TSK_TCHAR *
     }
 
     /* TODO: Decide what to do if the file already exisits. For now, always overwrite */
+#ifdef TSK_WIN32
     writer->outputFileHandle = CreateFile(writer->fileName, FILE_WRITE_DATA,
         FILE_SHARE_READ, NULL, CREATE_ALWAYS, 0,
         NULL);
     if (writer->outputFileHandle == INVALID_HANDLE_VALUE) {
         int lastError = (int)GetLastError();
-        writer->outputFileHandle = 0; /* so we don't close it next time */
-
-        /* Close everything and free the memory */
-        tsk_img_writer_close(writer);
-        free(raw_info->img_writer);
-        raw_info->img_writer = NULL;
-
+        createFailed(raw_info);
         tsk_error_reset();
         tsk_error_set_errno(TSK_ERR_IMG_OPEN);
-        tsk_error_set_errstr("tsk_img_writer_create: error creating file \"%" PRIttocTSK "\"", outputFileName);
+        tsk_error_set_errstr("tsk_img_writer_create: error creating file \"%" PRIttocTSK "\" - %d",
+            outputFileName, lastError);
         return TSK_ERR;
     }
-
-    /* Write the backup copy of the footer */
-    TSK_RETVAL_ENUM retval = writeFooter(writer);
-    if (retval != TSK_OK) {
-        return retval;
+#else
+    writer->outputFileHandle = open(writer->fileName, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+    if (writer->outputFileHandle < 0) {
+        int lastError = errno;
+        createFailed(raw_info);
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_OPEN);
+        tsk_error_set_errstr("tsk_img_writer_create: error creating file \"%" PRIttocTSK "\" - %s",
+            outputFileName, strerror(lastError));
+        return TSK_ERR;
     }
+#endif
 
-    /* Write the dynamic disk header */
-    retval = writeDynamicDiskHeader(writer);
-    if (retval != TSK_OK) {
-        return retval;
+    /* Write the backup copy of the footer and the dynamic disk header */
+    if ((writeFooter(writer, 0) != TSK_OK) || (writeDynamicDiskHeader(writer) != TSK_OK)) {
+        return createFailed(raw_info);
     }
 
     /* Write the (empty) Block Allocation Table. Each entry is 4 bytes*/
@@ -708,18 +1261,16 @@ TSK_RETVAL_ENUM tsk_img_writer_create(TSK_IMG_INFO * img_info, const TSK_TCHAR *
         batLengthOnDisk += (VHD_SECTOR_SIZE - ((4 * writer->totalBlocks) % VHD_SECTOR_SIZE));
     }
 
-    DWORD bytesWritten;
-    unsigned char batBuf[4] = { 0xff, 0xff, 0xff, 0xff };
-    for (unsigned int i = 0; i < batLengthOnDisk / 4; i++) {
-        /* My understanding is that Windows will buffer all these making it no less efficient than 
-           writing the whole thing at once */
-        if (FALSE == WriteFile(writer->outputFileHandle, batBuf, 4, &bytesWritten, NULL)) {
-            int lastError = GetLastError();
-            tsk_error_reset();
-            tsk_error_set_errno(TSK_ERR_IMG_WRITE);
-            tsk_error_set_errstr("tsk_img_writer_create: Error writing block allocation table", lastError);
-            return TSK_ERR;
-        }
+    unsigned char * batBuf = (unsigned char *)tsk_malloc(batLengthOnDisk);
+    if (batBuf == NULL) {
+        return createFailed(raw_info);
+    }
+    memset(batBuf, 0xff, batLengthOnDisk);
+    TSK_RETVAL_ENUM retval = writeAt(writer, writer->batOffset, batBuf, batLengthOnDisk,
+        "block allocation table");
+    free(batBuf);
+    if (retval != TSK_OK) {
+        return createFailed(raw_info);
     }
 
     /* Offset for the first data block - 0x600 bytes for the two headers plus the BAT length*/
@@ -729,9 +1280,22 @@ TSK_RETVAL_ENUM tsk_img_writer_create(TSK_IMG_INFO * img_info, const TSK_TCHAR *
     writer->blockStatus = (IMG_WRITER_BLOCK_STATUS_ENUM*)tsk_malloc(writer->totalBlocks * sizeof(IMG_WRITER_BLOCK_STATUS_ENUM));
     writer->blockToSectorNumber = (uint32_t*)tsk_malloc(writer->totalBlocks * sizeof(uint32_t));
     writer->blockToSectorBitmap = (unsigned char **)tsk_malloc(writer->totalBlocks * sizeof(unsigned char *));
+    if ((writer->blockStatus == NULL) || (writer->blockToSectorNumber == NULL)
+        || (writer->blockToSectorBitmap == NULL)) {
+        return createFailed(raw_info);
+    }
+
+    /* Start the thread that writes the queued data */
+    TSK_IMG_WRITER_QUEUE * queue = new TSK_IMG_WRITER_QUEUE;
+    tsk_init_lock(&(queue->lock));
+    tsk_init_lock(&(queue->statusLock));
+    queue->queuedBytes = 0;
+    queue->flushRequested = 0;
+    queue->flushDone = 0;
+    queue->stop = false;
+    queue->failed = false;
+    writer->queue = queue;
+    startWriterThread(writer);
 
     return TSK_OK;
-#endif
 }
-
-
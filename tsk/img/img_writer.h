@@ -29,6 +29,7 @@ extern "C" {
     typedef enum IMG_WRITER_BLOCK_STATUS_ENUM IMG_WRITER_BLOCK_STATUS_ENUM;
 
     typedef struct TSK_IMG_WRITER TSK_IMG_WRITER;
+    typedef struct TSK_IMG_WRITER_QUEUE TSK_IMG_WRITER_QUEUE;
     struct TSK_IMG_WRITER {
         TSK_IMG_INFO * img_info;
         int is_finished;
@@ -57,6 +58,10 @@ extern "C" {
         uint32_t* blockToSectorNumber;
         unsigned char ** blockToSectorBitmap;
 
+        TSK_IMG_WRITER_QUEUE * queue;  ///< Data waiting for the writer thread (NULL for TCI)
+
+        struct TCI_WRITER * tci;       ///< State of the writer of a TSK chunked image (NULL for VHD)
+
         TSK_RETVAL_ENUM(*add)(TSK_IMG_WRITER* img_writer, TSK_OFF_T addr, char *buffer, size_t len);
         TSK_RETVAL_ENUM(*close)(TSK_IMG_WRITER* img_writer);
         TSK_RETVAL_ENUM(*finish_image)(TSK_IMG_WRITER* img_writer);
@@ -0,0 +1,895 @@
+/*
+ * Brian Carrier [carrier <at> sleuthkit [dot] org]
+ * Copyright (c) 2006-2016 Brian Carrier, Basis Technology.  All rights reserved
+ *
+ * This software is distributed under the Common Public License 1.0
+ *
+ */
+
+
+/** \file raid.c
+ * Internal code to read a RAID 0 or RAID 5 set whose members were acquired
+ * as separate disk images.  The members are opened as normal images and
+ * this code maps each byte of the logical device to a member.  When a read
+ * spans stripes on several members, each member is read by its own worker
+ * thread at the same time.  A RAID 5 set can be read with one member
+ * missing; its data is rebuilt from the parity.
+ */
+
+#include "tsk_img_i.h"
+#include "raid.h"
+
+static const char *
+raid_layout_name(TSK_IMG_RAID_LAYOUT_ENUM a_layout)
+{
+    switch (a_layout) {
+    case TSK_IMG_RAID_LAYOUT_LEFT_ASYMMETRIC:
+        return "left asymmetric";
+    case TSK_IMG_RAID_LAYOUT_LEFT_SYMMETRIC:
+        return "left symmetric";
+    case TSK_IMG_RAID_LAYOUT_RIGHT_ASYMMETRIC:
+        return "right asymmetric";
+    case TSK_IMG_RAID_LAYOUT_RIGHT_SYMMETRIC:
+        return "right symmetric";
+    }
+    return "unknown";
+}
+
+/**
+ * Find where a stripe of the logical device is stored.
+ * @param raid_info RAID set
+ * @param a_stripe Stripe number in the logical device
+ * @param a_member [out] Member that has the stripe
+ * @param a_member_off [out] Offset of the stripe in the member
+ */
+static void
+raid_map(IMG_RAID_INFO * raid_info, uint64_t a_stripe, int *a_member,
+    TSK_OFF_T * a_member_off)
+{
+    int n = raid_info->num_members;
+    uint64_t row;
+
+    if (raid_info->level == TSK_IMG_RAID_LEVEL_0) {
+        row = a_stripe / n;
+        *a_member = (int) (a_stripe % n);
+    }
+    else {
+        int data_idx;
+        int parity;
+
+        row = a_stripe / (n - 1);
+        data_idx = (int) (a_stripe % (n - 1));
+
+        if ((raid_info->layout == TSK_IMG_RAID_LAYOUT_LEFT_ASYMMETRIC)
+            || (raid_info->layout == TSK_IMG_RAID_LAYOUT_LEFT_SYMMETRIC))
+            parity = (n - 1) - (int) (row % n);
+        else
+            parity = (int) (row % n);
+
+        if ((raid_info->layout == TSK_IMG_RAID_LAYOUT_LEFT_SYMMETRIC)
+            || (raid_info->layout == TSK_IMG_RAID_LAYOUT_RIGHT_SYMMETRIC))
+            *a_member = (parity + 1 + data_idx) % n;
+        else
+            *a_member = (data_idx < parity) ? data_idx : data_idx + 1;
+    }
+
+    *a_member_off =
+        raid_info->data_offset + (TSK_OFF_T) row * raid_info->stripe_size;
+}
+
+/**
+ * Read bytes from a member.
+ * @returns 1 on error (the member read must return all of the bytes)
+ */
+static uint8_t
+raid_read_member(IMG_RAID_INFO * raid_info, int a_member,
+    TSK_OFF_T a_off, char *a_buf, size_t a_len)
+{
+    ssize_t cnt =
+        tsk_img_read(raid_info->members[a_member], a_off, a_buf, a_len);
+    return (cnt < 0 || (size_t) cnt != a_len) ? 1 : 0;
+}
+
+/**
+ * Rebuild data of the missing member of a RAID 5 set by XORing the same
+ * bytes of all of the other members (data and parity).
+ * @returns 1 on error
+ */
+static uint8_t
+raid_rebuild(IMG_RAID_INFO * raid_info, int a_missing, TSK_OFF_T a_off,
+    char *a_buf, size_t a_len)
+{
+    char *tmp;
+    int i;
+    size_t j;
+
+    if ((tmp = (char *) tsk_malloc(a_len)) == NULL)
+        return 1;
+
+    memset(a_buf, 0, a_len);
+    for (i = 0; i < raid_info->num_members; i++) {
+        if (i == a_missing)
+            continue;
+        if (raid_read_member(raid_info, i, a_off, tmp, a_len)) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_IMG_READ);
+            tsk_error_set_errstr("raid_rebuild: error reading member %d at %"
+                PRIuOFF " to rebuild member %d", i, a_off, a_missing);
+            free(tmp);
+            return 1;
+        }
+        for (j = 0; j < a_len; j++)
+            a_buf[j] ^= tmp[j];
+    }
+    free(tmp);
+    return 0;
+}
+
+/**
+ * Add a run of bytes to the part of a read that a member does.
+ * @returns 1 on error
+ */
+static uint8_t
+raid_add_segment(RAID_MEMBER_JOB * a_job, TSK_OFF_T a_off, char *a_buf,
+    size_t a_len)
+{
+    RAID_SEGMENT *seg;
+
+    // one run if it follows the last one in both the member and the buffer
+    if (a_job->num_segs > 0) {
+        seg = &a_job->segs[a_job->num_segs - 1];
+        if ((seg->member_off + (TSK_OFF_T) seg->len == a_off)
+            && (seg->buf + seg->len == a_buf)) {
+            seg->len += a_len;
+            return 0;
+        }
+    }
+
+    if (a_job->num_segs == a_job->segs_alloc) {
+        size_t new_alloc = a_job->segs_alloc ? a_job->segs_alloc * 2 : 16;
+        if ((seg =
+                (RAID_SEGMENT *) tsk_realloc(a_job->segs,
+                    new_alloc * sizeof(RAID_SEGMENT))) == NULL)
+            return 1;
+        a_job->segs = seg;
+        a_job->segs_alloc = new_alloc;
+    }
+    seg = &a_job->segs[a_job->num_segs++];
+    seg->member_off = a_off;
+    seg->buf = a_buf;
+    seg->len = a_len;
+    return 0;
+}
+
+/**
+ * Read all of the segments of a job.  Sets failed on error.
+ */
+static void
+raid_do_job(RAID_MEMBER_JOB * a_job)
+{
+    size_t i;
+
+    for (i = 0; i < a_job->num_segs; i++) {
+        if (raid_read_member(a_job->raid_info, a_job->member,
+                a_job->segs[i].member_off, a_job->segs[i].buf,
+                a_job->segs[i].len)) {
+            a_job->failed = 1;
+            return;
+        }
+    }
+}
+
+#ifdef TSK_WIN32
+static unsigned __stdcall
+raid_worker(void *a_arg)
+{
+    RAID_MEMBER_JOB *job = (RAID_MEMBER_JOB *) a_arg;
+    IMG_RAID_INFO *raid_info = job->raid_info;
+
+    while (1) {
+        WaitForSingleObject(job->go, INFINITE);
+        if (raid_info->stop)
+            break;
+        raid_do_job(job);
+        if (InterlockedDecrement(&raid_info->pending) == 0)
+            SetEvent(raid_info->done);
+    }
+    return 0;
+}
+#elif defined(TSK_MULTITHREAD_LIB)
+static void *
+raid_worker(void *a_arg)
+{
+    RAID_MEMBER_JOB *job = (RAID_MEMBER_JOB *) a_arg;
+    IMG_RAID_INFO *raid_info = job->raid_info;
+
+    pthread_mutex_lock(&raid_info->mutex);
+    while (1) {
+        while ((raid_info->stop == 0) && (job->active == 0))
+            pthread_cond_wait(&raid_info->go_cond, &raid_info->mutex);
+        if (raid_info->stop)
+            break;
+        pthread_mutex_unlock(&raid_info->mutex);
+
+        raid_do_job(job);
+
+        pthread_mutex_lock(&raid_info->mutex);
+        job->active = 0;
+        if (--raid_info->pending == 0)
+            pthread_cond_signal(&raid_info->done_cond);
+    }
+    pthread_mutex_unlock(&raid_info->mutex);
+    return NULL;
+}
+#endif
+
+/**
+ * Read the segments of all of the members.  The calling thread reads one
+ * member and the workers read the others at the same time.
+ * @returns 1 on error
+ */
+static uint8_t
+raid_run_jobs(IMG_RAID_INFO * raid_info)
+{
+    RAID_MEMBER_JOB *first = NULL;
+    int num_jobs = 0;
+    int i;
+
+    for (i = 0; i < raid_info->num_members; i++) {
+        if (raid_info->jobs[i].num_segs == 0)
+            continue;
+        if (first == NULL)
+            first = &raid_info->jobs[i];
+        num_jobs++;
+    }
+
+#if defined(TSK_WIN32) || defined(TSK_MULTITHREAD_LIB)
+    if (num_jobs > 1) {
+#ifdef TSK_WIN32
+        raid_info->pending = num_jobs - 1;
+        ResetEvent(raid_info->done);
+        for (i = 0; i < raid_info->num_members; i++) {
+            if ((raid_info->jobs[i].num_segs > 0)
+                && (&raid_info->jobs[i] != first))
+                SetEvent(raid_info->jobs[i].go);
+        }
+        raid_do_job(first);
+        WaitForSingleObject(raid_info->done, INFINITE);
+#else
+        pthread_mutex_lock(&raid_info->mutex);
+        raid_info->pending = num_jobs - 1;
+        for (i = 0; i < raid_info->num_members; i++) {
+            if ((raid_info->jobs[i].num_segs > 0)
+                && (&raid_info->jobs[i] != first))
+                raid_info->jobs[i].active = 1;
+        }
+        pthread_cond_broadcast(&raid_info->go_cond);
+        pthread_mutex_unlock(&raid_info->mutex);
+
+        raid_do_job(first);
+
+        pthread_mutex_lock(&raid_info->mutex);
+        while (raid_info->pending > 0)
+            pthread_cond_wait(&raid_info->done_cond, &raid_info->mutex);
+        pthread_mutex_unlock(&raid_info->mutex);
+#endif
+    }
+    else
+#endif
+    if (first != NULL) {
+        raid_do_job(first);
+    }
+
+    for (i = 0; i < raid_info->num_members; i++) {
+        if (raid_info->jobs[i].failed) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_IMG_READ);
+            tsk_error_set_errstr("raid_image_read: error reading member %d",
+                i);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static ssize_t
+raid_image_read(TSK_IMG_INFO * img_info, TSK_OFF_T offset, char *buf,
+    size_t len)
+{
+    IMG_RAID_INFO *raid_info = (IMG_RAID_INFO *) img_info;
+    size_t stripe_size = raid_info->stripe_size;
+    size_t done = 0;
+    uint8_t use_workers = 0;
+    uint8_t failed = 0;
+    int i;
+
+    if (tsk_verbose)
+        tsk_fprintf(stderr,
+            "raid_image_read: byte offset: %" PRIuOFF " len: %" PRIuSIZE
+            "\n", offset, len);
+
+    if (offset > img_info->size) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_READ_OFF);
+        tsk_error_set_errstr("raid_image_read - %" PRIuOFF, offset);
+        return -1;
+    }
+    if ((TSK_OFF_T) len > img_info->size - offset)
+        len = (size_t) (img_info->size - offset);
+
+    // the workers are used by one read at a time
+    if (raid_info->num_threads > 0) {
+        tsk_take_lock(&raid_info->busy_lock);
+        if (raid_info->busy == 0) {
+            raid_info->busy = 1;
+            use_workers = 1;
+        }
+        tsk_release_lock(&raid_info->busy_lock);
+    }
+    if (use_workers) {
+        for (i = 0; i < raid_info->num_members; i++) {
+            raid_info->jobs[i].num_segs = 0;
+            raid_info->jobs[i].failed = 0;
+        }
+    }
+
+    while (done < len) {
+        TSK_OFF_T cur_off = offset + (TSK_OFF_T) done;
+        uint64_t stripe = (uint64_t) (cur_off / stripe_size);
+        size_t rel_off = (size_t) (cur_off % stripe_size);
+        size_t cnt = stripe_size - rel_off;
+        TSK_OFF_T member_off;
+        int member;
+
+        if (cnt > len - done)
+            cnt = len - done;
+
+        raid_map(raid_info, stripe, &member, &member_off);
+        member_off += rel_off;
+
+        if (raid_info->members[member] == NULL) {
+            if (raid_rebuild(raid_info, member, member_off, &buf[done],
+                    cnt)) {
+                failed = 1;
+                break;
+            }
+        }
+        else if (use_workers) {
+            if (raid_add_segment(&raid_info->jobs[member], member_off,
+                    &buf[done], cnt)) {
+                failed = 1;
+                break;
+            }
+        }
+        else if (raid_read_member(raid_info, member, member_off,
+                &buf[done], cnt)) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_IMG_READ);
+            tsk_error_set_errstr("raid_image_read: error reading member %d",
+                member);
+            failed = 1;
+            break;
+        }
+        done += cnt;
+    }
+
+    if (use_workers) {
+        if ((failed == 0) && raid_run_jobs(raid_info))
+            failed = 1;
+        tsk_take_lock(&raid_info->busy_lock);
+        raid_info->busy = 0;
+        tsk_release_lock(&raid_info->busy_lock);
+    }
+
+    if (failed)
+        return -1;
+    return (ssize_t) done;
+}
+
+static void
+raid_image_imgstat(TSK_IMG_INFO * img_info, FILE * hFile)
+{
+    IMG_RAID_INFO *raid_info = (IMG_RAID_INFO *) img_info;
+    int i;
+
+    tsk_fprintf(hFile, "IMAGE FILE INFORMATION\n");
+    tsk_fprintf(hFile, "--------------------------------------------\n");
+    tsk_fprintf(hFile, "Image Type:\t\traid\n");
+    tsk_fprintf(hFile, "\nSize in bytes:\t%" PRIuOFF "\n", img_info->size);
+    tsk_fprintf(hFile, "Sector size:\t%d\n", img_info->sector_size);
+    tsk_fprintf(hFile, "RAID level:\t%d\n", (int) raid_info->level);
+    if (raid_info->level == TSK_IMG_RAID_LEVEL_5)
+        tsk_fprintf(hFile, "Parity layout:\t%s\n",
+            raid_layout_name(raid_info->layout));
+    tsk_fprintf(hFile, "Stripe size:\t%u\n", raid_info->stripe_size);
+    tsk_fprintf(hFile, "Data offset:\t%" PRIuOFF "\n",
+        raid_info->data_offset);
+
+    tsk_fprintf(hFile, "\n--------------------------------------------\n");
+    tsk_fprintf(hFile, "Members:\n");
+    for (i = 0; i < raid_info->num_members; i++) {
+        TSK_IMG_INFO *member = raid_info->members[i];
+        if (member == NULL) {
+            tsk_fprintf(hFile, "%d: missing\n", i);
+        }
+        else if (member->num_img > 0) {
+            tsk_fprintf(hFile, "%d: %" PRIttocTSK "  (%" PRIuOFF
+                " bytes)\n", i, member->images[0], member->size);
+        }
+        else {
+            tsk_fprintf(hFile, "%d: (%" PRIuOFF " bytes)\n", i,
+                member->size);
+        }
+    }
+    return;
+}
+
+/**
+ * Stop the worker threads and free the memory of the jobs.
+ */
+static void
+raid_stop_workers(IMG_RAID_INFO * raid_info)
+{
+    int i;
+
+    if (raid_info->jobs == NULL)
+        return;
+
+#ifdef TSK_WIN32
+    raid_info->stop = 1;
+    for (i = 0; i < raid_info->num_members; i++) {
+        if (raid_info->jobs[i].thread != 0) {
+            SetEvent(raid_info->jobs[i].go);
+            WaitForSingleObject(raid_info->jobs[i].thread, INFINITE);
+            CloseHandle(raid_info->jobs[i].thread);
+        }
+        if (raid_info->jobs[i].go != NULL)
+            CloseHandle(raid_info->jobs[i].go);
+    }
+    if (raid_info->done != NULL)
+        CloseHandle(raid_info->done);
+#elif defined(TSK_MULTITHREAD_LIB)
+    pthread_mutex_lock(&raid_info->mutex);
+    raid_info->stop = 1;
+    pthread_cond_broadcast(&raid_info->go_cond);
+    pthread_mutex_unlock(&raid_info->mutex);
+    for (i = 0; i < raid_info->num_threads; i++) {
+        pthread_join(raid_info->jobs[i].thread, NULL);
+    }
+    pthread_cond_destroy(&raid_info->go_cond);
+    pthread_cond_destroy(&raid_info->done_cond);
+    pthread_mutex_destroy(&raid_info->mutex);
+#endif
+    raid_info->num_threads = 0;
+
+    for (i = 0; i < raid_info->num_members; i++) {
+        free(raid_info->jobs[i].segs);
+    }
+    free(raid_info->jobs);
+    raid_info->jobs = NULL;
+}
+
+/**
+ * Start one worker thread per member.  If they can not all be started,
+ * none are used and reads go to the members one after the other.
+ */
+static void
+raid_start_workers(IMG_RAID_INFO * raid_info)
+{
+#ifdef TSK_WIN32
+    int i;
+
+    if ((raid_info->done = CreateEvent(NULL, TRUE, FALSE, NULL)) == NULL)
+        return;
+    for (i = 0; i < raid_info->num_members; i++) {
+        RAID_MEMBER_JOB *job = &raid_info->jobs[i];
+        if (raid_info->members[i] == NULL)
+            continue;
+        if (((job->go = CreateEvent(NULL, FALSE, FALSE, NULL)) == NULL)
+            || ((job->thread =
+                    (HANDLE) _beginthreadex(NULL, 0, raid_worker, job, 0,
+                        NULL)) == 0)) {
+            break;
+        }
+    }
+    if (i < raid_info->num_members) {
+        // stop the ones that did start, but keep the job memory
+        int j;
+        raid_info->stop = 1;
+        for (j = 0; j <= i; j++) {
+            if (raid_info->jobs[j].thread != 0) {
+                SetEvent(raid_info->jobs[j].go);
+                WaitForSingleObject(raid_info->jobs[j].thread, INFINITE);
+                CloseHandle(raid_info->jobs[j].thread);
+                raid_info->jobs[j].thread = 0;
+            }
+            if (raid_info->jobs[j].go != NULL) {
+                CloseHandle(raid_info->jobs[j].go);
+                raid_info->jobs[j].go = NULL;
+            }
+        }
+        CloseHandle(raid_info->done);
+        raid_info->done = NULL;
+        raid_info->stop = 0;
+        return;
+    }
+    raid_info->num_threads = raid_info->num_members;
+#elif defined(TSK_MULTITHREAD_LIB)
+    int i;
+
+    pthread_mutex_init(&raid_info->mutex, NULL);
+    pthread_cond_init(&raid_info->go_cond, NULL);
+    pthread_cond_init(&raid_info->done_cond, NULL);
+
+    // workers are started for all members (one for a missing member
+    // never gets segments) so that num_threads is the index of the next one
+    for (i = 0; i < raid_info->num_members; i++) {
+        if (pthread_create(&raid_info->jobs[i].thread, NULL, raid_worker,
+                &raid_info->jobs[i]) != 0)
+            break;
+        raid_info->num_threads++;
+    }
+    if (i < raid_info->num_members) {
+        int started = raid_info->num_threads;
+        pthread_mutex_lock(&raid_info->mutex);
+        raid_info->stop = 1;
+        pthread_cond_broadcast(&raid_info->go_cond);
+        pthread_mutex_unlock(&raid_info->mutex);
+        for (i = 0; i < started; i++)
+            pthread_join(raid_info->jobs[i].thread, NULL);
+        raid_info->num_threads = 0;
+        raid_info->stop = 0;
+    }
+#endif
+}
+
+static void
+raid_image_close(TSK_IMG_INFO * img_info)
+{
+    IMG_RAID_INFO *raid_info = (IMG_RAID_INFO *) img_info;
+    int i;
+
+    raid_stop_workers(raid_info);
+    tsk_deinit_lock(&raid_info->busy_lock);
+
+    for (i = 0; i < raid_info->num_members; i++) {
+        if (raid_info->members[i] != NULL)
+            tsk_img_close(raid_info->members[i]);
+    }
+    free(raid_info->members);
+
+    if (img_info->images) {
+        for (i = 0; i < img_info->num_img; i++) {
+            free(img_info->images[i]);
+        }
+        free(img_info->images);
+    }
+
+    tsk_img_free(raid_info);
+}
+
+/**
+ * \ingroup imglib
+ * Opens a RAID set whose members were acquired as separate disk images.
+ * The result is read like any other disk image, so the volume and file
+ * system code works on top of it.  When the open succeeds, the members
+ * belong to the RAID set and are closed by tsk_img_close() on it.  When
+ * it fails, they still belong to the caller.
+ *
+ * @param a_num_members Number of members in the set
+ * @param a_members Opened member images in the order of the set.  For
+ * RAID 5, one of them can be NULL if the member is missing; its data is
+ * rebuilt from the others.
+ * @param a_level RAID level
+ * @param a_layout Parity layout (only used for RAID 5)
+ * @param a_stripe_size Size of a stripe (chunk) on one member in bytes
+ * (a multiple of 512)
+ * @param a_data_offset Offset in each member where the striped data
+ * starts (for example, after a metadata header)
+ * @return Pointer to TSK_IMG_INFO or NULL on error
+ */
+TSK_IMG_INFO *
+tsk_img_open_raid(int a_num_members, TSK_IMG_INFO * const a_members[],
+    TSK_IMG_RAID_LEVEL_ENUM a_level, TSK_IMG_RAID_LAYOUT_ENUM a_layout,
+    unsigned int a_stripe_size, TSK_OFF_T a_data_offset)
+{
+    IMG_RAID_INFO *raid_info;
+    TSK_IMG_INFO *img_info;
+    TSK_OFF_T member_size = -1;
+    unsigned int sector_size = 0;
+    int num_missing = 0;
+    int num_img = 0;
+    uint64_t rows;
+    int i;
+
+    tsk_error_reset();
+
+    if ((a_num_members < 2) || (a_members == NULL)) {
+        tsk_error_set_errno(TSK_ERR_IMG_ARG);
+        tsk_error_set_errstr("tsk_img_open_raid: at least two members are needed");
+        return NULL;
+    }
+    if ((a_level != TSK_IMG_RAID_LEVEL_0)
+        && (a_level != TSK_IMG_RAID_LEVEL_5)) {
+        tsk_error_set_errno(TSK_ERR_IMG_ARG);
+        tsk_error_set_errstr("tsk_img_open_raid: unsupported RAID level %d",
+            (int) a_level);
+        return NULL;
+    }
+    if ((a_level == TSK_IMG_RAID_LEVEL_5)
+        && ((a_num_members < 3)
+            || (a_layout < TSK_IMG_RAID_LAYOUT_LEFT_ASYMMETRIC)
+            || (a_layout > TSK_IMG_RAID_LAYOUT_RIGHT_SYMMETRIC))) {
+        tsk_error_set_errno(TSK_ERR_IMG_ARG);
+        tsk_error_set_errstr("tsk_img_open_raid: RAID 5 needs at least three members and a valid layout");
+        return NULL;
+    }
+    if ((a_stripe_size == 0) || (a_stripe_size % 512 != 0)) {
+        tsk_error_set_errno(TSK_ERR_IMG_ARG);
+        tsk_error_set_errstr("tsk_img_open_raid: stripe size is not a multiple of 512 (%u)",
+            a_stripe_size);
+        return NULL;
+    }
+    if (a_data_offset < 0) {
+        tsk_error_set_errno(TSK_ERR_IMG_ARG);
+        tsk_error_set_errstr("tsk_img_open_raid: negative data offset");
+        return NULL;
+    }
+
+    // all members must have the same sector size; the smallest sets the size
+    for (i = 0; i < a_num_members; i++) {
+        if (a_members[i] == NULL) {
+            num_missing++;
+            continue;
+        }
+        if (sector_size == 0) {
+            sector_size = a_members[i]->sector_size;
+        }
+        else if (a_members[i]->sector_size != sector_size) {
+            tsk_error_set_errno(TSK_ERR_IMG_ARG);
+            tsk_error_set_errstr("tsk_img_open_raid: member %d has sector size %u instead of %u",
+                i, a_members[i]->sector_size, sector_size);
+            return NULL;
+        }
+        if ((member_size < 0) || (a_members[i]->size < member_size))
+            member_size = a_members[i]->size;
+        num_img += a_members[i]->num_img;
+    }
+    if (num_missing > ((a_level == TSK_IMG_RAID_LEVEL_5) ? 1 : 0)) {
+        tsk_error_set_errno(TSK_ERR_IMG_ARG);
+        tsk_error_set_errstr("tsk_img_open_raid: %d members are missing",
+            num_missing);
+        return NULL;
+    }
+    if (member_size < a_data_offset + (TSK_OFF_T) a_stripe_size) {
+        tsk_error_set_errno(TSK_ERR_IMG_ARG);
+        tsk_error_set_errstr("tsk_img_open_raid: members are smaller than one stripe");
+        return NULL;
+    }
+    rows = (uint64_t) ((member_size - a_data_offset) / a_stripe_size);
+
+    if ((raid_info =
+            (IMG_RAID_INFO *) tsk_img_malloc(sizeof(IMG_RAID_INFO))) ==
+        NULL)
+        return NULL;
+    img_info = (TSK_IMG_INFO *) raid_info;
+
+    raid_info->num_members = a_num_members;
+    raid_info->level = a_level;
+    raid_info->layout = a_layout;
+    raid_info->stripe_size = a_stripe_size;
+    raid_info->data_offset = a_data_offset;
+    if (((raid_info->members =
+                (TSK_IMG_INFO **) tsk_malloc(a_num_members *
+                    sizeof(TSK_IMG_INFO *))) == NULL)
+        || ((raid_info->jobs =
+                (RAID_MEMBER_JOB *) tsk_malloc(a_num_members *
+                    sizeof(RAID_MEMBER_JOB))) == NULL)
+        || ((img_info->images =
+                (TSK_TCHAR **) tsk_malloc((num_img + 1) *
+                    sizeof(TSK_TCHAR *))) == NULL)) {
+        free(raid_info->members);
+        free(raid_info->jobs);
+        tsk_img_free(raid_info);
+        return NULL;
+    }
+
+    // the image names are the names of all of the members' files
+    for (i = 0; i < a_num_members; i++) {
+        int j;
+        raid_info->members[i] = a_members[i];
+        raid_info->jobs[i].raid_info = raid_info;
+        raid_info->jobs[i].member = i;
+        if (a_members[i] == NULL)
+            continue;
+        for (j = 0; j < a_members[i]->num_img; j++) {
+            size_t len = TSTRLEN(a_members[i]->images[j]);
+            TSK_TCHAR *name =
+                (TSK_TCHAR *) tsk_malloc(sizeof(TSK_TCHAR) * (len + 1));
+            if (name == NULL) {
+                int k;
+                for (k = 0; k < img_info->num_img; k++)
+                    free(img_info->images[k]);
+                free(img_info->images);
+                free(raid_info->members);
+                free(raid_info->jobs);
+                tsk_img_free(raid_info);
+                return NULL;
+            }
+            TSTRNCPY(name, a_members[i]->images[j], len + 1);
+            img_info->images[img_info->num_img++] = name;
+        }
+    }
+
+    img_info->tag = TSK_IMG_INFO_TAG;
+    img_info->itype = TSK_IMG_TYPE_RAID;
+    if (a_level == TSK_IMG_RAID_LEVEL_0)
+        img_info->size =
+            (TSK_OFF_T) (rows * a_stripe_size * a_num_members);
+    else
+        img_info->size =
+            (TSK_OFF_T) (rows * a_stripe_size * (a_num_members - 1));
+    img_info->sector_size = sector_size ? sector_size : 512;
+    img_info->read = &raid_image_read;
+    img_info->close = &raid_image_close;
+    img_info->imgstat = &raid_image_imgstat;
+    // the members do their own locking and the workers are only used
+    // by one read at a time
+    img_info->parallel_read = 1;
+    img_info->disk_cache = NULL;
+
+    tsk_init_lock(&raid_info->busy_lock);
+    raid_start_workers(raid_info);
+    tsk_init_lock(&(img_info->cache_lock));
+
+    if (tsk_verbose)
+        tsk_fprintf(stderr,
+            "tsk_img_open_raid: RAID %d with %d members, stripe size %u, size %"
+            PRIuOFF ", %d worker threads\n", (int) a_level, a_num_members,
+            a_stripe_size, img_info->size, raid_info->num_threads);
+
+    return img_info;
+}
+
+/**
+ * \ingroup imglib
+ * Opens a RAID set from the names of its member images and a string that
+ * describes the set.  This is used by the TSK command line tools to open
+ * the set given on the command line.  The string has the form
+ * "level,stripe_size[,layout][,data_offset]" where level is 0 or 5, the
+ * stripe size is in bytes (or in KB with a "k" suffix), and the layout
+ * is one of "la", "ls", "ra" or "rs" (left/right, asymmetric/symmetric;
+ * RAID 5 only, "ls" if not given).  A member named "missing" is missing.
+ *
+ * @param a_spec String that describes the set
+ * @param a_num_img Number of members in the set
+ * @param a_images Names of the member images in the order of the set
+ * (each member is one image file)
+ * @param a_type Type of the member images
+ * @param a_ssize Size of device sector in bytes (or 0 for default)
+ * @return Pointer to TSK_IMG_INFO or NULL on error
+ */
+TSK_IMG_INFO *
+tsk_img_open_raid_spec(const TSK_TCHAR * a_spec, int a_num_img,
+    const TSK_TCHAR * const a_images[], TSK_IMG_TYPE_ENUM a_type,
+    unsigned int a_ssize)
+{
+    TSK_IMG_RAID_LEVEL_ENUM level;
+    TSK_IMG_RAID_LAYOUT_ENUM layout = TSK_IMG_RAID_LAYOUT_LEFT_SYMMETRIC;
+    unsigned long stripe_size;
+    TSK_OFF_T data_offset = 0;
+    TSK_IMG_INFO **members;
+    TSK_IMG_INFO *img_info;
+    char spec[64];
+    char *toks[4];
+    int num_toks = 0;
+    char *tok;
+    char *cp;
+    int i;
+
+    tsk_error_reset();
+
+    // convert to char
+    for (i = 0; i < 63 && a_spec[i] != '\0'; i++) {
+        spec[i] = (char) a_spec[i];
+    }
+    spec[i] = '\0';
+
+    // split at the commas
+    for (cp = spec; num_toks < 4; cp++) {
+        toks[num_toks++] = cp;
+        if ((cp = strchr(cp, ',')) == NULL)
+            break;
+        *cp = '\0';
+    }
+    if ((cp != NULL) || (num_toks < 2)) {
+        tsk_error_set_errno(TSK_ERR_IMG_ARG);
+        tsk_error_set_errstr("tsk_img_open_raid_spec: RAID description is not level,stripe_size[,layout][,data_offset]");
+        return NULL;
+    }
+
+    // level
+    tok = toks[0];
+    if ((strcmp(tok, "0") != 0) && (strcmp(tok, "5") != 0)) {
+        tsk_error_set_errno(TSK_ERR_IMG_ARG);
+        tsk_error_set_errstr("tsk_img_open_raid_spec: RAID level must be 0 or 5");
+        return NULL;
+    }
+    level = (tok[0] == '0') ? TSK_IMG_RAID_LEVEL_0 : TSK_IMG_RAID_LEVEL_5;
+
+    // stripe size
+    tok = toks[1];
+    if (((stripe_size = strtoul(tok, &cp, 10)) == 0)
+        || ((*cp != '\0') && (strcmp(cp, "k") != 0))
+        || ((*cp == 'k') && (stripe_size > ((unsigned int) -1) / 1024))
+        || (stripe_size > (unsigned int) -1)) {
+        tsk_error_set_errno(TSK_ERR_IMG_ARG);
+        tsk_error_set_errstr("tsk_img_open_raid_spec: invalid stripe size");
+        return NULL;
+    }
+    if (*cp == 'k')
+        stripe_size *= 1024;
+
+    // layout and data offset
+    for (i = 2; i < num_toks; i++) {
+        tok = toks[i];
+        if (strcmp(tok, "la") == 0)
+            layout = TSK_IMG_RAID_LAYOUT_LEFT_ASYMMETRIC;
+        else if (strcmp(tok, "ls") == 0)
+            layout = TSK_IMG_RAID_LAYOUT_LEFT_SYMMETRIC;
+        else if (strcmp(tok, "ra") == 0)
+            layout = TSK_IMG_RAID_LAYOUT_RIGHT_ASYMMETRIC;
+        else if (strcmp(tok, "rs") == 0)
+            layout = TSK_IMG_RAID_LAYOUT_RIGHT_SYMMETRIC;
+        else if ((tok[0] >= '0') && (tok[0] <= '9')) {
+            data_offset = (TSK_OFF_T) strtoull(tok, &cp, 10);
+            if (*cp != '\0') {
+                tsk_error_set_errno(TSK_ERR_IMG_ARG);
+                tsk_error_set_errstr("tsk_img_open_raid_spec: invalid data offset: %s",
+                    tok);
+                return NULL;
+            }
+        }
+        else {
+            tsk_error_set_errno(TSK_ERR_IMG_ARG);
+            tsk_error_set_errstr("tsk_img_open_raid_spec: unknown layout: %s",
+                tok);
+            return NULL;
+        }
+    }
+
+    if (a_num_img < 2) {
+        tsk_error_set_errno(TSK_ERR_IMG_ARG);
+        tsk_error_set_errstr("tsk_img_open_raid_spec: at least two members are needed");
+        return NULL;
+    }
+    if ((members =
+            (TSK_IMG_INFO **) tsk_malloc(a_num_img *
+                sizeof(TSK_IMG_INFO *))) == NULL)
+        return NULL;
+
+    for (i = 0; i < a_num_img; i++) {
+        if (TSTRCMP(a_images[i], _TSK_T("missing")) == 0)
+            continue;
+        if ((members[i] =
+                tsk_img_open_sing(a_images[i], a_type, a_ssize)) == NULL)
+            break;
+    }
+
+    img_info = NULL;
+    if (i == a_num_img)
+        img_info =
+            tsk_img_open_raid(a_num_img, members, level, layout,
+            (unsigned int) stripe_size, data_offset);
+
+    // the members belong to the set only if it was opened
+    if (img_info == NULL) {
+        int j;
+        for (j = 0; j < a_num_img; j++) {
+            if (members[j] != NULL)
+                tsk_img_close(members[j]);
+        }
+    }
+    free(members);
+    return img_info;
+}
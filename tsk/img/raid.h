@@ -0,0 +1,83 @@
+/*
+ * Brian Carrier [carrier <at> sleuthkit [dot] org]
+ * Copyright (c) 2006-2016 Brian Carrier, Basis Technology.  All rights reserved
+ *
+ * This software is distributed under the Common Public License 1.0
+ *
+ */
+
+/*
+ * Header files for RAID sets that are made of other disk images.
+ */
+
+#ifndef _TSK_IMG_RAID_H
+#define _TSK_IMG_RAID_H
+
+#ifdef TSK_WIN32
+#include <process.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /* A run of bytes in one member that is part of a read */
+    typedef struct {
+        TSK_OFF_T member_off;   ///< Offset in the member image
+        char *buf;              ///< Where the data goes in the caller's buffer
+        size_t len;
+    } RAID_SEGMENT;
+
+    typedef struct IMG_RAID_INFO IMG_RAID_INFO;
+
+    /* The part of a read that one member does */
+    typedef struct {
+        IMG_RAID_INFO *raid_info;
+        int member;
+        RAID_SEGMENT *segs;
+        size_t num_segs;
+        size_t segs_alloc;
+        int failed;             ///< Set if a read of the member failed
+#ifdef TSK_WIN32
+        HANDLE thread;
+        HANDLE go;              ///< Set when the worker has segments to read
+#elif defined(TSK_MULTITHREAD_LIB)
+        pthread_t thread;
+        int active;             ///< Set when the worker has segments to read
+#endif
+    } RAID_MEMBER_JOB;
+
+    struct IMG_RAID_INFO {
+        TSK_IMG_INFO img_info;
+
+        // nothing in this part changes after tsk_img_open_raid
+        int num_members;
+        TSK_IMG_INFO **members; ///< NULL for the missing member of a degraded RAID 5
+        TSK_IMG_RAID_LEVEL_ENUM level;
+        TSK_IMG_RAID_LAYOUT_ENUM layout;
+        unsigned int stripe_size;
+        TSK_OFF_T data_offset;  ///< Where the striped data starts in each member
+
+        /* One worker thread per member reads the segments of that member.
+         * Only one read at a time uses the workers (busy is set); other
+         * reads at the same time read the members one after the other. */
+        RAID_MEMBER_JOB *jobs;
+        int num_threads;        ///< Number of worker threads that were started
+        tsk_lock_t busy_lock;
+        int busy;
+        int stop;
+#ifdef TSK_WIN32
+        volatile LONG pending;  ///< Workers that have not finished their segments
+        HANDLE done;            ///< Set when pending gets to 0
+#elif defined(TSK_MULTITHREAD_LIB)
+        pthread_mutex_t mutex;
+        pthread_cond_t go_cond;
+        pthread_cond_t done_cond;
+        int pending;            ///< Workers that have not finished their segments
+#endif
+    };
+
+#ifdef __cplusplus
+}
+#endif
+#endif                          // _TSK_IMG_RAID_H
@@ -170,11 +170,6 @@ raw_read_segment(IMG_RAW_INFO * raw_info, int idx, char *buf,
             nread = (DWORD)len;
         }
         cnt = (ssize_t) nread;
-
-        if (raw_info->img_writer != NULL) {
-            /* img_writer is not used with split images, so rel_offset is just the normal offset*/
-            raw_info->img_writer->add(raw_info->img_writer, rel_offset, buf, cnt);
-        }
     }
 #else
     if (cimg->seek_pos != rel_offset) {
@@ -201,6 +196,11 @@ raw_read_segment(IMG_RAW_INFO * raw_info, int idx, char *buf,
 #endif
     cimg->seek_pos += cnt;
 
+    if ((raw_info->img_writer != NULL) && (cnt > 0)) {
+        /* img_writer is not used with split images, so rel_offset is just the normal offset*/
+        raw_info->img_writer->add(raw_info->img_writer, rel_offset, buf, cnt);
+    }
+
     return cnt;
 }
 
@@ -378,13 +378,11 @@ raw_close(TSK_IMG_INFO * img_info)
     IMG_RAW_INFO *raw_info = (IMG_RAW_INFO *) img_info;
     int i;
 
-#ifdef TSK_WIN32
     if (raw_info->img_writer != NULL) {
         raw_info->img_writer->close(raw_info->img_writer);
         free(raw_info->img_writer);
         raw_info->img_writer = NULL;
     }
-#endif
 
     for (i = 0; i < SPLIT_CACHE; i++) {
         if (raw_info->cache[i].fd != 0)
@@ -0,0 +1,1466 @@
+/*
+ * Brian Carrier [carrier <at> sleuthkit [dot] org]
+ * Copyright (c) 2006-2016 Brian Carrier, Basis Technology.  All rights reserved
+ *
+ * This software is distributed under the Common Public License 1.0
+ *
+ */
+
+
+/** \file tci.c
+ * Internal code to read and write TSK chunked images (TCI).  The image is
+ * split into chunks of a fixed size that are compressed on their own, so
+ * any chunk can be read without the ones before it.  The file has a
+ * header, the stored chunks in the order that they were written and an
+ * index with the offset, size and CRC-32 of each chunk.  The header has
+ * the MD5 and SHA-1 of the image.  The writer compresses a batch of chunks
+ * at a time with several threads and large reads are split between
+ * threads.
+ */
+
+#include "tsk_img_i.h"
+
+#if HAVE_LIBZ
+#include "tci.h"
+#include "raw.h"
+#include <zlib.h>
+
+#ifdef TSK_WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#define TCI_MAGIC "TSKTCI01"
+#define TCI_VERSION 1
+#define TCI_HEADER_SIZE 512
+#define TCI_INDEX_ENTRY_SIZE 16
+#define TCI_CHUNK_SIZE (64 * 1024)      ///< Chunk size of the images that are written
+#define TCI_MAX_CHUNK_SIZE (16 * 1024 * 1024)
+#define TCI_NUM_THREADS 4
+#define TCI_BATCH_CHUNKS 64     ///< Complete chunks that are compressed together
+#define TCI_MAX_STAGED 256      ///< Incomplete chunks that are kept in memory
+#define TCI_PARALLEL_CHUNKS 16  ///< Reads of at least this many chunks use several threads
+
+/* Offset of a chunk that was never added to the image */
+#define TCI_OFFSET_MISSING 0xffffffffffffffffULL
+
+/* A chunk that has some of its data (the sectors bitmap has the ones
+ * that were added) */
+struct TCI_STAGED {
+    uint64_t chunk;
+    char *buf;
+    uint8_t *sectors;
+    uint32_t filled;            ///< Number of sectors that were added
+};
+
+/* A complete chunk that is waiting to be compressed and written */
+struct TCI_PENDING {
+    uint64_t chunk;
+    char *buf;
+    size_t len;
+    char *out;                  ///< Compressed data (NULL if stored as is)
+    uLongf out_len;
+    uint32_t crc;
+    int zero;                   ///< 1 if the chunk is all zeros
+};
+
+/* A function that one of the threads of tci_run runs */
+typedef struct {
+    void (*func) (void *);
+    void *arg;
+#ifdef TSK_WIN32
+    HANDLE thread;
+#elif defined(TSK_MULTITHREAD_LIB)
+    pthread_t thread;
+    int started;
+#endif
+} TCI_THREAD;
+
+#ifdef TSK_WIN32
+static unsigned __stdcall
+tci_thread(void *a_arg)
+{
+    TCI_THREAD *t = (TCI_THREAD *) a_arg;
+    t->func(t->arg);
+    return 0;
+}
+#elif defined(TSK_MULTITHREAD_LIB)
+static void *
+tci_thread(void *a_arg)
+{
+    TCI_THREAD *t = (TCI_THREAD *) a_arg;
+    t->func(t->arg);
+    return NULL;
+}
+#endif
+
+/**
+ * Run functions at the same time, one of them in the calling thread.
+ * If a thread can not be started, its function is run after the others.
+ */
+static void
+tci_run(TCI_THREAD * a_threads, int a_num)
+{
+    int i;
+
+#ifdef TSK_WIN32
+    for (i = 1; i < a_num; i++) {
+        a_threads[i].thread =
+            (HANDLE) _beginthreadex(NULL, 0, tci_thread, &a_threads[i], 0,
+            NULL);
+    }
+    a_threads[0].func(a_threads[0].arg);
+    for (i = 1; i < a_num; i++) {
+        if (a_threads[i].thread != 0) {
+            WaitForSingleObject(a_threads[i].thread, INFINITE);
+            CloseHandle(a_threads[i].thread);
+        }
+        else {
+            a_threads[i].func(a_threads[i].arg);
+        }
+    }
+#elif defined(TSK_MULTITHREAD_LIB)
+    for (i = 1; i < a_num; i++) {
+        a_threads[i].started = (pthread_create(&a_threads[i].thread, NULL,
+                tci_thread, &a_threads[i]) == 0);
+    }
+    a_threads[0].func(a_threads[0].arg);
+    for (i = 1; i < a_num; i++) {
+        if (a_threads[i].started)
+            pthread_join(a_threads[i].thread, NULL);
+        else
+            a_threads[i].func(a_threads[i].arg);
+    }
+#else
+    for (i = 0; i < a_num; i++) {
+        a_threads[i].func(a_threads[i].arg);
+    }
+#endif
+}
+
+static void
+tci_put32(uint8_t * a_buf, uint32_t a_val)
+{
+    a_buf[0] = (uint8_t) a_val;
+    a_buf[1] = (uint8_t) (a_val >> 8);
+    a_buf[2] = (uint8_t) (a_val >> 16);
+    a_buf[3] = (uint8_t) (a_val >> 24);
+}
+
+static void
+tci_put64(uint8_t * a_buf, uint64_t a_val)
+{
+    tci_put32(a_buf, (uint32_t) a_val);
+    tci_put32(&a_buf[4], (uint32_t) (a_val >> 32));
+}
+
+/**
+ * Read from the file at an offset without moving a shared file pointer,
+ * so several threads can read at once.
+ * @returns -1 on error or the number of bytes read
+ */
+#ifdef TSK_WIN32
+static ssize_t
+tci_pread(HANDLE a_fd, char *a_buf, size_t a_len, TSK_OFF_T a_off)
+{
+    OVERLAPPED ov;
+    DWORD nread;
+
+    memset(&ov, 0, sizeof(ov));
+    ov.Offset = (DWORD) (a_off & 0xffffffff);
+    ov.OffsetHigh = (DWORD) (a_off >> 32);
+    if (FALSE == ReadFile(a_fd, a_buf, (DWORD) a_len, &nread, &ov)) {
+        if (GetLastError() == ERROR_HANDLE_EOF)
+            return 0;
+        return -1;
+    }
+    return (ssize_t) nread;
+}
+#else
+static ssize_t
+tci_pread(int a_fd, char *a_buf, size_t a_len, TSK_OFF_T a_off)
+{
+    size_t done = 0;
+
+    while (done < a_len) {
+        ssize_t cnt = pread(a_fd, &a_buf[done], a_len - done,
+            (off_t) (a_off + done));
+        if (cnt < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (cnt == 0)
+            break;
+        done += cnt;
+    }
+    return (ssize_t) done;
+}
+#endif
+
+/**
+ * Write all of a buffer to the file at an offset.
+ * @returns 1 on error (and sets tsk_error)
+ */
+#ifdef TSK_WIN32
+static uint8_t
+tci_pwrite(HANDLE a_fd, const char *a_buf, size_t a_len, TSK_OFF_T a_off)
+{
+    OVERLAPPED ov;
+    DWORD nwritten;
+
+    memset(&ov, 0, sizeof(ov));
+    ov.Offset = (DWORD) (a_off & 0xffffffff);
+    ov.OffsetHigh = (DWORD) (a_off >> 32);
+    if ((FALSE == WriteFile(a_fd, a_buf, (DWORD) a_len, &nwritten, &ov))
+        || (nwritten != a_len)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_WRITE);
+        tsk_error_set_errstr("tci: error writing offset %" PRIuOFF
+            " (%d)", a_off, (int) GetLastError());
+        return 1;
+    }
+    return 0;
+}
+#else
+static uint8_t
+tci_pwrite(int a_fd, const char *a_buf, size_t a_len, TSK_OFF_T a_off)
+{
+    size_t done = 0;
+
+    while (done < a_len) {
+        ssize_t cnt = pwrite(a_fd, &a_buf[done], a_len - done,
+            (off_t) (a_off + done));
+        if (cnt < 0) {
+            if (errno == EINTR)
+                continue;
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_IMG_WRITE);
+            tsk_error_set_errstr("tci: error writing offset %" PRIuOFF
+                ": %s", a_off, strerror(errno));
+            return 1;
+        }
+        done += cnt;
+    }
+    return 0;
+}
+#endif
+
+/**
+ * Read a chunk and inflate it if it is compressed.
+ * @param a_fd File to read from
+ * @param a_entry Where the chunk is stored
+ * @param a_chunk Chunk number (for error messages)
+ * @param a_len Number of bytes of image data in the chunk
+ * @param a_out Buffer of at least a_len bytes for the image data
+ * @param a_tmp Buffer of at least a_len bytes for compressed data
+ * @returns 1 on error (and sets tsk_error)
+ */
+static uint8_t
+#ifdef TSK_WIN32
+tci_load_chunk(HANDLE a_fd, const TCI_CHUNK * a_entry, uint64_t a_chunk,
+#else
+tci_load_chunk(int a_fd, const TCI_CHUNK * a_entry, uint64_t a_chunk,
+#endif
+    size_t a_len, char *a_out, char *a_tmp)
+{
+    uLongf out_len;
+    ssize_t cnt;
+    int zret;
+
+    if (a_entry->offset == TCI_OFFSET_MISSING) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_READ);
+        tsk_error_set_errstr("tci: chunk %" PRIu64
+            " was not added to the image", a_chunk);
+        return 1;
+    }
+
+    // zero chunks are not stored
+    if ((a_entry->offset == 0) && (a_entry->size == 0)) {
+        memset(a_out, 0, a_len);
+        return 0;
+    }
+
+    if (a_entry->size == a_len) {
+        cnt = tci_pread(a_fd, a_out, a_len, a_entry->offset);
+    }
+    else {
+        cnt = tci_pread(a_fd, a_tmp, a_entry->size, a_entry->offset);
+    }
+    if (cnt != (ssize_t) a_entry->size) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_READ);
+        tsk_error_set_errstr("tci: error reading chunk %" PRIu64 ": %s",
+            a_chunk, (cnt < 0) ? strerror(errno) : "short read");
+        return 1;
+    }
+
+    if (a_entry->size != a_len) {
+        out_len = (uLongf) a_len;
+        zret = uncompress((Bytef *) a_out, &out_len, (Bytef *) a_tmp,
+            a_entry->size);
+        if ((zret != Z_OK) || (out_len != a_len)) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_IMG_READ);
+            tsk_error_set_errstr("tci: error inflating chunk %" PRIu64
+                " (zlib error %d)", a_chunk, zret);
+            return 1;
+        }
+    }
+
+    if (crc32(0, (Bytef *) a_out, (uInt) a_len) != a_entry->crc) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_READ);
+        tsk_error_set_errstr("tci: CRC of chunk %" PRIu64
+            " does not match", a_chunk);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Read a range of the image one chunk at a time.  The range must be
+ * inside the image.
+ * @returns 1 on error (and sets tsk_error)
+ */
+static uint8_t
+tci_read_range(IMG_TCI_INFO * tci_info, TSK_OFF_T a_off, char *a_buf,
+    size_t a_len)
+{
+    size_t chunk_size = tci_info->chunk_size;
+    char *chunk_buf = NULL;
+    char *tmp_buf;
+    size_t done = 0;
+
+    if ((tmp_buf = (char *) tsk_malloc(chunk_size)) == NULL)
+        return 1;
+
+    while (done < a_len) {
+        TSK_OFF_T cur_off = a_off + (TSK_OFF_T) done;
+        uint64_t chunk = (uint64_t) (cur_off / chunk_size);
+        size_t rel_off = (size_t) (cur_off % chunk_size);
+        size_t chunk_len = chunk_size;
+        size_t cnt;
+
+        if ((TSK_OFF_T) chunk_len >
+            tci_info->img_info.size - (TSK_OFF_T) (chunk * chunk_size))
+            chunk_len =
+                (size_t) (tci_info->img_info.size -
+                (TSK_OFF_T) (chunk * chunk_size));
+        cnt = chunk_len - rel_off;
+        if (cnt > a_len - done)
+            cnt = a_len - done;
+
+        // whole chunks go straight to the caller's buffer
+        if ((rel_off == 0) && (cnt == chunk_len)) {
+            if (tci_load_chunk(tci_info->fd, &tci_info->chunks[chunk],
+                    chunk, chunk_len, &a_buf[done], tmp_buf)) {
+                free(chunk_buf);
+                free(tmp_buf);
+                return 1;
+            }
+        }
+        else {
+            if ((chunk_buf == NULL)
+                && ((chunk_buf = (char *) tsk_malloc(chunk_size)) == NULL)) {
+                free(tmp_buf);
+                return 1;
+            }
+            if (tci_load_chunk(tci_info->fd, &tci_info->chunks[chunk],
+                    chunk, chunk_len, chunk_buf, tmp_buf)) {
+                free(chunk_buf);
+                free(tmp_buf);
+                return 1;
+            }
+            memcpy(&a_buf[done], &chunk_buf[rel_off], cnt);
+        }
+        done += cnt;
+    }
+
+    free(chunk_buf);
+    free(tmp_buf);
+    return 0;
+}
+
+/* Part of a large read that one thread does */
+typedef struct {
+    IMG_TCI_INFO *tci_info;
+    TSK_OFF_T off;
+    char *buf;
+    size_t len;
+    int failed;
+} TCI_READ_PART;
+
+static void
+tci_read_part(void *a_arg)
+{
+    TCI_READ_PART *part = (TCI_READ_PART *) a_arg;
+    if (tci_read_range(part->tci_info, part->off, part->buf, part->len))
+        part->failed = 1;
+}
+
+static ssize_t
+tci_image_read(TSK_IMG_INFO * img_info, TSK_OFF_T offset, char *buf,
+    size_t len)
+{
+    IMG_TCI_INFO *tci_info = (IMG_TCI_INFO *) img_info;
+    TCI_READ_PART parts[TCI_NUM_THREADS];
+    TCI_THREAD threads[TCI_NUM_THREADS];
+    TSK_OFF_T part_len;
+    TSK_OFF_T cur;
+    int num_parts = 0;
+    int i;
+
+    if (tsk_verbose)
+        tsk_fprintf(stderr,
+            "tci_image_read: byte offset: %" PRIuOFF " len: %" PRIuSIZE
+            "\n", offset, len);
+
+    if (offset > img_info->size) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_READ_OFF);
+        tsk_error_set_errstr("tci_image_read - %" PRIuOFF, offset);
+        return -1;
+    }
+    if ((TSK_OFF_T) len > img_info->size - offset)
+        len = (size_t) (img_info->size - offset);
+
+    if (len < (size_t) TCI_PARALLEL_CHUNKS * tci_info->chunk_size) {
+        if (tci_read_range(tci_info, offset, buf, len))
+            return -1;
+        return (ssize_t) len;
+    }
+
+    /* Split the read between the threads at chunk boundaries so that
+     * no chunk is inflated twice */
+    part_len = (TSK_OFF_T) (len / TCI_NUM_THREADS);
+    part_len -= part_len % tci_info->chunk_size;
+    cur = offset;
+    for (i = 0; i < TCI_NUM_THREADS; i++) {
+        TSK_OFF_T end;
+
+        if (i == TCI_NUM_THREADS - 1) {
+            end = offset + (TSK_OFF_T) len;
+        }
+        else {
+            end = cur + part_len;
+            end -= end % tci_info->chunk_size;
+            if (end <= cur)
+                continue;
+        }
+        parts[num_parts].tci_info = tci_info;
+        parts[num_parts].off = cur;
+        parts[num_parts].buf = &buf[cur - offset];
+        parts[num_parts].len = (size_t) (end - cur);
+        parts[num_parts].failed = 0;
+        threads[num_parts].func = tci_read_part;
+        threads[num_parts].arg = &parts[num_parts];
+        num_parts++;
+        cur = end;
+    }
+    tci_run(threads, num_parts);
+
+    for (i = 0; i < num_parts; i++) {
+        if (parts[i].failed)
+            return -1;
+    }
+    return (ssize_t) len;
+}
+
+static void
+tci_hash_to_string(const uint8_t * a_hash, size_t a_len, char *a_str)
+{
+    size_t i;
+    for (i = 0; i < a_len; i++) {
+        snprintf(&a_str[i * 2], 3, "%02x", a_hash[i]);
+    }
+}
+
+static void
+tci_image_imgstat(TSK_IMG_INFO * img_info, FILE * hFile)
+{
+    IMG_TCI_INFO *tci_info = (IMG_TCI_INFO *) img_info;
+    char hash[41];
+
+    tsk_fprintf(hFile, "IMAGE FILE INFORMATION\n");
+    tsk_fprintf(hFile, "--------------------------------------------\n");
+    tsk_fprintf(hFile, "Image Type:\t\ttci\n");
+    tsk_fprintf(hFile, "\nSize of data in bytes:\t%" PRIuOFF "\n",
+        img_info->size);
+    tsk_fprintf(hFile, "Sector size:\t%d\n", img_info->sector_size);
+    tsk_fprintf(hFile, "Chunk size:\t%" PRIu32 "\n", tci_info->chunk_size);
+    tsk_fprintf(hFile, "Chunks:\t\t%" PRIu64 "\n", tci_info->num_chunks);
+
+    if (tci_info->hash_flags & TSK_BASE_HASH_MD5) {
+        tci_hash_to_string(tci_info->md5, TSK_MD5_DIGEST_LENGTH, hash);
+        tsk_fprintf(hFile, "MD5 hash of data:\t%s\n", hash);
+    }
+    if (tci_info->hash_flags & TSK_BASE_HASH_SHA1) {
+        tci_hash_to_string(tci_info->sha1, 20, hash);
+        tsk_fprintf(hFile, "SHA1 hash of data:\t%s\n", hash);
+    }
+    return;
+}
+
+static void
+tci_image_close(TSK_IMG_INFO * img_info)
+{
+    IMG_TCI_INFO *tci_info = (IMG_TCI_INFO *) img_info;
+    int i;
+
+#ifdef TSK_WIN32
+    if (tci_info->fd != INVALID_HANDLE_VALUE)
+        CloseHandle(tci_info->fd);
+#else
+    if (tci_info->fd >= 0)
+        close(tci_info->fd);
+#endif
+    free(tci_info->chunks);
+
+    if (img_info->images) {
+        for (i = 0; i < img_info->num_img; i++) {
+            free(img_info->images[i]);
+        }
+        free(img_info->images);
+    }
+
+    tsk_img_free(tci_info);
+}
+
+/**
+ * Read and check the index of an image.
+ * @param a_index_off Offset of the index in the file
+ * @param a_index_crc CRC-32 of the index from the header
+ * @returns 1 on error (and sets tsk_error)
+ */
+static uint8_t
+tci_load_index(IMG_TCI_INFO * tci_info, TSK_OFF_T a_file_size,
+    uint64_t a_index_off, uint32_t a_index_crc)
+{
+    uint64_t index_len = tci_info->num_chunks * TCI_INDEX_ENTRY_SIZE;
+    uint8_t *index;
+    uint64_t i;
+
+    if ((a_index_off < TCI_HEADER_SIZE)
+        || (a_index_off > (uint64_t) a_file_size)
+        || (index_len > (uint64_t) a_file_size - a_index_off)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_OPEN);
+        tsk_error_set_errstr("tci_open: index is not in the file");
+        return 1;
+    }
+
+    if ((index = (uint8_t *) tsk_malloc((size_t) index_len)) == NULL)
+        return 1;
+    if ((tci_info->chunks =
+            (TCI_CHUNK *) tsk_malloc((size_t) tci_info->num_chunks *
+                sizeof(TCI_CHUNK))) == NULL) {
+        free(index);
+        return 1;
+    }
+
+    if (tci_pread(tci_info->fd, (char *) index, (size_t) index_len,
+            (TSK_OFF_T) a_index_off) != (ssize_t) index_len) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_READ);
+        tsk_error_set_errstr("tci_open: error reading index");
+        free(index);
+        return 1;
+    }
+    if (crc32(0, index, (uInt) index_len) != a_index_crc) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_OPEN);
+        tsk_error_set_errstr("tci_open: CRC of index does not match");
+        free(index);
+        return 1;
+    }
+
+    for (i = 0; i < tci_info->num_chunks; i++) {
+        TCI_CHUNK *chunk = &tci_info->chunks[i];
+        uint8_t *entry = &index[i * TCI_INDEX_ENTRY_SIZE];
+
+        chunk->offset = tsk_getu64(TSK_LIT_ENDIAN, entry);
+        chunk->size = tsk_getu32(TSK_LIT_ENDIAN, &entry[8]);
+        chunk->crc = tsk_getu32(TSK_LIT_ENDIAN, &entry[12]);
+        if (chunk->offset == TCI_OFFSET_MISSING)
+            continue;
+        if ((chunk->size > tci_info->chunk_size)
+            || (chunk->offset > (uint64_t) a_file_size)
+            || (chunk->size > (uint64_t) a_file_size - chunk->offset)) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_IMG_OPEN);
+            tsk_error_set_errstr("tci_open: chunk %" PRIu64
+                " is not in the file", i);
+            free(index);
+            return 1;
+        }
+    }
+
+    free(index);
+    return 0;
+}
+
+TSK_IMG_INFO *
+tci_open(int a_num_img, const TSK_TCHAR * const a_images[],
+    unsigned int a_ssize)
+{
+    IMG_TCI_INFO *tci_info;
+    TSK_IMG_INFO *img_info;
+    uint8_t head[TCI_HEADER_SIZE];
+    TSK_OFF_T file_size;
+    uint32_t sector_size;
+    uint64_t index_off;
+    uint64_t needed;
+    size_t len;
+
+    if (a_num_img != 1) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_ARG);
+        tsk_error_set_errstr("tci_open: TSK chunked images are a single file");
+        return NULL;
+    }
+
+    if ((tci_info =
+            (IMG_TCI_INFO *) tsk_img_malloc(sizeof(IMG_TCI_INFO))) ==
+        NULL) {
+        return NULL;
+    }
+    img_info = (TSK_IMG_INFO *) tci_info;
+#ifdef TSK_WIN32
+    tci_info->fd = INVALID_HANDLE_VALUE;
+#else
+    tci_info->fd = -1;
+#endif
+
+    len = TSTRLEN(a_images[0]);
+    if (((img_info->images =
+                (TSK_TCHAR **) tsk_malloc(sizeof(TSK_TCHAR *))) == NULL)
+        || ((img_info->images[0] =
+                (TSK_TCHAR *) tsk_malloc((len + 1) * sizeof(TSK_TCHAR))) ==
+            NULL)) {
+        tci_image_close(img_info);
+        return NULL;
+    }
+    img_info->num_img = 1;
+    TSTRNCPY(img_info->images[0], a_images[0], len + 1);
+
+#ifdef TSK_WIN32
+    {
+        LARGE_INTEGER li;
+
+        tci_info->fd = CreateFile(a_images[0], FILE_READ_DATA,
+            FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+        if (tci_info->fd == INVALID_HANDLE_VALUE) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_IMG_OPEN);
+            tsk_error_set_errstr("tci_open: file \"%" PRIttocTSK
+                "\" - (error %d)", a_images[0], (int) GetLastError());
+            tci_image_close(img_info);
+            return NULL;
+        }
+        if (GetFileSizeEx(tci_info->fd, &li) == 0) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_IMG_OPEN);
+            tsk_error_set_errstr("tci_open: error getting size of \"%"
+                PRIttocTSK "\"", a_images[0]);
+            tci_image_close(img_info);
+            return NULL;
+        }
+        file_size = li.QuadPart;
+    }
+#else
+    {
+        struct stat stat_buf;
+
+        if ((tci_info->fd = open(a_images[0], O_RDONLY | O_BINARY)) < 0) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_IMG_OPEN);
+            tsk_error_set_errstr("tci_open: file \"%" PRIttocTSK "\" - %s",
+                a_images[0], strerror(errno));
+            tci_image_close(img_info);
+            return NULL;
+        }
+        if (fstat(tci_info->fd, &stat_buf) < 0) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_IMG_OPEN);
+            tsk_error_set_errstr("tci_open: file \"%" PRIttocTSK "\" - %s",
+                a_images[0], strerror(errno));
+            tci_image_close(img_info);
+            return NULL;
+        }
+        file_size = stat_buf.st_size;
+    }
+#endif
+
+    if ((tci_pread(tci_info->fd, (char *) head, TCI_HEADER_SIZE,
+                0) != TCI_HEADER_SIZE)
+        || (memcmp(head, TCI_MAGIC, 8) != 0)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_MAGIC);
+        tsk_error_set_errstr("tci_open: not a TSK chunked image");
+        tci_image_close(img_info);
+        return NULL;
+    }
+
+    if (crc32(0, head, TCI_HEADER_SIZE - 4) !=
+        tsk_getu32(TSK_LIT_ENDIAN, &head[TCI_HEADER_SIZE - 4])) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_OPEN);
+        tsk_error_set_errstr("tci_open: CRC of header does not match");
+        tci_image_close(img_info);
+        return NULL;
+    }
+
+    if (tsk_getu32(TSK_LIT_ENDIAN, &head[8]) != TCI_VERSION) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_OPEN);
+        tsk_error_set_errstr("tci_open: unsupported version %" PRIu32,
+            tsk_getu32(TSK_LIT_ENDIAN, &head[8]));
+        tci_image_close(img_info);
+        return NULL;
+    }
+
+    tci_info->chunk_size = tsk_getu32(TSK_LIT_ENDIAN, &head[12]);
+    img_info->size = tsk_getu64(TSK_LIT_ENDIAN, &head[16]);
+    sector_size = tsk_getu32(TSK_LIT_ENDIAN, &head[24]);
+    tci_info->hash_flags = tsk_getu32(TSK_LIT_ENDIAN, &head[28]);
+    tci_info->num_chunks = tsk_getu64(TSK_LIT_ENDIAN, &head[32]);
+    index_off = tsk_getu64(TSK_LIT_ENDIAN, &head[40]);
+    memcpy(tci_info->md5, &head[52], TSK_MD5_DIGEST_LENGTH);
+    memcpy(tci_info->sha1, &head[68], 20);
+
+    if ((tci_info->chunk_size < 512)
+        || (tci_info->chunk_size > TCI_MAX_CHUNK_SIZE)
+        || (tci_info->chunk_size % 512) || (img_info->size < 0)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_OPEN);
+        tsk_error_set_errstr("tci_open: invalid chunk size %" PRIu32,
+            tci_info->chunk_size);
+        tci_image_close(img_info);
+        return NULL;
+    }
+
+    needed = ((uint64_t) img_info->size + tci_info->chunk_size - 1) /
+        tci_info->chunk_size;
+    if (tci_info->num_chunks != needed) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_OPEN);
+        tsk_error_set_errstr("tci_open: image has %" PRIu64 " of %" PRIu64
+            " chunks", tci_info->num_chunks, needed);
+        tci_image_close(img_info);
+        return NULL;
+    }
+
+    // the writer sets the index offset when it is closed
+    if (index_off == 0) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_OPEN);
+        tsk_error_set_errstr("tci_open: image was not closed by its writer");
+        tci_image_close(img_info);
+        return NULL;
+    }
+
+    if (tci_load_index(tci_info, file_size, index_off,
+            tsk_getu32(TSK_LIT_ENDIAN, &head[48]))) {
+        tci_image_close(img_info);
+        return NULL;
+    }
+
+    // use what they gave us
+    if (a_ssize != 0) {
+        img_info->sector_size = a_ssize;
+    }
+    else if ((sector_size == 0) || (sector_size % 512)) {
+        img_info->sector_size = 512;
+    }
+    else {
+        img_info->sector_size = sector_size;
+    }
+
+    img_info->itype = TSK_IMG_TYPE_TCI;
+    img_info->read = &tci_image_read;
+    img_info->close = &tci_image_close;
+    img_info->imgstat = &tci_image_imgstat;
+    // reads only use data that does not change
+    img_info->parallel_read = 1;
+
+    return img_info;
+}
+
+
+/*
+ * Writer
+ */
+
+static size_t
+tci_chunk_len(TSK_IMG_WRITER * img_writer, uint64_t a_chunk)
+{
+    TCI_WRITER *tci = img_writer->tci;
+    TSK_OFF_T start = (TSK_OFF_T) (a_chunk * tci->chunk_size);
+
+    if (img_writer->imageSize - start < (TSK_OFF_T) tci->chunk_size)
+        return (size_t) (img_writer->imageSize - start);
+    return tci->chunk_size;
+}
+
+/**
+ * Write the header of the image.  The index offset is 0 until the
+ * index is written at close.
+ * @returns 1 on error (and sets tsk_error)
+ */
+static uint8_t
+tci_write_header(TSK_IMG_WRITER * img_writer, uint64_t a_index_off,
+    uint32_t a_index_crc, uint32_t a_hash_flags, const uint8_t * a_md5,
+    const uint8_t * a_sha1)
+{
+    TCI_WRITER *tci = img_writer->tci;
+    uint8_t head[TCI_HEADER_SIZE];
+
+    memset(head, 0, TCI_HEADER_SIZE);
+    memcpy(head, TCI_MAGIC, 8);
+    tci_put32(&head[8], TCI_VERSION);
+    tci_put32(&head[12], tci->chunk_size);
+    tci_put64(&head[16], (uint64_t) img_writer->imageSize);
+    tci_put32(&head[24], img_writer->img_info->sector_size);
+    tci_put32(&head[28], a_hash_flags);
+    tci_put64(&head[32], tci->num_chunks);
+    tci_put64(&head[40], a_index_off);
+    tci_put32(&head[48], a_index_crc);
+    if (a_md5)
+        memcpy(&head[52], a_md5, TSK_MD5_DIGEST_LENGTH);
+    if (a_sha1)
+        memcpy(&head[68], a_sha1, 20);
+    tci_put32(&head[TCI_HEADER_SIZE - 4], crc32(0, head,
+            TCI_HEADER_SIZE - 4));
+
+    return tci_pwrite(tci->fd, (const char *) head, TCI_HEADER_SIZE, 0);
+}
+
+static int
+tci_is_zero(const char *a_buf, size_t a_len)
+{
+    size_t i = 0;
+
+    for (; i + sizeof(uint64_t) <= a_len; i += sizeof(uint64_t)) {
+        uint64_t val;
+        memcpy(&val, &a_buf[i], sizeof(val));
+        if (val != 0)
+            return 0;
+    }
+    for (; i < a_len; i++) {
+        if (a_buf[i] != 0)
+            return 0;
+    }
+    return 1;
+}
+
+/* The pending chunks that one thread compresses */
+typedef struct {
+    TCI_PENDING *pending;
+    int num_pending;
+    int first;
+    int step;
+} TCI_COMPRESS_PART;
+
+static void
+tci_compress_part(void *a_arg)
+{
+    TCI_COMPRESS_PART *part = (TCI_COMPRESS_PART *) a_arg;
+    int i;
+
+    for (i = part->first; i < part->num_pending; i += part->step) {
+        TCI_PENDING *p = &part->pending[i];
+
+        p->crc = crc32(0, (Bytef *) p->buf, (uInt) p->len);
+        if (tci_is_zero(p->buf, p->len)) {
+            p->zero = 1;
+            continue;
+        }
+
+        // chunks that do not get smaller are stored as is
+        p->out_len = compressBound((uLong) p->len);
+        if ((p->out = (char *) malloc(p->out_len)) == NULL)
+            continue;
+        if ((compress2((Bytef *) p->out, &p->out_len, (Bytef *) p->buf,
+                    (uLong) p->len, Z_BEST_SPEED) != Z_OK)
+            || (p->out_len >= p->len)) {
+            free(p->out);
+            p->out = NULL;
+        }
+    }
+}
+
+static int
+tci_pending_cmp(const void *a_a, const void *a_b)
+{
+    const TCI_PENDING *a = (const TCI_PENDING *) a_a;
+    const TCI_PENDING *b = (const TCI_PENDING *) a_b;
+
+    if (a->chunk < b->chunk)
+        return -1;
+    return (a->chunk > b->chunk) ? 1 : 0;
+}
+
+/**
+ * Compress the pending chunks with several threads and write them.
+ * The writer lock must be held.
+ * @returns 1 on error (and sets tsk_error)
+ */
+static uint8_t
+tci_flush_pending(TSK_IMG_WRITER * img_writer)
+{
+    TCI_WRITER *tci = img_writer->tci;
+    TCI_COMPRESS_PART parts[TCI_NUM_THREADS];
+    TCI_THREAD threads[TCI_NUM_THREADS];
+    int num_threads;
+    uint8_t retval = 0;
+    int i;
+
+    if (tci->num_pending == 0)
+        return tci->failed;
+
+    // in chunk order, so that the image hashes can use as many as possible
+    qsort(tci->pending, tci->num_pending, sizeof(TCI_PENDING),
+        tci_pending_cmp);
+
+    num_threads = (tci->num_pending < TCI_NUM_THREADS) ?
+        tci->num_pending : TCI_NUM_THREADS;
+    for (i = 0; i < num_threads; i++) {
+        parts[i].pending = tci->pending;
+        parts[i].num_pending = tci->num_pending;
+        parts[i].first = i;
+        parts[i].step = num_threads;
+        threads[i].func = tci_compress_part;
+        threads[i].arg = &parts[i];
+    }
+    tci_run(threads, num_threads);
+
+    for (i = 0; i < tci->num_pending; i++) {
+        TCI_PENDING *p = &tci->pending[i];
+        TCI_CHUNK *entry = &tci->chunks[p->chunk];
+
+        if ((tci->failed == 0) && (p->zero == 0)) {
+            const char *data = (p->out != NULL) ? p->out : p->buf;
+            size_t size = (p->out != NULL) ? (size_t) p->out_len : p->len;
+
+            if (tci_pwrite(tci->fd, data, size, tci->next_offset)) {
+                tci->failed = 1;
+                retval = 1;
+            }
+            else {
+                entry->offset = (uint64_t) tci->next_offset;
+                entry->size = (uint32_t) size;
+                entry->crc = p->crc;
+                tci->next_offset += size;
+            }
+        }
+        else if (tci->failed == 0) {
+            entry->offset = 0;
+            entry->size = 0;
+            entry->crc = p->crc;
+        }
+
+        if (tci->failed == 0) {
+            tci->chunks_written++;
+            if (p->chunk == tci->hash_next) {
+                TSK_MD5_Update(&tci->md5, (unsigned char *) p->buf,
+                    (unsigned int) p->len);
+                TSK_SHA_Update(&tci->sha1, (BYTE *) p->buf, (int) p->len);
+                tci->hash_next++;
+            }
+        }
+        free(p->out);
+        free(p->buf);
+    }
+    tci->num_pending = 0;
+
+    if (tci->failed)
+        retval = 1;
+    return retval;
+}
+
+/**
+ * Add a complete chunk to the ones waiting to be written.  The writer
+ * takes the buffer.  The writer lock must be held.
+ */
+static uint8_t
+tci_add_pending(TSK_IMG_WRITER * img_writer, uint64_t a_chunk, char *a_buf,
+    size_t a_len)
+{
+    TCI_WRITER *tci = img_writer->tci;
+    TCI_PENDING *p = &tci->pending[tci->num_pending++];
+
+    memset(p, 0, sizeof(TCI_PENDING));
+    p->chunk = a_chunk;
+    p->buf = a_buf;
+    p->len = a_len;
+    tci->chunk_done[a_chunk] = 1;
+
+    if (tci->num_pending == TCI_BATCH_CHUNKS)
+        return tci_flush_pending(img_writer);
+    return 0;
+}
+
+static void
+tci_drop_staged(TCI_WRITER * tci, int a_idx)
+{
+    free(tci->staged[a_idx].buf);
+    free(tci->staged[a_idx].sectors);
+    memmove(&tci->staged[a_idx], &tci->staged[a_idx + 1],
+        (tci->num_staged - a_idx - 1) * sizeof(TCI_STAGED));
+    tci->num_staged--;
+}
+
+/**
+ * Copy part of a chunk into its staged copy and mark the sectors that it
+ * fills.  Moves the chunk to the pending ones once all of its sectors are
+ * filled.  The writer lock must be held.
+ */
+static uint8_t
+tci_stage(TSK_IMG_WRITER * img_writer, uint64_t a_chunk, size_t a_rel,
+    const char *a_buf, size_t a_len)
+{
+    TCI_WRITER *tci = img_writer->tci;
+    size_t chunk_len = tci_chunk_len(img_writer, a_chunk);
+    uint32_t num_sectors = (uint32_t) ((chunk_len + 511) / 512);
+    TCI_STAGED *staged = NULL;
+    size_t first, last, s;
+    int i;
+
+    for (i = tci->num_staged - 1; i >= 0; i--) {
+        if (tci->staged[i].chunk == a_chunk) {
+            staged = &tci->staged[i];
+            break;
+        }
+    }
+
+    if (staged == NULL) {
+        // the data of the oldest one will be read again when the image is finished
+        if (tci->num_staged == TCI_MAX_STAGED)
+            tci_drop_staged(tci, 0);
+
+        i = tci->num_staged;
+        staged = &tci->staged[i];
+        staged->chunk = a_chunk;
+        staged->filled = 0;
+        staged->sectors = NULL;
+        if (((staged->buf = (char *) tsk_malloc(chunk_len)) == NULL)
+            || ((staged->sectors =
+                    (uint8_t *) tsk_malloc((num_sectors + 7) / 8)) ==
+                NULL)) {
+            free(staged->buf);
+            return 1;
+        }
+        tci->num_staged++;
+    }
+
+    memcpy(&staged->buf[a_rel], a_buf, a_len);
+
+    // only whole sectors (and the end of the last one) count
+    first = (a_rel + 511) / 512;
+    if (a_rel + a_len == chunk_len)
+        last = num_sectors;
+    else
+        last = (a_rel + a_len) / 512;
+    for (s = first; s < last; s++) {
+        if ((staged->sectors[s / 8] & (1 << (s % 8))) == 0) {
+            staged->sectors[s / 8] |= (1 << (s % 8));
+            staged->filled++;
+        }
+    }
+
+    if (staged->filled == num_sectors) {
+        char *buf = staged->buf;
+        staged->buf = NULL;
+        tci_drop_staged(tci, i);
+        return tci_add_pending(img_writer, a_chunk, buf, chunk_len);
+    }
+    return 0;
+}
+
+/*
+ * Add data that was read from the image.  Chunks are compressed and
+ * written once all of their data has been added.
+ */
+static TSK_RETVAL_ENUM
+tci_writer_add(TSK_IMG_WRITER * img_writer, TSK_OFF_T addr, char *buffer,
+    size_t len)
+{
+    TCI_WRITER *tci = img_writer->tci;
+    uint8_t failed = 0;
+
+    tsk_take_lock(&tci->lock);
+    while ((len > 0) && (addr < img_writer->imageSize) && (failed == 0)) {
+        uint64_t chunk = (uint64_t) (addr / tci->chunk_size);
+        size_t rel = (size_t) (addr % tci->chunk_size);
+        size_t chunk_len = tci_chunk_len(img_writer, chunk);
+        size_t cnt = chunk_len - rel;
+
+        if (cnt > len)
+            cnt = len;
+
+        if (tci->chunk_done[chunk] == 0) {
+            if ((rel == 0) && (cnt == chunk_len)) {
+                char *buf;
+                int i;
+
+                for (i = 0; i < tci->num_staged; i++) {
+                    if (tci->staged[i].chunk == chunk) {
+                        tci_drop_staged(tci, i);
+                        break;
+                    }
+                }
+                if ((buf = (char *) tsk_malloc(chunk_len)) == NULL) {
+                    failed = 1;
+                    break;
+                }
+                memcpy(buf, buffer, chunk_len);
+                failed = tci_add_pending(img_writer, chunk, buf, chunk_len);
+            }
+            else {
+                failed = tci_stage(img_writer, chunk, rel, buffer, cnt);
+            }
+        }
+
+        addr += cnt;
+        buffer += cnt;
+        len -= cnt;
+    }
+    tsk_release_lock(&tci->lock);
+
+    return failed ? TSK_ERR : TSK_OK;
+}
+
+/*
+ * Read the chunks that were not added yet from the image and write them.
+ */
+static TSK_RETVAL_ENUM
+tci_writer_finish_image(TSK_IMG_WRITER * img_writer)
+{
+    TCI_WRITER *tci = img_writer->tci;
+    char *buf;
+    uint64_t i;
+    uint8_t failed;
+
+    if (tsk_verbose) {
+        tsk_fprintf(stderr,
+            "tci_writer_finish_image: Finishing image\n");
+    }
+
+    if (img_writer->is_finished == 1) {
+        return TSK_OK;
+    }
+
+    if ((buf = (char *) tsk_malloc(tci->chunk_size)) == NULL)
+        return TSK_ERR;
+
+    for (i = 0; i < tci->num_chunks; i++) {
+        if (img_writer->cancelFinish) {
+            free(buf);
+            return TSK_ERR;
+        }
+
+        // reading the chunk can also add it through the image's read function
+        if (tci->chunk_done[i] == 0) {
+            size_t len = tci_chunk_len(img_writer, i);
+            TSK_OFF_T off = (TSK_OFF_T) (i * tci->chunk_size);
+
+            if (tsk_img_read(img_writer->img_info, off, buf,
+                    len) != (ssize_t) len) {
+                free(buf);
+                return TSK_ERR;
+            }
+            if (tci_writer_add(img_writer, off, buf, len) != TSK_OK) {
+                free(buf);
+                return TSK_ERR;
+            }
+        }
+        img_writer->finishProgress = (int) (((i + 1) * 100) /
+            tci->num_chunks);
+    }
+    free(buf);
+
+    tsk_take_lock(&tci->lock);
+    failed = tci_flush_pending(img_writer);
+    tsk_release_lock(&tci->lock);
+    if (failed)
+        return TSK_ERR;
+
+    img_writer->is_finished = 1;
+    return TSK_OK;
+}
+
+/**
+ * Write the pending chunks, the index and the final header.  Chunks that
+ * were not added are marked as missing in the index.  The image hashes
+ * are only stored if every chunk was added.
+ * @returns 1 on error (and sets tsk_error)
+ */
+static uint8_t
+tci_writer_finish_file(TSK_IMG_WRITER * img_writer)
+{
+    TCI_WRITER *tci = img_writer->tci;
+    uint8_t md5[TSK_MD5_DIGEST_LENGTH];
+    uint8_t sha1[20];
+    uint32_t hash_flags = 0;
+    uint8_t *index;
+    uint64_t index_len;
+    uint64_t i;
+
+    if (tci_flush_pending(img_writer))
+        return 1;
+
+    if (tci->chunks_written == tci->num_chunks) {
+        char *buf;
+        char *tmp;
+
+        /* Hash the chunks that were written after a gap from the file */
+        if (((buf = (char *) tsk_malloc(tci->chunk_size)) == NULL)
+            || ((tmp = (char *) tsk_malloc(tci->chunk_size)) == NULL)) {
+            free(buf);
+            return 1;
+        }
+        for (; tci->hash_next < tci->num_chunks; tci->hash_next++) {
+            size_t len = tci_chunk_len(img_writer, tci->hash_next);
+            if (tci_load_chunk(tci->fd, &tci->chunks[tci->hash_next],
+                    tci->hash_next, len, buf, tmp)) {
+                free(buf);
+                free(tmp);
+                return 1;
+            }
+            TSK_MD5_Update(&tci->md5, (unsigned char *) buf,
+                (unsigned int) len);
+            TSK_SHA_Update(&tci->sha1, (BYTE *) buf, (int) len);
+        }
+        free(buf);
+        free(tmp);
+
+        TSK_MD5_Final(md5, &tci->md5);
+        TSK_SHA_Final(sha1, &tci->sha1);
+        hash_flags = TSK_BASE_HASH_MD5 | TSK_BASE_HASH_SHA1;
+    }
+    else if (tsk_verbose) {
+        tsk_fprintf(stderr,
+            "tci_writer_close: %" PRIu64 " of %" PRIu64
+            " chunks were added\n", tci->chunks_written, tci->num_chunks);
+    }
+
+    index_len = tci->num_chunks * TCI_INDEX_ENTRY_SIZE;
+    if ((index = (uint8_t *) tsk_malloc((size_t) index_len)) == NULL)
+        return 1;
+    for (i = 0; i < tci->num_chunks; i++) {
+        uint8_t *entry = &index[i * TCI_INDEX_ENTRY_SIZE];
+
+        if (tci->chunk_done[i]) {
+            tci_put64(entry, tci->chunks[i].offset);
+            tci_put32(&entry[8], tci->chunks[i].size);
+            tci_put32(&entry[12], tci->chunks[i].crc);
+        }
+        else {
+            tci_put64(entry, TCI_OFFSET_MISSING);
+        }
+    }
+
+    if (tci_pwrite(tci->fd, (const char *) index, (size_t) index_len,
+            tci->next_offset)) {
+        free(index);
+        return 1;
+    }
+
+    if (tci_write_header(img_writer, (uint64_t) tci->next_offset,
+            crc32(0, index, (uInt) index_len), hash_flags,
+            hash_flags ? md5 : NULL, hash_flags ? sha1 : NULL)) {
+        free(index);
+        return 1;
+    }
+    free(index);
+    return 0;
+}
+
+/*
+ * Finish the file and free the writer's memory
+ */
+static TSK_RETVAL_ENUM
+tci_writer_close(TSK_IMG_WRITER * img_writer)
+{
+    TCI_WRITER *tci = img_writer->tci;
+    TSK_RETVAL_ENUM retval = TSK_OK;
+    int i;
+
+    if (tsk_verbose) {
+        tsk_fprintf(stderr, "tci_writer_close: Closing image writer\n");
+    }
+
+    if (tci == NULL)
+        return TSK_OK;
+
+    tsk_take_lock(&tci->lock);
+    if ((tci->failed == 0) && (tci->chunk_done != NULL)) {
+        if (tci_writer_finish_file(img_writer))
+            retval = TSK_ERR;
+    }
+
+    for (i = 0; i < tci->num_pending; i++) {
+        free(tci->pending[i].buf);
+    }
+    for (i = 0; i < tci->num_staged; i++) {
+        free(tci->staged[i].buf);
+        free(tci->staged[i].sectors);
+    }
+    tsk_release_lock(&tci->lock);
+
+#ifdef TSK_WIN32
+    if (tci->fd != INVALID_HANDLE_VALUE)
+        CloseHandle(tci->fd);
+#else
+    if (tci->fd >= 0)
+        close(tci->fd);
+#endif
+
+    free(tci->pending);
+    free(tci->staged);
+    free(tci->chunks);
+    free(tci->chunk_done);
+    tsk_deinit_lock(&tci->lock);
+    free(tci);
+    img_writer->tci = NULL;
+
+    free(img_writer->fileName);
+    img_writer->fileName = NULL;
+
+    return retval;
+}
+
+/**
+ * \internal
+ * Create an image writer that makes a TSK chunked image of a raw image
+ * and save it in the image.
+ * @param img_info Raw image that is being read
+ * @param a_path Path of the TCI file to create
+ * @returns TSK_ERR on error
+ */
+TSK_RETVAL_ENUM
+tci_writer_create(TSK_IMG_INFO * img_info, const TSK_TCHAR * a_path)
+{
+    IMG_RAW_INFO *raw_info = (IMG_RAW_INFO *) img_info;
+    TSK_IMG_WRITER *writer;
+    TCI_WRITER *tci;
+    size_t len;
+
+    if (tsk_verbose) {
+        tsk_fprintf(stderr,
+            "tci_writer_create: Creating image writer in %" PRIttocTSK
+            "\n", a_path);
+    }
+
+    if ((img_info->itype != TSK_IMG_TYPE_RAW) || (img_info->num_img != 1)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_OPEN);
+        tsk_error_set_errstr
+            ("tci_writer_create: image writer can only be used on single raw images");
+        return TSK_ERR;
+    }
+
+    if ((writer =
+            (TSK_IMG_WRITER *) tsk_malloc(sizeof(TSK_IMG_WRITER))) ==
+        NULL)
+        return TSK_ERR;
+    if ((tci = (TCI_WRITER *) tsk_malloc(sizeof(TCI_WRITER))) == NULL) {
+        free(writer);
+        return TSK_ERR;
+    }
+    writer->tci = tci;
+    writer->img_info = img_info;
+    writer->imageSize = img_info->size;
+    writer->add = tci_writer_add;
+    writer->close = tci_writer_close;
+    writer->finish_image = tci_writer_finish_image;
+
+    tsk_init_lock(&tci->lock);
+    tci->chunk_size = TCI_CHUNK_SIZE;
+    tci->num_chunks = ((uint64_t) img_info->size + tci->chunk_size - 1) /
+        tci->chunk_size;
+    tci->next_offset = TCI_HEADER_SIZE;
+    TSK_MD5_Init(&tci->md5);
+    TSK_SHA_Init(&tci->sha1);
+#ifdef TSK_WIN32
+    tci->fd = INVALID_HANDLE_VALUE;
+#else
+    tci->fd = -1;
+#endif
+
+    len = TSTRLEN(a_path);
+    if ((writer->fileName =
+            (TSK_TCHAR *) tsk_malloc((len + 1) * sizeof(TSK_TCHAR))) ==
+        NULL) {
+        tci->failed = 1;
+        tci_writer_close(writer);
+        free(writer);
+        return TSK_ERR;
+    }
+    TSTRNCPY(writer->fileName, a_path, len + 1);
+
+    if (((tci->chunks =
+                (TCI_CHUNK *) tsk_malloc((size_t) (tci->num_chunks + 1) *
+                    sizeof(TCI_CHUNK))) == NULL)
+        || ((tci->chunk_done =
+                (uint8_t *) tsk_malloc((size_t) tci->num_chunks + 1)) ==
+            NULL)
+        || ((tci->staged =
+                (TCI_STAGED *) tsk_malloc(TCI_MAX_STAGED *
+                    sizeof(TCI_STAGED))) == NULL)
+        || ((tci->pending =
+                (TCI_PENDING *) tsk_malloc(TCI_BATCH_CHUNKS *
+                    sizeof(TCI_PENDING))) == NULL)) {
+        tci->failed = 1;
+        tci_writer_close(writer);
+        free(writer);
+        return TSK_ERR;
+    }
+
+    /* The file is also read at close to hash chunks that were added out
+     * of order */
+#ifdef TSK_WIN32
+    tci->fd = CreateFile(a_path, FILE_WRITE_DATA | FILE_READ_DATA,
+        FILE_SHARE_READ, NULL, CREATE_ALWAYS, 0, NULL);
+    if (tci->fd == INVALID_HANDLE_VALUE) {
+        int lastError = (int) GetLastError();
+        tci->failed = 1;
+        tci_writer_close(writer);
+        free(writer);
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_OPEN);
+        tsk_error_set_errstr("tci_writer_create: error creating file \"%"
+            PRIttocTSK "\" (%d)", a_path, lastError);
+        return TSK_ERR;
+    }
+#else
+    tci->fd = open(a_path, O_RDWR | O_CREAT | O_TRUNC | O_BINARY, 0644);
+    if (tci->fd < 0) {
+        int lastError = errno;
+        tci->failed = 1;
+        tci_writer_close(writer);
+        free(writer);
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_OPEN);
+        tsk_error_set_errstr("tci_writer_create: error creating file \"%"
+            PRIttocTSK "\" (%s)", a_path, strerror(lastError));
+        return TSK_ERR;
+    }
+#endif
+
+    // the index offset is set at close
+    if (tci_write_header(writer, 0, 0, 0, NULL, NULL)) {
+        tci->failed = 1;
+        tci_writer_close(writer);
+        free(writer);
+        return TSK_ERR;
+    }
+
+    raw_info->img_writer = writer;
+    return TSK_OK;
+}
+
+#endif                          /* HAVE_LIBZ */
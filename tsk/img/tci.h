@@ -0,0 +1,91 @@
+/*
+ * Brian Carrier [carrier <at> sleuthkit [dot] org]
+ * Copyright (c) 2006-2016 Brian Carrier, Basis Technology.  All rights reserved
+ *
+ * This software is distributed under the Common Public License 1.0
+ *
+ */
+
+/*
+ * Header files for the TSK chunked image (TCI) reader and writer.
+ */
+
+#ifndef _TSK_IMG_TCI_H
+#define _TSK_IMG_TCI_H
+
+#if HAVE_LIBZ
+
+#include "img_writer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    extern TSK_IMG_INFO *tci_open(int, const TSK_TCHAR * const images[],
+        unsigned int a_ssize);
+    extern TSK_RETVAL_ENUM tci_writer_create(TSK_IMG_INFO * img_info,
+        const TSK_TCHAR * a_path);
+
+    /* Where a chunk is stored.  A chunk with an offset and size of 0 is
+     * all zeros and is not stored.  A chunk whose size is less than the
+     * chunk length is zlib compressed. */
+    typedef struct {
+        uint64_t offset;        ///< Offset of the stored data in the file
+        uint32_t size;          ///< Number of bytes stored
+        uint32_t crc;           ///< CRC-32 of the uncompressed data
+    } TCI_CHUNK;
+
+    typedef struct {
+        TSK_IMG_INFO img_info;
+
+        // nothing below changes after tci_open, so reads do not lock
+#ifdef TSK_WIN32
+        HANDLE fd;
+#else
+        int fd;
+#endif
+        TCI_CHUNK *chunks;
+        uint64_t num_chunks;
+        uint32_t chunk_size;
+
+        uint32_t hash_flags;    ///< TSK_BASE_HASH_MD5 and TSK_BASE_HASH_SHA1 if the hashes are set
+        uint8_t md5[TSK_MD5_DIGEST_LENGTH];
+        uint8_t sha1[20];
+    } IMG_TCI_INFO;
+
+    typedef struct TCI_STAGED TCI_STAGED;
+    typedef struct TCI_PENDING TCI_PENDING;
+
+    /* State of an image writer that makes a TCI file */
+    typedef struct TCI_WRITER {
+#ifdef TSK_WIN32
+        HANDLE fd;
+#else
+        int fd;
+#endif
+        tsk_lock_t lock;        ///< Held while data is added
+        uint32_t chunk_size;
+        uint64_t num_chunks;
+        TCI_CHUNK *chunks;
+        uint8_t *chunk_done;    ///< 1 for each chunk that has been written
+        uint64_t chunks_written;
+        TSK_OFF_T next_offset;  ///< Where the next chunk is written
+        int failed;             ///< Set after a write error
+
+        TCI_STAGED *staged;     ///< Chunks that have only some of their data
+        int num_staged;
+        TCI_PENDING *pending;   ///< Complete chunks waiting to be compressed
+        int num_pending;
+
+        /* The hashes of the image are updated while the chunks are
+         * added in order and finished from the file at close */
+        uint64_t hash_next;     ///< Next chunk to add to the hashes
+        TSK_MD5_CTX md5;
+        TSK_SHA_CTX sha1;
+    } TCI_WRITER;
+
+#ifdef __cplusplus
+}
+#endif
+#endif
+#endif // _TSK_IMG_TCI_H
@@ -44,7 +44,7 @@ extern "C" {
      * Macro that takes a image type and returns 1 if the type
      * is for an EWF file format. */
 #define TSK_IMG_TYPE_ISEWF(t) \
-    ((((t) & TSK_IMG_TYPE_EWF_EWF))?1:0)
+    ((((t) & TSK_IMG_TYPE_EWF_EWF) || ((t) & TSK_IMG_TYPE_EWF_NATIVE))?1:0)
 
 
     /**
@@ -67,15 +67,59 @@ extern "C" {
         TSK_IMG_TYPE_EWF_EWF = 0x0040,   ///< EWF version
         TSK_IMG_TYPE_VMDK_VMDK = 0x0080, ///< VMDK version
         TSK_IMG_TYPE_VHD_VHD = 0x0100,   ///< VHD version
+        TSK_IMG_TYPE_EWF_NATIVE = 0x0200,        ///< EWF read by the built-in reader
+        TSK_IMG_TYPE_RAID = 0x0400,      ///< RAID set made of other images (see tsk_img_open_raid())
+        TSK_IMG_TYPE_TCI = 0x0800,       ///< TSK chunked image
         TSK_IMG_TYPE_EXTERNAL = 0x1000,  ///< external defined format which at least implements TSK_IMG_INFO, used by pytsk
 
         TSK_IMG_TYPE_UNSUPP = 0xffff   ///< Unsupported disk image type
     } TSK_IMG_TYPE_ENUM;
 
+    /**
+     * RAID levels that tsk_img_open_raid() can put together.
+     */
+    typedef enum {
+        TSK_IMG_RAID_LEVEL_0 = 0,       ///< Striping without parity
+        TSK_IMG_RAID_LEVEL_5 = 5        ///< Striping with one parity stripe per row
+    } TSK_IMG_RAID_LEVEL_ENUM;
+
+    /**
+     * Where the parity stripe is in each row of a RAID 5 set and the order
+     * of the data stripes after it.  The names are the ones used by Linux md.
+     */
+    typedef enum {
+        TSK_IMG_RAID_LAYOUT_LEFT_ASYMMETRIC = 0,        ///< Parity moves from the last member to the first, data in member order
+        TSK_IMG_RAID_LAYOUT_LEFT_SYMMETRIC = 1, ///< Parity moves from the last member to the first, data starts after the parity (md default)
+        TSK_IMG_RAID_LAYOUT_RIGHT_ASYMMETRIC = 2,       ///< Parity moves from the first member to the last, data in member order
+        TSK_IMG_RAID_LAYOUT_RIGHT_SYMMETRIC = 3 ///< Parity moves from the first member to the last, data starts after the parity
+    } TSK_IMG_RAID_LAYOUT_ENUM;
+
 #define TSK_IMG_INFO_CACHE_NUM  32
 #define TSK_IMG_INFO_CACHE_LEN  65536
 
     typedef struct TSK_IMG_INFO TSK_IMG_INFO;
+    typedef struct TSK_IMG_DISK_CACHE TSK_IMG_DISK_CACHE;
+
+#define TSK_IMG_STATS_LAT_NUM   32      ///< Number of buckets in the latency histogram
+
+    /**
+     * Counts of how reads of an image were done, for sizing caches and
+     * finding slow storage.  The counters are updated atomically while
+     * the image is read.  Get a copy with tsk_img_get_stats().
+     */
+    typedef struct {
+        uint64_t reads;         ///< Number of calls to tsk_img_read()
+        uint64_t read_bytes;    ///< Number of bytes asked for by tsk_img_read()
+        uint64_t cache_hits;    ///< Reads that were found in the cache
+        uint64_t cache_misses;  ///< Reads that loaded a cache entry
+        uint64_t cache_skips;   ///< Reads that were too large for the cache
+        uint64_t lock_wait_usec;        ///< Time spent waiting for cache_lock
+        uint64_t backend_reads; ///< Number of reads of the image format
+        uint64_t backend_bytes; ///< Number of bytes returned by the image format
+        uint64_t backend_errors;        ///< Number of reads of the image format that failed
+        uint64_t backend_usec;  ///< Time spent in reads of the image format
+        uint64_t backend_lat[TSK_IMG_STATS_LAT_NUM];    ///< Reads of the image format that took less than 2^i microseconds (and at least 2^(i-1))
+    } TSK_IMG_STATS;
 #define TSK_IMG_INFO_TAG 0x39204231
 
     /**
@@ -102,6 +146,10 @@ extern "C" {
         ssize_t(*read) (TSK_IMG_INFO * img, TSK_OFF_T off, char *buf, size_t len);     ///< \internal External progs should call tsk_img_read()
         void (*close) (TSK_IMG_INFO *); ///< \internal Progs should call tsk_img_close()
         void (*imgstat) (TSK_IMG_INFO *, FILE *);       ///< Pointer to file type specific function
+
+        uint8_t parallel_read;  ///< \internal Set if read() does its own locking and can be called by several threads at once (cache_lock is then not held while it runs)
+        TSK_IMG_DISK_CACHE *disk_cache; ///< \internal Persistent cache that read() is called through (NULL if none)
+        TSK_IMG_STATS stats;    ///< \internal Read statistics (use tsk_img_get_stats())
     };
 
     // open and close functions
@@ -120,12 +168,32 @@ extern "C" {
         ssize_t(*read) (TSK_IMG_INFO * img, TSK_OFF_T off, char *buf, size_t len),
         void (*close) (TSK_IMG_INFO *),
         void (*imgstat) (TSK_IMG_INFO *, FILE *));
+    extern TSK_IMG_INFO *tsk_img_open_raid(int a_num_members,
+        TSK_IMG_INFO * const a_members[], TSK_IMG_RAID_LEVEL_ENUM a_level,
+        TSK_IMG_RAID_LAYOUT_ENUM a_layout, unsigned int a_stripe_size,
+        TSK_OFF_T a_data_offset);
+    extern TSK_IMG_INFO *tsk_img_open_raid_spec(const TSK_TCHAR * a_spec,
+        int a_num_img, const TSK_TCHAR * const a_images[],
+        TSK_IMG_TYPE_ENUM a_type, unsigned int a_ssize);
     extern void tsk_img_close(TSK_IMG_INFO *);
 
     // read functions
     extern ssize_t tsk_img_read(TSK_IMG_INFO * img, TSK_OFF_T off,
         char *buf, size_t len);
 
+    extern uint8_t tsk_img_set_ewf_cache(TSK_IMG_INFO * img,
+        unsigned int max_handles, unsigned int cache_mb);
+    extern void tsk_img_set_e01_index(uint8_t a_write);
+    extern uint8_t tsk_img_set_disk_cache(TSK_IMG_INFO * img,
+        const TSK_TCHAR * a_dir, unsigned int a_max_mb,
+        unsigned int a_block_kb);
+
+    // read statistics
+    extern void tsk_img_get_stats(TSK_IMG_INFO * img,
+        TSK_IMG_STATS * a_stats);
+    extern void tsk_img_reset_stats(TSK_IMG_INFO * img);
+    extern void tsk_img_stats_print(TSK_IMG_INFO * img, FILE * hFile);
+
     // type conversion functions
     extern TSK_IMG_TYPE_ENUM tsk_img_type_toid_utf8(const char *);
     extern TSK_IMG_TYPE_ENUM tsk_img_type_toid(const TSK_TCHAR *);
@@ -37,32 +37,111 @@ getError(libvhdi_error_t * vhdi_error,
 } 
 
 
-static ssize_t
-vhdi_image_read(TSK_IMG_INFO * img_info, TSK_OFF_T offset, char *buf,
-    size_t len)
+/**
+ * Open another libvhdi file for the image.
+ * @param vhdi_info Image to open the file for
+ * @param a_handle Set to the file
+ * @returns 1 on error and 0 on success
+ */
+static uint8_t
+vhdi_open_handle(IMG_VHDI_INFO * vhdi_info, libvhdi_file_t ** a_handle)
 {
     char error_string[TSK_VHDI_ERROR_STRING_SIZE];
     libvhdi_error_t *vhdi_error = NULL;
+    libvhdi_file_t *handle = NULL;
+    const char *what = NULL;
 
-    ssize_t cnt;
-    IMG_VHDI_INFO *vhdi_info = (IMG_VHDI_INFO *) img_info;
-
-    if (tsk_verbose)
-        tsk_fprintf(stderr,
-            "vhdi_image_read: byte offset: %" PRIuOFF " len: %" PRIuSIZE
-            "\n", offset, len);
+    if (libvhdi_file_initialize(&handle, &vhdi_error) != 1) {
+        what = "initializing handle";
+    }
+#if defined( TSK_WIN32 )
+    else if (libvhdi_file_open_wide(handle,
+            (const wchar_t *) vhdi_info->img_info.images[0],
+            LIBVHDI_OPEN_READ, &vhdi_error) != 1)
+#else
+    else if (libvhdi_file_open(handle,
+            (const char *) vhdi_info->img_info.images[0],
+            LIBVHDI_OPEN_READ, &vhdi_error) != 1)
+#endif
+    {
+        what = "opening";
+    }
 
-    if (offset > img_info->size) {
+    if (what != NULL) {
         tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_IMG_READ_OFF);
-        tsk_error_set_errstr("vhdi_image_read - %" PRIuOFF, offset);
-        return -1;
+        tsk_error_set_errno(TSK_ERR_IMG_OPEN);
+        getError(vhdi_error, error_string);
+        tsk_error_set_errstr("vhdi_open file: %" PRIttocTSK
+            ": Error %s (%s)", vhdi_info->img_info.images[0], what,
+            error_string);
+        libvhdi_error_free(&vhdi_error);
+        if (handle != NULL)
+            libvhdi_file_free(&handle, NULL);
+        return 1;
     }
 
-    tsk_take_lock(&(vhdi_info->read_lock));
+    *a_handle = handle;
+    return 0;
+}
+
+/**
+ * Read from the image with one of the files in its pool.  An idle
+ * file is used if there is one.  Otherwise, another file is opened
+ * (up to max_handles) or the read waits for the file with the fewest
+ * reads using it.
+ */
+static ssize_t
+vhdi_read_handle(IMG_VHDI_INFO * vhdi_info, TSK_OFF_T offset, char *buf,
+    size_t len)
+{
+    char error_string[TSK_VHDI_ERROR_STRING_SIZE];
+    libvhdi_error_t *vhdi_error = NULL;
+    VHDI_HANDLE_SLOT *slot = NULL;
+    ssize_t cnt;
+    int i;
 
-    cnt = libvhdi_file_read_buffer_at_offset(vhdi_info->handle,
+    tsk_take_lock(&(vhdi_info->pool_lock));
+    for (i = 0; i < vhdi_info->num_handles; i++) {
+        if (vhdi_info->slots[i].users == 0) {
+            slot = &(vhdi_info->slots[i]);
+            break;
+        }
+    }
+    if ((slot == NULL) && (vhdi_info->num_handles < vhdi_info->max_handles)) {
+        libvhdi_file_t *handle = NULL;
+        if (vhdi_open_handle(vhdi_info, &handle)) {
+            if (tsk_verbose)
+                tsk_fprintf(stderr,
+                    "vhdi_read_handle: Error opening file %d, using %d files: %s\n",
+                    vhdi_info->num_handles + 1, vhdi_info->num_handles,
+                    tsk_error_get());
+            tsk_error_reset();
+            vhdi_info->max_handles = vhdi_info->num_handles;
+        }
+        else {
+            slot = &(vhdi_info->slots[vhdi_info->num_handles++]);
+            slot->handle = handle;
+        }
+    }
+    if (slot == NULL) {
+        slot = &(vhdi_info->slots[0]);
+        for (i = 1; i < vhdi_info->num_handles; i++) {
+            if (vhdi_info->slots[i].users < slot->users)
+                slot = &(vhdi_info->slots[i]);
+        }
+    }
+    slot->users++;
+    tsk_release_lock(&(vhdi_info->pool_lock));
+
+    tsk_take_lock(&(slot->lock));
+    cnt = libvhdi_file_read_buffer_at_offset(slot->handle,
         buf, len, offset, &vhdi_error);
+    tsk_release_lock(&(slot->lock));
+
+    tsk_take_lock(&(vhdi_info->pool_lock));
+    slot->users--;
+    tsk_release_lock(&(vhdi_info->pool_lock));
+
     if (cnt < 0) {
         char *errmsg = NULL;
         tsk_error_reset();
@@ -74,24 +153,230 @@ vhdi_image_read(TSK_IMG_INFO * img_info, TSK_OFF_T offset, char *buf,
 
         tsk_error_set_errstr("vhdi_image_read - offset: %" PRIuOFF
             " - len: %" PRIuSIZE " - %s", offset, len, errmsg);
-        tsk_release_lock(&(vhdi_info->read_lock));
+        libvhdi_error_free(&vhdi_error);
         return -1;
     }
+    return cnt;
+}
+
+/**
+ * Read bytes from the image file itself (not the disk in it).
+ * @returns 1 on error and 0 on success
+ */
+static uint8_t
+vhdi_file_read(FILE * hFile, uint64_t a_off, void *a_buf, size_t a_len)
+{
+#if defined( TSK_WIN32 )
+    if (_fseeki64(hFile, (__int64) a_off, SEEK_SET) != 0)
+        return 1;
+#else
+    if (fseeko(hFile, (off_t) a_off, SEEK_SET) != 0)
+        return 1;
+#endif
+    if (fread(a_buf, 1, a_len, hFile) != a_len)
+        return 1;
+    return 0;
+}
+
+/**
+ * Load which blocks are stored from the block allocation table of the
+ * image.  This is only done for a dynamic VHD, where a block that is not
+ * in the table is zeros.  For fixed and differencing disks and for VHDX
+ * the map is left NULL and everything is read with libvhdi.  Errors are
+ * not fatal.
+ */
+static void
+vhdi_load_block_map(IMG_VHDI_INFO * vhdi_info)
+{
+    TSK_IMG_INFO *img_info = (TSK_IMG_INFO *) vhdi_info;
+    FILE *hFile = NULL;
+    uint8_t footer[512];
+    uint8_t head[1024];
+    uint8_t *bat = NULL;
+    uint64_t head_off, bat_off, i;
+    uint32_t bat_entries, block_size;
+    const char *why = NULL;
+
+#if defined( TSK_WIN32 )
+    hFile = _wfopen(img_info->images[0], L"rb");
+#else
+    hFile = fopen(img_info->images[0], "rb");
+#endif
+    if (hFile == NULL)
+        return;
+
+    // dynamic disks have a copy of the footer at the start
+    if (vhdi_file_read(hFile, 0, footer, sizeof(footer))) {
+        why = "error reading footer";
+        goto done;
+    }
+    if (memcmp(footer, "conectix", 8) != 0) {
+        why = "not a dynamic VHD";
+        goto done;
+    }
+    // 2 is fixed, 3 is dynamic and 4 is differencing
+    if (tsk_getu32(TSK_BIG_ENDIAN, &footer[60]) != 3) {
+        why = "not a dynamic disk";
+        goto done;
+    }
+    if (tsk_getu64(TSK_BIG_ENDIAN, &footer[48]) !=
+        (uint64_t) img_info->size) {
+        why = "unexpected disk size";
+        goto done;
+    }
 
-    tsk_release_lock(&(vhdi_info->read_lock));
+    head_off = tsk_getu64(TSK_BIG_ENDIAN, &footer[16]);
+    if (vhdi_file_read(hFile, head_off, head, sizeof(head))) {
+        why = "error reading dynamic disk header";
+        goto done;
+    }
+    if (memcmp(head, "cxsparse", 8) != 0) {
+        why = "bad dynamic disk header";
+        goto done;
+    }
+    bat_off = tsk_getu64(TSK_BIG_ENDIAN, &head[16]);
+    bat_entries = tsk_getu32(TSK_BIG_ENDIAN, &head[28]);
+    block_size = tsk_getu32(TSK_BIG_ENDIAN, &head[32]);
+    if ((block_size == 0) || (block_size % 512)) {
+        why = "unexpected block size";
+        goto done;
+    }
 
-    return cnt;
+    vhdi_info->block_size = block_size;
+    vhdi_info->num_blocks =
+        ((uint64_t) img_info->size + block_size - 1) / block_size;
+    if (vhdi_info->num_blocks > bat_entries) {
+        why = "block allocation table is too small";
+        goto done;
+    }
+
+    if (((bat =
+                (uint8_t *) tsk_malloc((size_t) vhdi_info->num_blocks *
+                    4)) == NULL)
+        || ((vhdi_info->block_map =
+                (uint8_t *) tsk_malloc((size_t) (vhdi_info->num_blocks +
+                        7) / 8)) == NULL)) {
+        why = tsk_error_get();
+        goto done;
+    }
+    if (vhdi_file_read(hFile, bat_off, bat,
+            (size_t) vhdi_info->num_blocks * 4)) {
+        why = "error reading block allocation table";
+        goto done;
+    }
+    for (i = 0; i < vhdi_info->num_blocks; i++) {
+        if (tsk_getu32(TSK_BIG_ENDIAN, &bat[i * 4]) != 0xffffffff) {
+            vhdi_info->block_map[i / 8] |= (1 << (i % 8));
+            vhdi_info->num_alloc_blocks++;
+        }
+    }
+
+  done:
+    if (why != NULL) {
+        if (tsk_verbose)
+            tsk_fprintf(stderr,
+                "vhdi_load_block_map: reading all blocks with libvhdi (%s)\n",
+                why);
+        tsk_error_reset();
+        free(vhdi_info->block_map);
+        vhdi_info->block_map = NULL;
+        vhdi_info->num_alloc_blocks = 0;
+    }
+    else if (tsk_verbose) {
+        tsk_fprintf(stderr,
+            "vhdi_load_block_map: %" PRIu64 " of %" PRIu64
+            " blocks stored\n", vhdi_info->num_alloc_blocks,
+            vhdi_info->num_blocks);
+    }
+    free(bat);
+    fclose(hFile);
+}
+
+/**
+ * @returns 1 if the block is stored in the image
+ */
+static int
+vhdi_block_is_alloc(IMG_VHDI_INFO * vhdi_info, uint64_t a_block)
+{
+    return (vhdi_info->block_map[a_block / 8] & (1 << (a_block % 8))) != 0;
+}
+
+static ssize_t
+vhdi_image_read(TSK_IMG_INFO * img_info, TSK_OFF_T offset, char *buf,
+    size_t len)
+{
+    IMG_VHDI_INFO *vhdi_info = (IMG_VHDI_INFO *) img_info;
+    size_t done = 0;
+
+    if (tsk_verbose)
+        tsk_fprintf(stderr,
+            "vhdi_image_read: byte offset: %" PRIuOFF " len: %" PRIuSIZE
+            "\n", offset, len);
+
+    if (offset > img_info->size) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_READ_OFF);
+        tsk_error_set_errstr("vhdi_image_read - %" PRIuOFF, offset);
+        return -1;
+    }
+
+    if (vhdi_info->block_map == NULL)
+        return vhdi_read_handle(vhdi_info, offset, buf, len);
+
+    if ((TSK_OFF_T) len > img_info->size - offset)
+        len = (size_t) (img_info->size - offset);
+
+    // Split the read into runs of blocks that are all stored or all
+    // not stored.  Blocks that are not stored are zeros.
+    while (done < len) {
+        TSK_OFF_T cur = offset + done;
+        uint64_t block = cur / vhdi_info->block_size;
+        int alloc = vhdi_block_is_alloc(vhdi_info, block);
+        TSK_OFF_T run_end = (TSK_OFF_T) (block + 1) * vhdi_info->block_size;
+        size_t cnt;
+
+        while ((run_end < offset + (TSK_OFF_T) len)
+            && (vhdi_block_is_alloc(vhdi_info,
+                    run_end / vhdi_info->block_size) == alloc))
+            run_end += vhdi_info->block_size;
+        if (run_end > offset + (TSK_OFF_T) len)
+            run_end = offset + len;
+        cnt = (size_t) (run_end - cur);
+
+        if (alloc) {
+            ssize_t retval =
+                vhdi_read_handle(vhdi_info, cur, &buf[done], cnt);
+            if (retval < 0)
+                return -1;
+            done += retval;
+            if ((size_t) retval < cnt)
+                break;
+        }
+        else {
+            memset(&buf[done], 0, cnt);
+            done += cnt;
+        }
+    }
+    return (ssize_t) done;
 }
 
 static void
 vhdi_image_imgstat(TSK_IMG_INFO * img_info, FILE * hFile)
 {
+    IMG_VHDI_INFO *vhdi_info = (IMG_VHDI_INFO *) img_info;
+
     tsk_fprintf(hFile, "IMAGE FILE INFORMATION\n");
     tsk_fprintf(hFile, "--------------------------------------------\n");
     tsk_fprintf(hFile, "Image Type:\t\tvhdi\n");
     tsk_fprintf(hFile, "\nSize of data in bytes:\t%" PRIuOFF "\n",
         img_info->size);
     tsk_fprintf(hFile, "Sector size:\t%d\n", img_info->sector_size);
+    if (vhdi_info->block_map != NULL) {
+        tsk_fprintf(hFile, "Block size:\t%" PRIuOFF "\n",
+            vhdi_info->block_size);
+        tsk_fprintf(hFile, "Stored blocks:\t%" PRIu64 " of %" PRIu64 "\n",
+            vhdi_info->num_alloc_blocks, vhdi_info->num_blocks);
+    }
 
     return;
 }
@@ -106,37 +391,46 @@ static void
     char *errmsg = NULL;
     IMG_VHDI_INFO *vhdi_info = (IMG_VHDI_INFO *) img_info;
 
-    if( libvhdi_file_close(vhdi_info->handle, &vhdi_error ) != 0 )
-    {
-        tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_AUX_GENERIC);
-        if (getError(vhdi_error, error_string))
-            errmsg = strerror(errno);
-        else
-            errmsg = error_string;
-
-        tsk_error_set_errstr("vhdi_image_close: unable to close handle - %s", errmsg);
-    }
-
-    libvhdi_file_free(&(vhdi_info->handle), NULL);
-    if( libvhdi_file_free(&(vhdi_info->handle), &vhdi_error ) != 1 )
-    {
-        tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_AUX_GENERIC);
-        if (getError(vhdi_error, error_string))
-            errmsg = strerror(errno);
-        else
-            errmsg = error_string;
+    // slots[0] holds vhdi_info->handle
+    for (i = 0; i < vhdi_info->num_handles; i++) {
+        if (libvhdi_file_close(vhdi_info->slots[i].handle,
+                &vhdi_error) != 0) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_AUX_GENERIC);
+            if (getError(vhdi_error, error_string))
+                errmsg = strerror(errno);
+            else
+                errmsg = error_string;
+
+            tsk_error_set_errstr
+                ("vhdi_image_close: unable to close handle - %s", errmsg);
+            libvhdi_error_free(&vhdi_error);
+        }
 
-        tsk_error_set_errstr("vhdi_image_close: unable to free handle - %s", errmsg);
+        if (libvhdi_file_free(&(vhdi_info->slots[i].handle),
+                &vhdi_error) != 1) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_AUX_GENERIC);
+            if (getError(vhdi_error, error_string))
+                errmsg = strerror(errno);
+            else
+                errmsg = error_string;
+
+            tsk_error_set_errstr
+                ("vhdi_image_close: unable to free handle - %s", errmsg);
+            libvhdi_error_free(&vhdi_error);
+        }
     }
+    for (i = 0; i < VHDI_MAX_HANDLES; i++)
+        tsk_deinit_lock(&(vhdi_info->slots[i].lock));
+    tsk_deinit_lock(&(vhdi_info->pool_lock));
+    free(vhdi_info->block_map);
 
     for (i = 0; i < vhdi_info->img_info.num_img; i++) {
         free(vhdi_info->img_info.images[i]);
     }
     free(vhdi_info->img_info.images);
 
-    tsk_deinit_lock(&(vhdi_info->read_lock));
     tsk_img_free(img_info);
 }
 
@@ -182,22 +476,6 @@ vhdi_open(int a_num_img,
             TSTRLEN(a_images[i]) + 1);
     }
 
-    if (libvhdi_file_initialize(&(vhdi_info->handle), &vhdi_error) != 1) {
-        tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_IMG_OPEN);
-
-        getError(vhdi_error, error_string);
-        tsk_error_set_errstr("vhdi_open file: %" PRIttocTSK
-            ": Error initializing handle (%s)", a_images[0], error_string);
-        libvhdi_error_free(&vhdi_error);
-
-        tsk_img_free(vhdi_info);
-
-        if (tsk_verbose != 0) {
-            tsk_fprintf(stderr, "Unable to create vhdi handle\n");
-        }
-        return (NULL);
-    }
     // Check the file signature before we call the library open
 #if defined( TSK_WIN32 )
     if( libvhdi_check_file_signature_wide((const wchar_t *) vhdi_info->img_info.images[0], &vhdi_error ) != 1 )
@@ -221,24 +499,7 @@ vhdi_open(int a_num_img,
         }
         return (NULL);
     }
-#if defined( TSK_WIN32 )
-    if (libvhdi_file_open_wide(vhdi_info->handle,
-            (const wchar_t *) vhdi_info->img_info.images[0],
-            LIBVHDI_OPEN_READ, &vhdi_error) != 1)
-#else
-    if (libvhdi_file_open(vhdi_info->handle,
-            (const char *) vhdi_info->img_info.images[0],
-            LIBVHDI_OPEN_READ, &vhdi_error) != 1)
-#endif
-    {
-        tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_IMG_OPEN);
-
-        getError(vhdi_error, error_string);
-        tsk_error_set_errstr("vhdi_open file: %" PRIttocTSK
-            ": Error opening (%s)", a_images[0], error_string);
-        libvhdi_error_free(&vhdi_error);
-
+    if (vhdi_open_handle(vhdi_info, &(vhdi_info->handle))) {
         tsk_img_free(vhdi_info);
 
         if (tsk_verbose != 0) {
@@ -257,6 +518,8 @@ vhdi_open(int a_num_img,
             error_string);
         libvhdi_error_free(&vhdi_error);
 
+        libvhdi_file_close(vhdi_info->handle, NULL);
+        libvhdi_file_free(&(vhdi_info->handle), NULL);
         tsk_img_free(vhdi_info);
 
         if (tsk_verbose != 0) {
@@ -276,8 +539,16 @@ vhdi_open(int a_num_img,
     img_info->close = &vhdi_image_close;
     img_info->imgstat = &vhdi_image_imgstat;
 
-    // initialize the read lock
-    tsk_init_lock(&(vhdi_info->read_lock));
+    // reads are spread over a pool of files that each have a lock
+    tsk_init_lock(&(vhdi_info->pool_lock));
+    for (i = 0; i < VHDI_MAX_HANDLES; i++)
+        tsk_init_lock(&(vhdi_info->slots[i].lock));
+    vhdi_info->slots[0].handle = vhdi_info->handle;
+    vhdi_info->num_handles = 1;
+    vhdi_info->max_handles = VHDI_MAX_HANDLES;
+    img_info->parallel_read = 1;
+
+    vhdi_load_block_map(vhdi_info);
 
     return (img_info);
 }
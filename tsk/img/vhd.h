@@ -29,10 +29,35 @@ extern "C" {
     extern TSK_IMG_INFO *vhdi_open(int, const TSK_TCHAR * const images[],
         unsigned int a_ssize);
 
+// Most libvhdi files that an image is read with at once
+#define VHDI_MAX_HANDLES 4
+
+    /* A libvhdi file in the pool of an image.  libvhdi files are not
+     * thread safe, so each one is only used by one read at a time. */
+    typedef struct {
+        libvhdi_file_t *handle; ///< NULL until first needed
+        tsk_lock_t lock;        ///< Held while the file is being used
+        int users;              ///< Reads using or waiting for the file (protected by pool_lock)
+    } VHDI_HANDLE_SLOT;
+
     typedef struct {
         TSK_IMG_INFO img_info;
         libvhdi_file_t *handle;
-        tsk_lock_t read_lock;   // Lock for reads since according to documentation libvhdi is not fully thread safe yet
+
+        // Reads are spread over a pool of files that are opened as
+        // they are needed.  slots[0] holds handle.
+        tsk_lock_t pool_lock;   ///< Lock for the slot users counts and num_handles
+        VHDI_HANDLE_SLOT slots[VHDI_MAX_HANDLES];
+        int max_handles;        ///< Number of slots that can be used
+        int num_handles;        ///< Number of slots that have been used
+
+        // Which blocks are stored, read from the block allocation table
+        // of a dynamic disk when it is opened.  Blocks that are not
+        // stored are zeros and are not read with libvhdi.
+        uint8_t *block_map;     ///< Bit for each block (NULL if not known)
+        uint64_t num_blocks;
+        uint64_t num_alloc_blocks;
+        TSK_OFF_T block_size;   ///< Size of a block in bytes
     } IMG_VHDI_INFO;
 
 #ifdef __cplusplus
@@ -37,32 +37,115 @@ getError(libvmdk_error_t * vmdk_error,
 } 
 
 
-static ssize_t
-vmdk_image_read(TSK_IMG_INFO * img_info, TSK_OFF_T offset, char *buf,
-    size_t len)
+/**
+ * Open another libvmdk handle for the image.
+ * @param vmdk_info Image to open the handle for
+ * @param a_handle Set to the handle
+ * @returns 1 on error and 0 on success
+ */
+static uint8_t
+vmdk_open_handle(IMG_VMDK_INFO * vmdk_info, libvmdk_handle_t ** a_handle)
 {
     char error_string[TSK_VMDK_ERROR_STRING_SIZE];
     libvmdk_error_t *vmdk_error = NULL;
+    libvmdk_handle_t *handle = NULL;
+    const char *what = NULL;
 
-    ssize_t cnt;
-    IMG_VMDK_INFO *vmdk_info = (IMG_VMDK_INFO *) img_info;
-
-    if (tsk_verbose)
-        tsk_fprintf(stderr,
-            "vmdk_image_read: byte offset: %" PRIuOFF " len: %" PRIuSIZE
-            "\n", offset, len);
+    if (libvmdk_handle_initialize(&handle, &vmdk_error) != 1) {
+        what = "initializing handle";
+    }
+#if defined( TSK_WIN32 )
+    else if (libvmdk_handle_open_wide(handle,
+            (const wchar_t *) vmdk_info->img_info.images[0],
+            LIBVMDK_OPEN_READ, &vmdk_error) != 1)
+#else
+    else if (libvmdk_handle_open(handle,
+            (const char *) vmdk_info->img_info.images[0],
+            LIBVMDK_OPEN_READ, &vmdk_error) != 1)
+#endif
+    {
+        what = "opening";
+    }
+    else if (libvmdk_handle_open_extent_data_files(handle,
+            &vmdk_error) != 1) {
+        what = "opening extent data files for image";
+    }
 
-    if (offset > img_info->size) {
+    if (what != NULL) {
         tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_IMG_READ_OFF);
-        tsk_error_set_errstr("vmdk_image_read - %" PRIuOFF, offset);
-        return -1;
+        tsk_error_set_errno(TSK_ERR_IMG_OPEN);
+        getError(vmdk_error, error_string);
+        tsk_error_set_errstr("vmdk_open file: %" PRIttocTSK
+            ": Error %s (%s)", vmdk_info->img_info.images[0], what,
+            error_string);
+        libvmdk_error_free(&vmdk_error);
+        if (handle != NULL)
+            libvmdk_handle_free(&handle, NULL);
+        return 1;
     }
 
-    tsk_take_lock(&(vmdk_info->read_lock));
+    *a_handle = handle;
+    return 0;
+}
+
+/**
+ * Read from the image with one of the handles in its pool.  An idle
+ * handle is used if there is one.  Otherwise, another handle is opened
+ * (up to max_handles) or the read waits for the handle with the fewest
+ * reads using it.
+ */
+static ssize_t
+vmdk_read_handle(IMG_VMDK_INFO * vmdk_info, TSK_OFF_T offset, char *buf,
+    size_t len)
+{
+    char error_string[TSK_VMDK_ERROR_STRING_SIZE];
+    libvmdk_error_t *vmdk_error = NULL;
+    VMDK_HANDLE_SLOT *slot = NULL;
+    ssize_t cnt;
+    int i;
 
-    cnt = libvmdk_handle_read_buffer_at_offset(vmdk_info->handle,
+    tsk_take_lock(&(vmdk_info->pool_lock));
+    for (i = 0; i < vmdk_info->num_handles; i++) {
+        if (vmdk_info->slots[i].users == 0) {
+            slot = &(vmdk_info->slots[i]);
+            break;
+        }
+    }
+    if ((slot == NULL) && (vmdk_info->num_handles < vmdk_info->max_handles)) {
+        libvmdk_handle_t *handle = NULL;
+        if (vmdk_open_handle(vmdk_info, &handle)) {
+            if (tsk_verbose)
+                tsk_fprintf(stderr,
+                    "vmdk_read_handle: Error opening handle %d, using %d handles: %s\n",
+                    vmdk_info->num_handles + 1, vmdk_info->num_handles,
+                    tsk_error_get());
+            tsk_error_reset();
+            vmdk_info->max_handles = vmdk_info->num_handles;
+        }
+        else {
+            slot = &(vmdk_info->slots[vmdk_info->num_handles++]);
+            slot->handle = handle;
+        }
+    }
+    if (slot == NULL) {
+        slot = &(vmdk_info->slots[0]);
+        for (i = 1; i < vmdk_info->num_handles; i++) {
+            if (vmdk_info->slots[i].users < slot->users)
+                slot = &(vmdk_info->slots[i]);
+        }
+    }
+    slot->users++;
+    tsk_release_lock(&(vmdk_info->pool_lock));
+
+    tsk_take_lock(&(slot->lock));
+    cnt = libvmdk_handle_read_buffer_at_offset(slot->handle,
         buf, len, offset, &vmdk_error);
+    tsk_release_lock(&(slot->lock));
+
+    tsk_take_lock(&(vmdk_info->pool_lock));
+    slot->users--;
+    tsk_release_lock(&(vmdk_info->pool_lock));
+
     if (cnt < 0) {
         char *errmsg = NULL;
         tsk_error_reset();
@@ -74,24 +157,261 @@ vmdk_image_read(TSK_IMG_INFO * img_info, TSK_OFF_T offset, char *buf,
 
         tsk_error_set_errstr("vmdk_image_read - offset: %" PRIuOFF
             " - len: %" PRIuSIZE " - %s", offset, len, errmsg);
-        tsk_release_lock(&(vmdk_info->read_lock));
+        libvmdk_error_free(&vmdk_error);
         return -1;
     }
+    return cnt;
+}
 
-    tsk_release_lock(&(vmdk_info->read_lock));
+/**
+ * Read bytes from the image file itself (not the disk in it).
+ * @returns 1 on error and 0 on success
+ */
+static uint8_t
+vmdk_file_read(FILE * hFile, uint64_t a_off, void *a_buf, size_t a_len)
+{
+#if defined( TSK_WIN32 )
+    if (_fseeki64(hFile, (__int64) a_off, SEEK_SET) != 0)
+        return 1;
+#else
+    if (fseeko(hFile, (off_t) a_off, SEEK_SET) != 0)
+        return 1;
+#endif
+    if (fread(a_buf, 1, a_len, hFile) != a_len)
+        return 1;
+    return 0;
+}
 
-    return cnt;
+/**
+ * Load which grains are stored from the grain directory and grain tables
+ * of the image.  This is only done for a monolithic sparse extent that
+ * has no parent, where a grain that is not in a grain table is zeros.
+ * For other images (split, stream optimized, snapshots) the map is left
+ * NULL and everything is read with libvmdk.  Errors are not fatal.
+ */
+static void
+vmdk_load_grain_map(IMG_VMDK_INFO * vmdk_info)
+{
+    TSK_IMG_INFO *img_info = (TSK_IMG_INFO *) vmdk_info;
+    FILE *hFile = NULL;
+    uint8_t head[512];
+    char *desc = NULL;
+    uint32_t *gd = NULL;
+    uint32_t *gt = NULL;
+    uint64_t capacity, grain_secs, desc_off, desc_size, gd_off;
+    uint64_t num_gts, gt_idx;
+    uint32_t gtes_per_gt;
+    const char *why = NULL;
+
+    if (img_info->num_img != 1)
+        return;
+
+#if defined( TSK_WIN32 )
+    hFile = _wfopen(img_info->images[0], L"rb");
+#else
+    hFile = fopen(img_info->images[0], "rb");
+#endif
+    if (hFile == NULL)
+        return;
+
+    if (vmdk_file_read(hFile, 0, head, sizeof(head))) {
+        why = "error reading header";
+        goto done;
+    }
+    if (memcmp(head, "KDMV", 4) != 0) {
+        why = "not a sparse extent";
+        goto done;
+    }
+    capacity = tsk_getu64(TSK_LIT_ENDIAN, &head[12]);
+    grain_secs = tsk_getu64(TSK_LIT_ENDIAN, &head[20]);
+    desc_off = tsk_getu64(TSK_LIT_ENDIAN, &head[28]);
+    desc_size = tsk_getu64(TSK_LIT_ENDIAN, &head[36]);
+    gtes_per_gt = tsk_getu32(TSK_LIT_ENDIAN, &head[44]);
+    gd_off = tsk_getu64(TSK_LIT_ENDIAN, &head[56]);
+
+    // stream optimized images have the grain directory at the end
+    if (gd_off == 0xffffffffffffffffULL) {
+        why = "grain directory at end";
+        goto done;
+    }
+    if ((capacity * 512 != (uint64_t) img_info->size) || (grain_secs == 0)
+        || (grain_secs > 0x10000) || (gtes_per_gt == 0)
+        || (gtes_per_gt > 0x10000) || (gd_off == 0)) {
+        why = "unexpected header values";
+        goto done;
+    }
+
+    // the descriptor must be in this file and say that it has no parent
+    if ((desc_off == 0) || (desc_size == 0) || (desc_size > 2048)) {
+        why = "no embedded descriptor";
+        goto done;
+    }
+    if ((desc = (char *) tsk_malloc((size_t) desc_size * 512 + 1)) == NULL) {
+        why = tsk_error_get();
+        goto done;
+    }
+    if (vmdk_file_read(hFile, desc_off * 512, desc,
+            (size_t) desc_size * 512)) {
+        why = "error reading descriptor";
+        goto done;
+    }
+    desc[desc_size * 512] = '\0';
+    if ((strstr(desc, "monolithicSparse") == NULL)
+        || (strstr(desc, "parentCID=ffffffff") == NULL)) {
+        why = "not a monolithic sparse image without a parent";
+        goto done;
+    }
+
+    vmdk_info->grain_size = (TSK_OFF_T) grain_secs * 512;
+    vmdk_info->num_grains = (capacity + grain_secs - 1) / grain_secs;
+    num_gts = (vmdk_info->num_grains + gtes_per_gt - 1) / gtes_per_gt;
+
+    if (((gd = (uint32_t *) tsk_malloc((size_t) num_gts * 4)) == NULL)
+        || ((gt = (uint32_t *) tsk_malloc(gtes_per_gt * 4)) == NULL)
+        || ((vmdk_info->grain_map =
+                (uint8_t *) tsk_malloc((size_t) (vmdk_info->num_grains +
+                        7) / 8)) == NULL)) {
+        why = tsk_error_get();
+        goto done;
+    }
+
+    if (vmdk_file_read(hFile, gd_off * 512, gd, (size_t) num_gts * 4)) {
+        why = "error reading grain directory";
+        goto done;
+    }
+    for (gt_idx = 0; gt_idx < num_gts; gt_idx++) {
+        uint64_t gt_off = tsk_getu32(TSK_LIT_ENDIAN, &gd[gt_idx]);
+        uint64_t first = gt_idx * gtes_per_gt;
+        uint32_t n = gtes_per_gt;
+        uint32_t i;
+
+        // no grain table means that none of its grains are stored
+        if (gt_off == 0)
+            continue;
+        if (first + n > vmdk_info->num_grains)
+            n = (uint32_t) (vmdk_info->num_grains - first);
+        if (vmdk_file_read(hFile, gt_off * 512, gt, n * 4)) {
+            why = "error reading grain table";
+            goto done;
+        }
+        // 0 is not stored and 1 is a zero grain
+        for (i = 0; i < n; i++) {
+            if (tsk_getu32(TSK_LIT_ENDIAN, &gt[i]) > 1) {
+                vmdk_info->grain_map[(first + i) / 8] |=
+                    (1 << ((first + i) % 8));
+                vmdk_info->num_alloc_grains++;
+            }
+        }
+    }
+
+  done:
+    if (why != NULL) {
+        if (tsk_verbose)
+            tsk_fprintf(stderr,
+                "vmdk_load_grain_map: reading all grains with libvmdk (%s)\n",
+                why);
+        tsk_error_reset();
+        free(vmdk_info->grain_map);
+        vmdk_info->grain_map = NULL;
+        vmdk_info->num_alloc_grains = 0;
+    }
+    else if (tsk_verbose) {
+        tsk_fprintf(stderr,
+            "vmdk_load_grain_map: %" PRIu64 " of %" PRIu64
+            " grains stored\n", vmdk_info->num_alloc_grains,
+            vmdk_info->num_grains);
+    }
+    free(gt);
+    free(gd);
+    free(desc);
+    fclose(hFile);
+}
+
+/**
+ * @returns 1 if the grain is stored in the image
+ */
+static int
+vmdk_grain_is_alloc(IMG_VMDK_INFO * vmdk_info, uint64_t a_grain)
+{
+    return (vmdk_info->grain_map[a_grain / 8] & (1 << (a_grain % 8))) != 0;
+}
+
+static ssize_t
+vmdk_image_read(TSK_IMG_INFO * img_info, TSK_OFF_T offset, char *buf,
+    size_t len)
+{
+    IMG_VMDK_INFO *vmdk_info = (IMG_VMDK_INFO *) img_info;
+    size_t done = 0;
+
+    if (tsk_verbose)
+        tsk_fprintf(stderr,
+            "vmdk_image_read: byte offset: %" PRIuOFF " len: %" PRIuSIZE
+            "\n", offset, len);
+
+    if (offset > img_info->size) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_IMG_READ_OFF);
+        tsk_error_set_errstr("vmdk_image_read - %" PRIuOFF, offset);
+        return -1;
+    }
+
+    if (vmdk_info->grain_map == NULL)
+        return vmdk_read_handle(vmdk_info, offset, buf, len);
+
+    if ((TSK_OFF_T) len > img_info->size - offset)
+        len = (size_t) (img_info->size - offset);
+
+    // Split the read into runs of grains that are all stored or all
+    // not stored.  Grains that are not stored are zeros.
+    while (done < len) {
+        TSK_OFF_T cur = offset + done;
+        uint64_t grain = cur / vmdk_info->grain_size;
+        int alloc = vmdk_grain_is_alloc(vmdk_info, grain);
+        TSK_OFF_T run_end = (TSK_OFF_T) (grain + 1) * vmdk_info->grain_size;
+        size_t cnt;
+
+        while ((run_end < offset + (TSK_OFF_T) len)
+            && (vmdk_grain_is_alloc(vmdk_info,
+                    run_end / vmdk_info->grain_size) == alloc))
+            run_end += vmdk_info->grain_size;
+        if (run_end > offset + (TSK_OFF_T) len)
+            run_end = offset + len;
+        cnt = (size_t) (run_end - cur);
+
+        if (alloc) {
+            ssize_t retval =
+                vmdk_read_handle(vmdk_info, cur, &buf[done], cnt);
+            if (retval < 0)
+                return -1;
+            done += retval;
+            if ((size_t) retval < cnt)
+                break;
+        }
+        else {
+            memset(&buf[done], 0, cnt);
+            done += cnt;
+        }
+    }
+    return (ssize_t) done;
 }
 
 static void
 vmdk_image_imgstat(TSK_IMG_INFO * img_info, FILE * hFile)
 {
+    IMG_VMDK_INFO *vmdk_info = (IMG_VMDK_INFO *) img_info;
+
     tsk_fprintf(hFile, "IMAGE FILE INFORMATION\n");
     tsk_fprintf(hFile, "--------------------------------------------\n");
     tsk_fprintf(hFile, "Image Type:\t\tvmdk\n");
     tsk_fprintf(hFile, "\nSize of data in bytes:\t%" PRIuOFF "\n",
         img_info->size);
     tsk_fprintf(hFile, "Sector size:\t%d\n", img_info->sector_size);
+    if (vmdk_info->grain_map != NULL) {
+        tsk_fprintf(hFile, "Grain size:\t%" PRIuOFF "\n",
+            vmdk_info->grain_size);
+        tsk_fprintf(hFile, "Stored grains:\t%" PRIu64 " of %" PRIu64 "\n",
+            vmdk_info->num_alloc_grains, vmdk_info->num_grains);
+    }
 
     return;
 }
@@ -106,37 +426,46 @@ static void
     char *errmsg = NULL;
     IMG_VMDK_INFO *vmdk_info = (IMG_VMDK_INFO *) img_info;
 
-    if( libvmdk_handle_close(vmdk_info->handle, &vmdk_error ) != 0 )
-    {
-        tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_AUX_GENERIC);
-        if (getError(vmdk_error, error_string))
-            errmsg = strerror(errno);
-        else
-            errmsg = error_string;
-
-        tsk_error_set_errstr("vmdk_image_close: unable to close handle - %s", errmsg);
-    }
-
-    libvmdk_handle_free(&(vmdk_info->handle), NULL);
-    if( libvmdk_handle_free(&(vmdk_info->handle), &vmdk_error ) != 1 )
-    {
-        tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_AUX_GENERIC);
-        if (getError(vmdk_error, error_string))
-            errmsg = strerror(errno);
-        else
-            errmsg = error_string;
+    // slots[0] holds vmdk_info->handle
+    for (i = 0; i < vmdk_info->num_handles; i++) {
+        if (libvmdk_handle_close(vmdk_info->slots[i].handle,
+                &vmdk_error) != 0) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_AUX_GENERIC);
+            if (getError(vmdk_error, error_string))
+                errmsg = strerror(errno);
+            else
+                errmsg = error_string;
+
+            tsk_error_set_errstr
+                ("vmdk_image_close: unable to close handle - %s", errmsg);
+            libvmdk_error_free(&vmdk_error);
+        }
 
-        tsk_error_set_errstr("vmdk_image_close: unable to free handle - %s", errmsg);
+        if (libvmdk_handle_free(&(vmdk_info->slots[i].handle),
+                &vmdk_error) != 1) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_AUX_GENERIC);
+            if (getError(vmdk_error, error_string))
+                errmsg = strerror(errno);
+            else
+                errmsg = error_string;
+
+            tsk_error_set_errstr
+                ("vmdk_image_close: unable to free handle - %s", errmsg);
+            libvmdk_error_free(&vmdk_error);
+        }
     }
+    for (i = 0; i < VMDK_MAX_HANDLES; i++)
+        tsk_deinit_lock(&(vmdk_info->slots[i].lock));
+    tsk_deinit_lock(&(vmdk_info->pool_lock));
+    free(vmdk_info->grain_map);
 
     for (i = 0; i < vmdk_info->img_info.num_img; i++) {
         free(vmdk_info->img_info.images[i]);
     }
     free(vmdk_info->img_info.images);
 
-    tsk_deinit_lock(&(vmdk_info->read_lock));
     tsk_img_free(img_info);
 }
 
@@ -182,40 +511,7 @@ vmdk_open(int a_num_img,
             TSTRLEN(a_images[i]) + 1);
     }
 
-    if (libvmdk_handle_initialize(&(vmdk_info->handle), &vmdk_error) != 1) {
-        tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_IMG_OPEN);
-
-        getError(vmdk_error, error_string);
-        tsk_error_set_errstr("vmdk_open file: %" PRIttocTSK
-            ": Error initializing handle (%s)", a_images[0], error_string);
-        libvmdk_error_free(&vmdk_error);
-
-        tsk_img_free(vmdk_info);
-
-        if (tsk_verbose != 0) {
-            tsk_fprintf(stderr, "Unable to create vmdk handle\n");
-        }
-        return (NULL);
-    }
-#if defined( TSK_WIN32 )
-    if (libvmdk_handle_open_wide(vmdk_info->handle,
-            (const wchar_t *) vmdk_info->img_info.images[0],
-            LIBVMDK_OPEN_READ, &vmdk_error) != 1)
-#else
-    if (libvmdk_handle_open(vmdk_info->handle,
-            (const char *) vmdk_info->img_info.images[0],
-            LIBVMDK_OPEN_READ, &vmdk_error) != 1)
-#endif
-    {
-        tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_IMG_OPEN);
-
-        getError(vmdk_error, error_string);
-        tsk_error_set_errstr("vmdk_open file: %" PRIttocTSK
-            ": Error opening (%s)", a_images[0], error_string);
-        libvmdk_error_free(&vmdk_error);
-
+    if (vmdk_open_handle(vmdk_info, &(vmdk_info->handle))) {
         tsk_img_free(vmdk_info);
 
         if (tsk_verbose != 0) {
@@ -223,24 +519,6 @@ vmdk_open(int a_num_img,
         }
         return (NULL);
     }
-    if( libvmdk_handle_open_extent_data_files(vmdk_info->handle, &vmdk_error ) != 1 )
-	{
-        tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_IMG_OPEN);
-
-        getError(vmdk_error, error_string);
-        tsk_error_set_errstr("vmdk_open file: %" PRIttocTSK
-            ": Error opening extent data files for image (%s)", a_images[0],
-            error_string);
-        libvmdk_error_free(&vmdk_error);
-
-        tsk_img_free(vmdk_info);
-
-        if (tsk_verbose != 0) {
-            tsk_fprintf(stderr, "Error opening vmdk extent data files\n");
-        }
-        return (NULL);
-    }
     if (libvmdk_handle_get_media_size(vmdk_info->handle,
             (size64_t *) & (img_info->size), &vmdk_error) != 1) {
         tsk_error_reset();
@@ -252,6 +530,8 @@ vmdk_open(int a_num_img,
             error_string);
         libvmdk_error_free(&vmdk_error);
 
+        libvmdk_handle_close(vmdk_info->handle, NULL);
+        libvmdk_handle_free(&(vmdk_info->handle), NULL);
         tsk_img_free(vmdk_info);
 
         if (tsk_verbose != 0) {
@@ -271,8 +551,16 @@ vmdk_open(int a_num_img,
     img_info->close = &vmdk_image_close;
     img_info->imgstat = &vmdk_image_imgstat;
 
-    // initialize the read lock
-    tsk_init_lock(&(vmdk_info->read_lock));
+    // reads are spread over a pool of handles that each have a lock
+    tsk_init_lock(&(vmdk_info->pool_lock));
+    for (i = 0; i < VMDK_MAX_HANDLES; i++)
+        tsk_init_lock(&(vmdk_info->slots[i].lock));
+    vmdk_info->slots[0].handle = vmdk_info->handle;
+    vmdk_info->num_handles = 1;
+    vmdk_info->max_handles = VMDK_MAX_HANDLES;
+    img_info->parallel_read = 1;
+
+    vmdk_load_grain_map(vmdk_info);
 
     return (img_info);
 }
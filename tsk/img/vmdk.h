@@ -29,10 +29,35 @@ extern "C" {
     extern TSK_IMG_INFO *vmdk_open(int, const TSK_TCHAR * const images[],
         unsigned int a_ssize);
 
+// Most libvmdk handles that an image is read with at once
+#define VMDK_MAX_HANDLES 4
+
+    /* A libvmdk handle in the pool of an image.  libvmdk handles are not
+     * thread safe, so each one is only used by one read at a time. */
+    typedef struct {
+        libvmdk_handle_t *handle;       ///< NULL until first needed
+        tsk_lock_t lock;        ///< Held while the handle is being used
+        int users;              ///< Reads using or waiting for the handle (protected by pool_lock)
+    } VMDK_HANDLE_SLOT;
+
     typedef struct {
         TSK_IMG_INFO img_info;
         libvmdk_handle_t *handle;
-        tsk_lock_t read_lock;   // Lock for reads since according to documentation libvmdk is not fully thread safe yet
+
+        // Reads are spread over a pool of handles that are opened as
+        // they are needed.  slots[0] holds handle.
+        tsk_lock_t pool_lock;   ///< Lock for the slot users counts and num_handles
+        VMDK_HANDLE_SLOT slots[VMDK_MAX_HANDLES];
+        int max_handles;        ///< Number of slots that can be used
+        int num_handles;        ///< Number of slots that have been used
+
+        // Which grains are stored, read from the grain tables of a
+        // monolithic sparse extent without a parent when it is opened.
+        // Grains that are not stored are zeros and are not read with libvmdk.
+        uint8_t *grain_map;     ///< Bit for each grain (NULL if not known)
+        uint64_t num_grains;
+        uint64_t num_alloc_grains;
+        TSK_OFF_T grain_size;   ///< Size of a grain in bytes
     } IMG_VMDK_INFO;
 
 #ifdef __cplusplus
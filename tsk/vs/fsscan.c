@@ -0,0 +1,402 @@
+/*
+ * The Sleuth Kit
+ *
+ * Brian Carrier [carrier <at> sleuthkit [dot] org]
+ * Copyright (c) 2006-2016 Brian Carrier, Basis Technology.  All rights reserved
+ *
+ * This software is distributed under the Common Public License 1.0
+ */
+
+/** \file fsscan.c
+ * Creates a volume system for an image whose partition table is missing or
+ * damaged by scanning the image for file system signatures.  The image is
+ * split between several threads that each read it in large batches and
+ * check every sector for the boot sector or superblock signatures of NTFS,
+ * exFAT, FAT, ext, HFS+ and ISO9660.  Each candidate is then opened with
+ * the normal file system code and the ones that open become the volumes.
+ */
+
+#include "tsk_vs_i.h"
+#include "tsk/fs/tsk_fs.h"
+
+#ifdef TSK_WIN32
+#include <process.h>
+#endif
+
+#define FSSCAN_NUM_THREADS 4
+#define FSSCAN_BATCH (4 * 1024 * 1024)  ///< Bytes of new data in each read
+
+/* The signature that is farthest from the start of a file system is the
+ * ISO9660 volume descriptor at 32KB.  Each read has this much extra data
+ * so that all signatures of a start in the batch can be checked. */
+#define FSSCAN_OVERLAP (32768 + 2048)
+
+/* A place where a file system could start */
+typedef struct {
+    TSK_OFF_T offset;           ///< Byte offset relative to the start of the scan
+    TSK_FS_TYPE_ENUM ftype;
+} FSSCAN_CAND;
+
+/* Part of the image that one thread scans */
+typedef struct {
+    TSK_IMG_INFO *img_info;
+    TSK_OFF_T scan_start;       ///< Image offset where the scan starts
+    TSK_OFF_T scan_end;         ///< Image offset where the scan ends
+    TSK_OFF_T start;            ///< First offset (relative to scan_start) for this thread
+    TSK_OFF_T end;              ///< End of this thread's part (relative to scan_start)
+    unsigned int step;          ///< Alignment of the starts that are checked
+
+    FSSCAN_CAND *cands;
+    size_t num_cands;
+    size_t cands_alloc;
+    int failed;
+#ifdef TSK_WIN32
+    HANDLE thread;
+#elif defined(TSK_MULTITHREAD_LIB)
+    pthread_t thread;
+    int started;
+#endif
+} FSSCAN_PART;
+
+
+/**
+ * Check whether a file system could start at a buffer.
+ * @param a_buf Data at the possible start
+ * @param a_len Number of bytes that are available in a_buf
+ * @returns The type of file system or TSK_FS_TYPE_UNSUPP
+ */
+static TSK_FS_TYPE_ENUM
+fsscan_match(const uint8_t * a_buf, size_t a_len)
+{
+    if (a_len < 512)
+        return TSK_FS_TYPE_UNSUPP;
+
+    // NTFS, exFAT and FAT boot sectors
+    if ((a_buf[510] == 0x55) && (a_buf[511] == 0xaa)) {
+        if (memcmp(&a_buf[3], "NTFS    ", 8) == 0)
+            return TSK_FS_TYPE_NTFS;
+        if (memcmp(&a_buf[3], "EXFAT   ", 8) == 0)
+            return TSK_FS_TYPE_EXFAT;
+        if (((a_buf[0] == 0xeb) || (a_buf[0] == 0xe9))
+            && ((memcmp(&a_buf[54], "FAT1", 4) == 0)
+                || (memcmp(&a_buf[82], "FAT32", 5) == 0)))
+            return TSK_FS_TYPE_FAT_DETECT;
+    }
+
+    if (a_len < 1024 + 128)
+        return TSK_FS_TYPE_UNSUPP;
+
+    // ext superblock: the magic is only two bytes, so some other fields
+    // have to make sense too
+    if ((a_buf[1024 + 56] == 0x53) && (a_buf[1024 + 57] == 0xef)
+        && (tsk_getu32(TSK_LIT_ENDIAN, &a_buf[1024 + 24]) <= 6)
+        && (tsk_getu32(TSK_LIT_ENDIAN, &a_buf[1024 + 76]) <= 1)
+        && (tsk_getu32(TSK_LIT_ENDIAN, &a_buf[1024]) != 0)
+        && (tsk_getu32(TSK_LIT_ENDIAN, &a_buf[1024 + 4]) != 0))
+        return TSK_FS_TYPE_EXT_DETECT;
+
+    // HFS+ and HFSX volume header
+    if ((a_buf[1024] == 'H') && ((a_buf[1025] == '+')
+            || (a_buf[1025] == 'X')) && (a_buf[1026] == 0)
+        && ((a_buf[1027] == 4) || (a_buf[1027] == 5)))
+        return TSK_FS_TYPE_HFS_DETECT;
+
+    // ISO9660 volume descriptor in the 16th 2KB sector
+    if ((a_len >= 32768 + 6) && (a_buf[32768] == 1)
+        && (memcmp(&a_buf[32769], "CD001", 5) == 0))
+        return TSK_FS_TYPE_ISO9660;
+
+    return TSK_FS_TYPE_UNSUPP;
+}
+
+/**
+ * Scan one part of the image.  Sets failed on error.
+ */
+static void
+fsscan_part(FSSCAN_PART * a_part)
+{
+    char *buf;
+    TSK_OFF_T batch;
+
+    if ((buf = (char *) tsk_malloc(FSSCAN_BATCH + FSSCAN_OVERLAP)) == NULL) {
+        a_part->failed = 1;
+        return;
+    }
+
+    for (batch = a_part->start; batch < a_part->end; batch += FSSCAN_BATCH) {
+        TSK_OFF_T img_off = a_part->scan_start + batch;
+        size_t len = FSSCAN_BATCH + FSSCAN_OVERLAP;
+        size_t num_starts;
+        size_t i;
+        ssize_t cnt;
+
+        if ((TSK_OFF_T) len > a_part->scan_end - img_off)
+            len = (size_t) (a_part->scan_end - img_off);
+
+        cnt = tsk_img_read(a_part->img_info, img_off, buf, len);
+        if (cnt < 0) {
+            a_part->failed = 1;
+            break;
+        }
+
+        // only the starts in this batch; the overlap is for their signatures
+        num_starts = FSSCAN_BATCH;
+        if ((TSK_OFF_T) num_starts > a_part->end - batch)
+            num_starts = (size_t) (a_part->end - batch);
+
+        for (i = 0; i < num_starts && i < (size_t) cnt; i += a_part->step) {
+            TSK_FS_TYPE_ENUM ftype =
+                fsscan_match((uint8_t *) & buf[i], (size_t) cnt - i);
+            if (ftype == TSK_FS_TYPE_UNSUPP)
+                continue;
+
+            if (a_part->num_cands == a_part->cands_alloc) {
+                size_t new_alloc =
+                    a_part->cands_alloc ? a_part->cands_alloc * 2 : 16;
+                FSSCAN_CAND *cands =
+                    (FSSCAN_CAND *) tsk_realloc(a_part->cands,
+                    new_alloc * sizeof(FSSCAN_CAND));
+                if (cands == NULL) {
+                    a_part->failed = 1;
+                    free(buf);
+                    return;
+                }
+                a_part->cands = cands;
+                a_part->cands_alloc = new_alloc;
+            }
+            a_part->cands[a_part->num_cands].offset = batch + i;
+            a_part->cands[a_part->num_cands].ftype = ftype;
+            a_part->num_cands++;
+        }
+    }
+    free(buf);
+}
+
+#ifdef TSK_WIN32
+static unsigned __stdcall
+fsscan_thread(void *a_arg)
+{
+    fsscan_part((FSSCAN_PART *) a_arg);
+    return 0;
+}
+#elif defined(TSK_MULTITHREAD_LIB)
+static void *
+fsscan_thread(void *a_arg)
+{
+    fsscan_part((FSSCAN_PART *) a_arg);
+    return NULL;
+}
+#endif
+
+/**
+ * Scan the parts of the image at the same time.  If a thread can not be
+ * started, its part is scanned by the calling thread.
+ */
+static void
+fsscan_run(FSSCAN_PART * a_parts, int a_num_parts)
+{
+    int i;
+
+#ifdef TSK_WIN32
+    for (i = 1; i < a_num_parts; i++) {
+        a_parts[i].thread =
+            (HANDLE) _beginthreadex(NULL, 0, fsscan_thread, &a_parts[i], 0,
+            NULL);
+    }
+    fsscan_part(&a_parts[0]);
+    for (i = 1; i < a_num_parts; i++) {
+        if (a_parts[i].thread != 0) {
+            WaitForSingleObject(a_parts[i].thread, INFINITE);
+            CloseHandle(a_parts[i].thread);
+        }
+        else {
+            fsscan_part(&a_parts[i]);
+        }
+    }
+#elif defined(TSK_MULTITHREAD_LIB)
+    for (i = 1; i < a_num_parts; i++) {
+        a_parts[i].started = (pthread_create(&a_parts[i].thread, NULL,
+                fsscan_thread, &a_parts[i]) == 0);
+    }
+    fsscan_part(&a_parts[0]);
+    for (i = 1; i < a_num_parts; i++) {
+        if (a_parts[i].started)
+            pthread_join(a_parts[i].thread, NULL);
+        else
+            fsscan_part(&a_parts[i]);
+    }
+#else
+    for (i = 0; i < a_num_parts; i++) {
+        fsscan_part(&a_parts[i]);
+    }
+#endif
+}
+
+static void
+fsscan_close(TSK_VS_INFO * vs)
+{
+    vs->tag = 0;
+    tsk_vs_part_free(vs);
+    free(vs);
+}
+
+/**
+ * \internal
+ * Scan an image for file systems and make a volume for each one that
+ * opens.  Candidates inside a file system that was already found (such
+ * as backup boot sectors and superblocks) are skipped.
+ *
+ * @param img_info Image to scan
+ * @param offset Byte offset in the image where the scan starts
+ * @returns NULL on error or if no file systems were found
+ */
+TSK_VS_INFO *
+tsk_vs_fsscan_open(TSK_IMG_INFO * img_info, TSK_DADDR_T offset)
+{
+    TSK_VS_INFO *vs;
+    FSSCAN_PART parts[FSSCAN_NUM_THREADS];
+    TSK_OFF_T scan_len;
+    TSK_OFF_T part_len;
+    TSK_OFF_T fs_end = 0;       // end of the last file system that was found
+    int num_parts;
+    int num_found = 0;
+    uint8_t failed = 0;
+    int i;
+
+    // clean up any errors that are lying around
+    tsk_error_reset();
+
+    if (img_info->sector_size == 0) {
+        tsk_error_set_errno(TSK_ERR_VS_ARG);
+        tsk_error_set_errstr("tsk_vs_fsscan_open: sector size is 0");
+        return NULL;
+    }
+    if ((TSK_OFF_T) offset >= img_info->size) {
+        tsk_error_set_errno(TSK_ERR_VS_ARG);
+        tsk_error_set_errstr("tsk_vs_fsscan_open: offset is past the end of the image");
+        return NULL;
+    }
+
+    vs = (TSK_VS_INFO *) tsk_malloc(sizeof(*vs));
+    if (vs == NULL)
+        return NULL;
+
+    vs->img_info = img_info;
+    vs->vstype = TSK_VS_TYPE_FSSCAN;
+    vs->tag = TSK_VS_INFO_TAG;
+    vs->offset = offset;
+    vs->part_list = NULL;
+    vs->part_count = 0;
+    vs->endian = 0;
+    vs->block_size = img_info->sector_size;
+    vs->close = fsscan_close;
+
+    /* Split the image into one part per thread at batch boundaries */
+    scan_len = img_info->size - offset;
+    part_len = (scan_len + FSSCAN_NUM_THREADS - 1) / FSSCAN_NUM_THREADS;
+    part_len = (part_len + FSSCAN_BATCH - 1) / FSSCAN_BATCH * FSSCAN_BATCH;
+    memset(parts, 0, sizeof(parts));
+    for (num_parts = 0; num_parts < FSSCAN_NUM_THREADS; num_parts++) {
+        FSSCAN_PART *part = &parts[num_parts];
+        part->start = num_parts * part_len;
+        if (part->start >= scan_len)
+            break;
+        part->end = part->start + part_len;
+        if (part->end > scan_len)
+            part->end = scan_len;
+        part->img_info = img_info;
+        part->scan_start = offset;
+        part->scan_end = img_info->size;
+        part->step = vs->block_size;
+    }
+
+    if (tsk_verbose)
+        tsk_fprintf(stderr,
+            "tsk_vs_fsscan_open: scanning %" PRIuOFF " bytes at offset %"
+            PRIuDADDR " with %d threads\n", scan_len, offset, num_parts);
+
+    fsscan_run(parts, num_parts);
+
+    /* The parts are in order and each has its candidates in order, so
+     * they can be checked from the start of the image to the end */
+    for (i = 0; i < num_parts && failed == 0; i++) {
+        size_t j;
+
+        if (parts[i].failed) {
+            if (tsk_verbose)
+                tsk_fprintf(stderr,
+                    "tsk_vs_fsscan_open: error scanning part %d\n", i);
+        }
+
+        for (j = 0; j < parts[i].num_cands; j++) {
+            FSSCAN_CAND *cand = &parts[i].cands[j];
+            TSK_FS_INFO *fs;
+            TSK_OFF_T fs_len;
+            char *desc;
+
+            if (cand->offset < fs_end)
+                continue;
+
+            if ((fs =
+                    tsk_fs_open_img(img_info, offset + cand->offset,
+                        cand->ftype)) == NULL) {
+                tsk_error_reset();
+                continue;
+            }
+
+            fs_len = (TSK_OFF_T) fs->block_count * fs->block_size;
+            if ((fs_len <= 0) || (fs_len > scan_len - cand->offset))
+                fs_len = scan_len - cand->offset;
+
+            if (tsk_verbose)
+                tsk_fprintf(stderr,
+                    "tsk_vs_fsscan_open: %s file system at offset %"
+                    PRIuOFF " (%" PRIuOFF " bytes)\n",
+                    tsk_fs_type_toname(fs->ftype), cand->offset, fs_len);
+
+            if ((desc = (char *) tsk_malloc(32)) == NULL) {
+                tsk_fs_close(fs);
+                failed = 1;
+                break;
+            }
+            snprintf(desc, 32, "%s (found by scan)",
+                tsk_fs_type_toname(fs->ftype));
+            tsk_fs_close(fs);
+
+            if (NULL == tsk_vs_part_add(vs,
+                    (TSK_DADDR_T) (cand->offset / vs->block_size),
+                    (TSK_DADDR_T) ((fs_len + vs->block_size -
+                            1) / vs->block_size), TSK_VS_PART_FLAG_ALLOC,
+                    desc, -1, num_found)) {
+                free(desc);
+                failed = 1;
+                break;
+            }
+            num_found++;
+            fs_end = cand->offset + fs_len;
+        }
+    }
+
+    for (i = 0; i < num_parts; i++)
+        free(parts[i].cands);
+
+    if (failed) {
+        fsscan_close(vs);
+        return NULL;
+    }
+    if (num_found == 0) {
+        fsscan_close(vs);
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_VS_UNKTYPE);
+        tsk_error_set_errstr("tsk_vs_fsscan_open: no file systems found");
+        return NULL;
+    }
+
+    /* fill in the sorted list with the 'unknown' values */
+    if (tsk_vs_part_unused(vs)) {
+        fsscan_close(vs);
+        return NULL;
+    }
+
+    return vs;
+}
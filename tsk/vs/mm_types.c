@@ -29,6 +29,8 @@ VS_TYPES vs_open_table[] = {
     {"sun", TSK_VS_TYPE_SUN,
         "Sun Volume Table of Contents (Solaris)"},
     {"gpt", TSK_VS_TYPE_GPT, "GUID Partition Table (EFI)"},
+    {"fsscan", TSK_VS_TYPE_FSSCAN,
+        "File systems found by scanning the image"},
     {0, 0, ""},
 };
 
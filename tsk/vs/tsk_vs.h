@@ -53,6 +53,7 @@ extern "C" {
         TSK_VS_TYPE_SUN = 0x0004,       ///< Sun VTOC
         TSK_VS_TYPE_MAC = 0x0008,       ///< Mac partition table
         TSK_VS_TYPE_GPT = 0x0010,       ///< GPT partition table
+        TSK_VS_TYPE_FSSCAN = 0x0020,    ///< Volumes made from the file systems found by scanning the image (never auto-detected)
         TSK_VS_TYPE_DBFILLER = 0x00F0,  ///< fake partition table type for loaddb (for images that do not have a volume system)
         TSK_VS_TYPE_UNSUPP = 0xffff,    ///< Unsupported
     } TSK_VS_TYPE_ENUM;
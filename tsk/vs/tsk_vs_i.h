@@ -29,6 +29,7 @@ extern TSK_VS_INFO *tsk_vs_mac_open(TSK_IMG_INFO *, TSK_DADDR_T);
 extern TSK_VS_INFO *tsk_vs_bsd_open(TSK_IMG_INFO *, TSK_DADDR_T);
 extern TSK_VS_INFO *tsk_vs_sun_open(TSK_IMG_INFO *, TSK_DADDR_T);
 extern TSK_VS_INFO *tsk_vs_gpt_open(TSK_IMG_INFO *, TSK_DADDR_T);
+extern TSK_VS_INFO *tsk_vs_fsscan_open(TSK_IMG_INFO *, TSK_DADDR_T);
 
 extern uint8_t tsk_vs_part_unused(TSK_VS_INFO *);
 extern TSK_VS_PART_INFO *tsk_vs_part_add(TSK_VS_INFO *, TSK_DADDR_T,